@@ -21,6 +21,16 @@ class HybridDB {
     const MSG_BEGIN_TXN = 0x06;
     const MSG_COMMIT_TXN = 0x07;
     const MSG_ROLLBACK_TXN = 0x08;
+    const MSG_COPY_IN = 0x09;
+    const MSG_COPY_DATA = 0x0A;
+    const MSG_COPY_DONE = 0x0B;
+    const MSG_BATCH = 0x0C;
+    const MSG_DECLARE_CURSOR = 0x0D;
+    const MSG_FETCH = 0x0E;
+    const MSG_CLOSE_CURSOR = 0x0F;
+    const MSG_SET_PRIORITY = 0x14;
+    
+    const COPY_CSV = 0;
     
     public function __construct($host = 'localhost', $port = 5432) {
         $this->host = $host;
@@ -49,14 +59,22 @@ class HybridDB {
         socket_write($this->socket, $message, strlen($message));
     }
     
-    private function receiveMessage() {
-        $header = socket_read($this->socket, 5);
-        if (!$header) {
-            throw new Exception("Connection lost");
+    private function readExact($length) {
+        $data = '';
+        while (strlen($data) < $length) {
+            $chunk = socket_read($this->socket, $length - strlen($data));
+            if ($chunk === false || $chunk === '') {
+                throw new Exception("Connection lost");
+            }
+            $data .= $chunk;
         }
-        
+        return $data;
+    }
+    
+    private function receiveMessage() {
+        $header = $this->readExact(5);
         $data = unpack('Ctype/Vlength', $header);
-        $payload = socket_read($this->socket, $data['length']);
+        $payload = $data['length'] > 0 ? $this->readExact($data['length']) : '';
         
         return [
             'type' => $data['type'],
@@ -64,6 +82,16 @@ class HybridDB {
         ];
     }
     
+    private function request($type, $payload = '') {
+        $this->sendMessage($type, $payload);
+        $response = $this->receiveMessage();
+        
+        if ($response['type'] == self::MSG_ERROR) {
+            throw new Exception($response['payload']);
+        }
+        return json_decode($response['payload'], true);
+    }
+    
     // Execute SQL query - ALL PROCESSING ON C++ SERVER!
     public function query($sql) {
         $this->sendMessage(self::MSG_QUERY, $sql);
@@ -76,6 +104,35 @@ class HybridDB {
         return json_decode($response['payload'], true);
     }
     
+    // Run several statements in one round trip and one transaction
+    public function batch($statements) {
+        $payload = '';
+        foreach ($statements as $sql) {
+            $payload .= pack('V', strlen($sql)) . $sql;
+        }
+        return $this->request(self::MSG_BATCH, $payload);
+    }
+    
+    // Server-side cursors: rows are produced a page at a time on the server
+    public function declareCursor($sql) {
+        return $this->request(self::MSG_DECLARE_CURSOR, $sql)['cursor'];
+    }
+    
+    // Returns ['rows' => [...], 'done' => bool]; the server closes the cursor once done
+    public function fetch($cursor, $maxRows = 1000) {
+        return $this->request(self::MSG_FETCH, pack('VV', $cursor, $maxRows));
+    }
+    
+    public function closeCursor($cursor) {
+        $this->request(self::MSG_CLOSE_CURSOR, pack('V', $cursor));
+    }
+    
+    // Queue this connection's later requests as 'high', 'normal' or 'low' priority
+    public function setPriority($priority) {
+        $classes = ['high' => 0, 'normal' => 1, 'low' => 2];
+        return $this->request(self::MSG_SET_PRIORITY, chr($classes[$priority]));
+    }
+    
     // Transaction methods
     public function begin() {
         $this->sendMessage(self::MSG_BEGIN_TXN);
@@ -121,15 +178,69 @@ class HybridDB {
         return $this->query("CREATE TABLE $name ($cols)");
     }
     
+    // SQL literal for a PHP value
+    public static function quote($value) {
+        if ($value === null) {
+            return 'NULL';
+        }
+        if (is_bool($value)) {
+            return $value ? 'TRUE' : 'FALSE';
+        }
+        if (is_string($value)) {
+            return "'" . str_replace("'", "''", $value) . "'";
+        }
+        return (string)$value;
+    }
+    
     public function insert($table, $data) {
         $cols = implode(', ', array_keys($data));
-        $vals = implode(', ', array_map(function($v) {
-            return is_string($v) ? "'$v'" : $v;
-        }, $data));
+        $vals = implode(', ', array_map([self::class, 'quote'], $data));
         
         return $this->query("INSERT INTO $table ($cols) VALUES ($vals)");
     }
     
+    private static function csvField($value) {
+        if ($value === null) {
+            return '';
+        }
+        if (is_bool($value)) {
+            return $value ? 'true' : 'false';
+        }
+        $text = (string)$value;
+        if ($text === '' || strpbrk($text, ",\"\r\n") !== false) {
+            return '"' . str_replace('"', '""', $text) . '"';
+        }
+        return $text;
+    }
+    
+    // Bulk load rows (values in column order) through the COPY fast path
+    public function copyFrom($table, $rows, $chunkSize = 1048576) {
+        $this->sendMessage(self::MSG_COPY_IN, chr(self::COPY_CSV) . $table);
+        $response = $this->receiveMessage();
+        if ($response['type'] == self::MSG_ERROR) {
+            throw new Exception($response['payload']);
+        }
+        
+        $chunk = '';
+        foreach ($rows as $row) {
+            $chunk .= implode(',', array_map([self::class, 'csvField'], $row)) . "\n";
+            if (strlen($chunk) >= $chunkSize) {
+                $this->sendMessage(self::MSG_COPY_DATA, $chunk);
+                $chunk = '';
+            }
+        }
+        if ($chunk !== '') {
+            $this->sendMessage(self::MSG_COPY_DATA, $chunk);
+        }
+        
+        $this->sendMessage(self::MSG_COPY_DONE);
+        $response = $this->receiveMessage();
+        if ($response['type'] == self::MSG_ERROR) {
+            throw new Exception($response['payload']);
+        }
+        return json_decode($response['payload'], true);
+    }
+    
     public function select($table, $where = null) {
         $sql = "SELECT * FROM $table";
         if ($where) {
@@ -140,7 +251,7 @@ class HybridDB {
     
     public function update($table, $data, $where) {
         $set = implode(', ', array_map(function($k, $v) {
-            return "$k = " . (is_string($v) ? "'$v'" : $v);
+            return "$k = " . self::quote($v);
         }, array_keys($data), $data));
         
         return $this->query("UPDATE $table SET $set WHERE $where");
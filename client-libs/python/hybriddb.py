@@ -8,7 +8,7 @@ This only handles socket communication
 import socket
 import struct
 import json
-from typing import List, Dict, Any, Optional
+from typing import List, Dict, Any, Optional, Iterable, Sequence
 
 class HybridDB:
     MSG_CONNECT = 0x01
@@ -19,6 +19,17 @@ class HybridDB:
     MSG_BEGIN_TXN = 0x06
     MSG_COMMIT_TXN = 0x07
     MSG_ROLLBACK_TXN = 0x08
+    MSG_COPY_IN = 0x09
+    MSG_COPY_DATA = 0x0A
+    MSG_COPY_DONE = 0x0B
+    MSG_BATCH = 0x0C
+    MSG_DECLARE_CURSOR = 0x0D
+    MSG_FETCH = 0x0E
+    MSG_CLOSE_CURSOR = 0x0F
+    MSG_SET_PRIORITY = 0x14
+    
+    COPY_CSV = 0
+    PRIORITIES = {'high': 0, 'normal': 1, 'low': 2}
     
     def __init__(self, host='localhost', port=5432):
         self.host = host
@@ -37,19 +48,32 @@ class HybridDB:
     def _send_message(self, msg_type: int, payload: bytes = b''):
         """Send message to server"""
         length = len(payload)
-        message = struct.pack('!BI', msg_type, length) + payload
+        message = struct.pack('<BI', msg_type, length) + payload
         self.socket.sendall(message)
     
+    def _recv_exact(self, length: int) -> bytes:
+        data = b''
+        while len(data) < length:
+            chunk = self.socket.recv(length - len(data))
+            if not chunk:
+                raise ConnectionError("Connection lost")
+            data += chunk
+        return data
+        
     def _receive_message(self) -> tuple:
         """Receive message from server"""
-        header = self.socket.recv(5)
-        if not header:
-            raise ConnectionError("Connection lost")
-        
-        msg_type, length = struct.unpack('!BI', header)
-        payload = self.socket.recv(length)
+        header = self._recv_exact(5)
+        msg_type, length = struct.unpack('<BI', header)
+        payload = self._recv_exact(length)
         
         return msg_type, payload
+        
+    def _request(self, msg_type: int, payload: bytes = b'') -> Any:
+        self._send_message(msg_type, payload)
+        msg_type, payload = self._receive_message()
+        if msg_type == self.MSG_ERROR:
+            raise Exception(payload.decode('utf-8'))
+        return json.loads(payload.decode('utf-8'))
     
     def query(self, sql: str) -> List[Dict]:
         """Execute SQL query - ALL PROCESSING ON C++ SERVER!"""
@@ -60,6 +84,40 @@ class HybridDB:
             raise Exception(payload.decode('utf-8'))
         
         return json.loads(payload.decode('utf-8'))
+        
+    def batch(self, statements: Sequence[str]) -> List[Any]:
+        """Run several statements in one round trip and one transaction"""
+        payload = b''.join(struct.pack('<I', len(s)) + s for s in (st.encode('utf-8') for st in statements))
+        return self._request(self.MSG_BATCH, payload)
+        
+    def declare_cursor(self, sql: str) -> int:
+        """Open a server-side cursor over a SELECT"""
+        return self._request(self.MSG_DECLARE_CURSOR, sql.encode('utf-8'))['cursor']
+        
+    def fetch(self, cursor: int, max_rows: int = 1000) -> Dict:
+        """Fetch the next rows; the cursor is closed by the server once done is true"""
+        return self._request(self.MSG_FETCH, struct.pack('<II', cursor, max_rows))
+        
+    def close_cursor(self, cursor: int):
+        """Close a cursor before it is exhausted"""
+        self._request(self.MSG_CLOSE_CURSOR, struct.pack('<I', cursor))
+        
+    def set_priority(self, priority: str) -> Dict:
+        """Queue this connection's later requests as 'high', 'normal' or 'low' priority"""
+        return self._request(self.MSG_SET_PRIORITY, bytes([self.PRIORITIES[priority]]))
+        
+    def iterate(self, sql: str, page_size: int = 1000) -> Iterable[Dict]:
+        """Stream a SELECT page by page through a cursor"""
+        cursor = self.declare_cursor(sql)
+        done = False
+        try:
+            while not done:
+                page = self.fetch(cursor, page_size)
+                done = page['done']
+                yield from page['rows']
+        finally:
+            if not done:
+                self.close_cursor(cursor)
     
     def begin(self) -> bool:
         """Begin transaction"""
@@ -99,12 +157,62 @@ class HybridDB:
         cols = ', '.join(f"{k} {v}" for k, v in columns.items())
         return self.query(f"CREATE TABLE {name} ({cols})")
     
+    @staticmethod
+    def quote(value: Any) -> str:
+        """SQL literal for a Python value"""
+        if value is None:
+            return 'NULL'
+        if isinstance(value, bool):
+            return 'TRUE' if value else 'FALSE'
+        if isinstance(value, (dict, list)):
+            value = json.dumps(value)
+        if isinstance(value, str):
+            return "'" + value.replace("'", "''") + "'"
+        return str(value)
+        
     def insert(self, table: str, data: Dict[str, Any]) -> Any:
-        """Insert row"""
+        """Insert row; dict and list values are sent as JSON documents"""
         cols = ', '.join(data.keys())
-        vals = ', '.join(f"'{v}'" if isinstance(v, str) else str(v) for v in data.values())
+        vals = ', '.join(self.quote(v) for v in data.values())
         return self.query(f"INSERT INTO {table} ({cols}) VALUES ({vals})")
     
+    @staticmethod
+    def _csv_field(value: Any) -> str:
+        if value is None:
+            return ''
+        if isinstance(value, bool):
+            return 'true' if value else 'false'
+        text = str(value)
+        if text == '' or any(c in text for c in ',"\r\n'):
+            return '"' + text.replace('"', '""') + '"'
+        return text
+    
+    def copy_from(self, table: str, rows: Iterable[Sequence[Any]], chunk_size: int = 1 << 20) -> Dict:
+        """Bulk load rows (values in column order) through the COPY fast path"""
+        self._send_message(self.MSG_COPY_IN, bytes([self.COPY_CSV]) + table.encode('utf-8'))
+        msg_type, payload = self._receive_message()
+        if msg_type == self.MSG_ERROR:
+            raise Exception(payload.decode('utf-8'))
+        
+        chunk = []
+        size = 0
+        for row in rows:
+            line = ','.join(self._csv_field(v) for v in row) + '\n'
+            chunk.append(line)
+            size += len(line)
+            if size >= chunk_size:
+                self._send_message(self.MSG_COPY_DATA, ''.join(chunk).encode('utf-8'))
+                chunk = []
+                size = 0
+        if chunk:
+            self._send_message(self.MSG_COPY_DATA, ''.join(chunk).encode('utf-8'))
+        
+        self._send_message(self.MSG_COPY_DONE)
+        msg_type, payload = self._receive_message()
+        if msg_type == self.MSG_ERROR:
+            raise Exception(payload.decode('utf-8'))
+        return json.loads(payload.decode('utf-8'))
+    
     def select(self, table: str, where: Optional[str] = None) -> List[Dict]:
         """Select rows"""
         sql = f"SELECT * FROM {table}"
@@ -114,8 +222,7 @@ class HybridDB:
     
     def update(self, table: str, data: Dict[str, Any], where: str) -> Any:
         """Update rows"""
-        set_clause = ', '.join(f"{k} = '{v}'" if isinstance(v, str) else f"{k} = {v}" 
-                              for k, v in data.items())
+        set_clause = ', '.join(f"{k} = {self.quote(v)}" for k, v in data.items())
         return self.query(f"UPDATE {table} SET {set_clause} WHERE {where}")
     
     def delete(self, table: str, where: str) -> Any:
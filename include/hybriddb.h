@@ -17,10 +17,12 @@
 #endif
 
 #include <cstdint>
+#include <cstring>
 #include <string>
 #include <vector>
 #include <map>
 #include <unordered_map>
+#include <list>
 #include <memory>
 #include <functional>
 #include <mutex>
@@ -29,6 +31,8 @@
 #include <thread>
 #include <condition_variable>
 #include <queue>
+#include <deque>
+#include <chrono>
 #include <fstream>
 #include <iostream>
 
@@ -39,12 +43,55 @@
 #define MAX_CONNECTIONS 2000
 #define BUFFER_POOL_SIZE_MB 512
 #define WAL_SEGMENT_SIZE (16 * 1024 * 1024) // 16MB
+#define WAL_BUFFER_BYTES (64 * 1024)           // log buffer size that triggers a write to the segment
+#define MAX_CURSORS_PER_CONNECTION 32
+#define MAX_FETCH_ROWS 10000
+#define MAX_FRAME_BYTES (256 * 1024 * 1024)    // longest protocol message payload; a longer one drops the peer
+#define FRAME_READ_CHUNK (1024 * 1024)          // a payload's buffer grows by this much as its bytes arrive
+#define CURSOR_MEMORY_BYTES (1024 * 1024)   // result a cursor keeps in memory before it spills to a file
+#define JSON_MAX_DEPTH 512
+#define COLUMN_BLOCK_ROWS 16384     // rows per column store block
+#define PAGE_EXTENT_ALIGN 512       // compressed page extents are rounded up to this
+#define LSM_MEMTABLE_BYTES (4 * 1024 * 1024)   // memtable size that triggers a flush
+#define LSM_BACKGROUND_THREADS 2                // flush and compaction workers
+#define LSM_COMPACTION_MB_PER_SEC 64            // write budget shared by all compactions
+#define TIMESERIES_CHUNK_SECONDS 86400          // default time span of one chunk
+#define TIMESERIES_SEAL_ROWS 8192               // rows in pages that trigger a seal into chunks
+#define PAGE_BLOOM_BITS 2048                    // per-page bloom filter, WITH (BLOOM_FILTER = ON)
+#define PAGE_ZONE_MAX_STRING 64                 // longer strings leave a page's zone map unbounded
+#define FULLTEXT_BLOCK 128                      // postings per bit-packed block
+#define FULLTEXT_BUFFER_DOCS 1024               // documents buffered before a segment is frozen
+#define STATS_SAMPLE_ROWS 30000                 // ANALYZE reservoir size per table
+#define STATS_HISTOGRAM_BUCKETS 64              // equi-depth buckets per column
+#define STATS_MOST_COMMON 16                    // most common values kept per column
+#define ARENA_BLOCK_BYTES (64 * 1024)           // scratch arena block size
+#define ARENA_RETAIN_BYTES (1024 * 1024)        // scratch a connection keeps between requests
+#define REPLICATION_QUEUE_BYTES (64 * 1024 * 1024)  // committed transactions held for replicas
+#define REPLICATION_STATUS_MS 1000              // idle time before a primary reports its LSN
+#define REPLICA_STATE_MS 1000                   // longest a replica goes between saves of its state
+#define SHARD_IDLE_CONNECTIONS 8                // pooled connections a coordinator keeps per data node
+#define BACKUP_PAUSE_MS 10000                   // wait for open transactions before a backup gives up
+#define BACKUP_APPEND_PAGES 256                 // pages a restore writes per batch
+#define METRICS_HISTOGRAM_BITS 36               // histograms clamp values of 2^36 and up (69 s in nanoseconds)
+#define METRICS_SUB_BUCKET_BITS 4               // each power of two split in 16 buckets: 1/16 precision
+#define QUERY_LOG_STATEMENTS 5000               // statement shapes the query log totals
+#define ADMISSION_QUEUE_LIMIT 256               // requests waiting per priority before more are turned away
+#define ADMISSION_MEMORY_MB 256                 // memory running requests may reserve together
+#define ADMISSION_MIN_RESERVATION (64 * 1024)   // reserved by any request, however small its estimate
+#define ADMIN_REFRESH_MS 1000                   // age at which the admin stats snapshot is rebuilt
+#define ADMIN_IDLE_SECONDS 30                   // idle time before an admin keep-alive connection is closed
+#define ADMIN_MAX_CLIENTS 64                    // admin connections held at once
+#define ADMIN_MAX_REQUEST_BYTES (64 * 1024)     // longest admin HTTP request, headers and body
+#define CATALOG_FORMAT_VERSION 1                // catalog file layout; newer files are refused
 
 namespace hybriddb {
 
 // Forward declarations
 class Server;
 class StorageEngine;
+class ColumnStore;
+class LSMStore;
+class TimeSeriesStore;
 class BufferPool;
 class WALManager;
 class TransactionManager;
@@ -52,6 +99,246 @@ class QueryEngine;
 class NetworkManager;
 class AdminInterface;
 
+// ============================================================================
+// SCRATCH MEMORY
+// ============================================================================
+
+// Counts since the arena was last reset
+struct ArenaStats {
+    uint64_t allocations;
+    uint64_t bytes;             // requested
+    uint64_t blocks;            // taken from the heap
+    uint64_t reserved;          // held in blocks, including those kept by resets
+};
+
+// Bump allocator for memory that dies with a request. Allocations are never
+// freed one by one; reset() takes them all back at once and keeps blocks up
+// to ARENA_RETAIN_BYTES for the next request. Not thread-safe: each
+// connection owns one and makes it current on its own thread with an
+// ArenaScope for as long as a request runs.
+class Arena {
+private:
+    struct Block {
+        std::unique_ptr<uint8_t[]> data;
+        size_t size;
+    };
+    
+    std::vector<Block> blocks;
+    size_t filling;             // block being filled
+    size_t used;                // bytes of it handed out
+    size_t blockSize;
+    ArenaStats stats;
+    
+    static thread_local Arena* active;
+    friend class ArenaScope;
+    
+public:
+    explicit Arena(size_t blockSize = ARENA_BLOCK_BYTES);
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+    
+    void* allocate(size_t size, size_t align);
+    void reset();
+    ArenaStats getStats() const { return stats; }
+    
+    // The arena of the request running on this thread, if any
+    static Arena* current() { return active; }
+};
+
+class ArenaScope {
+private:
+    Arena* previous;
+    
+public:
+    explicit ArenaScope(Arena* arena) : previous(Arena::active) { Arena::active = arena; }
+    ~ArenaScope() { Arena::active = previous; }
+    ArenaScope(const ArenaScope&) = delete;
+    ArenaScope& operator=(const ArenaScope&) = delete;
+};
+
+// Allocates from the arena current when the container was made, or from the
+// heap outside any request. Containers using it must not outlive the request.
+template <typename T>
+class ArenaAllocator {
+public:
+    typedef T value_type;
+    Arena* arena;
+    
+    ArenaAllocator() noexcept : arena(Arena::current()) {}
+    explicit ArenaAllocator(Arena* arena) noexcept : arena(arena) {}
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) noexcept : arena(other.arena) {}
+    
+    T* allocate(size_t n) {
+        if (!arena) return std::allocator<T>().allocate(n);
+        return static_cast<T*>(arena->allocate(n * sizeof(T), alignof(T)));
+    }
+    void deallocate(T* p, size_t n) noexcept {
+        if (!arena) std::allocator<T>().deallocate(p, n);
+    }
+    
+    template <typename U>
+    bool operator==(const ArenaAllocator<U>& other) const noexcept { return arena == other.arena; }
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const noexcept { return arena != other.arena; }
+};
+
+template <typename T>
+using ScratchVector = std::vector<T, ArenaAllocator<T>>;
+
+// ============================================================================
+// METRICS
+// ============================================================================
+
+// Events counted on the hot paths, exported by the admin interface
+enum class Counter : uint8_t {
+    QUERIES_SELECT,
+    QUERIES_INSERT,
+    QUERIES_UPDATE,
+    QUERIES_DELETE,
+    QUERIES_OTHER,              // DDL, ANALYZE and views
+    QUERY_ERRORS,               // requests answered with an error
+    POOL_HITS,                  // buffer pool lookups
+    POOL_MISSES,
+    POOL_EVICTIONS,
+    WAL_RECORDS,
+    WAL_BYTES,
+    LOCK_WAITS_STORAGE,         // acquisitions that found the lock held
+    LOCK_WAITS_WAL,
+    LOCK_WAITS_TRANSACTIONS,
+    BYTES_IN,                   // protocol frames, headers included
+    BYTES_OUT,
+    COUNT
+};
+
+// Distributions, in nanoseconds unless noted
+enum class Histogram : uint8_t {
+    QUERY_PARSE,
+    QUERY_EXECUTE,
+    WAL_APPEND,                 // including the wait for the log mutex
+    WAL_FLUSH,                  // writing the log buffer out to its segment
+    GROUP_COMMIT,               // commits one log flush made durable (a count)
+    LOCK_WAIT,                  // of the acquisitions counted as lock waits
+    ADMISSION_WAIT,             // queued before admission control let a request run
+    COUNT
+};
+
+const size_t METRIC_COUNTERS = static_cast<size_t>(Counter::COUNT);
+const size_t METRIC_HISTOGRAMS = static_cast<size_t>(Histogram::COUNT);
+// Values below 2 << METRICS_SUB_BUCKET_BITS have a bucket each; above that
+// every power of two is split evenly
+const size_t HISTOGRAM_BUCKETS = (METRICS_HISTOGRAM_BITS - METRICS_SUB_BUCKET_BITS + 1) << METRICS_SUB_BUCKET_BITS;
+
+// What one thread has recorded. Only that thread writes it; a scrape reads it
+// while it does.
+struct MetricsShard {
+    std::atomic<uint64_t> counters[METRIC_COUNTERS];
+    std::atomic<uint64_t> sums[METRIC_HISTOGRAMS];
+    std::atomic<uint64_t> buckets[METRIC_HISTOGRAMS][HISTOGRAM_BUCKETS];
+};
+
+struct HistogramSnapshot {
+    uint64_t count;
+    uint64_t sum;
+    std::vector<uint64_t> buckets;
+    
+    // The value at or below which fraction q of those recorded fall, to
+    // within its bucket; 0 if none were
+    uint64_t percentile(double q) const;
+};
+
+struct MetricsSnapshot {
+    uint64_t counters[METRIC_COUNTERS];
+    HistogramSnapshot histograms[METRIC_HISTOGRAMS];
+    
+    uint64_t counter(Counter c) const { return counters[static_cast<size_t>(c)]; }
+    const HistogramSnapshot& histogram(Histogram h) const { return histograms[static_cast<size_t>(h)]; }
+};
+
+// Process-wide counters and HDR-style histograms: log-linear buckets that
+// keep every value to within 1/16 from 1 up to METRICS_HISTOGRAM_BITS.
+// Each thread records into a shard of its own with plain relaxed stores, so
+// the hot paths never lock or share a cache line; collect() sums the shards.
+// The shard of a thread that exits goes, counts and all, to the next new
+// thread, so totals never go back.
+class Metrics {
+private:
+    static thread_local MetricsShard* local;
+    static MetricsShard* attach();
+    static MetricsShard* shard() { return local ? local : attach(); }
+    
+    static void bump(std::atomic<uint64_t>& slot, uint64_t n) {
+        slot.store(slot.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+    
+public:
+    static void add(Counter counter, uint64_t n = 1) { bump(shard()->counters[static_cast<size_t>(counter)], n); }
+    static void record(Histogram histogram, uint64_t value) {
+        MetricsShard* s = shard();
+        bump(s->buckets[static_cast<size_t>(histogram)][bucketOf(value)], 1);
+        bump(s->sums[static_cast<size_t>(histogram)], value);
+    }
+    static MetricsSnapshot collect();
+    // This thread's count alone, to measure a stretch of work it runs
+    static uint64_t own(Counter counter) {
+        return local ? local->counters[static_cast<size_t>(counter)].load(std::memory_order_relaxed) : 0;
+    }
+    
+    static size_t bucketOf(uint64_t value) {
+        const uint64_t largest = (1ULL << METRICS_HISTOGRAM_BITS) - 1;
+        if (value > largest) value = largest;
+        if (value < (2ULL << METRICS_SUB_BUCKET_BITS)) return static_cast<size_t>(value);
+        unsigned exponent = 63 - __builtin_clzll(value);
+        unsigned shift = exponent - METRICS_SUB_BUCKET_BITS;
+        return (static_cast<size_t>(shift + 1) << METRICS_SUB_BUCKET_BITS) +
+               static_cast<size_t>((value >> shift) - (1ULL << METRICS_SUB_BUCKET_BITS));
+    }
+    // The largest value that falls in bucket
+    static uint64_t bucketLimit(size_t bucket);
+};
+
+// Records the nanoseconds from construction to destruction
+class LatencyTimer {
+private:
+    Histogram histogram;
+    std::chrono::steady_clock::time_point start;
+    
+public:
+    explicit LatencyTimer(Histogram histogram) : histogram(histogram), start(std::chrono::steady_clock::now()) {}
+    ~LatencyTimer() {
+        Metrics::record(histogram, std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count());
+    }
+    LatencyTimer(const LatencyTimer&) = delete;
+    LatencyTimer& operator=(const LatencyTimer&) = delete;
+};
+
+// Locks lockable (a mutex or a unique_lock), counting the acquisition as a
+// wait and timing it if the lock was held. An uncontended one costs a
+// try_lock.
+template <typename Lockable>
+void lockMetered(Lockable& lockable, Counter waits) {
+    if (lockable.try_lock()) return;
+    auto start = std::chrono::steady_clock::now();
+    lockable.lock();
+    Metrics::add(waits);
+    Metrics::record(Histogram::LOCK_WAIT, std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count());
+}
+
+// A lock_guard that takes its mutex with lockMetered
+template <typename Mutex>
+class MeteredLock {
+private:
+    Mutex& mutex;
+    
+public:
+    MeteredLock(Mutex& mutex, Counter waits) : mutex(mutex) { lockMetered(mutex, waits); }
+    ~MeteredLock() { mutex.unlock(); }
+    MeteredLock(const MeteredLock&) = delete;
+    MeteredLock& operator=(const MeteredLock&) = delete;
+};
+
 // ============================================================================
 // TYPE SYSTEM
 // ============================================================================
@@ -71,6 +358,17 @@ enum class DataType : uint8_t {
     TYPE_JSON = 11
 };
 
+inline bool isIntegerType(DataType type) {
+    return type == DataType::TYPE_INT8 || type == DataType::TYPE_INT16 ||
+           type == DataType::TYPE_INT32 || type == DataType::TYPE_INT64 ||
+           type == DataType::TYPE_TIMESTAMP;
+}
+
+inline bool isNumericType(DataType type) {
+    return isIntegerType(type) || type == DataType::TYPE_FLOAT ||
+           type == DataType::TYPE_DOUBLE || type == DataType::TYPE_BOOLEAN;
+}
+
 struct Value {
     DataType type;
     union {
@@ -88,11 +386,177 @@ struct Value {
     Value(const std::string& v);
     Value(const char* v);
     
+    // Appends the encoding to out; the returning form is for one-off uses
+    void serialize(std::vector<uint8_t>& out) const;
     std::vector<uint8_t> serialize() const;
+    size_t serializedSize() const;
     static Value deserialize(const uint8_t* data, size_t& offset);
+    // Bounds-checked; false if the encoding runs past length
+    static bool deserialize(const uint8_t* data, size_t length, size_t& offset, Value& out);
+    static Value fromText(const std::string& text, DataType type);
+    // As fromText, but false if a number or boolean is not the whole text
+    // or is out of range; out then holds what fromText would return
+    static bool parseText(const std::string& text, DataType type, Value& out);
     
     std::string toString() const;
+    bool isNull() const { return type == DataType::TYPE_NULL; }
+    int compare(const Value& other) const;
+    // Equal for values that compare equal, NaN aside: 1, 1.0 and TRUE hash alike
+    uint64_t hash() const;
     bool operator==(const Value& other) const;
+    bool operator<(const Value& other) const { return compare(other) < 0; }
+};
+
+// ----------------------------------------------------------------------------
+// Encoding
+// ----------------------------------------------------------------------------
+//
+// Encoders append to a buffer the caller owns and reuses. Fixed-width fields
+// are stored little-endian, the host order of every supported platform, and
+// lengths that are usually small as LEB128 varints. ByteReader decodes in
+// place and never reads past its span; a short buffer turns ok() false.
+
+template <typename T>
+inline void putFixed(std::vector<uint8_t>& out, T v) {
+    size_t at = out.size();
+    out.resize(at + sizeof(T));
+    memcpy(out.data() + at, &v, sizeof(T));
+}
+
+inline void putVarint(std::vector<uint8_t>& out, uint64_t v) {
+    while (v >= 0x80) {
+        out.push_back(static_cast<uint8_t>(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(v));
+}
+
+inline void putBytes(std::vector<uint8_t>& out, const void* data, size_t length) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    out.insert(out.end(), bytes, bytes + length);
+}
+
+inline size_t varintSize(uint64_t v) {
+    size_t n = 1;
+    while (v >= 0x80) {
+        v >>= 7;
+        n++;
+    }
+    return n;
+}
+
+class ByteReader {
+private:
+    const uint8_t* p;
+    const uint8_t* end;
+    bool good;
+    
+public:
+    ByteReader(const uint8_t* data, size_t length) : p(data), end(data + length), good(true) {}
+    
+    template <typename T>
+    T get() {
+        T v{};
+        if (static_cast<size_t>(end - p) < sizeof(T)) {
+            good = false;
+            return v;
+        }
+        memcpy(&v, p, sizeof(T));
+        p += sizeof(T);
+        return v;
+    }
+    
+    uint64_t varint() {
+        uint64_t v = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (p == end) break;
+            uint8_t byte = *p++;
+            v |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) return v;
+        }
+        good = false;
+        return 0;
+    }
+    
+    // The next n bytes where they lie, or nullptr if fewer are left
+    const uint8_t* take(size_t n) {
+        if (static_cast<size_t>(end - p) < n) {
+            good = false;
+            return nullptr;
+        }
+        const uint8_t* at = p;
+        p += n;
+        return at;
+    }
+    
+    std::string string(size_t n) {
+        const uint8_t* at = take(n);
+        return at ? std::string(reinterpret_cast<const char*>(at), n) : std::string();
+    }
+    
+    Value value() {
+        Value v;
+        size_t offset = 0;
+        if (!Value::deserialize(p, end - p, offset, v)) {
+            good = false;
+            return Value();
+        }
+        p += offset;
+        return v;
+    }
+    
+    const uint8_t* position() const { return p; }
+    size_t remaining() const { return end - p; }
+    size_t consumed(const uint8_t* start) const { return p - start; }
+    bool ok() const { return good; }
+};
+
+// ============================================================================
+// DOCUMENTS (binary JSON)
+// ============================================================================
+
+// TYPE_JSON values hold documents in this encoding, never JSON text:
+//   scalars:  tag [int64 | double | uint32 len + UTF-8 bytes]
+//   ARRAY:    tag, uint32 count, uint32 node size, uint32 value offset[count], values
+//   OBJECT:   tag, uint32 count, uint32 node size,
+//             (uint32 key offset, uint32 value offset)[count] sorted by key, body
+// Offsets are relative to the container node, so every sub-document can be
+// copied out as a standalone document. Keys in the body are uint16 len + bytes.
+enum class JSONTag : uint8_t {
+    NULL_VALUE = 0,
+    FALSE_VALUE = 1,
+    TRUE_VALUE = 2,
+    INT = 3,
+    DOUBLE = 4,
+    STRING = 5,
+    ARRAY = 6,
+    OBJECT = 7
+};
+
+class JSONDocument {
+public:
+    // Structural-index parser (json_parser.cpp); encodeScalar is the
+    // byte-at-a-time reference and produces identical output
+    static bool encode(const char* text, size_t length, std::vector<uint8_t>& out, std::string& error);
+    static bool encodeScalar(const char* text, size_t length, std::vector<uint8_t>& out, std::string& error);
+    static bool structuralIndex(const char* text, size_t length, std::vector<uint32_t>& positions,
+                                std::string& error);
+    static void toText(const uint8_t* node, size_t length, std::string& out);
+    static void appendWords(const uint8_t* node, size_t length, std::string& out);  // values only, no keys
+    
+    // Path segments are object keys or array indexes; returns nullptr if absent
+    static const uint8_t* find(const uint8_t* doc, size_t length,
+                               const std::vector<std::string>& path, size_t& nodeLength);
+    static bool extract(const Value& doc, const std::vector<std::string>& path, Value& out);
+    static Value toValue(const uint8_t* node, size_t length);
+    static size_t nodeSize(const uint8_t* node, size_t available);
+    
+    static std::vector<std::string> splitPath(const std::string& path);   // "a.b.0", "$.a.b"
+    static std::string joinPath(const std::vector<std::string>& path);
+    
+    static void appendInt(std::vector<uint8_t>& out, int64_t v);
+    static void appendDouble(std::vector<uint8_t>& out, double v);
+    static void appendString(std::vector<uint8_t>& out, const char* s, size_t n);
 };
 
 // ============================================================================
@@ -106,18 +570,44 @@ struct PageHeader {
     uint16_t itemCount;
     uint32_t flags;
     uint32_t checksum;
+    uint64_t lsn;           // log position of the page's last write, when the engine has a clock
 } __attribute__((packed));
 
+#define PAGE_DATA_SIZE (PAGE_SIZE - sizeof(PageHeader))
+
+// Records are packed front to back as [uint16 length][tuple bytes]
 struct Page {
     PageHeader header;
-    uint8_t data[PAGE_SIZE - sizeof(PageHeader)];
+    uint8_t data[PAGE_DATA_SIZE];
     
     Page();
     void initialize(uint32_t pageId, uint32_t tableId);
     uint32_t calculateChecksum() const;
     bool verify() const;
+    
+    bool appendRecord(const uint8_t* record, uint16_t length);
+};
+
+enum class PageCompression : uint8_t {
+    NONE = 0,
+    LZ4 = 1
+};
+
+// LZ4 block format (no frame header), so pages can be checked with the
+// reference tools. compress returns 0 when the output would not fit.
+class LZ4Codec {
+public:
+    static size_t compress(const uint8_t* src, size_t length, uint8_t* dst, size_t capacity);
+    static bool decompress(const uint8_t* src, size_t length, uint8_t* dst, size_t size);
 };
 
+// Physical tuple address: page id in the high bits, record slot in the low 16
+inline uint64_t makeTupleId(uint32_t pageId, uint16_t slot) {
+    return (static_cast<uint64_t>(pageId) << 16) | slot;
+}
+inline uint32_t tupleIdPage(uint64_t tupleId) { return static_cast<uint32_t>(tupleId >> 16); }
+inline uint16_t tupleIdSlot(uint64_t tupleId) { return static_cast<uint16_t>(tupleId & 0xFFFF); }
+
 struct Tuple {
     uint64_t rowId;
     uint64_t txnId;
@@ -125,7 +615,9 @@ struct Tuple {
     bool deleted;
     std::map<std::string, Value> columns;
     
+    void serialize(std::vector<uint8_t>& out) const;
     std::vector<uint8_t> serialize() const;
+    size_t serializedSize() const;
     static Tuple deserialize(const uint8_t* data, size_t length);
 };
 
@@ -138,45 +630,795 @@ struct ColumnDef {
     Value defaultValue;
 };
 
+// Secondary index declared with CREATE INDEX; path indexes a field inside a JSON column
+struct IndexDef {
+    std::string name;
+    std::string column;
+    std::vector<std::string> path;
+    bool unique;
+    bool fulltext = false;      // CREATE FULLTEXT INDEX, see FullTextIndex
+};
+
+enum class StorageMode : uint8_t {
+    ROW = 0,
+    COLUMN = 1,     // per-column segment files, see ColumnStore
+    LSM = 2,        // memtable and sorted runs, see LSMStore
+    TIMESERIES = 3  // time-partitioned chunks, see TimeSeriesStore
+};
+
+// WITH (CHUNK_INTERVAL = ..., RETENTION = ...) on a time-series table, in
+// seconds of its time column. A retention of 0 keeps every chunk.
+struct SeriesOptions {
+    int64_t chunkInterval = TIMESERIES_CHUNK_SECONDS;
+    int64_t retention = 0;
+};
+
+// Built by ANALYZE: the row count and, per declared column, the number of
+// distinct values (a HyperLogLog estimate over every row), plus a NULL
+// fraction, most common values and an equi-depth histogram taken from a
+// reservoir sample. The planner reads them to cost index probes and scans.
+struct ColumnStatistics {
+    std::string column;
+    double distinct = 0;
+    double nullFraction = 0;
+    std::vector<std::pair<Value, double>> mostCommon;  // value, fraction of rows; most common first
+    std::vector<Value> histogram;       // bucket bounds over the sampled non-NULL values; empty if unordered
+    
+    // Fractions of all rows, NULLs included in the denominator
+    double equalFraction(const Value& value) const;
+    double belowFraction(const Value& value, bool inclusive) const;
+};
+
+struct TableStatistics {
+    uint64_t rows = 0;
+    uint64_t sampled = 0;
+    int64_t analyzedAt = 0;             // unix seconds
+    std::vector<ColumnStatistics> columns;
+    
+    const ColumnStatistics* column(const std::string& name) const;
+    void serialize(std::vector<uint8_t>& out) const;
+    bool deserialize(const uint8_t* data, size_t length, size_t& offset);
+};
+
 struct TableSchema {
     uint32_t tableId;
     std::string tableName;
     std::vector<ColumnDef> columns;
     std::string primaryKeyColumn;
     bool isDocumentMode;
+    StorageMode storageMode = StorageMode::ROW;
+    PageCompression compression = PageCompression::NONE;
+    bool bloomFilters = false;      // per-page bloom filters on row pages
+    SeriesOptions series;
     uint64_t rowCount;
+    uint64_t nextRowId;
+    std::vector<IndexDef> indexes;
+    std::shared_ptr<const TableStatistics> statistics;     // null until ANALYZE; replaced whole
+    std::vector<std::string> shards;   // on a coordinator: host:port of the node holding each hash
+                                        // partition of the primary key, in partition order
     
-    std::vector<uint8_t> serialize() const;
-    static TableSchema deserialize(const uint8_t* data, size_t length);
+    // Catalog file entry; deserialize is bounds-checked and false if the
+    // entry is cut short or malformed
+    void serialize(std::vector<uint8_t>& out) const;
+    static bool deserialize(const uint8_t* data, size_t length, size_t& offset, TableSchema& schema);
+};
+
+// Row counts change with every write, so they live beside the immutable
+// schema, shared by every catalog version that holds the table
+struct TableCounters {
+    std::atomic<uint64_t> rowCount{0};
+    std::atomic<uint64_t> nextRowId{1};
+};
+
+// One published version of the catalog. Never modified once published; DDL
+// copies it, changes the copy and swaps it in, so readers need no lock.
+struct Catalog {
+    struct Entry {
+        std::shared_ptr<const TableSchema> schema;     // rowCount and nextRowId as of the last save
+        std::shared_ptr<TableCounters> counters;
+    };
+    
+    // A materialized view keeps only its definition; its rows are rebuilt
+    // from the table at startup
+    struct View {
+        std::string table;
+        std::string definition;     // the CREATE MATERIALIZED VIEW statement
+    };
+    
+    uint64_t version = 0;       // bumped by every change, and stored in the file
+    std::map<std::string, Entry> tables;
+    std::map<std::string, View> views;
+};
+
+// Writes bytes to path.tmp, syncs it and renames it over path, so a crash
+// leaves either the old contents or the new
+bool replaceFile(const std::string& path, const std::vector<uint8_t>& bytes, std::string& error);
+
+// ----------------------------------------------------------------------------
+// Column store
+// ----------------------------------------------------------------------------
+//
+// A column table keeps each column in its own segment file. Rows are written
+// in blocks of up to COLUMN_BLOCK_ROWS; each block stores every column as one
+// chunk in the cheapest of the encodings below, with a zone map (min/max and
+// NULL count) kept in the block directory so scans can skip whole blocks.
+// New rows land in the table's row-format pages first and are moved into a
+// block once enough committed rows have accumulated (QueryEngine::compactColumns).
+
+enum class ColumnEncoding : uint8_t {
+    PLAIN = 0,
+    RLE = 1,            // (value, run length) pairs
+    DICTIONARY = 2,     // distinct strings + bit-packed codes
+    BITPACK = 3,        // frame of reference: block minimum + fixed-width offsets
+    DELTA = 4,          // first value + bit-packed deltas from the smallest delta
+    DELTA_OF_DELTA = 5, // time-series timestamps: Gorilla delta-of-delta bit stream
+    XOR = 6             // time-series doubles: Gorilla XOR bit stream
+};
+
+// Rows stored in column segments use tuple ids with the top bit set; the
+// remaining bits are the row's ordinal within the segments.
+const uint64_t COLUMN_TUPLE_FLAG = 1ULL << 63;
+
+inline bool isColumnTupleId(uint64_t tupleId) { return (tupleId & COLUMN_TUPLE_FLAG) != 0; }
+inline uint64_t makeColumnTupleId(uint64_t ordinal) { return ordinal | COLUMN_TUPLE_FLAG; }
+inline uint64_t columnTupleOrdinal(uint64_t tupleId) { return tupleId & ~COLUMN_TUPLE_FLAG; }
+
+// One column of one block decoded into a flat array. Integer types, BOOLEAN
+// and TIMESTAMP decode into ints, FLOAT/DOUBLE into doubles and the rest into
+// values. Slots of NULL rows hold an arbitrary placeholder.
+struct ColumnVector {
+    DataType type;
+    std::vector<int64_t> ints;
+    std::vector<double> doubles;
+    std::vector<Value> values;
+    std::vector<uint8_t> nulls;     // one byte per row, empty when the block has no NULLs
+    
+    bool isNull(size_t row) const { return !nulls.empty() && nulls[row]; }
+    Value get(size_t row) const;
+};
+
+struct ZoneMap {
+    Value min;          // NULL when the chunk has no non-NULL values or is not ordered (JSON, BINARY)
+    Value max;
+    uint32_t nullCount;
+};
+
+// The cheapest encoding for one column of a block, and its inverse; shared
+// with the time-series store. The data handed to decodeColumnChunk must have
+// 16 readable bytes past length.
+ColumnEncoding encodeColumnChunk(const std::vector<const Value*>& column, DataType type,
+                                 std::vector<uint8_t>& out, ZoneMap& zone);
+bool decodeColumnChunk(const uint8_t* data, size_t length, ColumnEncoding encoding, DataType type,
+                       size_t n, ColumnVector& out);
+
+class ColumnStore {
+private:
+    struct Chunk {
+        uint64_t offset;
+        uint32_t length;
+        ColumnEncoding encoding;
+        ZoneMap zone;
+    };
+    
+    struct Block {
+        uint64_t firstRow;
+        uint32_t rowCount;
+        std::vector<Chunk> chunks;      // one per column, then the row ids
+    };
+    
+    struct Table {
+        std::string directory;
+        std::vector<ColumnDef> columns;
+        std::vector<Block> blocks;
+        std::vector<uint8_t> deleted;   // bitmap over row ordinals
+        uint64_t rowCount;
+        std::vector<std::unique_ptr<std::fstream>> segments;
+        std::fstream directoryFile;
+        std::fstream deleteFile;
+    };
+    
+    std::string dataDirectory;
+    std::map<uint32_t, std::unique_ptr<Table>> tables;      // nullptr: not a column table
+    std::mutex mutex;
+    
+    // Last block decoded for point reads, so index lookups into the same block
+    // do not decode it again
+    uint32_t cachedTable;
+    size_t cachedBlock;
+    std::vector<ColumnVector> cachedColumns;
+    
+    // Callers must hold mutex
+    std::string tableDirectory(uint32_t tableId) const;
+    Table* openTable(uint32_t tableId);
+    bool readChunk(Table& table, const Block& block, size_t column, ColumnVector& out);
+    size_t findBlock(const Table& table, uint64_t ordinal) const;
+    
+public:
+    ColumnStore(const std::string& dataDir);
+    
+    bool createTable(uint32_t tableId, const std::vector<ColumnDef>& columns);
+    bool dropTable(uint32_t tableId);
+    bool isColumnTable(uint32_t tableId);
+    
+    // Writes rows as one new block; columns a tuple lacks are stored as NULL
+    bool appendBlock(uint32_t tableId, const std::vector<Tuple>& rows, uint64_t* firstOrdinal = nullptr);
+    
+    std::vector<ColumnDef> getColumns(uint32_t tableId);
+    size_t getBlockCount(uint32_t tableId);
+    uint64_t getRowCount(uint32_t tableId);
+    std::vector<ZoneMap> getZoneMaps(uint32_t tableId, size_t block);
+    
+    // Decodes the listed columns (schema positions) of one block. deleted gets
+    // one byte per row; rowIds, if given, the rows' logical row ids.
+    bool readBlock(uint32_t tableId, size_t block, const std::vector<size_t>& columns,
+                   std::vector<ColumnVector>& out, std::vector<uint8_t>& deleted,
+                   uint64_t* firstRow = nullptr, std::vector<int64_t>* rowIds = nullptr);
+                   
+    bool readRow(uint32_t tableId, uint64_t ordinal, Tuple& tuple);
+    bool setDeleted(uint32_t tableId, uint64_t ordinal, bool deleted);
+    void sync();
+};
+
+// ----------------------------------------------------------------------------
+// LSM store
+// ----------------------------------------------------------------------------
+//
+// An LSM table takes writes into an in-memory skiplist (the memtable) and an
+// append-only log instead of rewriting pages. A full memtable is frozen and
+// written out by a background thread as a sorted run file: data blocks, a
+// bloom filter and a block index. Level 0 holds runs straight from memtables,
+// which may overlap; every deeper level is one sorted sequence of disjoint
+// runs, ten times larger than the level above. Compactions merge a level into
+// the overlapping runs of the next one on the same threads, rate limited.
+//
+// Rows are keyed by an ordinal the store assigns on insert, so new rows always
+// sort after existing ones. A delete or undelete writes a small mark entry that
+// merges into the row the next time both meet in a flush or compaction.
+
+// Rows stored in an LSM table use tuple ids with the second-highest bit set;
+// the remaining bits are the row's key.
+const uint64_t LSM_TUPLE_FLAG = 1ULL << 62;
+
+inline bool isLSMTupleId(uint64_t tupleId) {
+    return (tupleId & (COLUMN_TUPLE_FLAG | LSM_TUPLE_FLAG)) == LSM_TUPLE_FLAG;
+}
+inline uint64_t makeLSMTupleId(uint64_t key) { return key | LSM_TUPLE_FLAG; }
+inline uint64_t lsmTupleKey(uint64_t tupleId) { return tupleId & ~LSM_TUPLE_FLAG; }
+
+// Counters summed over all LSM tables
+struct LSMStats {
+    uint64_t bytesWritten;          // row and mark bytes handed to insert/setDeleted
+    uint64_t flushes;
+    uint64_t bytesFlushed;
+    uint64_t compactions;
+    uint64_t trivialMoves;          // runs moved down a level without rewriting
+    uint64_t bytesCompacted;        // written by compactions
+    uint64_t writeStalls;           // writers that waited for a flush
+    uint64_t bloomChecks;
+    uint64_t bloomSkips;            // run reads avoided by a bloom filter
+};
+
+class LSMStore {
+private:
+    struct MemTable;            // concurrent skiplist, see lsm_store.cpp
+    struct Run;                 // one sorted run file
+    class Cursor;               // merged walk over memtables and runs
+    
+    // Runs by level, level 0 oldest first. Never modified once published;
+    // flushes and compactions install a new one.
+    struct Version {
+        std::vector<std::vector<std::shared_ptr<Run>>> levels;
+    };
+    
+    struct Table {
+        uint32_t tableId;
+        std::string directory;
+        PageCompression codec;
+        std::mutex writeMutex;              // one writer at a time: key, log, memtable
+        std::ofstream log;
+        
+        std::mutex mutex;                   // guards the fields below
+        std::condition_variable changed;    // a flush or compaction finished
+        std::shared_ptr<MemTable> memtable;
+        std::deque<std::shared_ptr<MemTable>> immutables;  // oldest first
+        std::shared_ptr<const Version> version;
+        std::vector<uint64_t> compactPointers;             // per level: last key compacted
+        uint64_t nextKey;
+        uint64_t nextFile;
+        bool flushing;
+        bool compacting;
+        bool dropped;
+    };
+    
+    std::string dataDirectory;
+    std::map<uint32_t, std::shared_ptr<Table>> tables;     // nullptr: not an LSM table
+    std::mutex mutex;
+    std::mutex purgeMutex;
+    std::function<bool()> purgeCheck;
+    
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> jobs;
+    std::mutex jobMutex;
+    std::condition_variable jobReady;
+    std::condition_variable jobsDone;
+    size_t runningJobs;
+    bool stopping;
+    
+    // Token bucket over compaction writes
+    std::mutex rateMutex;
+    double rateTokens;
+    std::chrono::steady_clock::time_point rateRefill;
+    
+    std::atomic<uint64_t> bytesWritten;
+    std::atomic<uint64_t> flushes;
+    std::atomic<uint64_t> bytesFlushed;
+    std::atomic<uint64_t> compactions;
+    std::atomic<uint64_t> trivialMoves;
+    std::atomic<uint64_t> bytesCompacted;
+    std::atomic<uint64_t> writeStalls;
+    std::atomic<uint64_t> bloomChecks;
+    std::atomic<uint64_t> bloomSkips;
+    
+    std::string tableDirectory(uint32_t tableId) const;
+    std::string filePath(const Table& table, const char* prefix, uint64_t number) const;
+    std::shared_ptr<Table> openTable(uint32_t tableId);
+    bool recover(Table& table);
+    
+    int pickLevel(const Version& version) const;
+    
+    // Callers must hold Table::mutex
+    bool writeManifestLocked(Table& table, const Version& version);
+    bool openLogLocked(Table& table);
+    void scheduleLocked(const std::shared_ptr<Table>& table);
+    
+    // Callers must hold Table::writeMutex
+    bool append(const std::shared_ptr<Table>& table, uint64_t key, uint8_t flags,
+                const uint8_t* record, size_t length);
+                
+    std::shared_ptr<Run> writeRun(Table& table, const std::function<bool(uint64_t&, uint8_t&, std::vector<uint8_t>&)>& source,
+                                  uint64_t number, bool throttled);
+    void flushJob(std::shared_ptr<Table> table);
+    void compactJob(std::shared_ptr<Table> table);
+    void throttle(size_t bytes);
+    void worker();
+    
+public:
+    LSMStore(const std::string& dataDir);
+    ~LSMStore();
+    
+    bool createTable(uint32_t tableId, PageCompression codec = PageCompression::NONE);
+    bool dropTable(uint32_t tableId);
+    bool isLSMTable(uint32_t tableId);
+    
+    bool insert(uint32_t tableId, const Tuple& tuple, uint64_t* key = nullptr);
+    bool read(uint32_t tableId, uint64_t key, Tuple& tuple);
+    bool setDeleted(uint32_t tableId, uint64_t key, bool deleted);
+    
+    // Writes rows straight to a level 0 run, skipping the memtable and the log
+    bool ingest(uint32_t tableId, const std::vector<Tuple>& rows, uint64_t* firstKey = nullptr);
+    
+    // Live rows with keys in [from, limit), examining at most maxKeys keys.
+    // next is set to the key to resume from; returns false once nothing is left.
+    bool scan(uint32_t tableId, uint64_t from, uint64_t limit, size_t maxKeys,
+              std::vector<std::pair<uint64_t, Tuple>>& out, uint64_t& next);
+    uint64_t getNextKey(uint32_t tableId);
+    
+    // Deleted rows are only dropped by compactions that start while check()
+    // is true, so a rollback can still bring them back. Without a check they
+    // are kept.
+    void setPurgeCheck(std::function<bool()> check);
+    
+    // Blocks until no flush or compaction is queued or running
+    void waitIdle();
+    LSMStats getStats() const;
+    void sync();
+};
+
+// ----------------------------------------------------------------------------
+// Time-series store
+// ----------------------------------------------------------------------------
+//
+// A time-series table is cut into chunks by its time column (the first
+// TIMESTAMP column), each covering SeriesOptions::chunkInterval seconds and
+// kept in its own files. Like column tables, new rows land in the table's
+// pages first; once enough have been committed they are sealed into the
+// chunks their times fall in as segments of up to COLUMN_BLOCK_ROWS rows.
+// Within a segment timestamps are delta-of-delta coded and FLOAT/DOUBLE
+// columns XOR coded (Gorilla); other columns use the column store encodings.
+// Scans skip chunks outside the queried time range, and retention drops whole
+// chunks by removing their files.
+//
+// Sealing also folds rows into per-minute and per-hour rollups: for every
+// series (the table's STRING columns) and bucket, a row count and the count,
+// sum, minimum and maximum of each numeric column. Rollups summarize rows as
+// they arrive; deleting rows later, by DELETE or by retention, leaves them.
+
+// Rows stored in chunks use tuple ids with the third-highest bit set, the
+// chunk number in bits 32-55 and the row's ordinal within the chunk below.
+const uint64_t SERIES_TUPLE_FLAG = 1ULL << 61;
+
+inline bool isSeriesTupleId(uint64_t tupleId) {
+    return (tupleId & (COLUMN_TUPLE_FLAG | LSM_TUPLE_FLAG | SERIES_TUPLE_FLAG)) == SERIES_TUPLE_FLAG;
+}
+inline uint64_t makeSeriesTupleId(uint32_t chunk, uint32_t row) {
+    return SERIES_TUPLE_FLAG | (static_cast<uint64_t>(chunk) << 32) | row;
+}
+inline uint32_t seriesTupleChunk(uint64_t tupleId) { return static_cast<uint32_t>(tupleId >> 32) & 0xFFFFFF; }
+inline uint32_t seriesTupleRow(uint64_t tupleId) { return static_cast<uint32_t>(tupleId); }
+
+// Counters summed over all time-series tables
+struct TimeSeriesStats {
+    uint64_t chunks;
+    uint64_t chunksDropped;         // by retention
+    uint64_t rowsSealed;
+    uint64_t timestampBytes;        // delta-of-delta output for the sealed rows
+    uint64_t values;                // non-NULL FLOAT/DOUBLE values sealed
+    uint64_t valueBytes;            // XOR output for them
+    uint64_t rollupBuckets;
+};
+
+class TimeSeriesStore {
+private:
+    struct Chunk {
+        uint64_t offset;
+        uint32_t length;
+        ColumnEncoding encoding;
+        ZoneMap zone;
+    };
+    
+    struct Segment {
+        uint32_t firstRow;
+        uint32_t rowCount;
+        std::vector<Chunk> chunks;      // one per column, then the row ids
+    };
+    
+    struct Partition {
+        uint32_t id;
+        int64_t start;
+        std::vector<Segment> segments;
+        uint32_t rowCount;
+        std::vector<uint8_t> deleted;   // bitmap over row ordinals
+        std::fstream data;
+        std::fstream directoryFile;
+        std::fstream deleteFile;
+    };
+    
+    struct Stat {
+        uint64_t count;
+        double sum;
+        double min;
+        double max;
+    };
+    
+    struct Bucket {
+        uint64_t rows;
+        std::vector<Stat> stats;        // one per value column
+    };
+    
+    // Bucket start and series key (the serialized tag values)
+    typedef std::map<std::pair<int64_t, std::string>, Bucket> Rollup;
+    
+    struct Table {
+        std::string directory;
+        std::vector<ColumnDef> columns;
+        size_t timeColumn;
+        std::vector<size_t> tagColumns;         // STRING
+        std::vector<size_t> valueColumns;       // numeric, other than the time column
+        SeriesOptions options;
+        uint32_t nextChunk;
+        int64_t newest;                         // latest time sealed
+        std::map<int64_t, std::unique_ptr<Partition>> chunks;  // by start time
+        std::map<uint32_t, Partition*> chunkIds;
+        Rollup rollups[2];                      // minute, hour
+        std::ofstream rollupLog;
+    };
+    
+    std::string dataDirectory;
+    std::map<uint32_t, std::unique_ptr<Table>> tables;      // nullptr: not a time-series table
+    std::mutex mutex;
+    
+    std::atomic<uint64_t> chunksDropped;
+    std::atomic<uint64_t> rowsSealed;
+    std::atomic<uint64_t> timestampBytes;
+    std::atomic<uint64_t> values;
+    std::atomic<uint64_t> valueBytes;
+    
+    // Callers must hold mutex
+    std::string tableDirectory(uint32_t tableId) const;
+    std::string chunkPath(const Table& table, uint32_t chunk, const char* extension) const;
+    Table* openTable(uint32_t tableId);
+    bool openPartition(Table& table, uint32_t id, int64_t start, bool create);
+    bool writeManifest(Table& table);
+    bool writeSegment(Table& table, Partition& partition, const Tuple* rows, size_t count);
+    bool readChunk(Table& table, Partition& partition, const Segment& segment, size_t column, ColumnVector& out);
+    int64_t timeOf(const Table& table, const Tuple& row) const;
+    std::string seriesKey(const Table& table, const Tuple& row) const;
+    void fold(const Table& table, Rollup& rollup, int64_t bucket, const std::string& key, const Tuple& row) const;
+    bool appendRollups(Table& table, const std::vector<std::pair<int, std::pair<int64_t, std::string>>>& touched);
+    
+public:
+    TimeSeriesStore(const std::string& dataDir);
+    
+    bool createTable(uint32_t tableId, const std::vector<ColumnDef>& columns, const SeriesOptions& options);
+    bool dropTable(uint32_t tableId);
+    bool isSeriesTable(uint32_t tableId);
+    std::vector<ColumnDef> getColumns(uint32_t tableId);
+    
+    // Sorts rows by time, writes them to the chunks their times fall in and
+    // folds them into the rollups
+    bool append(uint32_t tableId, std::vector<Tuple>& rows);
+    
+    // Drops the chunks that ended more than the retention before the newest
+    // sealed row; returns the live rows they held
+    uint64_t dropExpired(uint32_t tableId);
+    
+    // Segments of the chunks overlapping [from, to] as (handle, zone maps)
+    std::vector<std::pair<uint64_t, std::vector<ZoneMap>>> findSegments(uint32_t tableId, int64_t from, int64_t to);
+    
+    // Decodes the listed columns (schema positions) of one segment; like
+    // ColumnStore::readBlock. firstTupleId is the tuple id of its first row.
+    bool readSegment(uint32_t tableId, uint64_t handle, const std::vector<size_t>& columns,
+                     std::vector<ColumnVector>& out, std::vector<uint8_t>& deleted,
+                     uint64_t* firstTupleId = nullptr, std::vector<int64_t>* rowIds = nullptr);
+                     
+    bool readRow(uint32_t tableId, uint64_t tupleId, Tuple& tuple);
+    bool setDeleted(uint32_t tableId, uint64_t tupleId, bool deleted);
+    
+    // Rollup rows of width 60 or 3600 with buckets in [from, to]: bucket, the
+    // tag columns, rows (the row count), then min_c, max_c and avg_c for each
+    // numeric column c. pending rows, not sealed yet, are folded into a copy.
+    std::vector<ColumnDef> getRollupColumns(uint32_t tableId);
+    bool readRollup(uint32_t tableId, int64_t width, int64_t from, int64_t to,
+                    const std::vector<Tuple>& pending, std::vector<Tuple>& out);
+                    
+    TimeSeriesStats getStats();
+    void sync();
+};
+
+// Counters for compressed tables, summed over all of them
+struct CompressionStats {
+    uint64_t pagesWritten;
+    uint64_t bytesIn;           // page bytes handed to the compressor
+    uint64_t bytesOut;          // bytes stored for them
+    uint64_t compressNanos;
+    uint64_t pagesRead;
+    uint64_t decompressNanos;
+};
+
+// Scan summary of one page: a zone map per column and, for tables created
+// WITH (BLOOM_FILTER = ON), a bloom filter over (column, value) pairs. It
+// grows with every record appended; deletes leave it alone, so it can only
+// overstate what the page holds.
+struct PageSummary {
+    uint32_t rows = 0;              // records appended, deleted ones included
+    
+    // Null when the column's values cannot be bounded: never seen, mixed
+    // numbers and strings, long strings, JSON or binary
+    const ZoneMap* zone(const std::string& column) const;
+    // False only when no record of the page holds column = value
+    bool mayContain(const std::string& column, const Value& value) const;
+    
+    void add(const Tuple& tuple, bool bloomFilter);
+    void serialize(std::vector<uint8_t>& out, bool bloomFilter) const;
+    bool deserialize(const uint8_t* data, size_t length, size_t& offset, bool bloomFilter);
+    
+private:
+    struct Zone {
+        ZoneMap map;
+        bool bounded;
+    };
+    std::map<std::string, Zone> zones;
+    std::vector<uint64_t> bloom;    // PAGE_BLOOM_BITS, empty without a filter
+};
+
+// Pages of filtered table walks that were read and that their summaries ruled out
+struct ScanStats {
+    uint64_t pagesRead;
+    uint64_t pagesSkipped;
 };
 
 class StorageEngine {
 private:
+    // A compressed table stores each page as a variable-size extent in its
+    // .dat file; the .map file holds one (offset, length, capacity) entry per
+    // page. A rewritten page stays in place while it fits its extent and is
+    // moved to the end of the file otherwise.
+    struct PageExtent {
+        uint64_t offset;
+        uint32_t length;        // PAGE_SIZE: stored uncompressed
+        uint32_t capacity;
+    };
+    
+    struct PageMap {
+        PageCompression codec;
+        std::fstream file;
+        std::vector<PageExtent> extents;
+        uint64_t fileEnd;
+    };
+    
     std::string dataDirectory;
     std::unique_ptr<BufferPool> bufferPool;
+    std::unique_ptr<ColumnStore> columnStore;
+    std::unique_ptr<LSMStore> lsmStore;
+    std::unique_ptr<TimeSeriesStore> seriesStore;
     std::map<uint32_t, std::fstream> tableFiles;
+    std::map<uint32_t, uint32_t> pageCounts;
+    std::map<uint32_t, std::unique_ptr<PageMap>> pageMaps;     // nullptr: uncompressed table
     std::shared_mutex mutex;
     
+    // Page summaries live in memory and are written to the table's .zmp file
+    // by sync(). Pages from the last one saved onward are summarized again
+    // from their records when the file is loaded.
+    //
+    // They also keep the LSN each page was last written at, so a backup can
+    // pass over pages it need not ship without reading them. Those are only
+    // trusted from a file saved since the last write (the flag is cleared on
+    // disk by the first one); otherwise they are unknown until a page is read.
+    struct PageSummaries {
+        bool bloomFilters;
+        bool dirty;
+        bool lsnsSaved;
+        std::vector<PageSummary> pages;
+        std::vector<uint64_t> written;      // UINT64_MAX: unknown
+    };
+    std::map<uint32_t, PageSummaries> summaries;
+    std::function<uint64_t()> lsnClock;
+    
+    // Copy-on-write view of the pages a backup copies: a page of the
+    // snapshot is saved to the spill file before its first rewrite, unless
+    // the backup has already copied it. Pages added later are not in it.
+    struct Snapshot {
+        struct Table {
+            uint32_t pages;         // at the start
+            uint32_t copied;        // pages below this were handed out
+        };
+        std::map<uint32_t, Table> tables;
+        std::unordered_map<uint64_t, uint64_t> preserved;      // table id << 32 | page id -> spill offset
+        std::string spillPath;
+        std::fstream spill;
+        uint64_t spillEnd;
+        bool failed;                // a page could not be saved
+    };
+    std::unique_ptr<Snapshot> snapshot;
+    
+    std::atomic<uint64_t> compressedPagesWritten;
+    std::atomic<uint64_t> compressBytesIn;
+    std::atomic<uint64_t> compressBytesOut;
+    std::atomic<uint64_t> compressNanos;
+    std::atomic<uint64_t> compressedPagesRead;
+    std::atomic<uint64_t> decompressNanos;
+    std::atomic<uint64_t> scanPagesRead;
+    std::atomic<uint64_t> scanPagesSkipped;
+    
+    // Callers must hold mutex exclusively
+    std::string tablePath(uint32_t tableId) const;
+    std::string mapPath(uint32_t tableId) const;
+    std::string summaryPath(uint32_t tableId) const;
+    std::fstream* openTableFile(uint32_t tableId);
+    PageMap* openPageMap(uint32_t tableId);
+    uint32_t pageCountLocked(uint32_t tableId);
+    Page* readPageLocked(uint32_t tableId, uint32_t pageId);
+    // From the file, past the buffer pool
+    bool loadPageLocked(uint32_t tableId, uint32_t pageId, Page& page);
+    bool writePageLocked(uint32_t tableId, const Page& page);
+    void preserveLocked(uint32_t tableId, uint32_t pageId);
+    void noteWrittenLocked(uint32_t tableId, PageSummaries& table, uint32_t pageId, uint64_t lsn);
+    bool writeExtentsLocked(uint32_t tableId, PageMap& map, const Page* pages, size_t count);
+    PageSummaries& openSummaries(uint32_t tableId);
+    void summarizePageLocked(PageSummaries& table, const Page& page);
+    bool saveSummariesLocked(uint32_t tableId, PageSummaries& table);
+    bool appendRecordLocked(uint32_t tableId, const Tuple& tuple, const std::vector<uint8_t>& record,
+                            uint64_t* tupleId);
+    bool setDeletedLocked(uint32_t tableId, uint64_t tupleId, bool deleted);
+    
 public:
     StorageEngine(const std::string& dataDir);
     ~StorageEngine();
     
-    bool createTable(uint32_t tableId);
+    bool createTable(uint32_t tableId, PageCompression compression = PageCompression::NONE,
+                     bool bloomFilters = false);
     bool dropTable(uint32_t tableId);
+    ColumnStore* getColumnStore() { return columnStore.get(); }
+    LSMStore* getLSMStore() { return lsmStore.get(); }
+    TimeSeriesStore* getTimeSeriesStore() { return seriesStore.get(); }
+    CompressionStats getCompressionStats() const;
+    ScanStats getScanStats() const;
+    
+    // False when the page is empty or its summary fails filter; counts the
+    // page as read or skipped
+    bool pageMayMatch(uint32_t tableId, uint32_t pageId,
+                      const std::function<bool(const PageSummary&)>& filter);
     
     Page* readPage(uint32_t tableId, uint32_t pageId);
     bool writePage(uint32_t tableId, const Page& page);
     uint32_t allocatePage(uint32_t tableId);
+    uint32_t getPageCount(uint32_t tableId);
+    bool appendPages(uint32_t tableId, std::vector<Page>& pages);
     
-    bool insertTuple(uint32_t tableId, const Tuple& tuple);
-    bool updateTuple(uint32_t tableId, uint64_t rowId, const Tuple& tuple);
-    bool deleteTuple(uint32_t tableId, uint64_t rowId);
+    bool insertTuple(uint32_t tableId, const Tuple& tuple, uint64_t* tupleId = nullptr);
+    bool readTuple(uint32_t tableId, uint64_t tupleId, Tuple& tuple);
+    bool updateTuple(uint32_t tableId, uint64_t tupleId, const Tuple& tuple, uint64_t* newTupleId = nullptr);
+    bool deleteTuple(uint32_t tableId, uint64_t tupleId, bool deleted = true);
+    bool deleteTuples(uint32_t tableId, std::vector<uint64_t> tupleIds);
     std::vector<Tuple> scanTable(uint32_t tableId);
     
+    // Tuple ids with COLUMN_TUPLE_FLAG are routed to the column store by
+    // readTuple/updateTuple/deleteTuple; updated column rows move to pages.
+    // LSM tables take every insert, and ids with LSM_TUPLE_FLAG, to the LSM store.
+    // Ids with SERIES_TUPLE_FLAG go to the time-series store like column ids.
+    
+    // Stamps each page written with the clock's value; without one pages
+    // keep the LSN they carry. The clock is read before the page is written,
+    // so one that flushes the log keeps the write-ahead rule.
+    void setLSNClock(std::function<uint64_t()> clock);
+    
+    // Online backup of the pages of tables (backup.cpp). pageCounts gets the
+    // pages of each table at the start, which snapshotPage then reads as
+    // they were then, in page order. changed is false for a page last
+    // written before since; such a page is not read if the summaries know.
+    bool beginSnapshot(const std::vector<uint32_t>& tableIds, const std::string& spillPath,
+                       std::map<uint32_t, uint32_t>& pageCounts);
+    bool snapshotPage(uint32_t tableId, uint32_t pageId, uint64_t since, Page& page, bool& changed);
+    // False if a rewritten page could not be kept for the snapshot
+    bool endSnapshot();
+    bool inSnapshot(uint32_t tableId);
+    
     void sync();
     void checkpoint();
 };
 
+// Walks a table one page at a time. Only the current page is copied, so memory
+// stays bounded no matter how large the table is or how long the walk is kept open.
+// Column tables are walked one decoded block at a time, then through their pages.
+// LSM tables are walked in key order a batch of keys at a time. Time-series
+// tables are walked one decoded segment at a time, then through their pages.
+class TableIterator {
+private:
+    StorageEngine* storage;
+    uint32_t tableId;
+    uint32_t pageCount;
+    uint32_t pageId;
+    uint16_t slot;
+    size_t offset;
+    bool loaded;
+    Page page;
+    
+    ColumnStore* columns;           // null for row tables and page-only walks
+    std::vector<ColumnDef> columnDefs;
+    size_t blockCount;
+    size_t block;
+    size_t blockRow;
+    uint64_t blockFirstRow;
+    std::vector<ColumnVector> blockData;
+    std::vector<uint8_t> blockDeleted;
+    std::vector<int64_t> blockRowIds;
+    
+    TimeSeriesStore* series;        // null unless a time-series table
+    std::vector<uint64_t> seriesSegments;
+    size_t seriesSegment;
+    uint64_t seriesFirstId;
+    
+    std::function<bool(const PageSummary&)> pageFilter;
+    
+    LSMStore* lsm;                  // null unless an LSM table
+    uint64_t lsmNext;
+    uint64_t lsmLimit;
+    bool lsmDone;
+    std::vector<std::pair<uint64_t, Tuple>> lsmRows;
+    size_t lsmRow;
+    
+    bool nextColumnRow(Tuple& tuple, uint64_t* tupleId);
+    bool nextLSMRow(Tuple& tuple, uint64_t* tupleId);
+    bool nextSeriesRow(Tuple& tuple, uint64_t* tupleId);
+    
+public:
+    TableIterator(StorageEngine* se, uint32_t tableId, bool pagesOnly = false);
+    
+    // Pages the filter rules out by their summary are never read
+    void setPageFilter(std::function<bool(const PageSummary&)> filter) { pageFilter = std::move(filter); }
+    bool next(Tuple& tuple, uint64_t* tupleId = nullptr);
+};
+
 class BufferPool {
 private:
     struct Frame {
@@ -185,6 +1427,7 @@ private:
         uint32_t pageId;
         bool dirty;
         bool pinned;
+        bool referenced;
         uint64_t lastAccess;
     };
     
@@ -192,13 +1435,19 @@ private:
     std::unordered_map<uint64_t, size_t> pageMap;
     std::mutex mutex;
     size_t capacity;
+    size_t usedFrames;
+    size_t clockHand;
     std::atomic<uint64_t> hits;
     std::atomic<uint64_t> misses;
     
+    size_t findVictim();
+    
 public:
     BufferPool(size_t sizeMB);
     
     Page* getPage(uint32_t tableId, uint32_t pageId);
+    Page* putPage(uint32_t tableId, const Page& page);
+    void updatePage(uint32_t tableId, const Page& page);
     void markDirty(uint32_t tableId, uint32_t pageId);
     void flushAll();
     double getHitRate() const;
@@ -210,105 +1459,943 @@ public:
 
 enum class WALRecordType : uint8_t {
     BEGIN_TXN = 1,
-    COMMIT_TXN = 2,
+    COMMIT_TXN = 2,     // commit time (8, microseconds since the epoch)
     ABORT_TXN = 3,
-    INSERT = 4,
-    UPDATE = 5,
-    DELETE = 6,
-    CHECKPOINT = 7
+    INSERT = 4,         // tableId + tuple
+    UPDATE = 5,         // tableId + tupleId + new tuple length + new tuple + old tuple
+    DELETE = 6,         // tableId + tupleId + old tuple
+    CHECKPOINT = 7,
+    PAGE_IMAGE = 8,     // tableId + full page, used by bulk load
+    BULK_LOAD = 9,      // tableId + first page + page count, minimally logged load
+                        // (no pages for column and LSM tables)
+    SCHEMA = 10         // tableId (created tables, else 0) + statement text; outside any transaction
+};
+
+// A record decoded in place: data points into the buffer it was read from
+struct WALRecordView {
+    WALRecordType type;
+    uint64_t lsn;
+    uint64_t txnId;
+    const uint8_t* data;
+    uint32_t length;
+};
+
+// Framed as it is in the log: lsn (8), type (1), txnId (8), length (varint), data
+struct WALRecord {
+    WALRecordType type;
+    uint64_t lsn;
+    uint64_t txnId;
+    uint32_t length;
+    std::vector<uint8_t> data;
+    
+    void serialize(std::vector<uint8_t>& out) const;
+    std::vector<uint8_t> serialize() const;
+    static void encode(std::vector<uint8_t>& out, WALRecordType type, uint64_t lsn, uint64_t txnId,
+                       const uint8_t* data, size_t length);
+    // False on a truncated frame, such as the tail of a log cut by a crash
+    static bool decode(const uint8_t* buffer, size_t size, size_t& offset, WALRecordView& view);
+    static bool deserialize(const uint8_t* buffer, size_t size, size_t& offset, WALRecord& record);
+};
+
+// A record and its whole frame as written to the log
+typedef std::function<void(const WALRecordView& record, const uint8_t* frame, size_t length)> WALVisitor;
+
+class WALManager {
+private:
+    std::string walDirectory;
+    std::ofstream currentSegment;
+    std::vector<uint8_t> buffer;    // framed records not yet written to the segment
+    std::atomic<uint64_t> currentLSN;
+    std::mutex mutex;
+    std::thread flushThread;
+    std::atomic<bool> running;
+    size_t segmentBytes;
+    WALVisitor listener;
+    std::atomic<bool> fullLogging;
+    uint64_t flushedLSN;            // records below it were in the segment at the last flush
+    uint64_t unflushedCommits;      // COMMIT records appended since
+    
+    // Archiving: finished segments are copied to archiveDirectory by the
+    // flush thread
+    std::string archiveDirectory;
+    std::string currentPath;
+    std::atomic<bool> archivePending;
+    std::atomic<uint64_t> archivedSegments;
+    std::atomic<uint64_t> archiveFailures;
+    std::mutex archiveMutex;
+    
+    // Checkpoints: once a segment is finished the flush thread syncs the data
+    // files and removes the segments they make unneeded
+    std::function<void()> syncData;
+    std::atomic<bool> checkpointPending;
+    std::atomic<bool> keepSegments;
+    std::atomic<uint64_t> removedSegments;
+    
+    void flushWorker();
+    void openNewSegment();
+    void writeBuffer();
+    
+public:
+    WALManager(const std::string& walDir);
+    ~WALManager();
+    
+    // Frames the record straight into the log buffer; returns its LSN
+    uint64_t append(WALRecordType type, uint64_t txnId, const uint8_t* data, size_t length);
+    uint64_t appendRecord(const WALRecord& record);
+    // Every record below the returned LSN is in the segment files once this returns
+    uint64_t flush();
+    // Removes the segments whose records are all below checkpointLSN. With an
+    // archive, only those copied there; without one, none while segments are
+    // kept. The segment being written stays.
+    void checkpoint(uint64_t checkpointLSN);
+    void recover();
+    
+    // Records from the segment files in log order, starting with the oldest
+    // segment kept; a record that does not decode ends its segment. Segments
+    // are named by their first LSN, so each one leads to the next. One removed
+    // by a checkpoint is read from the archive.
+    void scan(const WALVisitor& visit);
+    // The same over the segments in directory, from the one named
+    // firstSegment; stops once visit returns false
+    static void scan(const std::string& directory, uint64_t firstSegment,
+                     const std::function<bool(const WALRecordView&, const uint8_t*, size_t)>& visit);
+    // The same, reading each segment from the first of directories that has it
+    static void scan(const std::vector<std::string>& directories, uint64_t firstSegment,
+                     const std::function<bool(const WALRecordView&, const uint8_t*, size_t)>& visit);
+    static std::string segmentPath(const std::string& directory, uint64_t firstLSN);
+    // The first LSNs of the segments in directory, in order
+    static std::vector<uint64_t> listSegments(const std::string& directory);
+    // Called with every record as it is appended, under the log mutex. Null
+    // removes it.
+    void setListener(WALVisitor visitor);
+    // While set, nothing is minimally logged: loads log their rows or pages
+    // so that the log alone can rebuild them
+    void setFullLogging(bool full) { fullLogging = full; }
+    bool isFullLogging() const { return fullLogging.load(); }
+    
+    // Copies every segment but the one being written to directory, as each
+    // fills; an archived log can rebuild everything, so this also turns
+    // full logging on
+    void setArchive(const std::string& directory);
+    // Ends the current segment, if it has records, so that it is archived
+    void switchSegment();
+    // Archives finished segments now; false if one could not be copied
+    bool archiveSegments();
+    uint64_t getArchivedSegments() const { return archivedSegments.load(); }
+    uint64_t getArchiveFailures() const { return archiveFailures.load(); }
+    
+    // Called by the flush thread before each checkpoint; it must leave every
+    // change logged so far in the data files. Without it no checkpoint runs.
+    void setCheckpointSync(std::function<void()> sync);
+    // While set, checkpoints without an archive remove nothing, so that a new
+    // replica can replay the log from the beginning
+    void setKeepSegments(bool keep) { keepSegments = keep; }
+    uint64_t getRemovedSegments() const { return removedSegments.load(); }
+    
+    uint64_t getCurrentLSN() const { return currentLSN.load(); }
+};
+
+// ============================================================================
+// TRANSACTION MANAGER
+// ============================================================================
+
+enum class IsolationLevel {
+    READ_UNCOMMITTED,
+    READ_COMMITTED,
+    REPEATABLE_READ,
+    SERIALIZABLE
+};
+
+// Called with the row changes of each transaction once it commits:
+// the INSERT, UPDATE and DELETE records it logged, and bulk-load records cut
+// to their table id. Writes outside a transaction are passed on as logged.
+typedef std::function<void(uint64_t txnId, const std::vector<WALRecord>& changes)> CommitHook;
+
+// Called when a transaction first writes a table (ended false) and again
+// when that transaction commits or rolls back (ended true), on commit after
+// the commit hook. A write outside a transaction is reported both ways at
+// once.
+typedef std::function<void(uint32_t tableId, bool ended)> WriteHook;
+
+// Called by commit once the COMMIT record is logged and before it returns,
+// outside any lock; synchronous replication waits in it
+typedef std::function<void(uint64_t commitLSN)> SyncHook;
+
+class TransactionManager {
+private:
+    struct Transaction {
+        uint64_t txnId;
+        IsolationLevel isolationLevel;
+        uint64_t startLSN;
+        uint64_t commitLSN;
+        std::vector<std::function<void()>> undoLog;
+        std::vector<WALRecord> changes;     // kept only while a commit hook is set
+        std::vector<uint32_t> tables;       // written, while a write hook is set
+        bool active;
+    };
+    
+    std::map<uint64_t, Transaction> activeTxns;
+    std::atomic<uint64_t> txnCounter;
+    std::shared_mutex mutex;
+    WALManager* walManager;
+    CommitHook commitHook;
+    WriteHook writeHook;
+    SyncHook syncHook;
+    std::atomic<bool> capturing;
+    std::atomic<bool> tracking;
+    bool paused;
+    std::condition_variable_any idle;   // paused ended, or the last transaction did
+    
+    void endWrites(std::vector<uint32_t>& tables);
+    
+public:
+    TransactionManager(WALManager* wal);
+    
+    // Null removes the hook
+    void setCommitHook(CommitHook hook);
+    // Set before transactions begin; tables written by one already running
+    // are not reported
+    void setWriteHook(WriteHook hook);
+    void setSyncHook(SyncHook hook);
+    WALManager* getWAL() const { return walManager; }
+    // The id the next transaction will get
+    uint64_t nextTxnId() const { return txnCounter.load(); }
+    
+    uint64_t begin(IsolationLevel level = IsolationLevel::READ_COMMITTED);
+    bool commit(uint64_t txnId);
+    bool rollback(uint64_t txnId);
+    
+    // Holds new transactions back until resume and waits for those running
+    // to end; false, holding nothing back, if they still run after timeout
+    bool pause(std::chrono::milliseconds timeout);
+    void resume();
+    
+    bool isActive(uint64_t txnId);
+    size_t getActiveCount();
+    void addUndoAction(uint64_t txnId, std::function<void()> action);
+    uint64_t logOperation(uint64_t txnId, WALRecordType type, const std::vector<uint8_t>& data);
+};
+
+// ============================================================================
+// INDEXES
+// ============================================================================
+
+class TableIndex {
+private:
+    std::string name;
+    std::string column;
+    std::vector<std::string> path;      // JSON path within column, empty for plain columns
+    bool unique;
+    std::multimap<Value, uint64_t> entries;     // key -> tuple id
+    mutable std::shared_mutex mutex;
+    
+public:
+    TableIndex(const std::string& name, const std::string& column, bool unique,
+               const std::vector<std::string>& path = {});
+    virtual ~TableIndex() = default;
+    
+    const std::string& getName() const { return name; }
+    const std::string& getColumn() const { return column; }
+    const std::vector<std::string>& getPath() const { return path; }
+    bool isUnique() const { return unique; }
+    bool covers(const std::string& column, const std::vector<std::string>& path) const;
+    
+    // Index key for a row, or for the raw value of the indexed column
+    Value keyFor(const Tuple& tuple) const;
+    Value keyFor(const Value& columnValue) const;
+    virtual size_t size() const;
+    virtual bool isFullText() const { return false; }
+    
+    virtual bool insert(const Value& key, uint64_t tupleId);
+    virtual void remove(const Value& key, uint64_t tupleId);
+    virtual bool contains(const Value& key) const;
+    virtual std::vector<uint64_t> lookup(const Value& key) const;
+    // Keys between low and high; a NULL bound leaves that end open. NULL keys
+    // are never returned.
+    std::vector<uint64_t> lookupRange(const Value& low, bool lowInclusive, const Value& high,
+                                      bool highInclusive) const;
+    
+    // Keys are sorted here; unique indexes reject duplicates before touching entries
+    virtual bool bulkInsert(std::vector<std::pair<Value, uint64_t>>& keys, std::string& error);
+};
+
+// ----------------------------------------------------------------------------
+// Full-text indexes
+// ----------------------------------------------------------------------------
+
+struct FullTextStats {
+    uint64_t documents;         // live documents
+    uint64_t segments;
+    uint64_t terms;             // distinct terms summed over segments
+    uint64_t postings;
+    uint64_t postingBytes;      // encoded posting data, without block headers
+    uint64_t merges;
+};
+
+// Inverted index over the words of a string or JSON column. Keys passed in
+// are the column (or path) values; each becomes a document of lower-cased
+// words. New documents collect in a buffer that is frozen into an immutable
+// segment every FULLTEXT_BUFFER_DOCS documents, and segments merge like a
+// binary counter, dropping deleted documents, so a term has O(log n) posting
+// lists. Lists are cut into blocks of FULLTEXT_BLOCK postings whose doc gaps
+// and term frequencies are bit-packed in four interleaved lanes (the
+// SIMD-BP128 layout); a short last block uses varints. Each block keeps its
+// last doc and the inputs of its best BM25 score, which search() uses to
+// skip blocks that cannot reach the current top k (block-max WAND).
+class FullTextIndex : public TableIndex {
+public:
+    FullTextIndex(const std::string& name, const std::string& column, const std::vector<std::string>& path = {});
+    
+    size_t size() const override;
+    bool isFullText() const override { return true; }
+    
+    bool insert(const Value& key, uint64_t tupleId) override;
+    void remove(const Value& key, uint64_t tupleId) override;
+    bool contains(const Value&) const override { return false; }
+    std::vector<uint64_t> lookup(const Value& query) const override;    // every match, unranked
+    bool bulkInsert(std::vector<std::pair<Value, uint64_t>>& keys, std::string& error) override;
+    
+    // Tuple ids of the k best matches for any of the query's words, by BM25,
+    // best first. scored, if given, receives the number of documents scored.
+    std::vector<std::pair<uint64_t, double>> search(const std::string& query, size_t k,
+                                                    size_t* scored = nullptr) const;
+    FullTextStats getStats() const;
+    
+    // Lower-cased runs of letters and digits; bytes above 0x7f count as
+    // letters so UTF-8 words stay whole. JSON contributes its values.
+    static void tokenize(const Value& value, std::vector<std::string>& tokens);
+    
+private:
+    struct PostingBlock {
+        uint32_t lastDoc;
+        uint32_t offset;        // into PostingList::data
+        uint16_t count;
+        uint8_t docWidth;       // bits per doc gap, 0xff for a varint block
+        uint8_t tfWidth;
+        uint32_t maxTf;         // block-max bound inputs
+        uint32_t minLength;
+    };
+    struct PostingList {
+        uint32_t count = 0;
+        uint32_t firstDoc = 0;
+        uint32_t maxTf = 0;
+        uint32_t minLength = UINT32_MAX;
+        std::vector<PostingBlock> blocks;
+        std::string data;
+    };
+    struct Segment {
+        uint32_t firstDoc;
+        uint32_t lastDoc;
+        uint32_t docCount;
+        std::unordered_map<std::string, PostingList> terms;
+    };
+    using Postings = std::vector<std::pair<uint32_t, uint32_t>>;   // (doc, term frequency)
+    class Cursor;
+    
+    std::vector<Segment> segments;
+    std::unordered_map<std::string, Postings> buffer;   // documents since the last freeze
+    uint32_t bufferFirst = 1;
+    std::vector<uint64_t> docTuples;        // doc id -> tuple id; doc ids start at 1
+    std::vector<uint32_t> docLengths;
+    std::vector<bool> docDeleted;
+    std::unordered_map<uint64_t, uint32_t> tupleDocs;
+    uint64_t liveDocs = 0;
+    uint64_t liveLength = 0;
+    uint64_t merges = 0;
+    mutable std::shared_mutex mutex;
+    
+    void addDocument(const Value& key, uint64_t tupleId, bool freezeFull);
+    void freeze();
+    void encode(const Postings& postings, PostingList& list) const;
+    static void decode(const PostingList& list, Postings& postings);
+    static void decodeBlock(const PostingList& list, size_t block, uint32_t* docs, uint32_t* tfs);
+    void merge();
+};
+
+// ============================================================================
+// SQL
+// ============================================================================
+
+enum class ExprType : uint8_t {
+    LITERAL,
+    COLUMN,
+    COMPARE,
+    AND,
+    OR,
+    NOT,
+    IS_NULL,
+    LIKE,
+    MATCH       // MATCH(col, 'words'): children[0] is the column, value the query
+};
+
+enum class CompareOp : uint8_t { EQ, NE, LT, LE, GT, GE };
+
+struct Expr {
+    ExprType type;
+    CompareOp op;
+    bool negated;           // IS NOT NULL, NOT LIKE
+    Value value;            // LITERAL, LIKE pattern, MATCH query
+    std::string column;     // COLUMN
+    std::vector<std::string> path;  // COLUMN: JSON path inside the column (data.email)
+    std::vector<std::shared_ptr<Expr>> children;
+    
+    Value evaluate(const Tuple& tuple) const;
+    bool matches(const Tuple& tuple) const;
+};
+
+// A WHERE clause compiled once per scan into a tree of operators, with the
+// comparisons instantiated per operator and column type and the literals
+// bound up front. Each column is looked up once per row however often it is
+// referenced, and compared in place. Answers as Expr::matches does. Keeps
+// per-row state, so a scan uses its own.
+class CompiledPredicate {
+public:
+    struct Node {
+        virtual ~Node() = default;
+        virtual bool test(CompiledPredicate& row) const = 0;
+    };
+    
+    CompiledPredicate(const TableSchema& schema, const Expr* where);
+    CompiledPredicate(const TableSchema& schema, const std::vector<const Expr*>& conjuncts);
+    
+    bool matches(const Tuple& tuple) {
+        current = &tuple;
+        generation++;
+        return !root || root->test(*this);
+    }
+    
+    // For the operators: a column of the current row, null when it has none
+    const Value* column(size_t slot) {
+        auto& cached = slots[slot];
+        if (cached.first != generation) {
+            auto it = current->columns.find(names[slot]);
+            cached = {generation, it != current->columns.end() ? &it->second : nullptr};
+        }
+        return cached.second;
+    }
+    const Tuple& tuple() const { return *current; }
+    
+private:
+    std::unique_ptr<Node> root;
+    std::vector<std::string> names;                             // column of each slot
+    std::vector<std::pair<uint64_t, const Value*>> slots;       // row generation, value
+    const Tuple* current;
+    uint64_t generation;
+    
+    std::unique_ptr<Node> compile(const TableSchema& schema, const Expr* expr);
+    size_t slotFor(const std::string& column);
+};
+
+enum class AggregateFn : uint8_t { COUNT, SUM, AVG, MIN, MAX };
+
+struct Aggregate {
+    AggregateFn fn;
+    std::string column;     // empty for COUNT(*)
+    
+    // Result column: count, sum(amount), ...
+    std::string name() const;
+};
+
+enum class StatementType : uint8_t {
+    CREATE_TABLE,
+    DROP_TABLE,
+    CREATE_INDEX,
+    DROP_INDEX,
+    INSERT,
+    SELECT,
+    UPDATE,
+    DELETE,
+    ANALYZE,        // table empty for every table
+    CREATE_VIEW,
+    DROP_VIEW,
+    REFRESH_VIEW
+};
+
+// EXPLAIN shows the plan of a SELECT, UPDATE or DELETE; EXPLAIN ANALYZE also
+// runs the statement and measures each operator
+enum class ExplainMode : uint8_t {
+    NONE,
+    PLAN,
+    ANALYZE
+};
+
+struct Statement {
+    StatementType type;
+    ExplainMode explain = ExplainMode::NONE;
+    std::string table;
+    bool ifExists = false;                                  // IF [NOT] EXISTS
+    bool documentMode = false;
+    StorageMode storageMode = StorageMode::ROW;             // CREATE COLUMNAR TABLE
+    PageCompression compression = PageCompression::NONE;   // WITH (COMPRESSION = LZ4)
+    bool bloomFilters = false;                              // WITH (BLOOM_FILTER = ON)
+    SeriesOptions series;                                   // WITH (CHUNK_INTERVAL = ..., RETENTION = ...)
+    std::vector<ColumnDef> columnDefs;                      // CREATE TABLE
+    IndexDef index;                                         // CREATE/DROP INDEX
+    std::vector<std::string> columns;                       // INSERT/SELECT list, empty = *
+    std::vector<std::vector<Value>> rows;                   // INSERT VALUES
+    std::vector<std::pair<std::string, Value>> assignments; // UPDATE SET
+    std::shared_ptr<Expr> where;
+    std::vector<Aggregate> aggregates;                      // SELECT COUNT(*), SUM(col), ...
+    std::string orderBy;
+    bool orderDesc = false;
+    int64_t limit = -1;
+    int64_t offset = 0;
+    int64_t rollup = 0;                                     // FROM t ROLLUP MINUTE | HOUR: bucket seconds
+    std::string groupBy;
+    std::string view;                                       // CREATE/DROP/REFRESH MATERIALIZED VIEW
+    std::string definition;                                 // CREATE/DROP of tables, indexes and views: the
+                                                            // statement text
+};
+
+class SQLParser {
+public:
+    static bool parse(const std::string& sql, Statement& statement, std::string& error);
+    // The statement's tokens rejoined one space apart, keywords upper-cased
+    // and comments dropped; false if it does not tokenize
+    static bool normalize(const std::string& sql, std::string& text);
+    // normalize with each literal replaced by ?, so that statements
+    // differing only in their constants share one text
+    static bool fingerprint(const std::string& sql, std::string& text);
+};
+
+// Result JSON as the executor writes it
+void appendJSONString(std::string& out, const std::string& text);
+void appendJSONString(std::string& out, const char* text, size_t length);
+void appendJSONValue(std::string& out, const Value& v);
+// An expression written back as SQL, as a coordinator sends it on
+void appendExpr(std::string& out, const Expr& expr);
+
+// ============================================================================
+// QUERY ENGINE
+// ============================================================================
+
+enum class CopyFormat : uint8_t {
+    CSV = 0,
+    BINARY = 1      // per row: uint32 length + serialized Values in column order
+};
+
+class BulkLoader;
+class Cursor;
+class ShardRouter;
+
+// How findRows reaches the rows of a WHERE, chosen by QueryEngine::planAccess
+// as the cheapest under the table statistics: an index probed for one key or
+// a key range, the posting lists of a leading MATCH, or a scan
+struct AccessPlan {
+    TableIndex* index = nullptr;
+    bool range = false;
+    Value key;                          // equality probe
+    Value low, high;                    // range probe; NULL for an open end
+    bool lowInclusive = false;
+    bool highInclusive = false;
+    FullTextIndex* fullText = nullptr;
+    const Expr* match = nullptr;
+    double rows = 0;                    // estimated matching rows
+    double cost = 0;                    // in rows read by a scan
+};
+
+// The operators of a plan, by what each does; a plan has at most one of each
+enum class PlanStage : uint8_t {
+    SCAN,           // an index probe, a full-text search or a scan, with the WHERE
+    FILTER,         // a WHERE over rows a view, rollup or grouping produced
+    AGGREGATE,
+    SORT,
+    OUTPUT,         // OFFSET, LIMIT and encoding the result
+    MODIFY,         // UPDATE or DELETE of the rows found
+    COUNT
+};
+
+// What one operator cost, without the operators feeding it. Work done in a
+// scan's callbacks, such as folding rows into aggregates, counts as the scan.
+struct OperatorCost {
+    uint64_t calls = 0;
+    uint64_t rows = 0;                  // produced
+    uint64_t wallNanos = 0;
+    uint64_t cpuNanos = 0;              // of the thread running the query
+    uint64_t poolHits = 0;
+    uint64_t poolReads = 0;             // pages read into the buffer pool
+    uint64_t scratchBytes = 0;          // taken from the request's arena
+};
+
+class OperatorScope;
+
+// The costs of the statement EXPLAIN ANALYZE runs, made current on the
+// query's thread with a ProfileScope. Operators measure themselves with an
+// OperatorScope, which does nothing when no profile is current.
+class QueryProfile {
+private:
+    OperatorCost stages[static_cast<size_t>(PlanStage::COUNT)];
+    OperatorScope* open;                // innermost running operator
+    
+    static thread_local QueryProfile* active;
+    friend class ProfileScope;
+    friend class OperatorScope;
+    
+public:
+    QueryProfile() : open(nullptr) {}
+    
+    const OperatorCost& cost(PlanStage stage) const { return stages[static_cast<size_t>(stage)]; }
+    
+    static QueryProfile* current() { return active; }
+    // Nanoseconds of CPU time the calling thread has used
+    static uint64_t threadCPUNanos();
 };
 
-struct WALRecord {
-    WALRecordType type;
-    uint64_t lsn;
-    uint64_t txnId;
-    uint32_t length;
-    std::vector<uint8_t> data;
+class ProfileScope {
+private:
+    QueryProfile* previous;
     
-    std::vector<uint8_t> serialize() const;
-    static WALRecord deserialize(const uint8_t* data);
+public:
+    explicit ProfileScope(QueryProfile* profile) : previous(QueryProfile::active) { QueryProfile::active = profile; }
+    ~ProfileScope() { QueryProfile::active = previous; }
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
 };
 
-class WALManager {
+// Charges what runs from construction to destruction to stage, less what
+// operators opened inside it charge to theirs
+class OperatorScope {
 private:
-    std::string walDirectory;
-    std::ofstream currentSegment;
-    std::atomic<uint64_t> currentLSN;
-    std::mutex mutex;
-    std::thread flushThread;
-    std::atomic<bool> running;
+    QueryProfile* profile;
+    PlanStage stage;
+    OperatorScope* outer;
+    OperatorCost start;                 // readings at construction
+    OperatorCost inner;                 // charged to nested operators
+    uint64_t rows;
     
-    void flushWorker();
-    void openNewSegment();
+    static OperatorCost readings();
+    void begin();
+    void end();
     
 public:
-    WALManager(const std::string& walDir);
-    ~WALManager();
+    explicit OperatorScope(PlanStage stage) : profile(QueryProfile::active), stage(stage), rows(0) {
+        if (profile) begin();
+    }
+    ~OperatorScope() {
+        if (profile) end();
+    }
+    OperatorScope(const OperatorScope&) = delete;
+    OperatorScope& operator=(const OperatorScope&) = delete;
     
-    uint64_t appendRecord(const WALRecord& record);
-    void flush();
-    void checkpoint(uint64_t checkpointLSN);
-    void recover();
+    void produced(uint64_t n) { rows += n; }
+};
+
+// One operator of a plan as EXPLAIN shows it. Estimates come from the
+// planner's statistics; cost is in the rows a scan would read.
+struct PlanNode {
+    std::string op;                     // "Seq Scan", "Index Scan", "Sort", ...
+    std::string detail;
+    PlanStage stage;
+    double estimatedRows = 0;
+    double cost = 0;
+    std::vector<PlanNode> inputs;
+};
+
+struct ViewStats {
+    std::string name;
+    std::string table;
+    bool incremental;
+    uint64_t rows;
+    uint64_t changesApplied;        // source row changes folded in since the last build
+    uint64_t pendingChanges;        // committed changes only a REFRESH picks up
+    int64_t refreshedAt;            // Unix seconds of the last build
+    double refreshMillis;
+    double staleSeconds;            // age of the oldest pending change, 0 when current
+};
+
+// A single-table SELECT kept as its result: the matching rows by row id, or
+// one row of accumulators per group. Views of COUNT, SUM and AVG, and plain
+// filter views, follow the committed row changes of their table. MIN and MAX
+// cannot be taken back on a delete, and time-series retention drops rows
+// without logging them, so those views are rebuilt only by REFRESH and
+// count the changes they miss.
+class MaterializedView {
+public:
+    // Passes every source row the query's WHERE matches to its argument
+    typedef std::function<void(const std::function<void(const Tuple&)>&)> Scan;
     
-    uint64_t getCurrentLSN() const { return currentLSN.load(); }
+    MaterializedView(const std::string& name, const Statement& query, const TableSchema& source);
+    
+    const std::string& getName() const { return name; }
+    const Statement& getQuery() const { return query; }
+    const TableSchema& getSource() const { return source; }
+    // Columns of the result rows
+    const TableSchema& getShape() const { return shape; }
+    bool isIncremental() const { return incremental; }
+    
+    // A committed change to a source row: before is null for an insert,
+    // after for a delete. Changes of transactions begun before the last
+    // build are already part of it.
+    void apply(uint64_t txnId, const Tuple* before, const Tuple* after);
+    // A bulk load into the source; true when the view must be rebuilt
+    bool loaded(uint64_t txnId);
+    // nextTxn is read once the scan is done
+    void rebuild(const Scan& scan, const std::function<uint64_t()>& nextTxn);
+    void read(std::vector<Tuple>& out);
+    ViewStats getStats();
+    
+private:
+    struct Accumulator {
+        uint64_t count = 0;         // non-NULL inputs
+        uint64_t numeric = 0;       // inputs in the sums
+        uint64_t reals = 0;         // of those, not integers
+        int64_t intSum = 0;
+        double doubleSum = 0;
+        Value min;
+        Value max;
+    };
+    
+    struct Group {
+        uint64_t rows = 0;
+        std::vector<Accumulator> values;        // one per aggregate
+    };
+    
+    std::string name;
+    Statement query;
+    TableSchema source;
+    TableSchema shape;
+    bool aggregated;
+    bool incremental;
+    std::unique_ptr<CompiledPredicate> filter;
+    std::map<Value, Group> groups;
+    std::map<uint64_t, Tuple> rows;             // filter views, by row id
+    uint64_t buildTxn;
+    uint64_t changesApplied;
+    uint64_t pendingChanges;
+    std::chrono::steady_clock::time_point staleSince;
+    int64_t refreshedAt;
+    double refreshMillis;
+    std::mutex mutex;
+    
+    void add(const Tuple& tuple, int sign);
+    void pending();
 };
 
-// ============================================================================
-// TRANSACTION MANAGER
-// ============================================================================
+// ----------------------------------------------------------------------------
+// Result cache
+// ----------------------------------------------------------------------------
 
-enum class IsolationLevel {
-    READ_UNCOMMITTED,
-    READ_COMMITTED,
-    REPEATABLE_READ,
-    SERIALIZABLE
+struct ResultCacheStats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t stores;
+    uint64_t invalidations;     // entries found stale by a lookup
+    uint64_t evictions;         // to stay within the capacity
+    size_t entries;
+    size_t bytes;
+    size_t capacity;
 };
 
-class TransactionManager {
+// Encoded SELECT results keyed by the normalized statement text, evicted
+// least recently used past a byte capacity. Each entry remembers the
+// version of the table it read; a table's version moves when a transaction
+// that wrote it commits or rolls back, and on DDL. A result is only kept
+// when no transaction had uncommitted writes to its table while it ran, so
+// the cache only ever holds committed rows.
+class ResultCache {
 private:
-    struct Transaction {
-        uint64_t txnId;
-        IsolationLevel isolationLevel;
-        uint64_t startLSN;
-        uint64_t commitLSN;
-        std::vector<std::function<void()>> undoLog;
-        bool active;
+    struct Entry {
+        std::string key;
+        uint32_t tableId;
+        uint64_t version;
+        std::shared_ptr<const std::string> payload;
     };
     
-    std::map<uint64_t, Transaction> activeTxns;
-    std::atomic<uint64_t> txnCounter;
-    std::shared_mutex mutex;
-    WALManager* walManager;
+    struct Table {
+        uint64_t version = 0;
+        uint32_t writers = 0;       // open transactions that wrote it
+    };
+    
+    size_t capacity;
+    size_t bytes;
+    std::list<Entry> entries;       // most recently used first
+    std::unordered_map<std::string, std::list<Entry>::iterator> index;
+    std::unordered_map<uint32_t, Table> tables;
+    ResultCacheStats stats;
+    std::mutex mutex;
+    
+    static size_t footprint(const Entry& entry) { return entry.key.size() + entry.payload->size() + 64; }
+    void erase(std::list<Entry>::iterator it);
     
 public:
-    TransactionManager(WALManager* wal);
+    explicit ResultCache(size_t capacity);
     
-    uint64_t begin(IsolationLevel level = IsolationLevel::READ_COMMITTED);
-    bool commit(uint64_t txnId);
-    bool rollback(uint64_t txnId);
+    // key is the normalized statement
+    std::shared_ptr<const std::string> lookup(const std::string& key);
+    // The table's version for a query about to run; false while it has
+    // uncommitted writes, when the result must not be kept
+    bool snapshot(uint32_t tableId, uint64_t& version);
+    // Kept only if the table is still at the version the query started at
+    void store(const std::string& key, uint32_t tableId, uint64_t version, const std::string& payload);
     
-    void addUndoAction(uint64_t txnId, std::function<void()> action);
+    void writeBegan(uint32_t tableId);
+    void writeEnded(uint32_t tableId);
+    // Dropped tables, view DDL and refreshes
+    void invalidate(uint32_t tableId);
+    
+    ResultCacheStats getStats();
 };
 
-// ============================================================================
-// QUERY ENGINE
-// ============================================================================
+// Totals for statements of one shape
+struct StatementStats {
+    std::string query;              // fingerprint: literals replaced by ?
+    uint64_t calls;
+    uint64_t errors;
+    uint64_t rows;                  // returned or changed
+    uint64_t totalNanos;
+    uint64_t minNanos;
+    uint64_t maxNanos;
+    uint64_t poolHits;
+    uint64_t poolReads;
+};
+
+// Statements the query engine ran from SQL text, totalled per fingerprint
+// as pg_stat_statements does. Past QUERY_LOG_STATEMENTS shapes the least
+// called half are dropped. Statements that take at least the slow-query
+// threshold are also written out whole, one line each, to the slow log.
+class QueryLog {
+private:
+    std::unordered_map<std::string, StatementStats> statements;
+    uint64_t slowNanos;             // 0 while there is no slow log
+    std::ofstream slowLog;
+    uint64_t slowQueries;
+    std::mutex mutex;
+    
+public:
+    QueryLog();
+    
+    // Appends statements of at least millis to path
+    bool setSlowLog(const std::string& path, double millis);
+    void record(const std::string& sql, uint64_t nanos, uint64_t rows, bool ok, uint64_t poolHits,
+                uint64_t poolReads);
+                
+    std::vector<StatementStats> getStats();
+    uint64_t getSlowQueries();
+    void reset();
+};
 
 class QueryEngine {
 private:
     StorageEngine* storage;
     TransactionManager* txnManager;
-    std::map<std::string, TableSchema> catalog;
+    std::shared_ptr<const Catalog> catalog;     // std::atomic_load/atomic_store only
+    std::string catalogPath;                    // empty keeps the catalog in memory
+    std::string catalogError;                   // why the catalog file could not be loaded
+    std::map<uint32_t, std::vector<std::unique_ptr<TableIndex>>> indexes;
     std::atomic<uint32_t> tableIdCounter;
-    std::shared_mutex catalogMutex;
+    std::shared_mutex catalogMutex;             // held by catalog writers, and guards indexes
+    std::mutex compactMutex;
+    std::map<uint32_t, uint64_t> pagedColumnRows;  // column and time-series tables: rows inserted since
+                                                   // the last compaction or seal
+    std::map<std::string, std::shared_ptr<MaterializedView>> views;
+    std::shared_mutex viewMutex;
+    ResultCache* resultCache;
+    QueryLog* queryLog;
+    static thread_local uint64_t resultRows;    // returned or changed by the statement running on this thread
+    
+    // Replicas
+    std::atomic<bool> readOnly;
+    std::shared_mutex replayMutex;      // held by replay, shared by reads
+    std::string replicaError;           // under replayMutex; set once replication stopped
+    std::map<uint32_t, std::string> replicaTables;      // primary table id -> table name
+    std::map<uint32_t, std::unordered_map<uint64_t, uint64_t>> replicaRows;    // table id -> row id -> tuple id
+    
+    ShardRouter* shardRouter;           // set on a coordinator
+    
+    std::shared_ptr<const Catalog> currentCatalog() const { return std::atomic_load(&catalog); }
+    // Caller holds catalogMutex: swaps next in with a new version and saves it
+    void publishCatalog(std::shared_ptr<Catalog> next);
+    bool writeCatalog(const Catalog& current, std::string& error);
+    bool loadCatalog(std::string& error);
+    static TableSchema withCounters(const Catalog::Entry& entry);
+    
+    void createIndexes(const TableSchema& schema);
+    static std::unique_ptr<TableIndex> makeIndex(const IndexDef& def);
+    void compactColumns(const TableSchema& schema);
+    bool lookupTable(const std::string& name, TableSchema& schema);
+    
+    bool insertRow(const TableSchema& schema, const std::map<std::string, Value>& values,
+                   uint64_t txnId, std::string& error);
+    // Checks the unique indexes, then logs and stores a complete row
+    bool appendRow(const TableSchema& schema, const Tuple& tuple, uint64_t txnId, std::string& error,
+                   uint64_t* newTupleId = nullptr);
+    bool updateRow(const TableSchema& schema, uint64_t tupleId, const Tuple& current,
+                   const std::map<std::string, Value>& values, uint64_t txnId, std::string& error,
+                   uint64_t* updatedTupleId = nullptr);
+    bool removeRow(const TableSchema& schema, uint64_t tupleId, const Tuple& current, uint64_t txnId);
+    
+    bool executeCreate(const Statement& stmt, std::string& result, std::string& error);
+    bool executeIndex(const Statement& stmt, std::string& result, std::string& error);
+    bool executeInsert(const Statement& stmt, uint64_t txnId, std::string& result, std::string& error);
+    bool executeSQL(const std::string& sql, uint64_t txnId, std::string& result, std::string& error);
+    bool executeSelect(const Statement& stmt, std::string& result, std::string& error);
+    static bool checkAggregates(const Statement& stmt, const TableSchema& schema, std::string& error);
+    bool executeAggregate(const Statement& stmt, const TableSchema& schema, std::string& result, std::string& error);
+    bool executeRollup(const Statement& stmt, const TableSchema& schema, std::string& result, std::string& error);
+    bool executeUpdate(const Statement& stmt, uint64_t txnId, std::string& result, std::string& error);
+    bool executeDelete(const Statement& stmt, uint64_t txnId, std::string& result, std::string& error);
+    bool executeAnalyze(const Statement& stmt, std::string& result, std::string& error);
+    bool executeExplain(const Statement& stmt, uint64_t txnId, std::string& result, std::string& error);
+    bool explainPlan(const Statement& stmt, PlanNode& plan, std::string& error);
+    PlanNode explainScan(const TableSchema& schema, const Expr* where, size_t wanted);
+    bool executeView(const Statement& stmt, std::string& result, std::string& error);
+    bool readView(const Statement& stmt, MaterializedView& view, std::string& result, std::string& error);
+    std::shared_ptr<MaterializedView> lookupView(const std::string& name);
+    void rebuildView(MaterializedView& view, const TableSchema& schema);
+    // ORDER BY, aggregates and rollups: a cursor takes the SELECT path's whole result
+    static bool wholeResult(const Statement& stmt);
+    // Adds the view's definition to the catalog, or takes it out when stmt drops it
+    void saveView(const Statement& stmt);
+    // Recreates the views the loaded catalog defines
+    void loadViews();
+    void dropViews(const std::string& table);
+    // The commit hook: folds committed row changes into the views of their tables
+    void applyChanges(uint64_t txnId, const std::vector<WALRecord>& changes);
+    std::shared_ptr<TableStatistics> analyzeTable(const TableSchema& schema);
+    void logSchema(const Statement& stmt);
+    bool replaySchema(const WALRecordView& record, std::string& error);
+    bool replayRow(const WALRecordView& record, uint64_t txnId, std::string& error);
+    // Row id -> tuple id for every row of a replicated table; reload scans again
+    std::unordered_map<uint64_t, uint64_t>& replicaRowMap(const TableSchema& schema, bool reload = false);
+    bool findReplicaRow(const TableSchema& schema, uint64_t rowId, uint64_t& tupleId, Tuple& tuple);
+    bool shardedTable(const Statement& stmt, TableSchema& schema);
+    bool createSharded(const Statement& stmt, std::string& result, std::string& error);
+    bool executeSharded(const Statement& stmt, const TableSchema& schema, uint64_t txnId,
+                        std::string& result, std::string& error);
+    bool insertSharded(const Statement& stmt, const TableSchema& schema, std::string& result, std::string& error);
+    bool selectSharded(const Statement& stmt, const TableSchema& schema, std::string& result, std::string& error);
+    bool aggregateSharded(const Statement& stmt, const TableSchema& schema, std::string& result, std::string& error);
+    AccessPlan planAccess(const TableSchema& schema, const Expr* where, size_t wanted = SIZE_MAX);
+    ScratchVector<std::pair<uint64_t, Tuple>> findRows(const TableSchema& schema, const Expr* where,
+                                                       size_t wanted = SIZE_MAX);
+    bool useColumnScan(const TableSchema& schema, const Expr* where, size_t wanted = SIZE_MAX);
+    
+    // Column tables: decodes the requested columns (plus any the filter needs)
+    // of each block the zone maps cannot rule out, filters them with vector
+    // kernels and passes the surviving row positions to onBlock. Rows still in
+    // pages go to onRow. Either callback returns false to stop the scan.
+    // Time-series tables are scanned the same way, segment by segment, over
+    // the chunks a time range in the filter leaves.
+    void scanColumns(const TableSchema& schema, const Expr* where, std::vector<size_t> columns,
+                     const std::function<bool(const std::vector<ColumnVector>&, const std::vector<uint32_t>&)>& onBlock,
+                     const std::function<bool(const Tuple&)>& onRow);
     
 public:
-    QueryEngine(StorageEngine* se, TransactionManager* tm);
+    // The catalog is loaded from catalogPath and saved back to it on every
+    // change; without one it lives in memory only
+    QueryEngine(StorageEngine* se, TransactionManager* tm, const std::string& catalogPath = std::string());
+    ~QueryEngine();
     
     // DDL
-    bool createTable(const std::string& name, const std::vector<ColumnDef>& columns, bool docMode);
+    bool createTable(const std::string& name, const std::vector<ColumnDef>& columns, bool docMode,
+                     StorageMode mode = StorageMode::ROW,
+                     PageCompression compression = PageCompression::NONE,
+                     const SeriesOptions& series = SeriesOptions(), bool bloomFilters = false);
     bool dropTable(const std::string& name);
-    TableSchema* getTableSchema(const std::string& name);
+    // The version current when called; row counts as of the last save
+    std::shared_ptr<const TableSchema> getTableSchema(const std::string& name);
+    bool createIndex(const std::string& table, const IndexDef& def, std::string& error);
+    bool dropIndex(const std::string& name, std::string& error);
     
     // DML
     bool insert(const std::string& table, const std::map<std::string, Value>& values, uint64_t txnId);
@@ -316,8 +2403,177 @@ public:
     bool update(const std::string& table, uint64_t rowId, const std::map<std::string, Value>& values, uint64_t txnId);
     bool remove(const std::string& table, uint64_t rowId, uint64_t txnId);
     
-    void saveCatalog();
-    void loadCatalog();
+    // SQL; results are JSON. txnId 0 runs the statement in its own transaction.
+    // Such SELECTs also fill the result cache, when one is set.
+    bool execute(const std::string& sql, uint64_t txnId, std::string& result, std::string& error);
+    bool execute(const Statement& stmt, uint64_t txnId, std::string& result, std::string& error);
+    std::unique_ptr<Cursor> openCursor(const std::string& sql, std::string& error);
+    // False once the table is dropped, or dropped and created again
+    bool tableExists(const std::string& name, uint32_t tableId);
+    // Rough bytes a statement holds while it runs, from the plan's row
+    // estimates; never less than ADMISSION_MIN_RESERVATION
+    uint64_t estimateMemory(const std::string& sql);
+    // The same for DECLARE: a plain cursor holds at most CURSOR_MEMORY_BYTES
+    uint64_t estimateCursorMemory(const std::string& sql);
+    
+    // Bulk load
+    std::unique_ptr<BulkLoader> beginCopy(const std::string& table, CopyFormat format, uint64_t txnId);
+    uint64_t allocateRowIds(const std::string& table, uint64_t count);
+    void updateRowCount(const std::string& table, int64_t delta);
+    std::vector<TableIndex*> getIndexes(uint32_t tableId);
+    void buildIndexes(const std::string& table);
+    
+    // Time-series tables: moves committed rows out of the pages into chunks,
+    // then drops the chunks past the retention
+    void sealSeries(const TableSchema& schema);
+    
+    std::vector<ViewStats> getViewStats();
+    
+    // Null turns caching off; set before transactions begin
+    void setResultCache(ResultCache* cache);
+    ResultCache* getResultCache() const { return resultCache; }
+    // Statements run from SQL text are recorded in it; null records nothing
+    void setQueryLog(QueryLog* log) { queryLog = log; }
+    
+    // Replicas refuse client writes, and each SELECT runs between two
+    // replayed transactions, so it sees the primary as of one commit
+    void setReadOnly(bool readOnly) { this->readOnly = readOnly; }
+    bool isReadOnly() const { return readOnly.load(); }
+    // Replication has stopped for good: reads are refused from then on
+    // rather than answered from data that no longer follows the primary
+    void setReplicaError(const std::string& reason);
+    // Primary table id -> table name, which a restarted replica needs back
+    // to read the primary's row records
+    std::map<uint32_t, std::string> getReplicaTables();
+    void setReplicaTables(const std::map<uint32_t, std::string>& tables);
+    // Applies one committed transaction of the primary, given as its log
+    // frames, in a local transaction; lsn is set to that of the last frame,
+    // and schema, if given, to true when a frame changed the schema
+    bool replay(const uint8_t* frames, size_t length, uint64_t& lsn, std::string& error, bool* schema = nullptr);
+    // A restored server replays its archived log like a replica: the log
+    // names the tables it already has by their ids here
+    void adoptTables();
+    
+    // Tables stored on this server; a coordinator's sharded tables are not
+    std::vector<TableSchema> listTables();
+    
+    // A coordinator creates every table across the router's nodes and runs
+    // statements on its tables there (sharding.cpp)
+    void setShardRouter(ShardRouter* router) { shardRouter = router; }
+    ShardRouter* getShardRouter() const { return shardRouter; }
+    
+    // Set when the catalog file is damaged; the engine then starts empty
+    // and leaves the file alone
+    const std::string& getCatalogError() const { return catalogError; }
+    uint64_t getCatalogVersion() const { return currentCatalog()->version; }
+    // Writes the current version out with up to date row counts
+    bool saveCatalog();
+};
+
+// The result of a SELECT, produced whole when the cursor is declared and
+// handed out a batch at a time. Later writes do not change it. Rows are kept
+// as JSON, each after its uint32 length, in memory up to CURSOR_MEMORY_BYTES
+// and in a temporary file past that.
+class Cursor {
+private:
+    std::string table;
+    uint32_t tableId;
+    std::string rows;
+    size_t position;                // next row in rows, when nothing spilled
+    FILE* spill;                    // every row, once the result outgrew memory
+    uint64_t remaining;
+    std::string error;
+    
+    void append(const std::string& row);
+    void finish();
+    bool next(std::string& row);
+    
+public:
+    // Walks the table for a plain SELECT
+    Cursor(StorageEngine* se, const TableSchema& schema, const Statement& stmt);
+    // Takes the rows of a result the SELECT path produced whole
+    Cursor(const TableSchema& schema, const std::string& result);
+    ~Cursor();
+    Cursor(const Cursor&) = delete;
+    Cursor& operator=(const Cursor&) = delete;
+    
+    // Appends {"rows":[...],"done":bool} with at most maxRows rows
+    void fetch(size_t maxRows, std::string& json);
+    bool isExhausted() const { return remaining == 0; }
+    const std::string& getTable() const { return table; }
+    uint32_t getTableId() const { return tableId; }
+    const std::string& getError() const { return error; }
+};
+
+// Streams CSV or binary row batches straight into full pages, bypassing the
+// per-row insert path. Index keys are collected and bulk-built by sorting.
+class BulkLoader {
+private:
+    QueryEngine* queryEngine;
+    StorageEngine* storage;
+    TransactionManager* txnManager;
+    TableSchema schema;
+    CopyFormat format;
+    uint64_t txnId;
+    bool ownsTxn;
+    bool minimalLogging;
+    
+    Page currentPage;
+    std::vector<Page> pendingPages;
+    std::vector<uint32_t> writtenPages;
+    std::vector<uint16_t> writtenItems;                 // rows on each written page
+    std::vector<TableIndex*> indexes;
+    std::vector<size_t> indexColumns;
+    std::vector<std::vector<std::pair<Value, uint64_t>>> indexKeys;
+    size_t indexesLoaded;                               // indexes the keys went into
+    std::vector<size_t> encodeOrder;                    // columns in Tuple::serialize order
+    std::vector<std::vector<uint8_t>> columnHeaders;    // encoded column names
+    std::vector<uint8_t> rowBuffer;
+    
+    // Column and LSM tables skip the pages and write full column blocks or
+    // level 0 runs directly
+    bool columnar;
+    bool lsm;
+    std::vector<Tuple> columnRows;
+    std::vector<std::pair<uint64_t, uint32_t>> columnBlocks;   // first ordinal, rows
+    
+    uint64_t nextRowId;
+    uint64_t rowIdLimit;
+    uint64_t rowsLoaded;
+    uint64_t bytesLoaded;
+    
+    std::vector<std::string> csvFields;
+    std::vector<bool> csvFieldQuoted;
+    std::string csvField;
+    bool csvInQuotes;
+    bool csvAfterQuote;
+    bool csvQuoted;
+    std::vector<uint8_t> binaryCarry;
+    
+    std::string error;
+    bool failed;
+    bool finished;
+    
+    bool fail(const std::string& message);
+    bool addRow(std::vector<Value>& values);
+    bool endCSVRow();
+    bool feedCSV(const uint8_t* data, size_t length);
+    bool feedBinary(const uint8_t* data, size_t length);
+    bool flushPages();
+    bool flushColumns();
+    
+public:
+    BulkLoader(QueryEngine* qe, StorageEngine* se, TransactionManager* tm,
+               const TableSchema& schema, CopyFormat format, uint64_t txnId);
+    ~BulkLoader();
+    
+    bool feed(const uint8_t* data, size_t length);
+    bool finish();
+    void abort();
+    
+    uint64_t getRowsLoaded() const { return rowsLoaded; }
+    uint64_t getBytesLoaded() const { return bytesLoaded; }
+    const std::string& getError() const { return error; }
 };
 
 // ============================================================================
@@ -332,15 +2588,160 @@ enum class MessageType : uint8_t {
     ERROR = 0x05,
     BEGIN_TXN = 0x06,
     COMMIT_TXN = 0x07,
-    ROLLBACK_TXN = 0x08
+    ROLLBACK_TXN = 0x08,
+    COPY_IN = 0x09,     // format byte + table name; answered with RESULT or ERROR
+    COPY_DATA = 0x0A,   // raw CSV/binary chunk, no response
+    COPY_DONE = 0x0B,   // finish the load; answered with row/byte counts
+    BATCH = 0x0C,       // [uint32 length + statement]*, run in one transaction
+    DECLARE_CURSOR = 0x0D,  // SELECT text; answered with {"cursor":id}
+    FETCH = 0x0E,       // uint32 cursor id + uint32 max rows
+    CLOSE_CURSOR = 0x0F, // uint32 cursor id
+    SET_PRIORITY = 0x14, // priority byte (0 high, 1 normal, 2 low) for the connection's later requests
+    
+    // Replication port only
+    REPLICATE = 0x10,   // replica: uint64 first LSN wanted, 0 for the whole log
+    WAL_DATA = 0x11,    // primary: the log frames of one committed transaction
+    WAL_STATUS = 0x12,  // primary: uint64 next LSN of its log, sent while idle
+    WAL_ACK = 0x13      // replica: uint64 LSN of the last frame it applied
 };
 
+// Framed as type (1), payload length (4), payload
 struct Message {
     MessageType type;
     std::vector<uint8_t> payload;
     
+    void serialize(std::vector<uint8_t>& out) const;
     std::vector<uint8_t> serialize() const;
-    static Message deserialize(const uint8_t* data, size_t length);
+    static void encodeHeader(uint8_t header[5], MessageType type, uint32_t length);
+    // False until the buffer holds a whole frame; the payload is copied out
+    static bool deserialize(const uint8_t* data, size_t length, size_t& offset, Message& msg);
+};
+
+#ifdef PLATFORM_WINDOWS
+typedef SOCKET SocketHandle;
+#else
+typedef int SocketHandle;
+#endif
+
+// Blocking frame I/O on a connected socket. The header and the payload go
+// out in one gathered write; a failed read leaves msg a DISCONNECT.
+bool writeFrame(SocketHandle socket, MessageType type, const uint8_t* payload, size_t length);
+bool readFrame(SocketHandle socket, Message& msg);
+// Outbound connections of replicas and coordinators
+bool connectSocket(const std::string& host, uint16_t port, SocketHandle& socket);
+void closeSocket(SocketHandle socket);
+
+// ----------------------------------------------------------------------------
+// Admission control
+// ----------------------------------------------------------------------------
+//
+// Client requests run in a fixed number of slots, each with a reservation
+// from a shared memory budget. Requests that find no room wait in a queue
+// per priority. Freed room goes to the oldest request of the highest
+// priority, and a request that does not fit holds back all those behind
+// it. LOW requests may hold only part of the slots, so batch work cannot
+// crowd out the rest. A request is turned away at once when its queue is
+// full, and once its deadline passes while it waits.
+
+enum class Priority : uint8_t {
+    HIGH = 0,
+    NORMAL = 1,
+    LOW = 2
+};
+
+const size_t PRIORITY_CLASSES = 3;
+const char* priorityName(Priority priority);
+
+struct AdmissionConfig {
+    size_t slots = 0;                   // requests running at once; 0 turns admission control off
+    size_t lowSlots = 0;                // of those LOW requests may hold; 0 for half
+    size_t queueLimit = ADMISSION_QUEUE_LIMIT;
+    uint64_t memoryBudget = static_cast<uint64_t>(ADMISSION_MEMORY_MB) << 20;   // 0 reserves nothing
+    uint32_t timeoutMillis[PRIORITY_CLASSES] = {1000, 5000, 30000};           // by priority
+};
+
+struct AdmissionClassStats {
+    uint64_t queued;            // waiting now
+    uint64_t running;
+    uint64_t admitted;
+    uint64_t rejected;          // turned away by a full queue
+    uint64_t timedOut;          // gave up at their deadline
+    uint64_t waitNanos;         // summed over those admitted
+    uint64_t maxWaitNanos;
+};
+
+struct AdmissionStats {
+    size_t slots;
+    size_t lowSlots;
+    size_t running;
+    uint64_t memoryBudget;
+    uint64_t reserved;
+    AdmissionClassStats classes[PRIORITY_CLASSES];
+};
+
+class AdmissionController {
+private:
+    struct Waiter {
+        Priority priority;
+        uint64_t bytes;
+        bool admitted = false;
+        std::condition_variable ready;
+    };
+    
+    AdmissionConfig config;
+    std::mutex mutex;
+    std::deque<Waiter*> queues[PRIORITY_CLASSES];
+    size_t running;
+    size_t runningLow;
+    uint64_t reserved;
+    AdmissionClassStats stats[PRIORITY_CLASSES];
+    
+    bool fits(Priority priority, uint64_t bytes) const;
+    void take(Priority priority, uint64_t bytes);
+    void dispatch();
+    
+public:
+    explicit AdmissionController(const AdmissionConfig& config);
+    
+    // Blocks until the request may run with bytes reserved, or returns false
+    // with the reason in error. Requests inside a client transaction are
+    // exempt: they may hold locks that running requests wait for, so they
+    // take their share at once, past the limits if need be.
+    bool admit(Priority priority, uint64_t bytes, bool exempt, std::string& error);
+    void release(Priority priority, uint64_t bytes);
+    
+    AdmissionStats getStats();
+};
+
+// An admission, given back when the ticket goes out of scope. Without a
+// controller every request is admitted.
+class AdmissionTicket {
+private:
+    AdmissionController* controller;
+    Priority priority;
+    uint64_t bytes;
+    bool held;
+    
+public:
+    AdmissionTicket() : controller(nullptr), priority(Priority::NORMAL), bytes(0), held(false) {}
+    ~AdmissionTicket() { if (held) controller->release(priority, bytes); }
+    AdmissionTicket(const AdmissionTicket&) = delete;
+    AdmissionTicket& operator=(const AdmissionTicket&) = delete;
+    
+    bool acquire(AdmissionController* controller, Priority priority, uint64_t bytes, bool exempt,
+                 std::string& error);
+};
+
+// One client connection as the admin listing shows it
+struct ConnectionInfo {
+    uint64_t id;
+    std::string address;
+    int64_t connectedAt;        // unix seconds
+    int64_t lastRequestAt;      // unix milliseconds, 0 before the first request
+    uint64_t requests;
+    uint64_t transactionId;     // 0 outside a transaction
+    Priority priority;
+    bool busy;
 };
 
 class ClientConnection {
@@ -352,22 +2753,55 @@ private:
 #endif
     std::string clientAddr;
     uint64_t connectionId;
-    uint64_t currentTxnId;
+    std::atomic<uint64_t> currentTxnId;
     QueryEngine* queryEngine;
     TransactionManager* txnManager;
     std::atomic<bool> active;
+    std::unique_ptr<BulkLoader> activeCopy;
+    std::map<uint32_t, std::unique_ptr<Cursor>> cursors;
+    uint32_t cursorCounter;
+    NetworkManager* network;
+    Arena scratch;              // reset before each request
+    std::atomic<Priority> priority;     // of the requests admission control queues
     
+    // Read by the admin connection listing without any lock
+    int64_t connectedAt;                // unix seconds
+    std::atomic<int64_t> lastRequestAt; // unix milliseconds the latest request started
+    std::atomic<uint64_t> requests;
+    std::atomic<bool> busy;             // a request is running
+    
+    bool sendFrame(MessageType type, const uint8_t* payload, size_t length);
     bool sendMessage(const Message& msg);
+    bool sendResult(MessageType type, const std::string& payload);
     Message receiveMessage();
     void handleQuery(const std::string& query);
+    void handleCopyIn(const std::vector<uint8_t>& payload);
+    void handleCopyDone();
+    void handleBatch(const std::vector<uint8_t>& payload);
+    void handleDeclareCursor(const std::string& query);
+    void handleFetch(const std::vector<uint8_t>& payload);
+    void handleCloseCursor(const std::vector<uint8_t>& payload);
+    void handleSetPriority(const std::vector<uint8_t>& payload);
+    bool admit(AdmissionTicket& ticket, uint64_t bytes);
     
 public:
     ClientConnection(int sock, const std::string& addr, uint64_t connId,
-                    QueryEngine* qe, TransactionManager* tm);
+                    QueryEngine* qe, TransactionManager* tm, NetworkManager* nm);
     ~ClientConnection();
     
     void run();
     void stop();
+    
+    ConnectionInfo getInfo() const;
+};
+
+// Scratch arena use summed over the requests of every connection
+struct ScratchStats {
+    uint64_t requests;
+    uint64_t allocations;
+    uint64_t bytes;
+    uint64_t blocks;            // heap blocks the arenas had to take
+    uint64_t largest;           // most bytes one request used
 };
 
 class NetworkManager {
@@ -379,13 +2813,22 @@ private:
 #endif
     uint16_t port;
     std::atomic<bool> running;
-    std::vector<std::unique_ptr<ClientConnection>> connections;
-    std::vector<std::thread> threads;
+    // By id; a connection's thread holds a reference too and drops the entry
+    // when the client goes away
+    std::map<uint64_t, std::shared_ptr<ClientConnection>> connections;
     std::mutex mutex;
     std::atomic<uint64_t> connectionCounter;
+    std::atomic<uint64_t> activeConnections;
     
     QueryEngine* queryEngine;
     TransactionManager* txnManager;
+    AdmissionController* admission;
+    
+    std::atomic<uint64_t> scratchRequests;
+    std::atomic<uint64_t> scratchAllocations;
+    std::atomic<uint64_t> scratchBytes;
+    std::atomic<uint64_t> scratchBlocks;
+    std::atomic<uint64_t> scratchLargest;
     
     void acceptLoop();
     void initializeSocket();
@@ -394,16 +2837,323 @@ public:
     NetworkManager(uint16_t port, QueryEngine* qe, TransactionManager* tm);
     ~NetworkManager();
     
+    // Null admits every request; set before start
+    void setAdmission(AdmissionController* controller) { admission = controller; }
+    AdmissionController* getAdmission() const { return admission; }
+    
     bool start();
     void stop();
     
     size_t getActiveConnections() const;
+    uint64_t getTotalConnections() const;
+    std::vector<ConnectionInfo> getConnections();
+    
+    // Called by a connection after each request that used its arena
+    void recordScratch(const ArenaStats& request);
+    ScratchStats getScratchStats() const;
+};
+
+// ============================================================================
+// REPLICATION
+// ============================================================================
+
+// ASYNC commits return once logged; SYNC commits also wait for a connected
+// replica to apply them
+enum class ReplicationMode : uint8_t {
+    ASYNC = 0,
+    SYNC = 1
+};
+
+// A server either serves replicas on listenPort (0 for none) or follows the
+// primary at primaryHost:primaryPort as a read-only replica
+struct ReplicationConfig {
+    uint16_t listenPort = 0;
+    ReplicationMode mode = ReplicationMode::ASYNC;
+    std::string primaryHost;
+    uint16_t primaryPort = 0;
+};
+
+// Groups log records into committed transactions: the records of each one,
+// ending with its COMMIT record, released when that record arrives. Records
+// of rolled back transactions are dropped and SCHEMA records stand alone.
+class CommitAssembler {
+private:
+    std::unordered_map<uint64_t, std::vector<uint8_t>> open;    // txn id -> frames so far
+    
+public:
+    // True when the record completes a transaction; its frames are then in batch
+    bool add(const WALRecordView& record, const uint8_t* frame, size_t length, std::vector<uint8_t>& batch);
+};
+
+struct ReplicaStatus {
+    std::string address;
+    uint64_t sentLSN;           // commit record of the last transaction shipped
+    uint64_t appliedLSN;        // and of the last one the replica confirmed
+    uint64_t lagRecords;        // log records written since then
+    uint64_t lagMillis;         // age of the oldest transaction shipped but not confirmed
+    bool catchingUp;            // still reading the segment files
+};
+
+// Ships committed transactions to replicas over the replication port. A
+// replica first gets what it asks for from the segment files, then the
+// transactions committed since it connected, in commit order, from memory.
+class ReplicationSender {
+private:
+    struct Batch {
+        uint64_t lsn;           // of the COMMIT (or SCHEMA) record
+        std::shared_ptr<const std::vector<uint8_t>> frames;
+        std::chrono::steady_clock::time_point committed;
+    };
+    
+    struct Session {
+        SocketHandle socket;
+        std::string address;
+        uint64_t next;          // sequence number of the next live batch to send
+        uint64_t sentLSN;
+        uint64_t appliedLSN;
+        bool confirmed;         // appliedLSN is set
+        bool catchingUp;
+        std::deque<std::pair<uint64_t, std::chrono::steady_clock::time_point>> inFlight;
+        std::atomic<bool> active;
+        
+        ~Session();
+    };
+    
+    SocketHandle listenSocket;
+    uint16_t port;
+    ReplicationMode mode;
+    WALManager* wal;
+    TransactionManager* txnManager;
+    std::atomic<bool> running;
+    
+    std::mutex mutex;
+    std::condition_variable changed;
+    CommitAssembler assembler;
+    std::deque<Batch> stream;
+    uint64_t streamStart;       // sequence number of stream.front()
+    size_t streamBytes;
+    std::vector<std::shared_ptr<Session>> sessions;
+    
+    void record(const WALRecordView& record, const uint8_t* frame, size_t length);
+    void acceptLoop();
+    void serve(std::shared_ptr<Session> session);
+    void receiveAcks(std::shared_ptr<Session> session);
+    bool ship(Session& session, uint64_t lsn, const uint8_t* frames, size_t length,
+              std::chrono::steady_clock::time_point committed);
+    void trim();
+    void waitForReplica(uint64_t lsn);
+    
+public:
+    ReplicationSender(uint16_t port, ReplicationMode mode, WALManager* wal, TransactionManager* tm);
+    ~ReplicationSender();
+    
+    bool start();
+    void stop();
+    
+    ReplicationMode getMode() const { return mode; }
+    std::vector<ReplicaStatus> getStatus();
+};
+
+struct ReceiverStatus {
+    std::string primary;
+    bool connected;
+    uint64_t appliedLSN;        // last frame applied, once any is
+    uint64_t primaryLSN;        // next LSN of the primary's log, as last reported
+    uint64_t transactions;
+    uint64_t bytes;
+    std::string error;          // why replay stopped, if it did
+};
+
+// Follows a primary: connects to its replication port, asks for the log
+// after the last frame applied and replays each transaction as it arrives.
+// Reconnects after a lost connection; a transaction that fails to replay
+// stops it, since going on would diverge. The next LSN and the primary's
+// table ids are saved in statePath after every transaction, so a restarted
+// replica resumes where it stopped.
+class ReplicationReceiver {
+private:
+    std::string host;
+    uint16_t port;
+    std::string statePath;
+    QueryEngine* queryEngine;
+    std::atomic<bool> running;
+    std::thread thread;
+    SocketHandle socket;
+    std::atomic<bool> connected;
+    
+    mutable std::mutex mutex;
+    uint64_t nextLSN;
+    uint64_t primaryLSN;
+    uint64_t transactions;
+    uint64_t bytes;
+    std::string error;
+    
+    void run();
+    bool follow();
+    bool loadState(std::string& error);
+    bool saveState(uint64_t next, std::string& error);
+    // Records why replay stopped; the replica then refuses reads
+    void fail(const std::string& reason);
+    
+public:
+    ReplicationReceiver(const std::string& host, uint16_t port, const std::string& statePath, QueryEngine* qe);
+    ~ReplicationReceiver();
+    
+    void start();
+    void stop();
+    
+    ReceiverStatus getStatus() const;
+};
+
+// ============================================================================
+// SHARDING
+// ============================================================================
+
+struct ShardNodeStats {
+    std::string address;
+    uint64_t requests;
+    uint64_t failures;
+    uint64_t micros;            // spent waiting on the node
+};
+
+// A coordinator's way to its data nodes: ordinary servers, sent SQL over
+// the client protocol. Each node keeps a few idle connections for reuse.
+class ShardRouter {
+private:
+    struct Node {
+        std::string host;
+        uint16_t port;
+        std::mutex mutex;
+        std::vector<SocketHandle> idle;
+        std::atomic<uint64_t> requests;
+        std::atomic<uint64_t> failures;
+        std::atomic<uint64_t> micros;
+    };
+    
+    std::vector<std::string> configured;
+    mutable std::mutex mutex;
+    std::map<std::string, std::unique_ptr<Node>> nodes;     // by host:port
+    std::atomic<uint64_t> routed;
+    std::atomic<uint64_t> scattered;
+    
+    Node& node(const std::string& address);
+    bool request(const std::string& address, const std::string& sql, std::string& result, std::string& error);
+    
+public:
+    explicit ShardRouter(const std::vector<std::string>& addresses);
+    ~ShardRouter();
+    
+    // The nodes new tables are spread over, as given on the command line
+    const std::vector<std::string>& getNodes() const { return configured; }
+    static size_t partitionOf(const Value& key, size_t partitions);
+    
+    // One statement on one node
+    bool run(const std::string& address, const std::string& sql, std::string& result, std::string& error);
+    // Statements on several nodes at once, each given as (node, sql); the
+    // results come back in the same order. False with the first node's error.
+    bool scatter(const std::vector<std::pair<std::string, std::string>>& requests,
+                 std::vector<std::string>& results, std::string& error);
+                 
+    std::vector<ShardNodeStats> getStats() const;
+    uint64_t getRouted() const { return routed.load(); }
+    uint64_t getScattered() const { return scattered.load(); }
+};
+
+// ============================================================================
+// BACKUP
+// ============================================================================
+
+// One backup as its manifest records it
+struct BackupInfo {
+    std::string label;
+    std::string base;           // the backup an incremental one builds on; empty for a full one
+    uint64_t startLSN;          // the backup holds everything logged before this
+    uint64_t stopLSN;           // and a restore needs the archived log up to this
+    int64_t startTime;          // unix seconds
+    int64_t stopTime;
+    uint64_t pages;             // row pages it holds
+    uint64_t pagesSkipped;      // unchanged since the base, left to it
+    uint64_t files;             // column, LSM, time-series and catalog files copied
+    uint64_t bytes;
+};
+
+// Where a restore stops replaying the archived log: before the first
+// transaction committed past lsn, or later than time
+struct RestoreTarget {
+    uint64_t lsn = UINT64_MAX;
+    int64_t time = INT64_MAX;   // microseconds since the epoch
+};
+
+// Takes online backups into a directory, one subdirectory each. A full
+// backup holds every row page; an incremental one only the pages written
+// since the start of the backup it builds on. Row pages are copied while
+// writes go on, as they were when the backup started; column, LSM and
+// time-series files and the catalog are copied while new transactions
+// wait. The log is archived to <directory>/wal, so a restore can go on from
+// a backup to any later point.
+class BackupManager {
+private:
+    std::string dataDirectory;
+    std::string directory;
+    StorageEngine* storage;
+    WALManager* wal;
+    TransactionManager* txnManager;
+    QueryEngine* queryEngine;
+    std::mutex mutex;           // one backup at a time
+    std::atomic<bool> running;
+    std::atomic<uint64_t> completed;
+    std::atomic<uint64_t> failed;
+    
+    bool copyPages(const std::string& path, const std::map<uint32_t, uint32_t>& pageCounts, uint64_t since,
+                   BackupInfo& info, std::string& error);
+                   
+public:
+    BackupManager(const std::string& dataDir, const std::string& directory, StorageEngine* se,
+                  WALManager* wal, TransactionManager* tm, QueryEngine* qe);
+                  
+    // An incremental backup builds on the latest one, and is taken full
+    // when there is none
+    bool backup(bool incremental, BackupInfo& info, std::string& error);
+    // Completed backups, oldest first
+    std::vector<BackupInfo> list() const;
+    const std::string& getDirectory() const { return directory; }
+    bool isRunning() const { return running.load(); }
+    uint64_t getCompleted() const { return completed.load(); }
+    uint64_t getFailed() const { return failed.load(); }
+    
+    // Lays out the backup at path, with those it builds on, as the data
+    // directory dataDir, which must not hold tables yet; false if the
+    // backup is past target
+    static bool restore(const std::string& path, const std::string& dataDir, const RestoreTarget& target,
+                        BackupInfo& info, std::string& error);
+    // Replays archived transactions from lsn fromLSN up to target into a
+    // restored server; lsn is set to the last record applied
+    static bool replayArchive(const std::string& archiveDir, uint64_t fromLSN, const RestoreTarget& target,
+                              QueryEngine* queryEngine, uint64_t& transactions, uint64_t& lsn,
+                              std::string& error);
 };
 
 // ============================================================================
 // ADMIN INTERFACE (C++ web server)
 // ============================================================================
 
+// What the admin GET endpoints serve, built in one go off the request path.
+// Never modified once published; a refresh publishes a new one.
+struct AdminSnapshot {
+    std::string stats;
+    std::string metrics;
+    std::string connections;
+    std::string tables;
+    std::string views;
+    std::string queries;
+    std::string backups;
+    std::chrono::steady_clock::time_point builtAt;
+};
+
+// One thread serves every admin connection from a poll loop, keeping
+// HTTP/1.1 connections open between requests. Handlers run on that thread
+// too, so they take no engine lock: GETs answer from the snapshot and a
+// backup runs on a thread of its own.
 class AdminInterface {
 private:
 #ifdef PLATFORM_WINDOWS
@@ -414,10 +3164,28 @@ private:
     uint16_t port;
     std::atomic<bool> running;
     Server* server;
+    std::thread loop;
+    std::thread refresher;      // rebuilds the snapshot off the event loop
+    std::mutex refreshMutex;
+    std::condition_variable refreshWake;                // stop() cuts the wait short
+    std::shared_ptr<const AdminSnapshot> snapshot;     // std::atomic_load/atomic_store only
     
-    void handleHTTPRequest(int clientSocket);
+    struct HTTPClient;
+    
+    void eventLoop();
+    void refreshLoop();
+    void refreshSnapshot();
+    // False until a whole request is buffered. A request that takes the
+    // socket to a thread of its own sets handedOff.
+    bool handleHTTPRequest(HTTPClient& client, bool& handedOff);
+    std::string route(const std::string& method, const std::string& target, bool keepAlive,
+                      SocketHandle clientSocket, bool& handedOff);
     std::string generateStatsJSON();
+    std::string generateMetricsText();
     std::string generateTablesJSON();
+    std::string generateViewsJSON();
+    std::string generateQueriesJSON();
+    std::string generateBackupsJSON();
     std::string generateConnectionsJSON();
     
 public:
@@ -426,6 +3194,9 @@ public:
     
     bool start();
     void stop();
+    
+    // The latest published snapshot; any thread may hold on to it
+    std::shared_ptr<const AdminSnapshot> getSnapshot() const { return std::atomic_load(&snapshot); }
 };
 
 // ============================================================================
@@ -441,17 +3212,29 @@ private:
     std::unique_ptr<StorageEngine> storage;
     std::unique_ptr<WALManager> wal;
     std::unique_ptr<TransactionManager> txnManager;
+    std::unique_ptr<ResultCache> resultCache;
+    std::unique_ptr<QueryLog> queryLog;
+    std::unique_ptr<AdmissionController> admission;
+    std::unique_ptr<ShardRouter> shardRouter;
     std::unique_ptr<QueryEngine> queryEngine;
     std::unique_ptr<NetworkManager> network;
+    std::unique_ptr<ReplicationSender> replicationSender;
+    std::unique_ptr<ReplicationReceiver> replicationReceiver;
+    std::unique_ptr<BackupManager> backups;
     std::unique_ptr<AdminInterface> admin;
     
     std::atomic<bool> running;
-    std::atomic<uint64_t> totalQueries;
-    std::atomic<uint64_t> totalConnections;
     std::chrono::system_clock::time_point startTime;
     
 public:
-    Server(const std::string& dataDir, uint16_t dbPort, uint16_t adminPort);
+    // resultCacheBytes of 0 leaves the result cache off; shardNodes make the
+    // server a coordinator over those nodes; backupDir turns on backups and
+    // log archiving into it; admission.slots of 0 admits every request
+    Server(const std::string& dataDir, uint16_t dbPort, uint16_t adminPort, size_t resultCacheBytes = 0,
+           const ReplicationConfig& replication = ReplicationConfig(),
+           const std::vector<std::string>& shardNodes = std::vector<std::string>(),
+           const std::string& backupDir = std::string(),
+           const AdmissionConfig& admission = AdmissionConfig());
     ~Server();
     
     bool start();
@@ -464,10 +3247,10 @@ public:
         uint64_t totalConnections;
         uint64_t activeConnections;
         uint64_t uptime;
-        double cacheHitRate;
+        double cacheHitRate;        // buffer pool
         size_t tableCount;
         uint64_t totalRows;
-        uint64_t walSize;
+        uint64_t walSize;           // bytes of log segments on disk
     };
     
     Stats getStats() const;
@@ -475,6 +3258,14 @@ public:
     StorageEngine* getStorage() { return storage.get(); }
     QueryEngine* getQueryEngine() { return queryEngine.get(); }
     TransactionManager* getTxnManager() { return txnManager.get(); }
+    NetworkManager* getNetwork() { return network.get(); }
+    WALManager* getWAL() { return wal.get(); }
+    ReplicationSender* getReplicationSender() { return replicationSender.get(); }
+    ReplicationReceiver* getReplicationReceiver() { return replicationReceiver.get(); }
+    ShardRouter* getShardRouter() { return shardRouter.get(); }
+    BackupManager* getBackups() { return backups.get(); }
+    QueryLog* getQueryLog() { return queryLog.get(); }
+    AdmissionController* getAdmission() { return admission.get(); }
 };
 
 } // namespace hybriddb
@@ -0,0 +1,630 @@
+#include "../include/hybriddb.h"
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <cstdio>
+#include <cmath>
+#include <algorithm>
+#include <string_view>
+
+namespace hybriddb {
+
+// ============================================================================
+// BINARY JSON DOCUMENTS
+// ============================================================================
+
+namespace {
+
+inline uint32_t readU32(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint16_t readU16(const uint8_t* p) {
+    uint16_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline void writeU32(std::vector<uint8_t>& out, size_t at, uint32_t v) {
+    memcpy(out.data() + at, &v, sizeof(v));
+}
+
+inline void appendU32(std::vector<uint8_t>& out, uint32_t v) {
+    uint8_t bytes[4];
+    memcpy(bytes, &v, sizeof(v));
+    out.insert(out.end(), bytes, bytes + 4);
+}
+
+// Text -> binary encoder. Containers are written body first; their offset
+// table is spliced in once the member count is known.
+class Encoder {
+private:
+    const char* text;
+    size_t length;
+    size_t pos;
+    std::vector<uint8_t>& out;
+    std::string& error;
+    int depth;
+    
+    bool fail(const std::string& message) {
+        if (error.empty()) error = message + " at offset " + std::to_string(pos);
+        return false;
+    }
+    
+    void skipSpace() {
+        while (pos < length && (text[pos] == ' ' || text[pos] == '\t' || text[pos] == '\n' || text[pos] == '\r')) pos++;
+    }
+    
+    bool literal(const char* word, JSONTag tag) {
+        size_t n = strlen(word);
+        if (length - pos < n || memcmp(text + pos, word, n) != 0) return fail("invalid literal");
+        pos += n;
+        out.push_back(static_cast<uint8_t>(tag));
+        return true;
+    }
+    
+    static void appendUTF8(std::string& s, uint32_t cp) {
+        if (cp < 0x80) {
+            s += static_cast<char>(cp);
+        } else if (cp < 0x800) {
+            s += static_cast<char>(0xC0 | (cp >> 6));
+            s += static_cast<char>(0x80 | (cp & 0x3F));
+        } else if (cp < 0x10000) {
+            s += static_cast<char>(0xE0 | (cp >> 12));
+            s += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            s += static_cast<char>(0x80 | (cp & 0x3F));
+        } else {
+            s += static_cast<char>(0xF0 | (cp >> 18));
+            s += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+            s += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            s += static_cast<char>(0x80 | (cp & 0x3F));
+        }
+    }
+    
+    bool hex4(uint32_t& cp) {
+        if (length - pos < 4) return fail("truncated \\u escape");
+        cp = 0;
+        for (int i = 0; i < 4; i++) {
+            char c = text[pos++];
+            cp <<= 4;
+            if (c >= '0' && c <= '9') cp |= c - '0';
+            else if (c >= 'a' && c <= 'f') cp |= c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F') cp |= c - 'A' + 10;
+            else return fail("invalid \\u escape");
+        }
+        return true;
+    }
+    
+    bool string(std::string& s) {
+        pos++;  // opening quote
+        while (true) {
+            size_t run = pos;
+            while (pos < length && text[pos] != '"' && text[pos] != '\\' &&
+                   static_cast<unsigned char>(text[pos]) >= 0x20) {
+                pos++;
+            }
+            s.append(text + run, pos - run);
+            
+            if (pos >= length) return fail("unterminated string");
+            char c = text[pos++];
+            if (c == '"') return true;
+            if (c != '\\') return fail("control character in string");
+            if (pos >= length) return fail("unterminated string");
+            
+            switch (text[pos++]) {
+                case '"': s += '"'; break;
+                case '\\': s += '\\'; break;
+                case '/': s += '/'; break;
+                case 'b': s += '\b'; break;
+                case 'f': s += '\f'; break;
+                case 'n': s += '\n'; break;
+                case 'r': s += '\r'; break;
+                case 't': s += '\t'; break;
+                case 'u': {
+                    uint32_t cp = 0;
+                    if (!hex4(cp)) return false;
+                    if (cp >= 0xD800 && cp < 0xDC00) {
+                        uint32_t low = 0;
+                        if (length - pos < 2 || text[pos] != '\\' || text[pos + 1] != 'u') {
+                            return fail("unpaired surrogate");
+                        }
+                        pos += 2;
+                        if (!hex4(low) || low < 0xDC00 || low >= 0xE000) return fail("unpaired surrogate");
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                    }
+                    appendUTF8(s, cp);
+                    break;
+                }
+                default:
+                    return fail("invalid escape");
+            }
+        }
+    }
+    
+    bool number() {
+        size_t start = pos;
+        bool integral = true;
+        if (text[pos] == '-') pos++;
+        if (pos >= length || !isdigit(static_cast<unsigned char>(text[pos]))) return fail("invalid number");
+        while (pos < length && isdigit(static_cast<unsigned char>(text[pos]))) pos++;
+        if (pos < length && text[pos] == '.') {
+            integral = false;
+            pos++;
+            if (pos >= length || !isdigit(static_cast<unsigned char>(text[pos]))) return fail("invalid number");
+            while (pos < length && isdigit(static_cast<unsigned char>(text[pos]))) pos++;
+        }
+        if (pos < length && (text[pos] == 'e' || text[pos] == 'E')) {
+            integral = false;
+            pos++;
+            if (pos < length && (text[pos] == '+' || text[pos] == '-')) pos++;
+            if (pos >= length || !isdigit(static_cast<unsigned char>(text[pos]))) return fail("invalid number");
+            while (pos < length && isdigit(static_cast<unsigned char>(text[pos]))) pos++;
+        }
+        
+        std::string digits(text + start, pos - start);
+        if (integral) {
+            errno = 0;
+            long long v = strtoll(digits.c_str(), nullptr, 10);
+            if (errno == 0) {
+                JSONDocument::appendInt(out, v);
+                return true;
+            }
+        }
+        JSONDocument::appendDouble(out, strtod(digits.c_str(), nullptr));
+        return true;
+    }
+    
+    bool array() {
+        pos++;  // [
+        size_t node = out.size();
+        out.push_back(static_cast<uint8_t>(JSONTag::ARRAY));
+        appendU32(out, 0);
+        appendU32(out, 0);
+        size_t body = out.size();
+        
+        std::vector<uint32_t> offsets;
+        skipSpace();
+        if (pos < length && text[pos] == ']') {
+            pos++;
+        } else {
+            while (true) {
+                offsets.push_back(out.size() - body);
+                if (!value()) return false;
+                skipSpace();
+                if (pos >= length) return fail("unterminated array");
+                if (text[pos] == ',') {
+                    pos++;
+                    continue;
+                }
+                if (text[pos] != ']') return fail("expected ',' or ']'");
+                pos++;
+                break;
+            }
+        }
+        
+        // Offsets are relative to the node start, past the table being inserted
+        uint32_t tableSize = offsets.size() * sizeof(uint32_t);
+        std::vector<uint8_t> table(tableSize);
+        for (size_t i = 0; i < offsets.size(); i++) {
+            uint32_t at = (body - node) + tableSize + offsets[i];
+            memcpy(table.data() + i * sizeof(uint32_t), &at, sizeof(at));
+        }
+        out.insert(out.begin() + body, table.begin(), table.end());
+        writeU32(out, node + 1, offsets.size());
+        writeU32(out, node + 5, out.size() - node);
+        return true;
+    }
+    
+    bool object() {
+        pos++;  // {
+        size_t node = out.size();
+        out.push_back(static_cast<uint8_t>(JSONTag::OBJECT));
+        appendU32(out, 0);
+        appendU32(out, 0);
+        size_t body = out.size();
+        
+        struct Entry {
+            uint32_t keyOffset;
+            uint32_t valueOffset;
+            size_t order;
+        };
+        std::vector<Entry> entries;
+        
+        skipSpace();
+        if (pos < length && text[pos] == '}') {
+            pos++;
+        } else {
+            std::string key;
+            while (true) {
+                skipSpace();
+                if (pos >= length || text[pos] != '"') return fail("expected object key");
+                key.clear();
+                if (!string(key)) return false;
+                if (key.size() > 0xFFFF) return fail("object key too long");
+                
+                Entry entry;
+                entry.keyOffset = out.size() - body;
+                entry.order = entries.size();
+                uint16_t keyLength = key.size();
+                out.push_back(keyLength & 0xFF);
+                out.push_back(keyLength >> 8);
+                out.insert(out.end(), key.begin(), key.end());
+                
+                skipSpace();
+                if (pos >= length || text[pos] != ':') return fail("expected ':'");
+                pos++;
+                entry.valueOffset = out.size() - body;
+                if (!value()) return false;
+                entries.push_back(entry);
+                
+                skipSpace();
+                if (pos >= length) return fail("unterminated object");
+                if (text[pos] == ',') {
+                    pos++;
+                    continue;
+                }
+                if (text[pos] != '}') return fail("expected ',' or '}'");
+                pos++;
+                break;
+            }
+        }
+        
+        // Sort the offset table by key so lookups can binary search it. For
+        // duplicate keys the last one wins, as in most JSON parsers.
+        const uint8_t* base = out.data() + body;
+        auto keyOf = [base](const Entry& e) {
+            return std::string_view(reinterpret_cast<const char*>(base + e.keyOffset + 2), readU16(base + e.keyOffset));
+        };
+        std::sort(entries.begin(), entries.end(), [&](const Entry& a, const Entry& b) {
+            int c = keyOf(a).compare(keyOf(b));
+            return c != 0 ? c < 0 : a.order < b.order;
+        });
+        std::vector<Entry> unique;
+        for (size_t i = 0; i < entries.size(); i++) {
+            if (i + 1 < entries.size() && keyOf(entries[i]) == keyOf(entries[i + 1])) continue;
+            unique.push_back(entries[i]);
+        }
+        
+        uint32_t tableSize = unique.size() * 2 * sizeof(uint32_t);
+        uint32_t shift = (body - node) + tableSize;
+        std::vector<uint8_t> table(tableSize);
+        for (size_t i = 0; i < unique.size(); i++) {
+            uint32_t keyAt = shift + unique[i].keyOffset;
+            uint32_t valueAt = shift + unique[i].valueOffset;
+            memcpy(table.data() + i * 8, &keyAt, sizeof(keyAt));
+            memcpy(table.data() + i * 8 + 4, &valueAt, sizeof(valueAt));
+        }
+        out.insert(out.begin() + body, table.begin(), table.end());
+        writeU32(out, node + 1, unique.size());
+        writeU32(out, node + 5, out.size() - node);
+        return true;
+    }
+    
+public:
+    Encoder(const char* t, size_t len, std::vector<uint8_t>& o, std::string& e)
+        : text(t), length(len), pos(0), out(o), error(e), depth(0) {}
+        
+    bool value() {
+        skipSpace();
+        if (pos >= length) return fail("unexpected end of input");
+        if (++depth > JSON_MAX_DEPTH) return fail("document nested too deeply");
+        
+        bool ok;
+        switch (text[pos]) {
+            case '{': ok = object(); break;
+            case '[': ok = array(); break;
+            case '"': {
+                std::string s;
+                ok = string(s);
+                if (ok) JSONDocument::appendString(out, s.data(), s.size());
+                break;
+            }
+            case 't': ok = literal("true", JSONTag::TRUE_VALUE); break;
+            case 'f': ok = literal("false", JSONTag::FALSE_VALUE); break;
+            case 'n': ok = literal("null", JSONTag::NULL_VALUE); break;
+            default: ok = number(); break;
+        }
+        depth--;
+        return ok;
+    }
+    
+    bool document() {
+        if (!value()) return false;
+        skipSpace();
+        if (pos != length) return fail("trailing characters after document");
+        return true;
+    }
+};
+
+} // namespace
+
+void JSONDocument::appendInt(std::vector<uint8_t>& out, int64_t v) {
+    out.push_back(static_cast<uint8_t>(JSONTag::INT));
+    uint8_t bytes[8];
+    memcpy(bytes, &v, sizeof(v));
+    out.insert(out.end(), bytes, bytes + 8);
+}
+
+void JSONDocument::appendDouble(std::vector<uint8_t>& out, double v) {
+    out.push_back(static_cast<uint8_t>(JSONTag::DOUBLE));
+    uint8_t bytes[8];
+    memcpy(bytes, &v, sizeof(v));
+    out.insert(out.end(), bytes, bytes + 8);
+}
+
+void JSONDocument::appendString(std::vector<uint8_t>& out, const char* s, size_t n) {
+    out.push_back(static_cast<uint8_t>(JSONTag::STRING));
+    appendU32(out, n);
+    out.insert(out.end(), s, s + n);
+}
+
+bool JSONDocument::encodeScalar(const char* text, size_t length, std::vector<uint8_t>& out, std::string& error) {
+    out.clear();
+    Encoder encoder(text, length, out, error);
+    return encoder.document();
+}
+
+size_t JSONDocument::nodeSize(const uint8_t* node, size_t available) {
+    if (available == 0) return 0;
+    size_t size;
+    switch (static_cast<JSONTag>(node[0])) {
+        case JSONTag::NULL_VALUE:
+        case JSONTag::FALSE_VALUE:
+        case JSONTag::TRUE_VALUE:
+            size = 1;
+            break;
+        case JSONTag::INT:
+        case JSONTag::DOUBLE:
+            size = 9;
+            break;
+        case JSONTag::STRING:
+            if (available < 5) return 0;
+            size = 5 + static_cast<size_t>(readU32(node + 1));
+            break;
+        case JSONTag::ARRAY:
+        case JSONTag::OBJECT:
+            if (available < 9) return 0;
+            size = readU32(node + 5);
+            break;
+        default:
+            return 0;
+    }
+    return size <= available ? size : 0;
+}
+
+// Object members are found by binary search over the sorted offset table and
+// array elements by direct index, so a path lookup touches only the nodes on
+// the path and never decodes the rest of the document.
+const uint8_t* JSONDocument::find(const uint8_t* doc, size_t length,
+                                  const std::vector<std::string>& path, size_t& nodeLength) {
+    const uint8_t* node = doc;
+    size_t available = length;
+    
+    for (const auto& segment : path) {
+        size_t size = nodeSize(node, available);
+        if (size < 9) return nullptr;
+        JSONTag tag = static_cast<JSONTag>(node[0]);
+        uint32_t count = readU32(node + 1);
+        if (9 + static_cast<size_t>(count) * (tag == JSONTag::OBJECT ? 8 : 4) > size) return nullptr;
+        
+        uint32_t offset;
+        if (tag == JSONTag::ARRAY) {
+            char* end;
+            unsigned long index = strtoul(segment.c_str(), &end, 10);
+            if (segment.empty() || *end != '\0' || index >= count) return nullptr;
+            offset = readU32(node + 9 + index * 4);
+        } else if (tag == JSONTag::OBJECT) {
+            size_t lo = 0, hi = count;
+            bool found = false;
+            while (lo < hi) {
+                size_t mid = (lo + hi) / 2;
+                uint32_t keyAt = readU32(node + 9 + mid * 8);
+                if (keyAt + 2 > size) return nullptr;
+                uint16_t keyLength = readU16(node + keyAt);
+                if (keyAt + 2 + keyLength > size) return nullptr;
+                int c = std::string_view(reinterpret_cast<const char*>(node + keyAt + 2), keyLength).compare(segment);
+                if (c == 0) {
+                    offset = readU32(node + 9 + mid * 8 + 4);
+                    found = true;
+                    break;
+                }
+                if (c < 0) lo = mid + 1;
+                else hi = mid;
+            }
+            if (!found) return nullptr;
+        } else {
+            return nullptr;
+        }
+        
+        if (offset >= size) return nullptr;
+        node += offset;
+        available = size - offset;
+    }
+    
+    nodeLength = nodeSize(node, available);
+    return nodeLength ? node : nullptr;
+}
+
+Value JSONDocument::toValue(const uint8_t* node, size_t length) {
+    Value v;
+    if (length == 0) return v;
+    
+    switch (static_cast<JSONTag>(node[0])) {
+        case JSONTag::NULL_VALUE:
+            break;
+        case JSONTag::FALSE_VALUE:
+            v = Value(false);
+            break;
+        case JSONTag::TRUE_VALUE:
+            v = Value(true);
+            break;
+        case JSONTag::INT: {
+            int64_t n;
+            memcpy(&n, node + 1, sizeof(n));
+            v = Value(n);
+            break;
+        }
+        case JSONTag::DOUBLE: {
+            double d;
+            memcpy(&d, node + 1, sizeof(d));
+            v = Value(d);
+            break;
+        }
+        case JSONTag::STRING:
+            v = Value(std::string(reinterpret_cast<const char*>(node + 5), readU32(node + 1)));
+            break;
+        default:
+            // Nested containers are self-contained and come back as documents
+            v.type = DataType::TYPE_JSON;
+            v.binaryVal.assign(node, node + length);
+            break;
+    }
+    return v;
+}
+
+bool JSONDocument::extract(const Value& doc, const std::vector<std::string>& path, Value& out) {
+    out = Value();
+    if (doc.type != DataType::TYPE_JSON) return false;
+    
+    size_t nodeLength;
+    const uint8_t* node = find(doc.binaryVal.data(), doc.binaryVal.size(), path, nodeLength);
+    if (!node) return false;
+    out = toValue(node, nodeLength);
+    return true;
+}
+
+void JSONDocument::toText(const uint8_t* node, size_t length, std::string& out) {
+    size_t size = nodeSize(node, length);
+    if (size == 0) {
+        out += "null";
+        return;
+    }
+    
+    switch (static_cast<JSONTag>(node[0])) {
+        case JSONTag::NULL_VALUE: out += "null"; break;
+        case JSONTag::FALSE_VALUE: out += "false"; break;
+        case JSONTag::TRUE_VALUE: out += "true"; break;
+        case JSONTag::INT: {
+            int64_t n;
+            memcpy(&n, node + 1, sizeof(n));
+            out += std::to_string(n);
+            break;
+        }
+        case JSONTag::DOUBLE: {
+            double d;
+            memcpy(&d, node + 1, sizeof(d));
+            if (!std::isfinite(d)) {
+                out += "null";
+                break;
+            }
+            char buffer[32];
+            snprintf(buffer, sizeof(buffer), "%.17g", d);
+            out += buffer;
+            break;
+        }
+        case JSONTag::STRING:
+            appendJSONString(out, reinterpret_cast<const char*>(node + 5), readU32(node + 1));
+            break;
+        case JSONTag::ARRAY: {
+            uint32_t count = readU32(node + 1);
+            out += '[';
+            for (uint32_t i = 0; i < count; i++) {
+                uint32_t offset = readU32(node + 9 + i * 4);
+                if (i > 0) out += ',';
+                toText(node + offset, size - offset, out);
+            }
+            out += ']';
+            break;
+        }
+        case JSONTag::OBJECT: {
+            uint32_t count = readU32(node + 1);
+            out += '{';
+            for (uint32_t i = 0; i < count; i++) {
+                uint32_t keyAt = readU32(node + 9 + i * 8);
+                uint32_t valueAt = readU32(node + 9 + i * 8 + 4);
+                if (i > 0) out += ',';
+                appendJSONString(out, reinterpret_cast<const char*>(node + keyAt + 2), readU16(node + keyAt));
+                out += ':';
+                toText(node + valueAt, size - valueAt, out);
+            }
+            out += '}';
+            break;
+        }
+    }
+}
+
+// The scalar values of a document as space-separated text, keys left out,
+// for the full-text tokenizer
+void JSONDocument::appendWords(const uint8_t* node, size_t length, std::string& out) {
+    size_t size = nodeSize(node, length);
+    if (size == 0) return;
+    
+    switch (static_cast<JSONTag>(node[0])) {
+        case JSONTag::INT: {
+            int64_t n;
+            memcpy(&n, node + 1, sizeof(n));
+            out += std::to_string(n);
+            out += ' ';
+            break;
+        }
+        case JSONTag::DOUBLE: {
+            double d;
+            memcpy(&d, node + 1, sizeof(d));
+            char buffer[32];
+            snprintf(buffer, sizeof(buffer), "%g", d);
+            out += buffer;
+            out += ' ';
+            break;
+        }
+        case JSONTag::STRING:
+            out.append(reinterpret_cast<const char*>(node + 5), readU32(node + 1));
+            out += ' ';
+            break;
+        case JSONTag::ARRAY: {
+            uint32_t count = readU32(node + 1);
+            for (uint32_t i = 0; i < count; i++) {
+                uint32_t offset = readU32(node + 9 + i * 4);
+                appendWords(node + offset, size - offset, out);
+            }
+            break;
+        }
+        case JSONTag::OBJECT: {
+            uint32_t count = readU32(node + 1);
+            for (uint32_t i = 0; i < count; i++) {
+                uint32_t valueAt = readU32(node + 9 + i * 8 + 4);
+                appendWords(node + valueAt, size - valueAt, out);
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+std::vector<std::string> JSONDocument::splitPath(const std::string& path) {
+    std::vector<std::string> segments;
+    size_t start = 0;
+    if (path.compare(0, 2, "$.") == 0) start = 2;
+    else if (path == "$") return segments;
+    
+    while (start <= path.size()) {
+        size_t dot = path.find('.', start);
+        if (dot == std::string::npos) dot = path.size();
+        segments.push_back(path.substr(start, dot - start));
+        start = dot + 1;
+    }
+    return segments;
+}
+
+std::string JSONDocument::joinPath(const std::vector<std::string>& path) {
+    std::string joined;
+    for (const auto& segment : path) {
+        if (!joined.empty()) joined += '.';
+        joined += segment;
+    }
+    return joined;
+}
+
+} // namespace hybriddb
@@ -0,0 +1,591 @@
+#include "../include/hybriddb.h"
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <charconv>
+
+#if defined(__AVX2__)
+    #include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+    #include <arm_neon.h>
+#endif
+
+namespace hybriddb {
+
+// ============================================================================
+// STRUCTURAL-INDEX JSON PARSER
+// ============================================================================
+//
+// Two passes, in the style of simdjson:
+//   1. Classify 64 input bytes at a time into bitmasks (quotes, backslashes,
+//      operators, whitespace) with AVX2/NEON compares, resolve escapes and
+//      string interiors with bit arithmetic, and emit the positions of every
+//      structural character plus the first byte of every scalar.
+//   2. Walk those positions and write the binary document directly. Each
+//      scalar's extent is bounded by the next structural position, so
+//      strings without escapes are a single memcpy.
+// No intermediate tree is built and container offset tables are sized up
+// front from member counts found in stage 1, so nothing is moved afterwards.
+
+namespace {
+
+struct BlockMasks {
+    uint64_t quote;
+    uint64_t backslash;
+    uint64_t op;            // { } [ ] : ,
+    uint64_t whitespace;
+    uint64_t control;       // bytes below 0x20, rejected inside strings
+};
+
+#if defined(__AVX2__)
+
+inline uint64_t eqMask(__m256i lo, __m256i hi, char c) {
+    __m256i v = _mm256_set1_epi8(c);
+    uint32_t a = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, v)));
+    uint32_t b = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, v)));
+    return a | (static_cast<uint64_t>(b) << 32);
+}
+
+inline void classify(const uint8_t* p, BlockMasks& m) {
+    __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    __m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 32));
+    
+    // '[' | 0x20 == '{' and ']' | 0x20 == '}', so two compares cover all brackets
+    __m256i case20 = _mm256_set1_epi8(0x20);
+    __m256i loFolded = _mm256_or_si256(lo, case20);
+    __m256i hiFolded = _mm256_or_si256(hi, case20);
+    
+    m.quote = eqMask(lo, hi, '"');
+    m.backslash = eqMask(lo, hi, '\\');
+    m.op = eqMask(loFolded, hiFolded, '{') | eqMask(loFolded, hiFolded, '}') |
+           eqMask(lo, hi, ':') | eqMask(lo, hi, ',');
+    m.whitespace = eqMask(lo, hi, ' ') | eqMask(lo, hi, '\n') |
+                   eqMask(lo, hi, '\r') | eqMask(lo, hi, '\t');
+                   
+    // max(c, 0x1F) == 0x1F exactly when c <= 0x1F
+    __m256i limit = _mm256_set1_epi8(0x1F);
+    m.control = eqMask(_mm256_max_epu8(lo, limit), _mm256_max_epu8(hi, limit), 0x1F);
+}
+
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+
+inline uint64_t movemask(uint8x16_t a, uint8x16_t b, uint8x16_t c, uint8x16_t d) {
+    static const uint8_t weights[16] = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+    uint8x16_t w = vld1q_u8(weights);
+    uint8x16_t sum = vpaddq_u8(vpaddq_u8(vandq_u8(a, w), vandq_u8(b, w)),
+                               vpaddq_u8(vandq_u8(c, w), vandq_u8(d, w)));
+    sum = vpaddq_u8(sum, sum);
+    return vgetq_lane_u64(vreinterpretq_u64_u8(sum), 0);
+}
+
+inline uint64_t eqMask(const uint8x16_t* v, uint8_t c) {
+    uint8x16_t needle = vdupq_n_u8(c);
+    return movemask(vceqq_u8(v[0], needle), vceqq_u8(v[1], needle),
+                    vceqq_u8(v[2], needle), vceqq_u8(v[3], needle));
+}
+
+inline void classify(const uint8_t* p, BlockMasks& m) {
+    uint8x16_t v[4] = {vld1q_u8(p), vld1q_u8(p + 16), vld1q_u8(p + 32), vld1q_u8(p + 48)};
+    uint8x16_t folded[4];
+    for (int i = 0; i < 4; i++) folded[i] = vorrq_u8(v[i], vdupq_n_u8(0x20));
+    
+    m.quote = eqMask(v, '"');
+    m.backslash = eqMask(v, '\\');
+    m.op = eqMask(folded, '{') | eqMask(folded, '}') | eqMask(v, ':') | eqMask(v, ',');
+    m.whitespace = eqMask(v, ' ') | eqMask(v, '\n') | eqMask(v, '\r') | eqMask(v, '\t');
+    
+    uint8x16_t limit = vdupq_n_u8(0x20);
+    m.control = movemask(vcltq_u8(v[0], limit), vcltq_u8(v[1], limit),
+                         vcltq_u8(v[2], limit), vcltq_u8(v[3], limit));
+}
+
+#else
+
+inline void classify(const uint8_t* p, BlockMasks& m) {
+    m.quote = m.backslash = m.op = m.whitespace = m.control = 0;
+    for (int i = 0; i < 64; i++) {
+        uint64_t bit = 1ULL << i;
+        if (p[i] < 0x20) m.control |= bit;
+        switch (p[i]) {
+            case '"': m.quote |= bit; break;
+            case '\\': m.backslash |= bit; break;
+            case '{': case '}': case '[': case ']': case ':': case ',': m.op |= bit; break;
+            case ' ': case '\n': case '\r': case '\t': m.whitespace |= bit; break;
+            default: break;
+        }
+    }
+}
+
+#endif
+
+// Inclusive prefix XOR: bit i = xor of bits 0..i. Turns quote positions into
+// an in-string mask (opening quote set, closing quote clear).
+inline uint64_t prefixXor(uint64_t x) {
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    return x;
+}
+
+// Characters preceded by an odd run of backslashes. prevEscaped carries a
+// dangling backslash into the next block.
+inline uint64_t findEscaped(uint64_t backslash, uint64_t& prevEscaped) {
+    const uint64_t evenBits = 0x5555555555555555ULL;
+    
+    backslash &= ~prevEscaped;
+    uint64_t followsEscape = (backslash << 1) | prevEscaped;
+    uint64_t oddSequenceStarts = backslash & ~evenBits & ~followsEscape;
+    
+    uint64_t sequencesStartingOnEvenBits;
+    prevEscaped = __builtin_add_overflow(oddSequenceStarts, backslash, &sequencesStartingOnEvenBits) ? 1 : 0;
+    uint64_t invertMask = sequencesStartingOnEvenBits << 1;
+    
+    return (evenBits ^ invertMask) & followsEscape;
+}
+
+inline bool isSpace(char c) {
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+class Builder {
+private:
+    const char* text;
+    size_t length;
+    const uint32_t* index;
+    size_t count;
+    const std::vector<uint32_t>& members;
+    size_t i;
+    std::vector<uint8_t>& out;
+    size_t used;
+    std::string& error;
+    int depth;
+    std::vector<std::pair<uint32_t, uint32_t>>& entries;   // (key, value) offsets of open objects
+    
+    bool fail(const std::string& message, size_t at) {
+        if (error.empty()) error = message + " at offset " + std::to_string(at);
+        return false;
+    }
+    
+    uint8_t* reserve(size_t n) {
+        if (used + n > out.size()) out.resize(std::max(out.size() * 2, used + n));
+        uint8_t* p = out.data() + used;
+        used += n;
+        return p;
+    }
+    
+    void putU32(size_t at, uint32_t v) { memcpy(out.data() + at, &v, sizeof(v)); }
+    
+    // A scalar runs from its first byte to the next structural, minus whitespace
+    size_t tokenEnd() const {
+        size_t end = (i + 1 < count) ? index[i + 1] : length;
+        while (end > index[i] && isSpace(text[end - 1])) end--;
+        return end;
+    }
+    
+    bool expect(char c) {
+        if (i >= count || text[index[i]] != c) {
+            return fail(std::string("expected '") + c + "'", i < count ? index[i] : length);
+        }
+        i++;
+        return true;
+    }
+    
+    static void appendUTF8(uint8_t*& w, uint32_t cp) {
+        if (cp < 0x80) {
+            *w++ = cp;
+        } else if (cp < 0x800) {
+            *w++ = 0xC0 | (cp >> 6);
+            *w++ = 0x80 | (cp & 0x3F);
+        } else if (cp < 0x10000) {
+            *w++ = 0xE0 | (cp >> 12);
+            *w++ = 0x80 | ((cp >> 6) & 0x3F);
+            *w++ = 0x80 | (cp & 0x3F);
+        } else {
+            *w++ = 0xF0 | (cp >> 18);
+            *w++ = 0x80 | ((cp >> 12) & 0x3F);
+            *w++ = 0x80 | ((cp >> 6) & 0x3F);
+            *w++ = 0x80 | (cp & 0x3F);
+        }
+    }
+    
+    static bool hex4(const char* p, uint32_t& cp) {
+        cp = 0;
+        for (int k = 0; k < 4; k++) {
+            char c = p[k];
+            cp <<= 4;
+            if (c >= '0' && c <= '9') cp |= c - '0';
+            else if (c >= 'a' && c <= 'f') cp |= c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F') cp |= c - 'A' + 10;
+            else return false;
+        }
+        return true;
+    }
+    
+    // Writes the unescaped string body (no tag) with a length prefix of
+    // lenBytes (2 for keys, 4 for string values); returns false on bad input
+    bool string(size_t lenBytes) {
+        size_t start = index[i] + 1;
+        size_t end = tokenEnd();
+        if (end <= start || text[end - 1] != '"') return fail("unterminated string", index[i]);
+        end--;
+        size_t n = end - start;
+        
+        size_t at = used;
+        uint8_t* w = reserve(lenBytes + n);
+        w += lenBytes;
+        
+        const char* s = text + start;
+        const char* escape = static_cast<const char*>(memchr(s, '\\', n));
+        if (!escape) {
+            memcpy(w, s, n);
+        } else {
+            // Escapes only ever shrink the text, so n bytes are enough
+            uint8_t* begin = w;
+            const char* p = s;
+            const char* limit = s + n;
+            while (escape) {
+                memcpy(w, p, escape - p);
+                w += escape - p;
+                p = escape + 1;
+                if (p >= limit) return fail("invalid escape", start);
+                
+                switch (*p++) {
+                    case '"': *w++ = '"'; break;
+                    case '\\': *w++ = '\\'; break;
+                    case '/': *w++ = '/'; break;
+                    case 'b': *w++ = '\b'; break;
+                    case 'f': *w++ = '\f'; break;
+                    case 'n': *w++ = '\n'; break;
+                    case 'r': *w++ = '\r'; break;
+                    case 't': *w++ = '\t'; break;
+                    case 'u': {
+                        uint32_t cp;
+                        if (limit - p < 4 || !hex4(p, cp)) return fail("invalid \\u escape", start);
+                        p += 4;
+                        if (cp >= 0xD800 && cp < 0xDC00) {
+                            uint32_t low;
+                            if (limit - p < 6 || p[0] != '\\' || p[1] != 'u' || !hex4(p + 2, low) ||
+                                low < 0xDC00 || low >= 0xE000) {
+                                return fail("unpaired surrogate", start);
+                            }
+                            p += 6;
+                            cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                        }
+                        appendUTF8(w, cp);
+                        break;
+                    }
+                    default:
+                        return fail("invalid escape", start);
+                }
+                escape = static_cast<const char*>(memchr(p, '\\', limit - p));
+            }
+            memcpy(w, p, limit - p);
+            w += limit - p;
+            n = w - begin;
+            used = at + lenBytes + n;
+        }
+        
+        if (lenBytes == 2) {
+            if (n > 0xFFFF) return fail("object key too long", start);
+            uint16_t keyLength = n;
+            memcpy(out.data() + at, &keyLength, sizeof(keyLength));
+        } else {
+            putU32(at, n);
+        }
+        i++;
+        return true;
+    }
+    
+    static bool isDigit(char c) { return c >= '0' && c <= '9'; }
+    
+    // -?digits(.digits)?([eE][+-]?digits)?, same grammar as the scalar encoder
+    bool number() {
+        size_t start = index[i];
+        const char* first = text + start;
+        const char* last = text + tokenEnd();
+        const char* p = first;
+        bool integral = true;
+        
+        if (p < last && *p == '-') p++;
+        if (p >= last || !isDigit(*p)) return fail("invalid number", start);
+        while (p < last && isDigit(*p)) p++;
+        if (p < last && *p == '.') {
+            integral = false;
+            if (++p >= last || !isDigit(*p)) return fail("invalid number", start);
+            while (p < last && isDigit(*p)) p++;
+        }
+        if (p < last && (*p == 'e' || *p == 'E')) {
+            integral = false;
+            p++;
+            if (p < last && (*p == '+' || *p == '-')) p++;
+            if (p >= last || !isDigit(*p)) return fail("invalid number", start);
+            while (p < last && isDigit(*p)) p++;
+        }
+        if (p != last) return fail("invalid number", start);
+        
+        uint8_t* w = reserve(9);
+        if (integral) {
+            int64_t v;
+            if (std::from_chars(first, last, v).ec == std::errc()) {
+                w[0] = static_cast<uint8_t>(JSONTag::INT);
+                memcpy(w + 1, &v, sizeof(v));
+                i++;
+                return true;
+            }
+        }
+        
+        // from_chars leaves d untouched on overflow; strtod gives the +-HUGE_VAL
+        // the scalar encoder stores
+        double d;
+        if (std::from_chars(first, last, d).ec != std::errc()) {
+            d = strtod(std::string(first, last).c_str(), nullptr);
+        }
+        w[0] = static_cast<uint8_t>(JSONTag::DOUBLE);
+        memcpy(w + 1, &d, sizeof(d));
+        i++;
+        return true;
+    }
+    
+    bool literal() {
+        size_t start = index[i];
+        size_t n = tokenEnd() - start;
+        const char* p = text + start;
+        
+        JSONTag tag;
+        if (n == 4 && memcmp(p, "true", 4) == 0) tag = JSONTag::TRUE_VALUE;
+        else if (n == 5 && memcmp(p, "false", 5) == 0) tag = JSONTag::FALSE_VALUE;
+        else if (n == 4 && memcmp(p, "null", 4) == 0) tag = JSONTag::NULL_VALUE;
+        else return fail("invalid literal", start);
+        
+        *reserve(1) = static_cast<uint8_t>(tag);
+        i++;
+        return true;
+    }
+    
+    bool array() {
+        uint32_t n = members[i];
+        i++;
+        
+        size_t node = used;
+        uint8_t* w = reserve(9 + static_cast<size_t>(n) * 4);
+        w[0] = static_cast<uint8_t>(JSONTag::ARRAY);
+        putU32(node + 1, n);
+        
+        for (uint32_t k = 0; k < n; k++) {
+            putU32(node + 9 + k * 4, used - node);
+            if (!value()) return false;
+            if (k + 1 < n && !expect(',')) return false;
+        }
+        if (!expect(']')) return false;
+        
+        putU32(node + 5, used - node);
+        return true;
+    }
+    
+    bool object() {
+        uint32_t n = members[i];
+        i++;
+        
+        size_t node = used;
+        uint8_t* w = reserve(9 + static_cast<size_t>(n) * 8);
+        w[0] = static_cast<uint8_t>(JSONTag::OBJECT);
+        
+        size_t firstEntry = entries.size();
+        for (uint32_t k = 0; k < n; k++) {
+            if (i >= count || text[index[i]] != '"') return fail("expected object key", i < count ? index[i] : length);
+            uint32_t keyAt = used - node;
+            if (!string(2) || !expect(':')) return false;
+            
+            uint32_t valueAt = used - node;
+            if (!value()) return false;
+            entries.emplace_back(keyAt, valueAt);
+            
+            if (k + 1 < n && !expect(',')) return false;
+        }
+        if (!expect('}')) return false;
+        
+        // Sort by key; for duplicate keys the last one wins, and value offsets
+        // grow with input order so they break ties. Nested objects have
+        // already consumed and released their slice of entries.
+        const uint8_t* base = out.data() + node;
+        auto keyOf = [base](uint32_t at) {
+            uint16_t len;
+            memcpy(&len, base + at, sizeof(len));
+            return std::string_view(reinterpret_cast<const char*>(base + at + 2), len);
+        };
+        auto begin = entries.begin() + firstEntry;
+        std::sort(begin, entries.end(), [&](const auto& a, const auto& b) {
+            int c = keyOf(a.first).compare(keyOf(b.first));
+            return c != 0 ? c < 0 : a.second < b.second;
+        });
+        
+        uint32_t unique = 0;
+        for (auto it = begin; it != entries.end(); ++it) {
+            if (it + 1 != entries.end() && keyOf(it->first) == keyOf((it + 1)->first)) continue;
+            *(begin + unique++) = *it;
+        }
+        
+        // Duplicates leave table slots unused; close the gap so the layout
+        // matches the scalar encoder byte for byte
+        uint32_t gap = (n - unique) * 8;
+        if (gap > 0) {
+            size_t body = node + 9 + static_cast<size_t>(n) * 8;
+            memmove(out.data() + body - gap, out.data() + body, used - body);
+            used -= gap;
+        }
+        for (uint32_t k = 0; k < unique; k++) {
+            putU32(node + 9 + k * 8, (begin + k)->first - gap);
+            putU32(node + 9 + k * 8 + 4, (begin + k)->second - gap);
+        }
+        entries.erase(begin, entries.end());
+        
+        putU32(node + 1, unique);
+        putU32(node + 5, used - node);
+        return true;
+    }
+    
+public:
+    Builder(const char* t, size_t len, const std::vector<uint32_t>& idx, const std::vector<uint32_t>& m,
+            std::vector<std::pair<uint32_t, uint32_t>>& scratch, std::vector<uint8_t>& o, std::string& e)
+        : text(t), length(len), index(idx.data()), count(idx.size()), members(m), i(0),
+          out(o), used(0), error(e), depth(0), entries(scratch) {
+        entries.clear();
+        out.resize(len + 64);
+    }
+    
+    bool value() {
+        if (i >= count) return fail("unexpected end of input", length);
+        if (++depth > JSON_MAX_DEPTH) return fail("document nested too deeply", index[i]);
+        
+        bool ok;
+        switch (text[index[i]]) {
+            case '{': ok = object(); break;
+            case '[': ok = array(); break;
+            case '"': {
+                uint8_t* w = reserve(1);
+                *w = static_cast<uint8_t>(JSONTag::STRING);
+                ok = string(4);
+                break;
+            }
+            case 't': case 'f': case 'n': ok = literal(); break;
+            case '}': case ']': case ':': case ',':
+                ok = fail(std::string("unexpected '") + text[index[i]] + "'", index[i]);
+                break;
+            default: ok = number(); break;
+        }
+        depth--;
+        return ok;
+    }
+    
+    bool document() {
+        if (!value()) return false;
+        if (i != count) return fail("trailing characters after document", index[i]);
+        out.resize(used);
+        return true;
+    }
+};
+
+} // namespace
+
+bool JSONDocument::structuralIndex(const char* text, size_t length, std::vector<uint32_t>& positions,
+                                   std::string& error) {
+    if (length >= UINT32_MAX) {
+        error = "document too large";
+        return false;
+    }
+    
+    // Worst case every byte is structural
+    positions.resize(length + 64);
+    uint32_t* w = positions.data();
+    
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(text);
+    uint64_t prevEscaped = 0;
+    uint64_t prevInString = 0;
+    uint64_t prevScalar = 0;
+    
+    uint8_t tail[64];
+    for (size_t base = 0; base < length; base += 64) {
+        const uint8_t* block = data + base;
+        if (length - base < 64) {
+            memset(tail, ' ', sizeof(tail));
+            memcpy(tail, block, length - base);
+            block = tail;
+        }
+        
+        BlockMasks m;
+        classify(block, m);
+        
+        uint64_t escaped = findEscaped(m.backslash, prevEscaped);
+        uint64_t quotes = m.quote & ~escaped;
+        uint64_t inString = prefixXor(quotes) ^ prevInString;
+        prevInString = static_cast<uint64_t>(static_cast<int64_t>(inString) >> 63);
+        
+        // Scalars outside strings start where the previous byte was an
+        // operator, whitespace or the end of the previous block's scalar run
+        uint64_t scalar = ~(m.op | m.whitespace | m.quote) & ~inString;
+        uint64_t followsScalar = (scalar << 1) | prevScalar;
+        prevScalar = scalar >> 63;
+        uint64_t scalarStarts = scalar & ~followsScalar;
+        
+        if (m.control & inString) {
+            error = "control character in string at offset " +
+                    std::to_string(base + __builtin_ctzll(m.control & inString));
+            return false;
+        }
+        
+        uint64_t structurals = (m.op & ~inString) | (quotes & inString) | scalarStarts;
+        if (length - base < 64) structurals &= (1ULL << (length - base)) - 1;
+        
+        while (structurals) {
+            *w++ = static_cast<uint32_t>(base + __builtin_ctzll(structurals));
+            structurals &= structurals - 1;
+        }
+    }
+    
+    positions.resize(w - positions.data());
+    if (prevInString) {
+        error = "unterminated string";
+        return false;
+    }
+    return true;
+}
+
+bool JSONDocument::encode(const char* text, size_t length, std::vector<uint8_t>& out, std::string& error) {
+    thread_local std::vector<uint32_t> positions;
+    thread_local std::vector<uint32_t> members;
+    thread_local std::vector<uint32_t> stack;
+    thread_local std::vector<std::pair<uint32_t, uint32_t>> entries;
+    
+    if (!structuralIndex(text, length, positions, error)) return false;
+    
+    // Member counts per container so offset tables can be laid out before
+    // the members are written
+    members.assign(positions.size(), 0);
+    stack.clear();
+    for (size_t k = 0; k < positions.size(); k++) {
+        char c = text[positions[k]];
+        if (c == '{' || c == '[') {
+            if (k + 1 < positions.size()) {
+                char next = text[positions[k + 1]];
+                members[k] = (next == '}' || next == ']') ? 0 : 1;
+            }
+            stack.push_back(k);
+        } else if (c == '}' || c == ']') {
+            if (stack.empty() || (text[positions[stack.back()]] == '{') != (c == '}')) {
+                error = "mismatched brackets at offset " + std::to_string(positions[k]);
+                return false;
+            }
+            stack.pop_back();
+        } else if (c == ',' && !stack.empty()) {
+            members[stack.back()]++;
+        }
+    }
+    
+    Builder builder(text, length, positions, members, entries, out, error);
+    return builder.document();
+}
+
+} // namespace hybriddb
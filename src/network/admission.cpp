@@ -0,0 +1,139 @@
+#include "../include/hybriddb.h"
+#include <algorithm>
+
+namespace hybriddb {
+
+// ============================================================================
+// ADMISSION CONTROL
+// ============================================================================
+
+const char* priorityName(Priority priority) {
+    static const char* const names[PRIORITY_CLASSES] = {"high", "normal", "low"};
+    return names[static_cast<size_t>(priority)];
+}
+
+AdmissionController::AdmissionController(const AdmissionConfig& config)
+    : config(config), running(0), runningLow(0), reserved(0) {
+    if (this->config.lowSlots == 0) this->config.lowSlots = std::max<size_t>(1, config.slots / 2);
+    memset(stats, 0, sizeof(stats));
+}
+
+// Caller holds mutex
+bool AdmissionController::fits(Priority priority, uint64_t bytes) const {
+    if (running >= config.slots) return false;
+    if (priority == Priority::LOW && runningLow >= config.lowSlots) return false;
+    return reserved + bytes <= config.memoryBudget;
+}
+
+// Caller holds mutex
+void AdmissionController::take(Priority priority, uint64_t bytes) {
+    running++;
+    if (priority == Priority::LOW) runningLow++;
+    reserved += bytes;
+    stats[static_cast<size_t>(priority)].running++;
+}
+
+// Caller holds mutex. Hands freed room to waiters, highest priority first;
+// the first that does not fit stops the rest, so a large request is not
+// starved by smaller ones behind it.
+void AdmissionController::dispatch() {
+    for (auto& queue : queues) {
+        while (!queue.empty()) {
+            Waiter* waiter = queue.front();
+            if (!fits(waiter->priority, waiter->bytes)) return;
+            queue.pop_front();
+            take(waiter->priority, waiter->bytes);
+            waiter->admitted = true;
+            waiter->ready.notify_one();
+        }
+    }
+}
+
+bool AdmissionController::admit(Priority priority, uint64_t bytes, bool exempt, std::string& error) {
+    // A request larger than the whole budget runs alone
+    bytes = std::min(bytes, config.memoryBudget);
+    size_t level = static_cast<size_t>(priority);
+    AdmissionClassStats& counts = stats[level];
+    
+    std::unique_lock<std::mutex> lock(mutex);
+    bool ahead = false;
+    for (size_t p = 0; p <= level; p++) ahead = ahead || !queues[p].empty();
+    if (exempt || (!ahead && fits(priority, bytes))) {
+        take(priority, bytes);
+        counts.admitted++;
+        lock.unlock();
+        if (!exempt) Metrics::record(Histogram::ADMISSION_WAIT, 0);
+        return true;
+    }
+    
+    if (queues[level].size() >= config.queueLimit) {
+        counts.rejected++;
+        error = "server busy: " + std::to_string(queues[level].size()) + " " + priorityName(priority) +
+                " priority requests already queued";
+        return false;
+    }
+    
+    Waiter waiter;
+    waiter.priority = priority;
+    waiter.bytes = bytes;
+    queues[level].push_back(&waiter);
+    counts.queued++;
+    auto started = std::chrono::steady_clock::now();
+    auto deadline = started + std::chrono::milliseconds(config.timeoutMillis[level]);
+    while (!waiter.admitted && waiter.ready.wait_until(lock, deadline) != std::cv_status::timeout) {}
+    counts.queued--;
+    uint64_t waited = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - started).count();
+        
+    if (!waiter.admitted) {
+        auto& queue = queues[level];
+        queue.erase(std::find(queue.begin(), queue.end(), &waiter));
+        counts.timedOut++;
+        // It may have been what held the others back
+        dispatch();
+        error = "server busy: not admitted within " + std::to_string(config.timeoutMillis[level]) + " ms at " +
+                priorityName(priority) + " priority";
+        return false;
+    }
+    
+    counts.admitted++;
+    counts.waitNanos += waited;
+    counts.maxWaitNanos = std::max(counts.maxWaitNanos, waited);
+    lock.unlock();
+    Metrics::record(Histogram::ADMISSION_WAIT, waited);
+    return true;
+}
+
+void AdmissionController::release(Priority priority, uint64_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex);
+    running--;
+    if (priority == Priority::LOW) runningLow--;
+    reserved -= std::min(bytes, config.memoryBudget);
+    stats[static_cast<size_t>(priority)].running--;
+    dispatch();
+}
+
+AdmissionStats AdmissionController::getStats() {
+    std::lock_guard<std::mutex> lock(mutex);
+    AdmissionStats result;
+    result.slots = config.slots;
+    result.lowSlots = config.lowSlots;
+    result.running = running;
+    result.memoryBudget = config.memoryBudget;
+    result.reserved = reserved;
+    std::copy(std::begin(stats), std::end(stats), std::begin(result.classes));
+    return result;
+}
+
+bool AdmissionTicket::acquire(AdmissionController* controller, Priority priority, uint64_t bytes, bool exempt,
+                              std::string& error) {
+    if (!controller) return true;
+    if (!controller->admit(priority, bytes, exempt, error)) return false;
+    this->controller = controller;
+    this->priority = priority;
+    this->bytes = bytes;
+    held = true;
+    return true;
+}
+
+} // namespace hybriddb
@@ -0,0 +1,159 @@
+#include "../include/hybriddb.h"
+#include <algorithm>
+#ifdef PLATFORM_WINDOWS
+#include <ws2tcpip.h>
+#else
+#include <sys/uio.h>
+#include <netdb.h>
+#endif
+
+namespace hybriddb {
+
+// ============================================================================
+// PROTOCOL MESSAGES
+// ============================================================================
+//
+// Shared by the server and the tools that speak the protocol. The length is
+// fixed-width so a reader knows how much to receive after five bytes.
+
+void Message::encodeHeader(uint8_t header[5], MessageType type, uint32_t length) {
+    header[0] = static_cast<uint8_t>(type);
+    memcpy(header + 1, &length, sizeof(length));
+}
+
+void Message::serialize(std::vector<uint8_t>& out) const {
+    size_t at = out.size();
+    out.resize(at + 5 + payload.size());
+    encodeHeader(out.data() + at, type, static_cast<uint32_t>(payload.size()));
+    if (!payload.empty()) memcpy(out.data() + at + 5, payload.data(), payload.size());
+}
+
+std::vector<uint8_t> Message::serialize() const {
+    std::vector<uint8_t> buffer;
+    serialize(buffer);
+    return buffer;
+}
+
+bool Message::deserialize(const uint8_t* data, size_t length, size_t& offset, Message& msg) {
+    if (offset > length) return false;
+    ByteReader in(data + offset, length - offset);
+    uint8_t type = in.get<uint8_t>();
+    uint32_t size = in.get<uint32_t>();
+    const uint8_t* payload = in.take(size);
+    if (!in.ok()) return false;
+    msg.type = static_cast<MessageType>(type);
+    msg.payload.assign(payload, payload + size);
+    offset += in.consumed(data + offset);
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+// Socket I/O
+// ----------------------------------------------------------------------------
+
+// A result is never copied into a message buffer first: the header and the
+// payload are gathered into one write
+bool writeFrame(SocketHandle socket, MessageType type, const uint8_t* payload, size_t length) {
+    uint8_t header[5];
+    Message::encodeHeader(header, type, static_cast<uint32_t>(length));
+    size_t total = sizeof(header) + length;
+    
+#ifdef PLATFORM_WINDOWS
+    std::vector<uint8_t> data(header, header + sizeof(header));
+    putBytes(data, payload, length);
+    size_t done = 0;
+    while (done < total) {
+        int sent = send(socket, reinterpret_cast<const char*>(data.data() + done), total - done, 0);
+        if (sent <= 0) return false;
+        done += sent;
+    }
+#else
+    size_t done = 0;
+    while (done < total) {
+        iovec parts[2];
+        int count = 0;
+        if (done < sizeof(header)) parts[count++] = {header + done, sizeof(header) - done};
+        size_t from = done < sizeof(header) ? 0 : done - sizeof(header);
+        if (from < length) parts[count++] = {const_cast<uint8_t*>(payload) + from, length - from};
+        
+        msghdr msg{};
+        msg.msg_iov = parts;
+        msg.msg_iovlen = count;
+        ssize_t sent = sendmsg(socket, &msg, MSG_NOSIGNAL);
+        if (sent <= 0) return false;
+        done += sent;
+    }
+#endif
+    Metrics::add(Counter::BYTES_OUT, total);
+    return true;
+}
+
+static bool receiveAll(SocketHandle socket, uint8_t* buffer, size_t length) {
+    size_t total = 0;
+    while (total < length) {
+        int received = recv(socket, reinterpret_cast<char*>(buffer + total), length - total, 0);
+        if (received <= 0) return false;
+        total += received;
+    }
+    return true;
+}
+
+bool readFrame(SocketHandle socket, Message& msg) {
+    msg.type = MessageType::DISCONNECT;
+    msg.payload.clear();
+    
+    uint8_t header[5];
+    if (!receiveAll(socket, header, sizeof(header))) return false;
+    
+    uint32_t length;
+    memcpy(&length, &header[1], sizeof(length));
+    if (length > MAX_FRAME_BYTES) return false;
+    
+    // The length comes from the peer, so memory is only taken for bytes
+    // that actually arrive
+    size_t received = 0;
+    while (received < length) {
+        size_t chunk = std::min<size_t>(length - received, FRAME_READ_CHUNK);
+        msg.payload.resize(received + chunk);
+        if (!receiveAll(socket, msg.payload.data() + received, chunk)) {
+            msg.payload.clear();
+            return false;
+        }
+        received += chunk;
+    }
+    
+    msg.type = static_cast<MessageType>(header[0]);
+    Metrics::add(Counter::BYTES_IN, sizeof(header) + length);
+    return true;
+}
+
+bool connectSocket(const std::string& host, uint16_t port, SocketHandle& socket) {
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* found = nullptr;
+    if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &found) != 0) return false;
+    
+    socket = ::socket(AF_INET, SOCK_STREAM, 0);
+#ifdef PLATFORM_WINDOWS
+    bool created = socket != INVALID_SOCKET;
+#else
+    bool created = socket >= 0;
+#endif
+    bool connected = created &&
+                     ::connect(socket, found->ai_addr, static_cast<socklen_t>(found->ai_addrlen)) == 0;
+    freeaddrinfo(found);
+    if (created && !connected) closeSocket(socket);
+    return connected;
+}
+
+void closeSocket(SocketHandle socket) {
+#ifdef PLATFORM_WINDOWS
+    closesocket(socket);
+#else
+    close(socket);
+#endif
+}
+
+} // namespace hybriddb
@@ -0,0 +1,528 @@
+#include "../include/hybriddb.h"
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+
+namespace hybriddb {
+
+// Wakes a thread blocked reading or writing the socket; it closes it
+static void shutdownSocket(SocketHandle socket) {
+#ifdef PLATFORM_WINDOWS
+    shutdown(socket, SD_BOTH);
+#else
+    shutdown(socket, SHUT_RDWR);
+#endif
+}
+
+static bool sendLSN(SocketHandle socket, MessageType type, uint64_t lsn) {
+    return writeFrame(socket, type, reinterpret_cast<const uint8_t*>(&lsn), sizeof(lsn));
+}
+
+static bool readLSN(const Message& msg, uint64_t& lsn) {
+    if (msg.payload.size() < sizeof(lsn)) return false;
+    memcpy(&lsn, msg.payload.data(), sizeof(lsn));
+    return true;
+}
+
+// ============================================================================
+// COMMIT ASSEMBLER
+// ============================================================================
+
+bool CommitAssembler::add(const WALRecordView& record, const uint8_t* frame, size_t length,
+                          std::vector<uint8_t>& batch) {
+    // Schema changes, and writes made outside any transaction, are applied
+    // on their own
+    if (record.type == WALRecordType::SCHEMA || record.txnId == 0) {
+        batch.assign(frame, frame + length);
+        return true;
+    }
+    
+    switch (record.type) {
+        case WALRecordType::BEGIN_TXN:
+            return false;
+        case WALRecordType::ABORT_TXN:
+            open.erase(record.txnId);
+            return false;
+        case WALRecordType::COMMIT_TXN: {
+            // A transaction that wrote nothing is still shipped, as its COMMIT
+            // alone, so a SYNC commit of it has something to wait for
+            auto it = open.find(record.txnId);
+            if (it != open.end()) {
+                batch = std::move(it->second);
+                open.erase(it);
+            } else {
+                batch.clear();
+            }
+            putBytes(batch, frame, length);
+            return true;
+        }
+        default:
+            putBytes(open[record.txnId], frame, length);
+            return false;
+    }
+}
+
+// ============================================================================
+// REPLICATION SENDER
+// ============================================================================
+
+ReplicationSender::Session::~Session() {
+    closeSocket(socket);
+}
+
+ReplicationSender::ReplicationSender(uint16_t p, ReplicationMode m, WALManager* w, TransactionManager* tm)
+    : port(p), mode(m), wal(w), txnManager(tm), running(false), streamStart(0), streamBytes(0) {}
+    
+ReplicationSender::~ReplicationSender() {
+    stop();
+}
+
+bool ReplicationSender::start() {
+#ifdef PLATFORM_WINDOWS
+    WSADATA wsaData;
+    WSAStartup(MAKEWORD(2, 2), &wsaData);
+    
+    listenSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+#else
+    listenSocket = socket(AF_INET, SOCK_STREAM, 0);
+    
+    int opt = 1;
+    setsockopt(listenSocket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+#endif
+    
+    sockaddr_in serverAddr;
+    serverAddr.sin_family = AF_INET;
+    serverAddr.sin_addr.s_addr = INADDR_ANY;
+    serverAddr.sin_port = htons(port);
+    
+    if (bind(listenSocket, (sockaddr*)&serverAddr, sizeof(serverAddr)) != 0 ||
+        listen(listenSocket, SOMAXCONN) != 0) {
+        closeSocket(listenSocket);
+        return false;
+    }
+    
+    // Bulk loads log their rows from now on, or a replica could not replay them
+    wal->setFullLogging(true);
+    wal->setListener([this](const WALRecordView& record, const uint8_t* frame, size_t length) {
+        this->record(record, frame, length);
+    });
+    if (mode == ReplicationMode::SYNC) {
+        txnManager->setSyncHook([this](uint64_t commitLSN) { waitForReplica(commitLSN); });
+    }
+    
+    running = true;
+    std::thread acceptThread(&ReplicationSender::acceptLoop, this);
+    acceptThread.detach();
+    return true;
+}
+
+void ReplicationSender::stop() {
+    if (!running.exchange(false)) return;
+    
+    txnManager->setSyncHook(nullptr);
+    wal->setListener(nullptr);
+    shutdownSocket(listenSocket);
+    closeSocket(listenSocket);
+    
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto& session : sessions) {
+        session->active = false;
+        shutdownSocket(session->socket);
+    }
+    changed.notify_all();
+}
+
+// The WAL listener, called under the log's own mutex for every record
+void ReplicationSender::record(const WALRecordView& record, const uint8_t* frame, size_t length) {
+    std::vector<uint8_t> batch;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!assembler.add(record, frame, length, batch)) return;
+    
+    // With no replica connected nothing is queued: one that connects later
+    // reads this transaction from the segment files
+    if (sessions.empty()) return;
+    
+    streamBytes += batch.size();
+    stream.push_back({record.lsn, std::make_shared<const std::vector<uint8_t>>(std::move(batch)),
+                      std::chrono::steady_clock::now()});
+    trim();
+    changed.notify_all();
+}
+
+void ReplicationSender::acceptLoop() {
+    while (running) {
+        sockaddr_in clientAddr;
+        socklen_t clientLen = sizeof(clientAddr);
+        
+        SocketHandle clientSocket = accept(listenSocket, (sockaddr*)&clientAddr, &clientLen);
+        if (clientSocket < 0) continue;
+        if (!running) {
+            closeSocket(clientSocket);
+            break;
+        }
+        
+        char clientIP[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &clientAddr.sin_addr, clientIP, INET_ADDRSTRLEN);
+        
+        auto session = std::make_shared<Session>();
+        session->socket = clientSocket;
+        session->address = std::string(clientIP) + ":" + std::to_string(ntohs(clientAddr.sin_port));
+        session->next = 0;
+        session->sentLSN = 0;
+        session->appliedLSN = 0;
+        session->confirmed = false;
+        session->catchingUp = true;
+        session->active = true;
+        
+        std::thread serveThread(&ReplicationSender::serve, this, session);
+        serveThread.detach();
+    }
+}
+
+// A replica asks for the log from some LSN on. What was committed before it
+// connected is read back from the segment files; what commits after is sent
+// from the queue. The flush marks the line between the two: every batch
+// queued from then on was committed at or after it.
+void ReplicationSender::serve(std::shared_ptr<Session> session) {
+    Message request;
+    uint64_t from = 0;
+    if (!readFrame(session->socket, request) || request.type != MessageType::REPLICATE || !readLSN(request, from)) {
+        return;
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        session->next = streamStart + stream.size();
+        sessions.push_back(session);
+    }
+    std::thread ackThread(&ReplicationSender::receiveAcks, this, session);
+    ackThread.detach();
+    std::cout << "Replica " << session->address << " connected, from LSN " << from << std::endl;
+    
+    uint64_t cut = wal->flush();
+    bool ok = true;
+    {
+        CommitAssembler history;
+        std::vector<uint8_t> batch;
+        wal->scan([&](const WALRecordView& record, const uint8_t* frame, size_t length) {
+            if (!ok || record.lsn >= cut || !history.add(record, frame, length, batch)) return;
+            if (record.lsn < from) return;
+            ok = ship(*session, record.lsn, batch.data(), batch.size(), std::chrono::steady_clock::now());
+        });
+    }
+    
+    std::unique_lock<std::mutex> lock(mutex);
+    session->catchingUp = false;
+    changed.notify_all();
+    
+    while (ok && running && session->active && session->next >= streamStart) {
+        if (session->next == streamStart + stream.size()) {
+            // Idle: tell the replica how far the log has got, so it knows its lag
+            if (changed.wait_for(lock, std::chrono::milliseconds(REPLICATION_STATUS_MS)) == std::cv_status::timeout) {
+                lock.unlock();
+                ok = sendLSN(session->socket, MessageType::WAL_STATUS, wal->getCurrentLSN());
+                lock.lock();
+            }
+            continue;
+        }
+        
+        Batch batch = stream[session->next - streamStart];
+        session->next++;
+        lock.unlock();
+        if (batch.lsn >= cut && batch.lsn >= from) {
+            ok = ship(*session, batch.lsn, batch.frames->data(), batch.frames->size(), batch.committed);
+        }
+        lock.lock();
+        trim();
+    }
+    
+    session->active = false;
+    shutdownSocket(session->socket);
+    sessions.erase(std::remove(sessions.begin(), sessions.end(), session), sessions.end());
+    trim();
+    changed.notify_all();
+    lock.unlock();
+    std::cout << "Replica " << session->address << " disconnected" << std::endl;
+}
+
+void ReplicationSender::receiveAcks(std::shared_ptr<Session> session) {
+    Message msg;
+    uint64_t lsn;
+    while (readFrame(session->socket, msg)) {
+        if (msg.type != MessageType::WAL_ACK || !readLSN(msg, lsn)) continue;
+        
+        std::lock_guard<std::mutex> lock(mutex);
+        session->appliedLSN = lsn;
+        session->confirmed = true;
+        while (!session->inFlight.empty() && session->inFlight.front().first <= lsn) session->inFlight.pop_front();
+        changed.notify_all();
+    }
+    
+    std::lock_guard<std::mutex> lock(mutex);
+    session->active = false;
+    shutdownSocket(session->socket);
+    changed.notify_all();
+}
+
+bool ReplicationSender::ship(Session& session, uint64_t lsn, const uint8_t* frames, size_t length,
+                             std::chrono::steady_clock::time_point committed) {
+    if (!writeFrame(session.socket, MessageType::WAL_DATA, frames, length)) return false;
+    
+    std::lock_guard<std::mutex> lock(mutex);
+    session.sentLSN = lsn;
+    session.inFlight.emplace_back(lsn, committed);
+    return true;
+}
+
+// Caller holds mutex. Batches every session has sent are dropped. Past
+// REPLICATION_QUEUE_BYTES the sessions furthest behind are cut off instead
+// of holding the queue; they catch up from the segment files on reconnect.
+void ReplicationSender::trim() {
+    uint64_t keep = streamStart + stream.size();
+    for (const auto& session : sessions) keep = std::min(keep, session->next);
+    
+    while (!stream.empty() && (streamStart < keep || streamBytes > REPLICATION_QUEUE_BYTES)) {
+        if (streamStart >= keep) {
+            for (auto& session : sessions) {
+                if (session->next == streamStart && session->active) {
+                    session->active = false;
+                    shutdownSocket(session->socket);
+                }
+            }
+        }
+        streamBytes -= stream.front().frames->size();
+        stream.pop_front();
+        streamStart++;
+    }
+}
+
+// A SYNC commit returns once a replica that has caught up confirms it. With
+// no such replica connected it does not wait, so a lost replica never stalls
+// the primary.
+void ReplicationSender::waitForReplica(uint64_t lsn) {
+    std::unique_lock<std::mutex> lock(mutex);
+    changed.wait(lock, [&]() {
+        if (!running) return true;
+        bool streaming = false;
+        for (const auto& session : sessions) {
+            if (!session->active || session->catchingUp) continue;
+            if (session->confirmed && session->appliedLSN >= lsn) return true;
+            streaming = true;
+        }
+        return !streaming;
+    });
+}
+
+std::vector<ReplicaStatus> ReplicationSender::getStatus() {
+    uint64_t current = wal->getCurrentLSN();
+    auto now = std::chrono::steady_clock::now();
+    
+    std::vector<ReplicaStatus> replicas;
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto& session : sessions) {
+        ReplicaStatus status;
+        status.address = session->address;
+        status.sentLSN = session->sentLSN;
+        status.appliedLSN = session->appliedLSN;
+        uint64_t applied = session->confirmed ? session->appliedLSN + 1 : 0;
+        status.lagRecords = current > applied ? current - applied : 0;
+        status.lagMillis = session->inFlight.empty() ? 0 :
+            std::chrono::duration_cast<std::chrono::milliseconds>(now - session->inFlight.front().second).count();
+        status.catchingUp = session->catchingUp;
+        replicas.push_back(status);
+    }
+    return replicas;
+}
+
+// ============================================================================
+// REPLICATION RECEIVER
+// ============================================================================
+
+ReplicationReceiver::ReplicationReceiver(const std::string& h, uint16_t p, const std::string& path, QueryEngine* qe)
+    : host(h), port(p), statePath(path), queryEngine(qe), running(false), connected(false),
+      nextLSN(0), primaryLSN(0), transactions(0), bytes(0) {
+#ifdef PLATFORM_WINDOWS
+    socket = INVALID_SOCKET;
+#else
+    socket = -1;
+#endif
+}
+
+ReplicationReceiver::~ReplicationReceiver() {
+    stop();
+}
+
+void ReplicationReceiver::start() {
+    std::string failure;
+    if (!loadState(failure)) {
+        std::cerr << "Replication not started: " << failure << std::endl;
+        fail(failure);
+        return;
+    }
+    running = true;
+    thread = std::thread(&ReplicationReceiver::run, this);
+}
+
+// The next LSN on the first line, then a line "id name" per table of the
+// primary. Without the file the replica is new and asks for the whole log.
+bool ReplicationReceiver::loadState(std::string& error) {
+    std::ifstream file(statePath);
+    if (!file) return true;
+    std::string text;
+    std::getline(file, text);
+    char* end = nullptr;
+    errno = 0;
+    uint64_t lsn = std::strtoull(text.c_str(), &end, 10);
+    if (text.empty() || *end != '\0' || errno == ERANGE) {
+        error = statePath + " is damaged: '" + text + "' is not an LSN";
+        return false;
+    }
+    
+    std::map<uint32_t, std::string> tables;
+    uint32_t id;
+    std::string name;
+    while (file >> id >> name) tables[id] = name;
+    if (!file.eof()) {
+        error = statePath + " is damaged: a table entry is malformed";
+        return false;
+    }
+    queryEngine->setReplicaTables(tables);
+    std::lock_guard<std::mutex> lock(mutex);
+    nextLSN = lsn;
+    return true;
+}
+
+bool ReplicationReceiver::saveState(uint64_t next, std::string& error) {
+    std::string text = std::to_string(next) + "\n";
+    for (const auto& [id, name] : queryEngine->getReplicaTables()) text += std::to_string(id) + " " + name + "\n";
+    return replaceFile(statePath, std::vector<uint8_t>(text.begin(), text.end()), error);
+}
+
+void ReplicationReceiver::fail(const std::string& reason) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        error = reason;
+    }
+    queryEngine->setReplicaError(reason);
+}
+
+void ReplicationReceiver::stop() {
+    if (!running.exchange(false)) return;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (connected) shutdownSocket(socket);
+    }
+    if (thread.joinable()) thread.join();
+}
+
+void ReplicationReceiver::run() {
+    while (running) {
+        if (!follow()) break;
+        
+        // Lost or refused: try again in a second
+        for (int i = 0; i < 10 && running; i++) std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+}
+
+// One connection to the primary. False when replay failed, which is final.
+bool ReplicationReceiver::follow() {
+    SocketHandle s;
+    if (!connectSocket(host, port, s)) return true;
+    
+    uint64_t from;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!running) {
+            closeSocket(s);
+            return true;
+        }
+        socket = s;
+        connected = true;
+        from = nextLSN;
+    }
+    
+    // Replay is idempotent, so the state is saved only now and then: after a
+    // schema change, once REPLICA_STATE_MS have passed, when the primary is
+    // idle and when the connection ends. A restart replays what came after.
+    // A save that fails stops replication, as a replay that fails does.
+    bool replaying = true;
+    uint64_t saved = from;
+    auto lastSave = std::chrono::steady_clock::now();
+    std::string failure;
+    auto save = [&](uint64_t next) {
+        if (next == saved) return true;
+        if (!saveState(next, failure)) return false;
+        saved = next;
+        lastSave = std::chrono::steady_clock::now();
+        return true;
+    };
+    
+    if (sendLSN(s, MessageType::REPLICATE, from)) {
+        std::cout << "Following primary " << host << ":" << port << " from LSN " << from << std::endl;
+        
+        Message msg;
+        uint64_t lsn = 0;
+        uint64_t next = from;
+        while (running && readFrame(s, msg)) {
+            uint64_t status;
+            if (msg.type == MessageType::WAL_STATUS && readLSN(msg, status)) {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    primaryLSN = status;
+                }
+                if (!save(next)) {
+                    replaying = false;
+                    break;
+                }
+                continue;
+            }
+            if (msg.type != MessageType::WAL_DATA) continue;
+            
+            bool schema = false;
+            if (!queryEngine->replay(msg.payload.data(), msg.payload.size(), lsn, failure, &schema)) {
+                replaying = false;
+                break;
+            }
+            next = lsn + 1;
+            if ((schema || std::chrono::steady_clock::now() - lastSave >= std::chrono::milliseconds(REPLICA_STATE_MS))
+                && !save(next)) {
+                replaying = false;
+                break;
+            }
+            
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                nextLSN = next;
+                primaryLSN = std::max(primaryLSN, nextLSN);
+                transactions++;
+                bytes += msg.payload.size();
+            }
+            if (!sendLSN(s, MessageType::WAL_ACK, lsn)) break;
+        }
+        if (replaying && !save(next)) replaying = false;
+        if (!replaying) {
+            std::cerr << "Replication stopped at LSN " << lsn << ": " << failure << std::endl;
+            fail(failure);
+        }
+    }
+    
+    std::lock_guard<std::mutex> lock(mutex);
+    connected = false;
+    closeSocket(s);
+    return replaying;
+}
+
+ReceiverStatus ReplicationReceiver::getStatus() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    ReceiverStatus status;
+    status.primary = host + ":" + std::to_string(port);
+    status.connected = connected;
+    status.appliedLSN = nextLSN > 0 ? nextLSN - 1 : 0;
+    status.primaryLSN = primaryLSN;
+    status.transactions = transactions;
+    status.bytes = bytes;
+    status.error = error;
+    return status;
+}
+
+} // namespace hybriddb
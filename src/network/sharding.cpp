@@ -0,0 +1,132 @@
+#include "../include/hybriddb.h"
+#include <cstdlib>
+
+namespace hybriddb {
+
+// ============================================================================
+// SHARD ROUTER
+// ============================================================================
+
+ShardRouter::ShardRouter(const std::vector<std::string>& addresses)
+    : configured(addresses), routed(0), scattered(0) {}
+    
+ShardRouter::~ShardRouter() {
+    for (auto& [address, node] : nodes) {
+        for (SocketHandle socket : node->idle) closeSocket(socket);
+    }
+}
+
+// Tables name their nodes in the catalog, so a node is known by its address
+// even when it is no longer among the configured ones
+ShardRouter::Node& ShardRouter::node(const std::string& address) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto& slot = nodes[address];
+    if (!slot) {
+        slot = std::make_unique<Node>();
+        size_t colon = address.rfind(':');
+        slot->host = address.substr(0, colon);
+        slot->port = colon == std::string::npos ? 0 : std::atoi(address.c_str() + colon + 1);
+        slot->requests = 0;
+        slot->failures = 0;
+        slot->micros = 0;
+    }
+    return *slot;
+}
+
+// Every key is hashed as Value::hash does it, so 5 and 5.0 land together
+size_t ShardRouter::partitionOf(const Value& key, size_t partitions) {
+    return partitions ? key.hash() % partitions : 0;
+}
+
+// A connection that fails mid-request is dropped, not retried: the node may
+// already have run the statement
+bool ShardRouter::request(const std::string& address, const std::string& sql,
+                          std::string& result, std::string& error) {
+    Node& target = node(address);
+    
+    SocketHandle socket;
+    bool pooled = false;
+    {
+        std::lock_guard<std::mutex> lock(target.mutex);
+        if (!target.idle.empty()) {
+            socket = target.idle.back();
+            target.idle.pop_back();
+            pooled = true;
+        }
+    }
+    if (!pooled && !connectSocket(target.host, target.port, socket)) {
+        target.failures++;
+        error = "shard " + address + " is unreachable";
+        return false;
+    }
+    
+    auto start = std::chrono::steady_clock::now();
+    Message response;
+    bool ok = writeFrame(socket, MessageType::QUERY, reinterpret_cast<const uint8_t*>(sql.data()), sql.size()) &&
+              readFrame(socket, response);
+    target.requests++;
+    target.micros += std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count();
+        
+    if (!ok) {
+        closeSocket(socket);
+        target.failures++;
+        error = "lost the connection to shard " + address;
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(target.mutex);
+        if (target.idle.size() < SHARD_IDLE_CONNECTIONS) target.idle.push_back(socket);
+        else closeSocket(socket);
+    }
+    
+    if (response.type != MessageType::RESULT) {
+        target.failures++;
+        error = "shard " + address + ": " + std::string(response.payload.begin(), response.payload.end());
+        return false;
+    }
+    result.assign(response.payload.begin(), response.payload.end());
+    return true;
+}
+
+bool ShardRouter::run(const std::string& address, const std::string& sql, std::string& result, std::string& error) {
+    routed++;
+    return request(address, sql, result, error);
+}
+
+// The first request runs on the calling thread, the others on a thread each
+bool ShardRouter::scatter(const std::vector<std::pair<std::string, std::string>>& requests,
+                          std::vector<std::string>& results, std::string& error) {
+    scattered++;
+    results.assign(requests.size(), std::string());
+    std::vector<std::string> errors(requests.size());
+    std::vector<char> ok(requests.size(), 0);
+    
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < requests.size(); i++) {
+        workers.emplace_back([&, i]() {
+            ok[i] = request(requests[i].first, requests[i].second, results[i], errors[i]);
+        });
+    }
+    if (!requests.empty()) ok[0] = request(requests[0].first, requests[0].second, results[0], errors[0]);
+    for (auto& worker : workers) worker.join();
+    
+    for (size_t i = 0; i < requests.size(); i++) {
+        if (!ok[i]) {
+            error = errors[i];
+            return false;
+        }
+    }
+    return true;
+}
+
+std::vector<ShardNodeStats> ShardRouter::getStats() const {
+    std::vector<ShardNodeStats> stats;
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto& [address, node] : nodes) {
+        stats.push_back({address, node->requests.load(), node->failures.load(), node->micros.load()});
+    }
+    return stats;
+}
+
+} // namespace hybriddb
@@ -0,0 +1,56 @@
+#include "../include/hybriddb.h"
+#include <algorithm>
+
+namespace hybriddb {
+
+// ============================================================================
+// SCRATCH ARENA
+// ============================================================================
+//
+// Blocks are filled in order. After a reset the kept blocks are filled again
+// from the first; an allocation too big for the block in turn moves on to
+// the next and leaves the rest of that one unused until the next reset.
+
+thread_local Arena* Arena::active = nullptr;
+
+Arena::Arena(size_t blockSize) : filling(0), used(0), blockSize(blockSize), stats() {}
+
+void* Arena::allocate(size_t size, size_t align) {
+    stats.allocations++;
+    stats.bytes += size;
+    
+    for (;; filling++, used = 0) {
+        if (filling == blocks.size()) {
+            size_t length = std::max(blockSize, size + align);
+            blocks.push_back({std::unique_ptr<uint8_t[]>(new uint8_t[length]), length});
+            stats.blocks++;
+            stats.reserved += length;
+        }
+        
+        Block& block = blocks[filling];
+        uintptr_t base = reinterpret_cast<uintptr_t>(block.data.get());
+        size_t offset = (base + used + align - 1) / align * align - base;
+        if (offset + size <= block.size) {
+            used = offset + size;
+            return block.data.get() + offset;
+        }
+    }
+}
+
+// A request that needed more than ARENA_RETAIN_BYTES gives the excess back,
+// so one large result does not pin memory for the life of the connection
+void Arena::reset() {
+    size_t kept = 0, reserved = 0;
+    while (kept < blocks.size() && reserved + blocks[kept].size <= ARENA_RETAIN_BYTES) {
+        reserved += blocks[kept].size;
+        kept++;
+    }
+    blocks.resize(kept);
+    
+    filling = 0;
+    used = 0;
+    stats = ArenaStats();
+    stats.reserved = reserved;
+}
+
+} // namespace hybriddb
@@ -0,0 +1,484 @@
+#include "../include/hybriddb.h"
+#include <cstring>
+#include <chrono>
+#include <algorithm>
+
+namespace hybriddb {
+
+// ============================================================================
+// BULK LOADER IMPLEMENTATION
+// ============================================================================
+
+// Pages are buffered and written as one sequential extent per batch
+#define BULK_LOAD_BATCH_PAGES 64
+#define BULK_LOAD_ROWID_BLOCK 4096
+
+namespace {
+
+// Flags every row a load wrote deleted. Pages are not emptied, since rows
+// inserted after the load was written may share its last page.
+void unloadRows(StorageEngine* storage, uint32_t tableId, bool lsm, const std::vector<uint32_t>& pages,
+                const std::vector<uint16_t>& items, const std::vector<std::pair<uint64_t, uint32_t>>& blocks) {
+    std::vector<uint64_t> tupleIds;
+    for (size_t p = 0; p < pages.size(); p++) {
+        for (uint16_t slot = 0; slot < items[p]; slot++) tupleIds.push_back(makeTupleId(pages[p], slot));
+    }
+    if (!tupleIds.empty()) storage->deleteTuples(tableId, std::move(tupleIds));
+    
+    for (const auto& [first, rows] : blocks) {
+        for (uint32_t i = 0; i < rows; i++) {
+            if (lsm) storage->getLSMStore()->setDeleted(tableId, first + i, true);
+            else storage->getColumnStore()->setDeleted(tableId, first + i, true);
+        }
+    }
+}
+
+} // namespace
+
+BulkLoader::BulkLoader(QueryEngine* qe, StorageEngine* se, TransactionManager* tm,
+                       const TableSchema& s, CopyFormat fmt, uint64_t txn)
+    : queryEngine(qe), storage(se), txnManager(tm), schema(s), format(fmt),
+      txnId(txn), ownsTxn(false), minimalLogging(false), indexesLoaded(0),
+      columnar(s.storageMode == StorageMode::COLUMN), lsm(s.storageMode == StorageMode::LSM),
+      nextRowId(0), rowIdLimit(0), rowsLoaded(0), bytesLoaded(0),
+      csvInQuotes(false), csvAfterQuote(false), csvQuoted(false),
+      failed(false), finished(false) {
+          
+    if (txnId == 0) {
+        txnId = txnManager->begin();
+        ownsTxn = true;
+    }
+    
+    // A table that has never held a row needs no per-page redo: if we crash
+    // mid-load the table is simply empty again, so we only force the data
+    // out at the end and log one BULK_LOAD record. Not while replicas follow
+    // the log: they need the rows.
+    minimalLogging = !txnManager->getWAL()->isFullLogging() &&
+                     schema.rowCount == 0 && storage->getPageCount(schema.tableId) <= 1;
+    
+    indexes = queryEngine->getIndexes(schema.tableId);
+    for (auto* index : indexes) {
+        size_t pos = 0;
+        while (pos < schema.columns.size() && schema.columns[pos].name != index->getColumn()) pos++;
+        indexColumns.push_back(pos);
+    }
+    indexKeys.resize(indexes.size());
+    
+    for (size_t i = 0; i < schema.columns.size(); i++) {
+        const std::string& name = schema.columns[i].name;
+        uint16_t nameLen = name.length();
+        std::vector<uint8_t> header(2);
+        memcpy(header.data(), &nameLen, 2);
+        header.insert(header.end(), name.begin(), name.end());
+        columnHeaders.push_back(header);
+        encodeOrder.push_back(i);
+    }
+    std::sort(encodeOrder.begin(), encodeOrder.end(), [this](size_t a, size_t b) {
+        return schema.columns[a].name < schema.columns[b].name;
+    });
+    
+    currentPage.initialize(0, schema.tableId);
+}
+
+BulkLoader::~BulkLoader() {
+    if (!finished) abort();
+}
+
+bool BulkLoader::fail(const std::string& message) {
+    if (!failed) {
+        error = message;
+        failed = true;
+    }
+    return false;
+}
+
+bool BulkLoader::feed(const uint8_t* data, size_t length) {
+    if (failed || finished) return false;
+    bytesLoaded += length;
+    return format == CopyFormat::CSV ? feedCSV(data, length) : feedBinary(data, length);
+}
+
+bool BulkLoader::addRow(std::vector<Value>& values) {
+    if (values.size() != schema.columns.size()) {
+        return fail("row " + std::to_string(rowsLoaded + 1) + " has " + std::to_string(values.size()) +
+                    " columns, expected " + std::to_string(schema.columns.size()));
+    }
+    
+    if (nextRowId == rowIdLimit) {
+        nextRowId = queryEngine->allocateRowIds(schema.tableName, BULK_LOAD_ROWID_BLOCK);
+        rowIdLimit = nextRowId + BULK_LOAD_ROWID_BLOCK;
+    }
+    
+    for (size_t i = 0; i < values.size(); i++) {
+        const ColumnDef& col = schema.columns[i];
+        if (values[i].isNull() && (!col.nullable || col.primaryKey)) {
+            if (col.defaultValue.isNull()) {
+                return fail("row " + std::to_string(rowsLoaded + 1) + ": column " + col.name + " cannot be NULL");
+            }
+            values[i] = col.defaultValue;
+        }
+    }
+    
+    uint64_t rowId = nextRowId++;
+    uint64_t timestamp = std::chrono::system_clock::now().time_since_epoch().count();
+    
+    if (columnar || lsm) {
+        Tuple tuple;
+        tuple.rowId = rowId;
+        tuple.txnId = txnId;
+        tuple.timestamp = timestamp;
+        tuple.deleted = false;
+        for (size_t i = 0; i < values.size(); i++) tuple.columns[schema.columns[i].name] = values[i];
+        
+        // Index entries carry the row's position in this load until finish()
+        for (size_t i = 0; i < indexes.size(); i++) {
+            Value key = indexColumns[i] < values.size() ? indexes[i]->keyFor(values[indexColumns[i]]) : Value();
+            indexKeys[i].emplace_back(std::move(key), rowsLoaded);
+        }
+        columnRows.push_back(std::move(tuple));
+        rowsLoaded++;
+        return columnRows.size() < COLUMN_BLOCK_ROWS || flushColumns();
+    }
+    
+    // Same layout as Tuple::serialize, written without building the column map
+    uint16_t count = values.size();
+    std::vector<uint8_t>& record = rowBuffer;
+    record.resize(27);
+    memcpy(record.data(), &rowId, 8);
+    memcpy(record.data() + 8, &txnId, 8);
+    memcpy(record.data() + 16, &timestamp, 8);
+    record[24] = 0;
+    memcpy(record.data() + 25, &count, 2);
+    for (size_t pos : encodeOrder) {
+        record.insert(record.end(), columnHeaders[pos].begin(), columnHeaders[pos].end());
+        values[pos].serialize(record);
+    }
+    
+    if (record.size() + sizeof(uint16_t) > PAGE_DATA_SIZE) {
+        return fail("row " + std::to_string(rowsLoaded + 1) + " does not fit in a page");
+    }
+    
+    if (!currentPage.appendRecord(record.data(), record.size())) {
+        pendingPages.push_back(currentPage);
+        currentPage.initialize(0, schema.tableId);
+        currentPage.appendRecord(record.data(), record.size());
+        
+        if (pendingPages.size() >= BULK_LOAD_BATCH_PAGES && !flushPages()) return false;
+    }
+    
+    // Page ids are only assigned when a batch is written, so index entries
+    // carry the page's ordinal within this load until finish() resolves them.
+    uint64_t provisional = makeTupleId(writtenPages.size() + pendingPages.size(),
+                                       currentPage.header.itemCount - 1);
+    for (size_t i = 0; i < indexes.size(); i++) {
+        // Indexes on undeclared document fields see NULL: COPY only loads declared columns
+        Value key = indexColumns[i] < values.size() ? indexes[i]->keyFor(values[indexColumns[i]]) : Value();
+        indexKeys[i].emplace_back(std::move(key), provisional);
+    }
+    
+    rowsLoaded++;
+    return true;
+}
+
+bool BulkLoader::flushPages() {
+    if (pendingPages.empty()) return true;
+    
+    if (!storage->appendPages(schema.tableId, pendingPages)) {
+        return fail("failed to write pages for table " + schema.tableName);
+    }
+    
+    for (const auto& page : pendingPages) {
+        writtenPages.push_back(page.header.pageId);
+        writtenItems.push_back(page.header.itemCount);
+        
+        if (!minimalLogging) {
+            std::vector<uint8_t> payload(sizeof(uint32_t) + PAGE_SIZE);
+            memcpy(payload.data(), &schema.tableId, sizeof(uint32_t));
+            memcpy(payload.data() + sizeof(uint32_t), &page, PAGE_SIZE);
+            txnManager->logOperation(txnId, WALRecordType::PAGE_IMAGE, payload);
+        }
+    }
+    
+    pendingPages.clear();
+    return true;
+}
+
+bool BulkLoader::flushColumns() {
+    if (columnRows.empty()) return true;
+    
+    // Blocks and runs are not logged for recovery, but replicas need the rows
+    if (txnManager->getWAL()->isFullLogging()) {
+        std::vector<uint8_t> payload;
+        for (const auto& tuple : columnRows) {
+            payload.clear();
+            putFixed<uint32_t>(payload, schema.tableId);
+            tuple.serialize(payload);
+            txnManager->logOperation(txnId, WALRecordType::INSERT, payload);
+        }
+    }
+    
+    uint64_t first;
+    if (lsm) {
+        if (!storage->getLSMStore()->ingest(schema.tableId, columnRows, &first)) {
+            return fail("failed to write run for table " + schema.tableName);
+        }
+    } else if (!storage->getColumnStore()->appendBlock(schema.tableId, columnRows, &first)) {
+        return fail("failed to write column block for table " + schema.tableName);
+    }
+    columnBlocks.emplace_back(first, columnRows.size());
+    columnRows.clear();
+    return true;
+}
+
+bool BulkLoader::endCSVRow() {
+    csvFields.push_back(csvField);
+    csvFieldQuoted.push_back(csvQuoted);
+    csvField.clear();
+    csvQuoted = false;
+    
+    // Blank line
+    if (csvFields.size() == 1 && csvFields[0].empty() && !csvFieldQuoted[0]) {
+        csvFields.clear();
+        csvFieldQuoted.clear();
+        return true;
+    }
+    
+    std::vector<Value> values;
+    values.reserve(csvFields.size());
+    for (size_t i = 0; i < csvFields.size(); i++) {
+        if (csvFields[i].empty() && !csvFieldQuoted[i]) {
+            values.emplace_back();
+        } else {
+            DataType type = i < schema.columns.size() ? schema.columns[i].type : DataType::TYPE_STRING;
+            values.emplace_back();
+            // The rule INSERT applies: a value that is not wholly a number is refused, not read as 0
+            if (!Value::parseText(csvFields[i], type, values.back())) {
+                std::string message = "row " + std::to_string(rowsLoaded + 1) + ": cannot store '" + csvFields[i] +
+                                      "' in column " + schema.columns[i].name;
+                csvFields.clear();
+                csvFieldQuoted.clear();
+                return fail(message);
+            }
+        }
+    }
+    csvFields.clear();
+    csvFieldQuoted.clear();
+    
+    return addRow(values);
+}
+
+// RFC 4180 style: comma separated, "" escapes a quote inside a quoted field,
+// quoted fields may span lines and chunk boundaries. An empty unquoted field is NULL.
+bool BulkLoader::feedCSV(const uint8_t* data, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        char c = static_cast<char>(data[i]);
+        
+        if (csvInQuotes) {
+            if (c == '"') {
+                csvInQuotes = false;
+                csvAfterQuote = true;
+            } else {
+                csvField.push_back(c);
+            }
+            continue;
+        }
+        
+        if (c == '"') {
+            if (csvAfterQuote) csvField.push_back('"');
+            csvInQuotes = true;
+            csvQuoted = true;
+            csvAfterQuote = false;
+            continue;
+        }
+        csvAfterQuote = false;
+        
+        if (c == ',') {
+            csvFields.push_back(csvField);
+            csvFieldQuoted.push_back(csvQuoted);
+            csvField.clear();
+            csvQuoted = false;
+        } else if (c == '\n') {
+            if (!endCSVRow()) return false;
+        } else if (c != '\r') {
+            // Copy the run of plain characters in one go
+            size_t end = i + 1;
+            while (end < length && data[end] != ',' && data[end] != '\n' &&
+                   data[end] != '\r' && data[end] != '"') {
+                end++;
+            }
+            csvField.append(reinterpret_cast<const char*>(data + i), end - i);
+            i = end - 1;
+        }
+    }
+    return true;
+}
+
+// Size of one encoded Value starting at data[0], or 0 if it is truncated/invalid
+static size_t encodedValueSize(const uint8_t* data, size_t available) {
+    if (available < 1) return 0;
+    
+    switch (static_cast<DataType>(data[0])) {
+        case DataType::TYPE_NULL:
+            return 1;
+        case DataType::TYPE_BOOLEAN:
+            return available >= 2 ? 2 : 0;
+        case DataType::TYPE_INT8:
+        case DataType::TYPE_INT16:
+        case DataType::TYPE_INT32:
+        case DataType::TYPE_INT64:
+        case DataType::TYPE_TIMESTAMP:
+        case DataType::TYPE_FLOAT:
+        case DataType::TYPE_DOUBLE:
+            return available >= 9 ? 9 : 0;
+        case DataType::TYPE_STRING:
+        case DataType::TYPE_BINARY:
+        case DataType::TYPE_JSON: {
+            if (available < 5) return 0;
+            uint32_t len;
+            memcpy(&len, data + 1, sizeof(len));
+            return available - 5 >= len ? 5 + len : 0;
+        }
+    }
+    return 0;
+}
+
+bool BulkLoader::feedBinary(const uint8_t* data, size_t length) {
+    binaryCarry.insert(binaryCarry.end(), data, data + length);
+    
+    size_t offset = 0;
+    while (binaryCarry.size() - offset >= sizeof(uint32_t)) {
+        uint32_t rowLength;
+        memcpy(&rowLength, binaryCarry.data() + offset, sizeof(rowLength));
+        if (binaryCarry.size() - offset - sizeof(uint32_t) < rowLength) break;
+        
+        const uint8_t* row = binaryCarry.data() + offset + sizeof(uint32_t);
+        std::vector<Value> values;
+        size_t pos = 0;
+        while (pos < rowLength) {
+            size_t size = encodedValueSize(row + pos, rowLength - pos);
+            if (size == 0) {
+                return fail("malformed binary row " + std::to_string(rowsLoaded + 1));
+            }
+            values.push_back(Value::deserialize(row, pos));
+        }
+        
+        offset += sizeof(uint32_t) + rowLength;
+        if (!addRow(values)) return false;
+    }
+    
+    binaryCarry.erase(binaryCarry.begin(), binaryCarry.begin() + offset);
+    return true;
+}
+
+bool BulkLoader::finish() {
+    if (finished) return !failed;
+    
+    if (!failed) {
+        if (format == CopyFormat::CSV && (!csvField.empty() || !csvFields.empty() || csvQuoted)) {
+            if (csvInQuotes) fail("unterminated quoted field at end of input");
+            else endCSVRow();
+        }
+        if (format == CopyFormat::BINARY && !binaryCarry.empty()) {
+            fail("truncated binary row at end of input");
+        }
+    }
+    
+    if (!failed && currentPage.header.itemCount > 0) {
+        pendingPages.push_back(currentPage);
+        currentPage.initialize(0, schema.tableId);
+    }
+    if (!failed) flushPages();
+    if (!failed) flushColumns();
+    
+    if (!failed) {
+        for (size_t i = 0; i < indexes.size(); i++) {
+            for (auto& entry : indexKeys[i]) {
+                if (columnar || lsm) {
+                    const auto& block = columnBlocks[entry.second / COLUMN_BLOCK_ROWS];
+                    uint64_t ordinal = block.first + entry.second % COLUMN_BLOCK_ROWS;
+                    entry.second = lsm ? makeLSMTupleId(ordinal) : makeColumnTupleId(ordinal);
+                } else {
+                    entry.second = makeTupleId(writtenPages[tupleIdPage(entry.second)],
+                                               tupleIdSlot(entry.second));
+                }
+            }
+            std::string indexError;
+            if (!indexes[i]->bulkInsert(indexKeys[i], indexError)) {
+                fail(indexError);
+                break;
+            }
+            indexesLoaded++;
+        }
+    }
+    
+    if (failed) {
+        abort();
+        return false;
+    }
+    
+    if (columnar || lsm || minimalLogging) {
+        // Column blocks and LSM runs are not logged; they are durable once
+        // synced, and their BULK_LOAD record names no pages
+        storage->sync();
+        
+        uint32_t firstPage = writtenPages.empty() ? 0 : writtenPages.front();
+        uint32_t pageCount = writtenPages.size();
+        std::vector<uint8_t> payload(3 * sizeof(uint32_t));
+        memcpy(payload.data(), &schema.tableId, sizeof(uint32_t));
+        memcpy(payload.data() + 4, &firstPage, sizeof(uint32_t));
+        memcpy(payload.data() + 8, &pageCount, sizeof(uint32_t));
+        txnManager->logOperation(txnId, WALRecordType::BULK_LOAD, payload);
+    }
+    
+    queryEngine->updateRowCount(schema.tableName, rowsLoaded);
+    if (ownsTxn) {
+        txnManager->commit(txnId);
+    } else {
+        // The client's transaction may still roll back; the rows and index
+        // keys are taken back then. Indexes are found again by name, since
+        // one may be dropped before the rollback.
+        std::vector<std::string> indexNames;
+        for (auto* index : indexes) indexNames.push_back(index->getName());
+        txnManager->addUndoAction(txnId, [engine = queryEngine, storage = storage, tableId = schema.tableId,
+                                          table = schema.tableName, lsm = lsm, rows = rowsLoaded,
+                                          pages = writtenPages, items = writtenItems, blocks = columnBlocks,
+                                          indexNames, keys = std::move(indexKeys)]() {
+            unloadRows(storage, tableId, lsm, pages, items, blocks);
+            for (auto* index : engine->getIndexes(tableId)) {
+                for (size_t i = 0; i < indexNames.size(); i++) {
+                    if (index->getName() != indexNames[i]) continue;
+                    for (const auto& [key, tupleId] : keys[i]) index->remove(key, tupleId);
+                }
+            }
+            engine->updateRowCount(table, -static_cast<int64_t>(rows));
+        });
+    }
+    
+    // Time-series rows load through the pages like any row table and are
+    // sealed into chunks once committed; rows of a transaction still open
+    // wait for a later seal
+    if (schema.storageMode == StorageMode::TIMESERIES) queryEngine->sealSeries(schema);
+    
+    finished = true;
+    return true;
+}
+
+// Rows already written are flagged deleted, and keys already indexed removed
+void BulkLoader::abort() {
+    if (finished) return;
+    finished = true;
+    
+    unloadRows(storage, schema.tableId, lsm, writtenPages, writtenItems, columnBlocks);
+    for (size_t i = 0; i < indexesLoaded; i++) {
+        for (const auto& [key, tupleId] : indexKeys[i]) indexes[i]->remove(key, tupleId);
+    }
+    writtenPages.clear();
+    writtenItems.clear();
+    pendingPages.clear();
+    columnBlocks.clear();
+    columnRows.clear();
+    
+    if (ownsTxn) txnManager->rollback(txnId);
+}
+
+} // namespace hybriddb
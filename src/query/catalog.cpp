@@ -0,0 +1,409 @@
+#include "../include/hybriddb.h"
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+#include <algorithm>
+#ifndef PLATFORM_WINDOWS
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace hybriddb {
+
+// ============================================================================
+// CATALOG
+// ============================================================================
+//
+// Readers take the published Catalog with one atomic load and never lock;
+// DDL serializes on catalogMutex, builds the next version from a copy of the
+// current one (entries are shared pointers, so a copy is one map of
+// pointers) and swaps it in. Row counters are atomics shared between
+// versions, so inserts never touch the catalog at all.
+//
+// File: "HDBC", format version (4), catalog version (8), next table id (4),
+// table count (4), CRC-32 of the file with this field zeroed (4), padding
+// (8), then the tables and the views. It is written to a temporary file,
+// synced and renamed over the old one, so a crash leaves one version or the
+// other.
+//
+// Table entry:
+//   table id (4), name, flags (1: document mode, bloom filters), storage
+//   mode (1), compression (1), chunk interval (8), retention (8), row count
+//   (8), next row id (8), primary key column, column count (varint) x
+//   [name, type (1), flags (1: nullable, primary key, unique), default
+//   value], index count (varint) x [name, column, path count (varint) x
+//   name, flags (1: unique, full-text)], statistics flag (1) and
+//   TableStatistics, shard count (varint) x address
+// Views: count (varint) x [name, table, definition]
+// Strings are a varint length and the bytes.
+
+namespace {
+
+const char CATALOG_MAGIC[4] = {'H', 'D', 'B', 'C'};
+const size_t CATALOG_HEADER = 36;
+const size_t CATALOG_CHECKSUM_AT = 24;
+
+uint32_t crc32(const uint8_t* data, size_t length, uint32_t crc = 0) {
+    static const auto table = []() {
+        std::vector<uint32_t> entries(256);
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            entries[i] = c;
+        }
+        return entries;
+    }();
+    crc = ~crc;
+    for (size_t i = 0; i < length; i++) crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+void putString(std::vector<uint8_t>& out, const std::string& s) {
+    putVarint(out, s.size());
+    putBytes(out, s.data(), s.size());
+}
+
+std::string getString(ByteReader& in) {
+    return in.string(in.varint());
+}
+
+// Read-only mapping of a whole file, unmapped when it goes out of scope
+class MappedFile {
+private:
+    const uint8_t* data;
+    size_t size;
+#ifdef PLATFORM_WINDOWS
+    HANDLE file;
+    HANDLE mapping;
+#else
+    int fd;
+#endif
+
+public:
+#ifdef PLATFORM_WINDOWS
+    MappedFile() : data(nullptr), size(0), file(INVALID_HANDLE_VALUE), mapping(NULL) {}
+    
+    ~MappedFile() {
+        if (data) UnmapViewOfFile(data);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+    }
+    
+    // False with missing set if there is no such file
+    bool open(const std::string& path, bool& missing) {
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                           FILE_ATTRIBUTE_NORMAL, NULL);
+        missing = file == INVALID_HANDLE_VALUE && GetLastError() == ERROR_FILE_NOT_FOUND;
+        if (file == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER length;
+        if (!GetFileSizeEx(file, &length) || length.QuadPart == 0) return false;
+        size = static_cast<size_t>(length.QuadPart);
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (!mapping) return false;
+        data = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        return data != nullptr;
+    }
+#else
+    MappedFile() : data(nullptr), size(0), fd(-1) {}
+    
+    ~MappedFile() {
+        if (data) munmap(const_cast<uint8_t*>(data), size);
+        if (fd >= 0) close(fd);
+    }
+    
+    // False with missing set if there is no such file
+    bool open(const std::string& path, bool& missing) {
+        fd = ::open(path.c_str(), O_RDONLY);
+        missing = fd < 0 && errno == ENOENT;
+        if (fd < 0) return false;
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size == 0) return false;
+        size = static_cast<size_t>(info.st_size);
+        void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped == MAP_FAILED) return false;
+        data = static_cast<const uint8_t*>(mapped);
+        return true;
+    }
+#endif
+    
+    const uint8_t* bytes() const { return data; }
+    size_t length() const { return size; }
+};
+
+// The file's data, then the directory entry the rename made, reach the disk
+bool syncFile(const std::string& path) {
+#ifdef PLATFORM_WINDOWS
+    (void)path;
+    return true;
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    bool synced = fsync(fd) == 0;
+    close(fd);
+    return synced;
+#endif
+}
+
+} // namespace
+
+void TableSchema::serialize(std::vector<uint8_t>& out) const {
+    putFixed<uint32_t>(out, tableId);
+    putString(out, tableName);
+    out.push_back((isDocumentMode ? 1 : 0) | (bloomFilters ? 2 : 0));
+    out.push_back(static_cast<uint8_t>(storageMode));
+    out.push_back(static_cast<uint8_t>(compression));
+    putFixed<int64_t>(out, series.chunkInterval);
+    putFixed<int64_t>(out, series.retention);
+    putFixed<uint64_t>(out, rowCount);
+    putFixed<uint64_t>(out, nextRowId);
+    putString(out, primaryKeyColumn);
+    
+    putVarint(out, columns.size());
+    for (const auto& col : columns) {
+        putString(out, col.name);
+        out.push_back(static_cast<uint8_t>(col.type));
+        out.push_back((col.nullable ? 1 : 0) | (col.primaryKey ? 2 : 0) | (col.unique ? 4 : 0));
+        col.defaultValue.serialize(out);
+    }
+    
+    putVarint(out, indexes.size());
+    for (const auto& index : indexes) {
+        putString(out, index.name);
+        putString(out, index.column);
+        putVarint(out, index.path.size());
+        for (const auto& part : index.path) putString(out, part);
+        out.push_back((index.unique ? 1 : 0) | (index.fulltext ? 2 : 0));
+    }
+    
+    out.push_back(statistics ? 1 : 0);
+    if (statistics) statistics->serialize(out);
+    
+    putVarint(out, shards.size());
+    for (const auto& shard : shards) putString(out, shard);
+}
+
+bool TableSchema::deserialize(const uint8_t* data, size_t length, size_t& offset, TableSchema& schema) {
+    if (offset > length) return false;
+    ByteReader in(data + offset, length - offset);
+    
+    schema.tableId = in.get<uint32_t>();
+    schema.tableName = getString(in);
+    uint8_t flags = in.get<uint8_t>();
+    schema.isDocumentMode = flags & 1;
+    schema.bloomFilters = flags & 2;
+    schema.storageMode = static_cast<StorageMode>(in.get<uint8_t>());
+    schema.compression = static_cast<PageCompression>(in.get<uint8_t>());
+    schema.series.chunkInterval = in.get<int64_t>();
+    schema.series.retention = in.get<int64_t>();
+    schema.rowCount = in.get<uint64_t>();
+    schema.nextRowId = in.get<uint64_t>();
+    schema.primaryKeyColumn = getString(in);
+    if (schema.storageMode > StorageMode::TIMESERIES || schema.compression > PageCompression::LZ4) return false;
+    
+    schema.columns.clear();
+    uint64_t count = in.varint();
+    for (uint64_t c = 0; c < count && in.ok(); c++) {
+        ColumnDef col;
+        col.name = getString(in);
+        col.type = static_cast<DataType>(in.get<uint8_t>());
+        uint8_t bits = in.get<uint8_t>();
+        col.nullable = bits & 1;
+        col.primaryKey = bits & 2;
+        col.unique = bits & 4;
+        col.defaultValue = in.value();
+        schema.columns.push_back(std::move(col));
+    }
+    
+    schema.indexes.clear();
+    count = in.varint();
+    for (uint64_t i = 0; i < count && in.ok(); i++) {
+        IndexDef index;
+        index.name = getString(in);
+        index.column = getString(in);
+        uint64_t parts = in.varint();
+        for (uint64_t p = 0; p < parts && in.ok(); p++) index.path.push_back(getString(in));
+        uint8_t bits = in.get<uint8_t>();
+        index.unique = bits & 1;
+        index.fulltext = bits & 2;
+        schema.indexes.push_back(std::move(index));
+    }
+    
+    schema.statistics.reset();
+    if (in.get<uint8_t>() && in.ok()) {
+        auto stats = std::make_shared<TableStatistics>();
+        size_t at = in.consumed(data + offset);
+        if (!stats->deserialize(data + offset, length - offset, at)) return false;
+        in.take(at - in.consumed(data + offset));
+        schema.statistics = std::move(stats);
+    }
+    
+    schema.shards.clear();
+    count = in.varint();
+    for (uint64_t s = 0; s < count && in.ok(); s++) schema.shards.push_back(getString(in));
+    
+    if (!in.ok()) return false;
+    offset += in.consumed(data + offset);
+    return true;
+}
+
+TableSchema QueryEngine::withCounters(const Catalog::Entry& entry) {
+    TableSchema schema = *entry.schema;
+    schema.rowCount = entry.counters->rowCount.load(std::memory_order_relaxed);
+    schema.nextRowId = entry.counters->nextRowId.load(std::memory_order_relaxed);
+    return schema;
+}
+
+// Caller holds catalogMutex. Readers that loaded the previous version keep it
+// until they are done. A save that fails leaves the change in memory only.
+void QueryEngine::publishCatalog(std::shared_ptr<Catalog> next) {
+    next->version = currentCatalog()->version + 1;
+    std::shared_ptr<const Catalog> published = std::move(next);
+    std::atomic_store(&catalog, published);
+    
+    std::string error;
+    if (!catalogPath.empty() && catalogError.empty() && !writeCatalog(*published, error)) {
+        std::cerr << "Cannot save the catalog: " << error << "\n";
+    }
+}
+
+bool replaceFile(const std::string& path, const std::vector<uint8_t>& bytes, std::string& error) {
+    std::string temporary = path + ".tmp";
+    std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+    file.close();
+    if (!file || !syncFile(temporary)) {
+        error = "cannot write " + temporary;
+        return false;
+    }
+#ifdef PLATFORM_WINDOWS
+    remove(path.c_str());
+#endif
+    if (rename(temporary.c_str(), path.c_str()) != 0) {
+        error = "cannot rename " + temporary + " to " + path;
+        return false;
+    }
+    size_t slash = path.find_last_of("/\\");
+    syncFile(slash == std::string::npos ? "." : path.substr(0, slash));
+    return true;
+}
+
+bool QueryEngine::writeCatalog(const Catalog& current, std::string& error) {
+    std::vector<uint8_t> bytes(CATALOG_HEADER, 0);
+    memcpy(bytes.data(), CATALOG_MAGIC, sizeof(CATALOG_MAGIC));
+    uint32_t format = CATALOG_FORMAT_VERSION;
+    uint32_t nextTableId = tableIdCounter.load();
+    uint32_t count = static_cast<uint32_t>(current.tables.size());
+    memcpy(&bytes[4], &format, 4);
+    memcpy(&bytes[8], &current.version, 8);
+    memcpy(&bytes[16], &nextTableId, 4);
+    memcpy(&bytes[20], &count, 4);
+    for (const auto& [name, entry] : current.tables) withCounters(entry).serialize(bytes);
+    putVarint(bytes, current.views.size());
+    for (const auto& [name, view] : current.views) {
+        putString(bytes, name);
+        putString(bytes, view.table);
+        putString(bytes, view.definition);
+    }
+    uint32_t checksum = crc32(bytes.data(), bytes.size());
+    memcpy(&bytes[CATALOG_CHECKSUM_AT], &checksum, 4);
+    return replaceFile(catalogPath, bytes, error);
+}
+
+bool QueryEngine::saveCatalog() {
+    if (catalogPath.empty() || !catalogError.empty()) return false;
+    std::unique_lock<std::shared_mutex> lock(catalogMutex);
+    std::string error;
+    if (!writeCatalog(*currentCatalog(), error)) {
+        std::cerr << "Cannot save the catalog: " << error << "\n";
+        return false;
+    }
+    return true;
+}
+
+// Maps the file and decodes the tables straight out of the mapping. No
+// file yet is an empty catalog. The caller rebuilds the indexes.
+bool QueryEngine::loadCatalog(std::string& error) {
+    MappedFile file;
+    bool missing = false;
+    if (!file.open(catalogPath, missing)) {
+        if (missing) return true;
+        error = "cannot read " + catalogPath;
+        return false;
+    }
+    const uint8_t* data = file.bytes();
+    size_t length = file.length();
+    
+    // Catalogs of older versions were a table count and that many empty
+    // entries; they never held a table
+    uint32_t legacyCount = 0;
+    if (length >= 4) memcpy(&legacyCount, data, 4);
+    if (length == 4 + 4 * static_cast<size_t>(legacyCount) &&
+        std::all_of(data + 4, data + length, [](uint8_t b) { return b == 0; })) {
+        return true;
+    }
+    
+    if (length < CATALOG_HEADER || memcmp(data, CATALOG_MAGIC, sizeof(CATALOG_MAGIC)) != 0) {
+        error = catalogPath + " is not a catalog file";
+        return false;
+    }
+    uint32_t format, nextTableId, count, checksum;
+    uint64_t version;
+    memcpy(&format, data + 4, 4);
+    memcpy(&version, data + 8, 8);
+    memcpy(&nextTableId, data + 16, 4);
+    memcpy(&count, data + 20, 4);
+    memcpy(&checksum, data + CATALOG_CHECKSUM_AT, 4);
+    if (format > CATALOG_FORMAT_VERSION) {
+        error = catalogPath + " has format " + std::to_string(format) + ", newer than this server reads";
+        return false;
+    }
+    const uint8_t zeros[4] = {};
+    uint32_t actual = crc32(data, CATALOG_CHECKSUM_AT);
+    actual = crc32(zeros, 4, actual);
+    actual = crc32(data + CATALOG_CHECKSUM_AT + 4, length - CATALOG_CHECKSUM_AT - 4, actual);
+    if (actual != checksum) {
+        error = catalogPath + " is damaged: checksum mismatch";
+        return false;
+    }
+    
+    auto loaded = std::make_shared<Catalog>();
+    loaded->version = version;
+    size_t offset = CATALOG_HEADER;
+    uint32_t highest = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        TableSchema schema;
+        if (!TableSchema::deserialize(data, length, offset, schema)) {
+            error = catalogPath + " is damaged: table entry " + std::to_string(i) + " is malformed";
+            return false;
+        }
+        highest = std::max(highest, schema.tableId);
+        
+        Catalog::Entry entry;
+        entry.counters = std::make_shared<TableCounters>();
+        entry.counters->rowCount = schema.rowCount;
+        entry.counters->nextRowId = schema.nextRowId;
+        std::string name = schema.tableName;
+        entry.schema = std::make_shared<const TableSchema>(std::move(schema));
+        loaded->tables[name] = std::move(entry);
+    }
+    
+    ByteReader in(data + offset, length - offset);
+    uint64_t views = in.varint();
+    for (uint64_t v = 0; v < views && in.ok(); v++) {
+        std::string name = getString(in);
+        Catalog::View& view = loaded->views[name];
+        view.table = getString(in);
+        view.definition = getString(in);
+    }
+    if (!in.ok()) {
+        error = catalogPath + " is damaged: the view entries are malformed";
+        return false;
+    }
+    
+    tableIdCounter = std::max({tableIdCounter.load(), nextTableId, highest + 1});
+    std::atomic_store(&catalog, std::shared_ptr<const Catalog>(std::move(loaded)));
+    return true;
+}
+
+} // namespace hybriddb
@@ -0,0 +1,2201 @@
+#include "../include/hybriddb.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+namespace hybriddb {
+
+// ============================================================================
+// EXPRESSION EVALUATION
+// ============================================================================
+
+static bool isTruthy(const Value& v) {
+    switch (v.type) {
+        case DataType::TYPE_NULL: return false;
+        case DataType::TYPE_BOOLEAN: return v.boolVal;
+        case DataType::TYPE_FLOAT:
+        case DataType::TYPE_DOUBLE: return v.doubleVal != 0.0;
+        case DataType::TYPE_STRING: return !v.stringVal.empty();
+        case DataType::TYPE_BINARY:
+        case DataType::TYPE_JSON: return !v.binaryVal.empty();
+        default: return v.intVal != 0;
+    }
+}
+
+// SQL LIKE: % matches any run, _ matches one character
+static bool likeMatch(const std::string& text, const std::string& pattern) {
+    size_t t = 0, p = 0;
+    size_t starP = std::string::npos, starT = 0;
+    
+    while (t < text.size()) {
+        if (p < pattern.size() && (pattern[p] == '_' || pattern[p] == text[t])) {
+            t++;
+            p++;
+        } else if (p < pattern.size() && pattern[p] == '%') {
+            starP = p++;
+            starT = t;
+        } else if (starP != std::string::npos) {
+            p = starP + 1;
+            t = ++starT;
+        } else {
+            return false;
+        }
+    }
+    while (p < pattern.size() && pattern[p] == '%') p++;
+    return p == pattern.size();
+}
+
+Value Expr::evaluate(const Tuple& tuple) const {
+    switch (type) {
+        case ExprType::LITERAL:
+            return value;
+        case ExprType::COLUMN: {
+            auto it = tuple.columns.find(column);
+            if (it == tuple.columns.end()) return Value();
+            if (path.empty()) return it->second;
+            
+            Value field;
+            JSONDocument::extract(it->second, path, field);
+            return field;
+        }
+        case ExprType::COMPARE: {
+            Value left = children[0]->evaluate(tuple);
+            Value right = children[1]->evaluate(tuple);
+            if (left.isNull() || right.isNull()) return Value();
+            
+            int c = left.compare(right);
+            switch (op) {
+                case CompareOp::EQ: return Value(c == 0);
+                case CompareOp::NE: return Value(c != 0);
+                case CompareOp::LT: return Value(c < 0);
+                case CompareOp::LE: return Value(c <= 0);
+                case CompareOp::GT: return Value(c > 0);
+                case CompareOp::GE: return Value(c >= 0);
+            }
+            return Value();
+        }
+        case ExprType::AND:
+            return Value(children[0]->matches(tuple) && children[1]->matches(tuple));
+        case ExprType::OR:
+            return Value(children[0]->matches(tuple) || children[1]->matches(tuple));
+        case ExprType::NOT:
+            return Value(!children[0]->matches(tuple));
+        case ExprType::IS_NULL:
+            return Value(children[0]->evaluate(tuple).isNull() != negated);
+        case ExprType::LIKE: {
+            Value v = children[0]->evaluate(tuple);
+            if (v.isNull()) return Value();
+            return Value(likeMatch(v.toString(), value.stringVal) != negated);
+        }
+        case ExprType::MATCH: {
+            // Any query word among the row's words, the same test a full-text index applies
+            std::vector<std::string> words, query;
+            FullTextIndex::tokenize(children[0]->evaluate(tuple), words);
+            FullTextIndex::tokenize(value, query);
+            std::sort(words.begin(), words.end());
+            for (const auto& word : query) {
+                if (std::binary_search(words.begin(), words.end(), word)) return Value(true);
+            }
+            return Value(false);
+        }
+    }
+    return Value();
+}
+
+bool Expr::matches(const Tuple& tuple) const {
+    return isTruthy(evaluate(tuple));
+}
+
+// ============================================================================
+// RESULT ENCODING
+// ============================================================================
+
+void appendJSONString(std::string& out, const std::string& text) {
+    appendJSONString(out, text.data(), text.size());
+}
+
+void appendJSONString(std::string& out, const char* text, size_t length) {
+    out += '"';
+    for (size_t i = 0; i < length; i++) {
+        char c = text[i];
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char escaped[8];
+                    snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                    out += escaped;
+                } else {
+                    out += c;
+                }
+        }
+    }
+    out += '"';
+}
+
+void appendJSONValue(std::string& out, const Value& v) {
+    switch (v.type) {
+        case DataType::TYPE_NULL:
+            out += "null";
+            break;
+        case DataType::TYPE_BOOLEAN:
+            out += v.boolVal ? "true" : "false";
+            break;
+        case DataType::TYPE_FLOAT:
+        case DataType::TYPE_DOUBLE: {
+            // JSON has no NaN or infinity
+            if (!std::isfinite(v.doubleVal)) {
+                out += "null";
+                break;
+            }
+            char buffer[32];
+            snprintf(buffer, sizeof(buffer), "%.17g", v.doubleVal);
+            out += buffer;
+            break;
+        }
+        case DataType::TYPE_STRING:
+            appendJSONString(out, v.stringVal);
+            break;
+        case DataType::TYPE_JSON:
+            JSONDocument::toText(v.binaryVal.data(), v.binaryVal.size(), out);
+            break;
+        case DataType::TYPE_BINARY: {
+            static const char hex[] = "0123456789abcdef";
+            out += '"';
+            for (uint8_t b : v.binaryVal) {
+                out += hex[b >> 4];
+                out += hex[b & 0xF];
+            }
+            out += '"';
+            break;
+        }
+        default:
+            out += std::to_string(v.intVal);
+    }
+}
+
+// Schema columns in declaration order, then any extra document fields
+static void appendJSONRow(std::string& out, const TableSchema& schema,
+                          const std::vector<std::string>& columns, const Tuple& tuple) {
+    out += '{';
+    bool first = true;
+    auto emit = [&](const std::string& name, const Value& v) {
+        if (!first) out += ',';
+        first = false;
+        appendJSONString(out, name);
+        out += ':';
+        appendJSONValue(out, v);
+    };
+    
+    if (!columns.empty()) {
+        for (const auto& name : columns) {
+            auto it = tuple.columns.find(name);
+            if (it != tuple.columns.end()) {
+                emit(name, it->second);
+                continue;
+            }
+            
+            // Path projection such as data.email
+            Value field;
+            size_t dot = name.find('.');
+            if (dot != std::string::npos) {
+                it = tuple.columns.find(name.substr(0, dot));
+                if (it != tuple.columns.end()) {
+                    JSONDocument::extract(it->second, JSONDocument::splitPath(name.substr(dot + 1)), field);
+                }
+            }
+            emit(name, field);
+        }
+    } else {
+        for (const auto& col : schema.columns) {
+            auto it = tuple.columns.find(col.name);
+            emit(col.name, it != tuple.columns.end() ? it->second : Value());
+        }
+        if (schema.isDocumentMode) {
+            for (const auto& [name, v] : tuple.columns) {
+                bool declared = false;
+                for (const auto& col : schema.columns) {
+                    if (col.name == name) {
+                        declared = true;
+                        break;
+                    }
+                }
+                if (!declared) emit(name, v);
+            }
+        }
+    }
+    out += '}';
+}
+
+// Literals are typed loosely by the parser; bring them to the column's type
+static bool coerceValue(const Value& v, DataType type, Value& out) {
+    if (v.isNull() || v.type == type) {
+        out = v;
+        return true;
+    }
+    
+    if (v.type == DataType::TYPE_STRING && type == DataType::TYPE_JSON) {
+        std::string error;
+        out = Value();
+        out.type = DataType::TYPE_JSON;
+        return JSONDocument::encode(v.stringVal.data(), v.stringVal.size(), out.binaryVal, error);
+    }
+    
+    if (v.type == DataType::TYPE_STRING) {
+        if (type == DataType::TYPE_BINARY || type == DataType::TYPE_BOOLEAN ||
+            type == DataType::TYPE_TIMESTAMP) {
+            return Value::parseText(v.stringVal, type, out);
+        }
+        return false;
+    }
+    
+    if (isIntegerType(type) && isIntegerType(v.type)) {
+        out = v;
+        out.type = type;
+        return true;
+    }
+    if ((type == DataType::TYPE_FLOAT || type == DataType::TYPE_DOUBLE) && isNumericType(v.type)) {
+        out = Value(isIntegerType(v.type) ? static_cast<double>(v.intVal) : v.doubleVal);
+        out.type = type;
+        return true;
+    }
+    if (type == DataType::TYPE_STRING) {
+        out = Value(v.toString());
+        return true;
+    }
+    if (type == DataType::TYPE_JSON) {
+        std::string text;
+        appendJSONValue(text, v);
+        out = Value::fromText(text, type);
+        return true;
+    }
+    return false;
+}
+
+static bool coerceAssignments(const TableSchema& schema, const std::vector<std::string>& names,
+                              const std::vector<Value>& values, std::map<std::string, Value>& row,
+                              std::string& error) {
+    for (size_t i = 0; i < names.size(); i++) {
+        const ColumnDef* def = nullptr;
+        for (const auto& col : schema.columns) {
+            if (col.name == names[i]) {
+                def = &col;
+                break;
+            }
+        }
+        
+        if (!def) {
+            if (!schema.isDocumentMode) {
+                error = "unknown column " + names[i] + " in table " + schema.tableName;
+                return false;
+            }
+            row[names[i]] = values[i];
+            continue;
+        }
+        
+        if (!coerceValue(values[i], def->type, row[names[i]])) {
+            error = "cannot store '" + values[i].toString() + "' in column " + def->name;
+            return false;
+        }
+    }
+    return true;
+}
+
+// ============================================================================
+// STATEMENT EXECUTION
+// ============================================================================
+
+thread_local uint64_t QueryEngine::resultRows = 0;
+
+// Timed whole, parse included, for the query log
+bool QueryEngine::execute(const std::string& sql, uint64_t txnId, std::string& result, std::string& error) {
+    if (!queryLog) return executeSQL(sql, txnId, result, error);
+    
+    auto started = std::chrono::steady_clock::now();
+    uint64_t hits = Metrics::own(Counter::POOL_HITS);
+    uint64_t reads = Metrics::own(Counter::POOL_MISSES);
+    resultRows = 0;
+    bool ok = executeSQL(sql, txnId, result, error);
+    uint64_t nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - started).count();
+    queryLog->record(sql, nanos, resultRows, ok, Metrics::own(Counter::POOL_HITS) - hits,
+                     Metrics::own(Counter::POOL_MISSES) - reads);
+    return ok;
+}
+
+// A SELECT inside a client transaction could see the transaction's own
+// writes, so only statements on their own use the result cache. Nor do
+// sharded tables, whose writes happen on other nodes.
+bool QueryEngine::executeSQL(const std::string& sql, uint64_t txnId, std::string& result, std::string& error) {
+    Statement stmt;
+    if (!SQLParser::parse(sql, stmt, error)) return false;
+    if (!resultCache || txnId != 0 || stmt.type != StatementType::SELECT || stmt.explain != ExplainMode::NONE) {
+        return execute(stmt, txnId, result, error);
+    }
+    
+    TableSchema schema;
+    uint32_t tableId;
+    if (lookupTable(stmt.table, schema)) {
+        if (!schema.shards.empty()) return execute(stmt, txnId, result, error);
+        tableId = schema.tableId;
+    } else if (auto view = lookupView(stmt.table)) {
+        tableId = view->getSource().tableId;
+    } else {
+        return execute(stmt, txnId, result, error);
+    }
+    
+    std::string key;
+    uint64_t version;
+    bool cacheable = resultCache->snapshot(tableId, version) && SQLParser::normalize(sql, key);
+    if (!execute(stmt, txnId, result, error)) return false;
+    if (cacheable) resultCache->store(key, tableId, version, result);
+    return true;
+}
+
+void QueryEngine::setResultCache(ResultCache* cache) {
+    resultCache = cache;
+    if (!cache) {
+        txnManager->setWriteHook(nullptr);
+        return;
+    }
+    txnManager->setWriteHook([cache](uint32_t tableId, bool ended) {
+        if (ended) cache->writeEnded(tableId);
+        else cache->writeBegan(tableId);
+    });
+}
+
+bool QueryEngine::execute(const Statement& stmt, uint64_t txnId, std::string& result, std::string& error) {
+    result.clear();
+    if (stmt.explain != ExplainMode::NONE) return executeExplain(stmt, txnId, result, error);
+    switch (stmt.type) {
+        case StatementType::SELECT: Metrics::add(Counter::QUERIES_SELECT); break;
+        case StatementType::INSERT: Metrics::add(Counter::QUERIES_INSERT); break;
+        case StatementType::UPDATE: Metrics::add(Counter::QUERIES_UPDATE); break;
+        case StatementType::DELETE: Metrics::add(Counter::QUERIES_DELETE); break;
+        default: Metrics::add(Counter::QUERIES_OTHER); break;
+    }
+    LatencyTimer timer(Histogram::QUERY_EXECUTE);
+    
+    bool reads = stmt.type == StatementType::SELECT || stmt.type == StatementType::ANALYZE ||
+                 stmt.type == StatementType::REFRESH_VIEW;
+    std::shared_lock<std::shared_mutex> replaying(replayMutex, std::defer_lock);
+    if (readOnly) {
+        if (!reads) {
+            error = "read-only replica: writes go to the primary";
+            return false;
+        }
+        replaying.lock();
+        if (!replicaError.empty()) {
+            error = "replica is out of date: replication stopped: " + replicaError;
+            return false;
+        }
+    }
+    
+    if (shardRouter) {
+        TableSchema schema;
+        if (stmt.type == StatementType::CREATE_TABLE) return createSharded(stmt, result, error);
+        if (shardedTable(stmt, schema)) return executeSharded(stmt, schema, txnId, result, error);
+    }
+    
+    switch (stmt.type) {
+        case StatementType::CREATE_TABLE:
+        case StatementType::DROP_TABLE:
+            if (!executeCreate(stmt, result, error)) return false;
+            logSchema(stmt);
+            return true;
+        case StatementType::CREATE_INDEX:
+        case StatementType::DROP_INDEX:
+            if (!executeIndex(stmt, result, error)) return false;
+            logSchema(stmt);
+            return true;
+        case StatementType::SELECT:
+            return executeSelect(stmt, result, error);
+        case StatementType::ANALYZE:
+            return executeAnalyze(stmt, result, error);
+        case StatementType::CREATE_VIEW:
+        case StatementType::DROP_VIEW:
+        case StatementType::REFRESH_VIEW:
+            if (!executeView(stmt, result, error)) return false;
+            if (stmt.type != StatementType::REFRESH_VIEW) logSchema(stmt);
+            return true;
+        default:
+            break;
+    }
+    
+    // Writes outside an explicit transaction get their own, so a failing
+    // multi-row statement leaves nothing behind
+    bool ownsTxn = txnId == 0;
+    if (ownsTxn) txnId = txnManager->begin();
+    
+    bool ok = false;
+    switch (stmt.type) {
+        case StatementType::INSERT: ok = executeInsert(stmt, txnId, result, error); break;
+        case StatementType::UPDATE: ok = executeUpdate(stmt, txnId, result, error); break;
+        case StatementType::DELETE: ok = executeDelete(stmt, txnId, result, error); break;
+        default: break;
+    }
+    
+    if (ownsTxn) {
+        if (ok) txnManager->commit(txnId);
+        else txnManager->rollback(txnId);
+    }
+    return ok;
+}
+
+bool QueryEngine::executeCreate(const Statement& stmt, std::string& result, std::string& error) {
+    TableSchema schema;
+    bool exists = lookupTable(stmt.table, schema);
+    
+    if (stmt.type == StatementType::CREATE_TABLE) {
+        if (exists && !stmt.ifExists) {
+            error = "table " + stmt.table + " already exists";
+            return false;
+        }
+        if (!exists && lookupView(stmt.table)) {
+            error = "a view named " + stmt.table + " already exists";
+            return false;
+        }
+        if (!exists && stmt.storageMode == StorageMode::TIMESERIES) {
+            bool timed = false;
+            for (const auto& col : stmt.columnDefs) {
+                timed |= col.type == DataType::TYPE_TIMESTAMP;
+                if (col.primaryKey || col.unique) {
+                    error = "time-series tables cannot have PRIMARY KEY or UNIQUE columns";
+                    return false;
+                }
+            }
+            if (!timed) {
+                error = "a time-series table needs a TIMESTAMP column";
+                return false;
+            }
+        }
+        if (!exists && !createTable(stmt.table, stmt.columnDefs, stmt.documentMode, stmt.storageMode,
+                                    stmt.compression, stmt.series, stmt.bloomFilters)) {
+            error = "could not create table " + stmt.table;
+            return false;
+        }
+    } else {
+        if (!exists && !stmt.ifExists) {
+            error = "table not found: " + stmt.table;
+            return false;
+        }
+        if (exists && !dropTable(stmt.table)) {
+            error = "cannot drop " + stmt.table + " while a backup copies it";
+            return false;
+        }
+    }
+    
+    result = "{\"ok\":true}";
+    return true;
+}
+
+bool QueryEngine::executeIndex(const Statement& stmt, std::string& result, std::string& error) {
+    if (stmt.type == StatementType::CREATE_INDEX) {
+        TableSchema schema;
+        bool exists = false;
+        if (lookupTable(stmt.table, schema)) {
+            for (auto* index : getIndexes(schema.tableId)) {
+                if (index->getName() == stmt.index.name) exists = true;
+            }
+        }
+        if (!(exists && stmt.ifExists) && !createIndex(stmt.table, stmt.index, error)) return false;
+    } else if (!dropIndex(stmt.index.name, error)) {
+        if (!stmt.ifExists) return false;
+        error.clear();
+    }
+    
+    result = "{\"ok\":true}";
+    return true;
+}
+
+// Statistics are gathered from a catalog snapshot and installed whole in a
+// new version; a table dropped or recreated meanwhile keeps what it has
+bool QueryEngine::executeAnalyze(const Statement& stmt, std::string& result, std::string& error) {
+    std::vector<TableSchema> tables;
+    if (stmt.table.empty()) {
+        for (const auto& [name, entry] : currentCatalog()->tables) tables.push_back(withCounters(entry));
+    } else {
+        TableSchema schema;
+        if (!lookupTable(stmt.table, schema)) {
+            error = "table not found: " + stmt.table;
+            return false;
+        }
+        tables.push_back(schema);
+    }
+    
+    result = "[";
+    for (const auto& schema : tables) {
+        std::shared_ptr<TableStatistics> stats = analyzeTable(schema);
+        {
+            std::unique_lock<std::shared_mutex> lock(catalogMutex);
+            auto next = std::make_shared<Catalog>(*currentCatalog());
+            auto it = next->tables.find(schema.tableName);
+            if (it == next->tables.end() || it->second.schema->tableId != schema.tableId) continue;
+            auto changed = std::make_shared<TableSchema>(*it->second.schema);
+            changed->statistics = stats;
+            it->second.schema = std::move(changed);
+            it->second.counters->rowCount = stats->rows;
+            publishCatalog(next);
+        }
+        
+        if (result.size() > 1) result += ",";
+        result += "{\"table\":";
+        appendJSONString(result, schema.tableName);
+        result += ",\"rows\":" + std::to_string(stats->rows) + ",\"sampled\":" + std::to_string(stats->sampled) +
+                  ",\"columns\":{";
+        for (size_t i = 0; i < stats->columns.size(); i++) {
+            const ColumnStatistics& col = stats->columns[i];
+            if (i) result += ",";
+            appendJSONString(result, col.column);
+            result += ":{\"distinct\":";
+            appendJSONValue(result, Value(static_cast<int64_t>(std::llround(col.distinct))));
+            result += ",\"nullFraction\":";
+            appendJSONValue(result, Value(col.nullFraction));
+            result += ",\"mostCommon\":" + std::to_string(col.mostCommon.size()) +
+                      ",\"buckets\":" + std::to_string(col.histogram.empty() ? 0 : col.histogram.size() - 1) + "}";
+        }
+        result += "}}";
+    }
+    result += "]";
+    return true;
+}
+
+bool QueryEngine::executeInsert(const Statement& stmt, uint64_t txnId, std::string& result, std::string& error) {
+    TableSchema schema;
+    if (!lookupTable(stmt.table, schema)) {
+        error = "table not found: " + stmt.table;
+        return false;
+    }
+    
+    std::vector<std::string> names = stmt.columns;
+    if (names.empty()) {
+        for (const auto& col : schema.columns) names.push_back(col.name);
+    }
+    
+    uint64_t affected = 0;
+    for (const auto& values : stmt.rows) {
+        if (values.size() != names.size()) {
+            error = "expected " + std::to_string(names.size()) + " values, got " + std::to_string(values.size());
+            return false;
+        }
+        
+        std::map<std::string, Value> row;
+        if (!coerceAssignments(schema, names, values, row, error)) return false;
+        if (!insertRow(schema, row, txnId, error)) return false;
+        affected++;
+    }
+    
+    resultRows = affected;
+    result = "{\"affected\":" + std::to_string(affected) + "}";
+    return true;
+}
+
+// col op literal in either order, with op as seen from the column
+static bool literalComparison(const Expr* expr, const Expr*& col, CompareOp& op, Value& literal) {
+    if (expr->type != ExprType::COMPARE) return false;
+    col = expr->children[0].get();
+    const Expr* lit = expr->children[1].get();
+    op = expr->op;
+    if (col->type == ExprType::LITERAL) {
+        std::swap(col, lit);
+        switch (op) {
+            case CompareOp::LT: op = CompareOp::GT; break;
+            case CompareOp::LE: op = CompareOp::GE; break;
+            case CompareOp::GT: op = CompareOp::LT; break;
+            case CompareOp::GE: op = CompareOp::LE; break;
+            default: break;
+        }
+    }
+    if (col->type != ExprType::COLUMN || lit->type != ExprType::LITERAL) return false;
+    literal = lit->value;
+    return true;
+}
+
+// The full-text index able to answer the leading MATCH of a WHERE clause, if any
+static FullTextIndex* matchProbe(const std::vector<TableIndex*>& indexes, const Expr* where, const Expr*& match) {
+    match = where;
+    while (match && match->type == ExprType::AND) match = match->children[0].get();
+    if (!match || match->type != ExprType::MATCH) return nullptr;
+    
+    const Expr* col = match->children[0].get();
+    for (auto* index : indexes) {
+        if (index->isFullText() && index->covers(col->column, col->path)) {
+            return static_cast<FullTextIndex*>(index);
+        }
+    }
+    return nullptr;
+}
+
+// Defined with the column scan helpers below
+static std::function<bool(const PageSummary&)> pageFilter(const TableSchema& schema, const Expr* where);
+
+// Matching rows with their tuple ids, at most wanted of them, reached the
+// way planAccess finds cheapest: by tuple ids from an index, from the posting
+// lists of a full-text index, best matches first, or by a scan.
+ScratchVector<std::pair<uint64_t, Tuple>> QueryEngine::findRows(const TableSchema& schema, const Expr* where,
+                                                                size_t wanted) {
+    ScratchVector<std::pair<uint64_t, Tuple>> rows;
+    if (wanted == 0) return rows;
+    OperatorScope scan(PlanStage::SCAN);
+    AccessPlan plan = planAccess(schema, where, wanted);
+    CompiledPredicate filter(schema, where);
+    
+    if (plan.index) {
+        auto tupleIds = plan.range ? plan.index->lookupRange(plan.low, plan.lowInclusive, plan.high, plan.highInclusive)
+                                   : plan.index->lookup(plan.key);
+        for (uint64_t tupleId : tupleIds) {
+            Tuple tuple;
+            if (storage->readTuple(schema.tableId, tupleId, tuple) && filter.matches(tuple)) {
+                rows.emplace_back(tupleId, std::move(tuple));
+                if (rows.size() >= wanted) break;
+            }
+        }
+        scan.produced(rows.size());
+        return rows;
+    }
+    
+    if (FullTextIndex* index = plan.fullText) {
+        // When the MATCH is the whole WHERE only the top wanted need ranking
+        const Expr* match = plan.match;
+        size_t k = where == match ? wanted : SIZE_MAX;
+        for (const auto& hit : index->search(match->value.toString(), k)) {
+            Tuple tuple;
+            if (storage->readTuple(schema.tableId, hit.first, tuple) && (where == match || filter.matches(tuple))) {
+                rows.emplace_back(hit.first, std::move(tuple));
+                if (rows.size() >= wanted) break;
+            }
+        }
+        scan.produced(rows.size());
+        return rows;
+    }
+    
+    TableIterator iterator(storage, schema.tableId);
+    iterator.setPageFilter(pageFilter(schema, where));
+    Tuple tuple;
+    uint64_t tupleId;
+    while (iterator.next(tuple, &tupleId)) {
+        if (filter.matches(tuple)) {
+            rows.emplace_back(tupleId, std::move(tuple));
+            if (rows.size() >= wanted) break;
+        }
+    }
+    scan.produced(rows.size());
+    return rows;
+}
+
+// Column scans serve a WHERE the planner does not send to an index
+bool QueryEngine::useColumnScan(const TableSchema& schema, const Expr* where, size_t wanted) {
+    if (schema.storageMode != StorageMode::COLUMN && schema.storageMode != StorageMode::TIMESERIES) return false;
+    
+    AccessPlan plan = planAccess(schema, where, wanted);
+    return !plan.index && !plan.fullText;
+}
+
+// ============================================================================
+// COLUMN SCANS
+// ============================================================================
+
+namespace {
+
+// A WHERE conjunct evaluated on decoded column vectors: a plain column
+// compared with a literal, or a column IS [NOT] NULL
+struct VectorPredicate {
+    size_t slot;            // index into the decoded vectors
+    DataType type;          // declared column type
+    bool nullTest;
+    bool negated;
+    CompareOp op;
+    Value literal;
+};
+
+bool usesInts(DataType type) {
+    return isIntegerType(type) || type == DataType::TYPE_BOOLEAN;
+}
+
+double numericValue(const Value& v) {
+    if (v.type == DataType::TYPE_BOOLEAN) return v.boolVal ? 1.0 : 0.0;
+    return isIntegerType(v.type) ? static_cast<double>(v.intVal) : v.doubleVal;
+}
+
+void splitConjuncts(const Expr* expr, std::vector<const Expr*>& out) {
+    if (expr->type == ExprType::AND) {
+        splitConjuncts(expr->children[0].get(), out);
+        splitConjuncts(expr->children[1].get(), out);
+    } else {
+        out.push_back(expr);
+    }
+}
+
+void referencedColumns(const Expr* expr, std::vector<std::string>& out) {
+    if (expr->type == ExprType::COLUMN) out.push_back(expr->column);
+    for (const auto& child : expr->children) referencedColumns(child.get(), out);
+}
+
+size_t columnPosition(const TableSchema& schema, const std::string& name) {
+    for (size_t i = 0; i < schema.columns.size(); i++) {
+        if (schema.columns[i].name == name) return i;
+    }
+    return SIZE_MAX;
+}
+
+bool vectorPredicate(const Expr* expr, const TableSchema& schema, VectorPredicate& p, size_t& column) {
+    const Expr* col;
+    p.nullTest = expr->type == ExprType::IS_NULL;
+    p.negated = expr->negated;
+    if (p.nullTest) {
+        col = expr->children[0].get();
+    } else if (!literalComparison(expr, col, p.op, p.literal)) {
+        return false;
+    }
+    
+    if (col->type != ExprType::COLUMN || !col->path.empty()) return false;
+    column = columnPosition(schema, col->column);
+    if (column == SIZE_MAX) return false;
+    p.type = schema.columns[column].type;
+    return true;
+}
+
+// False when no row of a chunk with this zone map can satisfy the predicate
+bool zoneMayMatch(const VectorPredicate& p, const ZoneMap& zone) {
+    bool ordered = p.type != DataType::TYPE_JSON && p.type != DataType::TYPE_BINARY;
+    if (p.nullTest) return p.negated ? !ordered || !zone.min.isNull() : zone.nullCount > 0;
+    if (p.literal.isNull()) return false;
+    if (!ordered) return true;
+    if (zone.min.isNull()) return false;
+    
+    int low = p.literal.compare(zone.min);
+    int high = p.literal.compare(zone.max);
+    switch (p.op) {
+        case CompareOp::EQ: return low >= 0 && high <= 0;
+        case CompareOp::NE: return low != 0 || high != 0;
+        case CompareOp::LT: return low > 0;
+        case CompareOp::LE: return low >= 0;
+        case CompareOp::GT: return high < 0;
+        case CompareOp::GE: return high <= 0;
+    }
+    return true;
+}
+
+// Narrows [from, to] to the values of an integer column that can satisfy p;
+// used to pick time-series chunks and rollup buckets
+void narrowRange(const VectorPredicate& p, int64_t& from, int64_t& to) {
+    if (p.nullTest || p.negated || !isIntegerType(p.literal.type)) return;
+    
+    int64_t v = p.literal.intVal;
+    switch (p.op) {
+        case CompareOp::EQ: from = std::max(from, v); to = std::min(to, v); break;
+        case CompareOp::GE: from = std::max(from, v); break;
+        case CompareOp::LE: to = std::min(to, v); break;
+        case CompareOp::GT:
+            if (v == INT64_MAX) to = INT64_MIN;
+            else from = std::max(from, v + 1);
+            break;
+        case CompareOp::LT:
+            if (v == INT64_MIN) from = INT64_MAX;
+            else to = std::min(to, v - 1);
+            break;
+        case CompareOp::NE: break;
+    }
+}
+
+size_t timeColumnPosition(const TableSchema& schema) {
+    for (size_t i = 0; i < schema.columns.size(); i++) {
+        if (schema.columns[i].type == DataType::TYPE_TIMESTAMP) return i;
+    }
+    return SIZE_MAX;
+}
+
+// Keeps the selected rows that are not NULL and pass test(load(row)). The
+// comparisons are written the way Value::compare orders values, so NaN
+// behaves as it does on the row path.
+template <typename Load, typename Test>
+void narrow(std::vector<uint32_t>& selection, const ColumnVector& column, Load load, Test test) {
+    size_t kept = 0;
+    if (column.nulls.empty()) {
+        for (uint32_t row : selection) {
+            selection[kept] = row;
+            kept += test(load(row));
+        }
+    } else {
+        for (uint32_t row : selection) {
+            selection[kept] = row;
+            kept += !column.nulls[row] && test(load(row));
+        }
+    }
+    selection.resize(kept);
+}
+
+template <typename T, typename Load>
+void narrowCompare(std::vector<uint32_t>& selection, const ColumnVector& column, CompareOp op,
+                   T literal, Load load) {
+    switch (op) {
+        case CompareOp::EQ: narrow(selection, column, load, [literal](T v) { return !(v < literal) && !(v > literal); }); break;
+        case CompareOp::NE: narrow(selection, column, load, [literal](T v) { return v < literal || v > literal; }); break;
+        case CompareOp::LT: narrow(selection, column, load, [literal](T v) { return v < literal; }); break;
+        case CompareOp::LE: narrow(selection, column, load, [literal](T v) { return !(v > literal); }); break;
+        case CompareOp::GT: narrow(selection, column, load, [literal](T v) { return v > literal; }); break;
+        case CompareOp::GE: narrow(selection, column, load, [literal](T v) { return !(v < literal); }); break;
+    }
+}
+
+void applyPredicate(const VectorPredicate& p, const ColumnVector& column, std::vector<uint32_t>& selection) {
+    if (p.nullTest) {
+        size_t kept = 0;
+        for (uint32_t row : selection) {
+            selection[kept] = row;
+            kept += column.isNull(row) != p.negated;
+        }
+        selection.resize(kept);
+        return;
+    }
+    if (p.literal.isNull()) {
+        selection.clear();
+        return;
+    }
+    
+    // Same typing rules as Value::compare: integers compare exactly, mixed
+    // numerics as doubles, everything else through Value
+    if (isIntegerType(p.type) && isIntegerType(p.literal.type)) {
+        const int64_t* ints = column.ints.data();
+        narrowCompare<int64_t>(selection, column, p.op, p.literal.intVal,
+                               [ints](uint32_t row) { return ints[row]; });
+    } else if (isNumericType(p.type) && isNumericType(p.literal.type)) {
+        double literal = numericValue(p.literal);
+        if (usesInts(p.type)) {
+            const int64_t* ints = column.ints.data();
+            narrowCompare<double>(selection, column, p.op, literal,
+                                  [ints](uint32_t row) { return static_cast<double>(ints[row]); });
+        } else {
+            const double* doubles = column.doubles.data();
+            narrowCompare<double>(selection, column, p.op, literal,
+                                  [doubles](uint32_t row) { return doubles[row]; });
+        }
+    } else {
+        const Value& literal = p.literal;
+        CompareOp op = p.op;
+        narrow(selection, column, [&column, &literal](uint32_t row) { return column.get(row).compare(literal); },
+               [op](int c) {
+                   switch (op) {
+                       case CompareOp::EQ: return c == 0;
+                       case CompareOp::NE: return c != 0;
+                       case CompareOp::LT: return c < 0;
+                       case CompareOp::LE: return c <= 0;
+                       case CompareOp::GT: return c > 0;
+                       case CompareOp::GE: return c >= 0;
+                   }
+                   return false;
+               });
+    }
+}
+
+} // namespace
+
+// Rules out pages of a row table walk by their zone maps and bloom filters;
+// empty when no conjunct of the WHERE is a plain column test
+static std::function<bool(const PageSummary&)> pageFilter(const TableSchema& schema, const Expr* where) {
+    std::vector<std::pair<std::string, VectorPredicate>> predicates;
+    if (where) {
+        std::vector<const Expr*> conjuncts;
+        splitConjuncts(where, conjuncts);
+        for (const Expr* conjunct : conjuncts) {
+            VectorPredicate p;
+            size_t column;
+            if (vectorPredicate(conjunct, schema, p, column)) predicates.emplace_back(schema.columns[column].name, p);
+        }
+    }
+    if (predicates.empty()) return nullptr;
+    
+    return [predicates](const PageSummary& page) {
+        for (const auto& [name, p] : predicates) {
+            // A page's zone holds numbers or strings; a literal of the other
+            // kind orders by type, which min and max say nothing about
+            const ZoneMap* zone = page.zone(name);
+            bool comparable = zone && (p.nullTest || zone->min.isNull() || p.literal.isNull() ||
+                                       isNumericType(p.literal.type) == isNumericType(zone->min.type));
+            if (comparable && !zoneMayMatch(p, *zone)) return false;
+            if (!p.nullTest && p.op == CompareOp::EQ && !page.mayContain(name, p.literal)) return false;
+        }
+        return true;
+    };
+}
+
+void QueryEngine::scanColumns(const TableSchema& schema, const Expr* where, std::vector<size_t> columns,
+                              const std::function<bool(const std::vector<ColumnVector>&, const std::vector<uint32_t>&)>& onBlock,
+                              const std::function<bool(const Tuple&)>& onRow) {
+    OperatorScope scan(PlanStage::SCAN);
+    auto slotFor = [&](size_t column) {
+        auto it = std::find(columns.begin(), columns.end(), column);
+        if (it != columns.end()) return static_cast<size_t>(it - columns.begin());
+        columns.push_back(column);
+        return columns.size() - 1;
+    };
+    
+    std::vector<VectorPredicate> predicates;
+    std::vector<const Expr*> residual;
+    std::vector<std::pair<std::string, size_t>> residualColumns;    // name, slot
+    if (where) {
+        std::vector<const Expr*> conjuncts;
+        splitConjuncts(where, conjuncts);
+        for (const Expr* conjunct : conjuncts) {
+            VectorPredicate p;
+            size_t column;
+            if (vectorPredicate(conjunct, schema, p, column)) {
+                p.slot = slotFor(column);
+                predicates.push_back(p);
+                continue;
+            }
+            
+            // Anything else runs on rows rebuilt from the columns it references
+            residual.push_back(conjunct);
+            std::vector<std::string> names;
+            referencedColumns(conjunct, names);
+            for (const auto& name : names) {
+                size_t position = columnPosition(schema, name);
+                if (position == SIZE_MAX) continue;
+                bool seen = false;
+                for (const auto& entry : residualColumns) seen |= entry.first == name;
+                if (!seen) residualColumns.emplace_back(name, slotFor(position));
+            }
+        }
+    }
+    
+    CompiledPredicate residualFilter(schema, residual);
+    
+    std::vector<ColumnVector> data;
+    std::vector<uint8_t> deleted;
+    std::vector<uint32_t> selection;
+    Tuple tuple;
+    
+    auto pruned = [&](const std::vector<ZoneMap>& zones) {
+        for (const auto& p : predicates) {
+            if (columns[p.slot] < zones.size() && !zoneMayMatch(p, zones[columns[p.slot]])) return true;
+        }
+        return false;
+    };
+    
+    // Filters the decoded block in data; false once onBlock stops the scan
+    auto filterBlock = [&]() {
+        selection.clear();
+        for (uint32_t row = 0; row < deleted.size(); row++) {
+            if (!deleted[row]) selection.push_back(row);
+        }
+        for (const auto& p : predicates) {
+            if (selection.empty()) break;
+            applyPredicate(p, data[p.slot], selection);
+        }
+        if (!residual.empty()) {
+            size_t kept = 0;
+            for (uint32_t row : selection) {
+                for (const auto& [name, slot] : residualColumns) tuple.columns[name] = data[slot].get(row);
+                selection[kept] = row;
+                kept += residualFilter.matches(tuple);
+            }
+            selection.resize(kept);
+        }
+        scan.produced(selection.size());
+        return selection.empty() || onBlock(data, selection);
+    };
+    
+    if (schema.storageMode == StorageMode::TIMESERIES) {
+        // Chunks outside the time range are never looked at
+        size_t timeColumn = timeColumnPosition(schema);
+        int64_t from = INT64_MIN, to = INT64_MAX;
+        for (const auto& p : predicates) {
+            if (columns[p.slot] == timeColumn) narrowRange(p, from, to);
+        }
+        
+        TimeSeriesStore* series = storage->getTimeSeriesStore();
+        for (const auto& [handle, zones] : series->findSegments(schema.tableId, from, to)) {
+            if (pruned(zones)) continue;
+            if (!series->readSegment(schema.tableId, handle, columns, data, deleted)) continue;
+            if (!filterBlock()) return;
+        }
+    } else {
+        ColumnStore* store = storage->getColumnStore();
+        size_t blockCount = store->getBlockCount(schema.tableId);
+        for (size_t block = 0; block < blockCount; block++) {
+            if (!predicates.empty() && pruned(store->getZoneMaps(schema.tableId, block))) continue;
+            if (!store->readBlock(schema.tableId, block, columns, data, deleted)) continue;
+            if (!filterBlock()) return;
+        }
+    }
+    
+    TableIterator iterator(storage, schema.tableId, true);
+    iterator.setPageFilter(pageFilter(schema, where));
+    CompiledPredicate filter(schema, where);
+    while (iterator.next(tuple)) {
+        if (!filter.matches(tuple)) continue;
+        scan.produced(1);
+        if (!onRow(tuple)) return;
+    }
+}
+
+// ============================================================================
+// COMPILED PREDICATES
+// ============================================================================
+//
+// CompiledPredicate turns an Expr into operator nodes. A column compared with
+// a literal becomes a CompareLiteral<Kind, OP>: the literal is converted once
+// to the column's native type, and each row is compared with no type switch
+// and no copy. Rows holding another type than the schema promises, such as
+// undeclared document fields, fall back to Value::compare. Everything else
+// gets a generic node over operands that resolve to a Value pointer.
+
+namespace {
+
+typedef CompiledPredicate::Node Node;
+
+template <CompareOp OP>
+inline bool holds(int c) {
+    switch (OP) {
+        case CompareOp::EQ: return c == 0;
+        case CompareOp::NE: return c != 0;
+        case CompareOp::LT: return c < 0;
+        case CompareOp::LE: return c <= 0;
+        case CompareOp::GT: return c > 0;
+        case CompareOp::GE: return c >= 0;
+    }
+    return false;
+}
+
+// Three-way comparisons in the native type, matching Value::compare
+struct IntegerKind {
+    typedef int64_t Native;
+    static bool has(const Value& v) { return isIntegerType(v.type); }
+    static int compare(const Value& v, int64_t bound) { return (v.intVal > bound) - (v.intVal < bound); }
+};
+
+struct IntegerAsRealKind {
+    typedef double Native;
+    static bool has(const Value& v) { return isIntegerType(v.type); }
+    static int compare(const Value& v, double bound) {
+        double d = static_cast<double>(v.intVal);
+        return (d > bound) - (d < bound);
+    }
+};
+
+struct RealKind {
+    typedef double Native;
+    static bool has(const Value& v) { return v.type == DataType::TYPE_FLOAT || v.type == DataType::TYPE_DOUBLE; }
+    static int compare(const Value& v, double bound) { return (v.doubleVal > bound) - (v.doubleVal < bound); }
+};
+
+struct StringKind {
+    typedef std::string Native;
+    static bool has(const Value& v) { return v.type == DataType::TYPE_STRING; }
+    static int compare(const Value& v, const std::string& bound) { return v.stringVal.compare(bound); }
+};
+
+template <typename Kind, CompareOp OP>
+class CompareLiteral : public Node {
+private:
+    size_t slot;
+    typename Kind::Native bound;
+    Value literal;
+    
+public:
+    CompareLiteral(size_t slot, typename Kind::Native bound, const Value& literal)
+        : slot(slot), bound(std::move(bound)), literal(literal) {}
+        
+    bool test(CompiledPredicate& row) const override {
+        const Value* v = row.column(slot);
+        if (!v) return false;
+        if (Kind::has(*v)) return holds<OP>(Kind::compare(*v, bound));
+        return !v->isNull() && holds<OP>(v->compare(literal));
+    }
+};
+
+template <typename Kind>
+std::unique_ptr<Node> compareLiteral(CompareOp op, size_t slot, typename Kind::Native bound, const Value& literal) {
+    switch (op) {
+        case CompareOp::EQ: return std::make_unique<CompareLiteral<Kind, CompareOp::EQ>>(slot, bound, literal);
+        case CompareOp::NE: return std::make_unique<CompareLiteral<Kind, CompareOp::NE>>(slot, bound, literal);
+        case CompareOp::LT: return std::make_unique<CompareLiteral<Kind, CompareOp::LT>>(slot, bound, literal);
+        case CompareOp::LE: return std::make_unique<CompareLiteral<Kind, CompareOp::LE>>(slot, bound, literal);
+        case CompareOp::GT: return std::make_unique<CompareLiteral<Kind, CompareOp::GT>>(slot, bound, literal);
+        case CompareOp::GE: return std::make_unique<CompareLiteral<Kind, CompareOp::GE>>(slot, bound, literal);
+    }
+    return nullptr;
+}
+
+// A literal, a column or a JSON path inside one; anything else is evaluated
+struct Operand {
+    const Expr* expr;
+    size_t slot;
+    
+    const Value* get(CompiledPredicate& row, Value& scratch) const {
+        switch (expr->type) {
+            case ExprType::LITERAL:
+                return &expr->value;
+            case ExprType::COLUMN:
+                if (expr->path.empty()) return row.column(slot);
+                if (const Value* document = row.column(slot)) {
+                    scratch = Value();
+                    JSONDocument::extract(*document, expr->path, scratch);
+                    return &scratch;
+                }
+                return nullptr;
+            default:
+                scratch = expr->evaluate(row.tuple());
+                return &scratch;
+        }
+    }
+};
+
+template <CompareOp OP>
+class CompareOperands : public Node {
+private:
+    Operand left, right;
+    
+public:
+    CompareOperands(Operand left, Operand right) : left(left), right(right) {}
+    
+    bool test(CompiledPredicate& row) const override {
+        Value leftScratch, rightScratch;
+        const Value* a = left.get(row, leftScratch);
+        const Value* b = right.get(row, rightScratch);
+        return a && b && !a->isNull() && !b->isNull() && holds<OP>(a->compare(*b));
+    }
+};
+
+std::unique_ptr<Node> compareOperands(CompareOp op, Operand left, Operand right) {
+    switch (op) {
+        case CompareOp::EQ: return std::make_unique<CompareOperands<CompareOp::EQ>>(left, right);
+        case CompareOp::NE: return std::make_unique<CompareOperands<CompareOp::NE>>(left, right);
+        case CompareOp::LT: return std::make_unique<CompareOperands<CompareOp::LT>>(left, right);
+        case CompareOp::LE: return std::make_unique<CompareOperands<CompareOp::LE>>(left, right);
+        case CompareOp::GT: return std::make_unique<CompareOperands<CompareOp::GT>>(left, right);
+        case CompareOp::GE: return std::make_unique<CompareOperands<CompareOp::GE>>(left, right);
+    }
+    return nullptr;
+}
+
+class Constant : public Node {
+private:
+    bool result;
+    
+public:
+    explicit Constant(bool result) : result(result) {}
+    bool test(CompiledPredicate&) const override { return result; }
+};
+
+// A bare operand as a condition, WHERE flag
+class Truthy : public Node {
+private:
+    Operand operand;
+    
+public:
+    explicit Truthy(Operand operand) : operand(operand) {}
+    
+    bool test(CompiledPredicate& row) const override {
+        Value scratch;
+        const Value* v = operand.get(row, scratch);
+        return v && isTruthy(*v);
+    }
+};
+
+class IsNull : public Node {
+private:
+    Operand operand;
+    bool negated;
+    
+public:
+    IsNull(Operand operand, bool negated) : operand(operand), negated(negated) {}
+    
+    bool test(CompiledPredicate& row) const override {
+        Value scratch;
+        const Value* v = operand.get(row, scratch);
+        return (!v || v->isNull()) != negated;
+    }
+};
+
+class Like : public Node {
+private:
+    Operand operand;
+    std::string pattern;
+    bool negated;
+    
+public:
+    Like(Operand operand, std::string pattern, bool negated)
+        : operand(operand), pattern(std::move(pattern)), negated(negated) {}
+        
+    bool test(CompiledPredicate& row) const override {
+        Value scratch;
+        const Value* v = operand.get(row, scratch);
+        if (!v || v->isNull()) return false;
+        bool match = v->type == DataType::TYPE_STRING ? likeMatch(v->stringVal, pattern)
+                                                      : likeMatch(v->toString(), pattern);
+        return match != negated;
+    }
+};
+
+// The query is tokenized once rather than per row
+class Match : public Node {
+private:
+    Operand operand;
+    std::vector<std::string> query;
+    
+public:
+    Match(Operand operand, const Value& text) : operand(operand) {
+        FullTextIndex::tokenize(text, query);
+    }
+    
+    bool test(CompiledPredicate& row) const override {
+        Value scratch;
+        const Value* v = operand.get(row, scratch);
+        std::vector<std::string> words;
+        FullTextIndex::tokenize(v ? *v : Value(), words);
+        std::sort(words.begin(), words.end());
+        for (const auto& word : query) {
+            if (std::binary_search(words.begin(), words.end(), word)) return true;
+        }
+        return false;
+    }
+};
+
+// AND and OR chains are flattened, so a conjunction of n terms is one loop
+template <bool ALL>
+class Junction : public Node {
+private:
+    std::vector<std::unique_ptr<Node>> terms;
+    
+public:
+    explicit Junction(std::vector<std::unique_ptr<Node>> terms) : terms(std::move(terms)) {}
+    
+    bool test(CompiledPredicate& row) const override {
+        for (const auto& term : terms) {
+            if (term->test(row) != ALL) return !ALL;
+        }
+        return ALL;
+    }
+};
+
+class Not : public Node {
+private:
+    std::unique_ptr<Node> term;
+    
+public:
+    explicit Not(std::unique_ptr<Node> term) : term(std::move(term)) {}
+    bool test(CompiledPredicate& row) const override { return !term->test(row); }
+};
+
+void flatten(const Expr* expr, ExprType type, std::vector<const Expr*>& out) {
+    if (expr->type == type) {
+        for (const auto& child : expr->children) flatten(child.get(), type, out);
+    } else {
+        out.push_back(expr);
+    }
+}
+
+} // namespace
+
+CompiledPredicate::CompiledPredicate(const TableSchema& schema, const Expr* where)
+    : current(nullptr), generation(0) {
+    if (where) root = compile(schema, where);
+}
+
+CompiledPredicate::CompiledPredicate(const TableSchema& schema, const std::vector<const Expr*>& conjuncts)
+    : current(nullptr), generation(0) {
+    if (conjuncts.size() == 1) {
+        root = compile(schema, conjuncts[0]);
+    } else if (!conjuncts.empty()) {
+        std::vector<std::unique_ptr<Node>> terms;
+        for (const Expr* conjunct : conjuncts) terms.push_back(compile(schema, conjunct));
+        root = std::make_unique<Junction<true>>(std::move(terms));
+    }
+}
+
+size_t CompiledPredicate::slotFor(const std::string& column) {
+    for (size_t i = 0; i < names.size(); i++) {
+        if (names[i] == column) return i;
+    }
+    names.push_back(column);
+    slots.emplace_back(0, nullptr);
+    return names.size() - 1;
+}
+
+std::unique_ptr<Node> CompiledPredicate::compile(const TableSchema& schema, const Expr* expr) {
+    auto operand = [&](const Expr* e) {
+        Operand o{e, 0};
+        if (e->type == ExprType::COLUMN) o.slot = slotFor(e->column);
+        return o;
+    };
+    
+    switch (expr->type) {
+        case ExprType::AND:
+        case ExprType::OR: {
+            std::vector<const Expr*> children;
+            flatten(expr, expr->type, children);
+            std::vector<std::unique_ptr<Node>> terms;
+            for (const Expr* child : children) terms.push_back(compile(schema, child));
+            if (expr->type == ExprType::AND) return std::make_unique<Junction<true>>(std::move(terms));
+            return std::make_unique<Junction<false>>(std::move(terms));
+        }
+        case ExprType::NOT:
+            return std::make_unique<Not>(compile(schema, expr->children[0].get()));
+        case ExprType::IS_NULL:
+            return std::make_unique<IsNull>(operand(expr->children[0].get()), expr->negated);
+        case ExprType::LIKE:
+            return std::make_unique<Like>(operand(expr->children[0].get()), expr->value.stringVal, expr->negated);
+        case ExprType::MATCH:
+            return std::make_unique<Match>(operand(expr->children[0].get()), expr->value);
+        case ExprType::COMPARE:
+            break;
+        default:
+            return std::make_unique<Truthy>(operand(expr));
+    }
+    
+    const Expr* col;
+    CompareOp op;
+    Value literal;
+    if (literalComparison(expr, col, op, literal)) {
+        if (literal.isNull()) return std::make_unique<Constant>(false);
+        
+        size_t position = col->path.empty() ? columnPosition(schema, col->column) : SIZE_MAX;
+        DataType type = position != SIZE_MAX ? schema.columns[position].type : DataType::TYPE_NULL;
+        size_t slot = slotFor(col->column);
+        if (isIntegerType(type) && isIntegerType(literal.type)) {
+            return compareLiteral<IntegerKind>(op, slot, literal.intVal, literal);
+        }
+        if (isIntegerType(type) && (literal.type == DataType::TYPE_FLOAT || literal.type == DataType::TYPE_DOUBLE)) {
+            return compareLiteral<IntegerAsRealKind>(op, slot, literal.doubleVal, literal);
+        }
+        if ((type == DataType::TYPE_FLOAT || type == DataType::TYPE_DOUBLE) && isNumericType(literal.type) &&
+            literal.type != DataType::TYPE_BOOLEAN) {
+            double bound = isIntegerType(literal.type) ? static_cast<double>(literal.intVal) : literal.doubleVal;
+            return compareLiteral<RealKind>(op, slot, bound, literal);
+        }
+        if (type == DataType::TYPE_STRING && literal.type == DataType::TYPE_STRING) {
+            return compareLiteral<StringKind>(op, slot, literal.stringVal, literal);
+        }
+    }
+    
+    // Operands seen from the expression's own side, as Expr::evaluate compares them
+    return compareOperands(expr->op, operand(expr->children[0].get()), operand(expr->children[1].get()));
+}
+
+// ============================================================================
+// ACCESS PLANNING
+// ============================================================================
+//
+// Costs are in units of one row read by a row-table scan. Selectivities come
+// from the statistics ANALYZE leaves in the schema; without them, or for a
+// JSON path, fixed guesses stand in: an equality picks few rows, a range a
+// third of them.
+
+namespace {
+
+const double SCAN_ROW_COST = 1.0;
+const double COLUMN_ROW_COST = 0.03;    // decoded a vector at a time
+const double INDEX_ROW_COST = 4.5;      // a row tuple fetched by id
+const double COLUMN_FETCH_COST = 200;   // a column tuple fetched by id, a chunk decoded per column
+const double INDEX_PROBE_COST = 0.5;
+const double DEFAULT_EQUAL = 0.005;
+const double DEFAULT_RANGE = 1.0 / 3;
+const double DEFAULT_PATTERN = 0.05;    // LIKE, MATCH
+
+double clampFraction(double f) {
+    return std::min(1.0, std::max(0.0, f));
+}
+
+const ColumnStatistics* columnStatistics(const TableSchema& schema, const Expr* col) {
+    if (!schema.statistics || col->type != ExprType::COLUMN || !col->path.empty()) return nullptr;
+    return schema.statistics->column(col->column);
+}
+
+// Fraction of rows with col op literal
+double compareSelectivity(const ColumnStatistics* stats, CompareOp op, const Value& literal) {
+    if (literal.isNull()) return 0;
+    if (!stats) return op == CompareOp::EQ ? DEFAULT_EQUAL : op == CompareOp::NE ? 1 - DEFAULT_EQUAL : DEFAULT_RANGE;
+    
+    double present = 1 - stats->nullFraction;
+    switch (op) {
+        case CompareOp::EQ: return clampFraction(stats->equalFraction(literal));
+        case CompareOp::NE: return clampFraction(present - stats->equalFraction(literal));
+        case CompareOp::LT: return clampFraction(stats->belowFraction(literal, false));
+        case CompareOp::LE: return clampFraction(stats->belowFraction(literal, true));
+        case CompareOp::GT: return clampFraction(present - stats->belowFraction(literal, true));
+        case CompareOp::GE: return clampFraction(present - stats->belowFraction(literal, false));
+    }
+    return DEFAULT_RANGE;
+}
+
+// Fraction of rows matching expr, conjuncts and disjuncts taken as independent
+double selectivity(const TableSchema& schema, const Expr* expr) {
+    if (!expr) return 1;
+    switch (expr->type) {
+        case ExprType::AND:
+            return selectivity(schema, expr->children[0].get()) * selectivity(schema, expr->children[1].get());
+        case ExprType::OR: {
+            double a = selectivity(schema, expr->children[0].get());
+            double b = selectivity(schema, expr->children[1].get());
+            return a + b - a * b;
+        }
+        case ExprType::NOT:
+            return 1 - selectivity(schema, expr->children[0].get());
+        case ExprType::IS_NULL: {
+            const ColumnStatistics* stats = columnStatistics(schema, expr->children[0].get());
+            double nulls = stats ? stats->nullFraction : DEFAULT_EQUAL;
+            return expr->negated ? 1 - nulls : nulls;
+        }
+        case ExprType::COMPARE: {
+            const Expr* col;
+            CompareOp op;
+            Value literal;
+            if (!literalComparison(expr, col, op, literal)) return DEFAULT_RANGE;
+            return compareSelectivity(columnStatistics(schema, col), op, literal);
+        }
+        case ExprType::LIKE:
+            return expr->negated ? 1 - DEFAULT_PATTERN : DEFAULT_PATTERN;
+        case ExprType::MATCH:
+            return DEFAULT_PATTERN;
+        default:
+            return DEFAULT_RANGE;
+    }
+}
+
+// The index probe answering the conjuncts on the index's column, with the
+// fraction of rows it returns; false when none of them constrain it
+bool indexProbe(const TableSchema& schema, TableIndex* index, const std::vector<const Expr*>& where,
+                AccessPlan& plan, double& fraction) {
+    const ColumnStatistics* stats = nullptr;
+    bool bounded = false;
+    for (const Expr* expr : where) {
+        const Expr* col;
+        CompareOp op;
+        Value literal;
+        if (!literalComparison(expr, col, op, literal) || !index->covers(col->column, col->path)) continue;
+        stats = columnStatistics(schema, col);
+        
+        if (op == CompareOp::EQ) {
+            plan.range = false;
+            plan.key = literal;
+            fraction = compareSelectivity(stats, op, literal);
+            if (index->isUnique()) fraction = std::min(fraction, 1.0 / std::max(1.0, plan.rows));
+            return true;
+        }
+        if (op == CompareOp::NE || literal.isNull()) continue;
+        
+        // Keep the tighter of two bounds on the same end
+        bool upper = op == CompareOp::LT || op == CompareOp::LE;
+        bool inclusive = op == CompareOp::LE || op == CompareOp::GE;
+        Value& bound = upper ? plan.high : plan.low;
+        bool& boundInclusive = upper ? plan.highInclusive : plan.lowInclusive;
+        int order = bound.isNull() ? 0 : literal.compare(bound);
+        if (bound.isNull() || (upper ? order < 0 : order > 0) || (order == 0 && !inclusive)) {
+            bound = literal;
+            boundInclusive = inclusive;
+        }
+        bounded = true;
+    }
+    if (!bounded) return false;
+    
+    plan.range = true;
+    if (stats) {
+        double high = plan.high.isNull() ? 1 - stats->nullFraction
+                                         : stats->belowFraction(plan.high, plan.highInclusive);
+        double low = plan.low.isNull() ? 0 : stats->belowFraction(plan.low, !plan.lowInclusive);
+        fraction = clampFraction(high - low);
+    } else {
+        fraction = (plan.low.isNull() ? 1 : DEFAULT_RANGE) * (plan.high.isNull() ? 1 : DEFAULT_RANGE);
+    }
+    return true;
+}
+
+} // namespace
+
+// The cheapest way to the rows matching where, wanted of them. A leading
+// MATCH with a full-text index always goes to the index, since only it
+// ranks the matches.
+AccessPlan QueryEngine::planAccess(const TableSchema& schema, const Expr* where, size_t wanted) {
+    AccessPlan best;
+    auto indexes = getIndexes(schema.tableId);
+    
+    const Expr* match;
+    if (FullTextIndex* index = matchProbe(indexes, where, match)) {
+        best.fullText = index;
+        best.match = match;
+        best.rows = selectivity(schema, where) * index->size();
+        return best;
+    }
+    
+    // Statistics may be stale; an index holds an entry for every live row
+    double rows = static_cast<double>(schema.rowCount);
+    if (schema.statistics) rows = std::max(rows, static_cast<double>(schema.statistics->rows));
+    for (auto* index : indexes) rows = std::max(rows, static_cast<double>(index->size()));
+    rows = std::max(rows, 1.0);
+    
+    double whereFraction = std::max(selectivity(schema, where), 1.0 / rows);
+    double limit = wanted == SIZE_MAX ? rows : static_cast<double>(wanted);
+    bool columnar = schema.storageMode == StorageMode::COLUMN || schema.storageMode == StorageMode::TIMESERIES;
+    best.rows = whereFraction * rows;
+    best.cost = (columnar ? COLUMN_ROW_COST : SCAN_ROW_COST) * std::min(rows, limit / whereFraction);
+    if (!where) return best;
+    
+    std::vector<const Expr*> terms;
+    splitConjuncts(where, terms);
+    double fetchCost = columnar ? COLUMN_FETCH_COST : INDEX_ROW_COST;
+    for (auto* index : indexes) {
+        if (index->isFullText()) continue;
+        AccessPlan plan;
+        plan.rows = rows;
+        double fraction;
+        if (!indexProbe(schema, index, terms, plan, fraction)) continue;
+        
+        // Of the rows the index returns, whereFraction / fraction pass the rest of where
+        double returned = std::max(fraction * rows, 1.0);
+        double passing = std::min(1.0, whereFraction / std::max(fraction, 1.0 / rows));
+        plan.cost = INDEX_PROBE_COST + fetchCost * std::min(returned, limit / passing);
+        if (plan.cost < best.cost) {
+            plan.index = index;
+            plan.rows = returned * passing;
+            best = plan;
+        }
+    }
+    return best;
+}
+
+// ============================================================================
+// AGGREGATES
+// ============================================================================
+
+namespace {
+
+struct AggregateState {
+    uint64_t count = 0;         // non-NULL inputs
+    uint64_t numeric = 0;       // inputs that went into the sums
+    bool integral = true;
+    int64_t intSum = 0;
+    double doubleSum = 0;
+    Value min;
+    Value max;
+    
+    void extreme(const Value& v) {
+        if (min.isNull() || v.compare(min) < 0) min = v;
+        if (max.isNull() || v.compare(max) > 0) max = v;
+    }
+    
+    void add(const Value& v) {
+        if (v.isNull()) return;
+        count++;
+        if (isIntegerType(v.type)) {
+            intSum += v.intVal;
+            doubleSum += static_cast<double>(v.intVal);
+            numeric++;
+        } else if (isNumericType(v.type)) {
+            integral = false;
+            doubleSum += numericValue(v);
+            numeric++;
+        }
+        extreme(v);
+    }
+    
+    // The selected rows of one decoded block
+    void add(const ColumnVector& column, const std::vector<uint32_t>& selection) {
+        bool nulls = !column.nulls.empty();
+        int64_t minRow = -1, maxRow = -1;
+        uint64_t n = 0;
+        
+        if (usesInts(column.type)) {
+            const int64_t* ints = column.ints.data();
+            int64_t sum = 0;
+            for (uint32_t row : selection) {
+                if (nulls && column.nulls[row]) continue;
+                int64_t v = ints[row];
+                sum += v;
+                n++;
+                if (minRow < 0 || v < ints[minRow]) minRow = row;
+                if (maxRow < 0 || v > ints[maxRow]) maxRow = row;
+            }
+            if (isIntegerType(column.type)) intSum += sum;
+            else if (n) integral = false;
+            doubleSum += static_cast<double>(sum);
+            numeric += n;
+        } else if (column.type == DataType::TYPE_FLOAT || column.type == DataType::TYPE_DOUBLE) {
+            const double* doubles = column.doubles.data();
+            double sum = 0;
+            for (uint32_t row : selection) {
+                if (nulls && column.nulls[row]) continue;
+                double v = doubles[row];
+                sum += v;
+                n++;
+                if (minRow < 0 || v < doubles[minRow]) minRow = row;
+                if (maxRow < 0 || v > doubles[maxRow]) maxRow = row;
+            }
+            if (n) integral = false;
+            doubleSum += sum;
+            numeric += n;
+        } else {
+            for (uint32_t row : selection) {
+                if (nulls && column.nulls[row]) continue;
+                n++;
+                if (minRow < 0 || column.values[row].compare(column.values[minRow]) < 0) minRow = row;
+                if (maxRow < 0 || column.values[row].compare(column.values[maxRow]) > 0) maxRow = row;
+            }
+        }
+        
+        count += n;
+        if (minRow >= 0) {
+            extreme(column.get(minRow));
+            extreme(column.get(maxRow));
+        }
+    }
+    
+    Value result(AggregateFn fn) const {
+        switch (fn) {
+            case AggregateFn::COUNT: return Value(static_cast<int64_t>(count));
+            case AggregateFn::SUM:
+                if (!numeric) return Value();
+                return integral ? Value(intSum) : Value(doubleSum);
+            case AggregateFn::AVG:
+                return numeric ? Value(doubleSum / numeric) : Value();
+            case AggregateFn::MIN: return min;
+            case AggregateFn::MAX: return max;
+        }
+        return Value();
+    }
+};
+
+} // namespace
+
+std::string Aggregate::name() const {
+    static const char* const names[] = {"count", "sum", "avg", "min", "max"};
+    if (column.empty()) return "count";
+    return std::string(names[static_cast<int>(fn)]) + "(" + column + ")";
+}
+
+// The aggregated and GROUP BY columns exist, and sums are taken over numbers
+bool QueryEngine::checkAggregates(const Statement& stmt, const TableSchema& schema, std::string& error) {
+    if (!stmt.groupBy.empty() && columnPosition(schema, stmt.groupBy) == SIZE_MAX && !schema.isDocumentMode) {
+        error = "unknown column " + stmt.groupBy + " in table " + schema.tableName;
+        return false;
+    }
+    for (const auto& aggregate : stmt.aggregates) {
+        if (aggregate.column.empty()) continue;
+        
+        size_t position = columnPosition(schema, aggregate.column);
+        if (position == SIZE_MAX) {
+            if (schema.isDocumentMode) continue;
+            error = "unknown column " + aggregate.column + " in table " + schema.tableName;
+            return false;
+        }
+        DataType type = schema.columns[position].type;
+        if ((aggregate.fn == AggregateFn::SUM || aggregate.fn == AggregateFn::AVG) && !isNumericType(type)) {
+            error = "cannot compute " + aggregate.name() + " over a non-numeric column";
+            return false;
+        }
+    }
+    return true;
+}
+
+// WHERE, ORDER BY and LIMIT over rows already produced, as a rollup or view
+// read or a grouped aggregate has them; the filter is in terms of the shape.
+// Returns the rows in the result.
+static size_t respondRows(const Statement& stmt, const TableSchema& shape, const Expr* filter,
+                          const std::vector<std::string>& columns, std::vector<Tuple>& rows, std::string& result) {
+    if (filter) {
+        OperatorScope filtering(PlanStage::FILTER);
+        CompiledPredicate compiled(shape, filter);
+        rows.erase(std::remove_if(rows.begin(), rows.end(), [&](const Tuple& row) { return !compiled.matches(row); }),
+                   rows.end());
+        filtering.produced(rows.size());
+    }
+    
+    if (!stmt.orderBy.empty()) {
+        OperatorScope sorting(PlanStage::SORT);
+        sorting.produced(rows.size());
+        const Value missing;
+        std::stable_sort(rows.begin(), rows.end(), [&](const Tuple& a, const Tuple& b) {
+            auto ia = a.columns.find(stmt.orderBy);
+            auto ib = b.columns.find(stmt.orderBy);
+            const Value& va = ia != a.columns.end() ? ia->second : missing;
+            const Value& vb = ib != b.columns.end() ? ib->second : missing;
+            return stmt.orderDesc ? vb < va : va < vb;
+        });
+    }
+    
+    OperatorScope output(PlanStage::OUTPUT);
+    size_t begin = std::min<size_t>(rows.size(), stmt.offset);
+    size_t end = stmt.limit < 0 ? rows.size() : std::min<size_t>(rows.size(), begin + stmt.limit);
+    result = "[";
+    for (size_t i = begin; i < end; i++) {
+        if (i > begin) result += ',';
+        appendJSONRow(result, shape, columns, rows[i]);
+    }
+    result += "]";
+    output.produced(end - begin);
+    return end - begin;
+}
+
+bool QueryEngine::executeAggregate(const Statement& stmt, const TableSchema& schema,
+                                   std::string& result, std::string& error) {
+    if (!checkAggregates(stmt, schema, error)) return false;
+    
+    // Groups are accumulated as a view that lives for the one statement
+    if (!stmt.groupBy.empty()) {
+        MaterializedView grouped(stmt.table, stmt, schema);
+        std::vector<Tuple> rows;
+        {
+            OperatorScope aggregate(PlanStage::AGGREGATE);
+            rebuildView(grouped, schema);
+            grouped.read(rows);
+            aggregate.produced(rows.size());
+        }
+        resultRows = respondRows(stmt, grouped.getShape(), nullptr, {}, rows, result);
+        return true;
+    }
+    
+    OperatorScope aggregate(PlanStage::AGGREGATE);
+    
+    std::vector<size_t> positions;
+    for (const auto& aggregate : stmt.aggregates) {
+        positions.push_back(aggregate.column.empty() ? SIZE_MAX : columnPosition(schema, aggregate.column));
+    }
+    
+    std::vector<AggregateState> states(stmt.aggregates.size());
+    auto addRow = [&](const Tuple& tuple) {
+        for (size_t i = 0; i < states.size(); i++) {
+            const std::string& column = stmt.aggregates[i].column;
+            if (column.empty()) {
+                states[i].count++;
+                continue;
+            }
+            auto it = tuple.columns.find(column);
+            if (it != tuple.columns.end()) states[i].add(it->second);
+        }
+        return true;
+    };
+    
+    if (useColumnScan(schema, stmt.where.get())) {
+        std::vector<size_t> columns;
+        std::vector<size_t> slots;
+        for (size_t position : positions) {
+            if (position == SIZE_MAX) {
+                slots.push_back(SIZE_MAX);
+                continue;
+            }
+            auto it = std::find(columns.begin(), columns.end(), position);
+            slots.push_back(it - columns.begin());
+            if (it == columns.end()) columns.push_back(position);
+        }
+        
+        scanColumns(schema, stmt.where.get(), columns,
+                    [&](const std::vector<ColumnVector>& data, const std::vector<uint32_t>& selection) {
+                        for (size_t i = 0; i < states.size(); i++) {
+                            if (slots[i] == SIZE_MAX) states[i].count += selection.size();
+                            else states[i].add(data[slots[i]], selection);
+                        }
+                        return true;
+                    },
+                    addRow);
+    } else {
+        for (const auto& row : findRows(schema, stmt.where.get())) addRow(row.second);
+    }
+    
+    result = "[{";
+    for (size_t i = 0; i < states.size(); i++) {
+        if (i) result += ',';
+        appendJSONString(result, stmt.aggregates[i].name());
+        result += ':';
+        appendJSONValue(result, states[i].result(stmt.aggregates[i].fn));
+    }
+    result += "}]";
+    aggregate.produced(1);
+    resultRows = 1;
+    return true;
+}
+
+bool QueryEngine::executeSelect(const Statement& stmt, std::string& result, std::string& error) {
+    TableSchema schema;
+    if (!lookupTable(stmt.table, schema)) {
+        if (auto view = lookupView(stmt.table)) return readView(stmt, *view, result, error);
+        error = "table not found: " + stmt.table;
+        return false;
+    }
+    
+    if (stmt.rollup) return executeRollup(stmt, schema, result, error);
+    if (!stmt.aggregates.empty() || !stmt.groupBy.empty()) return executeAggregate(stmt, schema, result, error);
+    
+    ScratchVector<std::pair<uint64_t, Tuple>> rows;
+    // Without ORDER BY the scan can stop once LIMIT rows are in
+    size_t wanted = stmt.orderBy.empty() && stmt.limit >= 0 ? stmt.offset + stmt.limit : SIZE_MAX;
+    if (useColumnScan(schema, stmt.where.get(), wanted)) {
+        // Only the projected and ORDER BY columns are decoded
+        std::vector<size_t> columns;
+        auto want = [&](const std::string& name) {
+            size_t position = columnPosition(schema, name.substr(0, name.find('.')));
+            if (position != SIZE_MAX && std::find(columns.begin(), columns.end(), position) == columns.end()) {
+                columns.push_back(position);
+            }
+        };
+        if (stmt.columns.empty()) {
+            for (const auto& col : schema.columns) want(col.name);
+        }
+        for (const auto& name : stmt.columns) want(name);
+        if (!stmt.orderBy.empty()) want(stmt.orderBy);
+        
+        auto onRow = [&](const Tuple& tuple) {
+            rows.emplace_back(0, tuple);
+            return rows.size() < wanted;
+        };
+        if (wanted > 0) {
+            scanColumns(schema, stmt.where.get(), columns,
+                        [&](const std::vector<ColumnVector>& data, const std::vector<uint32_t>& selection) {
+                            for (uint32_t row : selection) {
+                                Tuple tuple;
+                                for (size_t i = 0; i < columns.size(); i++) {
+                                    tuple.columns[schema.columns[columns[i]].name] = data[i].get(row);
+                                }
+                                rows.emplace_back(0, std::move(tuple));
+                                if (rows.size() >= wanted) return false;
+                            }
+                            return true;
+                        },
+                        onRow);
+        }
+    } else {
+        rows = findRows(schema, stmt.where.get(), wanted);
+    }
+    
+    size_t begin = std::min<size_t>(rows.size(), stmt.offset);
+    size_t end = stmt.limit < 0 ? rows.size() : std::min<size_t>(rows.size(), begin + stmt.limit);
+    
+    if (!stmt.orderBy.empty()) {
+        OperatorScope sorting(PlanStage::SORT);
+        sorting.produced(rows.size());
+        // Compared in place; copying the values would allocate for every string
+        const Value missing;
+        auto less = [&](const std::pair<uint64_t, Tuple>& a, const std::pair<uint64_t, Tuple>& b) {
+            auto ia = a.second.columns.find(stmt.orderBy);
+            auto ib = b.second.columns.find(stmt.orderBy);
+            const Value& va = ia != a.second.columns.end() ? ia->second : missing;
+            const Value& vb = ib != b.second.columns.end() ? ib->second : missing;
+            return stmt.orderDesc ? vb < va : va < vb;
+        };
+        // Only the rows up to the LIMIT need to be in order
+        std::partial_sort(rows.begin(), rows.begin() + end, rows.end(), less);
+    }
+    
+    OperatorScope output(PlanStage::OUTPUT);
+    result = "[";
+    for (size_t i = begin; i < end; i++) {
+        if (i > begin) result += ',';
+        appendJSONRow(result, schema, stmt.columns, rows[i].second);
+    }
+    result += "]";
+    output.produced(end - begin);
+    resultRows = end - begin;
+    return true;
+}
+
+// Reads the minute or hour rollups of a time-series table. WHERE, ORDER BY
+// and LIMIT apply to the rollup rows; bounds on the bucket column limit the
+// buckets read. Rows not sealed yet are folded in from the pages.
+bool QueryEngine::executeRollup(const Statement& stmt, const TableSchema& schema, std::string& result,
+                                std::string& error) {
+    if (schema.storageMode != StorageMode::TIMESERIES) {
+        error = "ROLLUP needs a TIMESERIES table; " + schema.tableName + " is not one";
+        return false;
+    }
+    
+    TimeSeriesStore* series = storage->getTimeSeriesStore();
+    TableSchema rollup;
+    rollup.tableName = schema.tableName;
+    rollup.columns = series->getRollupColumns(schema.tableId);
+    rollup.isDocumentMode = false;
+    for (const auto& name : stmt.columns) {
+        if (columnPosition(rollup, name) == SIZE_MAX) {
+            error = "unknown rollup column " + name;
+            return false;
+        }
+    }
+    
+    int64_t from = INT64_MIN, to = INT64_MAX;
+    if (stmt.where) {
+        std::vector<const Expr*> conjuncts;
+        splitConjuncts(stmt.where.get(), conjuncts);
+        for (const Expr* conjunct : conjuncts) {
+            VectorPredicate p;
+            size_t column;
+            if (vectorPredicate(conjunct, rollup, p, column) && column == 0) narrowRange(p, from, to);
+        }
+    }
+    
+    std::vector<Tuple> rows;
+    {
+        OperatorScope scan(PlanStage::SCAN);
+        std::vector<Tuple> pending;
+        TableIterator iterator(storage, schema.tableId, true);
+        Tuple tuple;
+        while (iterator.next(tuple)) pending.push_back(std::move(tuple));
+        
+        if (from <= to && !series->readRollup(schema.tableId, stmt.rollup, from, to, pending, rows)) {
+            error = "could not read the rollups of " + schema.tableName;
+            return false;
+        }
+        scan.produced(rows.size());
+    }
+    resultRows = respondRows(stmt, rollup, stmt.where.get(), stmt.columns, rows, result);
+    return true;
+}
+
+// A view is read as it stands; its own WHERE is already applied and the
+// query's WHERE, ORDER BY and LIMIT go over the view's rows
+bool QueryEngine::readView(const Statement& stmt, MaterializedView& view, std::string& result, std::string& error) {
+    if (stmt.rollup || !stmt.aggregates.empty() || !stmt.groupBy.empty()) {
+        error = "ROLLUP, aggregates and GROUP BY cannot be applied to view " + view.getName();
+        return false;
+    }
+    const TableSchema& shape = view.getShape();
+    if (!shape.isDocumentMode) {
+        for (const auto& name : stmt.columns) {
+            if (columnPosition(shape, name) == SIZE_MAX) {
+                error = "unknown column " + name + " in view " + view.getName();
+                return false;
+            }
+        }
+    }
+    
+    std::vector<Tuple> rows;
+    {
+        OperatorScope scan(PlanStage::SCAN);
+        view.read(rows);
+        scan.produced(rows.size());
+    }
+    resultRows = respondRows(stmt, shape, stmt.where.get(), stmt.columns, rows, result);
+    return true;
+}
+
+bool QueryEngine::executeUpdate(const Statement& stmt, uint64_t txnId, std::string& result, std::string& error) {
+    TableSchema schema;
+    if (!lookupTable(stmt.table, schema)) {
+        error = "table not found: " + stmt.table;
+        return false;
+    }
+    
+    std::vector<std::string> names;
+    std::vector<Value> values;
+    for (const auto& [name, value] : stmt.assignments) {
+        names.push_back(name);
+        values.push_back(value);
+    }
+    
+    std::map<std::string, Value> assignments;
+    if (!coerceAssignments(schema, names, values, assignments, error)) return false;
+    
+    // Matches are collected before writing so new versions are never revisited
+    OperatorScope modify(PlanStage::MODIFY);
+    uint64_t affected = 0;
+    for (const auto& [tupleId, tuple] : findRows(schema, stmt.where.get())) {
+        if (!updateRow(schema, tupleId, tuple, assignments, txnId, error)) return false;
+        affected++;
+    }
+    
+    modify.produced(affected);
+    resultRows = affected;
+    result = "{\"affected\":" + std::to_string(affected) + "}";
+    return true;
+}
+
+bool QueryEngine::executeDelete(const Statement& stmt, uint64_t txnId, std::string& result, std::string& error) {
+    TableSchema schema;
+    if (!lookupTable(stmt.table, schema)) {
+        error = "table not found: " + stmt.table;
+        return false;
+    }
+    
+    OperatorScope modify(PlanStage::MODIFY);
+    uint64_t affected = 0;
+    for (const auto& [tupleId, tuple] : findRows(schema, stmt.where.get())) {
+        if (!removeRow(schema, tupleId, tuple, txnId)) {
+            error = "could not delete row " + std::to_string(tuple.rowId);
+            return false;
+        }
+        affected++;
+    }
+    
+    modify.produced(affected);
+    resultRows = affected;
+    result = "{\"affected\":" + std::to_string(affected) + "}";
+    return true;
+}
+
+std::unique_ptr<Cursor> QueryEngine::openCursor(const std::string& sql, std::string& error) {
+    Statement stmt;
+    if (!SQLParser::parse(sql, stmt, error)) return nullptr;
+    
+    if (stmt.type != StatementType::SELECT) {
+        error = "cursors can only be declared over SELECT";
+        return nullptr;
+    }
+    
+    // On a replica the result is taken between two replayed transactions
+    std::shared_lock<std::shared_mutex> replaying(replayMutex, std::defer_lock);
+    if (readOnly) {
+        replaying.lock();
+        if (!replicaError.empty()) {
+            error = "replica is out of date: replication stopped: " + replicaError;
+            return nullptr;
+        }
+    }
+    
+    TableSchema schema;
+    if (!lookupTable(stmt.table, schema)) {
+        error = "table not found: " + stmt.table;
+        return nullptr;
+    }
+    if (!schema.shards.empty()) {
+        error = "cursors over sharded table " + stmt.table + " are not supported";
+        return nullptr;
+    }
+    
+    std::unique_ptr<Cursor> cursor;
+    if (wholeResult(stmt)) {
+        std::string result;
+        if (!executeSelect(stmt, result, error)) return nullptr;
+        cursor = std::make_unique<Cursor>(schema, result);
+    } else {
+        cursor = std::make_unique<Cursor>(storage, schema, stmt);
+    }
+    if (!cursor->getError().empty()) {
+        error = cursor->getError();
+        return nullptr;
+    }
+    return cursor;
+}
+
+bool QueryEngine::wholeResult(const Statement& stmt) {
+    return !stmt.orderBy.empty() || !stmt.aggregates.empty() || !stmt.groupBy.empty() || stmt.rollup;
+}
+
+bool QueryEngine::tableExists(const std::string& name, uint32_t tableId) {
+    auto current = currentCatalog();
+    auto it = current->tables.find(name);
+    return it != current->tables.end() && it->second.schema->tableId == tableId;
+}
+
+// ============================================================================
+// CURSOR IMPLEMENTATION
+// ============================================================================
+
+// The walk runs to the end here rather than a batch per FETCH: an UPDATE
+// flags a row's old version deleted and appends the new one, so a walk left
+// open across round trips would skip rows and return others twice.
+Cursor::Cursor(StorageEngine* se, const TableSchema& schema, const Statement& stmt)
+    : table(schema.tableName), tableId(schema.tableId), position(0), spill(nullptr), remaining(0) {
+    CompiledPredicate filter(schema, stmt.where.get());
+    TableIterator iterator(se, schema.tableId);
+    iterator.setPageFilter(pageFilter(schema, stmt.where.get()));
+    
+    uint64_t skipped = 0;
+    Tuple tuple;
+    std::string row;
+    while (error.empty() && (stmt.limit < 0 || remaining < static_cast<uint64_t>(stmt.limit))) {
+        if (!iterator.next(tuple)) break;
+        if (!filter.matches(tuple)) continue;
+        if (skipped < static_cast<uint64_t>(stmt.offset)) {
+            skipped++;
+            continue;
+        }
+        row.clear();
+        appendJSONRow(row, schema, stmt.columns, tuple);
+        append(row);
+        remaining++;
+    }
+    finish();
+}
+
+// The result is a JSON array of row objects. Rows end at the brace that
+// closes them; braces and brackets inside strings do not count.
+Cursor::Cursor(const TableSchema& schema, const std::string& result)
+    : table(schema.tableName), tableId(schema.tableId), position(0), spill(nullptr), remaining(0) {
+    size_t depth = 0, start = 0;
+    bool inString = false;
+    for (size_t i = 0; i < result.size() && error.empty(); i++) {
+        char c = result[i];
+        if (inString) {
+            if (c == '\\') i++;
+            else if (c == '"') inString = false;
+            continue;
+        }
+        if (c == '"') {
+            inString = true;
+        } else if (c == '{' || c == '[') {
+            if (depth++ == 1) start = i;
+        } else if ((c == '}' || c == ']') && depth > 0 && --depth == 1) {
+            append(result.substr(start, i + 1 - start));
+            remaining++;
+        }
+    }
+    finish();
+}
+
+Cursor::~Cursor() {
+    if (spill) fclose(spill);
+}
+
+// Rows still in memory join those already spilled, and reading starts over
+void Cursor::finish() {
+    if (!spill || !error.empty()) return;
+    if (fwrite(rows.data(), 1, rows.size(), spill) != rows.size()) {
+        error = "the result is too large to hold and no temporary file could be written";
+    }
+    rows.clear();
+    rows.shrink_to_fit();
+    rewind(spill);
+}
+
+// Past CURSOR_MEMORY_BYTES the rows move to a temporary file
+void Cursor::append(const std::string& row) {
+    uint32_t length = static_cast<uint32_t>(row.size());
+    rows.append(reinterpret_cast<const char*>(&length), sizeof(length));
+    rows += row;
+    if (rows.size() < CURSOR_MEMORY_BYTES || !error.empty()) return;
+    
+    if (!spill) spill = std::tmpfile();
+    if (!spill || fwrite(rows.data(), 1, rows.size(), spill) != rows.size()) {
+        error = "the result is too large to hold and no temporary file could be written";
+        return;
+    }
+    rows.clear();
+}
+
+bool Cursor::next(std::string& row) {
+    uint32_t length;
+    if (!spill) {
+        if (rows.size() - position < sizeof(length)) return false;
+        memcpy(&length, rows.data() + position, sizeof(length));
+        row.assign(rows, position + sizeof(length), length);
+        position += sizeof(length) + length;
+        return true;
+    }
+    if (fread(&length, sizeof(length), 1, spill) != 1) return false;
+    row.resize(length);
+    return length == 0 || fread(&row[0], 1, length, spill) == length;
+}
+
+void Cursor::fetch(size_t maxRows, std::string& json) {
+    json += "{\"rows\":[";
+    
+    std::string row;
+    for (size_t count = 0; count < maxRows && remaining > 0; count++) {
+        // A spill file that cannot be read back ends the result early
+        if (!next(row)) {
+            remaining = 0;
+            break;
+        }
+        if (count > 0) json += ',';
+        json += row;
+        remaining--;
+    }
+    
+    json += "],\"done\":";
+    json += remaining == 0 ? "true" : "false";
+    json += "}";
+}
+
+} // namespace hybriddb
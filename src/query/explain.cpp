@@ -0,0 +1,287 @@
+#include "../include/hybriddb.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+namespace hybriddb {
+
+// ============================================================================
+// EXPLAIN
+// ============================================================================
+//
+// The plan is built from the same decisions the executor makes: planAccess
+// for the way to the rows, then the fixed steps of a single-table statement
+// above it. EXPLAIN ANALYZE runs the statement under a QueryProfile and puts
+// each stage's measured cost on its node; a node's figures include those of
+// its inputs. The statement's own result is discarded, but its writes are
+// not: an EXPLAIN ANALYZE UPDATE updates.
+
+static PlanNode planNode(const char* op, const std::string& detail, PlanStage stage, double rows, double cost) {
+    PlanNode node;
+    node.op = op;
+    node.detail = detail;
+    node.stage = stage;
+    node.estimatedRows = rows;
+    node.cost = cost;
+    return node;
+}
+
+static void appendBound(std::string& out, const Value& bound, bool inclusive, bool low) {
+    if (bound.isNull()) {
+        out += low ? "(-inf" : "+inf)";
+        return;
+    }
+    if (low) out += inclusive ? "[" : "(";
+    out += bound.toString();
+    if (!low) out += inclusive ? "]" : ")";
+}
+
+PlanNode QueryEngine::explainScan(const TableSchema& schema, const Expr* where, size_t wanted) {
+    AccessPlan access = planAccess(schema, where, wanted);
+    std::string detail = schema.tableName;
+    const char* op = "Seq Scan";
+    if (access.index) {
+        op = "Index Scan";
+        detail += " using " + access.index->getName();
+        if (access.range) {
+            detail += " range ";
+            appendBound(detail, access.low, access.lowInclusive, true);
+            detail += ", ";
+            appendBound(detail, access.high, access.highInclusive, false);
+        } else {
+            detail += " key " + access.key.toString();
+        }
+    } else if (access.fullText) {
+        op = "Full-Text Scan";
+        detail += " using " + access.fullText->getName();
+    } else if (schema.storageMode == StorageMode::COLUMN || schema.storageMode == StorageMode::TIMESERIES) {
+        op = "Column Scan";
+    }
+    if (where) {
+        detail += " where ";
+        appendExpr(detail, *where);
+    }
+    
+    PlanNode scan = planNode(op, detail, PlanStage::SCAN, access.rows, access.cost);
+    if (wanted != SIZE_MAX) scan.estimatedRows = std::min(scan.estimatedRows, static_cast<double>(wanted));
+    return scan;
+}
+
+bool QueryEngine::explainPlan(const Statement& stmt, PlanNode& plan, std::string& error) {
+    TableSchema schema;
+    if (shardRouter && shardedTable(stmt, schema)) {
+        error = "EXPLAIN cannot show the plans the data nodes of " + stmt.table + " choose";
+        return false;
+    }
+    bool table = lookupTable(stmt.table, schema);
+    auto view = table || stmt.type != StatementType::SELECT ? nullptr : lookupView(stmt.table);
+    if (!table && !view) {
+        error = "table not found: " + stmt.table;
+        return false;
+    }
+    
+    if (stmt.type != StatementType::SELECT) {
+        PlanNode scan = explainScan(schema, stmt.where.get(), SIZE_MAX);
+        plan = planNode(stmt.type == StatementType::UPDATE ? "Update" : "Delete", stmt.table, PlanStage::MODIFY,
+                        scan.estimatedRows, scan.cost);
+        plan.inputs.push_back(std::move(scan));
+        return true;
+    }
+    
+    std::string aggregates;
+    for (const auto& aggregate : stmt.aggregates) {
+        if (!aggregates.empty()) aggregates += ", ";
+        aggregates += aggregate.name();
+    }
+    if (!aggregates.empty() && !stmt.groupBy.empty()) aggregates += " ";
+    if (!stmt.groupBy.empty()) aggregates += "by " + stmt.groupBy;
+    
+    // Rows of views, rollups and groups pass through a filter of their own
+    PlanNode input;
+    bool filtered = false;
+    if (view) {
+        double rows = static_cast<double>(view->getStats().rows);
+        input = planNode("View Scan", view->getName(), PlanStage::SCAN, rows, rows);
+        filtered = true;
+    } else if (stmt.rollup) {
+        double rows = static_cast<double>(schema.rowCount);
+        input = planNode("Rollup Scan", schema.tableName + (stmt.rollup >= 3600 ? " by hour" : " by minute"),
+                         PlanStage::SCAN, rows, rows);
+        filtered = true;
+    } else if (!stmt.groupBy.empty()) {
+        PlanNode scan = explainScan(schema, stmt.where.get(), SIZE_MAX);
+        double groups = scan.estimatedRows;
+        if (schema.statistics) {
+            if (const ColumnStatistics* stats = schema.statistics->column(stmt.groupBy)) {
+                groups = std::min(groups, std::max(1.0, stats->distinct));
+            }
+        }
+        input = planNode("Group Aggregate", aggregates, PlanStage::AGGREGATE, groups, scan.cost);
+        input.inputs.push_back(std::move(scan));
+    } else if (!stmt.aggregates.empty()) {
+        PlanNode scan = explainScan(schema, stmt.where.get(), SIZE_MAX);
+        plan = planNode("Aggregate", aggregates, PlanStage::AGGREGATE, 1, scan.cost);
+        plan.inputs.push_back(std::move(scan));
+        return true;
+    } else {
+        size_t wanted = stmt.orderBy.empty() && stmt.limit >= 0 ? stmt.offset + stmt.limit : SIZE_MAX;
+        input = explainScan(schema, stmt.where.get(), wanted);
+    }
+    
+    if (filtered && stmt.where) {
+        std::string detail;
+        appendExpr(detail, *stmt.where);
+        PlanNode filter = planNode("Filter", detail, PlanStage::FILTER, input.estimatedRows, input.cost);
+        filter.inputs.push_back(std::move(input));
+        input = std::move(filter);
+    }
+    
+    if (!stmt.orderBy.empty()) {
+        // A plain SELECT only orders the rows up to its LIMIT
+        bool topN = stmt.limit >= 0 && !filtered && stmt.groupBy.empty();
+        PlanNode sort = planNode(topN ? "Top-N Sort" : "Sort", stmt.orderBy + (stmt.orderDesc ? " DESC" : " ASC"),
+                                 PlanStage::SORT, input.estimatedRows, input.cost);
+        sort.inputs.push_back(std::move(input));
+        input = std::move(sort);
+    }
+    
+    double rows = std::max(0.0, input.estimatedRows - static_cast<double>(stmt.offset));
+    std::string detail;
+    if (stmt.limit >= 0) {
+        rows = std::min(rows, static_cast<double>(stmt.limit));
+        detail = "LIMIT " + std::to_string(stmt.limit);
+    }
+    if (stmt.offset > 0) detail += (detail.empty() ? "OFFSET " : " OFFSET ") + std::to_string(stmt.offset);
+    plan = planNode(detail.empty() ? "Result" : "Limit", detail, PlanStage::OUTPUT, rows, input.cost);
+    plan.inputs.push_back(std::move(input));
+    return true;
+}
+
+// A decoded row: the tuple and its column map, plus each value; strings and
+// documents are guessed at a typical size
+static double rowBytes(const TableSchema& schema) {
+    double bytes = 64;
+    for (const auto& column : schema.columns) {
+        bool variable = column.type == DataType::TYPE_STRING || column.type == DataType::TYPE_BINARY ||
+                        column.type == DataType::TYPE_JSON;
+        bytes += variable ? 96 : 48;
+    }
+    return bytes;
+}
+
+static double mostRows(const PlanNode& node) {
+    double rows = node.estimatedRows;
+    for (const auto& input : node.inputs) rows = std::max(rows, mostRows(input));
+    return rows;
+}
+
+// The most rows any step of the plan holds, decoded and again as JSON.
+// Statements without a plan (INSERT, DDL, sharded tables) reserve the
+// minimum.
+uint64_t QueryEngine::estimateMemory(const std::string& sql) {
+    Statement stmt;
+    PlanNode plan;
+    std::string error;
+    if (!SQLParser::parse(sql, stmt, error) ||
+        (stmt.type != StatementType::SELECT && stmt.type != StatementType::UPDATE &&
+         stmt.type != StatementType::DELETE) ||
+        !explainPlan(stmt, plan, error)) {
+        return std::max<uint64_t>(ADMISSION_MIN_RESERVATION, sql.size() * 4);
+    }
+    
+    TableSchema schema;
+    lookupTable(stmt.table, schema);
+    double bytes = mostRows(plan) * rowBytes(schema) * 2;
+    return std::max<uint64_t>(ADMISSION_MIN_RESERVATION, static_cast<uint64_t>(std::min(bytes, 1e18)));
+}
+
+uint64_t QueryEngine::estimateCursorMemory(const std::string& sql) {
+    uint64_t bytes = estimateMemory(sql);
+    Statement stmt;
+    std::string error;
+    if (SQLParser::parse(sql, stmt, error) && wholeResult(stmt)) return bytes;
+    return std::min<uint64_t>(bytes, CURSOR_MEMORY_BYTES);
+}
+
+static void appendMillis(std::string& out, uint64_t nanos) {
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%.3f", nanos / 1e6);
+    out += buffer;
+}
+
+// Returns the node's cost with its inputs'
+static OperatorCost appendPlan(std::string& out, const PlanNode& node, const QueryProfile* profile) {
+    char buffer[64];
+    out += "{\"operator\":";
+    appendJSONString(out, node.op);
+    out += ",\"detail\":";
+    appendJSONString(out, node.detail);
+    snprintf(buffer, sizeof(buffer), ",\"estimatedRows\":%.0f,\"cost\":%.1f", std::ceil(node.estimatedRows), node.cost);
+    out += buffer;
+    
+    OperatorCost total = profile ? profile->cost(node.stage) : OperatorCost();
+    uint64_t calls = total.calls, rows = total.rows;
+    if (!node.inputs.empty()) {
+        out += ",\"inputs\":[";
+        for (size_t i = 0; i < node.inputs.size(); i++) {
+            if (i) out += ',';
+            OperatorCost input = appendPlan(out, node.inputs[i], profile);
+            total.wallNanos += input.wallNanos;
+            total.cpuNanos += input.cpuNanos;
+            total.poolHits += input.poolHits;
+            total.poolReads += input.poolReads;
+            total.scratchBytes += input.scratchBytes;
+        }
+        out += "]";
+    }
+    
+    if (profile) {
+        out += ",\"loops\":" + std::to_string(calls);
+        out += ",\"actualRows\":" + std::to_string(rows);
+        out += ",\"wallMs\":";
+        appendMillis(out, total.wallNanos);
+        out += ",\"cpuMs\":";
+        appendMillis(out, total.cpuNanos);
+        out += ",\"bufferHits\":" + std::to_string(total.poolHits);
+        out += ",\"bufferReads\":" + std::to_string(total.poolReads);
+        out += ",\"scratchBytes\":" + std::to_string(total.scratchBytes);
+    }
+    out += "}";
+    return total;
+}
+
+bool QueryEngine::executeExplain(const Statement& stmt, uint64_t txnId, std::string& result, std::string& error) {
+    auto started = std::chrono::steady_clock::now();
+    PlanNode plan;
+    if (!explainPlan(stmt, plan, error)) return false;
+    uint64_t planning = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - started).count();
+        
+    QueryProfile profile;
+    uint64_t execution = 0;
+    if (stmt.explain == ExplainMode::ANALYZE) {
+        Statement run = stmt;
+        run.explain = ExplainMode::NONE;
+        std::string output;
+        auto executing = std::chrono::steady_clock::now();
+        {
+            ProfileScope scope(&profile);
+            if (!execute(run, txnId, output, error)) return false;
+        }
+        execution = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - executing).count();
+    }
+    
+    result = "{\"plan\":";
+    appendPlan(result, plan, stmt.explain == ExplainMode::ANALYZE ? &profile : nullptr);
+    result += ",\"planningMs\":";
+    appendMillis(result, planning);
+    if (stmt.explain == ExplainMode::ANALYZE) {
+        result += ",\"executionMs\":";
+        appendMillis(result, execution);
+    }
+    result += "}";
+    return true;
+}
+
+} // namespace hybriddb
@@ -0,0 +1,854 @@
+#include "../include/hybriddb.h"
+#include <cctype>
+#include <cstring>
+#include <algorithm>
+
+namespace hybriddb {
+
+// ============================================================================
+// SQL PARSER
+// ============================================================================
+//
+// Hand-written recursive descent over a small SQL subset:
+//   CREATE [DOCUMENT | COLUMNAR | LSM | TIMESERIES] TABLE [IF NOT EXISTS] t (col TYPE
+//       [PRIMARY KEY] [UNIQUE] [NOT NULL] [DEFAULT lit], ...) [WITH (option = value, ...)]
+//     where options are COMPRESSION = LZ4 | NONE, BLOOM_FILTER = ON | OFF and,
+//     for time-series tables, CHUNK_INTERVAL and RETENTION as seconds or a
+//     string like '7 days'
+//   DROP TABLE [IF EXISTS] t
+//   CREATE [UNIQUE | FULLTEXT] INDEX [IF NOT EXISTS] name ON t (col | col.json.path)
+//   DROP INDEX [IF EXISTS] name
+//   INSERT INTO t [(cols)] VALUES (lits), ...
+//   SELECT * | cols | aggs FROM t [ROLLUP MINUTE | HOUR] [WHERE e] [ORDER BY col [ASC|DESC]]
+//       [LIMIT n [OFFSET m]]
+//     where aggs are COUNT(*), COUNT(col), SUM(col), AVG(col), MIN(col), MAX(col)
+//   UPDATE t SET col = lit, ... [WHERE e]
+//   DELETE FROM t [WHERE e]
+//   ANALYZE [t]
+//   EXPLAIN [ANALYZE] followed by a SELECT, UPDATE or DELETE
+// Columns may be followed by a JSON path (data.address.city); the same
+// lookup is available as JSON_EXTRACT(col, '$.address.city'). MATCH(col,
+// 'words') is true for rows holding any of the words, ranked by a full-text
+// index on col when there is one.
+
+namespace {
+
+enum class TokenType { IDENT, KEYWORD, NUMBER, STRING, SYMBOL, END };
+
+struct Token {
+    TokenType type;
+    std::string text;       // keywords upper-cased, identifiers as written
+};
+
+const char* const KEYWORDS[] = {
+    "CREATE", "DOCUMENT", "COLUMNAR", "LSM", "TABLE", "IF", "NOT", "EXISTS", "DROP", "INSERT",
+    "INTO", "VALUES", "SELECT", "FROM", "WHERE", "ORDER", "BY", "ASC", "DESC", "LIMIT",
+    "OFFSET", "UPDATE", "SET", "DELETE", "AND", "OR", "IS", "NULL", "LIKE",
+    "TRUE", "FALSE", "PRIMARY", "KEY", "UNIQUE", "DEFAULT", "COUNT", "INDEX", "ON", "WITH",
+    "TIMESERIES", "ROLLUP", "FULLTEXT", "MATCH", "ANALYZE", "MATERIALIZED", "VIEW", "REFRESH", "AS",
+    "GROUP", "EXPLAIN"
+};
+
+bool isKeyword(const std::string& upper) {
+    for (const char* keyword : KEYWORDS) {
+        if (upper == keyword) return true;
+    }
+    return false;
+}
+
+bool tokenize(const std::string& sql, ScratchVector<Token>& tokens, std::string& error) {
+    size_t i = 0;
+    while (i < sql.size()) {
+        char c = sql[i];
+        
+        if (isspace(static_cast<unsigned char>(c))) {
+            i++;
+        } else if (c == '-' && i + 1 < sql.size() && sql[i + 1] == '-') {
+            while (i < sql.size() && sql[i] != '\n') i++;
+        } else if (isalpha(static_cast<unsigned char>(c)) || c == '_') {
+            size_t start = i;
+            while (i < sql.size() && (isalnum(static_cast<unsigned char>(sql[i])) || sql[i] == '_')) i++;
+            std::string word = sql.substr(start, i - start);
+            std::string upper = word;
+            std::transform(upper.begin(), upper.end(), upper.begin(), ::toupper);
+            if (isKeyword(upper)) {
+                tokens.push_back({TokenType::KEYWORD, upper});
+            } else {
+                tokens.push_back({TokenType::IDENT, word});
+            }
+        } else if (c == '"' || c == '`') {
+            size_t end = sql.find(c, i + 1);
+            if (end == std::string::npos) {
+                error = "unterminated quoted identifier";
+                return false;
+            }
+            tokens.push_back({TokenType::IDENT, sql.substr(i + 1, end - i - 1)});
+            i = end + 1;
+        } else if (c == '\'') {
+            // Copied in runs between quotes; document literals can be large
+            std::string text;
+            i++;
+            while (true) {
+                size_t end = sql.find('\'', i);
+                if (end == std::string::npos) {
+                    error = "unterminated string literal";
+                    return false;
+                }
+                text.append(sql, i, end - i);
+                i = end + 1;
+                if (i < sql.size() && sql[i] == '\'') {
+                    text += '\'';
+                    i++;
+                    continue;
+                }
+                break;
+            }
+            tokens.push_back({TokenType::STRING, text});
+        } else if (isdigit(static_cast<unsigned char>(c)) && !tokens.empty() &&
+                   tokens.back().type == TokenType::SYMBOL && tokens.back().text == ".") {
+            // Array index inside a path: data.items.0.name
+            size_t start = i;
+            while (i < sql.size() && isdigit(static_cast<unsigned char>(sql[i]))) i++;
+            tokens.push_back({TokenType::NUMBER, sql.substr(start, i - start)});
+        } else if (isdigit(static_cast<unsigned char>(c)) ||
+                   (c == '.' && i + 1 < sql.size() && isdigit(static_cast<unsigned char>(sql[i + 1])) &&
+                    (tokens.empty() || tokens.back().type != TokenType::IDENT))) {
+            size_t start = i;
+            while (i < sql.size() && (isdigit(static_cast<unsigned char>(sql[i])) || sql[i] == '.' ||
+                                      sql[i] == 'e' || sql[i] == 'E' ||
+                                      ((sql[i] == '+' || sql[i] == '-') && (sql[i - 1] == 'e' || sql[i - 1] == 'E')))) {
+                i++;
+            }
+            tokens.push_back({TokenType::NUMBER, sql.substr(start, i - start)});
+        } else {
+            static const char* const twoChar[] = {"<=", ">=", "<>", "!="};
+            bool matched = false;
+            for (const char* op : twoChar) {
+                if (sql.compare(i, 2, op) == 0) {
+                    tokens.push_back({TokenType::SYMBOL, op});
+                    i += 2;
+                    matched = true;
+                    break;
+                }
+            }
+            if (matched) continue;
+            
+            if (!strchr("(),;*=<>-+.", c)) {
+                error = std::string("unexpected character '") + c + "'";
+                return false;
+            }
+            tokens.push_back({TokenType::SYMBOL, std::string(1, c)});
+            i++;
+        }
+    }
+    tokens.push_back({TokenType::END, ""});
+    return true;
+}
+
+bool parseTypeName(const std::string& name, DataType& type) {
+    std::string upper = name;
+    std::transform(upper.begin(), upper.end(), upper.begin(), ::toupper);
+    
+    if (upper == "BOOLEAN" || upper == "BOOL") type = DataType::TYPE_BOOLEAN;
+    else if (upper == "TINYINT" || upper == "INT8") type = DataType::TYPE_INT8;
+    else if (upper == "SMALLINT" || upper == "INT16") type = DataType::TYPE_INT16;
+    else if (upper == "INT" || upper == "INT32") type = DataType::TYPE_INT32;
+    else if (upper == "INTEGER" || upper == "BIGINT" || upper == "INT64") type = DataType::TYPE_INT64;
+    else if (upper == "FLOAT" || upper == "REAL") type = DataType::TYPE_FLOAT;
+    else if (upper == "DOUBLE") type = DataType::TYPE_DOUBLE;
+    else if (upper == "STRING" || upper == "TEXT" || upper == "VARCHAR" || upper == "CHAR") type = DataType::TYPE_STRING;
+    else if (upper == "BINARY" || upper == "BLOB") type = DataType::TYPE_BINARY;
+    else if (upper == "TIMESTAMP" || upper == "DATETIME") type = DataType::TYPE_TIMESTAMP;
+    else if (upper == "JSON") type = DataType::TYPE_JSON;
+    else return false;
+    return true;
+}
+
+class Parser {
+private:
+    ScratchVector<Token> tokens;
+    size_t pos;
+    std::string error;
+    
+    const Token& peek() const { return tokens[pos]; }
+    
+    bool isKeyword(const char* keyword) const {
+        return peek().type == TokenType::KEYWORD && peek().text == keyword;
+    }
+    
+    bool isSymbol(const char* symbol) const {
+        return peek().type == TokenType::SYMBOL && peek().text == symbol;
+    }
+    
+    bool acceptKeyword(const char* keyword) {
+        if (!isKeyword(keyword)) return false;
+        pos++;
+        return true;
+    }
+    
+    bool acceptSymbol(const char* symbol) {
+        if (!isSymbol(symbol)) return false;
+        pos++;
+        return true;
+    }
+    
+    bool fail(const std::string& message) {
+        if (error.empty()) {
+            error = message;
+            if (peek().type == TokenType::END) error += " at end of statement";
+            else error += " near '" + peek().text + "'";
+        }
+        return false;
+    }
+    
+    bool expectKeyword(const char* keyword) {
+        return acceptKeyword(keyword) || fail(std::string("expected ") + keyword);
+    }
+    
+    bool expectSymbol(const char* symbol) {
+        return acceptSymbol(symbol) || fail(std::string("expected '") + symbol + "'");
+    }
+    
+    bool identifier(std::string& name) {
+        if (peek().type != TokenType::IDENT) return fail("expected identifier");
+        name = tokens[pos++].text;
+        return true;
+    }
+    
+    bool literal(Value& value) {
+        bool negative = false;
+        if (isSymbol("-") || isSymbol("+")) {
+            negative = tokens[pos++].text == "-";
+            if (peek().type != TokenType::NUMBER) return fail("expected number");
+        }
+        
+        const Token& token = peek();
+        if (token.type == TokenType::NUMBER) {
+            if (token.text.find_first_of(".eE") != std::string::npos) {
+                double d = strtod(token.text.c_str(), nullptr);
+                value = Value(negative ? -d : d);
+            } else {
+                int64_t n = strtoll(token.text.c_str(), nullptr, 10);
+                value = Value(negative ? -n : n);
+            }
+        } else if (token.type == TokenType::STRING) {
+            value = Value(token.text);
+        } else if (isKeyword("TRUE") || isKeyword("FALSE")) {
+            value = Value(token.text == "TRUE");
+        } else if (isKeyword("NULL")) {
+            value = Value();
+        } else {
+            return fail("expected literal");
+        }
+        pos++;
+        return true;
+    }
+    
+    // Segments after a column: .key or .0 for array elements
+    bool pathSegments(std::vector<std::string>& path) {
+        while (acceptSymbol(".")) {
+            if (peek().type != TokenType::IDENT && peek().type != TokenType::NUMBER &&
+                peek().type != TokenType::KEYWORD) {
+                return fail("expected path segment");
+            }
+            const Token& token = tokens[pos++];
+            path.push_back(token.type == TokenType::KEYWORD ? lowerCase(token.text) : token.text);
+        }
+        return true;
+    }
+    
+    static std::string lowerCase(std::string text) {
+        std::transform(text.begin(), text.end(), text.begin(), ::tolower);
+        return text;
+    }
+    
+    bool columnRef(std::string& column, std::vector<std::string>& path) {
+        if (peek().type == TokenType::IDENT && tokens[pos + 1].type == TokenType::SYMBOL &&
+            tokens[pos + 1].text == "(") {
+            std::string function = lowerCase(peek().text);
+            if (function != "json_extract") return fail("unknown function");
+            pos += 2;
+            if (!identifier(column) || !expectSymbol(",")) return false;
+            if (peek().type != TokenType::STRING) return fail("expected JSON path string");
+            path = JSONDocument::splitPath(tokens[pos++].text);
+            return expectSymbol(")");
+        }
+        return identifier(column) && pathSegments(path);
+    }
+    
+    bool operand(std::shared_ptr<Expr>& expr) {
+        expr = std::make_shared<Expr>();
+        expr->negated = false;
+        if (peek().type == TokenType::IDENT) {
+            expr->type = ExprType::COLUMN;
+            return columnRef(expr->column, expr->path);
+        }
+        expr->type = ExprType::LITERAL;
+        return literal(expr->value);
+    }
+    
+    bool predicate(std::shared_ptr<Expr>& expr) {
+        if (acceptSymbol("(")) {
+            return orExpr(expr) && expectSymbol(")");
+        }
+        if (acceptKeyword("MATCH")) {
+            expr = std::make_shared<Expr>();
+            expr->type = ExprType::MATCH;
+            expr->negated = false;
+            auto column = std::make_shared<Expr>();
+            column->type = ExprType::COLUMN;
+            column->negated = false;
+            expr->children.push_back(column);
+            if (!expectSymbol("(") || !columnRef(column->column, column->path) || !expectSymbol(",")) return false;
+            if (peek().type != TokenType::STRING) return fail("expected search string");
+            expr->value = Value(tokens[pos++].text);
+            return expectSymbol(")");
+        }
+        
+        std::shared_ptr<Expr> left;
+        if (!operand(left)) return false;
+        
+        if (acceptKeyword("IS")) {
+            expr = std::make_shared<Expr>();
+            expr->type = ExprType::IS_NULL;
+            expr->negated = acceptKeyword("NOT");
+            expr->children.push_back(left);
+            return expectKeyword("NULL");
+        }
+        
+        bool negated = acceptKeyword("NOT");
+        if (acceptKeyword("LIKE")) {
+            expr = std::make_shared<Expr>();
+            expr->type = ExprType::LIKE;
+            expr->negated = negated;
+            expr->children.push_back(left);
+            if (peek().type != TokenType::STRING) return fail("expected pattern string");
+            expr->value = Value(tokens[pos++].text);
+            return true;
+        }
+        if (negated) return fail("expected LIKE");
+        
+        static const std::pair<const char*, CompareOp> ops[] = {
+            {"=", CompareOp::EQ}, {"!=", CompareOp::NE}, {"<>", CompareOp::NE},
+            {"<", CompareOp::LT}, {"<=", CompareOp::LE}, {">", CompareOp::GT}, {">=", CompareOp::GE}
+        };
+        for (const auto& [symbol, op] : ops) {
+            if (acceptSymbol(symbol)) {
+                expr = std::make_shared<Expr>();
+                expr->type = ExprType::COMPARE;
+                expr->op = op;
+                expr->negated = false;
+                expr->children.push_back(left);
+                std::shared_ptr<Expr> right;
+                if (!operand(right)) return false;
+                expr->children.push_back(right);
+                return true;
+            }
+        }
+        
+        // A bare operand is truthy-tested (boolean columns)
+        expr = left;
+        return true;
+    }
+    
+    bool notExpr(std::shared_ptr<Expr>& expr) {
+        if (acceptKeyword("NOT")) {
+            expr = std::make_shared<Expr>();
+            expr->type = ExprType::NOT;
+            expr->negated = false;
+            expr->children.emplace_back();
+            return notExpr(expr->children.back());
+        }
+        return predicate(expr);
+    }
+    
+    bool binaryExpr(std::shared_ptr<Expr>& expr, const char* keyword, ExprType type,
+                    bool (Parser::*next)(std::shared_ptr<Expr>&)) {
+        if (!(this->*next)(expr)) return false;
+        while (acceptKeyword(keyword)) {
+            auto parent = std::make_shared<Expr>();
+            parent->type = type;
+            parent->negated = false;
+            parent->children.push_back(expr);
+            parent->children.emplace_back();
+            if (!(this->*next)(parent->children.back())) return false;
+            expr = parent;
+        }
+        return true;
+    }
+    
+    bool andExpr(std::shared_ptr<Expr>& expr) {
+        return binaryExpr(expr, "AND", ExprType::AND, &Parser::notExpr);
+    }
+    
+    bool orExpr(std::shared_ptr<Expr>& expr) {
+        return binaryExpr(expr, "OR", ExprType::OR, &Parser::andExpr);
+    }
+    
+    bool whereClause(Statement& stmt) {
+        if (!acceptKeyword("WHERE")) return true;
+        return orExpr(stmt.where);
+    }
+    
+    bool columnDef(Statement& stmt) {
+        // Table-level PRIMARY KEY (col)
+        if (acceptKeyword("PRIMARY")) {
+            std::string name;
+            if (!expectKeyword("KEY") || !expectSymbol("(") || !identifier(name) || !expectSymbol(")")) return false;
+            for (auto& col : stmt.columnDefs) {
+                if (col.name == name) {
+                    col.primaryKey = true;
+                    col.nullable = false;
+                    return true;
+                }
+            }
+            return fail("unknown primary key column " + name);
+        }
+        
+        ColumnDef col;
+        col.nullable = true;
+        col.primaryKey = false;
+        col.unique = false;
+        
+        if (!identifier(col.name)) return false;
+        if (peek().type != TokenType::IDENT || !parseTypeName(peek().text, col.type)) {
+            return fail("expected column type");
+        }
+        pos++;
+        
+        // VARCHAR(255) and friends: the length is accepted and ignored
+        if (acceptSymbol("(")) {
+            if (peek().type != TokenType::NUMBER) return fail("expected length");
+            pos++;
+            if (!expectSymbol(")")) return false;
+        }
+        
+        while (true) {
+            if (acceptKeyword("PRIMARY")) {
+                if (!expectKeyword("KEY")) return false;
+                col.primaryKey = true;
+                col.nullable = false;
+            } else if (acceptKeyword("UNIQUE")) {
+                col.unique = true;
+            } else if (acceptKeyword("NOT")) {
+                if (!expectKeyword("NULL")) return false;
+                col.nullable = false;
+            } else if (acceptKeyword("NULL")) {
+                col.nullable = true;
+            } else if (acceptKeyword("DEFAULT")) {
+                if (!literal(col.defaultValue)) return false;
+            } else {
+                break;
+            }
+        }
+        
+        stmt.columnDefs.push_back(col);
+        return true;
+    }
+    
+    bool createTable(Statement& stmt) {
+        stmt.type = StatementType::CREATE_TABLE;
+        if (acceptKeyword("COLUMNAR")) stmt.storageMode = StorageMode::COLUMN;
+        else if (acceptKeyword("LSM")) stmt.storageMode = StorageMode::LSM;
+        else if (acceptKeyword("TIMESERIES")) stmt.storageMode = StorageMode::TIMESERIES;
+        else stmt.documentMode = acceptKeyword("DOCUMENT");
+        if (!expectKeyword("TABLE")) return false;
+        if (acceptKeyword("IF")) {
+            if (!expectKeyword("NOT") || !expectKeyword("EXISTS")) return false;
+            stmt.ifExists = true;
+        }
+        if (!identifier(stmt.table)) return false;
+        
+        // Document tables may be declared without any fixed columns
+        if (!stmt.documentMode || isSymbol("(")) {
+            if (!expectSymbol("(")) return false;
+            do {
+                if (!columnDef(stmt)) return false;
+            } while (acceptSymbol(","));
+            if (!expectSymbol(")")) return false;
+        }
+        return tableOptions(stmt);
+    }
+    
+    bool tableOptions(Statement& stmt) {
+        if (!acceptKeyword("WITH")) return true;
+        if (!expectSymbol("(")) return false;
+        do {
+            std::string option;
+            if (!identifier(option)) return false;
+            option = lowerCase(option);
+            if (option == "chunk_interval" || option == "retention") {
+                if (stmt.storageMode != StorageMode::TIMESERIES) {
+                    return fail(option + " only applies to TIMESERIES tables");
+                }
+                if (!expectSymbol("=")) return false;
+                int64_t& seconds = option == "retention" ? stmt.series.retention : stmt.series.chunkInterval;
+                if (!duration(seconds)) return false;
+                if (seconds <= 0 && option == "chunk_interval") return fail("chunk_interval must be positive");
+                continue;
+            }
+            if (option == "bloom_filter") {
+                if (stmt.storageMode == StorageMode::LSM) return fail("bloom_filter does not apply to LSM tables");
+                if (!expectSymbol("=")) return false;
+                std::string setting = lowerCase(peek().text);
+                if (setting == "on" || setting == "true") stmt.bloomFilters = true;
+                else if (setting == "off" || setting == "false") stmt.bloomFilters = false;
+                else return fail("expected ON or OFF for bloom_filter");
+                pos++;
+                continue;
+            }
+            if (option != "compression") return fail("unknown table option " + option);
+            if (!expectSymbol("=")) return false;
+            if (peek().type != TokenType::IDENT && peek().type != TokenType::STRING) {
+                return fail("expected compression codec");
+            }
+            
+            std::string codec = lowerCase(peek().text);
+            if (codec == "lz4") stmt.compression = PageCompression::LZ4;
+            else if (codec == "none") stmt.compression = PageCompression::NONE;
+            else return fail("unknown compression codec");
+            pos++;
+        } while (acceptSymbol(","));
+        return expectSymbol(")");
+    }
+    
+    // Seconds as a number, or a string of a count and a unit: '90 seconds',
+    // '1 hour', '7 days'
+    bool duration(int64_t& seconds) {
+        if (peek().type == TokenType::NUMBER) {
+            seconds = strtoll(tokens[pos++].text.c_str(), nullptr, 10);
+            return true;
+        }
+        if (peek().type != TokenType::STRING) return fail("expected a duration");
+        
+        std::string text = lowerCase(tokens[pos++].text);
+        char* end;
+        long long count = strtoll(text.c_str(), &end, 10);
+        std::string unit = end;
+        unit.erase(0, unit.find_first_not_of(' '));
+        if (end == text.c_str() || count < 0) return fail("bad duration '" + text + "'");
+        if (unit.size() > 1 && unit.back() == 's') unit.pop_back();
+        
+        static const std::pair<const char*, int64_t> units[] = {
+            {"", 1}, {"second", 1}, {"minute", 60}, {"hour", 3600}, {"day", 86400}, {"week", 604800}};
+        for (const auto& [name, scale] : units) {
+            if (unit != name) continue;
+            if (count > INT64_MAX / scale) return fail("duration '" + text + "' is too long");
+            seconds = count * scale;
+            return true;
+        }
+        return fail("unknown unit in duration '" + text + "'");
+    }
+    
+    bool createIndex(Statement& stmt) {
+        stmt.type = StatementType::CREATE_INDEX;
+        if (acceptKeyword("IF")) {
+            if (!expectKeyword("NOT") || !expectKeyword("EXISTS")) return false;
+            stmt.ifExists = true;
+        }
+        if (!identifier(stmt.index.name) || !expectKeyword("ON") || !identifier(stmt.table)) return false;
+        if (!expectSymbol("(") || !columnRef(stmt.index.column, stmt.index.path)) return false;
+        return expectSymbol(")");
+    }
+    
+    bool dropIndex(Statement& stmt) {
+        stmt.type = StatementType::DROP_INDEX;
+        if (acceptKeyword("IF")) {
+            if (!expectKeyword("EXISTS")) return false;
+            stmt.ifExists = true;
+        }
+        return identifier(stmt.index.name);
+    }
+    
+    // ORDER BY and LIMIT belong to the queries that read the view
+    bool createView(Statement& stmt) {
+        if (acceptKeyword("IF")) {
+            if (!expectKeyword("NOT") || !expectKeyword("EXISTS")) return false;
+            stmt.ifExists = true;
+        }
+        if (!identifier(stmt.view) || !expectKeyword("AS") || !expectKeyword("SELECT") || !select(stmt)) return false;
+        if (stmt.rollup || !stmt.orderBy.empty() || stmt.limit >= 0 || stmt.offset) {
+            return fail("a view query cannot have ROLLUP, ORDER BY or LIMIT");
+        }
+        stmt.type = StatementType::CREATE_VIEW;
+        return true;
+    }
+    
+    bool dropView(Statement& stmt) {
+        stmt.type = StatementType::DROP_VIEW;
+        if (!expectKeyword("VIEW")) return false;
+        if (acceptKeyword("IF")) {
+            if (!expectKeyword("EXISTS")) return false;
+            stmt.ifExists = true;
+        }
+        return identifier(stmt.view);
+    }
+    
+    bool refreshView(Statement& stmt) {
+        stmt.type = StatementType::REFRESH_VIEW;
+        return expectKeyword("MATERIALIZED") && expectKeyword("VIEW") && identifier(stmt.view);
+    }
+    
+    bool create(Statement& stmt) {
+        if (acceptKeyword("MATERIALIZED")) {
+            return expectKeyword("VIEW") && createView(stmt);
+        }
+        if (acceptKeyword("UNIQUE")) {
+            stmt.index.unique = true;
+            return expectKeyword("INDEX") && createIndex(stmt);
+        }
+        if (acceptKeyword("FULLTEXT")) {
+            stmt.index.unique = false;
+            stmt.index.fulltext = true;
+            return expectKeyword("INDEX") && createIndex(stmt);
+        }
+        if (acceptKeyword("INDEX")) {
+            stmt.index.unique = false;
+            return createIndex(stmt);
+        }
+        return createTable(stmt);
+    }
+    
+    bool dropTable(Statement& stmt) {
+        stmt.type = StatementType::DROP_TABLE;
+        if (!expectKeyword("TABLE")) return false;
+        if (acceptKeyword("IF")) {
+            if (!expectKeyword("EXISTS")) return false;
+            stmt.ifExists = true;
+        }
+        return identifier(stmt.table);
+    }
+    
+    bool insert(Statement& stmt) {
+        stmt.type = StatementType::INSERT;
+        if (!expectKeyword("INTO") || !identifier(stmt.table)) return false;
+        
+        if (acceptSymbol("(")) {
+            do {
+                stmt.columns.emplace_back();
+                if (!identifier(stmt.columns.back())) return false;
+            } while (acceptSymbol(","));
+            if (!expectSymbol(")")) return false;
+        }
+        
+        if (!expectKeyword("VALUES")) return false;
+        do {
+            if (!expectSymbol("(")) return false;
+            stmt.rows.emplace_back();
+            do {
+                stmt.rows.back().emplace_back();
+                if (!literal(stmt.rows.back().back())) return false;
+            } while (acceptSymbol(","));
+            if (!expectSymbol(")")) return false;
+            if (!stmt.columns.empty() && stmt.rows.back().size() != stmt.columns.size()) {
+                return fail("VALUES list does not match column list");
+            }
+        } while (acceptSymbol(","));
+        return true;
+    }
+    
+    // COUNT is a keyword; SUM, AVG, MIN and MAX are only names when called
+    bool aggregateFunction(AggregateFn& fn) {
+        if (acceptKeyword("COUNT")) {
+            fn = AggregateFn::COUNT;
+            return true;
+        }
+        if (peek().type != TokenType::IDENT || tokens[pos + 1].type != TokenType::SYMBOL ||
+            tokens[pos + 1].text != "(") {
+            return false;
+        }
+        
+        std::string name = lowerCase(peek().text);
+        if (name == "sum") fn = AggregateFn::SUM;
+        else if (name == "avg") fn = AggregateFn::AVG;
+        else if (name == "min") fn = AggregateFn::MIN;
+        else if (name == "max") fn = AggregateFn::MAX;
+        else return false;
+        pos++;
+        return true;
+    }
+    
+    bool select(Statement& stmt) {
+        stmt.type = StatementType::SELECT;
+        
+        if (!acceptSymbol("*")) {
+            // Path projections are kept as their dotted name (data.email)
+            do {
+                AggregateFn fn;
+                if (aggregateFunction(fn)) {
+                    Aggregate aggregate{fn, ""};
+                    if (!expectSymbol("(")) return false;
+                    if (!(fn == AggregateFn::COUNT && acceptSymbol("*")) && !identifier(aggregate.column)) return false;
+                    if (!expectSymbol(")")) return false;
+                    stmt.aggregates.push_back(aggregate);
+                    continue;
+                }
+                
+                std::string column;
+                std::vector<std::string> path;
+                if (!columnRef(column, path)) return false;
+                if (!path.empty()) column += "." + JSONDocument::joinPath(path);
+                stmt.columns.push_back(column);
+            } while (acceptSymbol(","));
+        }
+        
+        if (!expectKeyword("FROM") || !identifier(stmt.table)) return false;
+        if (acceptKeyword("ROLLUP")) {
+            std::string width = peek().type == TokenType::IDENT ? lowerCase(peek().text) : "";
+            if (width == "minute") stmt.rollup = 60;
+            else if (width == "hour") stmt.rollup = 3600;
+            else return fail("expected MINUTE or HOUR after ROLLUP");
+            pos++;
+            if (!stmt.aggregates.empty()) return fail("ROLLUP rows already carry their aggregates");
+        }
+        if (!whereClause(stmt)) return false;
+        
+        // Only the group column may stand beside the aggregates
+        if (acceptKeyword("GROUP")) {
+            if (!expectKeyword("BY") || !identifier(stmt.groupBy)) return false;
+            if (stmt.rollup) return fail("ROLLUP rows are already grouped");
+            for (const auto& column : stmt.columns) {
+                if (column != stmt.groupBy) return fail("column " + column + " is not the GROUP BY column");
+            }
+        } else if (!stmt.aggregates.empty() && !stmt.columns.empty()) {
+            return fail("aggregates cannot be mixed with plain columns");
+        }
+        
+        if (acceptKeyword("ORDER")) {
+            if (!expectKeyword("BY") || !identifier(stmt.orderBy)) return false;
+            if (acceptKeyword("DESC")) stmt.orderDesc = true;
+            else acceptKeyword("ASC");
+        }
+        
+        if (acceptKeyword("LIMIT")) {
+            if (peek().type != TokenType::NUMBER) return fail("expected LIMIT count");
+            stmt.limit = strtoll(tokens[pos++].text.c_str(), nullptr, 10);
+            if (acceptKeyword("OFFSET")) {
+                if (peek().type != TokenType::NUMBER) return fail("expected OFFSET count");
+                stmt.offset = strtoll(tokens[pos++].text.c_str(), nullptr, 10);
+            }
+        }
+        return true;
+    }
+    
+    bool update(Statement& stmt) {
+        stmt.type = StatementType::UPDATE;
+        if (!identifier(stmt.table) || !expectKeyword("SET")) return false;
+        
+        do {
+            stmt.assignments.emplace_back();
+            if (!identifier(stmt.assignments.back().first) || !expectSymbol("=") ||
+                !literal(stmt.assignments.back().second)) {
+                return false;
+            }
+        } while (acceptSymbol(","));
+        return whereClause(stmt);
+    }
+    
+    bool remove(Statement& stmt) {
+        stmt.type = StatementType::DELETE;
+        if (!expectKeyword("FROM") || !identifier(stmt.table)) return false;
+        return whereClause(stmt);
+    }
+    
+    // Without a table every table is analyzed
+    bool analyze(Statement& stmt) {
+        stmt.type = StatementType::ANALYZE;
+        stmt.table.clear();
+        if (peek().type == TokenType::END || (peek().type == TokenType::SYMBOL && peek().text == ";")) return true;
+        return identifier(stmt.table);
+    }
+    
+public:
+    Parser() : pos(0) {}
+    
+    bool parse(const std::string& sql, Statement& stmt, std::string& message) {
+        if (!tokenize(sql, tokens, message)) return false;
+        
+        bool ok;
+        if (acceptKeyword("EXPLAIN")) {
+            stmt.explain = acceptKeyword("ANALYZE") ? ExplainMode::ANALYZE : ExplainMode::PLAN;
+            if (acceptKeyword("SELECT")) ok = select(stmt);
+            else if (acceptKeyword("UPDATE")) ok = update(stmt);
+            else if (acceptKeyword("DELETE")) ok = remove(stmt);
+            else ok = fail("EXPLAIN takes a SELECT, UPDATE or DELETE");
+        }
+        else if (acceptKeyword("CREATE")) ok = create(stmt);
+        else if (acceptKeyword("DROP")) {
+            if (acceptKeyword("INDEX")) ok = dropIndex(stmt);
+            else if (acceptKeyword("MATERIALIZED")) ok = dropView(stmt);
+            else ok = dropTable(stmt);
+        }
+        else if (acceptKeyword("INSERT")) ok = insert(stmt);
+        else if (acceptKeyword("SELECT")) ok = select(stmt);
+        else if (acceptKeyword("UPDATE")) ok = update(stmt);
+        else if (acceptKeyword("DELETE")) ok = remove(stmt);
+        else if (acceptKeyword("ANALYZE")) ok = analyze(stmt);
+        else if (acceptKeyword("REFRESH")) ok = refreshView(stmt);
+        else ok = fail("unsupported statement");
+        
+        if (ok) {
+            acceptSymbol(";");
+            if (peek().type != TokenType::END) ok = fail("unexpected trailing input");
+        }
+        bool schemaChange = stmt.type == StatementType::CREATE_TABLE || stmt.type == StatementType::DROP_TABLE ||
+                            stmt.type == StatementType::CREATE_INDEX || stmt.type == StatementType::DROP_INDEX ||
+                            stmt.type == StatementType::CREATE_VIEW || stmt.type == StatementType::DROP_VIEW;
+        if (ok && schemaChange) stmt.definition = sql;
+        
+        if (!ok) message = error;
+        return ok;
+    }
+};
+
+} // namespace
+
+bool SQLParser::parse(const std::string& sql, Statement& statement, std::string& error) {
+    LatencyTimer timer(Histogram::QUERY_PARSE);
+    Parser parser;
+    return parser.parse(sql, statement, error);
+}
+
+// Identifiers are quoted so that one never reads as a keyword or as two
+static bool joinTokens(const std::string& sql, std::string& text, bool literals) {
+    ScratchVector<Token> tokens;
+    std::string error;
+    if (!tokenize(sql, tokens, error)) return false;
+    if (tokens.size() > 1 && tokens[tokens.size() - 2].type == TokenType::SYMBOL &&
+        tokens[tokens.size() - 2].text == ";") {
+        tokens.erase(tokens.end() - 2);
+    }
+    
+    text.clear();
+    for (const auto& token : tokens) {
+        if (token.type == TokenType::END) break;
+        if (!text.empty()) text += ' ';
+        if (token.type == TokenType::IDENT) {
+            text += '"';
+            text += token.text;
+            text += '"';
+        } else if (!literals && (token.type == TokenType::STRING || token.type == TokenType::NUMBER)) {
+            text += '?';
+        } else if (token.type == TokenType::STRING) {
+            text += '\'';
+            for (char c : token.text) {
+                if (c == '\'') text += '\'';
+                text += c;
+            }
+            text += '\'';
+        } else {
+            text += token.text;
+        }
+    }
+    return true;
+}
+
+bool SQLParser::normalize(const std::string& sql, std::string& text) {
+    return joinTokens(sql, text, true);
+}
+
+bool SQLParser::fingerprint(const std::string& sql, std::string& text) {
+    return joinTokens(sql, text, false);
+}
+
+} // namespace hybriddb
@@ -0,0 +1,168 @@
+#include "../include/hybriddb.h"
+#include <algorithm>
+#include <ctime>
+
+namespace hybriddb {
+
+// ============================================================================
+// OPERATOR PROFILING
+// ============================================================================
+//
+// A scope reads the clocks, this thread's buffer pool counters and the
+// request arena when it opens and again when it closes. What it spent, less
+// what nested scopes spent, goes to its stage; the total goes to the scope
+// around it, so that one can take it off in turn.
+
+thread_local QueryProfile* QueryProfile::active = nullptr;
+
+uint64_t QueryProfile::threadCPUNanos() {
+#ifdef PLATFORM_WINDOWS
+    FILETIME created, exited, kernel, user;
+    if (!GetThreadTimes(GetCurrentThread(), &created, &exited, &kernel, &user)) return 0;
+    auto ticks = [](const FILETIME& t) {
+        return (static_cast<uint64_t>(t.dwHighDateTime) << 32) | t.dwLowDateTime;
+    };
+    return (ticks(kernel) + ticks(user)) * 100;
+#else
+    timespec now;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now) != 0) return 0;
+    return static_cast<uint64_t>(now.tv_sec) * 1000000000ULL + static_cast<uint64_t>(now.tv_nsec);
+#endif
+}
+
+OperatorCost OperatorScope::readings() {
+    OperatorCost now;
+    now.wallNanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    now.cpuNanos = QueryProfile::threadCPUNanos();
+    now.poolHits = Metrics::own(Counter::POOL_HITS);
+    now.poolReads = Metrics::own(Counter::POOL_MISSES);
+    if (Arena* arena = Arena::current()) now.scratchBytes = arena->getStats().bytes;
+    return now;
+}
+
+void OperatorScope::begin() {
+    outer = profile->open;
+    profile->open = this;
+    start = readings();
+}
+
+void OperatorScope::end() {
+    OperatorCost now = readings();
+    OperatorCost spent;
+    spent.wallNanos = now.wallNanos - start.wallNanos;
+    spent.cpuNanos = now.cpuNanos - start.cpuNanos;
+    spent.poolHits = now.poolHits - start.poolHits;
+    spent.poolReads = now.poolReads - start.poolReads;
+    spent.scratchBytes = now.scratchBytes - start.scratchBytes;
+    
+    OperatorCost& total = profile->stages[static_cast<size_t>(stage)];
+    total.calls++;
+    total.rows += rows;
+    total.wallNanos += spent.wallNanos - inner.wallNanos;
+    total.cpuNanos += spent.cpuNanos - inner.cpuNanos;
+    total.poolHits += spent.poolHits - inner.poolHits;
+    total.poolReads += spent.poolReads - inner.poolReads;
+    total.scratchBytes += spent.scratchBytes - inner.scratchBytes;
+    
+    if (outer) {
+        outer->inner.wallNanos += spent.wallNanos;
+        outer->inner.cpuNanos += spent.cpuNanos;
+        outer->inner.poolHits += spent.poolHits;
+        outer->inner.poolReads += spent.poolReads;
+        outer->inner.scratchBytes += spent.scratchBytes;
+    }
+    profile->open = outer;
+}
+
+// ============================================================================
+// QUERY LOG
+// ============================================================================
+
+QueryLog::QueryLog() : slowNanos(0), slowQueries(0) {}
+
+bool QueryLog::setSlowLog(const std::string& path, double millis) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (slowLog.is_open()) slowLog.close();
+    slowLog.open(path, std::ios::app);
+    if (!slowLog) {
+        slowNanos = 0;
+        return false;
+    }
+    slowNanos = std::max<uint64_t>(1, static_cast<uint64_t>(millis * 1e6));
+    return true;
+}
+
+// Statements that do not tokenize never ran and are not totalled
+void QueryLog::record(const std::string& sql, uint64_t nanos, uint64_t rows, bool ok, uint64_t poolHits,
+                      uint64_t poolReads) {
+    std::string key;
+    bool tokenized = SQLParser::fingerprint(sql, key);
+    
+    std::lock_guard<std::mutex> lock(mutex);
+    if (slowNanos && nanos >= slowNanos) {
+        char stamp[32];
+        time_t now = time(nullptr);
+        tm utc;
+#ifdef PLATFORM_WINDOWS
+        gmtime_s(&utc, &now);
+#else
+        gmtime_r(&now, &utc);
+#endif
+        strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%SZ", &utc);
+        
+        std::string text = sql;
+        for (char& c : text) c = c == '\n' || c == '\r' ? ' ' : c;
+        slowLog << stamp << " " << nanos / 1e6 << " ms, " << rows << " rows, " << poolHits << " hits, "
+                << poolReads << " reads" << (ok ? "" : ", failed") << ": " << text << std::endl;
+        slowQueries++;
+    }
+    if (!tokenized) return;
+    
+    auto it = statements.find(key);
+    if (it == statements.end()) {
+        if (statements.size() >= QUERY_LOG_STATEMENTS) {
+            std::vector<std::pair<uint64_t, std::string>> byCalls;
+            for (const auto& [text, stats] : statements) byCalls.emplace_back(stats.calls, text);
+            std::nth_element(byCalls.begin(), byCalls.begin() + byCalls.size() / 2, byCalls.end());
+            for (size_t i = 0; i < byCalls.size() / 2; i++) statements.erase(byCalls[i].second);
+        }
+        StatementStats fresh = {key, 0, 0, 0, 0, UINT64_MAX, 0, 0, 0};
+        it = statements.emplace(key, fresh).first;
+    }
+    
+    StatementStats& stats = it->second;
+    stats.calls++;
+    stats.errors += !ok;
+    stats.rows += rows;
+    stats.totalNanos += nanos;
+    stats.minNanos = std::min(stats.minNanos, nanos);
+    stats.maxNanos = std::max(stats.maxNanos, nanos);
+    stats.poolHits += poolHits;
+    stats.poolReads += poolReads;
+}
+
+// Most total time first
+std::vector<StatementStats> QueryLog::getStats() {
+    std::vector<StatementStats> result;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto& entry : statements) result.push_back(entry.second);
+    }
+    std::sort(result.begin(), result.end(), [](const StatementStats& a, const StatementStats& b) {
+        return a.totalNanos > b.totalNanos;
+    });
+    return result;
+}
+
+uint64_t QueryLog::getSlowQueries() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return slowQueries;
+}
+
+void QueryLog::reset() {
+    std::lock_guard<std::mutex> lock(mutex);
+    statements.clear();
+}
+
+} // namespace hybriddb
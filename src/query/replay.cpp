@@ -0,0 +1,268 @@
+#include "../include/hybriddb.h"
+#include <cstring>
+
+namespace hybriddb {
+
+// ============================================================================
+// SCHEMA RECORDS
+// ============================================================================
+//
+// A schema change is logged as the statement that made it, outside any
+// transaction, so a replica can run the same statement. A created table's
+// record also carries the id the primary gave it, which is how the primary's
+// row records name the table.
+
+void QueryEngine::logSchema(const Statement& stmt) {
+    if (stmt.definition.empty()) return;
+    
+    uint32_t tableId = 0;
+    TableSchema schema;
+    if (stmt.type == StatementType::CREATE_TABLE && lookupTable(stmt.table, schema)) tableId = schema.tableId;
+    
+    std::vector<uint8_t> payload;
+    payload.reserve(sizeof(tableId) + stmt.definition.size());
+    putFixed<uint32_t>(payload, tableId);
+    putBytes(payload, stmt.definition.data(), stmt.definition.size());
+    txnManager->logOperation(0, WALRecordType::SCHEMA, payload);
+}
+
+// ============================================================================
+// REPLICA REPLAY
+// ============================================================================
+//
+// Each committed transaction of the primary is applied in one local
+// transaction, so the replica's own log, views and result cache follow it as
+// they would a client's write. Rows are matched by row id: the primary's
+// tuple ids name slots in its files, which the replica does not share.
+//
+// Replay is idempotent, since a restarted replica asks again for what it
+// applied after its state was last saved. An insert whose row id is there is
+// skipped, and so is an update or delete whose row is gone; updates set the
+// whole row, so the rows end as they were. Tables created or dropped again
+// are matched by name.
+
+bool QueryEngine::replay(const uint8_t* frames, size_t length, uint64_t& lsn, std::string& error, bool* schema) {
+    std::unique_lock<std::shared_mutex> lock(replayMutex);
+    
+    uint64_t txnId = 0;
+    bool ok = true;
+    size_t offset = 0;
+    WALRecordView record;
+    while (ok && offset < length) {
+        if (!WALRecord::decode(frames, length, offset, record)) {
+            error = "malformed log frame at byte " + std::to_string(offset);
+            ok = false;
+            break;
+        }
+        lsn = record.lsn;
+        
+        switch (record.type) {
+            case WALRecordType::SCHEMA:
+                ok = replaySchema(record, error);
+                if (schema) *schema = true;
+                break;
+            case WALRecordType::INSERT:
+            case WALRecordType::UPDATE:
+            case WALRecordType::DELETE:
+            case WALRecordType::PAGE_IMAGE:
+                if (txnId == 0) txnId = txnManager->begin();
+                ok = replayRow(record, txnId, error);
+                break;
+            default:
+                // Transaction boundaries, and BULK_LOAD records: a primary
+                // with replicas logs the rows of every load
+                break;
+        }
+    }
+    
+    if (txnId != 0) {
+        if (ok) txnManager->commit(txnId);
+        else txnManager->rollback(txnId);
+    }
+    return ok;
+}
+
+void QueryEngine::setReplicaError(const std::string& reason) {
+    std::unique_lock<std::shared_mutex> lock(replayMutex);
+    replicaError = reason;
+}
+
+std::map<uint32_t, std::string> QueryEngine::getReplicaTables() {
+    std::shared_lock<std::shared_mutex> lock(replayMutex);
+    return replicaTables;
+}
+
+void QueryEngine::setReplicaTables(const std::map<uint32_t, std::string>& tables) {
+    std::unique_lock<std::shared_mutex> lock(replayMutex);
+    replicaTables = tables;
+}
+
+void QueryEngine::adoptTables() {
+    std::unique_lock<std::shared_mutex> lock(replayMutex);
+    for (const auto& [name, entry] : currentCatalog()->tables) replicaTables[entry.schema->tableId] = name;
+}
+
+bool QueryEngine::replaySchema(const WALRecordView& record, std::string& error) {
+    ByteReader in(record.data, record.length);
+    uint32_t primaryId = in.get<uint32_t>();
+    if (!in.ok()) {
+        error = "malformed schema record at LSN " + std::to_string(record.lsn);
+        return false;
+    }
+    std::string sql(reinterpret_cast<const char*>(record.data) + sizeof(primaryId), in.remaining());
+    
+    Statement stmt;
+    if (!SQLParser::parse(sql, stmt, error)) return false;
+    
+    TableSchema schema;
+    bool exists = lookupTable(stmt.table, schema);
+    if (stmt.type == StatementType::DROP_TABLE) {
+        if (!exists) return true;
+        replicaRows.erase(schema.tableId);
+        for (auto it = replicaTables.begin(); it != replicaTables.end();) {
+            if (it->second == stmt.table) it = replicaTables.erase(it);
+            else ++it;
+        }
+    }
+    if (stmt.type == StatementType::CREATE_TABLE && exists) {
+        if (primaryId != 0) replicaTables[primaryId] = stmt.table;
+        return true;
+    }
+    
+    std::string result;
+    bool ok;
+    switch (stmt.type) {
+        case StatementType::CREATE_TABLE:
+        case StatementType::DROP_TABLE:
+            ok = executeCreate(stmt, result, error);
+            break;
+        case StatementType::CREATE_INDEX:
+        case StatementType::DROP_INDEX:
+            ok = executeIndex(stmt, result, error);
+            break;
+        default:
+            ok = executeView(stmt, result, error);
+            break;
+    }
+    
+    if (ok && stmt.type == StatementType::CREATE_TABLE && primaryId != 0) replicaTables[primaryId] = stmt.table;
+    return ok;
+}
+
+bool QueryEngine::replayRow(const WALRecordView& record, uint64_t txnId, std::string& error) {
+    ByteReader in(record.data, record.length);
+    uint32_t primaryId = in.get<uint32_t>();
+    auto table = replicaTables.find(primaryId);
+    TableSchema schema;
+    if (!in.ok() || table == replicaTables.end() || !lookupTable(table->second, schema)) {
+        error = "record at LSN " + std::to_string(record.lsn) + " names unknown table " + std::to_string(primaryId);
+        return false;
+    }
+    auto& rows = replicaRowMap(schema);
+    
+    if (record.type == WALRecordType::PAGE_IMAGE) {
+        const uint8_t* image = in.take(PAGE_SIZE);
+        if (!image) {
+            error = "short page image at LSN " + std::to_string(record.lsn);
+            return false;
+        }
+        Page page;
+        memcpy(&page, image, PAGE_SIZE);
+        
+        size_t offset = 0;
+        for (uint16_t slot = 0; slot < page.header.itemCount; slot++) {
+            uint16_t size;
+            if (offset + sizeof(size) > PAGE_DATA_SIZE) break;
+            memcpy(&size, page.data + offset, sizeof(size));
+            offset += sizeof(size);
+            if (offset + size > PAGE_DATA_SIZE) break;
+            
+            Tuple tuple = Tuple::deserialize(page.data + offset, size);
+            offset += size;
+            if (rows.count(tuple.rowId)) continue;
+            tuple.txnId = txnId;
+            uint64_t tupleId;
+            if (!appendRow(schema, tuple, txnId, error, &tupleId)) return false;
+            rows[tuple.rowId] = tupleId;
+        }
+        return true;
+    }
+    
+    if (record.type == WALRecordType::INSERT) {
+        Tuple tuple = Tuple::deserialize(record.data + sizeof(primaryId), in.remaining());
+        if (rows.count(tuple.rowId)) return true;
+        tuple.txnId = txnId;
+        uint64_t tupleId;
+        if (!appendRow(schema, tuple, txnId, error, &tupleId)) return false;
+        rows[tuple.rowId] = tupleId;
+        return true;
+    }
+    
+    // UPDATE and DELETE carry the old row, and with it the row id
+    in.get<uint64_t>();
+    Tuple updated;
+    if (record.type == WALRecordType::UPDATE) {
+        uint32_t size = in.get<uint32_t>();
+        const uint8_t* after = in.take(size);
+        if (after) updated = Tuple::deserialize(after, size);
+    }
+    size_t rest = in.remaining();
+    const uint8_t* before = in.take(rest);
+    if (!in.ok()) {
+        error = "malformed row record at LSN " + std::to_string(record.lsn);
+        return false;
+    }
+    uint64_t rowId = Tuple::deserialize(before, rest).rowId;
+    
+    uint64_t tupleId;
+    Tuple current;
+    if (!findReplicaRow(schema, rowId, tupleId, current)) return true;
+    
+    if (record.type == WALRecordType::DELETE) {
+        if (!removeRow(schema, tupleId, current, txnId)) {
+            error = "could not delete row " + std::to_string(rowId) + " of " + schema.tableName;
+            return false;
+        }
+        rows.erase(rowId);
+        return true;
+    }
+    
+    uint64_t newTupleId;
+    if (!updateRow(schema, tupleId, current, updated.columns, txnId, error, &newTupleId)) return false;
+    rows[rowId] = newTupleId;
+    return true;
+}
+
+// The map of a table holds every row it has. It is built by one scan the
+// first time the table is replayed into, which after a restart finds the
+// rows replayed before it.
+std::unordered_map<uint64_t, uint64_t>& QueryEngine::replicaRowMap(const TableSchema& schema, bool reload) {
+    auto it = replicaRows.find(schema.tableId);
+    if (it != replicaRows.end() && !reload) return it->second;
+    
+    auto& rows = replicaRows[schema.tableId];
+    rows.clear();
+    Tuple tuple;
+    uint64_t tupleId;
+    TableIterator iterator(storage, schema.tableId);
+    while (iterator.next(tuple, &tupleId)) rows[tuple.rowId] = tupleId;
+    return rows;
+}
+
+// Updates keep the row id, so it finds a row wherever its tuple went. A
+// column compaction or a series seal moves rows without telling the map, so
+// the first stale entry found builds the map again.
+bool QueryEngine::findReplicaRow(const TableSchema& schema, uint64_t rowId, uint64_t& tupleId, Tuple& tuple) {
+    for (int attempt = 0; attempt < 2; attempt++) {
+        auto& rows = replicaRowMap(schema, attempt > 0);
+        auto it = rows.find(rowId);
+        if (it == rows.end()) return false;
+        if (storage->readTuple(schema.tableId, it->second, tuple) && tuple.rowId == rowId) {
+            tupleId = it->second;
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace hybriddb
@@ -0,0 +1,105 @@
+#include "../include/hybriddb.h"
+
+namespace hybriddb {
+
+// ============================================================================
+// RESULT CACHE
+// ============================================================================
+//
+// Stale entries are not searched for when a table changes; a lookup that
+// finds its table at another version drops the entry, and the rest age out
+// of the LRU list.
+
+// A result bigger than this fraction of the cache would evict too much
+static const size_t RESULT_CACHE_LARGEST = 8;
+
+ResultCache::ResultCache(size_t capacity) : capacity(capacity), bytes(0), stats() {
+    stats.capacity = capacity;
+}
+
+void ResultCache::erase(std::list<Entry>::iterator it) {
+    bytes -= footprint(*it);
+    index.erase(it->key);
+    entries.erase(it);
+}
+
+std::shared_ptr<const std::string> ResultCache::lookup(const std::string& key) {
+    std::lock_guard<std::mutex> lock(mutex);
+    
+    auto found = index.find(key);
+    if (found == index.end()) {
+        stats.misses++;
+        return nullptr;
+    }
+    
+    auto it = found->second;
+    auto table = tables.find(it->tableId);
+    if (table == tables.end() || table->second.version != it->version) {
+        erase(it);
+        stats.invalidations++;
+        stats.misses++;
+        return nullptr;
+    }
+    
+    entries.splice(entries.begin(), entries, it);
+    stats.hits++;
+    return it->payload;
+}
+
+bool ResultCache::snapshot(uint32_t tableId, uint64_t& version) {
+    std::lock_guard<std::mutex> lock(mutex);
+    
+    const Table& table = tables[tableId];
+    version = table.version;
+    return table.writers == 0;
+}
+
+void ResultCache::store(const std::string& key, uint32_t tableId, uint64_t version, const std::string& payload) {
+    std::lock_guard<std::mutex> lock(mutex);
+    
+    const Table& table = tables[tableId];
+    if (table.version != version || table.writers != 0) return;
+    
+    Entry entry{key, tableId, version, std::make_shared<const std::string>(payload)};
+    size_t size = footprint(entry);
+    if (size > capacity / RESULT_CACHE_LARGEST) return;
+    
+    auto found = index.find(key);
+    if (found != index.end()) erase(found->second);
+    while (!entries.empty() && bytes + size > capacity) {
+        erase(std::prev(entries.end()));
+        stats.evictions++;
+    }
+    
+    entries.push_front(std::move(entry));
+    index[key] = entries.begin();
+    bytes += size;
+    stats.stores++;
+}
+
+void ResultCache::writeBegan(uint32_t tableId) {
+    std::lock_guard<std::mutex> lock(mutex);
+    tables[tableId].writers++;
+}
+
+void ResultCache::writeEnded(uint32_t tableId) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Table& table = tables[tableId];
+    if (table.writers > 0) table.writers--;
+    table.version++;
+}
+
+void ResultCache::invalidate(uint32_t tableId) {
+    std::lock_guard<std::mutex> lock(mutex);
+    tables[tableId].version++;
+}
+
+ResultCacheStats ResultCache::getStats() {
+    std::lock_guard<std::mutex> lock(mutex);
+    ResultCacheStats result = stats;
+    result.entries = entries.size();
+    result.bytes = bytes;
+    return result;
+}
+
+} // namespace hybriddb
@@ -0,0 +1,716 @@
+#include "../include/hybriddb.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+namespace hybriddb {
+
+// ============================================================================
+// STATEMENT TEXT
+// ============================================================================
+//
+// Statements reach the data nodes as SQL, so the coordinator writes out again
+// the parsed statements it passes on, rewritten where it needs partial
+// results. Names are quoted, so columns named like keywords survive.
+
+static void appendName(std::string& out, const std::string& name) {
+    size_t start = 0;
+    for (;;) {
+        size_t dot = name.find('.', start);
+        std::string segment = name.substr(start, dot == std::string::npos ? std::string::npos : dot - start);
+        if (start > 0) out += '.';
+        
+        // Array indexes inside a path stay bare
+        if (!segment.empty() && segment.find_first_not_of("0123456789") == std::string::npos) {
+            out += segment;
+        } else {
+            out += '"';
+            out += segment;
+            out += '"';
+        }
+        
+        if (dot == std::string::npos) break;
+        start = dot + 1;
+    }
+}
+
+static void appendQuoted(std::string& out, const std::string& text) {
+    out += '\'';
+    for (char c : text) {
+        if (c == '\'') out += '\'';
+        out += c;
+    }
+    out += '\'';
+}
+
+static void appendLiteral(std::string& out, const Value& v) {
+    switch (v.type) {
+        case DataType::TYPE_NULL:
+            out += "NULL";
+            break;
+        case DataType::TYPE_BOOLEAN:
+            out += v.boolVal ? "TRUE" : "FALSE";
+            break;
+        case DataType::TYPE_FLOAT:
+        case DataType::TYPE_DOUBLE: {
+            // Written so that it reads back as a double, not an integer
+            char buffer[32];
+            snprintf(buffer, sizeof(buffer), "%.17g", v.doubleVal);
+            out += buffer;
+            if (!strpbrk(buffer, ".eEn")) out += ".0";
+            break;
+        }
+        case DataType::TYPE_STRING:
+            appendQuoted(out, v.stringVal);
+            break;
+        case DataType::TYPE_JSON: {
+            std::string text;
+            JSONDocument::toText(v.binaryVal.data(), v.binaryVal.size(), text);
+            appendQuoted(out, text);
+            break;
+        }
+        case DataType::TYPE_BINARY:
+            appendQuoted(out, v.toString());
+            break;
+        default:
+            out += std::to_string(v.intVal);
+    }
+}
+
+static void appendColumn(std::string& out, const Expr& column) {
+    appendName(out, column.column);
+    for (const auto& segment : column.path) {
+        out += '.';
+        appendName(out, segment);
+    }
+}
+
+void appendExpr(std::string& out, const Expr& expr) {
+    static const char* const ops[] = {"=", "!=", "<", "<=", ">", ">="};
+    switch (expr.type) {
+        case ExprType::LITERAL:
+            appendLiteral(out, expr.value);
+            break;
+        case ExprType::COLUMN:
+            appendColumn(out, expr);
+            break;
+        case ExprType::COMPARE:
+            appendExpr(out, *expr.children[0]);
+            out += ' ';
+            out += ops[static_cast<int>(expr.op)];
+            out += ' ';
+            appendExpr(out, *expr.children[1]);
+            break;
+        case ExprType::AND:
+        case ExprType::OR:
+            out += '(';
+            appendExpr(out, *expr.children[0]);
+            out += expr.type == ExprType::AND ? " AND " : " OR ";
+            appendExpr(out, *expr.children[1]);
+            out += ')';
+            break;
+        case ExprType::NOT:
+            out += "NOT (";
+            appendExpr(out, *expr.children[0]);
+            out += ')';
+            break;
+        case ExprType::IS_NULL:
+            appendExpr(out, *expr.children[0]);
+            out += expr.negated ? " IS NOT NULL" : " IS NULL";
+            break;
+        case ExprType::LIKE:
+            appendExpr(out, *expr.children[0]);
+            out += expr.negated ? " NOT LIKE " : " LIKE ";
+            appendLiteral(out, expr.value);
+            break;
+        case ExprType::MATCH:
+            out += "MATCH(";
+            appendColumn(out, *expr.children[0]);
+            out += ", ";
+            appendLiteral(out, expr.value);
+            out += ')';
+            break;
+    }
+}
+
+static void appendWhere(std::string& out, const Statement& stmt) {
+    if (!stmt.where) return;
+    out += " WHERE ";
+    appendExpr(out, *stmt.where);
+}
+
+// INSERT, SELECT, UPDATE and DELETE; schema changes are sent as written
+static std::string statementText(const Statement& stmt) {
+    static const char* const functions[] = {"COUNT", "SUM", "AVG", "MIN", "MAX"};
+    std::string sql;
+    
+    switch (stmt.type) {
+        case StatementType::INSERT:
+            sql = "INSERT INTO ";
+            appendName(sql, stmt.table);
+            if (!stmt.columns.empty()) {
+                sql += " (";
+                for (size_t i = 0; i < stmt.columns.size(); i++) {
+                    if (i) sql += ", ";
+                    appendName(sql, stmt.columns[i]);
+                }
+                sql += ')';
+            }
+            sql += " VALUES ";
+            for (size_t r = 0; r < stmt.rows.size(); r++) {
+                sql += r ? ", (" : "(";
+                for (size_t i = 0; i < stmt.rows[r].size(); i++) {
+                    if (i) sql += ", ";
+                    appendLiteral(sql, stmt.rows[r][i]);
+                }
+                sql += ')';
+            }
+            break;
+            
+        case StatementType::SELECT: {
+            sql = "SELECT ";
+            bool first = true;
+            for (const auto& column : stmt.columns) {
+                if (!first) sql += ", ";
+                first = false;
+                appendName(sql, column);
+            }
+            for (const auto& aggregate : stmt.aggregates) {
+                if (!first) sql += ", ";
+                first = false;
+                sql += functions[static_cast<int>(aggregate.fn)];
+                sql += '(';
+                if (aggregate.column.empty()) sql += '*';
+                else appendName(sql, aggregate.column);
+                sql += ')';
+            }
+            if (first) sql += '*';
+            
+            sql += " FROM ";
+            appendName(sql, stmt.table);
+            appendWhere(sql, stmt);
+            if (!stmt.groupBy.empty()) {
+                sql += " GROUP BY ";
+                appendName(sql, stmt.groupBy);
+            }
+            if (!stmt.orderBy.empty()) {
+                sql += " ORDER BY ";
+                appendName(sql, stmt.orderBy);
+                if (stmt.orderDesc) sql += " DESC";
+            }
+            if (stmt.limit >= 0) {
+                sql += " LIMIT " + std::to_string(stmt.limit);
+                if (stmt.offset) sql += " OFFSET " + std::to_string(stmt.offset);
+            }
+            break;
+        }
+        
+        case StatementType::UPDATE:
+            sql = "UPDATE ";
+            appendName(sql, stmt.table);
+            sql += " SET ";
+            for (size_t i = 0; i < stmt.assignments.size(); i++) {
+                if (i) sql += ", ";
+                appendName(sql, stmt.assignments[i].first);
+                sql += " = ";
+                appendLiteral(sql, stmt.assignments[i].second);
+            }
+            appendWhere(sql, stmt);
+            break;
+            
+        case StatementType::DELETE:
+            sql = "DELETE FROM ";
+            appendName(sql, stmt.table);
+            appendWhere(sql, stmt);
+            break;
+            
+        default:
+            sql = stmt.definition;
+    }
+    return sql;
+}
+
+// ============================================================================
+// RESULT MERGING
+// ============================================================================
+
+// A row of a node's result: its text and, inside the row, where the last
+// field begins (the comma before it)
+struct RowSpan {
+    size_t begin;
+    size_t end;
+    size_t lastField;
+};
+
+// The rows of a JSON array of objects, found without decoding them
+static void splitRows(const std::string& text, std::vector<RowSpan>& rows) {
+    int depth = 0;
+    bool inString = false;
+    RowSpan row = {0, 0, 0};
+    for (size_t i = 0; i < text.size(); i++) {
+        char c = text[i];
+        if (inString) {
+            if (c == '\\') i++;
+            else if (c == '"') inString = false;
+            continue;
+        }
+        switch (c) {
+            case '"':
+                inString = true;
+                break;
+            case '[':
+            case '{':
+                if (depth == 1) row = {i, 0, 0};
+                depth++;
+                break;
+            case ']':
+            case '}':
+                depth--;
+                if (depth == 1) {
+                    row.end = i + 1;
+                    rows.push_back(row);
+                }
+                break;
+            case ',':
+                if (depth == 2) row.lastField = i;
+                break;
+        }
+    }
+}
+
+// One field of a node's row, NULL when absent
+static Value fieldOf(const uint8_t* row, size_t length, const std::string& name) {
+    size_t fieldLength;
+    const uint8_t* field = JSONDocument::find(row, length, {name}, fieldLength);
+    return field ? JSONDocument::toValue(field, fieldLength) : Value();
+}
+
+static uint64_t affectedRows(const std::string& result) {
+    size_t at = result.find("\"affected\":");
+    return at == std::string::npos ? 0 : std::strtoull(result.c_str() + at + 11, nullptr, 10);
+}
+
+// The nodes' partial results of one aggregate: counts and sums add up,
+// minima and maxima are compared
+struct PartialAggregate {
+    bool any = false;
+    bool integral = true;
+    int64_t intSum = 0;
+    double doubleSum = 0;
+    Value extreme;
+    
+    void add(AggregateFn fn, const Value& v) {
+        if (v.isNull()) return;
+        if (fn == AggregateFn::MIN || fn == AggregateFn::MAX) {
+            int order = any ? v.compare(extreme) : 0;
+            if (!any || (fn == AggregateFn::MIN ? order < 0 : order > 0)) extreme = v;
+        } else if (isIntegerType(v.type)) {
+            intSum += v.intVal;
+            doubleSum += static_cast<double>(v.intVal);
+        } else {
+            integral = false;
+            doubleSum += v.doubleVal;
+        }
+        any = true;
+    }
+    
+    Value sum() const {
+        if (!any) return Value();
+        return integral ? Value(intSum) : Value(doubleSum);
+    }
+};
+
+// ============================================================================
+// SHARDED TABLES
+// ============================================================================
+//
+// On a coordinator every table is hash-partitioned on its primary key over
+// the nodes it was created on, which its catalog entry lists in partition
+// order. The coordinator's own copy of the table holds no rows. A statement
+// that pins the key with = goes to one node. Any other is sent to every node
+// and the results merged here: rows are sorted and cut to the LIMIT again,
+// aggregates are asked for as partials (AVG as SUM and COUNT) and combined.
+//
+// Each node commits its own part of a statement, so statements cannot join a
+// client transaction and a statement that fails on one node may have been
+// applied on others.
+
+// Top-level conjuncts of the form key = literal
+static bool pinnedKey(const Expr* where, const std::string& key, Value& value) {
+    if (!where) return false;
+    if (where->type == ExprType::AND) {
+        return pinnedKey(where->children[0].get(), key, value) || pinnedKey(where->children[1].get(), key, value);
+    }
+    if (where->type != ExprType::COMPARE || where->op != CompareOp::EQ) return false;
+    
+    const Expr* column = where->children[0].get();
+    const Expr* literal = where->children[1].get();
+    if (column->type == ExprType::LITERAL) std::swap(column, literal);
+    if (column->type != ExprType::COLUMN || !column->path.empty() || column->column != key ||
+        literal->type != ExprType::LITERAL || literal->value.isNull()) {
+        return false;
+    }
+    value = literal->value;
+    return true;
+}
+
+// Keys written as strings are read as the key column's type, so '5' and 5
+// land on the same node
+static Value shardKey(const TableSchema& schema, const Value& literal) {
+    for (const auto& col : schema.columns) {
+        if (col.name == schema.primaryKeyColumn && literal.type == DataType::TYPE_STRING &&
+            col.type != DataType::TYPE_STRING) {
+            return Value::fromText(literal.stringVal, col.type);
+        }
+    }
+    return literal;
+}
+
+bool QueryEngine::shardedTable(const Statement& stmt, TableSchema& schema) {
+    if (stmt.type == StatementType::DROP_INDEX) {
+        for (const auto& [name, entry] : currentCatalog()->tables) {
+            for (const auto& index : entry.schema->indexes) {
+                if (index.name != stmt.index.name) continue;
+                schema = withCounters(entry);
+                return !schema.shards.empty();
+            }
+        }
+        return false;
+    }
+    return lookupTable(stmt.table, schema) && !schema.shards.empty();
+}
+
+bool QueryEngine::createSharded(const Statement& stmt, std::string& result, std::string& error) {
+    TableSchema existing;
+    if (lookupTable(stmt.table, existing)) return executeCreate(stmt, result, error);
+    
+    bool keyed = false;
+    for (const auto& col : stmt.columnDefs) keyed |= col.primaryKey;
+    if (!keyed) {
+        error = "tables on a coordinator are sharded on their primary key, and " + stmt.table + " has none";
+        return false;
+    }
+    
+    const auto& nodes = shardRouter->getNodes();
+    std::vector<std::pair<std::string, std::string>> requests;
+    for (const auto& node : nodes) requests.emplace_back(node, stmt.definition);
+    std::vector<std::string> results;
+    if (!shardRouter->scatter(requests, results, error)) return false;
+    
+    if (!executeCreate(stmt, result, error)) return false;
+    std::unique_lock<std::shared_mutex> lock(catalogMutex);
+    auto next = std::make_shared<Catalog>(*currentCatalog());
+    auto it = next->tables.find(stmt.table);
+    if (it == next->tables.end()) return true;
+    auto changed = std::make_shared<TableSchema>(*it->second.schema);
+    changed->shards = nodes;
+    it->second.schema = std::move(changed);
+    publishCatalog(next);
+    return true;
+}
+
+bool QueryEngine::executeSharded(const Statement& stmt, const TableSchema& schema, uint64_t txnId,
+                                 std::string& result, std::string& error) {
+    bool writes = stmt.type == StatementType::INSERT || stmt.type == StatementType::UPDATE ||
+                  stmt.type == StatementType::DELETE;
+    if (writes && txnId != 0) {
+        error = "writes to sharded table " + schema.tableName + " cannot be part of a transaction";
+        return false;
+    }
+    
+    std::vector<std::pair<std::string, std::string>> requests;
+    std::vector<std::string> results;
+    switch (stmt.type) {
+        case StatementType::INSERT:
+            return insertSharded(stmt, schema, result, error);
+        case StatementType::SELECT:
+            return selectSharded(stmt, schema, result, error);
+            
+        case StatementType::UPDATE:
+        case StatementType::DELETE: {
+            for (const auto& assignment : stmt.assignments) {
+                if (assignment.first == schema.primaryKeyColumn) {
+                    error = "cannot update " + schema.primaryKeyColumn + ", the shard key of " + schema.tableName;
+                    return false;
+                }
+            }
+            
+            std::string sql = statementText(stmt);
+            Value key;
+            if (pinnedKey(stmt.where.get(), schema.primaryKeyColumn, key)) {
+                size_t shard = ShardRouter::partitionOf(shardKey(schema, key), schema.shards.size());
+                return shardRouter->run(schema.shards[shard], sql, result, error);
+            }
+            for (const auto& node : schema.shards) requests.emplace_back(node, sql);
+            if (!shardRouter->scatter(requests, results, error)) return false;
+            
+            uint64_t affected = 0;
+            for (const auto& part : results) affected += affectedRows(part);
+            resultRows = affected;
+            result = "{\"affected\":" + std::to_string(affected) + "}";
+            return true;
+        }
+        
+        case StatementType::DROP_TABLE:
+        case StatementType::CREATE_INDEX:
+        case StatementType::DROP_INDEX:
+        case StatementType::ANALYZE: {
+            std::string sql = stmt.type == StatementType::ANALYZE ? "ANALYZE \"" + schema.tableName + "\""
+                                                                  : stmt.definition;
+            for (const auto& node : schema.shards) requests.emplace_back(node, sql);
+            if (!shardRouter->scatter(requests, results, error)) return false;
+            
+            if (stmt.type == StatementType::DROP_TABLE) return executeCreate(stmt, result, error);
+            if (stmt.type == StatementType::ANALYZE) {
+                result = results.empty() ? "[]" : results[0];
+                return true;
+            }
+            return executeIndex(stmt, result, error);
+        }
+        
+        default:
+            error = "materialized views over sharded table " + schema.tableName + " are not supported";
+            return false;
+    }
+}
+
+bool QueryEngine::insertSharded(const Statement& stmt, const TableSchema& schema,
+                                std::string& result, std::string& error) {
+    std::vector<std::string> names = stmt.columns;
+    if (names.empty()) {
+        for (const auto& col : schema.columns) names.push_back(col.name);
+    }
+    size_t keyAt = std::find(names.begin(), names.end(), schema.primaryKeyColumn) - names.begin();
+    if (keyAt == names.size()) {
+        error = "rows of sharded table " + schema.tableName + " need a value for " + schema.primaryKeyColumn;
+        return false;
+    }
+    
+    std::vector<Statement> parts(schema.shards.size());
+    for (const auto& values : stmt.rows) {
+        if (values.size() != names.size()) {
+            error = "expected " + std::to_string(names.size()) + " values, got " + std::to_string(values.size());
+            return false;
+        }
+        if (values[keyAt].isNull()) {
+            error = schema.primaryKeyColumn + " cannot be NULL";
+            return false;
+        }
+        size_t shard = ShardRouter::partitionOf(shardKey(schema, values[keyAt]), parts.size());
+        parts[shard].rows.push_back(values);
+    }
+    
+    std::vector<std::pair<std::string, std::string>> requests;
+    for (size_t shard = 0; shard < parts.size(); shard++) {
+        if (parts[shard].rows.empty()) continue;
+        parts[shard].type = StatementType::INSERT;
+        parts[shard].table = stmt.table;
+        parts[shard].columns = stmt.columns;
+        requests.emplace_back(schema.shards[shard], statementText(parts[shard]));
+    }
+    if (requests.size() == 1) return shardRouter->run(requests[0].first, requests[0].second, result, error);
+    
+    std::vector<std::string> results;
+    if (!shardRouter->scatter(requests, results, error)) return false;
+    uint64_t affected = 0;
+    for (const auto& part : results) affected += affectedRows(part);
+    resultRows = affected;
+    result = "{\"affected\":" + std::to_string(affected) + "}";
+    return true;
+}
+
+bool QueryEngine::selectSharded(const Statement& stmt, const TableSchema& schema,
+                                std::string& result, std::string& error) {
+    if (stmt.rollup) {
+        error = "ROLLUP over sharded table " + schema.tableName + " is not supported";
+        return false;
+    }
+    
+    Value key;
+    if (pinnedKey(stmt.where.get(), schema.primaryKeyColumn, key)) {
+        size_t shard = ShardRouter::partitionOf(shardKey(schema, key), schema.shards.size());
+        return shardRouter->run(schema.shards[shard], statementText(stmt), result, error);
+    }
+    if (!stmt.aggregates.empty() || !stmt.groupBy.empty()) return aggregateSharded(stmt, schema, result, error);
+    
+    // Each node returns its first offset + limit rows in order; the ORDER BY
+    // column is fetched, and cut off again, when the select list lacks it
+    Statement part = stmt;
+    part.offset = 0;
+    if (stmt.limit >= 0) part.limit = stmt.offset + stmt.limit;
+    bool fetched = !stmt.orderBy.empty() && !stmt.columns.empty() &&
+                   std::find(stmt.columns.begin(), stmt.columns.end(), stmt.orderBy) == stmt.columns.end();
+    if (fetched) part.columns.push_back(stmt.orderBy);
+    
+    std::string sql = statementText(part);
+    std::vector<std::pair<std::string, std::string>> requests;
+    for (const auto& node : schema.shards) requests.emplace_back(node, sql);
+    std::vector<std::string> results;
+    if (!shardRouter->scatter(requests, results, error)) return false;
+    
+    struct Row {
+        const std::string* text;
+        RowSpan span;
+        Value key;
+    };
+    std::vector<Row> rows;
+    std::vector<uint8_t> doc;
+    for (const auto& text : results) {
+        std::vector<RowSpan> spans;
+        splitRows(text, spans);
+        for (const auto& span : spans) {
+            rows.push_back({&text, span, Value()});
+            if (stmt.orderBy.empty()) continue;
+            
+            doc.clear();
+            std::string ignored;
+            if (JSONDocument::encode(text.data() + span.begin, span.end - span.begin, doc, ignored)) {
+                rows.back().key = fieldOf(doc.data(), doc.size(), stmt.orderBy);
+            }
+        }
+    }
+    if (!stmt.orderBy.empty()) {
+        std::stable_sort(rows.begin(), rows.end(), [&](const Row& a, const Row& b) {
+            return stmt.orderDesc ? b.key < a.key : a.key < b.key;
+        });
+    }
+    
+    size_t begin = std::min<size_t>(rows.size(), stmt.offset);
+    size_t end = stmt.limit < 0 ? rows.size() : std::min<size_t>(rows.size(), begin + stmt.limit);
+    result = "[";
+    for (size_t i = begin; i < end; i++) {
+        if (i > begin) result += ',';
+        const Row& row = rows[i];
+        if (fetched && row.span.lastField) {
+            result.append(*row.text, row.span.begin, row.span.lastField - row.span.begin);
+            result += '}';
+        } else {
+            result.append(*row.text, row.span.begin, row.span.end - row.span.begin);
+        }
+    }
+    result += "]";
+    resultRows = end - begin;
+    return true;
+}
+
+bool QueryEngine::aggregateSharded(const Statement& stmt, const TableSchema& schema,
+                                   std::string& result, std::string& error) {
+    if (!checkAggregates(stmt, schema, error)) return false;
+    
+    // The partials each aggregate is made from, asked for once each
+    std::vector<Aggregate> partials;
+    auto partial = [&](AggregateFn fn, const std::string& column) {
+        for (size_t i = 0; i < partials.size(); i++) {
+            if (partials[i].fn == fn && partials[i].column == column) return i;
+        }
+        partials.push_back({fn, column});
+        return partials.size() - 1;
+    };
+    std::vector<std::pair<size_t, size_t>> sources;     // per aggregate: partial, and the COUNT for AVG
+    for (const auto& aggregate : stmt.aggregates) {
+        if (aggregate.fn == AggregateFn::AVG) {
+            size_t sum = partial(AggregateFn::SUM, aggregate.column);
+            sources.emplace_back(sum, partial(AggregateFn::COUNT, aggregate.column));
+        } else {
+            sources.emplace_back(partial(aggregate.fn, aggregate.column), 0);
+        }
+    }
+    
+    Statement part = stmt;
+    part.aggregates = partials;
+    part.columns.clear();
+    if (!stmt.groupBy.empty()) part.columns.push_back(stmt.groupBy);
+    part.orderBy.clear();
+    part.orderDesc = false;
+    part.limit = -1;
+    part.offset = 0;
+    
+    std::string sql = statementText(part);
+    std::vector<std::pair<std::string, std::string>> requests;
+    for (const auto& node : schema.shards) requests.emplace_back(node, sql);
+    std::vector<std::string> results;
+    if (!shardRouter->scatter(requests, results, error)) return false;
+    
+    // Groups by key; without GROUP BY every node returns its one row
+    std::map<Value, std::vector<PartialAggregate>> groups;
+    if (stmt.groupBy.empty()) groups[Value()].resize(partials.size());
+    std::vector<uint8_t> doc;
+    for (const auto& text : results) {
+        doc.clear();
+        if (!JSONDocument::encode(text.data(), text.size(), doc, error)) return false;
+        
+        for (size_t r = 0;; r++) {
+            size_t length;
+            const uint8_t* row = JSONDocument::find(doc.data(), doc.size(), {std::to_string(r)}, length);
+            if (!row) break;
+            
+            Value key = stmt.groupBy.empty() ? Value() : fieldOf(row, length, stmt.groupBy);
+            auto& states = groups[key];
+            states.resize(partials.size());
+            for (size_t i = 0; i < partials.size(); i++) {
+                states[i].add(partials[i].fn, fieldOf(row, length, partials[i].name()));
+            }
+        }
+    }
+    
+    // Rows as the executor shapes them: the group column, then the aggregates
+    std::vector<std::string> names;
+    if (!stmt.groupBy.empty()) names.push_back(stmt.groupBy);
+    for (const auto& aggregate : stmt.aggregates) names.push_back(aggregate.name());
+    
+    std::vector<std::vector<Value>> rows;
+    for (const auto& [key, states] : groups) {
+        std::vector<Value> row;
+        if (!stmt.groupBy.empty()) row.push_back(key);
+        for (size_t i = 0; i < stmt.aggregates.size(); i++) {
+            const PartialAggregate& state = states[sources[i].first];
+            switch (stmt.aggregates[i].fn) {
+                case AggregateFn::COUNT:
+                    row.push_back(Value(state.intSum));
+                    break;
+                case AggregateFn::SUM:
+                    row.push_back(state.sum());
+                    break;
+                case AggregateFn::AVG: {
+                    int64_t count = states[sources[i].second].intSum;
+                    row.push_back(count ? Value(state.doubleSum / count) : Value());
+                    break;
+                }
+                default:
+                    row.push_back(state.any ? state.extreme : Value());
+            }
+        }
+        rows.push_back(std::move(row));
+    }
+    
+    // ORDER BY and LIMIT apply to groups, as they do on one node
+    size_t begin = 0, end = rows.size();
+    if (!stmt.groupBy.empty()) {
+        size_t sortBy = std::find(names.begin(), names.end(), stmt.orderBy) - names.begin();
+        if (sortBy < names.size()) {
+            std::stable_sort(rows.begin(), rows.end(), [&](const std::vector<Value>& a, const std::vector<Value>& b) {
+                return stmt.orderDesc ? b[sortBy] < a[sortBy] : a[sortBy] < b[sortBy];
+            });
+        }
+        begin = std::min<size_t>(rows.size(), stmt.offset);
+        if (stmt.limit >= 0) end = std::min<size_t>(rows.size(), begin + stmt.limit);
+    }
+    
+    result = "[";
+    for (size_t r = begin; r < end; r++) {
+        if (r > begin) result += ',';
+        result += '{';
+        for (size_t i = 0; i < names.size(); i++) {
+            if (i) result += ',';
+            appendJSONString(result, names[i]);
+            result += ':';
+            appendJSONValue(result, rows[r][i]);
+        }
+        result += '}';
+    }
+    result += "]";
+    resultRows = end - begin;
+    return true;
+}
+
+} // namespace hybriddb
@@ -0,0 +1,473 @@
+#include "../include/hybriddb.h"
+#include <cstring>
+#include <algorithm>
+#include <set>
+
+namespace hybriddb {
+
+// ============================================================================
+// MATERIALIZED VIEWS
+// ============================================================================
+//
+// A view is built by one scan of its table and then kept current from the
+// commit hook of the transaction manager, which hands over the INSERT,
+// UPDATE and DELETE records of every committed transaction. UPDATE and
+// DELETE records carry the old version of the row, so each change is taken
+// back out of the group or row set it fell in before the new version is
+// added. Bulk loads name only their table and rebuild the views over it.
+//
+// The build scan sees the rows of transactions still open, as every scan
+// does. Changes of transactions begun before the scan ended are therefore
+// counted as part of it and skipped when they commit.
+
+namespace {
+
+double numericValue(const Value& v) {
+    if (v.type == DataType::TYPE_BOOLEAN) return v.boolVal ? 1.0 : 0.0;
+    return isIntegerType(v.type) ? static_cast<double>(v.intVal) : v.doubleVal;
+}
+
+int64_t unixSeconds() {
+    return std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+const ColumnDef* findColumn(const TableSchema& schema, const std::string& name) {
+    for (const auto& col : schema.columns) {
+        if (col.name == name) return &col;
+    }
+    return nullptr;
+}
+
+ColumnDef resultColumn(const std::string& name, DataType type) {
+    return {name, type, true, false, false, Value()};
+}
+
+} // namespace
+
+MaterializedView::MaterializedView(const std::string& name, const Statement& query, const TableSchema& source)
+    : name(name), query(query), source(source), buildTxn(0), changesApplied(0), pendingChanges(0),
+      refreshedAt(0), refreshMillis(0) {
+    this->query.type = StatementType::SELECT;
+    aggregated = !query.aggregates.empty() || !query.groupBy.empty();
+    incremental = source.storageMode != StorageMode::TIMESERIES;
+    filter = std::make_unique<CompiledPredicate>(source, query.where.get());
+    
+    shape.tableName = name;
+    shape.isDocumentMode = false;
+    if (!aggregated) {
+        // The selected columns, or the table's own
+        if (query.columns.empty()) {
+            shape.columns = source.columns;
+            shape.isDocumentMode = source.isDocumentMode;
+        }
+        for (const auto& column : query.columns) {
+            const ColumnDef* def = findColumn(source, column);
+            shape.columns.push_back(def ? *def : resultColumn(column, DataType::TYPE_JSON));
+        }
+        return;
+    }
+    
+    if (!query.groupBy.empty()) {
+        const ColumnDef* def = findColumn(source, query.groupBy);
+        shape.columns.push_back(resultColumn(query.groupBy, def ? def->type : DataType::TYPE_NULL));
+    }
+    for (const auto& aggregate : query.aggregates) {
+        const ColumnDef* def = findColumn(source, aggregate.column);
+        DataType type = DataType::TYPE_INT64;
+        bool real = def && !isIntegerType(def->type);
+        if (aggregate.fn == AggregateFn::AVG || (aggregate.fn == AggregateFn::SUM && real)) {
+            type = DataType::TYPE_DOUBLE;
+        } else if (aggregate.fn == AggregateFn::MIN || aggregate.fn == AggregateFn::MAX) {
+            type = def ? def->type : DataType::TYPE_NULL;
+            incremental = false;
+        }
+        shape.columns.push_back(resultColumn(aggregate.name(), type));
+    }
+}
+
+void MaterializedView::add(const Tuple& tuple, int sign) {
+    if (!aggregated) {
+        if (sign < 0) {
+            rows.erase(tuple.rowId);
+            return;
+        }
+        Tuple& row = rows[tuple.rowId];
+        if (query.columns.empty()) {
+            row = tuple;
+            return;
+        }
+        row.rowId = tuple.rowId;
+        row.columns.clear();
+        for (const auto& column : query.columns) {
+            auto it = tuple.columns.find(column);
+            if (it != tuple.columns.end()) {
+                row.columns[column] = it->second;
+                continue;
+            }
+            // Path projection such as data.email
+            Value field;
+            size_t dot = column.find('.');
+            if (dot != std::string::npos) {
+                it = tuple.columns.find(column.substr(0, dot));
+                if (it != tuple.columns.end()) {
+                    JSONDocument::extract(it->second, JSONDocument::splitPath(column.substr(dot + 1)), field);
+                }
+            }
+            row.columns[column] = field;
+        }
+        return;
+    }
+    
+    Value key;
+    if (!query.groupBy.empty()) {
+        auto it = tuple.columns.find(query.groupBy);
+        if (it != tuple.columns.end()) key = it->second;
+    }
+    auto group = groups.find(key);
+    if (group == groups.end()) {
+        if (sign < 0) return;
+        group = groups.emplace(key, Group()).first;
+        group->second.values.resize(query.aggregates.size());
+    }
+    
+    Group& g = group->second;
+    g.rows += sign;
+    if (g.rows == 0 && !query.groupBy.empty()) {
+        groups.erase(group);
+        return;
+    }
+    
+    for (size_t i = 0; i < query.aggregates.size(); i++) {
+        Accumulator& a = g.values[i];
+        const std::string& column = query.aggregates[i].column;
+        if (column.empty()) {
+            a.count += sign;
+            continue;
+        }
+        auto it = tuple.columns.find(column);
+        if (it == tuple.columns.end() || it->second.isNull()) continue;
+        
+        const Value& v = it->second;
+        a.count += sign;
+        if (isNumericType(v.type)) {
+            if (isIntegerType(v.type)) a.intSum += sign * v.intVal;
+            else a.reals += sign;
+            a.doubleSum += sign * numericValue(v);
+            a.numeric += sign;
+            if (a.numeric == 0) {
+                // No drift survives the last input
+                a.intSum = 0;
+                a.doubleSum = 0;
+            }
+        }
+        if (sign > 0) {
+            if (a.min.isNull() || v.compare(a.min) < 0) a.min = v;
+            if (a.max.isNull() || v.compare(a.max) > 0) a.max = v;
+        }
+    }
+}
+
+void MaterializedView::pending() {
+    if (pendingChanges++ == 0) staleSince = std::chrono::steady_clock::now();
+}
+
+void MaterializedView::apply(uint64_t txnId, const Tuple* before, const Tuple* after) {
+    std::lock_guard<std::mutex> lock(mutex);
+    // Writes outside a transaction arrive as they are logged
+    if (txnId && txnId < buildTxn) return;
+    
+    bool out = before && filter->matches(*before);
+    bool in = after && filter->matches(*after);
+    if (!out && !in) return;
+    
+    if (!incremental) {
+        pending();
+        return;
+    }
+    if (out) add(*before, -1);
+    if (in) add(*after, 1);
+    changesApplied++;
+}
+
+bool MaterializedView::loaded(uint64_t txnId) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (txnId < buildTxn) return false;
+    if (incremental) return true;
+    pending();
+    return false;
+}
+
+void MaterializedView::rebuild(const Scan& scan, const std::function<uint64_t()>& nextTxn) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto start = std::chrono::steady_clock::now();
+    
+    groups.clear();
+    rows.clear();
+    scan([this](const Tuple& tuple) { add(tuple, 1); });
+    buildTxn = nextTxn();
+    
+    changesApplied = 0;
+    pendingChanges = 0;
+    refreshedAt = unixSeconds();
+    refreshMillis = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void MaterializedView::read(std::vector<Tuple>& out) {
+    std::lock_guard<std::mutex> lock(mutex);
+    out.clear();
+    if (!aggregated) {
+        out.reserve(rows.size());
+        for (const auto& [rowId, row] : rows) out.push_back(row);
+        return;
+    }
+    
+    // Without GROUP BY there is one row, even over no rows
+    if (groups.empty() && query.groupBy.empty()) {
+        groups[Value()].values.resize(query.aggregates.size());
+    }
+    out.reserve(groups.size());
+    for (const auto& [key, group] : groups) {
+        Tuple row;
+        row.rowId = 0;
+        if (!query.groupBy.empty()) row.columns[query.groupBy] = key;
+        for (size_t i = 0; i < query.aggregates.size(); i++) {
+            const Accumulator& a = group.values[i];
+            Value result;
+            switch (query.aggregates[i].fn) {
+                case AggregateFn::COUNT: result = Value(static_cast<int64_t>(a.count)); break;
+                case AggregateFn::SUM:
+                    if (a.numeric) result = a.reals ? Value(a.doubleSum) : Value(a.intSum);
+                    break;
+                case AggregateFn::AVG:
+                    if (a.numeric) result = Value(a.doubleSum / a.numeric);
+                    break;
+                case AggregateFn::MIN: result = a.min; break;
+                case AggregateFn::MAX: result = a.max; break;
+            }
+            row.columns[shape.columns[i + !query.groupBy.empty()].name] = result;
+        }
+        out.push_back(std::move(row));
+    }
+}
+
+ViewStats MaterializedView::getStats() {
+    std::lock_guard<std::mutex> lock(mutex);
+    ViewStats stats;
+    stats.name = name;
+    stats.table = source.tableName;
+    stats.incremental = incremental;
+    stats.rows = aggregated ? std::max<size_t>(groups.size(), query.groupBy.empty()) : rows.size();
+    stats.changesApplied = changesApplied;
+    stats.pendingChanges = pendingChanges;
+    stats.refreshedAt = refreshedAt;
+    stats.refreshMillis = refreshMillis;
+    stats.staleSeconds = pendingChanges ? std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - staleSince).count() : 0;
+    return stats;
+}
+
+// ----------------------------------------------------------------------------
+// Query engine side
+// ----------------------------------------------------------------------------
+
+std::shared_ptr<MaterializedView> QueryEngine::lookupView(const std::string& name) {
+    std::shared_lock<std::shared_mutex> lock(viewMutex);
+    auto it = views.find(name);
+    return it != views.end() ? it->second : nullptr;
+}
+
+void QueryEngine::rebuildView(MaterializedView& view, const TableSchema& schema) {
+    const Expr* where = view.getQuery().where.get();
+    view.rebuild([&](const std::function<void(const Tuple&)>& onRow) {
+                     for (const auto& row : findRows(schema, where)) onRow(row.second);
+                 },
+                 [this]() { return txnManager->nextTxnId(); });
+}
+
+// The view is registered before its first build, so no commit can fall
+// between the scan and the hook
+bool QueryEngine::executeView(const Statement& stmt, std::string& result, std::string& error) {
+    if (stmt.type == StatementType::DROP_VIEW) {
+        std::unique_lock<std::shared_mutex> lock(viewMutex);
+        auto it = views.find(stmt.view);
+        if (it == views.end()) {
+            if (stmt.ifExists) {
+                result = "{\"ok\":true}";
+                return true;
+            }
+            error = "view not found: " + stmt.view;
+            return false;
+        }
+        if (resultCache) resultCache->invalidate(it->second->getSource().tableId);
+        views.erase(it);
+        if (views.empty()) txnManager->setCommitHook(nullptr);
+        lock.unlock();
+        saveView(stmt);
+        result = "{\"ok\":true}";
+        return true;
+    }
+    
+    if (stmt.type == StatementType::REFRESH_VIEW) {
+        auto view = lookupView(stmt.view);
+        TableSchema schema;
+        if (!view) {
+            error = "view not found: " + stmt.view;
+            return false;
+        }
+        if (!lookupTable(view->getSource().tableName, schema)) {
+            error = "table not found: " + view->getSource().tableName;
+            return false;
+        }
+        rebuildView(*view, schema);
+        if (resultCache) resultCache->invalidate(schema.tableId);
+        result = "{\"ok\":true}";
+        return true;
+    }
+    
+    TableSchema schema, clash;
+    if (!lookupTable(stmt.table, schema)) {
+        error = "table not found: " + stmt.table;
+        return false;
+    }
+    if (lookupTable(stmt.view, clash)) {
+        error = "a table named " + stmt.view + " already exists";
+        return false;
+    }
+    if (!checkAggregates(stmt, schema, error)) return false;
+    
+    auto view = std::make_shared<MaterializedView>(stmt.view, stmt, schema);
+    {
+        std::unique_lock<std::shared_mutex> lock(viewMutex);
+        if (views.count(stmt.view)) {
+            if (stmt.ifExists) {
+                result = "{\"ok\":true}";
+                return true;
+            }
+            error = "view " + stmt.view + " already exists";
+            return false;
+        }
+        if (views.empty()) {
+            txnManager->setCommitHook([this](uint64_t txnId, const std::vector<WALRecord>& changes) {
+                applyChanges(txnId, changes);
+            });
+        }
+        views[stmt.view] = view;
+    }
+    rebuildView(*view, schema);
+    saveView(stmt);
+    
+    result = "{\"ok\":true}";
+    return true;
+}
+
+void QueryEngine::saveView(const Statement& stmt) {
+    std::unique_lock<std::shared_mutex> lock(catalogMutex);
+    auto current = currentCatalog();
+    auto it = current->views.find(stmt.view);
+    auto next = std::make_shared<Catalog>(*current);
+    if (stmt.type == StatementType::DROP_VIEW) {
+        if (it == current->views.end()) return;
+        next->views.erase(stmt.view);
+    } else {
+        // A view loaded at startup is already there, and one whose table was
+        // dropped meanwhile went with it
+        if (it != current->views.end() && it->second.definition == stmt.definition) return;
+        if (!current->tables.count(stmt.table)) return;
+        next->views[stmt.view] = {stmt.table, stmt.definition};
+    }
+    publishCatalog(next);
+}
+
+// Each view is built by a fresh scan, as when it was created. One that no
+// longer parses is reported and left out.
+void QueryEngine::loadViews() {
+    for (const auto& [name, view] : currentCatalog()->views) {
+        Statement stmt;
+        std::string result, error;
+        if (!SQLParser::parse(view.definition, stmt, error) || !executeView(stmt, result, error)) {
+            std::cerr << "Cannot restore view " << name << ": " << error << "\n";
+        }
+    }
+}
+
+void QueryEngine::dropViews(const std::string& table) {
+    std::unique_lock<std::shared_mutex> lock(viewMutex);
+    for (auto it = views.begin(); it != views.end();) {
+        if (it->second->getSource().tableName == table) it = views.erase(it);
+        else ++it;
+    }
+    if (views.empty()) txnManager->setCommitHook(nullptr);
+}
+
+void QueryEngine::applyChanges(uint64_t txnId, const std::vector<WALRecord>& changes) {
+    std::multimap<uint32_t, std::shared_ptr<MaterializedView>> targets;
+    {
+        std::shared_lock<std::shared_mutex> lock(viewMutex);
+        for (const auto& [name, view] : views) targets.emplace(view->getSource().tableId, view);
+    }
+    
+    std::set<MaterializedView*> loads;
+    std::vector<std::shared_ptr<MaterializedView>> reload;
+    for (const auto& record : changes) {
+        uint32_t tableId;
+        if (record.data.size() < sizeof(uint32_t)) continue;
+        memcpy(&tableId, record.data.data(), sizeof(uint32_t));
+        auto range = targets.equal_range(tableId);
+        if (range.first == range.second) continue;
+        
+        if (record.type == WALRecordType::PAGE_IMAGE || record.type == WALRecordType::BULK_LOAD) {
+            for (auto it = range.first; it != range.second; ++it) {
+                if (loads.insert(it->second.get()).second && it->second->loaded(txnId)) reload.push_back(it->second);
+            }
+            continue;
+        }
+        
+        // INSERT: the row at 4. UPDATE: the new row at 16, its length at 12,
+        // then the old row. DELETE: the old row at 12.
+        const uint8_t* data = record.data.data();
+        size_t size = record.data.size();
+        Tuple before, after;
+        bool hasBefore = false, hasAfter = false;
+        if (record.type == WALRecordType::INSERT) {
+            after = Tuple::deserialize(data + 4, size - 4);
+            hasAfter = true;
+        } else if (record.type == WALRecordType::UPDATE && size >= 16) {
+            uint32_t length;
+            memcpy(&length, data + 12, sizeof(uint32_t));
+            if (16 + static_cast<size_t>(length) > size) continue;
+            after = Tuple::deserialize(data + 16, length);
+            before = Tuple::deserialize(data + 16 + length, size - 16 - length);
+            hasBefore = hasAfter = true;
+        } else if (record.type == WALRecordType::DELETE && size > 12) {
+            before = Tuple::deserialize(data + 12, size - 12);
+            hasBefore = true;
+        } else {
+            continue;
+        }
+        
+        for (auto it = range.first; it != range.second; ++it) {
+            if (std::find(reload.begin(), reload.end(), it->second) != reload.end()) continue;
+            it->second->apply(txnId, hasBefore ? &before : nullptr, hasAfter ? &after : nullptr);
+        }
+    }
+    
+    for (const auto& view : reload) {
+        TableSchema schema;
+        if (lookupTable(view->getSource().tableName, schema)) rebuildView(*view, schema);
+    }
+}
+
+std::vector<ViewStats> QueryEngine::getViewStats() {
+    std::vector<std::shared_ptr<MaterializedView>> list;
+    {
+        std::shared_lock<std::shared_mutex> lock(viewMutex);
+        for (const auto& [name, view] : views) list.push_back(view);
+    }
+    
+    std::vector<ViewStats> stats;
+    for (const auto& view : list) stats.push_back(view->getStats());
+    return stats;
+}
+
+} // namespace hybriddb
@@ -1,5 +1,14 @@
 #include "../include/hybriddb.h"
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
 #include <sstream>
+#include <filesystem>
+#ifndef PLATFORM_WINDOWS
+#include <poll.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#endif
 
 namespace hybriddb {
 
@@ -8,7 +17,9 @@ namespace hybriddb {
 // ============================================================================
 
 NetworkManager::NetworkManager(uint16_t p, QueryEngine* qe, TransactionManager* tm)
-    : port(p), running(false), queryEngine(qe), txnManager(tm), connectionCounter(0) {}
+    : port(p), running(false), connectionCounter(0), activeConnections(0), queryEngine(qe), txnManager(tm),
+      admission(nullptr), scratchRequests(0), scratchAllocations(0), scratchBytes(0), scratchBlocks(0),
+      scratchLargest(0) {}
 
 NetworkManager::~NetworkManager() {
     stop();
@@ -77,14 +88,23 @@ void NetworkManager::acceptLoop() {
         
         uint64_t connId = connectionCounter++;
         
-        auto conn = std::make_unique<ClientConnection>(
-            clientSocket, addr, connId, queryEngine, txnManager);
+        auto conn = std::make_shared<ClientConnection>(
+            clientSocket, addr, connId, queryEngine, txnManager, this);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            connections[connId] = conn;
+        }
+        activeConnections++;
         
-        std::thread connThread([c = conn.get()]() { c->run(); });
+        // The thread keeps the connection alive until run() returns, even if
+        // stop() has dropped it from the map by then
+        std::thread connThread([this, conn, connId]() {
+            conn->run();
+            activeConnections--;
+            std::lock_guard<std::mutex> lock(mutex);
+            connections.erase(connId);
+        });
         connThread.detach();
-        
-        std::lock_guard<std::mutex> lock(mutex);
-        connections.push_back(std::move(conn));
     }
 }
 
@@ -100,13 +120,50 @@ void NetworkManager::stop() {
     
     std::lock_guard<std::mutex> lock(mutex);
     for (auto& conn : connections) {
-        conn->stop();
+        conn.second->stop();
     }
     connections.clear();
 }
 
+// Counted apart from the map, so reading it takes no lock
 size_t NetworkManager::getActiveConnections() const {
-    return connections.size();
+    return activeConnections.load();
+}
+
+std::vector<ConnectionInfo> NetworkManager::getConnections() {
+    std::vector<std::shared_ptr<ClientConnection>> held;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        held.reserve(connections.size());
+        for (const auto& conn : connections) held.push_back(conn.second);
+    }
+    std::vector<ConnectionInfo> result;
+    result.reserve(held.size());
+    for (const auto& conn : held) result.push_back(conn->getInfo());
+    return result;
+}
+
+uint64_t NetworkManager::getTotalConnections() const {
+    return connectionCounter.load();
+}
+
+void NetworkManager::recordScratch(const ArenaStats& request) {
+    scratchRequests.fetch_add(1, std::memory_order_relaxed);
+    scratchAllocations.fetch_add(request.allocations, std::memory_order_relaxed);
+    scratchBytes.fetch_add(request.bytes, std::memory_order_relaxed);
+    scratchBlocks.fetch_add(request.blocks, std::memory_order_relaxed);
+    uint64_t largest = scratchLargest.load(std::memory_order_relaxed);
+    while (request.bytes > largest && !scratchLargest.compare_exchange_weak(largest, request.bytes)) {}
+}
+
+ScratchStats NetworkManager::getScratchStats() const {
+    ScratchStats stats;
+    stats.requests = scratchRequests.load();
+    stats.allocations = scratchAllocations.load();
+    stats.bytes = scratchBytes.load();
+    stats.blocks = scratchBlocks.load();
+    stats.largest = scratchLargest.load();
+    return stats;
 }
 
 // ============================================================================
@@ -114,9 +171,12 @@ size_t NetworkManager::getActiveConnections() const {
 // ============================================================================
 
 ClientConnection::ClientConnection(int sock, const std::string& addr, uint64_t connId,
-                                 QueryEngine* qe, TransactionManager* tm)
+                                 QueryEngine* qe, TransactionManager* tm, NetworkManager* nm)
     : socket(sock), clientAddr(addr), connectionId(connId), currentTxnId(0),
-      queryEngine(qe), txnManager(tm), active(true) {}
+      queryEngine(qe), txnManager(tm), active(true), cursorCounter(0), network(nm), priority(Priority::NORMAL),
+      connectedAt(std::chrono::duration_cast<std::chrono::seconds>(
+          std::chrono::system_clock::now().time_since_epoch()).count()),
+      lastRequestAt(0), requests(0), busy(false) {}
 
 ClientConnection::~ClientConnection() {
 #ifdef PLATFORM_WINDOWS
@@ -126,31 +186,22 @@ ClientConnection::~ClientConnection() {
 #endif
 }
 
+bool ClientConnection::sendFrame(MessageType type, const uint8_t* payload, size_t length) {
+    if (type == MessageType::ERROR) Metrics::add(Counter::QUERY_ERRORS);
+    return writeFrame(socket, type, payload, length);
+}
+
 bool ClientConnection::sendMessage(const Message& msg) {
-    auto data = msg.serialize();
-    int sent = send(socket, reinterpret_cast<const char*>(data.data()), data.size(), 0);
-    return sent > 0;
+    return sendFrame(msg.type, msg.payload.data(), msg.payload.size());
+}
+
+bool ClientConnection::sendResult(MessageType type, const std::string& payload) {
+    return sendFrame(type, reinterpret_cast<const uint8_t*>(payload.data()), payload.size());
 }
 
 Message ClientConnection::receiveMessage() {
-    uint8_t header[5];
-    int received = recv(socket, reinterpret_cast<char*>(header), 5, 0);
-    
-    if (received != 5) {
-        Message msg;
-        msg.type = MessageType::ERROR;
-        return msg;
-    }
-    
-    MessageType type = static_cast<MessageType>(header[0]);
-    uint32_t length = *reinterpret_cast<uint32_t*>(&header[1]);
-    
-    std::vector<uint8_t> payload(length);
-    received = recv(socket, reinterpret_cast<char*>(payload.data()), length, 0);
-    
     Message msg;
-    msg.type = type;
-    msg.payload = payload;
+    readFrame(socket, msg);
     return msg;
 }
 
@@ -159,6 +210,17 @@ void ClientConnection::run() {
     
     while (active) {
         Message msg = receiveMessage();
+        if (msg.type != MessageType::DISCONNECT) {
+            lastRequestAt = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+            requests++;
+            busy = true;
+        }
+        
+        // Parser tokens and the rows a statement collects come from scratch;
+        // none of it outlives the request
+        scratch.reset();
+        ArenaScope scope(&scratch);
         
         switch (msg.type) {
             case MessageType::QUERY: {
@@ -168,9 +230,7 @@ void ClientConnection::run() {
             }
             case MessageType::BEGIN_TXN: {
                 currentTxnId = txnManager->begin();
-                Message response;
-                response.type = MessageType::RESULT;
-                sendMessage(response);
+                sendResult(MessageType::RESULT, "{\"txn_id\":" + std::to_string(currentTxnId) + "}");
                 break;
             }
             case MessageType::COMMIT_TXN: {
@@ -189,45 +249,298 @@ void ClientConnection::run() {
                 sendMessage(response);
                 break;
             }
+            case MessageType::COPY_IN:
+                handleCopyIn(msg.payload);
+                break;
+            case MessageType::COPY_DATA:
+                // Errors are latched in the loader and reported at COPY_DONE
+                if (activeCopy) {
+                    activeCopy->feed(msg.payload.data(), msg.payload.size());
+                }
+                break;
+            case MessageType::COPY_DONE:
+                handleCopyDone();
+                break;
+            case MessageType::BATCH:
+                handleBatch(msg.payload);
+                break;
+            case MessageType::DECLARE_CURSOR:
+                handleDeclareCursor(std::string(msg.payload.begin(), msg.payload.end()));
+                break;
+            case MessageType::FETCH:
+                handleFetch(msg.payload);
+                break;
+            case MessageType::CLOSE_CURSOR:
+                handleCloseCursor(msg.payload);
+                break;
+            case MessageType::SET_PRIORITY:
+                handleSetPriority(msg.payload);
+                break;
             case MessageType::DISCONNECT:
                 active = false;
                 break;
             default:
                 break;
         }
+        
+        ArenaStats used = scratch.getStats();
+        if (used.allocations > 0) network->recordScratch(used);
+        busy = false;
     }
     
+    // A dropped connection must not leave its transaction holding undo state
+    if (currentTxnId != 0) {
+        txnManager->rollback(currentTxnId);
+        currentTxnId = 0;
+    }
+    cursors.clear();
+    
     std::cout << "Connection [" << connectionId << "] closed" << std::endl;
 }
 
+// A cached SELECT goes back without reaching the query engine; a miss runs
+// as usual and the engine stores its result
 void ClientConnection::handleQuery(const std::string& query) {
-    // Simple query parsing (in production, use a proper SQL parser)
+    std::string result, error;
+    ResultCache* cache = queryEngine->getResultCache();
+    if (cache && currentTxnId == 0 && SQLParser::normalize(query, result) && result.compare(0, 7, "SELECT ") == 0) {
+        if (auto cached = cache->lookup(result)) {
+            sendResult(MessageType::RESULT, *cached);
+            return;
+        }
+    }
+    
+    AdmissionTicket ticket;
+    if (!admit(ticket, network->getAdmission() ? queryEngine->estimateMemory(query) : 0)) return;
+    
+    if (queryEngine->execute(query, currentTxnId, result, error)) {
+        sendResult(MessageType::RESULT, result);
+    } else {
+        sendResult(MessageType::ERROR, error);
+    }
+}
+
+// Waits until admission control lets a request run; a request turned away
+// has been answered with the reason
+bool ClientConnection::admit(AdmissionTicket& ticket, uint64_t bytes) {
+    std::string error;
+    if (ticket.acquire(network->getAdmission(), priority, bytes, currentTxnId != 0, error)) return true;
+    sendResult(MessageType::ERROR, error);
+    return false;
+}
+
+void ClientConnection::handleSetPriority(const std::vector<uint8_t>& payload) {
+    if (payload.size() != 1 || payload[0] >= PRIORITY_CLASSES) {
+        sendResult(MessageType::ERROR, "malformed SET_PRIORITY: one byte, 0 high, 1 normal or 2 low");
+        return;
+    }
+    priority = static_cast<Priority>(payload[0]);
+    sendResult(MessageType::RESULT, std::string("{\"priority\":\"") + priorityName(priority) + "\"}");
+}
+
+// Every statement runs in one transaction (the client's, if one is open) and
+// the results come back as a single JSON array. The first failure rolls the
+// whole batch back, unless the client owns the transaction.
+void ClientConnection::handleBatch(const std::vector<uint8_t>& payload) {
+    std::vector<Statement> statements;
+    std::string error;
+    uint64_t bytes = 0;
+    
+    size_t offset = 0;
+    while (offset < payload.size()) {
+        uint32_t length;
+        if (payload.size() - offset < sizeof(length)) {
+            sendResult(MessageType::ERROR, "malformed BATCH");
+            return;
+        }
+        memcpy(&length, payload.data() + offset, sizeof(length));
+        offset += sizeof(length);
+        if (payload.size() - offset < length) {
+            sendResult(MessageType::ERROR, "malformed BATCH");
+            return;
+        }
+        
+        std::string sql(payload.begin() + offset, payload.begin() + offset + length);
+        offset += length;
+        
+        statements.emplace_back();
+        if (!SQLParser::parse(sql, statements.back(), error)) {
+            sendResult(MessageType::ERROR, "statement " + std::to_string(statements.size()) + ": " + error);
+            return;
+        }
+        if (network->getAdmission()) bytes += queryEngine->estimateMemory(sql);
+    }
+    
+    AdmissionTicket ticket;
+    if (!admit(ticket, bytes)) return;
+    
+    bool ownsTxn = currentTxnId == 0;
+    uint64_t txnId = ownsTxn ? txnManager->begin() : currentTxnId.load();
+    
+    std::string results = "[";
+    std::string result;
+    for (size_t i = 0; i < statements.size(); i++) {
+        if (!queryEngine->execute(statements[i], txnId, result, error)) {
+            if (ownsTxn) txnManager->rollback(txnId);
+            sendResult(MessageType::ERROR, "statement " + std::to_string(i + 1) + ": " + error);
+            return;
+        }
+        if (i > 0) results += ',';
+        results += result;
+    }
+    results += "]";
+    
+    if (ownsTxn && !txnManager->commit(txnId)) {
+        sendResult(MessageType::ERROR, "commit failed");
+        return;
+    }
+    sendResult(MessageType::RESULT, results);
+}
+
+void ClientConnection::handleDeclareCursor(const std::string& query) {
+    if (cursors.size() >= MAX_CURSORS_PER_CONNECTION) {
+        sendResult(MessageType::ERROR, "too many open cursors");
+        return;
+    }
+    
+    // DECLARE runs the whole query
+    AdmissionTicket ticket;
+    uint64_t bytes = network->getAdmission() ? queryEngine->estimateCursorMemory(query) : 0;
+    if (!admit(ticket, std::max<uint64_t>(bytes, ADMISSION_MIN_RESERVATION))) return;
+    
+    std::string error;
+    auto cursor = queryEngine->openCursor(query, error);
+    if (!cursor) {
+        sendResult(MessageType::ERROR, error);
+        return;
+    }
+    
+    uint32_t id = ++cursorCounter;
+    cursors[id] = std::move(cursor);
+    sendResult(MessageType::RESULT, "{\"cursor\":" + std::to_string(id) + "}");
+}
+
+// Exhausted cursors are closed automatically after their last batch
+void ClientConnection::handleFetch(const std::vector<uint8_t>& payload) {
+    uint32_t id, maxRows;
+    if (payload.size() < sizeof(id) + sizeof(maxRows)) {
+        sendResult(MessageType::ERROR, "malformed FETCH");
+        return;
+    }
+    memcpy(&id, payload.data(), sizeof(id));
+    memcpy(&maxRows, payload.data() + sizeof(id), sizeof(maxRows));
+    
+    auto it = cursors.find(id);
+    if (it == cursors.end()) {
+        sendResult(MessageType::ERROR, "unknown cursor " + std::to_string(id));
+        return;
+    }
+    
+    // The result is the table's as of DECLARE, but a dropped table takes its cursors with it
+    if (!queryEngine->tableExists(it->second->getTable(), it->second->getTableId())) {
+        std::string error = "cursor " + std::to_string(id) + " closed: table " + it->second->getTable() +
+                            " was dropped";
+        cursors.erase(it);
+        sendResult(MessageType::ERROR, error);
+        return;
+    }
+    
+    AdmissionTicket ticket;
+    if (!admit(ticket, ADMISSION_MIN_RESERVATION)) return;
+    
+    std::string result;
+    it->second->fetch(std::min<uint32_t>(std::max<uint32_t>(maxRows, 1), MAX_FETCH_ROWS), result);
+    if (it->second->isExhausted()) {
+        cursors.erase(it);
+    }
+    sendResult(MessageType::RESULT, result);
+}
+
+void ClientConnection::handleCloseCursor(const std::vector<uint8_t>& payload) {
+    uint32_t id;
+    if (payload.size() < sizeof(id)) {
+        sendResult(MessageType::ERROR, "malformed CLOSE_CURSOR");
+        return;
+    }
+    memcpy(&id, payload.data(), sizeof(id));
+    
+    // Closing an already exhausted cursor is not an error
+    cursors.erase(id);
+    sendResult(MessageType::RESULT, "{\"ok\":true}");
+}
+
+void ClientConnection::handleCopyIn(const std::vector<uint8_t>& payload) {
     Message response;
-    response.type = MessageType::RESULT;
     
-    // Parse and execute query
-    // For now, just echo back
-    response.payload.assign(query.begin(), query.end());
+    if (payload.size() < 2 || activeCopy) {
+        response.type = MessageType::ERROR;
+        std::string error = activeCopy ? "COPY already in progress" : "malformed COPY_IN";
+        response.payload.assign(error.begin(), error.end());
+        sendMessage(response);
+        return;
+    }
+    
+    CopyFormat format = payload[0] == static_cast<uint8_t>(CopyFormat::BINARY)
+                        ? CopyFormat::BINARY : CopyFormat::CSV;
+    std::string table(payload.begin() + 1, payload.end());
     
+    activeCopy = queryEngine->beginCopy(table, format, currentTxnId);
+    if (!activeCopy) {
+        response.type = MessageType::ERROR;
+        auto schema = queryEngine->getTableSchema(table);
+        std::string error = queryEngine->isReadOnly() ? "read-only replica: writes go to the primary"
+                          : !schema ? "table not found: " + table
+                          : "COPY into sharded table " + table + " is not supported: use INSERT";
+        response.payload.assign(error.begin(), error.end());
+    } else {
+        response.type = MessageType::RESULT;
+    }
     sendMessage(response);
 }
 
+void ClientConnection::handleCopyDone() {
+    Message response;
+    
+    if (!activeCopy) {
+        response.type = MessageType::ERROR;
+        std::string error = "no COPY in progress";
+        response.payload.assign(error.begin(), error.end());
+    } else if (activeCopy->finish()) {
+        response.type = MessageType::RESULT;
+        std::string result = "{\"rows\":" + std::to_string(activeCopy->getRowsLoaded()) +
+                             ",\"bytes\":" + std::to_string(activeCopy->getBytesLoaded()) + "}";
+        response.payload.assign(result.begin(), result.end());
+    } else {
+        response.type = MessageType::ERROR;
+        const std::string& error = activeCopy->getError();
+        response.payload.assign(error.begin(), error.end());
+    }
+    
+    activeCopy.reset();
+    sendMessage(response);
+}
+
+// Also wakes run() if it is waiting on the client; it closes the socket
 void ClientConnection::stop() {
     active = false;
+#ifdef PLATFORM_WINDOWS
+    shutdown(socket, SD_BOTH);
+#else
+    shutdown(socket, SHUT_RDWR);
+#endif
 }
 
-std::vector<uint8_t> Message::serialize() const {
-    std::vector<uint8_t> buffer;
-    buffer.push_back(static_cast<uint8_t>(type));
-    
-    uint32_t len = payload.size();
-    buffer.push_back((len >> 0) & 0xFF);
-    buffer.push_back((len >> 8) & 0xFF);
-    buffer.push_back((len >> 16) & 0xFF);
-    buffer.push_back((len >> 24) & 0xFF);
-    
-    buffer.insert(buffer.end(), payload.begin(), payload.end());
-    return buffer;
+ConnectionInfo ClientConnection::getInfo() const {
+    ConnectionInfo info;
+    info.id = connectionId;
+    info.address = clientAddr;
+    info.connectedAt = connectedAt;
+    info.lastRequestAt = lastRequestAt.load();
+    info.requests = requests.load();
+    info.transactionId = currentTxnId.load();
+    info.priority = priority.load();
+    info.busy = busy.load();
+    return info;
 }
 
 // ============================================================================
@@ -241,78 +554,370 @@ AdminInterface::~AdminInterface() {
     stop();
 }
 
-bool AdminInterface::start() {
-    try {
+namespace {
+
 #ifdef PLATFORM_WINDOWS
-        WSADATA wsaData;
-        WSAStartup(MAKEWORD(2, 2), &wsaData);
-        
-        listenSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
-        
-        sockaddr_in serverAddr;
-        serverAddr.sin_family = AF_INET;
-        serverAddr.sin_addr.s_addr = INADDR_ANY;
-        serverAddr.sin_port = htons(port);
-        
-        bind(listenSocket, (sockaddr*)&serverAddr, sizeof(serverAddr));
-        listen(listenSocket, SOMAXCONN);
+typedef WSAPOLLFD PollEntry;
+
+int pollSockets(PollEntry* entries, size_t count, int timeoutMillis) {
+    return WSAPoll(entries, static_cast<ULONG>(count), timeoutMillis);
+}
+
+bool validSocket(SocketHandle socket) {
+    return socket != INVALID_SOCKET;
+}
+
+void setBlocking(SocketHandle socket, bool blocking) {
+    u_long nonBlocking = blocking ? 0 : 1;
+    ioctlsocket(socket, FIONBIO, &nonBlocking);
+}
+
+bool wouldBlock() {
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+}
 #else
-        listenSocket = socket(AF_INET, SOCK_STREAM, 0);
-        
-        sockaddr_in serverAddr;
-        serverAddr.sin_family = AF_INET;
-        serverAddr.sin_addr.s_addr = INADDR_ANY;
-        serverAddr.sin_port = htons(port);
-        
-        bind(listenSocket, (sockaddr*)&serverAddr, sizeof(serverAddr));
-        listen(listenSocket, SOMAXCONN);
+typedef pollfd PollEntry;
+
+int pollSockets(PollEntry* entries, size_t count, int timeoutMillis) {
+    return poll(entries, count, timeoutMillis);
+}
+
+bool validSocket(SocketHandle socket) {
+    return socket >= 0;
+}
+
+void setBlocking(SocketHandle socket, bool blocking) {
+    int flags = fcntl(socket, F_GETFL, 0);
+    fcntl(socket, F_SETFL, blocking ? flags & ~O_NONBLOCK : flags | O_NONBLOCK);
+}
+
+bool wouldBlock() {
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+}
 #endif
-        
-        running = true;
-        
-        std::thread([this]() {
-            while (running) {
-                sockaddr_in clientAddr;
-                socklen_t clientLen = sizeof(clientAddr);
-                int clientSocket = accept(listenSocket, (sockaddr*)&clientAddr, &clientLen);
-                
-                if (clientSocket > 0) {
-                    std::thread([this, clientSocket]() {
-                        handleHTTPRequest(clientSocket);
+
+// Sends what it can without blocking; false if the client has gone
+bool sendSome(SocketHandle socket, const std::string& data, size_t& sent) {
+    while (sent < data.size()) {
 #ifdef PLATFORM_WINDOWS
-                        closesocket(clientSocket);
+        int written = send(socket, data.data() + sent, static_cast<int>(data.size() - sent), 0);
 #else
-                        close(clientSocket);
+        ssize_t written = send(socket, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+#endif
+        if (written < 0) return wouldBlock();
+        sent += written;
+    }
+    return true;
+}
+
+std::string httpResponse(const char* status, const char* contentType, const std::string& body, bool keepAlive) {
+    std::string response = std::string("HTTP/1.1 ") + status + "\r\n";
+    if (contentType) response += std::string("Content-Type: ") + contentType + "\r\n";
+    response += "Content-Length: " + std::to_string(body.size()) + "\r\n";
+    response += keepAlive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+    return response + body;
+}
+
+const char* const JSON_TYPE = "application/json";
+
+} // namespace
+
+// One admin connection of the event loop: bytes read and not yet parsed,
+// and a response being written out
+struct AdminInterface::HTTPClient {
+    SocketHandle socket;
+    std::string in;
+    std::string out;
+    size_t sent = 0;
+    bool closing = false;       // close once out is written
+    bool eof = false;           // the client has shut down its side; answer what it sent, then close
+    std::chrono::steady_clock::time_point lastActive;
+};
+
+bool AdminInterface::start() {
+#ifdef PLATFORM_WINDOWS
+    WSADATA wsaData;
+    WSAStartup(MAKEWORD(2, 2), &wsaData);
 #endif
-                    }).detach();
+    listenSocket = socket(AF_INET, SOCK_STREAM, 0);
+    if (!validSocket(listenSocket)) return false;
+    
+    // A restarted server can take its port back while old connections linger
+    int opt = 1;
+    setsockopt(listenSocket, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&opt), sizeof(opt));
+    
+    sockaddr_in serverAddr;
+    serverAddr.sin_family = AF_INET;
+    serverAddr.sin_addr.s_addr = INADDR_ANY;
+    serverAddr.sin_port = htons(port);
+    
+    if (bind(listenSocket, (sockaddr*)&serverAddr, sizeof(serverAddr)) != 0 ||
+        listen(listenSocket, SOMAXCONN) != 0) {
+        closeSocket(listenSocket);
+        return false;
+    }
+    setBlocking(listenSocket, false);
+    
+    // The first scrape finds a snapshot waiting
+    refreshSnapshot();
+    running = true;
+    loop = std::thread(&AdminInterface::eventLoop, this);
+    refresher = std::thread(&AdminInterface::refreshLoop, this);
+    return true;
+}
+
+// Building a snapshot takes engine locks, so it runs here rather than on the
+// event loop: a slow rebuild leaves scrapes with the previous snapshot
+void AdminInterface::refreshLoop() {
+    std::unique_lock<std::mutex> lock(refreshMutex);
+    while (running) {
+        refreshWake.wait_for(lock, std::chrono::milliseconds(ADMIN_REFRESH_MS));
+        if (!running) break;
+        lock.unlock();
+        refreshSnapshot();
+        lock.lock();
+    }
+}
+
+// Builds what the polled endpoints serve and publishes it whole; a scrape
+// holding the previous snapshot keeps it until it is done
+void AdminInterface::refreshSnapshot() {
+    auto next = std::make_shared<AdminSnapshot>();
+    next->stats = generateStatsJSON();
+    next->metrics = generateMetricsText();
+    next->connections = generateConnectionsJSON();
+    next->tables = generateTablesJSON();
+    next->views = generateViewsJSON();
+    next->queries = generateQueriesJSON();
+    next->backups = generateBackupsJSON();
+    next->builtAt = std::chrono::steady_clock::now();
+    std::atomic_store(&snapshot, std::shared_ptr<const AdminSnapshot>(std::move(next)));
+}
+
+void AdminInterface::eventLoop() {
+    std::vector<std::unique_ptr<HTTPClient>> clients;
+    std::vector<PollEntry> entries;
+    const auto idle = std::chrono::seconds(ADMIN_IDLE_SECONDS);
+    
+    while (running) {
+        // Past the client limit, new connections wait in the listen backlog
+        entries.clear();
+        bool accepting = clients.size() < ADMIN_MAX_CLIENTS;
+        if (accepting) entries.push_back({listenSocket, POLLIN, 0});
+        for (const auto& client : clients) {
+            short events = client->sent < client->out.size() ? POLLOUT : POLLIN;
+            entries.push_back({client->socket, events, 0});
+        }
+        if (pollSockets(entries.data(), entries.size(), ADMIN_REFRESH_MS) < 0 && !wouldBlock()) break;
+        auto now = std::chrono::steady_clock::now();
+        
+        size_t first = accepting ? 1 : 0;
+        for (size_t i = 0; i < clients.size(); i++) {
+            HTTPClient& client = *clients[i];
+            short events = entries[first + i].revents;
+            bool open = true;
+            
+            if (events & (POLLIN | POLLHUP | POLLERR)) {
+                char buffer[4096];
+                while (open && !client.eof) {
+                    int received = recv(client.socket, buffer, sizeof(buffer), 0);
+                    if (received > 0) {
+                        client.in.append(buffer, received);
+                        client.lastActive = now;
+                    } else {
+                        // A request may have come in the same read as the FIN
+                        client.eof = received == 0;
+                        open = client.eof || wouldBlock();
+                        break;
+                    }
                 }
+            } else if (events & POLLNVAL) {
+                open = false;
+            }
+            
+            // Requests are answered one at a time, so pipelined ones go back in order
+            bool handedOff = false;
+            while (open && !client.closing && client.sent == client.out.size()) {
+                client.out.clear();
+                client.sent = 0;
+                if (!handleHTTPRequest(client, handedOff) || handedOff) break;
+                open = sendSome(client.socket, client.out, client.sent);
+                client.lastActive = now;
+            }
+            if (open && !handedOff && client.sent < client.out.size()) {
+                open = sendSome(client.socket, client.out, client.sent);
             }
-        }).detach();
+            // Nothing more can arrive once the client has shut down, so with no
+            // response left to write every whole request it sent has been answered
+            if ((client.closing || client.eof) && client.sent == client.out.size()) open = false;
+            if (now - client.lastActive > idle) open = false;
+            
+            if (!open || handedOff) {
+                if (!handedOff) closeSocket(client.socket);
+                clients.erase(clients.begin() + i);
+                entries.erase(entries.begin() + first + i);
+                i--;
+            }
+        }
         
-        return true;
-    } catch (...) {
-        return false;
+        if (accepting && (entries[0].revents & POLLIN)) {
+            while (clients.size() < ADMIN_MAX_CLIENTS) {
+                SocketHandle clientSocket = accept(listenSocket, nullptr, nullptr);
+                if (!validSocket(clientSocket)) break;
+                setBlocking(clientSocket, false);
+                auto client = std::make_unique<HTTPClient>();
+                client->socket = clientSocket;
+                client->lastActive = now;
+                clients.push_back(std::move(client));
+            }
+        }
     }
+    
+    for (const auto& client : clients) closeSocket(client->socket);
+}
+
+static std::string backupJSON(const BackupInfo& info) {
+    std::ostringstream json;
+    json << "{\"label\":\"" << info.label << "\",";
+    json << "\"base\":" << (info.base.empty() ? "null" : "\"" + info.base + "\"") << ",";
+    json << "\"startLSN\":" << info.startLSN << ",";
+    json << "\"stopLSN\":" << info.stopLSN << ",";
+    json << "\"startTime\":" << info.startTime << ",";
+    json << "\"stopTime\":" << info.stopTime << ",";
+    json << "\"pages\":" << info.pages << ",";
+    json << "\"pagesSkipped\":" << info.pagesSkipped << ",";
+    json << "\"files\":" << info.files << ",";
+    json << "\"bytes\":" << info.bytes << "}";
+    return json.str();
 }
 
-void AdminInterface::handleHTTPRequest(int clientSocket) {
-    char buffer[4096];
-    int received = recv(clientSocket, buffer, sizeof(buffer), 0);
+// Takes the first whole request off client.in and puts its response in
+// client.out. HTTP/1.1 connections stay open unless the client asks for
+// "Connection: close"; HTTP/1.0 ones only if it asks for keep-alive.
+bool AdminInterface::handleHTTPRequest(HTTPClient& client, bool& handedOff) {
+    size_t headerEnd = client.in.find("\r\n\r\n");
+    if (headerEnd == std::string::npos) {
+        if (client.in.size() <= ADMIN_MAX_REQUEST_BYTES) return false;
+        client.out = httpResponse("431 Request Header Fields Too Large", nullptr, "", false);
+        client.closing = true;
+        return true;
+    }
     
-    if (received <= 0) return;
+    std::istringstream head(client.in.substr(0, headerEnd));
+    std::string line, method, target, version;
+    std::getline(head, line);
+    std::istringstream(line) >> method >> target >> version;
     
-    std::string request(buffer, received);
-    std::string response;
+    size_t bodyLength = 0;
+    std::string connection;
+    while (std::getline(head, line)) {
+        size_t colon = line.find(':');
+        if (colon == std::string::npos) continue;
+        std::string name = line.substr(0, colon);
+        std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+        size_t start = line.find_first_not_of(' ', colon + 1);
+        std::string value = start == std::string::npos ? "" : line.substr(start);
+        if (!value.empty() && value.back() == '\r') value.pop_back();
+        std::transform(value.begin(), value.end(), value.begin(), ::tolower);
+        if (name == "content-length") bodyLength = std::strtoull(value.c_str(), nullptr, 10);
+        if (name == "connection") connection = value;
+    }
     
-    if (request.find("GET /api/stats") != std::string::npos) {
-        response = "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n\r\n" + generateStatsJSON();
-    } else if (request.find("GET /api/tables") != std::string::npos) {
-        response = "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n\r\n" + generateTablesJSON();
-    } else {
-        response = "HTTP/1.1 404 Not Found\r\n\r\n";
+    size_t length = headerEnd + 4 + bodyLength;
+    if (length > ADMIN_MAX_REQUEST_BYTES) {
+        client.out = httpResponse("413 Payload Too Large", nullptr, "", false);
+        client.closing = true;
+        return true;
     }
+    if (client.in.size() < length) return false;
+    client.in.erase(0, length);
     
-    send(clientSocket, response.c_str(), response.length(), 0);
+    bool keepAlive = version == "HTTP/1.1" ? connection != "close" : connection == "keep-alive";
+    if (method.empty() || target.empty() || version.compare(0, 5, "HTTP/") != 0) {
+        client.out = httpResponse("400 Bad Request", nullptr, "", false);
+        client.closing = true;
+        return true;
+    }
+    client.out = route(method, target, keepAlive, client.socket, handedOff);
+    client.closing = !keepAlive;
+    return true;
+}
+
+std::string AdminInterface::route(const std::string& method, const std::string& target, bool keepAlive,
+                                  SocketHandle clientSocket, bool& handedOff) {
+    size_t question = target.find('?');
+    std::string path = target.substr(0, question);
+    std::string query = question == std::string::npos ? "" : target.substr(question + 1);
+    
+    if (method == "GET") {
+        // Every GET comes from the snapshot, never from the engine
+        auto snapshot = getSnapshot();
+        if (path == "/api/stats") return httpResponse("200 OK", JSON_TYPE, snapshot->stats, keepAlive);
+        if (path == "/metrics") {
+            return httpResponse("200 OK", "text/plain; version=0.0.4", snapshot->metrics, keepAlive);
+        }
+        if (path == "/api/connections") return httpResponse("200 OK", JSON_TYPE, snapshot->connections, keepAlive);
+        if (path == "/api/tables") return httpResponse("200 OK", JSON_TYPE, snapshot->tables, keepAlive);
+        if (path == "/api/views") return httpResponse("200 OK", JSON_TYPE, snapshot->views, keepAlive);
+        if (path == "/api/queries") return httpResponse("200 OK", JSON_TYPE, snapshot->queries, keepAlive);
+        if (path == "/api/backups") return httpResponse("200 OK", JSON_TYPE, snapshot->backups, keepAlive);
+    } else if (method == "POST") {
+        if (path == "/api/queries/reset") {
+            // The next snapshot, built now rather than at the next tick, shows the totals cleared
+            server->getQueryLog()->reset();
+            refreshWake.notify_all();
+            return httpResponse("200 OK", JSON_TYPE, "{\"ok\":true}", keepAlive);
+        }
+        if (path == "/api/backup") {
+            // A backup can take minutes; it answers from a thread of its own
+            // and closes the connection after. POST /api/backup?incremental=1
+            // builds on the latest backup.
+            bool incremental = query.find("incremental") != std::string::npos;
+            handedOff = true;
+            setBlocking(clientSocket, true);
+            std::thread([server = this->server, clientSocket, incremental]() {
+                BackupInfo info;
+                std::string error = "backups are off; start the server with -b <directory>";
+                std::string response;
+                if (server->getBackups() && server->getBackups()->backup(incremental, info, error)) {
+                    response = httpResponse("200 OK", JSON_TYPE, backupJSON(info), false);
+                } else {
+                    for (char& c : error) c = c == '"' || c == '\\' ? '\'' : c;
+                    response = httpResponse("500 Internal Server Error", JSON_TYPE,
+                                            "{\"error\":\"" + error + "\"}", false);
+                }
+                size_t sent = 0;
+                sendSome(clientSocket, response, sent);
+                closeSocket(clientSocket);
+            }).detach();
+            return "";
+        }
+    }
+    return httpResponse("404 Not Found", nullptr, "", keepAlive);
+}
+
+// Client connections by id, as of the snapshot
+std::string AdminInterface::generateConnectionsJSON() {
+    int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    std::string json = "[";
+    bool first = true;
+    for (const auto& info : server->getNetwork()->getConnections()) {
+        if (!first) json += ",";
+        first = false;
+        json += "{\"id\":" + std::to_string(info.id);
+        json += ",\"address\":";
+        appendJSONString(json, info.address);
+        json += ",\"connectedAt\":" + std::to_string(info.connectedAt);
+        json += ",\"requests\":" + std::to_string(info.requests);
+        int64_t since = info.lastRequestAt ? info.lastRequestAt : info.connectedAt * 1000;
+        json += ",\"idleMs\":" + std::to_string(info.busy ? 0 : std::max<int64_t>(0, now - since));
+        json += std::string(",\"state\":\"") + (info.busy ? "active" : "idle") + "\"";
+        json += ",\"transaction\":" + std::to_string(info.transactionId);
+        json += std::string(",\"priority\":\"") + priorityName(info.priority) + "\"}";
+    }
+    json += "]";
+    return json;
 }
 
 std::string AdminInterface::generateStatsJSON() {
@@ -323,29 +928,466 @@ std::string AdminInterface::generateStatsJSON() {
     json << "\"totalQueries\":" << stats.totalQueries << ",";
     json << "\"activeConnections\":" << stats.activeConnections << ",";
     json << "\"uptime\":" << stats.uptime << ",";
+    json << "\"totalConnections\":" << stats.totalConnections << ",";
     json << "\"cacheHitRate\":" << stats.cacheHitRate << ",";
-    json << "\"tableCount\":" << stats.tableCount;
+    json << "\"tableCount\":" << stats.tableCount << ",";
+    json << "\"totalRows\":" << stats.totalRows << ",";
+    json << "\"walSize\":" << stats.walSize << ",";
+    
+    // Percentiles of the instrumented hot paths, in microseconds
+    auto metrics = Metrics::collect();
+    auto latency = [&](const char* name, Histogram histogram) {
+        const HistogramSnapshot& h = metrics.histogram(histogram);
+        json << "\"" << name << "\":{";
+        json << "\"count\":" << h.count << ",";
+        json << "\"p50\":" << h.percentile(0.5) / 1000.0 << ",";
+        json << "\"p99\":" << h.percentile(0.99) / 1000.0 << ",";
+        json << "\"p999\":" << h.percentile(0.999) / 1000.0 << "}";
+    };
+    const HistogramSnapshot& group = metrics.histogram(Histogram::GROUP_COMMIT);
+    json << "\"latency\":{";
+    latency("parse", Histogram::QUERY_PARSE);
+    json << ",";
+    latency("execute", Histogram::QUERY_EXECUTE);
+    json << ",";
+    latency("walAppend", Histogram::WAL_APPEND);
+    json << ",";
+    latency("walFlush", Histogram::WAL_FLUSH);
+    json << ",";
+    latency("lockWait", Histogram::LOCK_WAIT);
+    json << ",";
+    latency("admissionWait", Histogram::ADMISSION_WAIT);
+    json << ",\"commitsPerFlush\":" << (group.count ? static_cast<double>(group.sum) / group.count : 0.0);
+    json << "},";
+    
+    auto compression = server->getStorage()->getCompressionStats();
+    json << "\"compression\":{";
+    json << "\"pagesWritten\":" << compression.pagesWritten << ",";
+    json << "\"pagesRead\":" << compression.pagesRead << ",";
+    json << "\"ratio\":" << (compression.bytesOut ? static_cast<double>(compression.bytesIn) / compression.bytesOut : 0.0) << ",";
+    json << "\"compressMs\":" << compression.compressNanos / 1e6 << ",";
+    json << "\"decompressMs\":" << compression.decompressNanos / 1e6;
+    json << "},";
+    
+    // Pages of filtered row table walks read, and ruled out by their summaries
+    auto scans = server->getStorage()->getScanStats();
+    json << "\"scans\":{";
+    json << "\"pagesRead\":" << scans.pagesRead << ",";
+    json << "\"pagesSkipped\":" << scans.pagesSkipped;
+    json << "},";
+    
+    // Write amplification: bytes flushed and compacted per byte written
+    auto lsm = server->getStorage()->getLSMStore()->getStats();
+    json << "\"lsm\":{";
+    json << "\"flushes\":" << lsm.flushes << ",";
+    json << "\"compactions\":" << lsm.compactions << ",";
+    json << "\"trivialMoves\":" << lsm.trivialMoves << ",";
+    json << "\"writeStalls\":" << lsm.writeStalls << ",";
+    json << "\"writeAmplification\":" << (lsm.bytesWritten ? static_cast<double>(lsm.bytesFlushed + lsm.bytesCompacted) / lsm.bytesWritten : 0.0) << ",";
+    json << "\"bloomChecks\":" << lsm.bloomChecks << ",";
+    json << "\"bloomSkips\":" << lsm.bloomSkips;
+    json << "},";
+    
+    auto series = server->getStorage()->getTimeSeriesStore()->getStats();
+    json << "\"timeseries\":{";
+    json << "\"chunks\":" << series.chunks << ",";
+    json << "\"chunksDropped\":" << series.chunksDropped << ",";
+    json << "\"rowsSealed\":" << series.rowsSealed << ",";
+    json << "\"bitsPerTimestamp\":" << (series.rowsSealed ? 8.0 * series.timestampBytes / series.rowsSealed : 0.0) << ",";
+    json << "\"bitsPerValue\":" << (series.values ? 8.0 * series.valueBytes / series.values : 0.0) << ",";
+    json << "\"rollupBuckets\":" << series.rollupBuckets;
+    json << "}";
+    
+    // Per-request scratch arenas of the connections
+    auto scratch = server->getNetwork()->getScratchStats();
+    json << ",\"scratch\":{";
+    json << "\"requests\":" << scratch.requests << ",";
+    json << "\"allocations\":" << scratch.allocations << ",";
+    json << "\"bytesPerRequest\":" << (scratch.requests ? scratch.bytes / scratch.requests : 0) << ",";
+    json << "\"largestRequest\":" << scratch.largest << ",";
+    json << "\"heapBlocks\":" << scratch.blocks;
+    json << "}";
+    
+    // Slots and memory in use, and each priority's queue
+    if (auto* admission = server->getAdmission()) {
+        auto status = admission->getStats();
+        json << ",\"admission\":{";
+        json << "\"slots\":" << status.slots << ",";
+        json << "\"lowSlots\":" << status.lowSlots << ",";
+        json << "\"running\":" << status.running << ",";
+        json << "\"memoryBudget\":" << status.memoryBudget << ",";
+        json << "\"reserved\":" << status.reserved;
+        for (size_t p = 0; p < PRIORITY_CLASSES; p++) {
+            const AdmissionClassStats& queue = status.classes[p];
+            json << ",\"" << priorityName(static_cast<Priority>(p)) << "\":{";
+            json << "\"queued\":" << queue.queued << ",";
+            json << "\"running\":" << queue.running << ",";
+            json << "\"admitted\":" << queue.admitted << ",";
+            json << "\"rejected\":" << queue.rejected << ",";
+            json << "\"timedOut\":" << queue.timedOut << ",";
+            json << "\"avgWaitMs\":" << (queue.admitted ? queue.waitNanos / 1e6 / queue.admitted : 0.0) << ",";
+            json << "\"maxWaitMs\":" << queue.maxWaitNanos / 1e6 << "}";
+        }
+        json << "}";
+    }
+    
+    // Only present when the server runs with a result cache (-c)
+    if (auto* cache = server->getQueryEngine()->getResultCache()) {
+        auto results = cache->getStats();
+        uint64_t lookups = results.hits + results.misses;
+        json << ",\"resultCache\":{";
+        json << "\"hits\":" << results.hits << ",";
+        json << "\"misses\":" << results.misses << ",";
+        json << "\"hitRate\":" << (lookups ? static_cast<double>(results.hits) / lookups : 0.0) << ",";
+        json << "\"stores\":" << results.stores << ",";
+        json << "\"invalidations\":" << results.invalidations << ",";
+        json << "\"evictions\":" << results.evictions << ",";
+        json << "\"entries\":" << results.entries << ",";
+        json << "\"bytes\":" << results.bytes << ",";
+        json << "\"capacity\":" << results.capacity;
+        json << "}";
+    }
+    
+    // Lag of each replica on a primary, or how far a replica has got
+    if (auto* sender = server->getReplicationSender()) {
+        json << ",\"replication\":{";
+        json << "\"role\":\"primary\",";
+        json << "\"mode\":\"" << (sender->getMode() == ReplicationMode::SYNC ? "sync" : "async") << "\",";
+        json << "\"currentLSN\":" << server->getWAL()->getCurrentLSN() << ",";
+        json << "\"replicas\":[";
+        auto replicas = sender->getStatus();
+        for (size_t i = 0; i < replicas.size(); i++) {
+            if (i > 0) json << ",";
+            json << "{\"address\":\"" << replicas[i].address << "\",";
+            json << "\"sentLSN\":" << replicas[i].sentLSN << ",";
+            json << "\"appliedLSN\":" << replicas[i].appliedLSN << ",";
+            json << "\"lagRecords\":" << replicas[i].lagRecords << ",";
+            json << "\"lagMs\":" << replicas[i].lagMillis << ",";
+            json << "\"catchingUp\":" << (replicas[i].catchingUp ? "true" : "false") << "}";
+        }
+        json << "]}";
+    } else if (auto* receiver = server->getReplicationReceiver()) {
+        auto status = receiver->getStatus();
+        json << ",\"replication\":{";
+        json << "\"role\":\"replica\",";
+        json << "\"primary\":\"" << status.primary << "\",";
+        json << "\"connected\":" << (status.connected ? "true" : "false") << ",";
+        json << "\"healthy\":" << (status.error.empty() ? "true" : "false") << ",";
+        json << "\"appliedLSN\":" << status.appliedLSN << ",";
+        json << "\"primaryLSN\":" << status.primaryLSN << ",";
+        json << "\"lagRecords\":" << (status.primaryLSN > status.appliedLSN + 1 ?
+                                        status.primaryLSN - status.appliedLSN - 1 : 0) << ",";
+        json << "\"transactions\":" << status.transactions << ",";
+        json << "\"bytes\":" << status.bytes << ",";
+        json << "\"error\":\"";
+        for (char c : status.error) json << (c == '"' || c == '\\' ? '\'' : c);
+        json << "\"}";
+    }
+    
+    // On a coordinator: statements sent to one node or to all, and per node
+    if (auto* router = server->getShardRouter()) {
+        json << ",\"sharding\":{";
+        json << "\"routed\":" << router->getRouted() << ",";
+        json << "\"scattered\":" << router->getScattered() << ",";
+        json << "\"nodes\":[";
+        auto nodes = router->getStats();
+        for (size_t i = 0; i < nodes.size(); i++) {
+            if (i > 0) json << ",";
+            json << "{\"address\":\"" << nodes[i].address << "\",";
+            json << "\"requests\":" << nodes[i].requests << ",";
+            json << "\"failures\":" << nodes[i].failures << ",";
+            json << "\"avgMs\":" << (nodes[i].requests ? nodes[i].micros / 1000.0 / nodes[i].requests : 0.0) << "}";
+        }
+        json << "]}";
+    }
+    
+    if (auto* backups = server->getBackups()) {
+        json << ",\"backup\":{";
+        json << "\"directory\":\"" << backups->getDirectory() << "\",";
+        json << "\"running\":" << (backups->isRunning() ? "true" : "false") << ",";
+        json << "\"completed\":" << backups->getCompleted() << ",";
+        json << "\"failed\":" << backups->getFailed() << ",";
+        json << "\"archivedSegments\":" << server->getWAL()->getArchivedSegments() << ",";
+        json << "\"removedSegments\":" << server->getWAL()->getRemovedSegments() << ",";
+        json << "\"archiveFailures\":" << server->getWAL()->getArchiveFailures() << "}";
+    }
     json << "}";
     
     return json.str();
 }
 
+// ----------------------------------------------------------------------------
+// Prometheus text format
+// ----------------------------------------------------------------------------
+
+namespace {
+
+// In Counter order; counters of one name are a family told apart by labels
+struct CounterInfo {
+    const char* name;
+    const char* labels;
+    const char* help;
+};
+
+const CounterInfo counterInfo[METRIC_COUNTERS] = {
+    {"hybriddb_queries_total", "type=\"select\"", "Statements executed, by type"},
+    {"hybriddb_queries_total", "type=\"insert\"", nullptr},
+    {"hybriddb_queries_total", "type=\"update\"", nullptr},
+    {"hybriddb_queries_total", "type=\"delete\"", nullptr},
+    {"hybriddb_queries_total", "type=\"other\"", nullptr},
+    {"hybriddb_query_errors_total", nullptr, "Requests answered with an error"},
+    {"hybriddb_buffer_pool_hits_total", nullptr, "Buffer pool lookups that found the page"},
+    {"hybriddb_buffer_pool_misses_total", nullptr, "Buffer pool lookups that went to the table file"},
+    {"hybriddb_buffer_pool_evictions_total", nullptr, "Pages evicted from the buffer pool"},
+    {"hybriddb_wal_records_total", nullptr, "Log records appended"},
+    {"hybriddb_wal_bytes_total", nullptr, "Log bytes appended"},
+    {"hybriddb_lock_waits_total", "lock=\"storage\"", "Lock acquisitions that found the lock held, by lock"},
+    {"hybriddb_lock_waits_total", "lock=\"wal\"", nullptr},
+    {"hybriddb_lock_waits_total", "lock=\"transactions\"", nullptr},
+    {"hybriddb_network_receive_bytes_total", nullptr, "Protocol bytes received"},
+    {"hybriddb_network_transmit_bytes_total", nullptr, "Protocol bytes sent"},
+};
+
+// In Histogram order
+struct HistogramInfo {
+    const char* name;
+    const char* help;
+    bool nanoseconds;           // exported in seconds
+};
+
+const HistogramInfo histogramInfo[METRIC_HISTOGRAMS] = {
+    {"hybriddb_query_parse_seconds", "Time to parse a statement", true},
+    {"hybriddb_query_execute_seconds", "Time to execute a statement", true},
+    {"hybriddb_wal_append_seconds", "Time to append a log record, waiting for the log included", true},
+    {"hybriddb_wal_flush_seconds", "Time to write the log buffer out to its segment", true},
+    {"hybriddb_group_commit_size", "Commits made durable by one log flush", false},
+    {"hybriddb_lock_wait_seconds", "Time waited for a held lock", true},
+    {"hybriddb_admission_wait_seconds", "Time a request waited for admission", true},
+};
+
+void writeMetric(std::ostringstream& out, const char* name, const char* type, const char* help, double value) {
+    out << "# HELP " << name << " " << help << "\n";
+    out << "# TYPE " << name << " " << type << "\n";
+    out << name << " " << value << "\n";
+}
+
+// Exported at 1, 2.5 and 5 steps from 1us to 10s, or at powers of two for
+// counts. A value is counted under the first bound at or above the top of
+// its fine bucket, so up to 1/16 late.
+void writeHistogram(std::ostringstream& out, const HistogramInfo& info, const HistogramSnapshot& histogram) {
+    std::vector<uint64_t> bounds;
+    if (info.nanoseconds) {
+        for (uint64_t decade = 1000; decade < 10000000000ULL; decade *= 10) {
+            bounds.insert(bounds.end(), {decade, decade * 5 / 2, decade * 5});
+        }
+        bounds.push_back(10000000000ULL);
+    } else {
+        for (uint64_t bound = 1; bound <= 1024; bound *= 2) bounds.push_back(bound);
+    }
+    double scale = info.nanoseconds ? 1e-9 : 1.0;
+    
+    out << "# HELP " << info.name << " " << info.help << "\n";
+    out << "# TYPE " << info.name << " histogram\n";
+    size_t fine = 0;
+    uint64_t below = 0;
+    for (uint64_t bound : bounds) {
+        while (fine < histogram.buckets.size() && Metrics::bucketLimit(fine) <= bound) {
+            below += histogram.buckets[fine++];
+        }
+        out << info.name << "_bucket{le=\"" << bound * scale << "\"} " << below << "\n";
+    }
+    out << info.name << "_bucket{le=\"+Inf\"} " << histogram.count << "\n";
+    out << info.name << "_sum " << histogram.sum * scale << "\n";
+    out << info.name << "_count " << histogram.count << "\n";
+}
+
+} // namespace
+
+// Every scrape sums the threads' shards afresh; nothing is kept between them
+std::string AdminInterface::generateMetricsText() {
+    auto metrics = Metrics::collect();
+    auto stats = server->getStats();
+    
+    std::ostringstream out;
+    out.precision(9);
+    for (size_t c = 0; c < METRIC_COUNTERS; c++) {
+        const CounterInfo& info = counterInfo[c];
+        if (info.help) {
+            out << "# HELP " << info.name << " " << info.help << "\n";
+            out << "# TYPE " << info.name << " counter\n";
+        }
+        out << info.name;
+        if (info.labels) out << "{" << info.labels << "}";
+        out << " " << metrics.counters[c] << "\n";
+    }
+    for (size_t h = 0; h < METRIC_HISTOGRAMS; h++) {
+        writeHistogram(out, histogramInfo[h], metrics.histograms[h]);
+    }
+    
+    writeMetric(out, "hybriddb_uptime_seconds", "gauge", "Seconds since the server started", stats.uptime);
+    writeMetric(out, "hybriddb_connections", "gauge", "Client connections held", stats.activeConnections);
+    writeMetric(out, "hybriddb_connections_total", "counter", "Client connections accepted",
+                stats.totalConnections);
+    writeMetric(out, "hybriddb_tables", "gauge", "Tables stored on this server", stats.tableCount);
+    writeMetric(out, "hybriddb_wal_size_bytes", "gauge", "Bytes of log segments on disk", stats.walSize);
+    writeMetric(out, "hybriddb_wal_lsn", "counter", "LSN the next log record gets",
+                server->getWAL()->getCurrentLSN());
+    auto compression = server->getStorage()->getCompressionStats();
+    writeMetric(out, "hybriddb_page_compress_seconds_total", "counter", "Time spent compressing table pages",
+                compression.compressNanos / 1e9);
+    writeMetric(out, "hybriddb_page_decompress_seconds_total", "counter", "Time spent decompressing table pages",
+                compression.decompressNanos / 1e9);
+                
+    if (auto* admission = server->getAdmission()) {
+        auto status = admission->getStats();
+        writeMetric(out, "hybriddb_admission_running", "gauge", "Requests holding an admission slot", status.running);
+        writeMetric(out, "hybriddb_admission_reserved_bytes", "gauge", "Memory reserved by admitted requests",
+                    status.reserved);
+        const struct {
+            const char* name;
+            const char* type;
+            const char* help;
+            uint64_t AdmissionClassStats::*field;
+        } families[] = {
+            {"hybriddb_admission_queued", "gauge", "Requests waiting for admission, by priority",
+             &AdmissionClassStats::queued},
+            {"hybriddb_admission_rejected_total", "counter", "Requests turned away by a full queue, by priority",
+             &AdmissionClassStats::rejected},
+            {"hybriddb_admission_timeouts_total", "counter", "Requests that waited past their deadline, by priority",
+             &AdmissionClassStats::timedOut},
+        };
+        for (const auto& family : families) {
+            out << "# HELP " << family.name << " " << family.help << "\n";
+            out << "# TYPE " << family.name << " " << family.type << "\n";
+            for (size_t p = 0; p < PRIORITY_CLASSES; p++) {
+                out << family.name << "{priority=\"" << priorityName(static_cast<Priority>(p)) << "\"} "
+                    << status.classes[p].*family.field << "\n";
+            }
+        }
+    }
+                
+    return out.str();
+}
+
+// Tables stored on this server, in the shape the admin panel reads; a
+// coordinator's sharded tables live on its nodes
+std::string AdminInterface::generateTablesJSON() {
+    static const char* const modes[] = {"row", "column", "lsm", "timeseries"};
+    
+    std::ostringstream json;
+    json << "{\"tables\":[";
+    bool first = true;
+    for (const auto& table : server->getQueryEngine()->listTables()) {
+        if (!first) json << ",";
+        first = false;
+        json << "{";
+        json << "\"name\":\"" << table.tableName << "\",";
+        json << "\"id\":" << table.tableId << ",";
+        json << "\"storage\":\"" << modes[static_cast<size_t>(table.storageMode)] << "\",";
+        json << "\"type\":\"" << (table.isDocumentMode ? "document" : "relational") << "\",";
+        json << "\"columns\":" << table.columns.size() << ",";
+        json << "\"indexes\":" << table.indexes.size() << ",";
+        json << "\"pages\":" << server->getStorage()->getPageCount(table.tableId) << ",";
+        json << "\"rows\":" << table.rowCount << ",";
+        json << "\"analyzed\":" << (table.statistics ? "true" : "false");
+        json << "}";
+    }
+    json << "]}";
+    
+    return json.str();
+}
+
+// Completed backups, oldest first; an incremental one names its base
+std::string AdminInterface::generateBackupsJSON() {
+    std::ostringstream json;
+    json << "[";
+    if (auto* backups = server->getBackups()) {
+        bool first = true;
+        for (const auto& info : backups->list()) {
+            if (!first) json << ",";
+            first = false;
+            json << backupJSON(info);
+        }
+    }
+    json << "]";
+    
+    return json.str();
+}
+
+// Materialized views and how far each lags its table: views that REFRESH
+// rebuilds count the committed changes they have yet to see
+std::string AdminInterface::generateViewsJSON() {
+    std::ostringstream json;
+    json << "[";
+    bool first = true;
+    for (const auto& view : server->getQueryEngine()->getViewStats()) {
+        if (!first) json << ",";
+        first = false;
+        json << "{";
+        json << "\"name\":\"" << view.name << "\",";
+        json << "\"table\":\"" << view.table << "\",";
+        json << "\"incremental\":" << (view.incremental ? "true" : "false") << ",";
+        json << "\"rows\":" << view.rows << ",";
+        json << "\"changesApplied\":" << view.changesApplied << ",";
+        json << "\"pendingChanges\":" << view.pendingChanges << ",";
+        json << "\"refreshedAt\":" << view.refreshedAt << ",";
+        json << "\"refreshMs\":" << view.refreshMillis << ",";
+        json << "\"staleSeconds\":" << view.staleSeconds;
+        json << "}";
+    }
+    json << "]";
+    
+    return json.str();
+}
+
+// Statement shapes by total time, as pg_stat_statements shows them
+std::string AdminInterface::generateQueriesJSON() {
+    QueryLog* log = server->getQueryLog();
+    std::string json = "{\"slowQueries\":" + std::to_string(log->getSlowQueries()) + ",\"statements\":[";
+    bool first = true;
+    for (const auto& stats : log->getStats()) {
+        if (!first) json += ",";
+        first = false;
+        char timing[160];
+        snprintf(timing, sizeof(timing), ",\"totalMs\":%.3f,\"meanMs\":%.3f,\"minMs\":%.3f,\"maxMs\":%.3f",
+                 stats.totalNanos / 1e6, stats.totalNanos / 1e6 / stats.calls, stats.minNanos / 1e6,
+                 stats.maxNanos / 1e6);
+        json += "{\"query\":";
+        appendJSONString(json, stats.query);
+        json += ",\"calls\":" + std::to_string(stats.calls);
+        json += ",\"errors\":" + std::to_string(stats.errors);
+        json += ",\"rows\":" + std::to_string(stats.rows);
+        json += timing;
+        json += ",\"bufferHits\":" + std::to_string(stats.poolHits);
+        json += ",\"bufferReads\":" + std::to_string(stats.poolReads);
+        json += "}";
+    }
+    json += "]}";
+    return json;
+}
+
+// The loop sees running drop within ADMIN_REFRESH_MS and closes its clients
 void AdminInterface::stop() {
-    running = false;
-#ifdef PLATFORM_WINDOWS
-    closesocket(listenSocket);
-#else
-    close(listenSocket);
-#endif
+    {
+        std::lock_guard<std::mutex> lock(refreshMutex);
+        running = false;
+    }
+    refreshWake.notify_all();
+    if (refresher.joinable()) refresher.join();
+    if (loop.joinable()) {
+        loop.join();
+        closeSocket(listenSocket);
+    }
 }
 
 // ============================================================================
 // MAIN SERVER (C++)
 // ============================================================================
 
-Server::Server(const std::string& dataDir, uint16_t dbPort, uint16_t adminPort)
-    : dataDirectory(dataDir), dbPort(dbPort), adminPort(adminPort), running(false),
-      totalQueries(0), totalConnections(0) {
+Server::Server(const std::string& dataDir, uint16_t dbPort, uint16_t adminPort, size_t resultCacheBytes,
+               const ReplicationConfig& replication, const std::vector<std::string>& shardNodes,
+               const std::string& backupDir, const AdmissionConfig& admissionConfig)
+    : dataDirectory(dataDir), dbPort(dbPort), adminPort(adminPort), running(false) {
     
     // Create directories
 #ifdef PLATFORM_WINDOWS
@@ -363,9 +1405,40 @@ Server::Server(const std::string& dataDir, uint16_t dbPort, uint16_t adminPort)
     // Initialize components
     storage = std::make_unique<StorageEngine>(dataDir + "/tables");
     wal = std::make_unique<WALManager>(dataDir + "/wal");
+    // Write-ahead: the log reaches the file before a page stamped with its LSN
+    // does, so a restart never hands out LSNs below those already on pages
+    storage->setLSNClock([log = wal.get()]() { return log->flush(); });
+    wal->setCheckpointSync([engine = storage.get()]() { engine->sync(); });
     txnManager = std::make_unique<TransactionManager>(wal.get());
-    queryEngine = std::make_unique<QueryEngine>(storage.get(), txnManager.get());
+    queryEngine = std::make_unique<QueryEngine>(storage.get(), txnManager.get(), dataDir + "/metadata/catalog.dat");
+    queryLog = std::make_unique<QueryLog>();
+    queryEngine->setQueryLog(queryLog.get());
+    if (resultCacheBytes > 0) {
+        resultCache = std::make_unique<ResultCache>(resultCacheBytes);
+        queryEngine->setResultCache(resultCache.get());
+    }
+    if (!shardNodes.empty()) {
+        shardRouter = std::make_unique<ShardRouter>(shardNodes);
+        queryEngine->setShardRouter(shardRouter.get());
+    }
     network = std::make_unique<NetworkManager>(dbPort, queryEngine.get(), txnManager.get());
+    if (admissionConfig.slots > 0) {
+        admission = std::make_unique<AdmissionController>(admissionConfig);
+        network->setAdmission(admission.get());
+    }
+    if (!replication.primaryHost.empty()) {
+        queryEngine->setReadOnly(true);
+        replicationReceiver = std::make_unique<ReplicationReceiver>(
+            replication.primaryHost, replication.primaryPort, dataDir + "/metadata/replica.state", queryEngine.get());
+    } else if (replication.listenPort != 0) {
+        wal->setKeepSegments(true);
+        replicationSender = std::make_unique<ReplicationSender>(
+            replication.listenPort, replication.mode, wal.get(), txnManager.get());
+    }
+    if (!backupDir.empty()) {
+        backups = std::make_unique<BackupManager>(dataDir, backupDir, storage.get(), wal.get(),
+                                                  txnManager.get(), queryEngine.get());
+    }
     admin = std::make_unique<AdminInterface>(adminPort, this);
 }
 
@@ -383,13 +1456,47 @@ bool Server::start() {
     std::cout << "Starting database server...\n";
     std::cout << "Database port: " << dbPort << "\n";
     std::cout << "Admin port: " << adminPort << "\n";
-    std::cout << "Data directory: " << dataDirectory << "\n\n";
+    std::cout << "Data directory: " << dataDirectory << "\n";
+    std::cout << "Catalog: version " << queryEngine->getCatalogVersion() << ", "
+              << queryEngine->listTables().size() << " tables\n";
+    if (replicationSender) {
+        std::cout << "Replication: serving replicas (" <<
+            (replicationSender->getMode() == ReplicationMode::SYNC ? "sync" : "async") << ")\n";
+    } else if (replicationReceiver) {
+        std::cout << "Replication: read-only replica of " << replicationReceiver->getStatus().primary << "\n";
+    }
+    if (admission) {
+        auto status = admission->getStats();
+        std::cout << "Admission: " << status.slots << " slots (" << status.lowSlots << " for low priority), "
+                  << (status.memoryBudget >> 20) << " MB budget\n";
+    }
+    if (shardRouter) {
+        std::cout << "Sharding: coordinator over " << shardRouter->getNodes().size() << " nodes\n";
+    }
+    if (backups) {
+        std::cout << "Backups: " << backups->getDirectory() << " (log archived to " << backups->getDirectory()
+                  << "/wal)\n";
+    }
+    std::cout << "\n";
+    
+    // Tables it cannot describe would be overwritten by the next DDL
+    if (!queryEngine->getCatalogError().empty()) {
+        std::cerr << "Cannot open the catalog: " << queryEngine->getCatalogError() << "\n";
+        return false;
+    }
     
     if (!network->start()) {
         std::cerr << "Failed to start network manager\n";
         return false;
     }
     
+    // Replicas are served before clients can write, so no load goes unlogged
+    if (replicationSender && !replicationSender->start()) {
+        std::cerr << "Failed to start replication sender\n";
+        return false;
+    }
+    if (replicationReceiver) replicationReceiver->start();
+    
     if (!admin->start()) {
         std::cerr << "Failed to start admin interface\n";
         return false;
@@ -405,6 +1512,8 @@ bool Server::start() {
 
 void Server::stop() {
     running = false;
+    if (replicationReceiver) replicationReceiver->stop();
+    if (replicationSender) replicationSender->stop();
     network->stop();
     admin->stop();
 }
@@ -412,24 +1521,44 @@ void Server::stop() {
 void Server::shutdown() {
     std::cout << "\nShutting down server...\n";
     stop();
+    // Row counters move with every write; the file has them as of the last DDL
+    queryEngine->saveCatalog();
     storage->sync();
     wal->flush();
+    if (backups) {
+        // The last segment too, so a restore can reach the end of the log
+        wal->switchSegment();
+        wal->archiveSegments();
+    }
     std::cout << "✓ Server shutdown complete\n";
 }
 
 Server::Stats Server::getStats() const {
+    MetricsSnapshot metrics = Metrics::collect();
+    
     Stats stats;
-    stats.totalQueries = totalQueries.load();
-    stats.totalConnections = totalConnections.load();
+    stats.totalQueries = metrics.counter(Counter::QUERIES_SELECT) + metrics.counter(Counter::QUERIES_INSERT) +
+                         metrics.counter(Counter::QUERIES_UPDATE) + metrics.counter(Counter::QUERIES_DELETE) +
+                         metrics.counter(Counter::QUERIES_OTHER);
+    stats.totalConnections = network->getTotalConnections();
     stats.activeConnections = network->getActiveConnections();
     
     auto now = std::chrono::system_clock::now();
     stats.uptime = std::chrono::duration_cast<std::chrono::seconds>(now - startTime).count();
     
-    stats.cacheHitRate = storage->getStorage() ? 0.95 : 0.0; // Placeholder
-    stats.tableCount = 0; // Get from catalog
+    uint64_t lookups = metrics.counter(Counter::POOL_HITS) + metrics.counter(Counter::POOL_MISSES);
+    stats.cacheHitRate = lookups ? static_cast<double>(metrics.counter(Counter::POOL_HITS)) / lookups : 0.0;
+    
+    auto tables = queryEngine->listTables();
+    stats.tableCount = tables.size();
     stats.totalRows = 0;
+    for (const auto& table : tables) stats.totalRows += table.rowCount;
+    
     stats.walSize = 0;
+    std::error_code error;
+    for (const auto& entry : std::filesystem::directory_iterator(dataDirectory + "/wal", error)) {
+        if (entry.is_regular_file(error)) stats.walSize += entry.file_size(error);
+    }
     
     return stats;
 }
@@ -444,6 +1573,16 @@ int main(int argc, char* argv[]) {
     std::string dataDir = "./data";
     uint16_t dbPort = 5432;
     uint16_t adminPort = 8080;
+    size_t resultCacheMB = 0;
+    double slowQueryMillis = -1;
+    hybriddb::ReplicationConfig replication;
+    std::vector<std::string> shardNodes;
+    std::string backupDir;
+    std::string restorePath;
+    hybriddb::RestoreTarget restoreTarget;
+    bool targeted = false;
+    hybriddb::AdmissionConfig admission;
+    admission.slots = std::max(4u, 2 * std::thread::hardware_concurrency());
     
     // Parse command line arguments
     for (int i = 1; i < argc; i++) {
@@ -454,10 +1593,110 @@ int main(int argc, char* argv[]) {
             adminPort = std::atoi(argv[++i]);
         } else if (arg == "-d" && i + 1 < argc) {
             dataDir = argv[++i];
+        } else if (arg == "-c" && i + 1 < argc) {
+            resultCacheMB = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "-q" && i + 1 < argc) {
+            slowQueryMillis = std::strtod(argv[++i], nullptr);
+        } else if (arg == "-x" && i + 1 < argc) {
+            // Requests running at once, 0 for no admission control
+            admission.slots = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "-m" && i + 1 < argc) {
+            admission.memoryBudget = std::strtoull(argv[++i], nullptr, 10) << 20;
+        } else if (arg == "-r" && i + 1 < argc) {
+            replication.listenPort = std::atoi(argv[++i]);
+        } else if (arg == "-s") {
+            replication.mode = hybriddb::ReplicationMode::SYNC;
+        } else if (arg == "-f" && i + 1 < argc) {
+            std::string primary = argv[++i];
+            size_t colon = primary.rfind(':');
+            if (colon == std::string::npos) {
+                std::cerr << "-f takes the primary's host:port\n";
+                return 1;
+            }
+            replication.primaryHost = primary.substr(0, colon);
+            replication.primaryPort = std::atoi(primary.c_str() + colon + 1);
+        } else if (arg == "-n" && i + 1 < argc) {
+            std::stringstream nodes(argv[++i]);
+            std::string node;
+            while (std::getline(nodes, node, ',')) {
+                if (node.find(':') == std::string::npos) {
+                    std::cerr << "-n takes the data nodes' host:port, separated by commas\n";
+                    return 1;
+                }
+                shardNodes.push_back(node);
+            }
+        } else if (arg == "-b" && i + 1 < argc) {
+            backupDir = argv[++i];
+        } else if (arg == "-R" && i + 1 < argc) {
+            restorePath = argv[++i];
+        } else if (arg == "-t" && i + 1 < argc) {
+            // An LSN, or @ and unix seconds
+            std::string target = argv[++i];
+            if (target[0] == '@') {
+                restoreTarget.time = static_cast<int64_t>(std::strtod(target.c_str() + 1, nullptr) * 1e6);
+            } else {
+                restoreTarget.lsn = std::strtoull(target.c_str(), nullptr, 10);
+            }
+            targeted = true;
+        }
+    }
+    
+    if (replication.listenPort != 0 && !replication.primaryHost.empty()) {
+        std::cerr << "A replica (-f) cannot serve replicas (-r)\n";
+        return 1;
+    }
+    if (!shardNodes.empty() && !replication.primaryHost.empty()) {
+        std::cerr << "A replica (-f) cannot be a coordinator (-n)\n";
+        return 1;
+    }
+    if (targeted && restorePath.empty()) {
+        std::cerr << "-t is the point a restore (-R) stops at\n";
+        return 1;
+    }
+    if (!restorePath.empty() && !replication.primaryHost.empty()) {
+        std::cerr << "A replica (-f) cannot be restored from a backup (-R)\n";
+        return 1;
+    }
+    
+    // A restore lays the backup out as the data directory, then the server
+    // replays the log archived next to it
+    hybriddb::BackupInfo restored;
+    if (!restorePath.empty()) {
+        std::string error;
+        if (!hybriddb::BackupManager::restore(restorePath, dataDir, restoreTarget, restored, error)) {
+            std::cerr << "Restore failed: " << error << "\n";
+            return 1;
         }
+        std::cout << "Restored backup " << restored.label << " as of LSN " << restored.startLSN << "\n";
+    }
+    
+    hybriddb::Server server(dataDir, dbPort, adminPort, resultCacheMB << 20, replication, shardNodes, backupDir,
+                            admission);
+    
+    // -q ms: statements taking at least that long are logged, 0 logs all
+    if (slowQueryMillis >= 0 && !server.getQueryLog()->setSlowLog(dataDir + "/slow_queries.log", slowQueryMillis)) {
+        std::cerr << "Cannot open " << dataDir << "/slow_queries.log\n";
+        return 1;
     }
     
-    hybriddb::Server server(dataDir, dbPort, adminPort);
+    if (!restorePath.empty()) {
+        std::filesystem::path backup(restorePath);
+        if (!backup.has_filename()) backup = backup.parent_path();
+        std::string archive = (backup.parent_path() / "wal").string();
+        
+        uint64_t transactions = 0, lsn = restored.startLSN;
+        std::string error;
+        server.getQueryEngine()->adoptTables();
+        if (!std::filesystem::exists(archive)) {
+            std::cout << "No archived log in " << archive << "; nothing replayed\n";
+        } else if (!hybriddb::BackupManager::replayArchive(archive, restored.startLSN, restoreTarget,
+                                                           server.getQueryEngine(), transactions, lsn, error)) {
+            std::cerr << "Restore failed: " << error << "\n";
+            return 1;
+        } else {
+            std::cout << "Replayed " << transactions << " archived transactions, up to LSN " << lsn << "\n";
+        }
+    }
     
     if (!server.start()) {
         std::cerr << "Failed to start server\n";
@@ -0,0 +1,630 @@
+#include "../include/hybriddb.h"
+#include <cstring>
+#include <ctime>
+#include <algorithm>
+#include <filesystem>
+#include <iomanip>
+#include <sstream>
+
+namespace hybriddb {
+
+namespace fs = std::filesystem;
+
+// ============================================================================
+// PAGE SNAPSHOTS
+// ============================================================================
+//
+// A backup copies a table's pages in order while writes go on. A page of
+// the snapshot that is about to be rewritten before the backup reached it is
+// first saved to the spill file, and the backup takes that copy instead.
+
+bool StorageEngine::beginSnapshot(const std::vector<uint32_t>& tableIds, const std::string& spillPath,
+                                  std::map<uint32_t, uint32_t>& pageCounts) {
+    std::lock_guard<std::shared_mutex> lock(mutex);
+    if (snapshot) return false;
+    
+    auto taken = std::make_unique<Snapshot>();
+    taken->spillPath = spillPath;
+    taken->spill.open(spillPath, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!taken->spill) return false;
+    taken->spillEnd = 0;
+    taken->failed = false;
+    for (uint32_t tableId : tableIds) {
+        uint32_t pages = pageCountLocked(tableId);
+        taken->tables[tableId] = {pages, 0};
+        pageCounts[tableId] = pages;
+    }
+    snapshot = std::move(taken);
+    return true;
+}
+
+// Called by writePageLocked before the page changes
+void StorageEngine::preserveLocked(uint32_t tableId, uint32_t pageId) {
+    auto it = snapshot->tables.find(tableId);
+    if (it == snapshot->tables.end() || pageId >= it->second.pages || pageId < it->second.copied) return;
+    uint64_t key = (static_cast<uint64_t>(tableId) << 32) | pageId;
+    if (snapshot->preserved.count(key)) return;
+    
+    Page* page = readPageLocked(tableId, pageId);
+    if (page) {
+        snapshot->spill.seekp(static_cast<std::streamoff>(snapshot->spillEnd));
+        snapshot->spill.write(reinterpret_cast<const char*>(page), PAGE_SIZE);
+    }
+    if (!page || !snapshot->spill) {
+        snapshot->spill.clear();
+        snapshot->failed = true;
+        return;
+    }
+    snapshot->preserved[key] = snapshot->spillEnd;
+    snapshot->spillEnd += PAGE_SIZE;
+}
+
+// Pages not in the buffer pool are read past it, so a backup does not
+// evict the pages queries use
+bool StorageEngine::snapshotPage(uint32_t tableId, uint32_t pageId, uint64_t since, Page& page, bool& changed) {
+    std::lock_guard<std::shared_mutex> lock(mutex);
+    if (!snapshot) return false;
+    auto it = snapshot->tables.find(tableId);
+    if (it == snapshot->tables.end() || pageId >= it->second.pages) return false;
+    it->second.copied = std::max(it->second.copied, pageId + 1);
+    
+    uint64_t key = (static_cast<uint64_t>(tableId) << 32) | pageId;
+    auto preserved = snapshot->preserved.find(key);
+    if (preserved != snapshot->preserved.end()) {
+        snapshot->spill.seekg(static_cast<std::streamoff>(preserved->second));
+        snapshot->spill.read(reinterpret_cast<char*>(&page), PAGE_SIZE);
+        snapshot->preserved.erase(preserved);
+        if (!snapshot->spill) {
+            snapshot->spill.clear();
+            return false;
+        }
+        changed = page.header.lsn >= since;
+        return true;
+    }
+    
+    PageSummaries& table = openSummaries(tableId);
+    if (since > 0 && pageId < table.written.size() && table.written[pageId] < since) {
+        changed = false;
+        return true;
+    }
+    
+    if (Page* cached = bufferPool->getPage(tableId, pageId)) {
+        page = *cached;
+    } else if (!loadPageLocked(tableId, pageId, page)) {
+        return false;
+    }
+    if (pageId < table.written.size()) table.written[pageId] = page.header.lsn;
+    changed = page.header.lsn >= since;
+    return true;
+}
+
+bool StorageEngine::endSnapshot() {
+    std::lock_guard<std::shared_mutex> lock(mutex);
+    if (!snapshot) return false;
+    
+    bool ok = !snapshot->failed;
+    snapshot->spill.close();
+    remove(snapshot->spillPath.c_str());
+    snapshot.reset();
+    return ok;
+}
+
+bool StorageEngine::inSnapshot(uint32_t tableId) {
+    std::lock_guard<std::shared_mutex> lock(mutex);
+    return snapshot && snapshot->tables.count(tableId) > 0;
+}
+
+// ============================================================================
+// MANIFESTS
+// ============================================================================
+//
+// A backup directory holds table_NNNNNN.pages files of [page id (4)][page]
+// records, a files/ tree of the other files copied from the data directory,
+// and backup.manifest, written last: a directory without one is a backup
+// that did not finish.
+
+namespace {
+
+const char* MANIFEST_NAME = "backup.manifest";
+const char* MANIFEST_HEADER = "hybriddb backup 1";
+
+struct ManifestTable {
+    uint32_t tableId;
+    PageCompression codec;
+    bool bloomFilters;
+    uint32_t pages;
+};
+
+// A file of the data directory, by its path there, and the backup holding
+// its bytes: this one, or the one before it when unchanged since
+struct ManifestFile {
+    std::string path;
+    uint64_t size;
+    int64_t modified;
+    std::string holder;
+};
+
+struct Manifest {
+    BackupInfo info;
+    std::vector<ManifestTable> tables;
+    std::vector<ManifestFile> files;
+};
+
+std::string pagesPath(const fs::path& backup, uint32_t tableId) {
+    std::ostringstream name;
+    name << "table_" << std::setfill('0') << std::setw(6) << tableId << ".pages";
+    return (backup / name.str()).string();
+}
+
+int64_t modifiedTime(const fs::directory_entry& entry) {
+    std::error_code ec;
+    return static_cast<int64_t>(entry.last_write_time(ec).time_since_epoch().count());
+}
+
+// The time the backup started, in UTC, then F (full) or I (incremental)
+std::string makeLabel(const std::string& directory, bool incremental) {
+    time_t now = time(nullptr);
+    char stamp[32];
+    strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", gmtime(&now));
+    std::string base = std::string(stamp) + (incremental ? "I" : "F");
+    
+    std::string label = base;
+    for (int n = 2; fs::exists(fs::path(directory) / label); n++) label = base + "-" + std::to_string(n);
+    return label;
+}
+
+bool writeManifest(const fs::path& backup, const Manifest& manifest, std::string& error) {
+    const BackupInfo& info = manifest.info;
+    std::ostringstream text;
+    text << MANIFEST_HEADER << "\n";
+    text << "label " << info.label << "\n";
+    if (!info.base.empty()) text << "base " << info.base << "\n";
+    text << "start_lsn " << info.startLSN << "\n";
+    text << "stop_lsn " << info.stopLSN << "\n";
+    text << "start_time " << info.startTime << "\n";
+    text << "stop_time " << info.stopTime << "\n";
+    text << "pages " << info.pages << "\n";
+    text << "pages_skipped " << info.pagesSkipped << "\n";
+    text << "files " << info.files << "\n";
+    text << "bytes " << info.bytes << "\n";
+    for (const auto& table : manifest.tables) {
+        text << "table " << table.tableId << " " << static_cast<int>(table.codec) << " "
+             << (table.bloomFilters ? 1 : 0) << " " << table.pages << "\n";
+    }
+    // The path goes last, so it may hold spaces
+    for (const auto& file : manifest.files) {
+        text << "file " << file.size << " " << file.modified << " " << file.holder << " " << file.path << "\n";
+    }
+    
+    fs::path path = backup / MANIFEST_NAME;
+    std::ofstream out(path.string() + ".tmp", std::ios::binary | std::ios::trunc);
+    out << text.str();
+    out.close();
+    std::error_code ec;
+    if (out) fs::rename(path.string() + ".tmp", path, ec);
+    if (!out || ec) {
+        error = "could not write " + path.string();
+        return false;
+    }
+    return true;
+}
+
+bool readManifest(const fs::path& backup, Manifest& manifest, std::string& error) {
+    fs::path path = backup / MANIFEST_NAME;
+    std::ifstream in(path.string());
+    std::string line;
+    if (!std::getline(in, line) || line != MANIFEST_HEADER) {
+        error = "no backup at " + backup.string();
+        return false;
+    }
+    
+    manifest = Manifest();
+    BackupInfo& info = manifest.info;
+    info = BackupInfo();
+    info.startLSN = info.stopLSN = 0;
+    info.startTime = info.stopTime = 0;
+    info.pages = info.pagesSkipped = info.files = info.bytes = 0;
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        std::string key;
+        if (!(fields >> key)) continue;
+        if (key == "label") fields >> info.label;
+        else if (key == "base") fields >> info.base;
+        else if (key == "start_lsn") fields >> info.startLSN;
+        else if (key == "stop_lsn") fields >> info.stopLSN;
+        else if (key == "start_time") fields >> info.startTime;
+        else if (key == "stop_time") fields >> info.stopTime;
+        else if (key == "pages") fields >> info.pages;
+        else if (key == "pages_skipped") fields >> info.pagesSkipped;
+        else if (key == "files") fields >> info.files;
+        else if (key == "bytes") fields >> info.bytes;
+        else if (key == "table") {
+            ManifestTable table;
+            int codec, bloom;
+            fields >> table.tableId >> codec >> bloom >> table.pages;
+            table.codec = static_cast<PageCompression>(codec);
+            table.bloomFilters = bloom != 0;
+            manifest.tables.push_back(table);
+        } else if (key == "file") {
+            ManifestFile file;
+            fields >> file.size >> file.modified >> file.holder;
+            fields.get();
+            std::getline(fields, file.path);
+            manifest.files.push_back(file);
+        }
+        if (fields.fail()) {
+            error = "damaged manifest " + path.string();
+            return false;
+        }
+    }
+    if (info.label.empty()) {
+        error = "damaged manifest " + path.string();
+        return false;
+    }
+    return true;
+}
+
+// The directories of column, LSM and time-series tables, and the catalog,
+// are copied file by file. A file unchanged in size and time since the base
+// is left to the backup that holds it.
+bool copyFiles(const std::string& dataDir, const fs::path& backup, const Manifest* base, Manifest& manifest,
+               std::string& error) {
+    std::map<std::string, const ManifestFile*> previous;
+    if (base) {
+        for (const auto& file : base->files) previous[file.path] = &file;
+    }
+    
+    std::error_code ec;
+    std::vector<fs::path> roots;
+    for (const auto& entry : fs::directory_iterator(fs::path(dataDir) / "tables", ec)) {
+        if (entry.is_directory()) roots.push_back(entry.path());
+    }
+    roots.push_back(fs::path(dataDir) / "metadata");
+    
+    for (const auto& root : roots) {
+        for (const auto& entry : fs::recursive_directory_iterator(root, ec)) {
+            if (!entry.is_regular_file()) continue;
+            
+            ManifestFile file;
+            file.path = fs::relative(entry.path(), dataDir).generic_string();
+            file.size = entry.file_size();
+            file.modified = modifiedTime(entry);
+            file.holder = manifest.info.label;
+            
+            auto it = previous.find(file.path);
+            if (it != previous.end() && it->second->size == file.size && it->second->modified == file.modified) {
+                file.holder = it->second->holder;
+                manifest.files.push_back(file);
+                continue;
+            }
+            
+            fs::path target = backup / "files" / file.path;
+            fs::create_directories(target.parent_path(), ec);
+            if (!ec) fs::copy_file(entry.path(), target, fs::copy_options::overwrite_existing, ec);
+            if (ec) {
+                error = "could not copy " + entry.path().string() + ": " + ec.message();
+                return false;
+            }
+            manifest.info.files++;
+            manifest.info.bytes += file.size;
+            manifest.files.push_back(file);
+        }
+    }
+    return true;
+}
+
+// Page 0 exists once the table does; the others are appended in batches,
+// each taken from the newest backup of the chain that holds it
+bool restorePages(StorageEngine& storage, const fs::path& parent, const std::vector<Manifest>& chain,
+                  const ManifestTable& table, std::string& error) {
+    std::vector<std::ifstream> files(chain.size());
+    std::vector<std::pair<int, uint64_t>> where(table.pages, {-1, 0});     // backup, offset
+    for (size_t b = chain.size(); b-- > 0;) {
+        files[b].open(pagesPath(parent / chain[b].info.label, table.tableId), std::ios::binary);
+        uint64_t offset = 0;
+        uint32_t pageId;
+        while (files[b].read(reinterpret_cast<char*>(&pageId), sizeof(pageId))) {
+            offset += sizeof(pageId);
+            if (pageId < where.size()) where[pageId] = {static_cast<int>(b), offset};
+            offset += PAGE_SIZE;
+            files[b].seekg(static_cast<std::streamoff>(offset));
+        }
+        files[b].clear();
+    }
+    
+    std::string name = "table " + std::to_string(table.tableId);
+    if (!storage.createTable(table.tableId, table.codec, table.bloomFilters)) {
+        error = "could not create " + name;
+        return false;
+    }
+    
+    std::vector<Page> batch;
+    for (uint32_t pageId = 0; pageId < table.pages; pageId++) {
+        int b = where[pageId].first;
+        if (b < 0) {
+            error = "page " + std::to_string(pageId) + " of " + name + " is in no backup of the chain";
+            return false;
+        }
+        Page page;
+        files[b].seekg(static_cast<std::streamoff>(where[pageId].second));
+        files[b].read(reinterpret_cast<char*>(&page), PAGE_SIZE);
+        if (!files[b] || !page.verify()) {
+            error = "page " + std::to_string(pageId) + " of " + name + " is damaged in " + chain[b].info.label;
+            return false;
+        }
+        
+        bool ok = true;
+        if (pageId == 0) {
+            ok = storage.writePage(table.tableId, page);
+        } else {
+            batch.push_back(page);
+            if (batch.size() == BACKUP_APPEND_PAGES || pageId + 1 == table.pages) {
+                ok = storage.appendPages(table.tableId, batch);
+                batch.clear();
+            }
+        }
+        if (!ok) {
+            error = "could not write the pages of " + name;
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+// ============================================================================
+// BACKUP MANAGER
+// ============================================================================
+
+BackupManager::BackupManager(const std::string& dataDir, const std::string& dir, StorageEngine* se,
+                             WALManager* w, TransactionManager* tm, QueryEngine* qe)
+    : dataDirectory(dataDir), directory(dir), storage(se), wal(w), txnManager(tm), queryEngine(qe),
+      running(false), completed(0), failed(0) {
+    wal->setArchive(directory + "/wal");
+}
+
+// New transactions wait while the files are copied and the snapshot is
+// taken, so those match the log up to the start LSN; the pages are copied
+// once they go on.
+bool BackupManager::backup(bool incremental, BackupInfo& info, std::string& error) {
+    std::unique_lock<std::mutex> lock(mutex, std::try_to_lock);
+    if (!lock.owns_lock()) {
+        error = "a backup is already running";
+        return false;
+    }
+    running = true;
+    
+    // A base newer than the log (another server's) cannot be built on
+    Manifest base;
+    bool haveBase = false;
+    if (incremental) {
+        auto previous = list();
+        haveBase = !previous.empty() && previous.back().startLSN <= wal->getCurrentLSN() &&
+                   readManifest(fs::path(directory) / previous.back().label, base, error);
+    }
+    
+    Manifest manifest;
+    BackupInfo& taken = manifest.info;
+    taken = BackupInfo();
+    taken.label = makeLabel(directory, haveBase);
+    taken.base = haveBase ? base.info.label : "";
+    taken.stopLSN = 0;
+    taken.stopTime = 0;
+    taken.pages = taken.pagesSkipped = taken.files = taken.bytes = 0;
+    fs::path path = fs::path(directory) / taken.label;
+    std::error_code ec;
+    fs::create_directories(path, ec);
+    
+    bool ok = !ec;
+    if (!ok) error = "could not create " + path.string() + ": " + ec.message();
+    if (ok && !txnManager->pause(std::chrono::milliseconds(BACKUP_PAUSE_MS))) {
+        error = "transactions still open after " + std::to_string(BACKUP_PAUSE_MS) + " ms";
+        ok = false;
+    }
+    
+    std::map<uint32_t, uint32_t> pageCounts;
+    bool snapshotTaken = false;
+    if (ok) {
+        storage->getLSMStore()->waitIdle();
+        storage->sync();
+        taken.startLSN = wal->flush();
+        taken.startTime = static_cast<int64_t>(time(nullptr));
+        
+        std::vector<uint32_t> tableIds;
+        for (const auto& schema : queryEngine->listTables()) {
+            tableIds.push_back(schema.tableId);
+            manifest.tables.push_back({schema.tableId, schema.compression, schema.bloomFilters, 0});
+        }
+        snapshotTaken = storage->beginSnapshot(tableIds, (path / "snapshot.spill").string(), pageCounts);
+        ok = snapshotTaken && copyFiles(dataDirectory, path, haveBase ? &base : nullptr, manifest, error);
+        if (!snapshotTaken) error = "could not start a page snapshot";
+        txnManager->resume();
+    }
+    
+    if (ok) ok = copyPages(path.string(), pageCounts, haveBase ? base.info.startLSN : 0, taken, error);
+    if (snapshotTaken && !storage->endSnapshot() && ok) {
+        error = "pages rewritten during the backup could not be kept";
+        ok = false;
+    }
+    
+    // The log up to the stop LSN is archived before the backup counts
+    if (ok) {
+        taken.stopLSN = wal->getCurrentLSN();
+        wal->switchSegment();
+        if (!wal->archiveSegments()) {
+            error = "could not archive the log";
+            ok = false;
+        }
+    }
+    if (ok) {
+        for (auto& table : manifest.tables) table.pages = pageCounts[table.tableId];
+        taken.stopTime = static_cast<int64_t>(time(nullptr));
+        ok = writeManifest(path, manifest, error);
+    }
+    
+    if (!ok) fs::remove_all(path, ec);
+    (ok ? completed : failed)++;
+    running = false;
+    if (ok) info = taken;
+    return ok;
+}
+
+bool BackupManager::copyPages(const std::string& path, const std::map<uint32_t, uint32_t>& pageCounts,
+                              uint64_t since, BackupInfo& info, std::string& error) {
+    Page page;
+    for (const auto& [tableId, count] : pageCounts) {
+        std::string file = pagesPath(path, tableId);
+        std::ofstream out(file, std::ios::binary | std::ios::trunc);
+        for (uint32_t pageId = 0; pageId < count; pageId++) {
+            bool changed;
+            if (!storage->snapshotPage(tableId, pageId, since, page, changed)) {
+                error = "could not read page " + std::to_string(pageId) + " of table " + std::to_string(tableId);
+                return false;
+            }
+            if (!changed) {
+                info.pagesSkipped++;
+                continue;
+            }
+            out.write(reinterpret_cast<const char*>(&pageId), sizeof(pageId));
+            out.write(reinterpret_cast<const char*>(&page), PAGE_SIZE);
+            info.pages++;
+            info.bytes += sizeof(pageId) + PAGE_SIZE;
+        }
+        out.close();
+        if (!out) {
+            error = "could not write " + file;
+            return false;
+        }
+    }
+    return true;
+}
+
+std::vector<BackupInfo> BackupManager::list() const {
+    std::vector<BackupInfo> backups;
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator(directory, ec)) {
+        Manifest manifest;
+        std::string error;
+        if (entry.is_directory() && readManifest(entry.path(), manifest, error)) backups.push_back(manifest.info);
+    }
+    std::sort(backups.begin(), backups.end(), [](const BackupInfo& a, const BackupInfo& b) {
+        if (a.startLSN != b.startLSN) return a.startLSN < b.startLSN;
+        if (a.startTime != b.startTime) return a.startTime < b.startTime;
+        return a.label < b.label;
+    });
+    return backups;
+}
+
+// ============================================================================
+// RESTORE
+// ============================================================================
+
+bool BackupManager::restore(const std::string& path, const std::string& dataDir, const RestoreTarget& target,
+                            BackupInfo& info, std::string& error) {
+    fs::path backup = fs::path(path);
+    if (!backup.has_filename()) backup = backup.parent_path();
+    fs::path parent = backup.parent_path();
+    
+    // Newest first
+    std::vector<Manifest> chain(1);
+    if (!readManifest(backup, chain[0], error)) return false;
+    while (!chain.back().info.base.empty()) {
+        Manifest base;
+        if (!readManifest(parent / chain.back().info.base, base, error)) return false;
+        chain.push_back(std::move(base));
+    }
+    const Manifest& newest = chain.front();
+    if (target.lsn < newest.info.startLSN || target.time < newest.info.startTime * 1000000) {
+        error = "backup " + newest.info.label + " is newer than the restore target";
+        return false;
+    }
+    
+    std::error_code ec;
+    fs::path tables = fs::path(dataDir) / "tables";
+    if (fs::exists(tables) && !fs::is_empty(tables, ec)) {
+        error = dataDir + " already holds tables";
+        return false;
+    }
+    for (const char* name : {"tables", "wal", "indexes", "metadata"}) {
+        fs::create_directories(fs::path(dataDir) / name, ec);
+    }
+    
+    {
+        StorageEngine pages(tables.string());
+        for (const auto& table : newest.tables) {
+            if (!restorePages(pages, parent, chain, table, error)) return false;
+        }
+    }
+    
+    for (const auto& file : newest.files) {
+        fs::path target = fs::path(dataDir) / file.path;
+        fs::create_directories(target.parent_path(), ec);
+        fs::copy_file(parent / file.holder / "files" / file.path, target, fs::copy_options::overwrite_existing, ec);
+        if (ec) {
+            error = "could not restore " + file.path + " from " + file.holder + ": " + ec.message();
+            return false;
+        }
+    }
+    
+    // The restored log goes on from the backup's start LSN, which its
+    // pages do not pass
+    std::vector<uint8_t> frame;
+    WALRecord::encode(frame, WALRecordType::CHECKPOINT, newest.info.startLSN, 0, nullptr, 0);
+    std::ofstream log(WALManager::segmentPath((fs::path(dataDir) / "wal").string(), 0),
+                      std::ios::binary | std::ios::trunc);
+    log.write(reinterpret_cast<const char*>(frame.data()), frame.size());
+    log.close();
+    if (!log) {
+        error = "could not start the log in " + dataDir;
+        return false;
+    }
+    
+    info = newest.info;
+    return true;
+}
+
+bool BackupManager::replayArchive(const std::string& archiveDir, uint64_t fromLSN, const RestoreTarget& target,
+                                  QueryEngine* queryEngine, uint64_t& transactions, uint64_t& lsn,
+                                  std::string& error) {
+    // The segment holding fromLSN is the last one named at or before it
+    uint64_t first = 0;
+    bool found = false;
+    for (uint64_t segment : WALManager::listSegments(archiveDir)) {
+        if (segment > fromLSN) break;
+        first = segment;
+        found = true;
+    }
+    if (!found) {
+        error = "no archived log in " + archiveDir + " reaches back to LSN " + std::to_string(fromLSN);
+        return false;
+    }
+    
+    transactions = 0;
+    lsn = fromLSN;
+    bool ok = true;
+    CommitAssembler assembler;
+    std::vector<uint8_t> batch;
+    WALManager::scan(archiveDir, first, [&](const WALRecordView& record, const uint8_t* frame, size_t length) {
+        if (record.lsn < fromLSN || !assembler.add(record, frame, length, batch)) return true;
+        if (record.lsn > target.lsn) return false;
+        if (record.type == WALRecordType::COMMIT_TXN && record.length >= sizeof(int64_t)) {
+            int64_t micros;
+            memcpy(&micros, record.data, sizeof(micros));
+            if (micros > target.time) return false;
+        }
+        
+        uint64_t last;
+        if (!queryEngine->replay(batch.data(), batch.size(), last, error)) {
+            error = "replaying LSN " + std::to_string(record.lsn) + ": " + error;
+            ok = false;
+            return false;
+        }
+        transactions++;
+        lsn = record.lsn;
+        return true;
+    });
+    return ok;
+}
+
+} // namespace hybriddb
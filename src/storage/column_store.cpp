@@ -0,0 +1,897 @@
+#include "../include/hybriddb.h"
+#include <cstring>
+#include <algorithm>
+#include <sstream>
+#include <iomanip>
+#include <unordered_map>
+#include <tuple>
+#ifndef PLATFORM_WINDOWS
+#include <sys/stat.h>
+#endif
+
+namespace hybriddb {
+
+// ============================================================================
+// COLUMN STORE IMPLEMENTATION
+// ============================================================================
+//
+// Files per table, under columns_<id>/:
+//   columns.def    column names, types and nullability
+//   column_N.seg   encoded chunks of column N, appended block by block; the
+//                  last segment holds the rows' logical row ids
+//   blocks.dir     one length-prefixed entry per block: first row ordinal,
+//                  row count and, per chunk, offset/length/encoding/zone map
+//   deleted.bm     bitmap over row ordinals, updated one byte at a time
+// A block becomes visible only once its directory entry is written, so a
+// crash mid-append leaves unreferenced bytes at the end of the segments.
+//
+// Chunk layout: uint8 hasNulls, [NULL bitmap], encoded values. NULL slots
+// repeat the previous value so they do not break runs or widen ranges.
+
+namespace {
+
+inline int bitWidth(uint64_t v) {
+    return v ? 64 - __builtin_clzll(v) : 0;
+}
+
+inline size_t packedSize(size_t count, int width) {
+    return (count * width + 7) / 8;
+}
+
+void packBits(const uint64_t* values, size_t count, int width, std::vector<uint8_t>& out) {
+    if (width == 0) return;
+    
+    unsigned __int128 acc = 0;
+    int bits = 0;
+    for (size_t i = 0; i < count; i++) {
+        acc |= static_cast<unsigned __int128>(values[i]) << bits;
+        bits += width;
+        if (bits >= 64) {
+            putFixed<uint64_t>(out, static_cast<uint64_t>(acc));
+            acc >>= 64;
+            bits -= 64;
+        }
+    }
+    for (; bits > 0; bits -= 8) {
+        out.push_back(static_cast<uint8_t>(acc));
+        acc >>= 8;
+    }
+}
+
+// Reads whole words, so the buffer must have 8 readable bytes past the data
+void unpackBits(const uint8_t* p, size_t count, int width, uint64_t* out) {
+    if (width == 0) {
+        std::fill(out, out + count, 0);
+        return;
+    }
+    
+    uint64_t mask = width == 64 ? ~0ULL : (1ULL << width) - 1;
+    unsigned __int128 acc = 0;
+    int bits = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (bits < width) {
+            uint64_t word;
+            memcpy(&word, p, sizeof(word));
+            p += sizeof(word);
+            acc |= static_cast<unsigned __int128>(word) << bits;
+            bits += 64;
+        }
+        out[i] = static_cast<uint64_t>(acc) & mask;
+        acc >>= width;
+        bits -= width;
+    }
+}
+
+bool usesInts(DataType type) {
+    return isIntegerType(type) || type == DataType::TYPE_BOOLEAN;
+}
+
+bool usesDoubles(DataType type) {
+    return type == DataType::TYPE_FLOAT || type == DataType::TYPE_DOUBLE;
+}
+
+Value typedInt(int64_t v, DataType type) {
+    if (type == DataType::TYPE_BOOLEAN) return Value(v != 0);
+    Value out(v);
+    out.type = type;
+    return out;
+}
+
+Value typedDouble(double v, DataType type) {
+    Value out(v);
+    out.type = type;
+    return out;
+}
+
+int64_t asInt(const Value& v) {
+    if (v.type == DataType::TYPE_BOOLEAN) return v.boolVal ? 1 : 0;
+    if (usesDoubles(v.type)) return static_cast<int64_t>(v.doubleVal);
+    if (v.type == DataType::TYPE_STRING) return strtoll(v.stringVal.c_str(), nullptr, 10);
+    return v.intVal;
+}
+
+double asDouble(const Value& v) {
+    if (usesDoubles(v.type)) return v.doubleVal;
+    if (v.type == DataType::TYPE_BOOLEAN) return v.boolVal ? 1.0 : 0.0;
+    if (v.type == DataType::TYPE_STRING) return strtod(v.stringVal.c_str(), nullptr);
+    return static_cast<double>(v.intVal);
+}
+
+// Smallest of frame-of-reference, delta and run-length for an integer chunk
+ColumnEncoding encodeInts(const std::vector<int64_t>& values, std::vector<uint8_t>& out) {
+    size_t n = values.size();
+    int64_t min = values[0], max = values[0];
+    int64_t minDelta = 0, maxDelta = 0;
+    size_t runs = 1;
+    for (size_t i = 1; i < n; i++) {
+        min = std::min(min, values[i]);
+        max = std::max(max, values[i]);
+        int64_t delta = static_cast<int64_t>(static_cast<uint64_t>(values[i]) - static_cast<uint64_t>(values[i - 1]));
+        if (i == 1) minDelta = maxDelta = delta;
+        minDelta = std::min(minDelta, delta);
+        maxDelta = std::max(maxDelta, delta);
+        if (values[i] != values[i - 1]) runs++;
+    }
+    
+    int packWidth = bitWidth(static_cast<uint64_t>(max) - static_cast<uint64_t>(min));
+    int deltaWidth = bitWidth(static_cast<uint64_t>(maxDelta) - static_cast<uint64_t>(minDelta));
+    size_t packSize = 9 + packedSize(n, packWidth);
+    size_t deltaSize = n > 1 ? 17 + packedSize(n - 1, deltaWidth) : SIZE_MAX;
+    size_t rleSize = 4 + runs * 12;
+    
+    std::vector<uint64_t> scratch;
+    if (rleSize < packSize && rleSize < deltaSize) {
+        putFixed<uint32_t>(out, runs);
+        size_t start = 0;
+        for (size_t i = 1; i <= n; i++) {
+            if (i == n || values[i] != values[start]) {
+                putFixed<int64_t>(out, values[start]);
+                putFixed<uint32_t>(out, i - start);
+                start = i;
+            }
+        }
+        return ColumnEncoding::RLE;
+    }
+    
+    if (deltaSize < packSize) {
+        putFixed<int64_t>(out, values[0]);
+        putFixed<int64_t>(out, minDelta);
+        out.push_back(deltaWidth);
+        scratch.resize(n - 1);
+        for (size_t i = 1; i < n; i++) {
+            scratch[i - 1] = static_cast<uint64_t>(values[i]) - static_cast<uint64_t>(values[i - 1]) -
+                             static_cast<uint64_t>(minDelta);
+        }
+        packBits(scratch.data(), n - 1, deltaWidth, out);
+        return ColumnEncoding::DELTA;
+    }
+    
+    putFixed<int64_t>(out, min);
+    out.push_back(packWidth);
+    scratch.resize(n);
+    for (size_t i = 0; i < n; i++) {
+        scratch[i] = static_cast<uint64_t>(values[i]) - static_cast<uint64_t>(min);
+    }
+    packBits(scratch.data(), n, packWidth, out);
+    return ColumnEncoding::BITPACK;
+}
+
+bool decodeInts(ByteReader& in, ColumnEncoding encoding, size_t n, std::vector<int64_t>& out) {
+    out.resize(n);
+    std::vector<uint64_t> scratch;
+    
+    switch (encoding) {
+        case ColumnEncoding::RLE: {
+            uint32_t runs = in.get<uint32_t>();
+            size_t at = 0;
+            for (uint32_t r = 0; r < runs && in.ok(); r++) {
+                int64_t v = in.get<int64_t>();
+                uint32_t length = in.get<uint32_t>();
+                if (length > n - at) return false;
+                std::fill(out.begin() + at, out.begin() + at + length, v);
+                at += length;
+            }
+            return in.ok() && at == n;
+        }
+        case ColumnEncoding::DELTA: {
+            int64_t first = in.get<int64_t>();
+            uint64_t minDelta = static_cast<uint64_t>(in.get<int64_t>());
+            int width = in.get<uint8_t>();
+            if (!in.ok() || width > 64 || !in.take(packedSize(n - 1, width))) return false;
+            
+            scratch.resize(n - 1);
+            unpackBits(in.position() - packedSize(n - 1, width), n - 1, width, scratch.data());
+            uint64_t v = static_cast<uint64_t>(first);
+            out[0] = first;
+            for (size_t i = 1; i < n; i++) {
+                v += scratch[i - 1] + minDelta;
+                out[i] = static_cast<int64_t>(v);
+            }
+            return true;
+        }
+        case ColumnEncoding::BITPACK: {
+            uint64_t min = static_cast<uint64_t>(in.get<int64_t>());
+            int width = in.get<uint8_t>();
+            if (!in.ok() || width > 64 || !in.take(packedSize(n, width))) return false;
+            
+            scratch.resize(n);
+            unpackBits(in.position() - packedSize(n, width), n, width, scratch.data());
+            for (size_t i = 0; i < n; i++) out[i] = static_cast<int64_t>(scratch[i] + min);
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+ColumnEncoding encodeDoubles(const std::vector<double>& values, std::vector<uint8_t>& out) {
+    size_t n = values.size();
+    size_t runs = 1;
+    for (size_t i = 1; i < n; i++) {
+        if (memcmp(&values[i], &values[i - 1], sizeof(double)) != 0) runs++;
+    }
+    
+    if (4 + runs * 12 < n * 8) {
+        putFixed<uint32_t>(out, runs);
+        size_t start = 0;
+        for (size_t i = 1; i <= n; i++) {
+            if (i == n || memcmp(&values[i], &values[start], sizeof(double)) != 0) {
+                putFixed<double>(out, values[start]);
+                putFixed<uint32_t>(out, i - start);
+                start = i;
+            }
+        }
+        return ColumnEncoding::RLE;
+    }
+    
+    size_t at = out.size();
+    out.resize(at + n * sizeof(double));
+    memcpy(out.data() + at, values.data(), n * sizeof(double));
+    return ColumnEncoding::PLAIN;
+}
+
+bool decodeDoubles(ByteReader& in, ColumnEncoding encoding, size_t n, std::vector<double>& out) {
+    out.resize(n);
+    if (encoding == ColumnEncoding::PLAIN) {
+        const uint8_t* data = in.take(n * sizeof(double));
+        if (!data) return false;
+        memcpy(out.data(), data, n * sizeof(double));
+        return true;
+    }
+    if (encoding != ColumnEncoding::RLE) return false;
+    
+    uint32_t runs = in.get<uint32_t>();
+    size_t at = 0;
+    for (uint32_t r = 0; r < runs && in.ok(); r++) {
+        double v = in.get<double>();
+        uint32_t length = in.get<uint32_t>();
+        if (length > n - at) return false;
+        std::fill(out.begin() + at, out.begin() + at + length, v);
+        at += length;
+    }
+    return in.ok() && at == n;
+}
+
+// Dictionary when it is smaller than the plain strings, which it is for the
+// low-cardinality columns (status, country, category) dashboards group on
+ColumnEncoding encodeStrings(const std::vector<const std::string*>& values, std::vector<uint8_t>& out) {
+    size_t n = values.size();
+    std::unordered_map<std::string, uint32_t> codes;
+    std::vector<const std::string*> dictionary;
+    std::vector<uint64_t> rowCodes(n);
+    size_t plainSize = 0, dictionarySize = 0;
+    
+    for (size_t i = 0; i < n; i++) {
+        plainSize += 4 + values[i]->size();
+        auto [it, inserted] = codes.emplace(*values[i], dictionary.size());
+        if (inserted) {
+            dictionary.push_back(values[i]);
+            dictionarySize += 4 + values[i]->size();
+        }
+        rowCodes[i] = it->second;
+    }
+    
+    int width = bitWidth(dictionary.size() - 1);
+    dictionarySize += 5 + packedSize(n, width);
+    
+    if (dictionarySize < plainSize) {
+        putFixed<uint32_t>(out, dictionary.size());
+        for (const auto* s : dictionary) {
+            putFixed<uint32_t>(out, s->size());
+            out.insert(out.end(), s->begin(), s->end());
+        }
+        out.push_back(width);
+        packBits(rowCodes.data(), n, width, out);
+        return ColumnEncoding::DICTIONARY;
+    }
+    
+    out.reserve(out.size() + plainSize);
+    for (const auto* s : values) {
+        putFixed<uint32_t>(out, s->size());
+        out.insert(out.end(), s->begin(), s->end());
+    }
+    return ColumnEncoding::PLAIN;
+}
+
+bool decodeStrings(ByteReader& in, ColumnEncoding encoding, size_t n, std::vector<Value>& out) {
+    out.resize(n);
+    if (encoding == ColumnEncoding::PLAIN) {
+        for (size_t i = 0; i < n; i++) {
+            uint32_t length = in.get<uint32_t>();
+            const uint8_t* data = in.take(length);
+            if (!data) return false;
+            out[i] = Value(std::string(reinterpret_cast<const char*>(data), length));
+        }
+        return true;
+    }
+    if (encoding != ColumnEncoding::DICTIONARY) return false;
+    
+    uint32_t count = in.get<uint32_t>();
+    std::vector<Value> dictionary;
+    for (uint32_t d = 0; d < count && in.ok(); d++) {
+        uint32_t length = in.get<uint32_t>();
+        const uint8_t* data = in.take(length);
+        if (!data) return false;
+        dictionary.emplace_back(std::string(reinterpret_cast<const char*>(data), length));
+    }
+    int width = in.get<uint8_t>();
+    if (!in.ok() || width > 32 || !in.take(packedSize(n, width))) return false;
+    
+    std::vector<uint64_t> codes(n);
+    unpackBits(in.position() - packedSize(n, width), n, width, codes.data());
+    for (size_t i = 0; i < n; i++) {
+        if (codes[i] >= dictionary.size()) return false;
+        out[i] = dictionary[codes[i]];
+    }
+    return true;
+}
+
+// Encodes one column of a block; zone gets min/max over the non-NULL values
+ColumnEncoding encodeColumn(const std::vector<const Value*>& column, DataType type,
+                            std::vector<uint8_t>& out, ZoneMap& zone) {
+    size_t n = column.size();
+    zone.min = Value();
+    zone.max = Value();
+    zone.nullCount = 0;
+    
+    std::vector<uint8_t> nulls((n + 7) / 8, 0);
+    for (size_t i = 0; i < n; i++) {
+        if (!column[i] || column[i]->isNull()) {
+            nulls[i / 8] |= 1 << (i % 8);
+            zone.nullCount++;
+        }
+    }
+    out.push_back(zone.nullCount > 0 ? 1 : 0);
+    if (zone.nullCount > 0) out.insert(out.end(), nulls.begin(), nulls.end());
+    
+    // Index of the first non-NULL row, used to fill NULL slots before it
+    size_t first = 0;
+    while (first < n && (!column[first] || column[first]->isNull())) first++;
+    auto present = [&](size_t i) { return column[i] && !column[i]->isNull(); };
+    
+    if (usesInts(type)) {
+        std::vector<int64_t> values(n);
+        int64_t last = first < n ? asInt(*column[first]) : 0;
+        for (size_t i = 0; i < n; i++) {
+            if (present(i)) last = asInt(*column[i]);
+            values[i] = last;
+        }
+        if (first < n) {
+            int64_t min = INT64_MAX, max = INT64_MIN;
+            for (size_t i = first; i < n; i++) {
+                if (!present(i)) continue;
+                min = std::min(min, values[i]);
+                max = std::max(max, values[i]);
+            }
+            zone.min = typedInt(min, type);
+            zone.max = typedInt(max, type);
+        }
+        return encodeInts(values, out);
+    }
+    
+    if (usesDoubles(type)) {
+        std::vector<double> values(n);
+        double last = first < n ? asDouble(*column[first]) : 0.0;
+        for (size_t i = 0; i < n; i++) {
+            if (present(i)) last = asDouble(*column[i]);
+            values[i] = last;
+        }
+        if (first < n) {
+            double min = values[first], max = values[first];
+            for (size_t i = first; i < n; i++) {
+                if (!present(i)) continue;
+                min = std::min(min, values[i]);
+                max = std::max(max, values[i]);
+            }
+            zone.min = typedDouble(min, type);
+            zone.max = typedDouble(max, type);
+        }
+        return encodeDoubles(values, out);
+    }
+    
+    if (type == DataType::TYPE_STRING) {
+        std::vector<std::string> converted(n);
+        std::vector<const std::string*> values(n);
+        const std::string* last = nullptr;
+        for (size_t i = 0; i < n; i++) {
+            if (present(i)) {
+                if (column[i]->type == DataType::TYPE_STRING) {
+                    last = &column[i]->stringVal;
+                } else {
+                    converted[i] = column[i]->toString();
+                    last = &converted[i];
+                }
+                if (zone.min.isNull() || *last < zone.min.stringVal) zone.min = Value(*last);
+                if (zone.max.isNull() || *last > zone.max.stringVal) zone.max = Value(*last);
+            }
+            values[i] = last ? last : &converted[i];
+        }
+        return encodeStrings(values, out);
+    }
+    
+    // BINARY and JSON: raw bytes, no ordering for zone maps
+    for (size_t i = 0; i < n; i++) {
+        std::vector<uint8_t> converted;
+        const std::vector<uint8_t>* bytes = &converted;
+        if (present(i)) {
+            if (column[i]->type == type) {
+                bytes = &column[i]->binaryVal;
+            } else if (type == DataType::TYPE_JSON) {
+                converted = Value::fromText(column[i]->toString(), type).binaryVal;
+            } else {
+                std::string text = column[i]->toString();
+                converted.assign(text.begin(), text.end());
+            }
+        }
+        putFixed<uint32_t>(out, bytes->size());
+        out.insert(out.end(), bytes->begin(), bytes->end());
+    }
+    return ColumnEncoding::PLAIN;
+}
+
+bool decodeColumn(const uint8_t* data, size_t length, ColumnEncoding encoding, DataType type,
+                  size_t n, ColumnVector& out) {
+    ByteReader in(data, length);
+    out.type = type;
+    out.ints.clear();
+    out.doubles.clear();
+    out.values.clear();
+    out.nulls.clear();
+    
+    if (in.get<uint8_t>()) {
+        const uint8_t* bitmap = in.take((n + 7) / 8);
+        if (!bitmap) return false;
+        out.nulls.resize(n);
+        for (size_t i = 0; i < n; i++) out.nulls[i] = (bitmap[i / 8] >> (i % 8)) & 1;
+    }
+    
+    if (usesInts(type)) return decodeInts(in, encoding, n, out.ints);
+    if (usesDoubles(type)) return decodeDoubles(in, encoding, n, out.doubles);
+    if (type == DataType::TYPE_STRING) return decodeStrings(in, encoding, n, out.values);
+    
+    out.values.resize(n);
+    for (size_t i = 0; i < n; i++) {
+        uint32_t size = in.get<uint32_t>();
+        const uint8_t* bytes = in.take(size);
+        if (!bytes) return false;
+        out.values[i].type = type;
+        out.values[i].binaryVal.assign(bytes, bytes + size);
+    }
+    return true;
+}
+
+std::vector<uint8_t> serializeBlock(uint64_t firstRow, uint32_t rowCount,
+                                    const std::vector<std::tuple<uint64_t, uint32_t, ColumnEncoding, ZoneMap>>& chunks) {
+    std::vector<uint8_t> entry;
+    putFixed<uint64_t>(entry, firstRow);
+    putFixed<uint32_t>(entry, rowCount);
+    putFixed<uint16_t>(entry, chunks.size());
+    for (const auto& [offset, length, encoding, zone] : chunks) {
+        putFixed<uint64_t>(entry, offset);
+        putFixed<uint32_t>(entry, length);
+        entry.push_back(static_cast<uint8_t>(encoding));
+        putFixed<uint32_t>(entry, zone.nullCount);
+        zone.min.serialize(entry);
+        zone.max.serialize(entry);
+    }
+    return entry;
+}
+
+} // namespace
+
+ColumnEncoding encodeColumnChunk(const std::vector<const Value*>& column, DataType type,
+                                 std::vector<uint8_t>& out, ZoneMap& zone) {
+    return encodeColumn(column, type, out, zone);
+}
+
+bool decodeColumnChunk(const uint8_t* data, size_t length, ColumnEncoding encoding, DataType type,
+                       size_t n, ColumnVector& out) {
+    return decodeColumn(data, length, encoding, type, n, out);
+}
+
+Value ColumnVector::get(size_t row) const {
+    if (isNull(row)) return Value();
+    if (usesInts(type)) return typedInt(ints[row], type);
+    if (usesDoubles(type)) return typedDouble(doubles[row], type);
+    return values[row];
+}
+
+ColumnStore::ColumnStore(const std::string& dataDir)
+    : dataDirectory(dataDir), cachedTable(0), cachedBlock(SIZE_MAX) {}
+    
+std::string ColumnStore::tableDirectory(uint32_t tableId) const {
+    std::ostringstream path;
+    path << dataDirectory << "/columns_" << std::setfill('0') << std::setw(6) << tableId;
+    return path.str();
+}
+
+static std::string segmentName(size_t column) {
+    std::ostringstream name;
+    name << "/column_" << std::setfill('0') << std::setw(4) << column << ".seg";
+    return name.str();
+}
+
+bool ColumnStore::createTable(uint32_t tableId, const std::vector<ColumnDef>& columns) {
+    std::lock_guard<std::mutex> lock(mutex);
+    
+    std::string directory = tableDirectory(tableId);
+#ifdef PLATFORM_WINDOWS
+    CreateDirectoryA(directory.c_str(), NULL);
+#else
+    mkdir(directory.c_str(), 0755);
+#endif
+    
+    std::vector<uint8_t> definition;
+    putFixed<uint16_t>(definition, columns.size());
+    for (const auto& col : columns) {
+        putFixed<uint16_t>(definition, col.name.size());
+        definition.insert(definition.end(), col.name.begin(), col.name.end());
+        definition.push_back(static_cast<uint8_t>(col.type));
+        definition.push_back(col.nullable ? 1 : 0);
+    }
+    
+    std::ofstream file(directory + "/columns.def", std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(definition.data()), definition.size());
+    if (!file) return false;
+    file.close();
+    
+    for (size_t c = 0; c <= columns.size(); c++) {
+        std::ofstream(directory + segmentName(c), std::ios::binary | std::ios::trunc);
+    }
+    std::ofstream(directory + "/blocks.dir", std::ios::binary | std::ios::trunc);
+    std::ofstream(directory + "/deleted.bm", std::ios::binary | std::ios::trunc);
+    
+    tables.erase(tableId);
+    if (cachedTable == tableId) cachedBlock = SIZE_MAX;
+    return openTable(tableId) != nullptr;
+}
+
+bool ColumnStore::dropTable(uint32_t tableId) {
+    std::lock_guard<std::mutex> lock(mutex);
+    
+    Table* table = openTable(tableId);
+    if (!table) return false;
+    
+    size_t segments = table->segments.size();
+    std::string directory = table->directory;
+    tables.erase(tableId);
+    if (cachedTable == tableId) cachedBlock = SIZE_MAX;
+    
+    for (size_t c = 0; c < segments; c++) remove((directory + segmentName(c)).c_str());
+    remove((directory + "/columns.def").c_str());
+    remove((directory + "/blocks.dir").c_str());
+    remove((directory + "/deleted.bm").c_str());
+#ifdef PLATFORM_WINDOWS
+    RemoveDirectoryA(directory.c_str());
+#else
+    rmdir(directory.c_str());
+#endif
+    return true;
+}
+
+// Loads a table's definition, block directory and delete bitmap on first use
+ColumnStore::Table* ColumnStore::openTable(uint32_t tableId) {
+    auto it = tables.find(tableId);
+    if (it != tables.end()) return it->second.get();
+    
+    std::string directory = tableDirectory(tableId);
+    std::ifstream definition(directory + "/columns.def", std::ios::binary);
+    if (!definition) {
+        tables[tableId] = nullptr;
+        return nullptr;
+    }
+    
+    auto readFile = [](std::istream& in) {
+        return std::vector<uint8_t>(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    };
+    
+    auto table = std::make_unique<Table>();
+    table->directory = directory;
+    table->rowCount = 0;
+    
+    std::vector<uint8_t> bytes = readFile(definition);
+    ByteReader in(bytes.data(), bytes.size());
+    uint16_t count = in.get<uint16_t>();
+    for (uint16_t c = 0; c < count && in.ok(); c++) {
+        ColumnDef col;
+        uint16_t nameLength = in.get<uint16_t>();
+        const uint8_t* name = in.take(nameLength);
+        if (!name) break;
+        col.name.assign(reinterpret_cast<const char*>(name), nameLength);
+        col.type = static_cast<DataType>(in.get<uint8_t>());
+        col.nullable = in.get<uint8_t>() != 0;
+        col.primaryKey = false;
+        col.unique = false;
+        table->columns.push_back(col);
+    }
+    if (!in.ok()) {
+        tables[tableId] = nullptr;
+        return nullptr;
+    }
+    
+    // A torn entry at the end of the directory is a block that never finished
+    std::ifstream blocks(directory + "/blocks.dir", std::ios::binary);
+    bytes = readFile(blocks);
+    ByteReader entries(bytes.data(), bytes.size());
+    while (entries.remaining() >= sizeof(uint32_t)) {
+        uint32_t length = entries.get<uint32_t>();
+        const uint8_t* data = entries.take(length);
+        if (!data) break;
+        
+        ByteReader entry(data, length);
+        Block block;
+        block.firstRow = entry.get<uint64_t>();
+        block.rowCount = entry.get<uint32_t>();
+        uint16_t chunks = entry.get<uint16_t>();
+        for (uint16_t c = 0; c < chunks && entry.ok(); c++) {
+            Chunk chunk;
+            chunk.offset = entry.get<uint64_t>();
+            chunk.length = entry.get<uint32_t>();
+            chunk.encoding = static_cast<ColumnEncoding>(entry.get<uint8_t>());
+            chunk.zone.nullCount = entry.get<uint32_t>();
+            chunk.zone.min = entry.value();
+            chunk.zone.max = entry.value();
+            block.chunks.push_back(chunk);
+        }
+        if (!entry.ok() || block.chunks.size() != table->columns.size() + 1) break;
+        
+        table->rowCount = block.firstRow + block.rowCount;
+        table->blocks.push_back(std::move(block));
+    }
+    
+    std::ifstream deleted(directory + "/deleted.bm", std::ios::binary);
+    table->deleted = readFile(deleted);
+    table->deleted.resize((table->rowCount + 7) / 8, 0);
+    
+    auto openStream = [](const std::string& path) {
+        return std::fstream(path, std::ios::in | std::ios::out | std::ios::binary);
+    };
+    for (size_t c = 0; c <= table->columns.size(); c++) {
+        table->segments.push_back(std::make_unique<std::fstream>(openStream(directory + segmentName(c))));
+    }
+    table->directoryFile = openStream(directory + "/blocks.dir");
+    table->deleteFile = openStream(directory + "/deleted.bm");
+    
+    Table* opened = table.get();
+    tables[tableId] = std::move(table);
+    return opened;
+}
+
+bool ColumnStore::isColumnTable(uint32_t tableId) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return openTable(tableId) != nullptr;
+}
+
+std::vector<ColumnDef> ColumnStore::getColumns(uint32_t tableId) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Table* table = openTable(tableId);
+    return table ? table->columns : std::vector<ColumnDef>();
+}
+
+size_t ColumnStore::getBlockCount(uint32_t tableId) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Table* table = openTable(tableId);
+    return table ? table->blocks.size() : 0;
+}
+
+uint64_t ColumnStore::getRowCount(uint32_t tableId) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Table* table = openTable(tableId);
+    return table ? table->rowCount : 0;
+}
+
+std::vector<ZoneMap> ColumnStore::getZoneMaps(uint32_t tableId, size_t block) {
+    std::lock_guard<std::mutex> lock(mutex);
+    
+    std::vector<ZoneMap> zones;
+    Table* table = openTable(tableId);
+    if (!table || block >= table->blocks.size()) return zones;
+    
+    const auto& chunks = table->blocks[block].chunks;
+    for (size_t c = 0; c < table->columns.size(); c++) zones.push_back(chunks[c].zone);
+    return zones;
+}
+
+bool ColumnStore::appendBlock(uint32_t tableId, const std::vector<Tuple>& rows, uint64_t* firstOrdinal) {
+    std::lock_guard<std::mutex> lock(mutex);
+    
+    Table* table = openTable(tableId);
+    if (!table) return false;
+    if (firstOrdinal) *firstOrdinal = table->rowCount;
+    if (rows.empty()) return true;
+    
+    std::vector<std::tuple<uint64_t, uint32_t, ColumnEncoding, ZoneMap>> chunks;
+    std::vector<const Value*> column(rows.size());
+    std::vector<uint8_t> buffer;
+    
+    auto writeChunk = [&](size_t c, ColumnEncoding encoding, const ZoneMap& zone) {
+        std::fstream& segment = *table->segments[c];
+        segment.seekp(0, std::ios::end);
+        uint64_t offset = static_cast<uint64_t>(segment.tellp());
+        segment.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+        segment.flush();
+        chunks.emplace_back(offset, buffer.size(), encoding, zone);
+        return static_cast<bool>(segment);
+    };
+    
+    for (size_t c = 0; c < table->columns.size(); c++) {
+        const ColumnDef& col = table->columns[c];
+        for (size_t r = 0; r < rows.size(); r++) {
+            auto it = rows[r].columns.find(col.name);
+            column[r] = it != rows[r].columns.end() ? &it->second : nullptr;
+        }
+        
+        ZoneMap zone;
+        buffer.clear();
+        ColumnEncoding encoding = encodeColumn(column, col.type, buffer, zone);
+        if (!writeChunk(c, encoding, zone)) return false;
+    }
+    
+    std::vector<Value> rowIds;
+    rowIds.reserve(rows.size());
+    for (size_t r = 0; r < rows.size(); r++) {
+        rowIds.emplace_back(static_cast<int64_t>(rows[r].rowId));
+        column[r] = &rowIds[r];
+    }
+    ZoneMap zone;
+    buffer.clear();
+    ColumnEncoding encoding = encodeColumn(column, DataType::TYPE_INT64, buffer, zone);
+    if (!writeChunk(table->columns.size(), encoding, zone)) return false;
+    
+    // The directory entry is what publishes the block
+    std::vector<uint8_t> entry = serializeBlock(table->rowCount, rows.size(), chunks);
+    uint32_t entryLength = entry.size();
+    table->directoryFile.seekp(0, std::ios::end);
+    table->directoryFile.write(reinterpret_cast<const char*>(&entryLength), sizeof(entryLength));
+    table->directoryFile.write(reinterpret_cast<const char*>(entry.data()), entry.size());
+    table->directoryFile.flush();
+    if (!table->directoryFile) return false;
+    
+    Block block;
+    block.firstRow = table->rowCount;
+    block.rowCount = rows.size();
+    for (const auto& [offset, length, chunkEncoding, chunkZone] : chunks) {
+        block.chunks.push_back({offset, length, chunkEncoding, chunkZone});
+    }
+    table->blocks.push_back(std::move(block));
+    table->rowCount += rows.size();
+    table->deleted.resize((table->rowCount + 7) / 8, 0);
+    return true;
+}
+
+bool ColumnStore::readChunk(Table& table, const Block& block, size_t column, ColumnVector& out) {
+    const Chunk& chunk = block.chunks[column];
+    DataType type = column < table.columns.size() ? table.columns[column].type : DataType::TYPE_INT64;
+    
+    // Padded so bit unpacking can read whole words past the end
+    thread_local std::vector<uint8_t> buffer;
+    buffer.assign(chunk.length + 16, 0);
+    
+    std::fstream& segment = *table.segments[column];
+    segment.seekg(chunk.offset);
+    segment.read(reinterpret_cast<char*>(buffer.data()), chunk.length);
+    if (!segment) {
+        segment.clear();
+        return false;
+    }
+    return decodeColumn(buffer.data(), chunk.length, chunk.encoding, type, block.rowCount, out);
+}
+
+size_t ColumnStore::findBlock(const Table& table, uint64_t ordinal) const {
+    auto it = std::upper_bound(table.blocks.begin(), table.blocks.end(), ordinal,
+                               [](uint64_t row, const Block& block) { return row < block.firstRow; });
+    if (it == table.blocks.begin()) return SIZE_MAX;
+    size_t index = (it - table.blocks.begin()) - 1;
+    const Block& block = table.blocks[index];
+    return ordinal < block.firstRow + block.rowCount ? index : SIZE_MAX;
+}
+
+bool ColumnStore::readBlock(uint32_t tableId, size_t blockIndex, const std::vector<size_t>& columns,
+                            std::vector<ColumnVector>& out, std::vector<uint8_t>& deleted,
+                            uint64_t* firstRow, std::vector<int64_t>* rowIds) {
+    std::lock_guard<std::mutex> lock(mutex);
+    
+    Table* table = openTable(tableId);
+    if (!table || blockIndex >= table->blocks.size()) return false;
+    const Block& block = table->blocks[blockIndex];
+    
+    out.resize(columns.size());
+    for (size_t i = 0; i < columns.size(); i++) {
+        if (columns[i] >= table->columns.size() || !readChunk(*table, block, columns[i], out[i])) return false;
+    }
+    
+    if (rowIds) {
+        ColumnVector ids;
+        if (!readChunk(*table, block, table->columns.size(), ids)) return false;
+        rowIds->swap(ids.ints);
+    }
+    
+    deleted.resize(block.rowCount);
+    for (uint32_t r = 0; r < block.rowCount; r++) {
+        uint64_t ordinal = block.firstRow + r;
+        deleted[r] = (table->deleted[ordinal / 8] >> (ordinal % 8)) & 1;
+    }
+    if (firstRow) *firstRow = block.firstRow;
+    return true;
+}
+
+bool ColumnStore::readRow(uint32_t tableId, uint64_t ordinal, Tuple& tuple) {
+    std::lock_guard<std::mutex> lock(mutex);
+    
+    Table* table = openTable(tableId);
+    if (!table || ordinal >= table->rowCount) return false;
+    if ((table->deleted[ordinal / 8] >> (ordinal % 8)) & 1) return false;
+    
+    size_t blockIndex = findBlock(*table, ordinal);
+    if (blockIndex == SIZE_MAX) return false;
+    const Block& block = table->blocks[blockIndex];
+    
+    if (cachedTable != tableId || cachedBlock != blockIndex) {
+        cachedBlock = SIZE_MAX;
+        cachedColumns.resize(table->columns.size() + 1);
+        for (size_t c = 0; c <= table->columns.size(); c++) {
+            if (!readChunk(*table, block, c, cachedColumns[c])) return false;
+        }
+        cachedTable = tableId;
+        cachedBlock = blockIndex;
+    }
+    
+    size_t row = ordinal - block.firstRow;
+    tuple.rowId = cachedColumns.back().ints[row];
+    tuple.txnId = 0;
+    tuple.timestamp = 0;
+    tuple.deleted = false;
+    tuple.columns.clear();
+    for (size_t c = 0; c < table->columns.size(); c++) {
+        tuple.columns[table->columns[c].name] = cachedColumns[c].get(row);
+    }
+    return true;
+}
+
+bool ColumnStore::setDeleted(uint32_t tableId, uint64_t ordinal, bool deleted) {
+    std::lock_guard<std::mutex> lock(mutex);
+    
+    Table* table = openTable(tableId);
+    if (!table || ordinal >= table->rowCount) return false;
+    
+    uint8_t& byte = table->deleted[ordinal / 8];
+    if (deleted) byte |= 1 << (ordinal % 8);
+    else byte &= ~(1 << (ordinal % 8));
+    
+    table->deleteFile.seekp(ordinal / 8);
+    table->deleteFile.write(reinterpret_cast<const char*>(&byte), 1);
+    table->deleteFile.flush();
+    return static_cast<bool>(table->deleteFile);
+}
+
+void ColumnStore::sync() {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto& [id, table] : tables) {
+        if (!table) continue;
+        for (auto& segment : table->segments) segment->flush();
+        table->directoryFile.flush();
+        table->deleteFile.flush();
+    }
+}
+
+} // namespace hybriddb
@@ -0,0 +1,181 @@
+#include "../include/hybriddb.h"
+#include <cstring>
+#include <algorithm>
+
+namespace hybriddb {
+
+// ============================================================================
+// LZ4 BLOCK CODEC
+// ============================================================================
+//
+// A sequence is a token (literal length in the high nibble, match length - 4
+// in the low one), extra length bytes for either when the nibble is 15, the
+// literals, and a little-endian 16-bit match offset. The block ends with a
+// literal-only sequence; the last match starts at least 12 bytes before the
+// end and the last 5 bytes are always literals.
+
+#define LZ4_HASH_LOG 12
+#define LZ4_MIN_MATCH 4
+#define LZ4_LAST_LITERALS 5
+#define LZ4_MATCH_LIMIT 12
+#define LZ4_MAX_OFFSET 65535
+
+namespace {
+
+inline uint32_t read32(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint64_t read64(const uint8_t* p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint32_t hashSequence(uint32_t sequence) {
+    return (sequence * 2654435761u) >> (32 - LZ4_HASH_LOG);
+}
+
+// Bytes two positions share, stopping at limit
+inline size_t commonLength(const uint8_t* a, const uint8_t* b, const uint8_t* limit) {
+    const uint8_t* start = a;
+    while (a + 8 <= limit) {
+        uint64_t diff = read64(a) ^ read64(b);
+        if (diff) return a - start + (__builtin_ctzll(diff) >> 3);
+        a += 8;
+        b += 8;
+    }
+    while (a < limit && *a == *b) {
+        a++;
+        b++;
+    }
+    return a - start;
+}
+
+inline void putLength(uint8_t*& op, size_t length) {
+    while (length >= 255) {
+        *op++ = 255;
+        length -= 255;
+    }
+    *op++ = static_cast<uint8_t>(length);
+}
+
+} // namespace
+
+size_t LZ4Codec::compress(const uint8_t* src, size_t length, uint8_t* dst, size_t capacity) {
+    uint32_t table[1 << LZ4_HASH_LOG];
+    memset(table, 0, sizeof(table));
+    
+    const uint8_t* ip = src;
+    const uint8_t* anchor = src;
+    const uint8_t* end = src + length;
+    const uint8_t* matchLimit = end - LZ4_LAST_LITERALS;
+    uint8_t* op = dst;
+    uint8_t* opEnd = dst + capacity;
+    
+    if (length >= LZ4_MATCH_LIMIT + 1) {
+        const uint8_t* searchLimit = end - LZ4_MATCH_LIMIT;
+        ip++;
+        while (ip < searchLimit) {
+            uint32_t sequence = read32(ip);
+            uint32_t h = hashSequence(sequence);
+            const uint8_t* ref = src + table[h];
+            table[h] = static_cast<uint32_t>(ip - src);
+            
+            if (ref >= ip || ip - ref > LZ4_MAX_OFFSET || read32(ref) != sequence) {
+                // Step further the longer nothing has matched
+                ip += 1 + ((ip - anchor) >> 6);
+                continue;
+            }
+            
+            while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+                ip--;
+                ref--;
+            }
+            size_t matchLength = LZ4_MIN_MATCH + commonLength(ip + LZ4_MIN_MATCH, ref + LZ4_MIN_MATCH, matchLimit);
+            size_t literals = ip - anchor;
+            
+            if (op + 1 + literals / 255 + 1 + literals + 2 + matchLength / 255 + 1 > opEnd) return 0;
+            
+            uint8_t* token = op++;
+            *token = static_cast<uint8_t>(std::min<size_t>(literals, 15) << 4);
+            if (literals >= 15) putLength(op, literals - 15);
+            memcpy(op, anchor, literals);
+            op += literals;
+            
+            uint16_t offset = static_cast<uint16_t>(ip - ref);
+            *op++ = offset & 0xFF;
+            *op++ = offset >> 8;
+            
+            size_t extra = matchLength - LZ4_MIN_MATCH;
+            *token |= static_cast<uint8_t>(std::min<size_t>(extra, 15));
+            if (extra >= 15) putLength(op, extra - 15);
+            
+            ip += matchLength;
+            anchor = ip;
+            if (ip < searchLimit) table[hashSequence(read32(ip - 2))] = static_cast<uint32_t>(ip - 2 - src);
+        }
+    }
+    
+    size_t literals = end - anchor;
+    if (op + 1 + literals / 255 + 1 + literals > opEnd) return 0;
+    *op++ = static_cast<uint8_t>(std::min<size_t>(literals, 15) << 4);
+    if (literals >= 15) putLength(op, literals - 15);
+    memcpy(op, anchor, literals);
+    op += literals;
+    return op - dst;
+}
+
+bool LZ4Codec::decompress(const uint8_t* src, size_t length, uint8_t* dst, size_t size) {
+    const uint8_t* ip = src;
+    const uint8_t* end = src + length;
+    uint8_t* op = dst;
+    uint8_t* opEnd = dst + size;
+    
+    auto readLength = [&](size_t& value) {
+        uint8_t b;
+        do {
+            if (ip >= end) return false;
+            b = *ip++;
+            value += b;
+        } while (b == 255);
+        return true;
+    };
+    
+    while (ip < end) {
+        uint8_t token = *ip++;
+        
+        size_t literals = token >> 4;
+        if (literals == 15 && !readLength(literals)) return false;
+        if (literals > static_cast<size_t>(end - ip) || literals > static_cast<size_t>(opEnd - op)) return false;
+        memcpy(op, ip, literals);
+        ip += literals;
+        op += literals;
+        
+        if (ip == end) break;
+        
+        if (end - ip < 2) return false;
+        size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > static_cast<size_t>(op - dst)) return false;
+        
+        size_t matchLength = (token & 0x0F);
+        if (matchLength == 15 && !readLength(matchLength)) return false;
+        matchLength += LZ4_MIN_MATCH;
+        if (matchLength > static_cast<size_t>(opEnd - op)) return false;
+        
+        // Overlapping matches repeat the bytes just written
+        const uint8_t* ref = op - offset;
+        if (offset >= matchLength) {
+            memcpy(op, ref, matchLength);
+            op += matchLength;
+        } else {
+            for (size_t i = 0; i < matchLength; i++) *op++ = *ref++;
+        }
+    }
+    return op == opEnd;
+}
+
+} // namespace hybriddb
@@ -0,0 +1,557 @@
+#include "../include/hybriddb.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstring>
+
+namespace hybriddb {
+
+// ============================================================================
+// FULL-TEXT INDEX IMPLEMENTATION
+// ============================================================================
+//
+// A posting list block of FULLTEXT_BLOCK postings stores the doc gaps
+// (doc - previous doc - 1) and then the term frequencies minus one, each
+// packed at the width of its largest value. Value i of a block sits in lane
+// i % 4 of four interleaved 32-bit word streams, the SIMD-BP128 layout, so
+// the same shift and mask applies to four lanes at once and the pack and
+// unpack loops vectorize. The first gap of a block is taken from the
+// previous block's last doc, or from the list's first doc.
+
+static_assert(FULLTEXT_BLOCK == 128, "posting blocks are packed as four lanes of 32 values");
+
+namespace {
+
+const size_t MAX_TOKEN_BYTES = 64;
+const uint8_t VARINT_BLOCK = 0xff;      // docWidth of a short block stored as varints
+const double BM25_K1 = 1.2;
+const double BM25_B = 0.75;
+
+uint8_t bitWidth(uint32_t bits) {
+    return bits ? 32 - __builtin_clz(bits) : 0;
+}
+
+void pack128(const uint32_t* in, uint8_t width, std::string& out) {
+    if (width == 0) return;
+    
+    uint32_t packed[FULLTEXT_BLOCK] = {};
+    uint32_t bit = 0, word = 0;
+    for (size_t j = 0; j < FULLTEXT_BLOCK / 4; j++) {
+        for (size_t lane = 0; lane < 4; lane++) {
+            uint32_t v = in[j * 4 + lane];
+            packed[word * 4 + lane] |= v << bit;
+            if (bit + width > 32) packed[word * 4 + 4 + lane] |= v >> (32 - bit);
+        }
+        bit += width;
+        if (bit >= 32) {
+            bit -= 32;
+            word++;
+        }
+    }
+    out.append(reinterpret_cast<const char*>(packed), width * 16);
+}
+
+void unpack128(const char* data, uint8_t width, uint32_t* out) {
+    if (width == 0) {
+        std::fill(out, out + FULLTEXT_BLOCK, 0);
+        return;
+    }
+    
+    uint32_t packed[FULLTEXT_BLOCK];
+    memcpy(packed, data, width * 16);
+    uint32_t mask = width == 32 ? UINT32_MAX : (1u << width) - 1;
+    uint32_t bit = 0, word = 0;
+    for (size_t j = 0; j < FULLTEXT_BLOCK / 4; j++) {
+        for (size_t lane = 0; lane < 4; lane++) {
+            uint32_t v = packed[word * 4 + lane] >> bit;
+            if (bit + width > 32) v |= packed[word * 4 + 4 + lane] << (32 - bit);
+            out[j * 4 + lane] = v & mask;
+        }
+        bit += width;
+        if (bit >= 32) {
+            bit -= 32;
+            word++;
+        }
+    }
+}
+
+void putVarint(std::string& out, uint32_t v) {
+    while (v >= 0x80) {
+        out += static_cast<char>(v | 0x80);
+        v >>= 7;
+    }
+    out += static_cast<char>(v);
+}
+
+uint32_t getVarint(const uint8_t*& p) {
+    uint32_t v = 0;
+    for (int shift = 0;; shift += 7) {
+        uint8_t byte = *p++;
+        v |= static_cast<uint32_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return v;
+    }
+}
+
+bool isWordByte(unsigned char c) {
+    return (c >= '0' && c <= '9') || ((c | 0x20) >= 'a' && (c | 0x20) <= 'z') || c >= 0x80;
+}
+
+} // namespace
+
+// Walks the chain of posting lists one term has across the segments and the
+// buffer. Only the block under the cursor is decoded; shallow() moves to the
+// block that could hold a doc without decoding it, which is all the block-max
+// check needs.
+class FullTextIndex::Cursor {
+public:
+    static constexpr uint32_t END = UINT32_MAX;
+    
+    std::vector<const PostingList*> lists;  // ascending, non-overlapping doc ranges
+    double idf = 0;
+    double bound = 0;                       // best score anywhere in the lists
+    uint32_t doc = 0;                       // current doc, END once exhausted
+    
+    bool shallow(uint32_t target) {
+        while (list < lists.size()) {
+            const auto& blocks = lists[list]->blocks;
+            if (blocks.back().lastDoc >= target) {
+                block = std::lower_bound(blocks.begin() + block, blocks.end(), target,
+                                         [](const PostingBlock& b, uint32_t d) { return b.lastDoc < d; }) -
+                        blocks.begin();
+                return true;
+            }
+            list++;
+            block = 0;
+        }
+        return false;
+    }
+    
+    // Moves to the first doc at or after target
+    void advance(uint32_t target) {
+        if (!shallow(target)) {
+            doc = END;
+            return;
+        }
+        if (decodedList != list || decodedBlock != block) {
+            decodeBlock(*lists[list], block, docs, tfs);
+            decodedList = list;
+            decodedBlock = block;
+            pos = 0;
+        }
+        while (docs[pos] < target) pos++;
+        doc = docs[pos];
+    }
+    
+    bool exhausted() const { return list >= lists.size(); }
+    const PostingBlock& current() const { return lists[list]->blocks[block]; }
+    uint32_t tf() const { return tfs[pos]; }
+    
+private:
+    size_t list = 0;
+    size_t block = 0;
+    size_t decodedList = SIZE_MAX;
+    size_t decodedBlock = 0;
+    size_t pos = 0;
+    uint32_t docs[FULLTEXT_BLOCK];
+    uint32_t tfs[FULLTEXT_BLOCK];
+};
+
+FullTextIndex::FullTextIndex(const std::string& n, const std::string& col, const std::vector<std::string>& p)
+    : TableIndex(n, col, false, p) {
+    // Doc 0 is never used so the first list of a segment can start its gaps at firstDoc - 1
+    docTuples.push_back(0);
+    docLengths.push_back(0);
+    docDeleted.push_back(true);
+}
+
+void FullTextIndex::tokenize(const Value& value, std::vector<std::string>& tokens) {
+    std::string converted;
+    const std::string* text = &value.stringVal;
+    if (value.isNull()) return;
+    if (value.type == DataType::TYPE_JSON) {
+        JSONDocument::appendWords(value.binaryVal.data(), value.binaryVal.size(), converted);
+        text = &converted;
+    } else if (value.type != DataType::TYPE_STRING) {
+        converted = value.toString();
+        text = &converted;
+    }
+    
+    std::string token;
+    for (char c : *text) {
+        unsigned char byte = static_cast<unsigned char>(c);
+        if (isWordByte(byte)) {
+            if (token.size() < MAX_TOKEN_BYTES) token += static_cast<char>(byte < 0x80 ? tolower(byte) : byte);
+        } else if (!token.empty()) {
+            tokens.push_back(std::move(token));
+            token.clear();
+        }
+    }
+    if (!token.empty()) tokens.push_back(std::move(token));
+}
+
+size_t FullTextIndex::size() const {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    return liveDocs;
+}
+
+bool FullTextIndex::insert(const Value& key, uint64_t tupleId) {
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    addDocument(key, tupleId, true);
+    return true;
+}
+
+void FullTextIndex::remove(const Value&, uint64_t tupleId) {
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    
+    // Postings of a deleted doc stay until its segment is merged; search skips them
+    auto it = tupleDocs.find(tupleId);
+    if (it == tupleDocs.end()) return;
+    docDeleted[it->second] = true;
+    liveDocs--;
+    liveLength -= docLengths[it->second];
+    tupleDocs.erase(it);
+}
+
+// One segment for the whole batch instead of a freeze and merges every
+// FULLTEXT_BUFFER_DOCS documents
+bool FullTextIndex::bulkInsert(std::vector<std::pair<Value, uint64_t>>& keys, std::string&) {
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    for (const auto& [key, tupleId] : keys) addDocument(key, tupleId, false);
+    freeze();
+    return true;
+}
+
+std::vector<uint64_t> FullTextIndex::lookup(const Value& query) const {
+    std::vector<uint64_t> result;
+    for (const auto& hit : search(query.toString(), SIZE_MAX)) result.push_back(hit.first);
+    return result;
+}
+
+void FullTextIndex::addDocument(const Value& key, uint64_t tupleId, bool freezeFull) {
+    if (key.isNull()) return;
+    
+    auto existing = tupleDocs.find(tupleId);
+    if (existing != tupleDocs.end()) {
+        docDeleted[existing->second] = true;
+        liveDocs--;
+        liveLength -= docLengths[existing->second];
+    }
+    
+    std::vector<std::string> tokens;
+    tokenize(key, tokens);
+    uint32_t doc = static_cast<uint32_t>(docTuples.size());
+    docTuples.push_back(tupleId);
+    docLengths.push_back(static_cast<uint32_t>(tokens.size()));
+    docDeleted.push_back(false);
+    tupleDocs[tupleId] = doc;
+    liveDocs++;
+    liveLength += tokens.size();
+    
+    std::sort(tokens.begin(), tokens.end());
+    for (size_t i = 0; i < tokens.size();) {
+        size_t j = i + 1;
+        while (j < tokens.size() && tokens[j] == tokens[i]) j++;
+        buffer[tokens[i]].emplace_back(doc, static_cast<uint32_t>(j - i));
+        i = j;
+    }
+    
+    if (freezeFull && doc + 1 - bufferFirst >= FULLTEXT_BUFFER_DOCS) freeze();
+}
+
+// Turns the buffered documents into a segment, then merges
+void FullTextIndex::freeze() {
+    uint32_t end = static_cast<uint32_t>(docTuples.size());
+    if (bufferFirst >= end) return;
+    
+    Segment segment;
+    segment.firstDoc = bufferFirst;
+    segment.lastDoc = end - 1;
+    segment.docCount = 0;
+    for (uint32_t doc = bufferFirst; doc < end; doc++) segment.docCount += !docDeleted[doc];
+    
+    Postings live;
+    for (const auto& [term, postings] : buffer) {
+        live.clear();
+        for (const auto& posting : postings) {
+            if (!docDeleted[posting.first]) live.push_back(posting);
+        }
+        if (!live.empty()) encode(live, segment.terms[term]);
+    }
+    buffer.clear();
+    bufferFirst = end;
+    segments.push_back(std::move(segment));
+    merge();
+}
+
+// Binary-counter merging: the newest segment joins the one before it while
+// that one is no bigger, so segment sizes at least double going back and a
+// term has O(log n) lists. Deleted docs are dropped on the way.
+void FullTextIndex::merge() {
+    Postings postings, more;
+    auto dropDeleted = [&]() {
+        postings.erase(std::remove_if(postings.begin(), postings.end(),
+                                      [&](const std::pair<uint32_t, uint32_t>& p) { return docDeleted[p.first]; }),
+                       postings.end());
+    };
+    
+    while (segments.size() >= 2 && segments[segments.size() - 2].docCount <= segments.back().docCount) {
+        Segment& older = segments[segments.size() - 2];
+        Segment& newer = segments.back();
+        
+        Segment merged;
+        merged.firstDoc = older.firstDoc;
+        merged.lastDoc = newer.lastDoc;
+        merged.docCount = 0;
+        for (uint32_t doc = merged.firstDoc; doc <= merged.lastDoc; doc++) merged.docCount += !docDeleted[doc];
+        
+        for (const auto& [term, list] : older.terms) {
+            postings.clear();
+            decode(list, postings);
+            auto it = newer.terms.find(term);
+            if (it != newer.terms.end()) {
+                more.clear();
+                decode(it->second, more);
+                postings.insert(postings.end(), more.begin(), more.end());
+            }
+            dropDeleted();
+            if (!postings.empty()) encode(postings, merged.terms[term]);
+        }
+        for (const auto& [term, list] : newer.terms) {
+            if (older.terms.count(term)) continue;
+            postings.clear();
+            decode(list, postings);
+            dropDeleted();
+            if (!postings.empty()) encode(postings, merged.terms[term]);
+        }
+        
+        segments.pop_back();
+        segments.back() = std::move(merged);
+        merges++;
+    }
+}
+
+void FullTextIndex::encode(const Postings& postings, PostingList& list) const {
+    list = PostingList();
+    list.count = static_cast<uint32_t>(postings.size());
+    list.firstDoc = postings.front().first;
+    
+    uint32_t gaps[FULLTEXT_BLOCK];
+    uint32_t tfs[FULLTEXT_BLOCK];
+    uint32_t prev = list.firstDoc - 1;
+    for (size_t start = 0; start < postings.size(); start += FULLTEXT_BLOCK) {
+        size_t count = std::min<size_t>(FULLTEXT_BLOCK, postings.size() - start);
+        PostingBlock block;
+        block.offset = static_cast<uint32_t>(list.data.size());
+        block.count = static_cast<uint16_t>(count);
+        block.maxTf = 0;
+        block.minLength = UINT32_MAX;
+        
+        uint32_t gapBits = 0, tfBits = 0;
+        for (size_t i = 0; i < count; i++) {
+            auto [doc, tf] = postings[start + i];
+            gaps[i] = doc - prev - 1;
+            tfs[i] = tf - 1;
+            gapBits |= gaps[i];
+            tfBits |= tfs[i];
+            prev = doc;
+            block.maxTf = std::max(block.maxTf, tf);
+            block.minLength = std::min(block.minLength, docLengths[doc]);
+        }
+        block.lastDoc = prev;
+        
+        if (count == FULLTEXT_BLOCK) {
+            block.docWidth = bitWidth(gapBits);
+            block.tfWidth = bitWidth(tfBits);
+            pack128(gaps, block.docWidth, list.data);
+            pack128(tfs, block.tfWidth, list.data);
+        } else {
+            block.docWidth = VARINT_BLOCK;
+            block.tfWidth = 0;
+            for (size_t i = 0; i < count; i++) {
+                putVarint(list.data, gaps[i]);
+                putVarint(list.data, tfs[i]);
+            }
+        }
+        list.maxTf = std::max(list.maxTf, block.maxTf);
+        list.minLength = std::min(list.minLength, block.minLength);
+        list.blocks.push_back(block);
+    }
+}
+
+void FullTextIndex::decodeBlock(const PostingList& list, size_t index, uint32_t* docs, uint32_t* tfs) {
+    const PostingBlock& block = list.blocks[index];
+    uint32_t prev = index ? list.blocks[index - 1].lastDoc : list.firstDoc - 1;
+    const char* data = list.data.data() + block.offset;
+    
+    if (block.docWidth == VARINT_BLOCK) {
+        const uint8_t* p = reinterpret_cast<const uint8_t*>(data);
+        for (size_t i = 0; i < block.count; i++) {
+            prev += getVarint(p) + 1;
+            docs[i] = prev;
+            tfs[i] = getVarint(p) + 1;
+        }
+        return;
+    }
+    
+    unpack128(data, block.docWidth, docs);
+    unpack128(data + block.docWidth * 16, block.tfWidth, tfs);
+    for (size_t i = 0; i < FULLTEXT_BLOCK; i++) {
+        prev += docs[i] + 1;
+        docs[i] = prev;
+        tfs[i]++;
+    }
+}
+
+void FullTextIndex::decode(const PostingList& list, Postings& postings) {
+    uint32_t docs[FULLTEXT_BLOCK];
+    uint32_t tfs[FULLTEXT_BLOCK];
+    for (size_t b = 0; b < list.blocks.size(); b++) {
+        decodeBlock(list, b, docs, tfs);
+        for (size_t i = 0; i < list.blocks[b].count; i++) postings.emplace_back(docs[i], tfs[i]);
+    }
+}
+
+// Block-max WAND (Ding and Suel). Cursors sorted by doc give a pivot: the
+// first doc whose terms' list-wide bounds could beat the k-th best score.
+// If the bounds of the blocks holding the pivot cannot either, every doc up
+// to the end of the shortest of those blocks is skipped unread.
+std::vector<std::pair<uint64_t, double>> FullTextIndex::search(const std::string& query, size_t k,
+                                                               size_t* scored) const {
+    std::vector<std::string> words;
+    tokenize(Value(query), words);
+    std::sort(words.begin(), words.end());
+    words.erase(std::unique(words.begin(), words.end()), words.end());
+    if (scored) *scored = 0;
+    
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    std::vector<std::pair<uint64_t, double>> result;
+    if (words.empty() || k == 0 || liveDocs == 0) return result;
+    
+    double averageLength = std::max(1.0, static_cast<double>(liveLength) / liveDocs);
+    auto termScore = [&](double idf, uint32_t tf, uint32_t length) {
+        double norm = BM25_K1 * (1 - BM25_B + BM25_B * length / averageLength);
+        return idf * tf * (BM25_K1 + 1) / (tf + norm);
+    };
+    
+    // Buffered postings are encoded per query so every cursor reads blocks
+    std::vector<PostingList> buffered(words.size());
+    std::vector<Cursor> cursors(words.size());
+    std::vector<Cursor*> order;
+    for (size_t i = 0; i < words.size(); i++) {
+        Cursor& cursor = cursors[i];
+        uint64_t df = 0;
+        for (const auto& segment : segments) {
+            auto it = segment.terms.find(words[i]);
+            if (it == segment.terms.end()) continue;
+            cursor.lists.push_back(&it->second);
+            df += it->second.count;
+        }
+        auto it = buffer.find(words[i]);
+        if (it != buffer.end()) {
+            encode(it->second, buffered[i]);
+            cursor.lists.push_back(&buffered[i]);
+            df += it->second.size();
+        }
+        if (cursor.lists.empty()) continue;
+        
+        // df counts deleted docs not merged away yet, so it can pass liveDocs
+        double n = static_cast<double>(std::max<uint64_t>(liveDocs, df));
+        cursor.idf = std::log(1 + (n - df + 0.5) / (df + 0.5));
+        for (const PostingList* list : cursor.lists) {
+            cursor.bound = std::max(cursor.bound, termScore(cursor.idf, list->maxTf, list->minLength));
+        }
+        cursor.advance(0);
+        order.push_back(&cursor);
+    }
+    
+    // Min-heap of (score, doc) holding the best k so far
+    auto better = [](const std::pair<double, uint32_t>& a, const std::pair<double, uint32_t>& b) {
+        return a.first > b.first || (a.first == b.first && a.second < b.second);
+    };
+    std::vector<std::pair<double, uint32_t>> top;
+    size_t count = 0;
+    
+    while (true) {
+        std::sort(order.begin(), order.end(), [](const Cursor* a, const Cursor* b) { return a->doc < b->doc; });
+        double threshold = top.size() >= k ? top.front().first : 0;
+        
+        double upper = 0;
+        size_t pivot = SIZE_MAX;
+        for (size_t i = 0; i < order.size() && order[i]->doc != Cursor::END; i++) {
+            upper += order[i]->bound;
+            if (upper > threshold) {
+                pivot = i;
+                break;
+            }
+        }
+        if (pivot == SIZE_MAX) break;
+        uint32_t pivotDoc = order[pivot]->doc;
+        while (pivot + 1 < order.size() && order[pivot + 1]->doc == pivotDoc) pivot++;
+        
+        // A cursor behind the pivot may have no block left that reaches it
+        double blockUpper = 0;
+        for (size_t i = 0; i <= pivot; i++) {
+            if (!order[i]->shallow(pivotDoc)) continue;
+            const PostingBlock& block = order[i]->current();
+            blockUpper += termScore(order[i]->idf, block.maxTf, block.minLength);
+        }
+        
+        if (blockUpper > threshold && order[0]->doc == pivotDoc) {
+            if (!docDeleted[pivotDoc]) {
+                double score = 0;
+                for (size_t i = 0; i <= pivot; i++) {
+                    score += termScore(order[i]->idf, order[i]->tf(), docLengths[pivotDoc]);
+                }
+                count++;
+                if (top.size() < k) {
+                    top.emplace_back(score, pivotDoc);
+                    std::push_heap(top.begin(), top.end(), better);
+                } else if (score > threshold) {
+                    std::pop_heap(top.begin(), top.end(), better);
+                    top.back() = {score, pivotDoc};
+                    std::push_heap(top.begin(), top.end(), better);
+                }
+            }
+            for (size_t i = 0; i <= pivot; i++) order[i]->advance(pivotDoc + 1);
+        } else if (blockUpper > threshold) {
+            for (size_t i = 0; i < pivot; i++) {
+                if (order[i]->doc < pivotDoc) order[i]->advance(pivotDoc);
+            }
+        } else {
+            uint32_t next = pivot + 1 < order.size() ? order[pivot + 1]->doc : Cursor::END;
+            for (size_t i = 0; i <= pivot; i++) {
+                if (!order[i]->exhausted()) next = std::min(next, order[i]->current().lastDoc + 1);
+            }
+            next = std::max(next, pivotDoc + 1);
+            for (size_t i = 0; i <= pivot; i++) {
+                if (order[i]->doc < next) order[i]->advance(next);
+            }
+        }
+    }
+    
+    std::sort(top.begin(), top.end(), better);
+    for (const auto& [score, doc] : top) result.emplace_back(docTuples[doc], score);
+    if (scored) *scored = count;
+    return result;
+}
+
+FullTextStats FullTextIndex::getStats() const {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    
+    FullTextStats stats = {};
+    stats.documents = liveDocs;
+    stats.segments = segments.size();
+    stats.merges = merges;
+    for (const auto& segment : segments) {
+        stats.terms += segment.terms.size();
+        for (const auto& [term, list] : segment.terms) {
+            stats.postings += list.count;
+            stats.postingBytes += list.data.size();
+        }
+    }
+    stats.terms += buffer.size();
+    for (const auto& [term, postings] : buffer) stats.postings += postings.size();
+    return stats;
+}
+
+} // namespace hybriddb
@@ -0,0 +1,118 @@
+#include "../include/hybriddb.h"
+#include <algorithm>
+
+namespace hybriddb {
+
+// ============================================================================
+// TABLE INDEX IMPLEMENTATION
+// ============================================================================
+
+TableIndex::TableIndex(const std::string& n, const std::string& col, bool uniq,
+                       const std::vector<std::string>& p)
+    : name(n), column(col), path(p), unique(uniq) {}
+    
+bool TableIndex::covers(const std::string& col, const std::vector<std::string>& p) const {
+    return column == col && path == p;
+}
+
+Value TableIndex::keyFor(const Value& columnValue) const {
+    if (path.empty()) return columnValue;
+    
+    // Path keys are read straight from the binary document without decoding it
+    Value key;
+    JSONDocument::extract(columnValue, path, key);
+    return key;
+}
+
+Value TableIndex::keyFor(const Tuple& tuple) const {
+    auto it = tuple.columns.find(column);
+    return it != tuple.columns.end() ? keyFor(it->second) : Value();
+}
+    
+size_t TableIndex::size() const {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    return entries.size();
+}
+
+bool TableIndex::insert(const Value& key, uint64_t tupleId) {
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    
+    if (unique && !key.isNull() && entries.count(key)) {
+        return false;
+    }
+    entries.emplace(key, tupleId);
+    return true;
+}
+
+void TableIndex::remove(const Value& key, uint64_t tupleId) {
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    
+    auto range = entries.equal_range(key);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->second == tupleId) {
+            entries.erase(it);
+            return;
+        }
+    }
+}
+
+bool TableIndex::contains(const Value& key) const {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    return entries.count(key) > 0;
+}
+
+std::vector<uint64_t> TableIndex::lookup(const Value& key) const {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    
+    std::vector<uint64_t> result;
+    auto range = entries.equal_range(key);
+    for (auto it = range.first; it != range.second; ++it) {
+        result.push_back(it->second);
+    }
+    return result;
+}
+
+std::vector<uint64_t> TableIndex::lookupRange(const Value& low, bool lowInclusive, const Value& high,
+                                              bool highInclusive) const {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    
+    std::vector<uint64_t> result;
+    if (!low.isNull() && !high.isNull() && low.compare(high) > 0) return result;
+    
+    auto it = low.isNull() ? entries.begin() : lowInclusive ? entries.lower_bound(low) : entries.upper_bound(low);
+    auto end = high.isNull() ? entries.end() : highInclusive ? entries.upper_bound(high) : entries.lower_bound(high);
+    for (; it != end; ++it) {
+        if (!it->first.isNull()) result.push_back(it->second);
+    }
+    return result;
+}
+
+bool TableIndex::bulkInsert(std::vector<std::pair<Value, uint64_t>>& keys, std::string& error) {
+    std::sort(keys.begin(), keys.end(),
+              [](const auto& a, const auto& b) {
+                  int c = a.first.compare(b.first);
+                  return c != 0 ? c < 0 : a.second < b.second;
+              });
+              
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    
+    if (unique) {
+        for (size_t i = 0; i < keys.size(); i++) {
+            if (keys[i].first.isNull()) continue;
+            if ((i > 0 && keys[i].first.compare(keys[i - 1].first) == 0) ||
+                entries.count(keys[i].first)) {
+                error = "duplicate key '" + keys[i].first.toString() + "' violates unique index " + name;
+                return false;
+            }
+        }
+    }
+    
+    // Sorted input lets every insertion use the end hint, so building an
+    // empty index is linear instead of O(n log n) rebalancing work.
+    for (auto& [key, tupleId] : keys) {
+        entries.emplace_hint(entries.end(), std::move(key), tupleId);
+    }
+    return true;
+}
+
+} // namespace hybriddb
@@ -0,0 +1,1446 @@
+#include "../include/hybriddb.h"
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+#include <sstream>
+#include <iomanip>
+#ifndef PLATFORM_WINDOWS
+#include <sys/stat.h>
+#endif
+
+namespace hybriddb {
+
+// ============================================================================
+// LSM STORE IMPLEMENTATION
+// ============================================================================
+//
+// Files per table, under lsm_<id>/:
+//   MANIFEST       codec, next key, next file number, oldest live log and the
+//                  runs of every level; replaced whole (write + rename)
+//   log_N.log      entries of the memtable that owns log N, in write order
+//   run_N.run      data blocks, bloom filter, block index, 40-byte footer
+//
+// An entry is uint64 key, uint8 flags, uint32 length and, for rows, the
+// serialized tuple. Blocks are uint8 codec, uint32 raw length, then the
+// entries, LZ4-compressed when the table asks for it and it pays off.
+//
+// Each key has one row entry, written when the row is inserted, and any
+// number of later marks. Newer entries sit in newer memtables, newer level 0
+// runs or shallower levels, so folding a key's entries newest first gives the
+// row with the newest mark's deleted flag.
+
+static const char LSM_MANIFEST_MAGIC[4] = {'H', 'D', 'B', 'L'};
+static const char LSM_RUN_MAGIC[4] = {'H', 'D', 'B', 'R'};
+static const size_t LSM_ENTRY_HEADER = 13;
+static const size_t LSM_BLOCK_HEADER = 5;
+static const size_t LSM_FOOTER = 40;
+static const size_t LSM_INDEX_ENTRY = 28;
+static const size_t LSM_BLOCK_BYTES = 4096;
+static const uint64_t LSM_RUN_BYTES = 8 * 1024 * 1024;
+static const size_t LSM_L0_RUNS = 4;                   // level 0 runs that trigger a compaction
+static const size_t LSM_MAX_IMMUTABLES = 2;            // writers stall beyond this
+static const uint64_t LSM_LEVEL1_BYTES = 32 * 1024 * 1024;
+static const uint64_t LSM_LEVEL_RATIO = 10;
+static const size_t LSM_MAX_LEVELS = 7;
+static const size_t LSM_BLOOM_BITS_PER_KEY = 10;
+static const uint8_t LSM_BLOOM_PROBES = 7;
+static const int LSM_SKIPLIST_HEIGHT = 12;
+static const size_t LSM_ARENA_BLOCK = 256 * 1024;
+
+// Entry flags
+static const uint8_t LSM_HAS_ROW = 1;       // carries the row; marks do not
+static const uint8_t LSM_DELETED = 2;
+
+namespace {
+
+struct Entry {
+    uint64_t key;
+    uint8_t flags;
+    std::vector<uint8_t> record;
+};
+
+// Folds an older entry of the same key into a newer one. The newest mark
+// decides the deleted flag; the row comes from whichever entry carries it.
+inline void foldOlder(Entry& entry, uint8_t flags, const uint8_t* record, uint32_t length) {
+    if ((entry.flags & LSM_HAS_ROW) || !(flags & LSM_HAS_ROW)) return;
+    entry.flags = LSM_HAS_ROW | (entry.flags & LSM_DELETED);
+    entry.record.assign(record, record + length);
+}
+
+inline void putEntry(std::vector<uint8_t>& out, uint64_t key, uint8_t flags,
+                     const uint8_t* record, uint32_t length) {
+    size_t at = out.size();
+    out.resize(at + LSM_ENTRY_HEADER + length);
+    memcpy(&out[at], &key, 8);
+    out[at + 8] = flags;
+    memcpy(&out[at + 9], &length, 4);
+    if (length) memcpy(&out[at + LSM_ENTRY_HEADER], record, length);
+}
+
+// Returns the entry's total size, 0 if it runs past the end
+inline size_t getEntry(const uint8_t* p, size_t remaining, uint64_t& key, uint8_t& flags,
+                       const uint8_t*& record, uint32_t& length) {
+    if (remaining < LSM_ENTRY_HEADER) return 0;
+    memcpy(&key, p, 8);
+    flags = p[8];
+    memcpy(&length, p + 9, 4);
+    if (length > remaining - LSM_ENTRY_HEADER) return 0;
+    record = p + LSM_ENTRY_HEADER;
+    return LSM_ENTRY_HEADER + length;
+}
+
+inline uint64_t bloomHash(uint64_t key) {
+    key += 0x9E3779B97F4A7C15ULL;
+    key = (key ^ (key >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    key = (key ^ (key >> 27)) * 0x94D049BB133111EBULL;
+    return key ^ (key >> 31);
+}
+
+// Double hashing: probe i tests bit h1 + i * h2
+inline bool bloomProbe(std::vector<uint8_t>& bits, uint8_t probes, uint64_t key, bool set) {
+    uint64_t total = bits.size() * 8;
+    uint64_t h = bloomHash(key);
+    uint64_t delta = (h >> 33) | 1;
+    for (uint8_t i = 0; i < probes; i++) {
+        uint64_t bit = h % total;
+        if (set) bits[bit / 8] |= 1 << (bit % 8);
+        else if (!(bits[bit / 8] & (1 << (bit % 8)))) return false;
+        h += delta;
+    }
+    return true;
+}
+
+void removeDirectory(const std::string& directory) {
+#ifdef PLATFORM_WINDOWS
+    RemoveDirectoryA(directory.c_str());
+#else
+    rmdir(directory.c_str());
+#endif
+}
+
+bool fileExists(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    return static_cast<bool>(file);
+}
+
+} // namespace
+
+// ----------------------------------------------------------------------------
+// Memtable
+// ----------------------------------------------------------------------------
+
+// Skiplist ordered by key, newest entry first among equal keys. One writer at
+// a time (Table::writeMutex); readers walk it without locks, which is safe
+// because a node is fully built before the release store that links it in,
+// and nodes are never unlinked or freed before the memtable itself.
+struct LSMStore::MemTable {
+    struct Node {
+        uint64_t key;
+        const uint8_t* record;
+        uint32_t length;
+        uint8_t flags;
+        std::atomic<Node*>* next;       // one per level of the node's height
+    };
+    
+    std::vector<std::unique_ptr<uint8_t[]>> arena;
+    size_t arenaUsed;
+    size_t arenaCapacity;
+    std::atomic<size_t> bytes;
+    Node* head;
+    uint64_t logNumber;
+    uint32_t seed;
+    
+    explicit MemTable(uint64_t log)
+        : arenaUsed(0), arenaCapacity(0), bytes(0), logNumber(log),
+          seed(0x9E3779B9u ^ static_cast<uint32_t>(log)) {
+        head = newNode(0, LSM_SKIPLIST_HEIGHT, 0, nullptr, 0);
+    }
+    
+    uint8_t* allocate(size_t size) {
+        size = (size + 7) & ~static_cast<size_t>(7);
+        if (arenaUsed + size > arenaCapacity) {
+            arenaCapacity = std::max(size, LSM_ARENA_BLOCK);
+            arena.emplace_back(new uint8_t[arenaCapacity]);
+            arenaUsed = 0;
+        }
+        uint8_t* p = arena.back().get() + arenaUsed;
+        arenaUsed += size;
+        bytes.fetch_add(size, std::memory_order_relaxed);
+        return p;
+    }
+    
+    Node* newNode(uint64_t key, int height, uint8_t flags, const uint8_t* record, uint32_t length) {
+        size_t links = height * sizeof(std::atomic<Node*>);
+        uint8_t* memory = allocate(sizeof(Node) + links + length);
+        Node* node = new (memory) Node;
+        node->key = key;
+        node->flags = flags;
+        node->length = length;
+        node->next = reinterpret_cast<std::atomic<Node*>*>(memory + sizeof(Node));
+        for (int l = 0; l < height; l++) new (&node->next[l]) std::atomic<Node*>(nullptr);
+        
+        uint8_t* copy = memory + sizeof(Node) + links;
+        if (length) memcpy(copy, record, length);
+        node->record = copy;
+        return node;
+    }
+    
+    int randomHeight() {
+        int height = 1;
+        while (height < LSM_SKIPLIST_HEIGHT) {
+            seed ^= seed << 13;
+            seed ^= seed >> 17;
+            seed ^= seed << 5;
+            if (seed & 3) break;
+            height++;
+        }
+        return height;
+    }
+    
+    void add(uint64_t key, uint8_t flags, const uint8_t* record, uint32_t length) {
+        Node* prev[LSM_SKIPLIST_HEIGHT];
+        Node* x = head;
+        for (int l = LSM_SKIPLIST_HEIGHT - 1; l >= 0; l--) {
+            Node* next;
+            while ((next = x->next[l].load(std::memory_order_acquire)) && next->key < key) x = next;
+            prev[l] = x;
+        }
+        
+        int height = randomHeight();
+        Node* node = newNode(key, height, flags, record, length);
+        for (int l = 0; l < height; l++) {
+            node->next[l].store(prev[l]->next[l].load(std::memory_order_relaxed), std::memory_order_relaxed);
+            prev[l]->next[l].store(node, std::memory_order_release);
+        }
+    }
+    
+    // First node with a key >= key, which is that key's newest entry
+    Node* seek(uint64_t key) const {
+        Node* x = head;
+        for (int l = LSM_SKIPLIST_HEIGHT - 1; l >= 0; l--) {
+            Node* next;
+            while ((next = x->next[l].load(std::memory_order_acquire)) && next->key < key) x = next;
+        }
+        return x->next[0].load(std::memory_order_acquire);
+    }
+    
+    bool empty() const { return head->next[0].load(std::memory_order_acquire) == nullptr; }
+};
+
+// ----------------------------------------------------------------------------
+// Runs
+// ----------------------------------------------------------------------------
+
+struct LSMStore::Run {
+    struct BlockHandle {
+        uint64_t firstKey;
+        uint64_t lastKey;
+        uint64_t offset;
+        uint32_t length;
+    };
+    
+    uint64_t number;
+    std::string path;
+    uint64_t size;
+    uint64_t minKey;
+    uint64_t maxKey;
+    uint64_t entries;
+    std::vector<BlockHandle> blocks;
+    std::vector<uint8_t> bloom;
+    uint8_t probes;
+    
+    // The last block read, so point reads into the same block skip the file
+    std::mutex fileMutex;
+    std::ifstream file;
+    size_t cachedIndex;
+    std::shared_ptr<const std::vector<uint8_t>> cached;
+    
+    // Set once no version refers to the run; the file goes with the last reader
+    std::atomic<bool> obsolete;
+    
+    Run() : number(0), size(0), minKey(0), maxKey(0), entries(0), probes(0),
+            cachedIndex(SIZE_MAX), obsolete(false) {}
+            
+    ~Run() {
+        if (obsolete) {
+            file.close();
+            remove(path.c_str());
+        }
+    }
+    
+    bool mayContain(uint64_t key) {
+        return !bloom.empty() && bloomProbe(bloom, probes, key, false);
+    }
+    
+    // First block whose last key is >= key
+    size_t findBlock(uint64_t key) const {
+        size_t lo = 0, hi = blocks.size();
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            if (blocks[mid].lastKey < key) lo = mid + 1;
+            else hi = mid;
+        }
+        return lo;
+    }
+    
+    std::shared_ptr<const std::vector<uint8_t>> readBlock(size_t index) {
+        std::lock_guard<std::mutex> lock(fileMutex);
+        if (index == cachedIndex) return cached;
+        
+        const BlockHandle& handle = blocks[index];
+        std::vector<uint8_t> stored(handle.length);
+        file.clear();
+        file.seekg(handle.offset);
+        file.read(reinterpret_cast<char*>(stored.data()), stored.size());
+        if (!file || stored.size() < LSM_BLOCK_HEADER) return nullptr;
+        
+        uint32_t rawLength;
+        memcpy(&rawLength, stored.data() + 1, 4);
+        auto data = std::make_shared<std::vector<uint8_t>>();
+        if (static_cast<PageCompression>(stored[0]) == PageCompression::LZ4) {
+            data->resize(rawLength);
+            if (!LZ4Codec::decompress(stored.data() + LSM_BLOCK_HEADER, stored.size() - LSM_BLOCK_HEADER,
+                                      data->data(), rawLength)) {
+                return nullptr;
+            }
+        } else {
+            if (rawLength != stored.size() - LSM_BLOCK_HEADER) return nullptr;
+            data->assign(stored.begin() + LSM_BLOCK_HEADER, stored.end());
+        }
+        
+        cachedIndex = index;
+        cached = data;
+        return cached;
+    }
+    
+    // Copies out the key's entry, if the run has one
+    bool get(uint64_t key, uint8_t& flags, std::vector<uint8_t>& record, bool& error) {
+        size_t index = findBlock(key);
+        if (index >= blocks.size() || blocks[index].firstKey > key) return false;
+        
+        auto data = readBlock(index);
+        if (!data) {
+            error = true;
+            return false;
+        }
+        size_t offset = 0;
+        while (offset < data->size()) {
+            uint64_t entryKey;
+            const uint8_t* bytes;
+            uint32_t length;
+            size_t size = getEntry(data->data() + offset, data->size() - offset, entryKey, flags, bytes, length);
+            if (size == 0 || entryKey > key) break;
+            if (entryKey == key) {
+                record.assign(bytes, bytes + length);
+                return true;
+            }
+            offset += size;
+        }
+        return false;
+    }
+    
+    // Loads the footer, block index and bloom filter
+    static std::shared_ptr<Run> open(const std::string& path, uint64_t number) {
+        auto run = std::make_shared<Run>();
+        run->number = number;
+        run->path = path;
+        run->file.open(path, std::ios::binary);
+        if (!run->file) return nullptr;
+        
+        run->file.seekg(0, std::ios::end);
+        run->size = run->file.tellg();
+        if (run->size < LSM_FOOTER) return nullptr;
+        
+        uint8_t footer[LSM_FOOTER];
+        run->file.seekg(run->size - LSM_FOOTER);
+        run->file.read(reinterpret_cast<char*>(footer), LSM_FOOTER);
+        if (!run->file || memcmp(footer + 36, LSM_RUN_MAGIC, sizeof(LSM_RUN_MAGIC)) != 0) return nullptr;
+        
+        uint64_t indexOffset, bloomOffset;
+        uint32_t blockCount, bloomBytes;
+        memcpy(&indexOffset, footer, 8);
+        memcpy(&bloomOffset, footer + 8, 8);
+        memcpy(&run->entries, footer + 16, 8);
+        memcpy(&blockCount, footer + 24, 4);
+        memcpy(&bloomBytes, footer + 28, 4);
+        run->probes = footer[32];
+        if (bloomOffset + bloomBytes > indexOffset ||
+            indexOffset + static_cast<uint64_t>(blockCount) * LSM_INDEX_ENTRY > run->size - LSM_FOOTER) {
+            return nullptr;
+        }
+        
+        run->bloom.resize(bloomBytes);
+        run->file.seekg(bloomOffset);
+        run->file.read(reinterpret_cast<char*>(run->bloom.data()), bloomBytes);
+        
+        std::vector<uint8_t> index(static_cast<size_t>(blockCount) * LSM_INDEX_ENTRY);
+        run->file.read(reinterpret_cast<char*>(index.data()), index.size());
+        if (!run->file) return nullptr;
+        
+        for (uint32_t b = 0; b < blockCount; b++) {
+            const uint8_t* p = index.data() + b * LSM_INDEX_ENTRY;
+            BlockHandle handle;
+            memcpy(&handle.firstKey, p, 8);
+            memcpy(&handle.lastKey, p + 8, 8);
+            memcpy(&handle.offset, p + 16, 8);
+            memcpy(&handle.length, p + 24, 4);
+            run->blocks.push_back(handle);
+        }
+        if (!run->blocks.empty()) {
+            run->minKey = run->blocks.front().firstKey;
+            run->maxKey = run->blocks.back().lastKey;
+        }
+        return run;
+    }
+};
+
+// ----------------------------------------------------------------------------
+// Merged walks
+// ----------------------------------------------------------------------------
+
+// Walks memtables and runs together in key order and folds each key's
+// entries into one. Sources are added newest first.
+class LSMStore::Cursor {
+private:
+    struct Source {
+        std::shared_ptr<MemTable> memtable;
+        MemTable::Node* node;
+        Entry folded;                               // memtables: the key's nodes folded together
+        
+        std::vector<std::shared_ptr<Run>> runs;     // disjoint, in key order
+        size_t run;
+        size_t block;
+        std::shared_ptr<const std::vector<uint8_t>> data;
+        size_t offset;
+        
+        bool valid;
+        uint64_t key;
+        uint8_t flags;
+        const uint8_t* record;
+        uint32_t length;
+    };
+    
+    std::vector<Source> sources;
+    Entry current;
+    bool positioned;
+    bool failed;
+    
+    void loadNode(Source& s) {
+        MemTable::Node* node = s.node;
+        if (!node) {
+            s.valid = false;
+            return;
+        }
+        s.folded.key = node->key;
+        s.folded.flags = node->flags;
+        s.folded.record.assign(node->record, node->record + node->length);
+        for (auto* n = node->next[0].load(std::memory_order_acquire); n && n->key == node->key;
+             n = n->next[0].load(std::memory_order_acquire)) {
+            foldOlder(s.folded, n->flags, n->record, n->length);
+        }
+        s.valid = true;
+        s.key = s.folded.key;
+        s.flags = s.folded.flags;
+        s.record = s.folded.record.data();
+        s.length = s.folded.record.size();
+    }
+    
+    // Reads the entry at the source's offset, moving on to later blocks and runs
+    void loadEntry(Source& s) {
+        while (true) {
+            if (s.data && s.offset < s.data->size()) {
+                size_t size = getEntry(s.data->data() + s.offset, s.data->size() - s.offset,
+                                       s.key, s.flags, s.record, s.length);
+                if (size == 0) break;
+                s.valid = true;
+                return;
+            }
+            s.data = nullptr;
+            s.offset = 0;
+            
+            while (s.run < s.runs.size() && s.block >= s.runs[s.run]->blocks.size()) {
+                s.run++;
+                s.block = 0;
+            }
+            if (s.run >= s.runs.size()) {
+                s.valid = false;
+                return;
+            }
+            s.data = s.runs[s.run]->readBlock(s.block++);
+            if (!s.data) break;
+        }
+        failed = true;
+        s.valid = false;
+    }
+    
+    void advance(Source& s) {
+        if (s.memtable) {
+            uint64_t key = s.node->key;
+            do {
+                s.node = s.node->next[0].load(std::memory_order_acquire);
+            } while (s.node && s.node->key == key);
+            loadNode(s);
+        } else {
+            s.offset += LSM_ENTRY_HEADER + s.length;
+            loadEntry(s);
+        }
+    }
+    
+    void settle() {
+        positioned = false;
+        uint64_t key = 0;
+        for (const auto& s : sources) {
+            if (s.valid && (!positioned || s.key < key)) {
+                key = s.key;
+                positioned = true;
+            }
+        }
+        if (!positioned) return;
+        
+        bool first = true;
+        for (auto& s : sources) {
+            if (!s.valid || s.key != key) continue;
+            if (first) {
+                current.key = key;
+                current.flags = s.flags;
+                current.record.assign(s.record, s.record + s.length);
+                first = false;
+            } else {
+                foldOlder(current, s.flags, s.record, s.length);
+            }
+            advance(s);
+        }
+    }
+    
+public:
+    Cursor() : positioned(false), failed(false) {}
+    
+    void addMemTable(const std::shared_ptr<MemTable>& memtable) {
+        Source s{};
+        s.memtable = memtable;
+        sources.push_back(std::move(s));
+    }
+    
+    void addRuns(const std::vector<std::shared_ptr<Run>>& runs) {
+        if (runs.empty()) return;
+        Source s{};
+        s.runs = runs;
+        sources.push_back(std::move(s));
+    }
+    
+    void seek(uint64_t key) {
+        for (auto& s : sources) {
+            if (s.memtable) {
+                s.node = s.memtable->seek(key);
+                loadNode(s);
+                continue;
+            }
+            
+            s.run = 0;
+            while (s.run < s.runs.size() && s.runs[s.run]->maxKey < key) s.run++;
+            s.block = s.run < s.runs.size() ? s.runs[s.run]->findBlock(key) : 0;
+            s.data = nullptr;
+            s.offset = 0;
+            loadEntry(s);
+            while (s.valid && s.key < key) {
+                s.offset += LSM_ENTRY_HEADER + s.length;
+                loadEntry(s);
+            }
+        }
+        settle();
+    }
+    
+    bool valid() const { return positioned; }
+    bool ok() const { return !failed; }
+    Entry& entry() { return current; }
+    void next() { settle(); }
+};
+
+// ----------------------------------------------------------------------------
+// Store
+// ----------------------------------------------------------------------------
+
+LSMStore::LSMStore(const std::string& dataDir)
+    : dataDirectory(dataDir), runningJobs(0), stopping(false),
+      rateTokens(0), rateRefill(std::chrono::steady_clock::now()),
+      bytesWritten(0), flushes(0), bytesFlushed(0), compactions(0), trivialMoves(0),
+      bytesCompacted(0), writeStalls(0), bloomChecks(0), bloomSkips(0) {
+    for (int i = 0; i < LSM_BACKGROUND_THREADS; i++) {
+        workers.emplace_back(&LSMStore::worker, this);
+    }
+}
+
+// Queued jobs are dropped; whatever they would have flushed is still in the logs
+LSMStore::~LSMStore() {
+    {
+        std::lock_guard<std::mutex> lock(jobMutex);
+        stopping = true;
+    }
+    jobReady.notify_all();
+    for (auto& thread : workers) {
+        if (thread.joinable()) thread.join();
+    }
+    sync();
+}
+
+std::string LSMStore::tableDirectory(uint32_t tableId) const {
+    std::ostringstream path;
+    path << dataDirectory << "/lsm_" << std::setfill('0') << std::setw(6) << tableId;
+    return path.str();
+}
+
+std::string LSMStore::filePath(const Table& table, const char* prefix, uint64_t number) const {
+    std::ostringstream path;
+    path << table.directory << "/" << prefix << "_" << std::setfill('0') << std::setw(6) << number
+         << (strcmp(prefix, "log") == 0 ? ".log" : ".run");
+    return path.str();
+}
+
+bool LSMStore::createTable(uint32_t tableId, PageCompression codec) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        
+        Table fresh;
+        fresh.tableId = tableId;
+        fresh.directory = tableDirectory(tableId);
+        fresh.codec = codec;
+        fresh.nextKey = 0;
+        fresh.nextFile = 1;
+#ifdef PLATFORM_WINDOWS
+        CreateDirectoryA(fresh.directory.c_str(), NULL);
+#else
+        mkdir(fresh.directory.c_str(), 0755);
+#endif
+        
+        Version empty;
+        empty.levels.resize(LSM_MAX_LEVELS);
+        if (!writeManifestLocked(fresh, empty)) return false;
+        tables.erase(tableId);
+    }
+    return openTable(tableId) != nullptr;
+}
+
+bool LSMStore::dropTable(uint32_t tableId) {
+    auto table = openTable(tableId);
+    if (!table) return false;
+    
+    uint64_t files;
+    {
+        std::unique_lock<std::mutex> lock(table->mutex);
+        table->dropped = true;
+        table->changed.wait(lock, [&]() { return !table->flushing && !table->compacting; });
+        files = table->nextFile;
+        for (const auto& level : table->version->levels) {
+            for (const auto& run : level) run->obsolete = true;
+        }
+        table->changed.notify_all();
+    }
+    {
+        std::lock_guard<std::mutex> lock(table->writeMutex);
+        table->log.close();
+    }
+    
+    for (uint64_t n = 1; n < files; n++) {
+        remove(filePath(*table, "log", n).c_str());
+        remove(filePath(*table, "run", n).c_str());
+    }
+    remove((table->directory + "/MANIFEST").c_str());
+    removeDirectory(table->directory);
+    
+    std::lock_guard<std::mutex> lock(mutex);
+    tables.erase(tableId);
+    return true;
+}
+
+bool LSMStore::isLSMTable(uint32_t tableId) {
+    return openTable(tableId) != nullptr;
+}
+
+// Loads a table's runs and replays its logs on first use
+std::shared_ptr<LSMStore::Table> LSMStore::openTable(uint32_t tableId) {
+    std::lock_guard<std::mutex> lock(mutex);
+    
+    auto it = tables.find(tableId);
+    if (it != tables.end()) return it->second;
+    
+    auto& slot = tables[tableId];
+    std::string directory = tableDirectory(tableId);
+    if (!fileExists(directory + "/MANIFEST")) return nullptr;
+    
+    auto table = std::make_shared<Table>();
+    table->tableId = tableId;
+    table->directory = directory;
+    table->flushing = false;
+    table->compacting = false;
+    table->dropped = false;
+    table->compactPointers.assign(LSM_MAX_LEVELS, 0);
+    if (!recover(*table)) {
+        std::cerr << "Could not open LSM table " << directory << "\n";
+        return nullptr;
+    }
+    
+    slot = table;
+    std::lock_guard<std::mutex> tableLock(table->mutex);
+    scheduleLocked(table);
+    return table;
+}
+
+bool LSMStore::recover(Table& table) {
+    std::ifstream manifest(table.directory + "/MANIFEST", std::ios::binary);
+    std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(manifest)), std::istreambuf_iterator<char>());
+    if (bytes.size() < 33 || memcmp(bytes.data(), LSM_MANIFEST_MAGIC, sizeof(LSM_MANIFEST_MAGIC)) != 0) {
+        return false;
+    }
+    
+    uint64_t logNumber;
+    uint32_t runCount;
+    table.codec = static_cast<PageCompression>(bytes[4]);
+    memcpy(&table.nextKey, &bytes[5], 8);
+    memcpy(&table.nextFile, &bytes[13], 8);
+    memcpy(&logNumber, &bytes[21], 8);
+    memcpy(&runCount, &bytes[29], 4);
+    if (bytes.size() < 33 + static_cast<size_t>(runCount) * 9) return false;
+    
+    Version version;
+    version.levels.resize(LSM_MAX_LEVELS);
+    for (uint32_t i = 0; i < runCount; i++) {
+        const uint8_t* p = &bytes[33 + i * 9];
+        uint64_t number;
+        memcpy(&number, p + 1, 8);
+        if (p[0] >= LSM_MAX_LEVELS) return false;
+        auto run = Run::open(filePath(table, "run", number), number);
+        if (!run) return false;
+        if (run->entries) table.nextKey = std::max(table.nextKey, run->maxKey + 1);
+        version.levels[p[0]].push_back(run);
+    }
+    
+    // Logs newer than the manifest's oldest live one hold memtables that
+    // never reached a run. A torn entry at the end of a log is dropped.
+    auto replayed = std::make_shared<MemTable>(0);
+    std::vector<uint64_t> logs;
+    for (uint64_t n = logNumber; n < table.nextFile; n++) {
+        std::ifstream log(filePath(table, "log", n), std::ios::binary);
+        if (!log) continue;
+        logs.push_back(n);
+        
+        std::vector<uint8_t> data((std::istreambuf_iterator<char>(log)), std::istreambuf_iterator<char>());
+        size_t offset = 0;
+        while (offset < data.size()) {
+            uint64_t key;
+            uint8_t flags;
+            const uint8_t* record;
+            uint32_t length;
+            size_t size = getEntry(data.data() + offset, data.size() - offset, key, flags, record, length);
+            if (size == 0) break;
+            replayed->add(key, flags, record, length);
+            table.nextKey = std::max(table.nextKey, key + 1);
+            offset += size;
+        }
+    }
+    
+    if (!replayed->empty()) {
+        MemTable::Node* node = replayed->seek(0);
+        auto source = [&](uint64_t& key, uint8_t& flags, std::vector<uint8_t>& record) {
+            if (!node) return false;
+            Entry entry{node->key, node->flags, std::vector<uint8_t>(node->record, node->record + node->length)};
+            for (node = node->next[0].load(); node && node->key == entry.key; node = node->next[0].load()) {
+                foldOlder(entry, node->flags, node->record, node->length);
+            }
+            key = entry.key;
+            flags = entry.flags;
+            record.swap(entry.record);
+            return true;
+        };
+        auto run = writeRun(table, source, table.nextFile++, false);
+        if (!run) return false;
+        version.levels[0].push_back(run);
+    }
+    
+    table.memtable = std::make_shared<MemTable>(table.nextFile++);
+    std::lock_guard<std::mutex> lock(table.mutex);
+    if (!openLogLocked(table) || !writeManifestLocked(table, version)) return false;
+    table.version = std::make_shared<const Version>(std::move(version));
+    for (uint64_t n : logs) remove(filePath(table, "log", n).c_str());
+    return true;
+}
+
+// MANIFEST: "HDBL", uint8 codec, uint64 next key, uint64 next file, uint64
+// oldest live log, uint32 run count, then per run uint8 level + uint64 number
+bool LSMStore::writeManifestLocked(Table& table, const Version& version) {
+    uint64_t logNumber = table.nextFile;
+    if (!table.immutables.empty()) logNumber = table.immutables.front()->logNumber;
+    else if (table.memtable) logNumber = table.memtable->logNumber;
+    
+    std::vector<uint8_t> bytes(LSM_MANIFEST_MAGIC, LSM_MANIFEST_MAGIC + sizeof(LSM_MANIFEST_MAGIC));
+    bytes.push_back(static_cast<uint8_t>(table.codec));
+    bytes.resize(33);
+    uint32_t runCount = 0;
+    for (const auto& level : version.levels) runCount += level.size();
+    memcpy(&bytes[5], &table.nextKey, 8);
+    memcpy(&bytes[13], &table.nextFile, 8);
+    memcpy(&bytes[21], &logNumber, 8);
+    memcpy(&bytes[29], &runCount, 4);
+    for (size_t l = 0; l < version.levels.size(); l++) {
+        for (const auto& run : version.levels[l]) {
+            bytes.push_back(static_cast<uint8_t>(l));
+            size_t at = bytes.size();
+            bytes.resize(at + 8);
+            memcpy(&bytes[at], &run->number, 8);
+        }
+    }
+    
+    std::string path = table.directory + "/MANIFEST";
+    std::ofstream file(path + ".tmp", std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+    file.close();
+    if (!file) return false;
+#ifdef PLATFORM_WINDOWS
+    remove(path.c_str());
+#endif
+    return rename((path + ".tmp").c_str(), path.c_str()) == 0;
+}
+
+
+bool LSMStore::openLogLocked(Table& table) {
+    table.log.close();
+    table.log.clear();
+    table.log.open(filePath(table, "log", table.memtable->logNumber), std::ios::binary | std::ios::trunc);
+    return static_cast<bool>(table.log);
+}
+
+// Level 0 is scored by run count, deeper levels by size against their target
+int LSMStore::pickLevel(const Version& version) const {
+    int best = -1;
+    double bestScore = 1.0;
+    uint64_t target = LSM_LEVEL1_BYTES;
+    for (size_t l = 0; l + 1 < version.levels.size(); l++) {
+        double score;
+        if (l == 0) {
+            score = static_cast<double>(version.levels[0].size()) / LSM_L0_RUNS;
+        } else {
+            uint64_t bytes = 0;
+            for (const auto& run : version.levels[l]) bytes += run->size;
+            score = static_cast<double>(bytes) / target;
+            target *= LSM_LEVEL_RATIO;
+        }
+        if (score >= bestScore) {
+            best = static_cast<int>(l);
+            bestScore = score;
+        }
+    }
+    return best;
+}
+
+void LSMStore::scheduleLocked(const std::shared_ptr<Table>& table) {
+    if (table->dropped) return;
+    
+    std::lock_guard<std::mutex> lock(jobMutex);
+    if (!table->flushing && !table->immutables.empty()) {
+        table->flushing = true;
+        jobs.push_back([this, table]() { flushJob(table); });
+        jobReady.notify_one();
+    }
+    if (!table->compacting && pickLevel(*table->version) >= 0) {
+        table->compacting = true;
+        jobs.push_back([this, table]() { compactJob(table); });
+        jobReady.notify_one();
+    }
+}
+
+void LSMStore::worker() {
+    while (true) {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(jobMutex);
+            jobReady.wait(lock, [this]() { return stopping || !jobs.empty(); });
+            if (stopping) return;
+            job = std::move(jobs.front());
+            jobs.pop_front();
+            runningJobs++;
+        }
+        
+        job();
+        
+        std::lock_guard<std::mutex> lock(jobMutex);
+        runningJobs--;
+        if (jobs.empty() && runningJobs == 0) jobsDone.notify_all();
+    }
+}
+
+void LSMStore::waitIdle() {
+    std::unique_lock<std::mutex> lock(jobMutex);
+    jobsDone.wait(lock, [this]() { return stopping || (jobs.empty() && runningJobs == 0); });
+}
+
+// Sleeps off whatever a compaction writes beyond LSM_COMPACTION_MB_PER_SEC,
+// allowing bursts of up to one second's budget
+void LSMStore::throttle(size_t bytes) {
+    const double rate = LSM_COMPACTION_MB_PER_SEC * 1024.0 * 1024.0;
+    double debt;
+    {
+        std::lock_guard<std::mutex> lock(rateMutex);
+        auto now = std::chrono::steady_clock::now();
+        double elapsed = std::chrono::duration<double>(now - rateRefill).count();
+        rateRefill = now;
+        rateTokens = std::min(rate, rateTokens + elapsed * rate) - bytes;
+        debt = -rateTokens;
+    }
+    if (debt > 0) std::this_thread::sleep_for(std::chrono::duration<double>(debt / rate));
+}
+
+// Writes the entries source produces, in key order, as run file number
+std::shared_ptr<LSMStore::Run> LSMStore::writeRun(Table& table,
+                                                  const std::function<bool(uint64_t&, uint8_t&, std::vector<uint8_t>&)>& source,
+                                                  uint64_t number, bool throttled) {
+    std::string path = filePath(table, "run", number);
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) return nullptr;
+    
+    std::vector<uint8_t> block, stored, index;
+    std::vector<uint64_t> keys;
+    uint64_t offset = 0;
+    uint64_t firstKey = 0, lastKey = 0;
+    
+    auto finishBlock = [&]() {
+        stored.resize(LSM_BLOCK_HEADER + block.size());
+        stored[0] = static_cast<uint8_t>(PageCompression::NONE);
+        uint32_t rawLength = block.size();
+        memcpy(&stored[1], &rawLength, 4);
+        
+        size_t packed = 0;
+        if (table.codec == PageCompression::LZ4) {
+            packed = LZ4Codec::compress(block.data(), block.size(), stored.data() + LSM_BLOCK_HEADER, block.size() - 1);
+        }
+        if (packed) {
+            stored[0] = static_cast<uint8_t>(PageCompression::LZ4);
+            stored.resize(LSM_BLOCK_HEADER + packed);
+        } else {
+            memcpy(stored.data() + LSM_BLOCK_HEADER, block.data(), block.size());
+        }
+        
+        if (throttled) throttle(stored.size());
+        out.write(reinterpret_cast<const char*>(stored.data()), stored.size());
+        
+        uint32_t length = stored.size();
+        size_t at = index.size();
+        index.resize(at + LSM_INDEX_ENTRY);
+        memcpy(&index[at], &firstKey, 8);
+        memcpy(&index[at + 8], &lastKey, 8);
+        memcpy(&index[at + 16], &offset, 8);
+        memcpy(&index[at + 24], &length, 4);
+        offset += length;
+        block.clear();
+    };
+    
+    uint64_t key;
+    uint8_t flags;
+    std::vector<uint8_t> record;
+    while (source(key, flags, record)) {
+        if (block.empty()) firstKey = key;
+        lastKey = key;
+        putEntry(block, key, flags, record.data(), record.size());
+        keys.push_back(key);
+        if (block.size() >= LSM_BLOCK_BYTES) finishBlock();
+    }
+    if (!block.empty()) finishBlock();
+    
+    std::vector<uint8_t> bloom((keys.size() * LSM_BLOOM_BITS_PER_KEY + 7) / 8);
+    if (!keys.empty()) {
+        for (uint64_t k : keys) bloomProbe(bloom, LSM_BLOOM_PROBES, k, true);
+    }
+    uint64_t bloomOffset = offset;
+    uint64_t indexOffset = bloomOffset + bloom.size();
+    out.write(reinterpret_cast<const char*>(bloom.data()), bloom.size());
+    out.write(reinterpret_cast<const char*>(index.data()), index.size());
+    
+    uint8_t footer[LSM_FOOTER] = {};
+    uint64_t entries = keys.size();
+    uint32_t blockCount = index.size() / LSM_INDEX_ENTRY;
+    uint32_t bloomBytes = bloom.size();
+    memcpy(footer, &indexOffset, 8);
+    memcpy(footer + 8, &bloomOffset, 8);
+    memcpy(footer + 16, &entries, 8);
+    memcpy(footer + 24, &blockCount, 4);
+    memcpy(footer + 28, &bloomBytes, 4);
+    footer[32] = LSM_BLOOM_PROBES;
+    memcpy(footer + 36, LSM_RUN_MAGIC, sizeof(LSM_RUN_MAGIC));
+    out.write(reinterpret_cast<const char*>(footer), LSM_FOOTER);
+    out.close();
+    if (!out) {
+        remove(path.c_str());
+        return nullptr;
+    }
+    
+    auto run = Run::open(path, number);
+    if (!run) remove(path.c_str());
+    return run;
+}
+
+void LSMStore::flushJob(std::shared_ptr<Table> table) {
+    std::shared_ptr<MemTable> memtable;
+    uint64_t number;
+    {
+        std::lock_guard<std::mutex> lock(table->mutex);
+        if (table->dropped || table->immutables.empty()) {
+            table->flushing = false;
+            table->changed.notify_all();
+            return;
+        }
+        memtable = table->immutables.front();
+        number = table->nextFile++;
+    }
+    
+    MemTable::Node* node = memtable->seek(0);
+    auto source = [&](uint64_t& key, uint8_t& flags, std::vector<uint8_t>& record) {
+        if (!node) return false;
+        key = node->key;
+        flags = node->flags;
+        record.assign(node->record, node->record + node->length);
+        Entry entry{key, flags, std::move(record)};
+        for (node = node->next[0].load(std::memory_order_acquire); node && node->key == key;
+             node = node->next[0].load(std::memory_order_acquire)) {
+            foldOlder(entry, node->flags, node->record, node->length);
+        }
+        flags = entry.flags;
+        record.swap(entry.record);
+        return true;
+    };
+    auto run = writeRun(*table, source, number, false);
+    
+    std::lock_guard<std::mutex> lock(table->mutex);
+    table->flushing = false;
+    if (!run) {
+        std::cerr << "LSM flush of table " << table->tableId << " failed\n";
+        table->changed.notify_all();
+        return;
+    }
+    
+    Version version = *table->version;
+    version.levels[0].push_back(run);
+    table->immutables.pop_front();
+    if (table->dropped || !writeManifestLocked(*table, version)) {
+        if (!table->dropped) std::cerr << "LSM manifest write for table " << table->tableId << " failed\n";
+        table->immutables.push_front(memtable);
+        run->obsolete = true;
+        table->changed.notify_all();
+        return;
+    }
+    
+    table->version = std::make_shared<const Version>(std::move(version));
+    remove(filePath(*table, "log", memtable->logNumber).c_str());
+    flushes++;
+    bytesFlushed += run->size;
+    scheduleLocked(table);
+    table->changed.notify_all();
+}
+
+// Merges the picked level's inputs with the overlapping runs one level down.
+// A level 1+ run that overlaps nothing below is moved without rewriting it.
+void LSMStore::compactJob(std::shared_ptr<Table> table) {
+    std::vector<std::shared_ptr<Run>> inputs, overlaps;
+    size_t level;
+    bool bottom = true;
+    bool purge = false;
+    {
+        std::lock_guard<std::mutex> lock(table->mutex);
+        int picked = table->dropped ? -1 : pickLevel(*table->version);
+        if (picked < 0) {
+            table->compacting = false;
+            table->changed.notify_all();
+            return;
+        }
+        level = picked;
+        
+        const auto& levels = table->version->levels;
+        if (level == 0) {
+            inputs = levels[0];
+        } else {
+            // Round robin through the level by key
+            const auto& runs = levels[level];
+            auto it = std::find_if(runs.begin(), runs.end(), [&](const std::shared_ptr<Run>& run) {
+                return run->minKey > table->compactPointers[level];
+            });
+            inputs.push_back(it != runs.end() ? *it : runs.front());
+        }
+        
+        uint64_t lo = UINT64_MAX, hi = 0;
+        for (const auto& run : inputs) {
+            if (!run->entries) continue;
+            lo = std::min(lo, run->minKey);
+            hi = std::max(hi, run->maxKey);
+        }
+        for (const auto& run : levels[level + 1]) {
+            if (run->entries && run->maxKey >= lo && run->minKey <= hi) overlaps.push_back(run);
+        }
+        for (size_t l = level + 2; l < levels.size(); l++) {
+            if (!levels[l].empty()) bottom = false;
+        }
+        table->compactPointers[level] = hi;
+    }
+    
+    // A deleted row can go once no transaction could still roll the delete
+    // back, unless something newer than the inputs mentions its key (an
+    // undelete written by a rollback that finished before the check)
+    std::vector<std::shared_ptr<MemTable>> newerTables;
+    std::vector<std::shared_ptr<Run>> newerRuns;
+    if (bottom) {
+        {
+            std::lock_guard<std::mutex> lock(purgeMutex);
+            purge = purgeCheck && purgeCheck();
+        }
+        if (purge) {
+            std::lock_guard<std::mutex> lock(table->mutex);
+            newerTables.push_back(table->memtable);
+            newerTables.insert(newerTables.end(), table->immutables.begin(), table->immutables.end());
+            const auto& levels = table->version->levels;
+            for (const auto& run : levels[0]) {
+                if (std::find(inputs.begin(), inputs.end(), run) == inputs.end()) newerRuns.push_back(run);
+            }
+            for (size_t l = 1; l < level; l++) newerRuns.insert(newerRuns.end(), levels[l].begin(), levels[l].end());
+        }
+    }
+    auto shadowed = [&](uint64_t key) {
+        for (const auto& memtable : newerTables) {
+            auto* node = memtable->seek(key);
+            if (node && node->key == key) return true;
+        }
+        for (const auto& run : newerRuns) {
+            if (!run->entries || key < run->minKey || key > run->maxKey || !run->mayContain(key)) continue;
+            uint8_t flags;
+            std::vector<uint8_t> record;
+            bool error = false;
+            if (run->get(key, flags, record, error) || error) return true;
+        }
+        return false;
+    };
+    
+    std::vector<std::shared_ptr<Run>> outputs;
+    bool ok = true;
+    bool moved = overlaps.empty() && inputs.size() == 1;
+    if (moved) {
+        outputs = inputs;
+    } else {
+        Cursor cursor;
+        for (auto it = inputs.rbegin(); it != inputs.rend(); ++it) cursor.addRuns({*it});
+        cursor.addRuns(overlaps);
+        cursor.seek(0);
+        
+        // At the bottom there is no older row left for a mark to apply to
+        while (cursor.valid()) {
+            uint64_t number;
+            {
+                std::lock_guard<std::mutex> lock(table->mutex);
+                number = table->nextFile++;
+            }
+            
+            uint64_t emitted = 0;
+            auto source = [&](uint64_t& key, uint8_t& flags, std::vector<uint8_t>& record) {
+                for (; cursor.valid(); cursor.next()) {
+                    Entry& entry = cursor.entry();
+                    if (!(entry.flags & LSM_HAS_ROW) && bottom) continue;
+                    if ((entry.flags & LSM_DELETED) && (entry.flags & LSM_HAS_ROW) && purge &&
+                        !shadowed(entry.key)) {
+                        continue;
+                    }
+                    if (emitted >= LSM_RUN_BYTES) return false;
+                    
+                    key = entry.key;
+                    flags = entry.flags;
+                    record.swap(entry.record);
+                    emitted += LSM_ENTRY_HEADER + record.size();
+                    cursor.next();
+                    return true;
+                }
+                return false;
+            };
+            auto run = writeRun(*table, source, number, true);
+            if (!run || !cursor.ok()) {
+                ok = false;
+                break;
+            }
+            if (run->entries) outputs.push_back(run);
+            else run->obsolete = true;
+        }
+    }
+    
+    std::lock_guard<std::mutex> lock(table->mutex);
+    table->compacting = false;
+    
+    Version version = *table->version;
+    auto drop = [](std::vector<std::shared_ptr<Run>>& runs, const std::vector<std::shared_ptr<Run>>& gone) {
+        runs.erase(std::remove_if(runs.begin(), runs.end(), [&](const std::shared_ptr<Run>& run) {
+            return std::find(gone.begin(), gone.end(), run) != gone.end();
+        }), runs.end());
+    };
+    drop(version.levels[level], inputs);
+    drop(version.levels[level + 1], overlaps);
+    auto& below = version.levels[level + 1];
+    below.insert(below.end(), outputs.begin(), outputs.end());
+    std::sort(below.begin(), below.end(), [](const std::shared_ptr<Run>& a, const std::shared_ptr<Run>& b) {
+        return a->minKey < b->minKey;
+    });
+    
+    if (!ok || table->dropped || !writeManifestLocked(*table, version)) {
+        if (!table->dropped) std::cerr << "LSM compaction of table " << table->tableId << " failed\n";
+        if (!moved) {
+            for (const auto& run : outputs) run->obsolete = true;
+        }
+        table->changed.notify_all();
+        return;
+    }
+    
+    if (moved) {
+        trivialMoves++;
+    } else {
+        for (const auto& run : inputs) run->obsolete = true;
+        for (const auto& run : overlaps) run->obsolete = true;
+        for (const auto& run : outputs) bytesCompacted += run->size;
+        compactions++;
+    }
+    table->version = std::make_shared<const Version>(std::move(version));
+    scheduleLocked(table);
+    table->changed.notify_all();
+}
+
+// Appends one entry to the log and the memtable, first swapping in a fresh
+// memtable when the current one is full
+bool LSMStore::append(const std::shared_ptr<Table>& self, uint64_t key, uint8_t flags,
+                      const uint8_t* record, size_t length) {
+    Table& table = *self;
+    if (table.memtable->bytes.load(std::memory_order_relaxed) >= LSM_MEMTABLE_BYTES) {
+        std::unique_lock<std::mutex> lock(table.mutex);
+        while (table.immutables.size() >= LSM_MAX_IMMUTABLES && !table.dropped) {
+            writeStalls++;
+            if (!table.flushing) scheduleLocked(self);
+            table.changed.wait(lock);
+        }
+        if (table.dropped) return false;
+        
+        table.immutables.push_back(table.memtable);
+        table.memtable = std::make_shared<MemTable>(table.nextFile++);
+        if (!openLogLocked(table)) return false;
+        scheduleLocked(self);
+    }
+    
+    std::vector<uint8_t> entry;
+    putEntry(entry, key, flags, record, length);
+    table.log.write(reinterpret_cast<const char*>(entry.data()), entry.size());
+    table.log.flush();
+    if (!table.log) return false;
+    
+    table.memtable->add(key, flags, record, length);
+    bytesWritten += entry.size();
+    return true;
+}
+
+bool LSMStore::insert(uint32_t tableId, const Tuple& tuple, uint64_t* key) {
+    auto table = openTable(tableId);
+    if (!table) return false;
+    
+    auto record = tuple.serialize();
+    std::lock_guard<std::mutex> lock(table->writeMutex);
+    uint64_t assigned;
+    {
+        std::lock_guard<std::mutex> stateLock(table->mutex);
+        assigned = table->nextKey++;
+    }
+    uint8_t flags = LSM_HAS_ROW | (tuple.deleted ? LSM_DELETED : 0);
+    if (!append(table, assigned, flags, record.data(), record.size())) return false;
+    if (key) *key = assigned;
+    return true;
+}
+
+bool LSMStore::setDeleted(uint32_t tableId, uint64_t key, bool deleted) {
+    auto table = openTable(tableId);
+    if (!table) return false;
+    
+    std::lock_guard<std::mutex> lock(table->writeMutex);
+    {
+        std::lock_guard<std::mutex> stateLock(table->mutex);
+        if (key >= table->nextKey) return false;
+    }
+    return append(table, key, deleted ? LSM_DELETED : 0, nullptr, 0);
+}
+
+bool LSMStore::ingest(uint32_t tableId, const std::vector<Tuple>& rows, uint64_t* firstKey) {
+    auto table = openTable(tableId);
+    if (!table) return false;
+    
+    uint64_t first, number;
+    {
+        std::lock_guard<std::mutex> lock(table->mutex);
+        first = table->nextKey;
+        table->nextKey += rows.size();
+        number = table->nextFile++;
+    }
+    
+    size_t i = 0;
+    uint64_t bytes = 0;
+    auto source = [&](uint64_t& key, uint8_t& flags, std::vector<uint8_t>& record) {
+        if (i >= rows.size()) return false;
+        key = first + i;
+        flags = LSM_HAS_ROW | (rows[i].deleted ? LSM_DELETED : 0);
+        record.clear();
+        rows[i++].serialize(record);
+        bytes += LSM_ENTRY_HEADER + record.size();
+        return true;
+    };
+    auto run = writeRun(*table, source, number, false);
+    if (!run) return false;
+    
+    std::lock_guard<std::mutex> lock(table->mutex);
+    Version version = *table->version;
+    version.levels[0].push_back(run);
+    if (table->dropped || !writeManifestLocked(*table, version)) {
+        run->obsolete = true;
+        return false;
+    }
+    table->version = std::make_shared<const Version>(std::move(version));
+    bytesWritten += bytes;
+    scheduleLocked(table);
+    
+    if (firstKey) *firstKey = first;
+    return true;
+}
+
+// Point read: memtables, then level 0 newest first, then one run per level.
+// Stops at the entry carrying the row, since everything older is deeper.
+bool LSMStore::read(uint32_t tableId, uint64_t key, Tuple& tuple) {
+    auto table = openTable(tableId);
+    if (!table) return false;
+    
+    std::vector<std::shared_ptr<MemTable>> memtables;
+    std::shared_ptr<const Version> version;
+    {
+        std::lock_guard<std::mutex> lock(table->mutex);
+        memtables.push_back(table->memtable);
+        memtables.insert(memtables.end(), table->immutables.rbegin(), table->immutables.rend());
+        version = table->version;
+    }
+    
+    Entry entry{key, 0, {}};
+    bool found = false;
+    auto fold = [&](uint8_t flags, const uint8_t* record, uint32_t length) {
+        if (!found) {
+            entry.flags = flags;
+            entry.record.assign(record, record + length);
+            found = true;
+        } else {
+            foldOlder(entry, flags, record, length);
+        }
+        return (entry.flags & LSM_HAS_ROW) != 0;
+    };
+    
+    for (const auto& memtable : memtables) {
+        for (auto* node = memtable->seek(key); node && node->key == key;
+             node = node->next[0].load(std::memory_order_acquire)) {
+            if (fold(node->flags, node->record, node->length)) break;
+        }
+        if (entry.flags & LSM_HAS_ROW) break;
+    }
+    
+    auto probe = [&](Run& run) {
+        if (!run.entries || key < run.minKey || key > run.maxKey) return false;
+        bloomChecks++;
+        if (!run.mayContain(key)) {
+            bloomSkips++;
+            return false;
+        }
+        uint8_t flags;
+        std::vector<uint8_t> record;
+        bool error = false;
+        return run.get(key, flags, record, error) && fold(flags, record.data(), record.size());
+    };
+    
+    if (!(entry.flags & LSM_HAS_ROW)) {
+        bool done = false;
+        const auto& levels = version->levels;
+        for (auto it = levels[0].rbegin(); it != levels[0].rend() && !done; ++it) done = probe(**it);
+        for (size_t l = 1; l < levels.size() && !done; l++) {
+            const auto& runs = levels[l];
+            auto it = std::lower_bound(runs.begin(), runs.end(), key,
+                                       [](const std::shared_ptr<Run>& run, uint64_t k) { return run->maxKey < k; });
+            if (it != runs.end()) done = probe(**it);
+        }
+    }
+    
+    if (!(entry.flags & LSM_HAS_ROW) || (entry.flags & LSM_DELETED)) return false;
+    tuple = Tuple::deserialize(entry.record.data(), entry.record.size());
+    tuple.deleted = false;
+    return true;
+}
+
+bool LSMStore::scan(uint32_t tableId, uint64_t from, uint64_t limit, size_t maxKeys,
+                    std::vector<std::pair<uint64_t, Tuple>>& out, uint64_t& next) {
+    next = limit;
+    auto table = openTable(tableId);
+    if (!table || from >= limit) return false;
+    
+    Cursor cursor;
+    {
+        std::lock_guard<std::mutex> lock(table->mutex);
+        cursor.addMemTable(table->memtable);
+        for (auto it = table->immutables.rbegin(); it != table->immutables.rend(); ++it) cursor.addMemTable(*it);
+        const auto& levels = table->version->levels;
+        for (auto it = levels[0].rbegin(); it != levels[0].rend(); ++it) cursor.addRuns({*it});
+        for (size_t l = 1; l < levels.size(); l++) cursor.addRuns(levels[l]);
+    }
+    
+    cursor.seek(from);
+    for (size_t examined = 0; cursor.valid() && cursor.entry().key < limit; cursor.next()) {
+        if (examined++ == maxKeys) {
+            next = cursor.entry().key;
+            return true;
+        }
+        
+        const Entry& entry = cursor.entry();
+        if ((entry.flags & LSM_HAS_ROW) && !(entry.flags & LSM_DELETED)) {
+            out.emplace_back(entry.key, Tuple::deserialize(entry.record.data(), entry.record.size()));
+            out.back().second.deleted = false;
+        }
+    }
+    return false;
+}
+
+uint64_t LSMStore::getNextKey(uint32_t tableId) {
+    auto table = openTable(tableId);
+    if (!table) return 0;
+    
+    std::lock_guard<std::mutex> lock(table->mutex);
+    return table->nextKey;
+}
+
+void LSMStore::setPurgeCheck(std::function<bool()> check) {
+    std::lock_guard<std::mutex> lock(purgeMutex);
+    purgeCheck = std::move(check);
+}
+
+LSMStats LSMStore::getStats() const {
+    LSMStats stats;
+    stats.bytesWritten = bytesWritten.load();
+    stats.flushes = flushes.load();
+    stats.bytesFlushed = bytesFlushed.load();
+    stats.compactions = compactions.load();
+    stats.trivialMoves = trivialMoves.load();
+    stats.bytesCompacted = bytesCompacted.load();
+    stats.writeStalls = writeStalls.load();
+    stats.bloomChecks = bloomChecks.load();
+    stats.bloomSkips = bloomSkips.load();
+    return stats;
+}
+
+void LSMStore::sync() {
+    std::vector<std::shared_ptr<Table>> open;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto& [id, table] : tables) {
+            if (table) open.push_back(table);
+        }
+    }
+    for (const auto& table : open) {
+        std::lock_guard<std::mutex> lock(table->writeMutex);
+        table->log.flush();
+    }
+}
+
+} // namespace hybriddb
@@ -0,0 +1,108 @@
+#include "../include/hybriddb.h"
+
+namespace hybriddb {
+
+// ============================================================================
+// METRICS
+// ============================================================================
+//
+// Shards are never freed: a thread takes a free one when it first records
+// and gives it back when it exits. A scrape reads each slot once with a
+// relaxed load, so a histogram's count and sum may be a few events apart.
+
+namespace {
+
+struct ShardRegistry {
+    std::mutex mutex;
+    std::vector<MetricsShard*> shards;
+    std::vector<MetricsShard*> free;
+};
+
+// Leaked, so threads still exiting during static destruction can use it
+ShardRegistry& registry() {
+    static ShardRegistry* shards = new ShardRegistry();
+    return *shards;
+}
+
+// Hands the thread's shard back when the thread exits
+struct ShardLease {
+    MetricsShard* shard = nullptr;
+    
+    ~ShardLease() {
+        if (!shard) return;
+        ShardRegistry& shards = registry();
+        std::lock_guard<std::mutex> lock(shards.mutex);
+        shards.free.push_back(shard);
+    }
+};
+
+thread_local ShardLease lease;
+
+} // namespace
+
+thread_local MetricsShard* Metrics::local = nullptr;
+
+MetricsShard* Metrics::attach() {
+    ShardRegistry& shards = registry();
+    {
+        std::lock_guard<std::mutex> lock(shards.mutex);
+        if (!shards.free.empty()) {
+            local = shards.free.back();
+            shards.free.pop_back();
+        } else {
+            local = new MetricsShard();
+            shards.shards.push_back(local);
+        }
+    }
+    lease.shard = local;
+    return local;
+}
+
+MetricsSnapshot Metrics::collect() {
+    MetricsSnapshot snapshot;
+    for (size_t c = 0; c < METRIC_COUNTERS; c++) snapshot.counters[c] = 0;
+    for (auto& histogram : snapshot.histograms) {
+        histogram.count = 0;
+        histogram.sum = 0;
+        histogram.buckets.assign(HISTOGRAM_BUCKETS, 0);
+    }
+    
+    ShardRegistry& shards = registry();
+    std::lock_guard<std::mutex> lock(shards.mutex);
+    for (const MetricsShard* shard : shards.shards) {
+        for (size_t c = 0; c < METRIC_COUNTERS; c++) {
+            snapshot.counters[c] += shard->counters[c].load(std::memory_order_relaxed);
+        }
+        for (size_t h = 0; h < METRIC_HISTOGRAMS; h++) {
+            HistogramSnapshot& histogram = snapshot.histograms[h];
+            histogram.sum += shard->sums[h].load(std::memory_order_relaxed);
+            for (size_t b = 0; b < HISTOGRAM_BUCKETS; b++) {
+                uint64_t count = shard->buckets[h][b].load(std::memory_order_relaxed);
+                histogram.buckets[b] += count;
+                histogram.count += count;
+            }
+        }
+    }
+    return snapshot;
+}
+
+uint64_t Metrics::bucketLimit(size_t bucket) {
+    if (bucket < (2u << METRICS_SUB_BUCKET_BITS)) return bucket;
+    unsigned shift = static_cast<unsigned>(bucket >> METRICS_SUB_BUCKET_BITS) - 1;
+    uint64_t mantissa = (1ULL << METRICS_SUB_BUCKET_BITS) + (bucket & ((1u << METRICS_SUB_BUCKET_BITS) - 1));
+    return ((mantissa + 1) << shift) - 1;
+}
+
+uint64_t HistogramSnapshot::percentile(double q) const {
+    if (count == 0) return 0;
+    uint64_t rank = static_cast<uint64_t>(q * count);
+    if (rank >= count) rank = count - 1;
+    uint64_t seen = 0;
+    for (size_t b = 0; b < buckets.size(); b++) {
+        seen += buckets[b];
+        if (seen > rank) return Metrics::bucketLimit(b);
+    }
+    return Metrics::bucketLimit(buckets.size() - 1);
+}
+
+} // namespace hybriddb
@@ -1,11 +1,45 @@
 #include "../include/hybriddb.h"
 #include <cstring>
+#include <cerrno>
+#include <cmath>
 #include <algorithm>
 #include <sstream>
 #include <iomanip>
+#include <iterator>
+#include <filesystem>
+#ifndef PLATFORM_WINDOWS
+#include <sys/stat.h>
+#endif
 
 namespace hybriddb {
 
+// Offset of the deleted flag inside a serialized tuple (after rowId, txnId, timestamp)
+static const size_t TUPLE_DELETED_OFFSET = 24;
+
+// Page map file: magic, codec, then one 16-byte PageExtent per page
+static const char PAGE_MAP_MAGIC[4] = {'H', 'D', 'B', 'M'};
+static const size_t PAGE_MAP_HEADER = 8;
+static const size_t PAGE_MAP_ENTRY = 16;
+
+// Page summary file: magic, version, bloom flag, page count, then one
+// length-prefixed PageSummary per page
+static const char PAGE_SUMMARY_MAGIC[4] = {'H', 'D', 'B', 'Z'};
+static const uint8_t PAGE_SUMMARY_VERSION = 2;      // 1: without page LSNs
+static const size_t PAGE_SUMMARY_HEADER = 12;
+
+// Keys an LSM table walk examines per LSMStore::scan call
+static const size_t LSM_SCAN_BATCH = 1024;
+
+// FNV-1a; page summaries are persisted, so std::hash will not do
+static uint64_t hashBytes(const void* data, size_t length, uint64_t h = 0xcbf29ce484222325ULL) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < length; i++) {
+        h ^= bytes[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
 // ============================================================================
 // VALUE IMPLEMENTATION
 // ============================================================================
@@ -17,46 +51,131 @@ Value::Value(double v) : type(DataType::TYPE_DOUBLE), doubleVal(v) {}
 Value::Value(const std::string& v) : type(DataType::TYPE_STRING), intVal(0), stringVal(v) {}
 Value::Value(const char* v) : type(DataType::TYPE_STRING), intVal(0), stringVal(v) {}
 
-std::vector<uint8_t> Value::serialize() const {
-    std::vector<uint8_t> buffer;
-    buffer.push_back(static_cast<uint8_t>(type));
+void Value::serialize(std::vector<uint8_t>& out) const {
+    out.push_back(static_cast<uint8_t>(type));
     
     switch (type) {
         case DataType::TYPE_NULL:
             break;
         case DataType::TYPE_BOOLEAN:
-            buffer.push_back(boolVal ? 1 : 0);
+            out.push_back(boolVal ? 1 : 0);
             break;
+        case DataType::TYPE_INT8:
+        case DataType::TYPE_INT16:
+        case DataType::TYPE_INT32:
         case DataType::TYPE_INT64:
-            for (int i = 0; i < 8; i++)
-                buffer.push_back((intVal >> (i * 8)) & 0xFF);
+        case DataType::TYPE_TIMESTAMP:
+            putFixed<int64_t>(out, intVal);
             break;
-        case DataType::TYPE_DOUBLE: {
-            uint64_t bits = *reinterpret_cast<const uint64_t*>(&doubleVal);
-            for (int i = 0; i < 8; i++)
-                buffer.push_back((bits >> (i * 8)) & 0xFF);
+        case DataType::TYPE_FLOAT:
+        case DataType::TYPE_DOUBLE:
+            putFixed<double>(out, doubleVal);
             break;
-        }
-        case DataType::TYPE_STRING: {
-            uint32_t len = stringVal.length();
-            for (int i = 0; i < 4; i++)
-                buffer.push_back((len >> (i * 8)) & 0xFF);
-            buffer.insert(buffer.end(), stringVal.begin(), stringVal.end());
+        case DataType::TYPE_STRING:
+            putFixed<uint32_t>(out, static_cast<uint32_t>(stringVal.size()));
+            putBytes(out, stringVal.data(), stringVal.size());
             break;
-        }
-        default:
+        case DataType::TYPE_BINARY:
+        case DataType::TYPE_JSON:
+            putFixed<uint32_t>(out, static_cast<uint32_t>(binaryVal.size()));
+            putBytes(out, binaryVal.data(), binaryVal.size());
             break;
     }
+}
+
+std::vector<uint8_t> Value::serialize() const {
+    std::vector<uint8_t> buffer;
+    buffer.reserve(serializedSize());
+    serialize(buffer);
     return buffer;
 }
 
+size_t Value::serializedSize() const {
+    switch (type) {
+        case DataType::TYPE_NULL:
+            return 1;
+        case DataType::TYPE_BOOLEAN:
+            return 2;
+        case DataType::TYPE_STRING:
+            return 5 + stringVal.size();
+        case DataType::TYPE_BINARY:
+        case DataType::TYPE_JSON:
+            return 5 + binaryVal.size();
+        default:
+            return 9;
+    }
+}
+
+Value Value::fromText(const std::string& text, DataType type) {
+    Value v;
+    parseText(text, type, v);
+    return v;
+}
+
+bool Value::parseText(const std::string& text, DataType type, Value& v) {
+    v = Value();
+    const char* start = text.c_str();
+    char* end = nullptr;
+    errno = 0;
+    switch (type) {
+        case DataType::TYPE_NULL:
+            break;
+        case DataType::TYPE_BOOLEAN: {
+            bool yes = text == "true" || text == "TRUE" || text == "t" || text == "1";
+            v = Value(yes);
+            return yes || text == "false" || text == "FALSE" || text == "f" || text == "0";
+        }
+        case DataType::TYPE_INT8:
+        case DataType::TYPE_INT16:
+        case DataType::TYPE_INT32:
+        case DataType::TYPE_INT64:
+        case DataType::TYPE_TIMESTAMP:
+            v = Value(static_cast<int64_t>(strtoll(start, &end, 10)));
+            v.type = type;
+            return !text.empty() && *end == '\0' && errno != ERANGE;
+        case DataType::TYPE_FLOAT:
+        case DataType::TYPE_DOUBLE:
+            v = Value(strtod(start, &end));
+            v.type = type;
+            return !text.empty() && *end == '\0' && errno != ERANGE;
+        case DataType::TYPE_STRING:
+            v = Value(text);
+            break;
+        case DataType::TYPE_BINARY:
+            v.type = type;
+            v.binaryVal.assign(text.begin(), text.end());
+            break;
+        case DataType::TYPE_JSON: {
+            // Text that is not a valid document is kept as a JSON string
+            std::string error;
+            v.type = type;
+            if (!JSONDocument::encode(text.data(), text.size(), v.binaryVal, error)) {
+                v.binaryVal.clear();
+                JSONDocument::appendString(v.binaryVal, text.data(), text.size());
+            }
+            break;
+        }
+    }
+    return true;
+}
+
 std::string Value::toString() const {
     switch (type) {
         case DataType::TYPE_NULL: return "NULL";
         case DataType::TYPE_BOOLEAN: return boolVal ? "true" : "false";
-        case DataType::TYPE_INT64: return std::to_string(intVal);
+        case DataType::TYPE_INT8:
+        case DataType::TYPE_INT16:
+        case DataType::TYPE_INT32:
+        case DataType::TYPE_INT64:
+        case DataType::TYPE_TIMESTAMP: return std::to_string(intVal);
+        case DataType::TYPE_FLOAT:
         case DataType::TYPE_DOUBLE: return std::to_string(doubleVal);
         case DataType::TYPE_STRING: return stringVal;
+        case DataType::TYPE_JSON: {
+            std::string text;
+            JSONDocument::toText(binaryVal.data(), binaryVal.size(), text);
+            return text;
+        }
         default: return "";
     }
 }
@@ -76,6 +195,7 @@ void Page::initialize(uint32_t pageId, uint32_t tableId) {
     header.itemCount = 0;
     header.flags = 0;
     header.checksum = calculateChecksum();
+    header.lsn = 0;
 }
 
 uint32_t Page::calculateChecksum() const {
@@ -91,11 +211,204 @@ bool Page::verify() const {
     return header.checksum == calculateChecksum();
 }
 
+bool Page::appendRecord(const uint8_t* record, uint16_t length) {
+    size_t needed = sizeof(uint16_t) + length;
+    if (needed > header.freeSpace) return false;
+    
+    size_t offset = PAGE_DATA_SIZE - header.freeSpace;
+    memcpy(data + offset, &length, sizeof(length));
+    memcpy(data + offset + sizeof(length), record, length);
+    
+    header.freeSpace -= needed;
+    header.itemCount++;
+    return true;
+}
+
+// ============================================================================
+// PAGE SUMMARY IMPLEMENTATION
+// ============================================================================
+
+namespace {
+
+bool isNumericValue(const Value& v) {
+    return isNumericType(v.type);
+}
+
+double numericValue(const Value& v) {
+    if (v.type == DataType::TYPE_BOOLEAN) return v.boolVal ? 1.0 : 0.0;
+    return isIntegerType(v.type) ? static_cast<double>(v.intVal) : v.doubleVal;
+}
+
+// False for values the filter does not cover: NaN, which compares equal to
+// every number, and anything but numbers and strings
+bool bloomHash(const std::string& column, const Value& v, uint64_t& hash) {
+    if (isNumericValue(v) ? std::isnan(numericValue(v)) : v.type != DataType::TYPE_STRING) return false;
+    hash = hashBytes(column.data(), column.size(), v.hash());
+    return true;
+}
+
+// Three probes by double hashing
+template <typename F>
+void bloomProbes(uint64_t hash, F probe) {
+    uint64_t step = (hash >> 32 | hash << 32) | 1;
+    for (int i = 0; i < 3; i++) probe((hash + i * step) % PAGE_BLOOM_BITS);
+}
+
+// Bytes Value::deserialize will consume at data, or 0 past length
+size_t valueLength(const uint8_t* data, size_t length) {
+    if (length == 0) return 0;
+    size_t needed = 1;
+    switch (static_cast<DataType>(data[0])) {
+        case DataType::TYPE_NULL: break;
+        case DataType::TYPE_BOOLEAN: needed += 1; break;
+        case DataType::TYPE_STRING:
+        case DataType::TYPE_BINARY:
+        case DataType::TYPE_JSON: {
+            if (length < 5) return 0;
+            uint32_t n;
+            memcpy(&n, data + 1, 4);
+            needed += 4 + static_cast<size_t>(n);
+            break;
+        }
+        default: needed += 8; break;
+    }
+    return needed <= length ? needed : 0;
+}
+
+} // namespace
+
+const ZoneMap* PageSummary::zone(const std::string& column) const {
+    auto it = zones.find(column);
+    return it != zones.end() && it->second.bounded ? &it->second.map : nullptr;
+}
+
+bool PageSummary::mayContain(const std::string& column, const Value& value) const {
+    uint64_t hash;
+    if (bloom.empty() || !bloomHash(column, value, hash)) return true;
+    
+    bool all = true;
+    bloomProbes(hash, [&](uint64_t bit) { all = all && (bloom[bit / 64] >> (bit % 64) & 1); });
+    return all;
+}
+
+void PageSummary::add(const Tuple& tuple, bool bloomFilter) {
+    if (bloomFilter && bloom.empty()) bloom.assign(PAGE_BLOOM_BITS / 64, 0);
+    
+    // Columns this tuple lacks read as NULL
+    for (auto& [name, zone] : zones) {
+        if (!tuple.columns.count(name)) zone.map.nullCount++;
+    }
+    
+    for (const auto& [name, value] : tuple.columns) {
+        auto inserted = zones.try_emplace(name);
+        Zone& zone = inserted.first->second;
+        if (inserted.second) {
+            zone.map.nullCount = rows;
+            zone.bounded = true;
+        }
+        
+        if (value.isNull()) {
+            zone.map.nullCount++;
+            continue;
+        }
+        
+        if (!bloom.empty()) {
+            uint64_t hash;
+            if (bloomHash(name, value, hash)) {
+                bloomProbes(hash, [&](uint64_t bit) { bloom[bit / 64] |= 1ULL << (bit % 64); });
+            } else if (isNumericValue(value)) {
+                // NaN compares equal to every number
+                bloom.assign(PAGE_BLOOM_BITS / 64, ~0ULL);
+            }
+        }
+        
+        if (!zone.bounded) continue;
+        bool numeric = isNumericValue(value);
+        if ((!numeric && value.type != DataType::TYPE_STRING) ||
+            (numeric && std::isnan(numericValue(value))) ||
+            (!numeric && value.stringVal.size() > PAGE_ZONE_MAX_STRING) ||
+            (!zone.map.min.isNull() && numeric != isNumericValue(zone.map.min))) {
+            zone.bounded = false;
+            zone.map.min = Value();
+            zone.map.max = Value();
+            continue;
+        }
+        if (zone.map.min.isNull() || value.compare(zone.map.min) < 0) zone.map.min = value;
+        if (zone.map.max.isNull() || value.compare(zone.map.max) > 0) zone.map.max = value;
+    }
+    rows++;
+}
+
+// rows, zone count, per zone: name, bounded flag, NULL count, min, max; then
+// the bloom bits when the table keeps them
+void PageSummary::serialize(std::vector<uint8_t>& out, bool bloomFilter) const {
+    auto put = [&](const void* data, size_t length) {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        out.insert(out.end(), bytes, bytes + length);
+    };
+    
+    put(&rows, 4);
+    uint16_t count = static_cast<uint16_t>(std::min<size_t>(zones.size(), UINT16_MAX));
+    put(&count, 2);
+    for (const auto& [name, zone] : zones) {
+        if (count-- == 0) break;
+        uint16_t length = static_cast<uint16_t>(std::min<size_t>(name.size(), UINT16_MAX));
+        put(&length, 2);
+        put(name.data(), length);
+        out.push_back(zone.bounded ? 1 : 0);
+        put(&zone.map.nullCount, 4);
+        zone.map.min.serialize(out);
+        zone.map.max.serialize(out);
+    }
+    if (!bloomFilter) return;
+    if (bloom.empty()) out.resize(out.size() + PAGE_BLOOM_BITS / 8, 0);
+    else put(bloom.data(), PAGE_BLOOM_BITS / 8);
+}
+
+bool PageSummary::deserialize(const uint8_t* data, size_t length, size_t& offset, bool bloomFilter) {
+    auto get = [&](void* to, size_t n) {
+        if (length - offset < n) return false;
+        memcpy(to, data + offset, n);
+        offset += n;
+        return true;
+    };
+    auto value = [&](Value& v) {
+        size_t n = valueLength(data + offset, length - offset);
+        if (n == 0) return false;
+        v = Value::deserialize(data, offset);
+        return true;
+    };
+    
+    zones.clear();
+    bloom.clear();
+    uint16_t count;
+    if (!get(&rows, 4) || !get(&count, 2)) return false;
+    for (uint16_t i = 0; i < count; i++) {
+        uint16_t nameLength;
+        if (!get(&nameLength, 2) || length - offset < nameLength) return false;
+        std::string name(reinterpret_cast<const char*>(data + offset), nameLength);
+        offset += nameLength;
+        
+        Zone zone;
+        uint8_t bounded;
+        if (!get(&bounded, 1) || !get(&zone.map.nullCount, 4) || !value(zone.map.min) || !value(zone.map.max)) {
+            return false;
+        }
+        zone.bounded = bounded != 0;
+        zones[name] = std::move(zone);
+    }
+    if (!bloomFilter) return true;
+    bloom.resize(PAGE_BLOOM_BITS / 64);
+    return get(bloom.data(), PAGE_BLOOM_BITS / 8);
+}
+
 // ============================================================================
 // STORAGE ENGINE IMPLEMENTATION
 // ============================================================================
 
-StorageEngine::StorageEngine(const std::string& dataDir) : dataDirectory(dataDir) {
+StorageEngine::StorageEngine(const std::string& dataDir)
+    : dataDirectory(dataDir), compressedPagesWritten(0), compressBytesIn(0), compressBytesOut(0),
+      compressNanos(0), compressedPagesRead(0), decompressNanos(0), scanPagesRead(0), scanPagesSkipped(0) {
     bufferPool = std::make_unique<BufferPool>(BUFFER_POOL_SIZE_MB);
     
 #ifdef PLATFORM_WINDOWS
@@ -103,222 +416,1405 @@ StorageEngine::StorageEngine(const std::string& dataDir) : dataDirectory(dataDir
 #else
     mkdir(dataDir.c_str(), 0755);
 #endif
+    
+    columnStore = std::make_unique<ColumnStore>(dataDir);
+    lsmStore = std::make_unique<LSMStore>(dataDir);
+    seriesStore = std::make_unique<TimeSeriesStore>(dataDir);
 }
 
 StorageEngine::~StorageEngine() {
     sync();
 }
 
-bool StorageEngine::createTable(uint32_t tableId) {
-    std::lock_guard<std::shared_mutex> lock(mutex);
-    
+std::string StorageEngine::tablePath(uint32_t tableId) const {
     std::ostringstream path;
     path << dataDirectory << "/table_" << std::setfill('0') << std::setw(6) << tableId << ".dat";
-    
-    std::ofstream file(path.str(), std::ios::binary);
-    if (!file) return false;
-    
-    Page page;
-    page.initialize(0, tableId);
-    file.write(reinterpret_cast<const char*>(&page), sizeof(Page));
-    file.close();
-    
-    return true;
+    return path.str();
 }
 
-bool StorageEngine::dropTable(uint32_t tableId) {
-    std::lock_guard<std::shared_mutex> lock(mutex);
-    
+std::string StorageEngine::mapPath(uint32_t tableId) const {
     std::ostringstream path;
-    path << dataDirectory << "/table_" << std::setfill('0') << std::setw(6) << tableId << ".dat";
-    
-    tableFiles.erase(tableId);
-    return remove(path.str().c_str()) == 0;
+    path << dataDirectory << "/table_" << std::setfill('0') << std::setw(6) << tableId << ".map";
+    return path.str();
 }
 
-Page* StorageEngine::readPage(uint32_t tableId, uint32_t pageId) {
-    Page* cached = bufferPool->getPage(tableId, pageId);
-    if (cached) return cached;
-    
-    std::shared_lock<std::shared_mutex> lock(mutex);
-    
+std::string StorageEngine::summaryPath(uint32_t tableId) const {
     std::ostringstream path;
-    path << dataDirectory << "/table_" << std::setfill('0') << std::setw(6) << tableId << ".dat";
-    
+    path << dataDirectory << "/table_" << std::setfill('0') << std::setw(6) << tableId << ".zmp";
+    return path.str();
+}
+
+std::fstream* StorageEngine::openTableFile(uint32_t tableId) {
     std::fstream& file = tableFiles[tableId];
     if (!file.is_open()) {
-        file.open(path.str(), std::ios::in | std::ios::out | std::ios::binary);
+        file.open(tablePath(tableId), std::ios::in | std::ios::out | std::ios::binary);
     }
+    if (!file) {
+        file.clear();
+        file.close();
+        return nullptr;
+    }
+    return &file;
+}
+
+// Loaded on first use. A table without a .map file stores raw pages.
+StorageEngine::PageMap* StorageEngine::openPageMap(uint32_t tableId) {
+    auto it = pageMaps.find(tableId);
+    if (it != pageMaps.end()) return it->second.get();
     
-    if (!file) return nullptr;
-    
-    Page* page = new Page();
-    file.seekg(pageId * PAGE_SIZE);
-    file.read(reinterpret_cast<char*>(page), PAGE_SIZE);
+    auto& slot = pageMaps[tableId];
+    auto map = std::make_unique<PageMap>();
+    map->file.open(mapPath(tableId), std::ios::in | std::ios::out | std::ios::binary);
+    if (!map->file) return nullptr;
     
-    if (!page->verify()) {
-        delete page;
+    char header[PAGE_MAP_HEADER];
+    map->file.read(header, PAGE_MAP_HEADER);
+    if (!map->file || memcmp(header, PAGE_MAP_MAGIC, sizeof(PAGE_MAP_MAGIC)) != 0) {
+        std::cerr << "Ignoring damaged page map " << mapPath(tableId) << "\n";
         return nullptr;
     }
+    map->codec = static_cast<PageCompression>(header[4]);
+    map->fileEnd = 0;
+    
+    // A torn trailing entry is ignored
+    uint8_t entry[PAGE_MAP_ENTRY];
+    while (map->file.read(reinterpret_cast<char*>(entry), PAGE_MAP_ENTRY)) {
+        PageExtent extent;
+        memcpy(&extent.offset, entry, 8);
+        memcpy(&extent.length, entry + 8, 4);
+        memcpy(&extent.capacity, entry + 12, 4);
+        map->extents.push_back(extent);
+        map->fileEnd = std::max(map->fileEnd, extent.offset + extent.capacity);
+    }
+    map->file.clear();
     
-    return page;
+    slot = std::move(map);
+    return slot.get();
 }
 
-bool StorageEngine::writePage(uint32_t tableId, const Page& page) {
-    bufferPool->markDirty(tableId, page.header.pageId);
-    
-    std::lock_guard<std::shared_mutex> lock(mutex);
+// Loaded on first use. The last page saved may have gained records since, and
+// later pages were never saved, so those are summarized from their records; a
+// missing or damaged file means every page is.
+StorageEngine::PageSummaries& StorageEngine::openSummaries(uint32_t tableId) {
+    auto it = summaries.find(tableId);
+    if (it != summaries.end()) return it->second;
     
-    std::ostringstream path;
-    path << dataDirectory << "/table_" << std::setfill('0') << std::setw(6) << tableId << ".dat";
+    PageSummaries& table = summaries[tableId];
+    table.bloomFilters = false;
+    table.dirty = false;
+    table.lsnsSaved = false;
+    uint32_t pageCount = pageCountLocked(tableId);
     
-    std::fstream& file = tableFiles[tableId];
-    if (!file.is_open()) {
-        file.open(path.str(), std::ios::in | std::ios::out | std::ios::binary);
+    std::ifstream file(summaryPath(tableId), std::ios::binary);
+    std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    uint32_t saved = 0;
+    bool lsns = false;
+    if (bytes.size() >= PAGE_SUMMARY_HEADER && memcmp(bytes.data(), PAGE_SUMMARY_MAGIC, 4) == 0 &&
+        (bytes[4] == PAGE_SUMMARY_VERSION || bytes[4] == 1)) {
+        table.bloomFilters = bytes[5] != 0;
+        lsns = bytes[4] == PAGE_SUMMARY_VERSION && bytes[6] != 0;
+        memcpy(&saved, &bytes[8], 4);
     }
+    if (saved > pageCount) saved = 0;
     
-    if (!file) return false;
+    size_t offset = PAGE_SUMMARY_HEADER;
+    while (table.pages.size() < saved) {
+        PageSummary summary;
+        if (!summary.deserialize(bytes.data(), bytes.size(), offset, table.bloomFilters)) break;
+        table.pages.push_back(std::move(summary));
+    }
+    if (table.pages.size() < saved) {
+        std::cerr << "Ignoring damaged page summaries " << summaryPath(tableId) << "\n";
+        table.pages.clear();
+    }
     
-    file.seekp(page.header.pageId * PAGE_SIZE);
-    file.write(reinterpret_cast<const char*>(&page), PAGE_SIZE);
-    file.flush();
+    table.written.assign(table.pages.size(), UINT64_MAX);
+    if (lsns && offset + table.pages.size() * sizeof(uint64_t) <= bytes.size()) {
+        memcpy(table.written.data(), &bytes[offset], table.pages.size() * sizeof(uint64_t));
+    }
     
-    return true;
+    if (!table.pages.empty()) table.pages.pop_back();
+    table.written.resize(pageCount, UINT64_MAX);
+    for (uint32_t pageId = static_cast<uint32_t>(table.pages.size()); pageId < pageCount; pageId++) {
+        Page* page = readPageLocked(tableId, pageId);
+        if (page) {
+            summarizePageLocked(table, *page);
+            table.written[pageId] = page->header.lsn;
+        } else {
+            // Unreadable: summarized as holding anything
+            table.pages.resize(pageId + 1);
+            table.pages[pageId].rows = 1;
+        }
+    }
+    return table;
 }
 
-void StorageEngine::sync() {
-    bufferPool->flushAll();
+// Summarizes a page from its records, deleted ones included, replacing what
+// was there
+void StorageEngine::summarizePageLocked(PageSummaries& table, const Page& page) {
+    uint32_t pageId = page.header.pageId;
+    if (pageId >= table.pages.size()) table.pages.resize(pageId + 1);
     
-    std::lock_guard<std::shared_mutex> lock(mutex);
-    for (auto& [id, file] : tableFiles) {
-        if (file.is_open()) {
-            file.flush();
-        }
+    PageSummary summary;
+    size_t offset = 0;
+    for (uint16_t i = 0; i < page.header.itemCount; i++) {
+        uint16_t length;
+        memcpy(&length, page.data + offset, sizeof(length));
+        summary.add(Tuple::deserialize(page.data + offset + sizeof(length), length), table.bloomFilters);
+        offset += sizeof(length) + length;
     }
+    table.pages[pageId] = std::move(summary);
+    table.dirty = true;
 }
 
-// ============================================================================
-// BUFFER POOL IMPLEMENTATION
-// ============================================================================
+// Written to a temporary file and renamed over the old one
+bool StorageEngine::saveSummariesLocked(uint32_t tableId, PageSummaries& table) {
+    std::vector<uint8_t> bytes(PAGE_SUMMARY_HEADER, 0);
+    memcpy(bytes.data(), PAGE_SUMMARY_MAGIC, 4);
+    bytes[4] = PAGE_SUMMARY_VERSION;
+    bytes[5] = table.bloomFilters ? 1 : 0;
+    bytes[6] = 1;
+    uint32_t count = static_cast<uint32_t>(table.pages.size());
+    memcpy(&bytes[8], &count, 4);
+    for (const auto& summary : table.pages) summary.serialize(bytes, table.bloomFilters);
+    table.written.resize(count, UINT64_MAX);
+    putBytes(bytes, table.written.data(), count * sizeof(uint64_t));
+    
+    std::string path = summaryPath(tableId);
+    std::ofstream file(path + ".tmp", std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+    file.close();
+    if (!file) return false;
+#ifdef PLATFORM_WINDOWS
+    remove(path.c_str());
+#endif
+    if (rename((path + ".tmp").c_str(), path.c_str()) != 0) return false;
+    table.dirty = false;
+    table.lsnsSaved = true;
+    return true;
+}
 
-BufferPool::BufferPool(size_t sizeMB) 
-    : capacity((sizeMB * 1024 * 1024) / PAGE_SIZE), hits(0), misses(0) {
-    frames.resize(capacity);
+// The saved LSNs stop being trusted before the first page write after a save
+void StorageEngine::noteWrittenLocked(uint32_t tableId, PageSummaries& table, uint32_t pageId, uint64_t lsn) {
+    if (table.lsnsSaved) {
+        std::fstream file(summaryPath(tableId), std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(6);
+        file.put(0);
+        file.flush();
+        table.lsnsSaved = false;
+    }
+    if (pageId >= table.written.size()) table.written.resize(pageId + 1, UINT64_MAX);
+    table.written[pageId] = lsn;
+    table.dirty = true;
 }
 
-Page* BufferPool::getPage(uint32_t tableId, uint32_t pageId) {
-    std::lock_guard<std::mutex> lock(mutex);
+uint32_t StorageEngine::pageCountLocked(uint32_t tableId) {
+    if (PageMap* map = openPageMap(tableId)) return static_cast<uint32_t>(map->extents.size());
     
-    uint64_t key = (static_cast<uint64_t>(tableId) << 32) | pageId;
-    auto it = pageMap.find(key);
+    auto it = pageCounts.find(tableId);
+    if (it != pageCounts.end()) return it->second;
     
-    if (it != pageMap.end()) {
-        hits++;
-        frames[it->second].lastAccess = std::chrono::system_clock::now().time_since_epoch().count();
-        return &frames[it->second].page;
-    }
+    std::fstream* file = openTableFile(tableId);
+    if (!file) return 0;
     
-    misses++;
-    return nullptr;
+    file->seekg(0, std::ios::end);
+    uint32_t count = static_cast<uint32_t>(file->tellg() / PAGE_SIZE);
+    pageCounts[tableId] = count;
+    return count;
 }
 
-void BufferPool::markDirty(uint32_t tableId, uint32_t pageId) {
-    std::lock_guard<std::mutex> lock(mutex);
+bool StorageEngine::createTable(uint32_t tableId, PageCompression compression, bool bloomFilters) {
+    MeteredLock<std::shared_mutex> lock(mutex, Counter::LOCK_WAITS_STORAGE);
     
-    uint64_t key = (static_cast<uint64_t>(tableId) << 32) | pageId;
-    auto it = pageMap.find(key);
+    std::ofstream file(tablePath(tableId), std::ios::binary);
+    if (!file) return false;
     
-    if (it != pageMap.end()) {
-        frames[it->second].dirty = true;
+    Page page;
+    page.initialize(0, tableId);
+    if (lsnClock) page.header.lsn = lsnClock();
+    tableFiles.erase(tableId);
+    pageMaps.erase(tableId);
+    
+    // The bloom filter choice lives in the summary file, written right away
+    PageSummaries& table = summaries[tableId];
+    table.bloomFilters = bloomFilters;
+    table.pages.assign(1, PageSummary());
+    table.written.assign(1, page.header.lsn);
+    if (!saveSummariesLocked(tableId, table)) return false;
+    
+    if (compression == PageCompression::NONE) {
+        file.write(reinterpret_cast<const char*>(&page), sizeof(Page));
+        file.close();
+        pageCounts[tableId] = 1;
+        return true;
     }
+    file.close();
+    
+    std::ofstream mapFile(mapPath(tableId), std::ios::binary);
+    char header[PAGE_MAP_HEADER] = {};
+    memcpy(header, PAGE_MAP_MAGIC, sizeof(PAGE_MAP_MAGIC));
+    header[4] = static_cast<char>(compression);
+    mapFile.write(header, PAGE_MAP_HEADER);
+    mapFile.close();
+    if (!mapFile) return false;
+    
+    PageMap* map = openPageMap(tableId);
+    return map && writeExtentsLocked(tableId, *map, &page, 1);
 }
 
-void BufferPool::flushAll() {
-    std::lock_guard<std::mutex> lock(mutex);
+bool StorageEngine::dropTable(uint32_t tableId) {
+    MeteredLock<std::shared_mutex> lock(mutex, Counter::LOCK_WAITS_STORAGE);
+    if (snapshot && snapshot->tables.count(tableId)) return false;
     
-    for (auto& frame : frames) {
-        if (frame.dirty) {
-            // Write back to disk (handled by StorageEngine)
-            frame.dirty = false;
-        }
-    }
+    tableFiles.erase(tableId);
+    pageCounts.erase(tableId);
+    pageMaps.erase(tableId);
+    summaries.erase(tableId);
+    remove(mapPath(tableId).c_str());
+    remove(summaryPath(tableId).c_str());
+    columnStore->dropTable(tableId);
+    lsmStore->dropTable(tableId);
+    seriesStore->dropTable(tableId);
+    return remove(tablePath(tableId).c_str()) == 0;
 }
 
-double BufferPool::getHitRate() const {
-    uint64_t total = hits + misses;
-    return total > 0 ? static_cast<double>(hits) / total : 0.0;
+Page* StorageEngine::readPageLocked(uint32_t tableId, uint32_t pageId) {
+    Page* cached = bufferPool->getPage(tableId, pageId);
+    if (cached) return cached;
+    
+    Page page;
+    if (!loadPageLocked(tableId, pageId, page)) return nullptr;
+    return bufferPool->putPage(tableId, page);
 }
 
-// ============================================================================
-// WAL MANAGER IMPLEMENTATION
-// ============================================================================
-
-WALManager::WALManager(const std::string& walDir) 
-    : walDirectory(walDir), currentLSN(0), running(true) {
+bool StorageEngine::loadPageLocked(uint32_t tableId, uint32_t pageId, Page& page) {
+    std::fstream* file = openTableFile(tableId);
+    if (!file) return false;
     
-#ifdef PLATFORM_WINDOWS
-    CreateDirectoryA(walDir.c_str(), NULL);
-#else
-    mkdir(walDir.c_str(), 0755);
-#endif
+    if (PageMap* map = openPageMap(tableId)) {
+        if (pageId >= map->extents.size()) return false;
+        const PageExtent& extent = map->extents[pageId];
+        
+        uint8_t buffer[PAGE_SIZE];
+        file->seekg(static_cast<std::streamoff>(extent.offset));
+        file->read(reinterpret_cast<char*>(buffer), extent.length);
+        if (!*file) {
+            file->clear();
+            return false;
+        }
+        
+        if (extent.length == PAGE_SIZE) {
+            memcpy(&page, buffer, PAGE_SIZE);
+        } else {
+            auto start = std::chrono::steady_clock::now();
+            bool ok = LZ4Codec::decompress(buffer, extent.length, reinterpret_cast<uint8_t*>(&page), PAGE_SIZE);
+            decompressNanos += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count();
+            compressedPagesRead++;
+            if (!ok) return false;
+        }
+    } else {
+        file->seekg(static_cast<std::streamoff>(pageId) * PAGE_SIZE);
+        file->read(reinterpret_cast<char*>(&page), PAGE_SIZE);
+        if (!*file) {
+            file->clear();
+            return false;
+        }
+    }
     
-    openNewSegment();
-    flushThread = std::thread(&WALManager::flushWorker, this);
+    return page.verify();
 }
 
-WALManager::~WALManager() {
-    running = false;
-    if (flushThread.joinable()) {
-        flushThread.join();
-    }
-    if (currentSegment.is_open()) {
-        currentSegment.close();
-    }
+Page* StorageEngine::readPage(uint32_t tableId, uint32_t pageId) {
+    MeteredLock<std::shared_mutex> lock(mutex, Counter::LOCK_WAITS_STORAGE);
+    return readPageLocked(tableId, pageId);
 }
 
-void WALManager::openNewSegment() {
-    std::ostringstream path;
-    path << walDirectory << "/wal_" << std::setfill('0') << std::setw(16) 
-         << std::hex << currentLSN.load() << ".log";
+bool StorageEngine::writePageLocked(uint32_t tableId, const Page& page) {
+    std::fstream* file = openTableFile(tableId);
+    if (!file) return false;
     
-    currentSegment.open(path.str(), std::ios::binary | std::ios::app);
-}
-
-uint64_t WALManager::appendRecord(const WALRecord& record) {
-    std::lock_guard<std::mutex> lock(mutex);
+    PageSummaries& table = openSummaries(tableId);
+    if (snapshot) preserveLocked(tableId, page.header.pageId);
     
-    uint64_t lsn = currentLSN++;
-    auto data = record.serialize();
+    Page image = page;
+    image.header.checksum = image.calculateChecksum();
+    if (lsnClock) image.header.lsn = lsnClock();
+    noteWrittenLocked(tableId, table, image.header.pageId, image.header.lsn);
+    bufferPool->updatePage(tableId, image);
     
-    currentSegment.write(reinterpret_cast<const char*>(&lsn), sizeof(lsn));
-    currentSegment.write(reinterpret_cast<const char*>(data.data()), data.size());
+    if (PageMap* map = openPageMap(tableId)) return writeExtentsLocked(tableId, *map, &image, 1);
     
-    return lsn;
+    file->seekp(static_cast<std::streamoff>(image.header.pageId) * PAGE_SIZE);
+    file->write(reinterpret_cast<const char*>(&image), PAGE_SIZE);
+    file->flush();
+    
+    return static_cast<bool>(*file);
 }
 
-void WALManager::flush() {
-    std::lock_guard<std::mutex> lock(mutex);
-    if (currentSegment.is_open()) {
-        currentSegment.flush();
+// Compresses pages into their extents. A page that no longer fits its extent,
+// and every new page, goes to the end of the file; those are gathered into one
+// write. Map entries are written after the data they point to.
+bool StorageEngine::writeExtentsLocked(uint32_t tableId, PageMap& map, const Page* pages, size_t count) {
+    std::fstream* file = openTableFile(tableId);
+    if (!file) return false;
+    
+    std::vector<uint8_t> tail;
+    std::vector<uint32_t> updated;
+    uint8_t buffer[PAGE_SIZE];
+    
+    for (size_t i = 0; i < count; i++) {
+        uint32_t pageId = pages[i].header.pageId;
+        if (pageId > map.extents.size()) return false;
+        
+        auto start = std::chrono::steady_clock::now();
+        const uint8_t* bytes = buffer;
+        size_t length = LZ4Codec::compress(reinterpret_cast<const uint8_t*>(&pages[i]), PAGE_SIZE,
+                                           buffer, PAGE_SIZE - 1);
+        compressNanos += std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count();
+        if (length == 0) {
+            bytes = reinterpret_cast<const uint8_t*>(&pages[i]);
+            length = PAGE_SIZE;
+        }
+        compressedPagesWritten++;
+        compressBytesIn += PAGE_SIZE;
+        compressBytesOut += length;
+        
+        if (pageId == map.extents.size()) map.extents.push_back({0, 0, 0});
+        PageExtent& extent = map.extents[pageId];
+        if (extent.capacity > 0 && length <= extent.capacity) {
+            file->seekp(static_cast<std::streamoff>(extent.offset));
+            file->write(reinterpret_cast<const char*>(bytes), length);
+        } else {
+            extent.offset = map.fileEnd + tail.size();
+            extent.capacity = (length + PAGE_EXTENT_ALIGN - 1) / PAGE_EXTENT_ALIGN * PAGE_EXTENT_ALIGN;
+            tail.insert(tail.end(), bytes, bytes + length);
+            tail.resize(tail.size() + extent.capacity - length);
+        }
+        extent.length = static_cast<uint32_t>(length);
+        updated.push_back(pageId);
     }
-}
-
-void WALManager::flushWorker() {
-    while (running) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
-        flush();
+    
+    if (!tail.empty()) {
+        file->seekp(static_cast<std::streamoff>(map.fileEnd));
+        file->write(reinterpret_cast<const char*>(tail.data()), tail.size());
+        map.fileEnd += tail.size();
+    }
+    file->flush();
+    if (!*file) {
+        file->clear();
+        return false;
+    }
+    
+    // Consecutive entries (a batch of appended pages) go out in one write
+    std::sort(updated.begin(), updated.end());
+    updated.erase(std::unique(updated.begin(), updated.end()), updated.end());
+    std::vector<uint8_t> entries;
+    for (size_t i = 0; i < updated.size(); i++) {
+        const PageExtent& extent = map.extents[updated[i]];
+        uint8_t entry[PAGE_MAP_ENTRY];
+        memcpy(entry, &extent.offset, 8);
+        memcpy(entry + 8, &extent.length, 4);
+        memcpy(entry + 12, &extent.capacity, 4);
+        entries.insert(entries.end(), entry, entry + PAGE_MAP_ENTRY);
+        
+        if (i + 1 == updated.size() || updated[i + 1] != updated[i] + 1) {
+            uint32_t first = updated[i] + 1 - entries.size() / PAGE_MAP_ENTRY;
+            map.file.seekp(static_cast<std::streamoff>(PAGE_MAP_HEADER + first * PAGE_MAP_ENTRY));
+            map.file.write(reinterpret_cast<const char*>(entries.data()), entries.size());
+            entries.clear();
+        }
+    }
+    map.file.flush();
+    if (!map.file) {
+        map.file.clear();
+        return false;
+    }
+    return true;
+}
+
+bool StorageEngine::writePage(uint32_t tableId, const Page& page) {
+    MeteredLock<std::shared_mutex> lock(mutex, Counter::LOCK_WAITS_STORAGE);
+    PageSummaries& table = openSummaries(tableId);
+    if (!writePageLocked(tableId, page)) return false;
+    summarizePageLocked(table, page);
+    return true;
+}
+
+uint32_t StorageEngine::allocatePage(uint32_t tableId) {
+    MeteredLock<std::shared_mutex> lock(mutex, Counter::LOCK_WAITS_STORAGE);
+    
+    PageSummaries& table = openSummaries(tableId);
+    uint32_t pageId = pageCountLocked(tableId);
+    Page page;
+    page.initialize(pageId, tableId);
+    if (!writePageLocked(tableId, page)) return 0;
+    
+    pageCounts[tableId] = pageId + 1;
+    summarizePageLocked(table, page);
+    return pageId;
+}
+
+uint32_t StorageEngine::getPageCount(uint32_t tableId) {
+    MeteredLock<std::shared_mutex> lock(mutex, Counter::LOCK_WAITS_STORAGE);
+    return pageCountLocked(tableId);
+}
+
+void StorageEngine::setLSNClock(std::function<uint64_t()> clock) {
+    MeteredLock<std::shared_mutex> lock(mutex, Counter::LOCK_WAITS_STORAGE);
+    lsnClock = std::move(clock);
+}
+
+bool StorageEngine::appendPages(uint32_t tableId, std::vector<Page>& pages) {
+    if (pages.empty()) return true;
+    
+    MeteredLock<std::shared_mutex> lock(mutex, Counter::LOCK_WAITS_STORAGE);
+    
+    std::fstream* file = openTableFile(tableId);
+    if (!file) return false;
+    
+    PageSummaries& table = openSummaries(tableId);
+    uint32_t firstPage = pageCountLocked(tableId);
+    uint64_t lsn = lsnClock ? lsnClock() : 0;
+    for (size_t i = 0; i < pages.size(); i++) {
+        pages[i].header.pageId = firstPage + i;
+        pages[i].header.tableId = tableId;
+        pages[i].header.checksum = pages[i].calculateChecksum();
+        if (lsnClock) pages[i].header.lsn = lsn;
+        noteWrittenLocked(tableId, table, pages[i].header.pageId, pages[i].header.lsn);
+    }
+    
+    if (PageMap* map = openPageMap(tableId)) {
+        if (!writeExtentsLocked(tableId, *map, pages.data(), pages.size())) return false;
+        pageCounts[tableId] = firstPage + pages.size();
+        for (const Page& page : pages) summarizePageLocked(table, page);
+        return true;
+    }
+    
+    // One sequential write for the whole batch instead of a seek+flush per page
+    file->seekp(static_cast<std::streamoff>(firstPage) * PAGE_SIZE);
+    file->write(reinterpret_cast<const char*>(pages.data()), pages.size() * PAGE_SIZE);
+    file->flush();
+    if (!*file) {
+        file->clear();
+        return false;
+    }
+    
+    pageCounts[tableId] = firstPage + pages.size();
+    for (const Page& page : pages) summarizePageLocked(table, page);
+    return true;
+}
+
+bool StorageEngine::appendRecordLocked(uint32_t tableId, const Tuple& tuple, const std::vector<uint8_t>& record,
+                                       uint64_t* tupleId) {
+    if (record.size() + sizeof(uint16_t) > PAGE_DATA_SIZE) return false;
+    
+    // Before the write, or loading would summarize the record a second time
+    PageSummaries& table = openSummaries(tableId);
+    uint32_t pageCount = pageCountLocked(tableId);
+    if (pageCount == 0) return false;
+    
+    Page* last = readPageLocked(tableId, pageCount - 1);
+    if (!last) return false;
+    
+    Page page = *last;
+    if (!page.appendRecord(record.data(), record.size())) {
+        page.initialize(pageCount, tableId);
+        page.appendRecord(record.data(), record.size());
+    }
+    
+    if (!writePageLocked(tableId, page)) return false;
+    pageCounts[tableId] = std::max(pageCount, page.header.pageId + 1);
+    
+    if (page.header.pageId >= table.pages.size()) table.pages.resize(page.header.pageId + 1);
+    table.pages[page.header.pageId].add(tuple, table.bloomFilters);
+    table.dirty = true;
+    
+    if (tupleId) *tupleId = makeTupleId(page.header.pageId, page.header.itemCount - 1);
+    return true;
+}
+
+// Flips the deleted byte of a record in place; the record keeps its slot
+bool StorageEngine::setDeletedLocked(uint32_t tableId, uint64_t tupleId, bool deleted) {
+    Page* cached = readPageLocked(tableId, tupleIdPage(tupleId));
+    if (!cached) return false;
+    
+    Page page = *cached;
+    uint16_t slot = tupleIdSlot(tupleId);
+    if (slot >= page.header.itemCount) return false;
+    
+    size_t offset = 0;
+    for (uint16_t i = 0; i < slot; i++) {
+        uint16_t length;
+        memcpy(&length, page.data + offset, sizeof(length));
+        offset += sizeof(length) + length;
+    }
+    
+    uint16_t length;
+    memcpy(&length, page.data + offset, sizeof(length));
+    if (length <= TUPLE_DELETED_OFFSET) return false;
+    
+    page.data[offset + sizeof(length) + TUPLE_DELETED_OFFSET] = deleted ? 1 : 0;
+    return writePageLocked(tableId, page);
+}
+
+bool StorageEngine::insertTuple(uint32_t tableId, const Tuple& tuple, uint64_t* tupleId) {
+    if (lsmStore->isLSMTable(tableId)) {
+        uint64_t key;
+        if (!lsmStore->insert(tableId, tuple, &key)) return false;
+        if (tupleId) *tupleId = makeLSMTupleId(key);
+        return true;
+    }
+    
+    thread_local std::vector<uint8_t> record;
+    record.clear();
+    tuple.serialize(record);
+    
+    MeteredLock<std::shared_mutex> lock(mutex, Counter::LOCK_WAITS_STORAGE);
+    return appendRecordLocked(tableId, tuple, record, tupleId);
+}
+
+bool StorageEngine::readTuple(uint32_t tableId, uint64_t tupleId, Tuple& tuple) {
+    if (isColumnTupleId(tupleId)) {
+        return columnStore->readRow(tableId, columnTupleOrdinal(tupleId), tuple);
+    }
+    if (isLSMTupleId(tupleId)) {
+        return lsmStore->read(tableId, lsmTupleKey(tupleId), tuple);
+    }
+    if (isSeriesTupleId(tupleId)) {
+        return seriesStore->readRow(tableId, tupleId, tuple);
+    }
+    
+    Page page;
+    {
+        MeteredLock<std::shared_mutex> lock(mutex, Counter::LOCK_WAITS_STORAGE);
+        Page* cached = readPageLocked(tableId, tupleIdPage(tupleId));
+        if (!cached) return false;
+        page = *cached;
+    }
+    
+    uint16_t slot = tupleIdSlot(tupleId);
+    if (slot >= page.header.itemCount) return false;
+    
+    size_t offset = 0;
+    for (uint16_t i = 0; i < slot; i++) {
+        uint16_t length;
+        memcpy(&length, page.data + offset, sizeof(length));
+        offset += sizeof(length) + length;
+    }
+    
+    uint16_t length;
+    memcpy(&length, page.data + offset, sizeof(length));
+    tuple = Tuple::deserialize(page.data + offset + sizeof(length), length);
+    return !tuple.deleted;
+}
+
+// Updates are out of place: the old version is marked deleted and the new one
+// appended, so the tuple id changes and callers must re-point their indexes.
+// A row updated out of a column block is appended to the table's pages; an
+// LSM row is marked deleted and the new version inserted under a new key.
+// Rows updated out of a time-series chunk go to the pages like column rows.
+bool StorageEngine::updateTuple(uint32_t tableId, uint64_t tupleId, const Tuple& tuple, uint64_t* newTupleId) {
+    if (isLSMTupleId(tupleId)) {
+        uint64_t key = lsmTupleKey(tupleId);
+        if (!lsmStore->setDeleted(tableId, key, true)) return false;
+        if (!insertTuple(tableId, tuple, newTupleId)) {
+            lsmStore->setDeleted(tableId, key, false);
+            return false;
+        }
+        return true;
+    }
+    
+    thread_local std::vector<uint8_t> record;
+    record.clear();
+    tuple.serialize(record);
+    
+    MeteredLock<std::shared_mutex> lock(mutex, Counter::LOCK_WAITS_STORAGE);
+    if (isColumnTupleId(tupleId)) {
+        uint64_t ordinal = columnTupleOrdinal(tupleId);
+        if (!columnStore->setDeleted(tableId, ordinal, true)) return false;
+        if (!appendRecordLocked(tableId, tuple, record, newTupleId)) {
+            columnStore->setDeleted(tableId, ordinal, false);
+            return false;
+        }
+        return true;
+    }
+    if (isSeriesTupleId(tupleId)) {
+        if (!seriesStore->setDeleted(tableId, tupleId, true)) return false;
+        if (!appendRecordLocked(tableId, tuple, record, newTupleId)) {
+            seriesStore->setDeleted(tableId, tupleId, false);
+            return false;
+        }
+        return true;
+    }
+    
+    if (!setDeletedLocked(tableId, tupleId, true)) return false;
+    if (!appendRecordLocked(tableId, tuple, record, newTupleId)) {
+        setDeletedLocked(tableId, tupleId, false);
+        return false;
+    }
+    return true;
+}
+
+bool StorageEngine::deleteTuple(uint32_t tableId, uint64_t tupleId, bool deleted) {
+    if (isColumnTupleId(tupleId)) {
+        return columnStore->setDeleted(tableId, columnTupleOrdinal(tupleId), deleted);
+    }
+    if (isLSMTupleId(tupleId)) {
+        return lsmStore->setDeleted(tableId, lsmTupleKey(tupleId), deleted);
+    }
+    if (isSeriesTupleId(tupleId)) {
+        return seriesStore->setDeleted(tableId, tupleId, deleted);
+    }
+    
+    MeteredLock<std::shared_mutex> lock(mutex, Counter::LOCK_WAITS_STORAGE);
+    return setDeletedLocked(tableId, tupleId, deleted);
+}
+
+// Marks many page rows deleted with one write per page
+bool StorageEngine::deleteTuples(uint32_t tableId, std::vector<uint64_t> tupleIds) {
+    std::sort(tupleIds.begin(), tupleIds.end());
+    while (!tupleIds.empty() && isLSMTupleId(tupleIds.back())) {
+        if (!lsmStore->setDeleted(tableId, lsmTupleKey(tupleIds.back()), true)) return false;
+        tupleIds.pop_back();
+    }
+    while (!tupleIds.empty() && isSeriesTupleId(tupleIds.back())) {
+        if (!seriesStore->setDeleted(tableId, tupleIds.back(), true)) return false;
+        tupleIds.pop_back();
+    }
+    
+    MeteredLock<std::shared_mutex> lock(mutex, Counter::LOCK_WAITS_STORAGE);
+    size_t i = 0;
+    while (i < tupleIds.size()) {
+        uint32_t pageId = tupleIdPage(tupleIds[i]);
+        Page* cached = readPageLocked(tableId, pageId);
+        if (!cached) return false;
+        
+        Page page = *cached;
+        size_t offset = 0;
+        uint16_t slot = 0;
+        for (; i < tupleIds.size() && tupleIdPage(tupleIds[i]) == pageId; i++) {
+            uint16_t target = tupleIdSlot(tupleIds[i]);
+            if (target >= page.header.itemCount) return false;
+            
+            uint16_t length;
+            for (; slot < target; slot++) {
+                memcpy(&length, page.data + offset, sizeof(length));
+                offset += sizeof(length) + length;
+            }
+            memcpy(&length, page.data + offset, sizeof(length));
+            if (length > TUPLE_DELETED_OFFSET) page.data[offset + sizeof(length) + TUPLE_DELETED_OFFSET] = 1;
+        }
+        if (!writePageLocked(tableId, page)) return false;
+    }
+    return true;
+}
+
+std::vector<Tuple> StorageEngine::scanTable(uint32_t tableId) {
+    std::vector<Tuple> tuples;
+    TableIterator iterator(this, tableId);
+    
+    Tuple tuple;
+    while (iterator.next(tuple)) {
+        tuples.push_back(std::move(tuple));
+    }
+    return tuples;
+}
+
+bool StorageEngine::pageMayMatch(uint32_t tableId, uint32_t pageId,
+                                 const std::function<bool(const PageSummary&)>& filter) {
+    MeteredLock<std::shared_mutex> lock(mutex, Counter::LOCK_WAITS_STORAGE);
+    PageSummaries& table = openSummaries(tableId);
+    if (pageId < table.pages.size()) {
+        const PageSummary& summary = table.pages[pageId];
+        if (summary.rows == 0 || !filter(summary)) {
+            scanPagesSkipped++;
+            return false;
+        }
+    }
+    scanPagesRead++;
+    return true;
+}
+
+ScanStats StorageEngine::getScanStats() const {
+    ScanStats stats;
+    stats.pagesRead = scanPagesRead.load();
+    stats.pagesSkipped = scanPagesSkipped.load();
+    return stats;
+}
+
+CompressionStats StorageEngine::getCompressionStats() const {
+    CompressionStats stats;
+    stats.pagesWritten = compressedPagesWritten.load();
+    stats.bytesIn = compressBytesIn.load();
+    stats.bytesOut = compressBytesOut.load();
+    stats.compressNanos = compressNanos.load();
+    stats.pagesRead = compressedPagesRead.load();
+    stats.decompressNanos = decompressNanos.load();
+    return stats;
+}
+
+void StorageEngine::sync() {
+    bufferPool->flushAll();
+    columnStore->sync();
+    lsmStore->sync();
+    seriesStore->sync();
+    
+    MeteredLock<std::shared_mutex> lock(mutex, Counter::LOCK_WAITS_STORAGE);
+    for (auto& [id, file] : tableFiles) {
+        if (file.is_open()) {
+            file.flush();
+        }
+    }
+    for (auto& [id, map] : pageMaps) {
+        if (map) map->file.flush();
+    }
+    for (auto& [id, table] : summaries) {
+        if (table.dirty && !saveSummariesLocked(id, table)) {
+            std::cerr << "Could not save page summaries " << summaryPath(id) << "\n";
+        }
+    }
+}
+
+// ============================================================================
+// TABLE ITERATOR IMPLEMENTATION
+// ============================================================================
+
+// The page and block counts are captured up front: rows appended during the
+// walk are not visited, which keeps UPDATE from revisiting the versions it writes.
+TableIterator::TableIterator(StorageEngine* se, uint32_t id, bool pagesOnly)
+    : storage(se), tableId(id), pageCount(se->getPageCount(id)), pageId(0),
+      slot(0), offset(0), loaded(false), columns(nullptr), blockCount(0), block(0),
+      blockRow(0), blockFirstRow(0), series(nullptr), seriesSegment(0), seriesFirstId(0),
+      lsm(nullptr), lsmNext(0), lsmLimit(0), lsmDone(true), lsmRow(0) {
+          
+    ColumnStore* store = se->getColumnStore();
+    if (!pagesOnly && store->isColumnTable(id)) {
+        columns = store;
+        columnDefs = store->getColumns(id);
+        blockCount = store->getBlockCount(id);
+    }
+    
+    TimeSeriesStore* seriesStore = se->getTimeSeriesStore();
+    if (!pagesOnly && seriesStore->isSeriesTable(id)) {
+        series = seriesStore;
+        columnDefs = seriesStore->getColumns(id);
+        for (const auto& segment : seriesStore->findSegments(id, INT64_MIN, INT64_MAX)) {
+            seriesSegments.push_back(segment.first);
+        }
+    }
+    
+    LSMStore* lsmStore = se->getLSMStore();
+    if (!pagesOnly && lsmStore->isLSMTable(id)) {
+        lsm = lsmStore;
+        lsmLimit = lsmStore->getNextKey(id);
+        lsmDone = false;
+    }
+}
+
+bool TableIterator::nextColumnRow(Tuple& tuple, uint64_t* tupleId) {
+    while (true) {
+        if (blockRow >= blockDeleted.size()) {
+            if (block >= blockCount) {
+                blockData.clear();
+                return false;
+            }
+            
+            std::vector<size_t> all(columnDefs.size());
+            for (size_t c = 0; c < all.size(); c++) all[c] = c;
+            blockRow = 0;
+            if (!columns->readBlock(tableId, block++, all, blockData, blockDeleted,
+                                    &blockFirstRow, &blockRowIds)) {
+                blockDeleted.clear();
+            }
+            continue;
+        }
+        
+        size_t row = blockRow++;
+        if (blockDeleted[row]) continue;
+        
+        tuple.rowId = blockRowIds[row];
+        tuple.txnId = 0;
+        tuple.timestamp = 0;
+        tuple.deleted = false;
+        tuple.columns.clear();
+        for (size_t c = 0; c < columnDefs.size(); c++) {
+            tuple.columns[columnDefs[c].name] = blockData[c].get(row);
+        }
+        if (tupleId) *tupleId = makeColumnTupleId(blockFirstRow + row);
+        return true;
+    }
+}
+
+// Shares the block buffers with nextColumnRow; a table is one or the other
+bool TableIterator::nextSeriesRow(Tuple& tuple, uint64_t* tupleId) {
+    while (true) {
+        if (blockRow >= blockDeleted.size()) {
+            if (seriesSegment >= seriesSegments.size()) {
+                blockData.clear();
+                return false;
+            }
+            
+            std::vector<size_t> all(columnDefs.size());
+            for (size_t c = 0; c < all.size(); c++) all[c] = c;
+            blockRow = 0;
+            if (!series->readSegment(tableId, seriesSegments[seriesSegment++], all, blockData, blockDeleted,
+                                     &seriesFirstId, &blockRowIds)) {
+                blockDeleted.clear();
+            }
+            continue;
+        }
+        
+        size_t row = blockRow++;
+        if (blockDeleted[row]) continue;
+        
+        tuple.rowId = blockRowIds[row];
+        tuple.txnId = 0;
+        tuple.timestamp = 0;
+        tuple.deleted = false;
+        tuple.columns.clear();
+        for (size_t c = 0; c < columnDefs.size(); c++) {
+            tuple.columns[columnDefs[c].name] = blockData[c].get(row);
+        }
+        if (tupleId) *tupleId = seriesFirstId + row;
+        return true;
+    }
+}
+
+bool TableIterator::nextLSMRow(Tuple& tuple, uint64_t* tupleId) {
+    while (lsmRow >= lsmRows.size()) {
+        if (lsmDone) {
+            lsmRows.clear();
+            return false;
+        }
+        lsmRows.clear();
+        lsmRow = 0;
+        lsmDone = !lsm->scan(tableId, lsmNext, lsmLimit, LSM_SCAN_BATCH, lsmRows, lsmNext);
+    }
+    
+    auto& row = lsmRows[lsmRow++];
+    tuple = std::move(row.second);
+    if (tupleId) *tupleId = makeLSMTupleId(row.first);
+    return true;
+}
+
+bool TableIterator::next(Tuple& tuple, uint64_t* tupleId) {
+    if (columns && nextColumnRow(tuple, tupleId)) return true;
+    if (series && nextSeriesRow(tuple, tupleId)) return true;
+    if (lsm && nextLSMRow(tuple, tupleId)) return true;
+    
+    while (pageId < pageCount) {
+        if (!loaded) {
+            if (pageFilter && !storage->pageMayMatch(tableId, pageId, pageFilter)) {
+                pageId++;
+                continue;
+            }
+            Page* cached = storage->readPage(tableId, pageId);
+            if (!cached) {
+                pageId++;
+                continue;
+            }
+            page = *cached;
+            slot = 0;
+            offset = 0;
+            loaded = true;
+        }
+        
+        while (slot < page.header.itemCount) {
+            uint16_t length;
+            memcpy(&length, page.data + offset, sizeof(length));
+            offset += sizeof(length);
+            
+            const uint8_t* record = page.data + offset;
+            uint16_t current = slot++;
+            offset += length;
+            
+            if (length > TUPLE_DELETED_OFFSET && record[TUPLE_DELETED_OFFSET]) continue;
+            
+            tuple = Tuple::deserialize(record, length);
+            if (tuple.deleted) continue;
+            if (tupleId) *tupleId = makeTupleId(pageId, current);
+            return true;
+        }
+        
+        loaded = false;
+        pageId++;
+    }
+    return false;
+}
+
+// ============================================================================
+// BUFFER POOL IMPLEMENTATION
+// ============================================================================
+
+BufferPool::BufferPool(size_t sizeMB) 
+    : capacity((sizeMB * 1024 * 1024) / PAGE_SIZE), usedFrames(0), clockHand(0), hits(0), misses(0) {
+    frames.resize(capacity);
+}
+
+Page* BufferPool::getPage(uint32_t tableId, uint32_t pageId) {
+    std::lock_guard<std::mutex> lock(mutex);
+    
+    uint64_t key = (static_cast<uint64_t>(tableId) << 32) | pageId;
+    auto it = pageMap.find(key);
+    
+    if (it != pageMap.end()) {
+        hits++;
+        Metrics::add(Counter::POOL_HITS);
+        Frame& frame = frames[it->second];
+        frame.referenced = true;
+        frame.lastAccess = std::chrono::system_clock::now().time_since_epoch().count();
+        return &frame.page;
+    }
+    
+    misses++;
+    Metrics::add(Counter::POOL_MISSES);
+    return nullptr;
+}
+
+// Clock sweep: unused frames first, then the first unpinned frame whose
+// reference bit is already clear. Pages are written through, so eviction
+// never has to write anything back.
+size_t BufferPool::findVictim() {
+    if (usedFrames < capacity) {
+        return usedFrames++;
+    }
+    
+    for (size_t scanned = 0; scanned < 2 * capacity; scanned++) {
+        Frame& frame = frames[clockHand];
+        size_t index = clockHand;
+        clockHand = (clockHand + 1) % capacity;
+        
+        if (frame.pinned) continue;
+        if (frame.referenced) {
+            frame.referenced = false;
+            continue;
+        }
+        
+        pageMap.erase((static_cast<uint64_t>(frame.tableId) << 32) | frame.pageId);
+        Metrics::add(Counter::POOL_EVICTIONS);
+        return index;
+    }
+    
+    size_t index = clockHand;
+    pageMap.erase((static_cast<uint64_t>(frames[index].tableId) << 32) | frames[index].pageId);
+    Metrics::add(Counter::POOL_EVICTIONS);
+    clockHand = (clockHand + 1) % capacity;
+    return index;
+}
+
+Page* BufferPool::putPage(uint32_t tableId, const Page& page) {
+    std::lock_guard<std::mutex> lock(mutex);
+    
+    uint64_t key = (static_cast<uint64_t>(tableId) << 32) | page.header.pageId;
+    auto it = pageMap.find(key);
+    
+    size_t index;
+    if (it != pageMap.end()) {
+        index = it->second;
+    } else {
+        index = findVictim();
+        pageMap[key] = index;
+    }
+    
+    Frame& frame = frames[index];
+    frame.page = page;
+    frame.tableId = tableId;
+    frame.pageId = page.header.pageId;
+    frame.dirty = false;
+    frame.referenced = true;
+    frame.lastAccess = std::chrono::system_clock::now().time_since_epoch().count();
+    return &frame.page;
+}
+
+void BufferPool::updatePage(uint32_t tableId, const Page& page) {
+    std::lock_guard<std::mutex> lock(mutex);
+    
+    uint64_t key = (static_cast<uint64_t>(tableId) << 32) | page.header.pageId;
+    auto it = pageMap.find(key);
+    
+    if (it != pageMap.end() && &frames[it->second].page != &page) {
+        frames[it->second].page = page;
+    }
+}
+
+void BufferPool::markDirty(uint32_t tableId, uint32_t pageId) {
+    std::lock_guard<std::mutex> lock(mutex);
+    
+    uint64_t key = (static_cast<uint64_t>(tableId) << 32) | pageId;
+    auto it = pageMap.find(key);
+    
+    if (it != pageMap.end()) {
+        frames[it->second].dirty = true;
+    }
+}
+
+void BufferPool::flushAll() {
+    std::lock_guard<std::mutex> lock(mutex);
+    
+    for (auto& frame : frames) {
+        if (frame.dirty) {
+            // Write back to disk (handled by StorageEngine)
+            frame.dirty = false;
+        }
     }
 }
 
+double BufferPool::getHitRate() const {
+    uint64_t total = hits + misses;
+    return total > 0 ? static_cast<double>(hits) / total : 0.0;
+}
+
+// ============================================================================
+// WAL MANAGER IMPLEMENTATION
+// ============================================================================
+
+WALManager::WALManager(const std::string& walDir) 
+    : walDirectory(walDir), currentLSN(0), running(true), segmentBytes(0), fullLogging(false),
+      flushedLSN(0), unflushedCommits(0), archivePending(false), archivedSegments(0), archiveFailures(0),
+      checkpointPending(false), keepSegments(false), removedSegments(0) {
+    
+#ifdef PLATFORM_WINDOWS
+    CreateDirectoryA(walDir.c_str(), NULL);
+#else
+    mkdir(walDir.c_str(), 0755);
+#endif
+    
+    // LSNs go on from the end of the log already on disk, which is in the
+    // newest segment; one that is empty was opened at the LSN in its name
+    std::vector<uint64_t> segments = listSegments(walDir);
+    if (!segments.empty()) {
+        currentLSN = segments.back();
+        std::ifstream file(segmentPath(walDir, segments.back()), std::ios::binary);
+        std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        size_t offset = 0;
+        WALRecordView record;
+        while (WALRecord::decode(bytes.data(), bytes.size(), offset, record)) currentLSN = record.lsn + 1;
+    }
+    openNewSegment();
+    flushThread = std::thread(&WALManager::flushWorker, this);
+}
+
+WALManager::~WALManager() {
+    running = false;
+    if (flushThread.joinable()) {
+        flushThread.join();
+    }
+    if (currentSegment.is_open()) {
+        writeBuffer();
+        currentSegment.close();
+    }
+}
+
+std::string WALManager::segmentPath(const std::string& directory, uint64_t firstLSN) {
+    std::ostringstream path;
+    path << directory << "/wal_" << std::setfill('0') << std::setw(16) 
+         << std::hex << firstLSN << ".log";
+    return path.str();
+}
+
+std::vector<uint64_t> WALManager::listSegments(const std::string& directory) {
+    std::vector<uint64_t> segments;
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(directory, ec)) {
+        std::string name = entry.path().filename().string();
+        if (name.size() != 24 || name.compare(0, 4, "wal_") != 0 || entry.path().extension() != ".log") continue;
+        segments.push_back(std::strtoull(name.substr(4, 16).c_str(), nullptr, 16));
+    }
+    std::sort(segments.begin(), segments.end());
+    return segments;
+}
+
+// A segment that was opened but never written is reused. Once one is
+// closed, the archive has a segment to copy.
+void WALManager::openNewSegment() {
+    if (currentSegment.is_open()) {
+        currentSegment.close();
+        if (!archiveDirectory.empty()) archivePending = true;
+        checkpointPending = true;
+    }
+    currentPath = segmentPath(walDirectory, currentLSN.load());
+    currentSegment.open(currentPath, std::ios::binary | std::ios::app);
+    currentSegment.seekp(0, std::ios::end);
+    std::streamoff end = currentSegment.tellp();
+    segmentBytes = end > 0 ? static_cast<size_t>(end) : 0;
+}
+
+uint64_t WALManager::append(WALRecordType type, uint64_t txnId, const uint8_t* data, size_t length) {
+    LatencyTimer timer(Histogram::WAL_APPEND);
+    MeteredLock<std::mutex> lock(mutex, Counter::LOCK_WAITS_WAL);
+    
+    uint64_t lsn = currentLSN++;
+    size_t start = buffer.size();
+    WALRecord::encode(buffer, type, lsn, txnId, data, length);
+    Metrics::add(Counter::WAL_RECORDS);
+    Metrics::add(Counter::WAL_BYTES, buffer.size() - start);
+    if (type == WALRecordType::COMMIT_TXN) unflushedCommits++;
+    if (listener) {
+        WALRecordView record{type, lsn, txnId, buffer.data() + buffer.size() - length, static_cast<uint32_t>(length)};
+        listener(record, buffer.data() + start, buffer.size() - start);
+    }
+    if (buffer.size() >= WAL_BUFFER_BYTES) writeBuffer();
+    
+    return lsn;
+}
+
+uint64_t WALManager::appendRecord(const WALRecord& record) {
+    return append(record.type, record.txnId, record.data.data(), record.data.size());
+}
+
+// Caller holds mutex. The buffer only ever holds whole records, so a full
+// segment is followed by one that starts at the next LSN.
+void WALManager::writeBuffer() {
+    if (buffer.empty() || !currentSegment.is_open()) return;
+    currentSegment.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+    segmentBytes += buffer.size();
+    buffer.clear();
+    
+    if (segmentBytes >= WAL_SEGMENT_SIZE) {
+        currentSegment.flush();
+        openNewSegment();
+    }
+}
+
+// The commits one flush makes durable together are its group commit
+uint64_t WALManager::flush() {
+    MeteredLock<std::mutex> lock(mutex, Counter::LOCK_WAITS_WAL);
+    if (currentSegment.is_open() && flushedLSN != currentLSN.load()) {
+        auto start = std::chrono::steady_clock::now();
+        writeBuffer();
+        currentSegment.flush();
+        Metrics::record(Histogram::WAL_FLUSH, std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count());
+        if (unflushedCommits > 0) Metrics::record(Histogram::GROUP_COMMIT, unflushedCommits);
+        flushedLSN = currentLSN.load();
+        unflushedCommits = 0;
+    }
+    return currentLSN.load();
+}
+
+void WALManager::scan(const WALVisitor& visit) {
+    std::string archive;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        archive = archiveDirectory;
+    }
+    std::vector<uint64_t> segments = listSegments(walDirectory);
+    if (!archive.empty()) {
+        std::vector<uint64_t> archived = listSegments(archive);
+        if (!archived.empty() && (segments.empty() || archived.front() < segments.front())) {
+            segments.insert(segments.begin(), archived.front());
+        }
+    }
+    if (segments.empty()) return;
+    
+    scan({walDirectory, archive}, segments.front(),
+         [&](const WALRecordView& record, const uint8_t* frame, size_t length) {
+        visit(record, frame, length);
+        return true;
+    });
+}
+
+void WALManager::scan(const std::string& directory, uint64_t firstSegment,
+                      const std::function<bool(const WALRecordView&, const uint8_t*, size_t)>& visit) {
+    scan(std::vector<std::string>{directory}, firstSegment, visit);
+}
+
+void WALManager::scan(const std::vector<std::string>& directories, uint64_t firstSegment,
+                      const std::function<bool(const WALRecordView&, const uint8_t*, size_t)>& visit) {
+    uint64_t first = firstSegment;
+    for (;;) {
+        std::ifstream file;
+        for (const auto& directory : directories) {
+            if (directory.empty()) continue;
+            file.open(segmentPath(directory, first), std::ios::binary);
+            if (file) break;
+            file.clear();
+        }
+        if (!file.is_open()) return;
+        std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        
+        uint64_t next = first;
+        size_t offset = 0, start = 0;
+        WALRecordView record;
+        while (WALRecord::decode(bytes.data(), bytes.size(), offset, record)) {
+            if (!visit(record, bytes.data() + start, offset - start)) return;
+            next = record.lsn + 1;
+            start = offset;
+        }
+        if (next == first) return;
+        first = next;
+    }
+}
+
+void WALManager::setListener(WALVisitor visitor) {
+    std::lock_guard<std::mutex> lock(mutex);
+    listener = std::move(visitor);
+}
+
+void WALManager::flushWorker() {
+    while (running) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        flush();
+        if (archivePending.exchange(false) && !archiveSegments()) archivePending = true;
+        
+        std::function<void()> sync;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            sync = syncData;
+        }
+        if (sync && checkpointPending.exchange(false)) {
+            uint64_t lsn = flush();
+            sync();
+            checkpoint(lsn);
+        }
+    }
+}
+
+void WALManager::setCheckpointSync(std::function<void()> sync) {
+    std::lock_guard<std::mutex> lock(mutex);
+    syncData = std::move(sync);
+}
+
+// A segment holds only records below the name of the one after it. One
+// that is not archived yet is left for a later checkpoint.
+void WALManager::checkpoint(uint64_t checkpointLSN) {
+    std::lock_guard<std::mutex> archiving(archiveMutex);
+    std::string current;
+    std::string archive;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        current = currentPath;
+        archive = archiveDirectory;
+    }
+    if (archive.empty() && keepSegments) return;
+    
+    namespace fs = std::filesystem;
+    std::vector<uint64_t> segments = listSegments(walDirectory);
+    for (size_t i = 0; i + 1 < segments.size() && segments[i + 1] <= checkpointLSN; i++) {
+        std::string path = segmentPath(walDirectory, segments[i]);
+        if (path == current) break;
+        
+        std::error_code ec;
+        if (!archive.empty()) {
+            fs::path copy = fs::path(archive) / fs::path(path).filename();
+            if (!fs::exists(copy, ec) || fs::file_size(copy, ec) != fs::file_size(path, ec)) continue;
+        }
+        if (fs::remove(path, ec)) removedSegments++;
+    }
+}
+
+// ============================================================================
+// WAL ARCHIVING
+// ============================================================================
+//
+// Each segment but the current one is copied to the archive under its own
+// name, through a temporary file, unless a copy of the same size is there.
+// A segment that could not be copied is tried again on the next pass.
+
+void WALManager::setArchive(const std::string& directory) {
+    std::filesystem::create_directories(directory);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        archiveDirectory = directory;
+    }
+    fullLogging = true;
+    archivePending = true;
+}
+
+void WALManager::switchSegment() {
+    std::lock_guard<std::mutex> lock(mutex);
+    writeBuffer();
+    if (segmentBytes > 0) {
+        currentSegment.flush();
+        openNewSegment();
+    }
+}
+
+bool WALManager::archiveSegments() {
+    std::lock_guard<std::mutex> archiving(archiveMutex);
+    std::string current;
+    std::string archive;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        current = currentPath;
+        archive = archiveDirectory;
+    }
+    if (archive.empty()) return true;
+    
+    namespace fs = std::filesystem;
+    std::error_code ec;
+    bool ok = true;
+    for (const auto& entry : fs::directory_iterator(walDirectory, ec)) {
+        std::string name = entry.path().filename().string();
+        if (name.compare(0, 4, "wal_") != 0 || entry.path().extension() != ".log") continue;
+        if (name == fs::path(current).filename().string()) continue;
+        
+        fs::path target = fs::path(archive) / name;
+        uintmax_t size = entry.file_size(ec);
+        if (fs::exists(target) && fs::file_size(target, ec) == size) continue;
+        
+        fs::path temporary = target;
+        temporary += ".tmp";
+        fs::copy_file(entry.path(), temporary, fs::copy_options::overwrite_existing, ec);
+        if (!ec) fs::rename(temporary, target, ec);
+        if (ec) {
+            std::cerr << "Could not archive " << entry.path().string() << ": " << ec.message() << "\n";
+            archiveFailures++;
+            ok = false;
+            continue;
+        }
+        archivedSegments++;
+    }
+    return ok;
+}
+
 // ============================================================================
 // TRANSACTION MANAGER IMPLEMENTATION
 // ============================================================================
 
 TransactionManager::TransactionManager(WALManager* wal) 
-    : walManager(wal), txnCounter(1) {}
+    : walManager(wal), txnCounter(1), capturing(false), tracking(false), paused(false) {}
+    
+// Transactions already running when a hook is set deliver only what they
+// log from then on
+void TransactionManager::setCommitHook(CommitHook hook) {
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    capturing = static_cast<bool>(hook);
+    commitHook = std::move(hook);
+    if (!capturing) {
+        for (auto& [id, txn] : activeTxns) txn.changes.clear();
+    }
+}
 
-uint64_t TransactionManager::begin(IsolationLevel level) {
+void TransactionManager::setWriteHook(WriteHook hook) {
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    tracking = static_cast<bool>(hook);
+    writeHook = std::move(hook);
+}
+
+void TransactionManager::setSyncHook(SyncHook hook) {
     std::unique_lock<std::shared_mutex> lock(mutex);
+    syncHook = std::move(hook);
+}
+
+// Outside the lock, once the transaction is gone
+void TransactionManager::endWrites(std::vector<uint32_t>& tables) {
+    if (tables.empty()) return;
+    WriteHook hook;
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        hook = writeHook;
+    }
+    if (!hook) return;
+    for (uint32_t tableId : tables) hook(tableId, true);
+}
+
+uint64_t TransactionManager::begin(IsolationLevel level) {
+    std::unique_lock<std::shared_mutex> lock(mutex, std::defer_lock);
+    lockMetered(lock, Counter::LOCK_WAITS_TRANSACTIONS);
+    idle.wait(lock, [this]() { return !paused; });
     
     uint64_t txnId = txnCounter++;
     Transaction txn;
@@ -329,70 +1825,182 @@ uint64_t TransactionManager::begin(IsolationLevel level) {
     
     activeTxns[txnId] = txn;
     
-    WALRecord record;
-    record.type = WALRecordType::BEGIN_TXN;
-    record.txnId = txnId;
-    walManager->appendRecord(record);
+    walManager->append(WALRecordType::BEGIN_TXN, txnId, nullptr, 0);
     
     return txnId;
 }
 
 bool TransactionManager::commit(uint64_t txnId) {
-    std::unique_lock<std::shared_mutex> lock(mutex);
+    std::unique_lock<std::shared_mutex> lock(mutex, std::defer_lock);
+    lockMetered(lock, Counter::LOCK_WAITS_TRANSACTIONS);
     
     auto it = activeTxns.find(txnId);
     if (it == activeTxns.end() || !it->second.active) {
         return false;
     }
     
-    WALRecord record;
-    record.type = WALRecordType::COMMIT_TXN;
-    record.txnId = txnId;
-    it->second.commitLSN = walManager->appendRecord(record);
+    // The commit time lets a restore stop at a point in time
+    int64_t micros = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    uint64_t commitLSN = walManager->append(WALRecordType::COMMIT_TXN, txnId,
+                                            reinterpret_cast<const uint8_t*>(&micros), sizeof(micros));
     
     it->second.active = false;
+    std::vector<WALRecord> changes = std::move(it->second.changes);
+    std::vector<uint32_t> tables = std::move(it->second.tables);
     activeTxns.erase(it);
+    if (paused && activeTxns.empty()) idle.notify_all();
+    
+    // The hooks run outside the lock; they may begin transactions of their own
+    CommitHook hook = changes.empty() ? nullptr : commitHook;
+    SyncHook sync = syncHook;
+    lock.unlock();
+    if (sync) sync(commitLSN);
+    if (hook) hook(txnId, changes);
+    endWrites(tables);
+    
+    return true;
+}
+
+bool TransactionManager::rollback(uint64_t txnId) {
+    std::unique_lock<std::shared_mutex> lock(mutex, std::defer_lock);
+    lockMetered(lock, Counter::LOCK_WAITS_TRANSACTIONS);
+    
+    auto it = activeTxns.find(txnId);
+    if (it == activeTxns.end()) {
+        return false;
+    }
+    
+    // Execute undo actions
+    for (auto rit = it->second.undoLog.rbegin(); rit != it->second.undoLog.rend(); ++rit) {
+        (*rit)();
+    }
+    
+    walManager->append(WALRecordType::ABORT_TXN, txnId, nullptr, 0);
+    
+    it->second.active = false;
+    std::vector<uint32_t> tables = std::move(it->second.tables);
+    activeTxns.erase(it);
+    if (paused && activeTxns.empty()) idle.notify_all();
+    
+    lock.unlock();
+    endWrites(tables);
+    
+    return true;
+}
+
+bool TransactionManager::pause(std::chrono::milliseconds timeout) {
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    if (paused) return false;
     
+    paused = true;
+    if (!idle.wait_for(lock, timeout, [this]() { return activeTxns.empty(); })) {
+        paused = false;
+        idle.notify_all();
+        return false;
+    }
     return true;
 }
 
-bool TransactionManager::rollback(uint64_t txnId) {
+void TransactionManager::resume() {
     std::unique_lock<std::shared_mutex> lock(mutex);
+    paused = false;
+    idle.notify_all();
+}
+
+bool TransactionManager::isActive(uint64_t txnId) {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    return activeTxns.count(txnId) > 0;
+}
+
+size_t TransactionManager::getActiveCount() {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    return activeTxns.size();
+}
+
+void TransactionManager::addUndoAction(uint64_t txnId, std::function<void()> action) {
+    std::unique_lock<std::shared_mutex> lock(mutex, std::defer_lock);
+    lockMetered(lock, Counter::LOCK_WAITS_TRANSACTIONS);
     
     auto it = activeTxns.find(txnId);
-    if (it == activeTxns.end()) {
-        return false;
+    if (it != activeTxns.end() && it->second.active) {
+        it->second.undoLog.push_back(std::move(action));
     }
+}
+
+uint64_t TransactionManager::logOperation(uint64_t txnId, WALRecordType type, const std::vector<uint8_t>& data) {
+    uint64_t lsn = walManager->append(type, txnId, data.data(), data.size());
     
-    // Execute undo actions
-    for (auto rit = it->second.undoLog.rbegin(); rit != it->second.undoLog.rend(); ++rit) {
-        (*rit)();
-    }
+    bool rowChange = type == WALRecordType::INSERT || type == WALRecordType::UPDATE ||
+                     type == WALRecordType::DELETE;
+    bool bulkLoad = type == WALRecordType::PAGE_IMAGE || type == WALRecordType::BULK_LOAD;
+    if (!(capturing || tracking) || !(rowChange || bulkLoad) || data.size() < sizeof(uint32_t)) return lsn;
     
+    // Every one of these starts with the table id. Page images are not
+    // needed to follow a load, only the table it went to.
+    uint32_t tableId;
+    memcpy(&tableId, data.data(), sizeof(uint32_t));
     WALRecord record;
-    record.type = WALRecordType::ABORT_TXN;
+    record.type = type;
+    record.lsn = lsn;
     record.txnId = txnId;
-    walManager->appendRecord(record);
+    if (capturing) record.data.assign(data.begin(), bulkLoad ? data.begin() + sizeof(uint32_t) : data.end());
+    record.length = record.data.size();
     
-    it->second.active = false;
-    activeTxns.erase(it);
+    std::unique_lock<std::shared_mutex> lock(mutex, std::defer_lock);
+    lockMetered(lock, Counter::LOCK_WAITS_TRANSACTIONS);
+    CommitHook commitTo = capturing ? commitHook : nullptr;
+    WriteHook writeTo = tracking ? writeHook : nullptr;
     
-    return true;
+    auto it = activeTxns.find(txnId);
+    if (it != activeTxns.end() && it->second.active) {
+        Transaction& txn = it->second;
+        if (commitTo) txn.changes.push_back(std::move(record));
+        bool first = writeTo && std::find(txn.tables.begin(), txn.tables.end(), tableId) == txn.tables.end();
+        if (first) txn.tables.push_back(tableId);
+        lock.unlock();
+        if (first) writeTo(tableId, false);
+        return lsn;
+    }
+    
+    lock.unlock();
+    if (writeTo) writeTo(tableId, false);
+    if (commitTo) commitTo(txnId, std::vector<WALRecord>{std::move(record)});
+    if (writeTo) writeTo(tableId, true);
+    return lsn;
 }
 
 // ============================================================================
 // QUERY ENGINE IMPLEMENTATION
 // ============================================================================
 
-QueryEngine::QueryEngine(StorageEngine* se, TransactionManager* tm)
-    : storage(se), txnManager(tm), tableIdCounter(1) {
-    loadCatalog();
+QueryEngine::QueryEngine(StorageEngine* se, TransactionManager* tm, const std::string& catalogPath)
+    : storage(se), txnManager(tm), catalog(std::make_shared<const Catalog>()), catalogPath(catalogPath),
+      tableIdCounter(1), resultCache(nullptr), queryLog(nullptr), readOnly(false), shardRouter(nullptr) {
+    // A damaged catalog is reported and left as it is; the server refuses to start
+    if (!this->catalogPath.empty() && !loadCatalog(catalogError)) {
+        std::cerr << "Catalog not loaded: " << catalogError << "\n";
+    }
+    for (const auto& [name, entry] : currentCatalog()->tables) buildIndexes(name);
+    loadViews();
+    
+    // LSM compactions may drop deleted rows only while no rollback could revive them
+    storage->getLSMStore()->setPurgeCheck([tm]() { return tm->getActiveCount() == 0; });
+}
+
+QueryEngine::~QueryEngine() {
+    txnManager->setCommitHook(nullptr);
+    if (resultCache) txnManager->setWriteHook(nullptr);
+    storage->getLSMStore()->setPurgeCheck(nullptr);
 }
 
-bool QueryEngine::createTable(const std::string& name, const std::vector<ColumnDef>& columns, bool docMode) {
+bool QueryEngine::createTable(const std::string& name, const std::vector<ColumnDef>& columns, bool docMode,
+                              StorageMode mode, PageCompression compression, const SeriesOptions& series,
+                              bool bloomFilters) {
     std::unique_lock<std::shared_mutex> lock(catalogMutex);
     
-    if (catalog.count(name)) {
+    auto next = std::make_shared<Catalog>(*currentCatalog());
+    if (next->tables.count(name)) {
         return false;
     }
     
@@ -401,125 +2009,889 @@ bool QueryEngine::createTable(const std::string& name, const std::vector<ColumnD
     schema.tableName = name;
     schema.columns = columns;
     schema.isDocumentMode = docMode;
+    schema.storageMode = mode;
+    schema.compression = compression;
+    schema.bloomFilters = bloomFilters;
+    schema.series = series;
     schema.rowCount = 0;
+    schema.nextRowId = 1;
+    for (const auto& col : columns) {
+        if (col.primaryKey) schema.primaryKeyColumn = col.name;
+    }
+    if (mode == StorageMode::TIMESERIES) {
+        // Chunks are placed by the time column, so every row needs one
+        for (auto& col : schema.columns) {
+            if (col.type == DataType::TYPE_TIMESTAMP) {
+                col.nullable = false;
+                break;
+            }
+        }
+    }
+    
+    Catalog::Entry& entry = next->tables[name];
+    entry.schema = std::make_shared<const TableSchema>(schema);
+    entry.counters = std::make_shared<TableCounters>();
+    storage->createTable(schema.tableId, compression, bloomFilters);
+    if (mode == StorageMode::COLUMN) {
+        storage->getColumnStore()->createTable(schema.tableId, columns);
+    } else if (mode == StorageMode::LSM) {
+        storage->getLSMStore()->createTable(schema.tableId, compression);
+    } else if (mode == StorageMode::TIMESERIES) {
+        storage->getTimeSeriesStore()->createTable(schema.tableId, schema.columns, series);
+    }
+    createIndexes(schema);
+    publishCatalog(next);
+    
+    return true;
+}
+
+// Primary key and UNIQUE columns get an index automatically, followed by
+// the indexes declared with CREATE INDEX
+void QueryEngine::createIndexes(const TableSchema& schema) {
+    auto& tableIndexes = indexes[schema.tableId];
+    tableIndexes.clear();
+    
+    for (const auto& col : schema.columns) {
+        if (col.primaryKey || col.unique) {
+            tableIndexes.push_back(std::make_unique<TableIndex>(
+                schema.tableName + "_" + col.name + "_idx", col.name, true));
+        }
+    }
+    for (const auto& def : schema.indexes) {
+        tableIndexes.push_back(makeIndex(def));
+    }
+}
+
+std::unique_ptr<TableIndex> QueryEngine::makeIndex(const IndexDef& def) {
+    if (def.fulltext) return std::make_unique<FullTextIndex>(def.name, def.column, def.path);
+    return std::make_unique<TableIndex>(def.name, def.column, def.unique, def.path);
+}
+
+bool QueryEngine::createIndex(const std::string& table, const IndexDef& def, std::string& error) {
+    TableSchema schema;
+    if (!lookupTable(table, schema)) {
+        error = "table not found: " + table;
+        return false;
+    }
+    if (schema.storageMode == StorageMode::TIMESERIES) {
+        error = "time-series tables cannot be indexed; filter on the time column instead";
+        return false;
+    }
+    
+    bool known = schema.isDocumentMode;
+    for (const auto& col : schema.columns) {
+        if (col.name == def.column) {
+            known = true;
+            if (!def.path.empty() && col.type != DataType::TYPE_JSON) {
+                error = "column " + def.column + " is not JSON; path indexes need a JSON column";
+                return false;
+            }
+            if (def.fulltext && col.type != DataType::TYPE_STRING && col.type != DataType::TYPE_JSON) {
+                error = "column " + def.column + " holds no text; full-text indexes need a string or JSON column";
+                return false;
+            }
+        }
+    }
+    if (!known) {
+        error = "unknown column " + def.column + " in table " + table;
+        return false;
+    }
+    
+    // Built from one heap scan with sorted keys before it becomes visible
+    auto index = makeIndex(def);
+    std::vector<std::pair<Value, uint64_t>> keys;
+    TableIterator iterator(storage, schema.tableId);
+    Tuple tuple;
+    uint64_t tupleId;
+    while (iterator.next(tuple, &tupleId)) {
+        keys.emplace_back(index->keyFor(tuple), tupleId);
+    }
+    if (!index->bulkInsert(keys, error)) return false;
     
-    catalog[name] = schema;
-    storage->createTable(schema.tableId);
-    saveCatalog();
+    std::unique_lock<std::shared_mutex> lock(catalogMutex);
+    auto next = std::make_shared<Catalog>(*currentCatalog());
+    auto it = next->tables.find(table);
+    if (it == next->tables.end()) {
+        error = "table not found: " + table;
+        return false;
+    }
+    uint32_t tableId = it->second.schema->tableId;
+    for (const auto& existing : indexes[tableId]) {
+        if (existing->getName() == def.name) {
+            error = "index " + def.name + " already exists";
+            return false;
+        }
+    }
     
+    auto changed = std::make_shared<TableSchema>(*it->second.schema);
+    changed->indexes.push_back(def);
+    it->second.schema = std::move(changed);
+    indexes[tableId].push_back(std::move(index));
+    publishCatalog(next);
     return true;
 }
 
+bool QueryEngine::dropIndex(const std::string& name, std::string& error) {
+    std::unique_lock<std::shared_mutex> lock(catalogMutex);
+    
+    auto next = std::make_shared<Catalog>(*currentCatalog());
+    for (auto& [tableName, entry] : next->tables) {
+        const auto& defs = entry.schema->indexes;
+        auto def = std::find_if(defs.begin(), defs.end(),
+                                [&](const IndexDef& d) { return d.name == name; });
+        if (def == defs.end()) continue;
+        
+        auto changed = std::make_shared<TableSchema>(*entry.schema);
+        changed->indexes.erase(changed->indexes.begin() + (def - defs.begin()));
+        entry.schema = std::move(changed);
+        auto& tableIndexes = indexes[entry.schema->tableId];
+        tableIndexes.erase(std::remove_if(tableIndexes.begin(), tableIndexes.end(),
+                                          [&](const std::unique_ptr<TableIndex>& index) {
+                                              return index->getName() == name;
+                                          }),
+                           tableIndexes.end());
+        publishCatalog(next);
+        return true;
+    }
+    
+    error = "index not found: " + name;
+    return false;
+}
+
 bool QueryEngine::dropTable(const std::string& name) {
+    TableSchema schema;
+    if (lookupTable(name, schema) && storage->inSnapshot(schema.tableId)) return false;
+    dropViews(name);
     std::unique_lock<std::shared_mutex> lock(catalogMutex);
     
-    auto it = catalog.find(name);
-    if (it == catalog.end()) {
+    auto next = std::make_shared<Catalog>(*currentCatalog());
+    auto it = next->tables.find(name);
+    if (it == next->tables.end()) {
+        return false;
+    }
+    
+    uint32_t tableId = it->second.schema->tableId;
+    storage->dropTable(tableId);
+    indexes.erase(tableId);
+    if (resultCache) resultCache->invalidate(tableId);
+    next->tables.erase(it);
+    for (auto view = next->views.begin(); view != next->views.end();) {
+        if (view->second.table == name) view = next->views.erase(view);
+        else ++view;
+    }
+    publishCatalog(next);
+    
+    return true;
+}
+
+std::shared_ptr<const TableSchema> QueryEngine::getTableSchema(const std::string& name) {
+    auto current = currentCatalog();
+    auto it = current->tables.find(name);
+    return it != current->tables.end() ? it->second.schema : nullptr;
+}
+
+std::vector<TableSchema> QueryEngine::listTables() {
+    auto current = currentCatalog();
+    
+    std::vector<TableSchema> tables;
+    for (const auto& [name, entry] : current->tables) {
+        if (entry.schema->shards.empty()) tables.push_back(withCounters(entry));
+    }
+    return tables;
+}
+
+// The hot path of every statement: one atomic load, no lock
+bool QueryEngine::lookupTable(const std::string& name, TableSchema& schema) {
+    auto current = currentCatalog();
+    auto it = current->tables.find(name);
+    if (it == current->tables.end()) return false;
+    schema = withCounters(it->second);
+    return true;
+}
+
+bool QueryEngine::insert(const std::string& table, const std::map<std::string, Value>& values, uint64_t txnId) {
+    TableSchema schema;
+    if (!lookupTable(table, schema)) return false;
+    
+    std::string error;
+    return insertRow(schema, values, txnId, error);
+}
+
+bool QueryEngine::insertRow(const TableSchema& schema, const std::map<std::string, Value>& values,
+                            uint64_t txnId, std::string& error) {
+    Tuple tuple;
+    tuple.rowId = 0;
+    tuple.txnId = txnId;
+    tuple.timestamp = std::chrono::system_clock::now().time_since_epoch().count();
+    tuple.deleted = false;
+    
+    bool autoKey = false;
+    for (const auto& col : schema.columns) {
+        auto vit = values.find(col.name);
+        Value v = (vit != values.end()) ? vit->second : col.defaultValue;
+        if (v.isNull() && col.primaryKey && vit == values.end() && isIntegerType(col.type)) {
+            // An omitted integer primary key takes the row id
+            autoKey = true;
+        } else if (v.isNull() && (!col.nullable || col.primaryKey)) {
+            error = "column " + col.name + " cannot be NULL";
+            return false;
+        }
+        tuple.columns[col.name] = v;
+    }
+    for (const auto& [name, value] : values) {
+        if (tuple.columns.count(name)) continue;
+        if (!schema.isDocumentMode) {
+            error = "unknown column " + name + " in table " + schema.tableName;
+            return false;
+        }
+        tuple.columns[name] = value;
+    }
+    
+    tuple.rowId = allocateRowIds(schema.tableName, 1);
+    if (autoKey) {
+        Value key(static_cast<int64_t>(tuple.rowId));
+        for (const auto& col : schema.columns) {
+            if (col.primaryKey) {
+                key.type = col.type;
+                tuple.columns[col.name] = key;
+            }
+        }
+    }
+    
+    return appendRow(schema, tuple, txnId, error);
+}
+
+bool QueryEngine::appendRow(const TableSchema& schema, const Tuple& tuple, uint64_t txnId, std::string& error,
+                            uint64_t* newTupleId) {
+    auto tableIndexes = getIndexes(schema.tableId);
+    for (auto* index : tableIndexes) {
+        Value key = index->keyFor(tuple);
+        if (index->isUnique() && !key.isNull() && index->contains(key)) {
+            error = "duplicate key '" + key.toString() + "' violates unique index " + index->getName();
+            return false;
+        }
+    }
+    
+    std::vector<uint8_t> payload;
+    payload.reserve(4 + tuple.serializedSize());
+    putFixed<uint32_t>(payload, schema.tableId);
+    tuple.serialize(payload);
+    txnManager->logOperation(txnId, WALRecordType::INSERT, payload);
+    
+    uint64_t tupleId;
+    if (!storage->insertTuple(schema.tableId, tuple, &tupleId)) {
+        error = "row does not fit in a page";
+        return false;
+    }
+    if (newTupleId) *newTupleId = tupleId;
+    
+    for (auto* index : tableIndexes) {
+        index->insert(index->keyFor(tuple), tupleId);
+    }
+    updateRowCount(schema.tableName, 1);
+    
+    txnManager->addUndoAction(txnId, [this, schema, tupleId, tuple]() {
+        storage->deleteTuple(schema.tableId, tupleId);
+        for (auto* index : getIndexes(schema.tableId)) {
+            index->remove(index->keyFor(tuple), tupleId);
+        }
+        updateRowCount(schema.tableName, -1);
+    });
+    
+    if (schema.storageMode == StorageMode::COLUMN) {
+        bool compact;
+        {
+            std::lock_guard<std::mutex> lock(compactMutex);
+            compact = ++pagedColumnRows[schema.tableId] >= COLUMN_BLOCK_ROWS;
+        }
+        if (compact) compactColumns(schema);
+    } else if (schema.storageMode == StorageMode::TIMESERIES) {
+        bool seal;
+        {
+            std::lock_guard<std::mutex> lock(compactMutex);
+            seal = ++pagedColumnRows[schema.tableId] >= TIMESERIES_SEAL_ROWS;
+        }
+        if (seal) sealSeries(schema);
+    }
+    
+    return true;
+}
+
+bool QueryEngine::updateRow(const TableSchema& schema, uint64_t tupleId, const Tuple& current,
+                            const std::map<std::string, Value>& values, uint64_t txnId, std::string& error,
+                            uint64_t* updatedTupleId) {
+    auto tableIndexes = getIndexes(schema.tableId);
+    
+    Tuple tuple = current;
+    tuple.txnId = txnId;
+    tuple.timestamp = std::chrono::system_clock::now().time_since_epoch().count();
+    for (const auto& [name, value] : values) {
+        if (!schema.isDocumentMode && !current.columns.count(name)) {
+            error = "unknown column " + name + " in table " + schema.tableName;
+            return false;
+        }
+        for (const auto& col : schema.columns) {
+            if (col.name == name && value.isNull() && (!col.nullable || col.primaryKey)) {
+                error = "column " + col.name + " cannot be NULL";
+                return false;
+            }
+        }
+        tuple.columns[name] = value;
+    }
+    
+    for (auto* index : tableIndexes) {
+        Value key = index->keyFor(tuple);
+        if (index->isUnique() && !key.isNull() && key.compare(index->keyFor(current)) != 0 &&
+            index->contains(key)) {
+            error = "duplicate key '" + key.toString() + "' violates unique index " + index->getName();
+            return false;
+        }
+    }
+    
+    // The old version follows the new one, for readers of the log that keep
+    // results derived from the rows
+    size_t length = tuple.serializedSize();
+    std::vector<uint8_t> payload;
+    payload.reserve(16 + length + current.serializedSize());
+    putFixed<uint32_t>(payload, schema.tableId);
+    putFixed<uint64_t>(payload, tupleId);
+    putFixed<uint32_t>(payload, static_cast<uint32_t>(length));
+    tuple.serialize(payload);
+    current.serialize(payload);
+    txnManager->logOperation(txnId, WALRecordType::UPDATE, payload);
+    
+    uint64_t newTupleId;
+    if (!storage->updateTuple(schema.tableId, tupleId, tuple, &newTupleId)) {
+        error = "row does not fit in a page";
         return false;
     }
+    if (updatedTupleId) *updatedTupleId = newTupleId;
+    
+    for (auto* index : tableIndexes) {
+        index->remove(index->keyFor(current), tupleId);
+        index->insert(index->keyFor(tuple), newTupleId);
+    }
+    
+    txnManager->addUndoAction(txnId, [this, schema, tupleId, newTupleId, current, tuple]() {
+        storage->deleteTuple(schema.tableId, newTupleId);
+        storage->deleteTuple(schema.tableId, tupleId, false);
+        for (auto* index : getIndexes(schema.tableId)) {
+            index->remove(index->keyFor(tuple), newTupleId);
+            index->insert(index->keyFor(current), tupleId);
+        }
+    });
+    
+    return true;
+}
+
+bool QueryEngine::removeRow(const TableSchema& schema, uint64_t tupleId, const Tuple& current, uint64_t txnId) {
+    std::vector<uint8_t> payload;
+    payload.reserve(12 + current.serializedSize());
+    putFixed<uint32_t>(payload, schema.tableId);
+    putFixed<uint64_t>(payload, tupleId);
+    current.serialize(payload);
+    txnManager->logOperation(txnId, WALRecordType::DELETE, payload);
+    
+    if (!storage->deleteTuple(schema.tableId, tupleId)) return false;
+    
+    for (auto* index : getIndexes(schema.tableId)) {
+        index->remove(index->keyFor(current), tupleId);
+    }
+    updateRowCount(schema.tableName, -1);
     
-    storage->dropTable(it->second.tableId);
-    catalog.erase(it);
-    saveCatalog();
+    txnManager->addUndoAction(txnId, [this, schema, tupleId, current]() {
+        storage->deleteTuple(schema.tableId, tupleId, false);
+        for (auto* index : getIndexes(schema.tableId)) {
+            index->insert(index->keyFor(current), tupleId);
+        }
+        updateRowCount(schema.tableName, 1);
+    });
     
     return true;
 }
 
-TableSchema* QueryEngine::getTableSchema(const std::string& name) {
+bool QueryEngine::update(const std::string& table, uint64_t rowId, const std::map<std::string, Value>& values, uint64_t txnId) {
+    TableSchema schema;
+    if (!lookupTable(table, schema)) return false;
+    
+    TableIterator iterator(storage, schema.tableId);
+    Tuple tuple;
+    uint64_t tupleId;
+    while (iterator.next(tuple, &tupleId)) {
+        if (tuple.rowId == rowId) {
+            std::string error;
+            return updateRow(schema, tupleId, tuple, values, txnId, error);
+        }
+    }
+    return false;
+}
+
+bool QueryEngine::remove(const std::string& table, uint64_t rowId, uint64_t txnId) {
+    TableSchema schema;
+    if (!lookupTable(table, schema)) return false;
+    
+    TableIterator iterator(storage, schema.tableId);
+    Tuple tuple;
+    uint64_t tupleId;
+    while (iterator.next(tuple, &tupleId)) {
+        if (tuple.rowId == rowId) {
+            return removeRow(schema, tupleId, tuple, txnId);
+        }
+    }
+    return false;
+}
+
+std::vector<Tuple> QueryEngine::select(const std::string& table, std::function<bool(const Tuple&)> filter) {
+    auto current = currentCatalog();
+    auto it = current->tables.find(table);
+    if (it == current->tables.end()) return {};
+    uint32_t tableId = it->second.schema->tableId;
+    
+    std::vector<Tuple> rows = storage->scanTable(tableId);
+    if (filter) {
+        rows.erase(std::remove_if(rows.begin(), rows.end(),
+                                  [&](const Tuple& t) { return !filter(t); }),
+                   rows.end());
+    }
+    return rows;
+}
+
+// Counters are atomics beside the schema; writers never wait on DDL
+uint64_t QueryEngine::allocateRowIds(const std::string& table, uint64_t count) {
+    auto current = currentCatalog();
+    auto it = current->tables.find(table);
+    if (it == current->tables.end()) return 0;
+    return it->second.counters->nextRowId.fetch_add(count);
+}
+
+void QueryEngine::updateRowCount(const std::string& table, int64_t delta) {
+    auto current = currentCatalog();
+    auto it = current->tables.find(table);
+    if (it != current->tables.end()) {
+        it->second.counters->rowCount.fetch_add(static_cast<uint64_t>(delta), std::memory_order_relaxed);
+    }
+}
+
+std::vector<TableIndex*> QueryEngine::getIndexes(uint32_t tableId) {
     std::shared_lock<std::shared_mutex> lock(catalogMutex);
     
-    auto it = catalog.find(name);
-    return (it != catalog.end()) ? &it->second : nullptr;
+    std::vector<TableIndex*> result;
+    auto it = indexes.find(tableId);
+    if (it != indexes.end()) {
+        for (auto& index : it->second) result.push_back(index.get());
+    }
+    return result;
 }
 
-void QueryEngine::saveCatalog() {
-    // Save catalog to disk
-    std::ofstream file("data/metadata/catalog.dat", std::ios::binary);
-    if (!file) return;
+// Rebuilds every index of a table from a heap scan, sorting keys up front.
+// The same walk recovers the row counters, which the catalog file only has
+// as of its last save.
+void QueryEngine::buildIndexes(const std::string& table) {
+    uint32_t tableId;
+    std::shared_ptr<TableCounters> counters;
+    {
+        std::unique_lock<std::shared_mutex> lock(catalogMutex);
+        auto current = currentCatalog();
+        auto it = current->tables.find(table);
+        if (it == current->tables.end()) return;
+        tableId = it->second.schema->tableId;
+        counters = it->second.counters;
+        createIndexes(*it->second.schema);
+    }
     
-    uint32_t count = catalog.size();
-    file.write(reinterpret_cast<const char*>(&count), sizeof(count));
+    auto tableIndexes = getIndexes(tableId);
+    std::vector<std::vector<std::pair<Value, uint64_t>>> keys(tableIndexes.size());
+    TableIterator iterator(storage, tableId);
+    Tuple tuple;
+    uint64_t tupleId;
+    uint64_t rows = 0, lastRowId = 0;
+    while (iterator.next(tuple, &tupleId)) {
+        for (size_t i = 0; i < tableIndexes.size(); i++) {
+            keys[i].emplace_back(tableIndexes[i]->keyFor(tuple), tupleId);
+        }
+        rows++;
+        lastRowId = std::max(lastRowId, tuple.rowId);
+    }
+    counters->rowCount = rows;
+    if (counters->nextRowId <= lastRowId) counters->nextRowId = lastRowId + 1;
     
-    for (const auto& [name, schema] : catalog) {
-        auto data = schema.serialize();
-        uint32_t len = data.size();
-        file.write(reinterpret_cast<const char*>(&len), sizeof(len));
-        file.write(reinterpret_cast<const char*>(data.data()), len);
+    std::string error;
+    for (size_t i = 0; i < tableIndexes.size(); i++) {
+        if (!tableIndexes[i]->bulkInsert(keys[i], error)) {
+            std::cerr << "Index rebuild for " << table << " failed: " << error << "\n";
+        }
     }
 }
 
-void QueryEngine::loadCatalog() {
-    std::ifstream file("data/metadata/catalog.dat", std::ios::binary);
-    if (!file) return;
+// Moves committed rows of a column table out of its pages into full column
+// blocks. Rows written by transactions still in flight stay behind, since
+// their undo actions refer to the page tuple ids.
+void QueryEngine::compactColumns(const TableSchema& schema) {
+    std::lock_guard<std::mutex> lock(compactMutex);
+    pagedColumnRows[schema.tableId] = 0;
+    
+    std::vector<Tuple> rows;
+    std::vector<uint64_t> heapIds;
+    TableIterator iterator(storage, schema.tableId, true);
+    Tuple tuple;
+    uint64_t tupleId;
+    while (iterator.next(tuple, &tupleId)) {
+        if (txnManager->isActive(tuple.txnId)) continue;
+        rows.push_back(std::move(tuple));
+        heapIds.push_back(tupleId);
+    }
     
-    uint32_t count;
-    file.read(reinterpret_cast<char*>(&count), sizeof(count));
+    size_t full = rows.size() - rows.size() % COLUMN_BLOCK_ROWS;
+    if (full == 0) return;
+    rows.resize(full);
+    heapIds.resize(full);
     
-    for (uint32_t i = 0; i < count; i++) {
-        uint32_t len;
-        file.read(reinterpret_cast<char*>(&len), sizeof(len));
-        
-        std::vector<uint8_t> data(len);
-        file.read(reinterpret_cast<char*>(data.data()), len);
+    auto* columnStore = storage->getColumnStore();
+    auto tableIndexes = getIndexes(schema.tableId);
+    for (size_t start = 0; start < full; start += COLUMN_BLOCK_ROWS) {
+        std::vector<Tuple> block(std::make_move_iterator(rows.begin() + start),
+                                 std::make_move_iterator(rows.begin() + start + COLUMN_BLOCK_ROWS));
+        uint64_t first;
+        if (!columnStore->appendBlock(schema.tableId, block, &first)) {
+            std::cerr << "Column compaction for " << schema.tableName << " failed\n";
+            return;
+        }
         
-        TableSchema schema = TableSchema::deserialize(data.data(), len);
-        catalog[schema.tableName] = schema;
-        tableIdCounter = std::max(tableIdCounter.load(), schema.tableId + 1);
+        std::vector<uint64_t> moved(heapIds.begin() + start, heapIds.begin() + start + COLUMN_BLOCK_ROWS);
+        storage->deleteTuples(schema.tableId, moved);
+        for (auto* index : tableIndexes) {
+            for (size_t i = 0; i < block.size(); i++) {
+                Value key = index->keyFor(block[i]);
+                index->remove(key, moved[i]);
+                index->insert(key, makeColumnTupleId(first + i));
+            }
+        }
     }
+    
+    // A scan racing the move may have seen some rows twice
+    if (resultCache) resultCache->invalidate(schema.tableId);
 }
 
-// Serialization implementations (simplified)
-std::vector<uint8_t> TableSchema::serialize() const {
-    std::vector<uint8_t> buffer;
-    // Implementation details...
-    return buffer;
+// Moves committed rows of a time-series table out of its pages into its
+// chunks, in batches so a large COPY is not held in memory twice. As with
+// compactColumns, rows of transactions in flight stay behind. Time-series
+// tables have no indexes to re-point.
+void QueryEngine::sealSeries(const TableSchema& schema) {
+    std::lock_guard<std::mutex> lock(compactMutex);
+    pagedColumnRows[schema.tableId] = 0;
+    
+    auto* seriesStore = storage->getTimeSeriesStore();
+    const size_t batchRows = 65536;
+    std::vector<Tuple> rows;
+    std::vector<uint64_t> heapIds;
+    auto seal = [&]() {
+        if (rows.empty()) return true;
+        if (!seriesStore->append(schema.tableId, rows)) {
+            std::cerr << "Sealing time-series table " << schema.tableName << " failed\n";
+            return false;
+        }
+        storage->deleteTuples(schema.tableId, heapIds);
+        rows.clear();
+        heapIds.clear();
+        return true;
+    };
+    
+    TableIterator iterator(storage, schema.tableId, true);
+    Tuple tuple;
+    uint64_t tupleId;
+    while (iterator.next(tuple, &tupleId)) {
+        if (txnManager->isActive(tuple.txnId)) continue;
+        rows.push_back(std::move(tuple));
+        heapIds.push_back(tupleId);
+        if (rows.size() >= batchRows && !seal()) return;
+    }
+    if (!seal()) return;
+    
+    uint64_t dropped = seriesStore->dropExpired(schema.tableId);
+    if (dropped) updateRowCount(schema.tableName, -static_cast<int64_t>(dropped));
+    
+    // Retention drops rows outside any transaction, and as in compactColumns
+    // a scan racing the move may have seen rows twice
+    if (resultCache) resultCache->invalidate(schema.tableId);
 }
 
-TableSchema TableSchema::deserialize(const uint8_t* data, size_t length) {
+std::unique_ptr<BulkLoader> QueryEngine::beginCopy(const std::string& table, CopyFormat format, uint64_t txnId) {
+    if (readOnly) return nullptr;
+    
     TableSchema schema;
-    // Implementation details...
-    return schema;
+    if (!lookupTable(table, schema) || !schema.shards.empty()) return nullptr;
+    return std::make_unique<BulkLoader>(this, storage, txnManager, schema, format, txnId);
+}
+
+// Tuple layout: rowId(8) txnId(8) timestamp(8) deleted(1) count(2)
+// followed by [nameLen(2) name Value] per column
+void Tuple::serialize(std::vector<uint8_t>& out) const {
+    // Grow once, and geometrically, so neither a reused buffer nor one many
+    // rows are appended to reallocates per column
+    size_t needed = out.size() + serializedSize();
+    if (needed > out.capacity()) out.reserve(std::max(needed, 2 * out.capacity()));
+    
+    putFixed<uint64_t>(out, rowId);
+    putFixed<uint64_t>(out, txnId);
+    putFixed<uint64_t>(out, timestamp);
+    out.push_back(deleted ? 1 : 0);
+    putFixed<uint16_t>(out, static_cast<uint16_t>(columns.size()));
+    
+    for (const auto& [name, value] : columns) {
+        putFixed<uint16_t>(out, static_cast<uint16_t>(name.size()));
+        putBytes(out, name.data(), name.size());
+        value.serialize(out);
+    }
 }
 
 std::vector<uint8_t> Tuple::serialize() const {
     std::vector<uint8_t> buffer;
-    // Implementation details...
+    buffer.reserve(serializedSize());
+    serialize(buffer);
     return buffer;
 }
 
+size_t Tuple::serializedSize() const {
+    size_t size = 27;
+    for (const auto& [name, value] : columns) size += 2 + name.size() + value.serializedSize();
+    return size;
+}
+
 Tuple Tuple::deserialize(const uint8_t* data, size_t length) {
     Tuple tuple;
-    // Implementation details...
+    tuple.rowId = 0;
+    tuple.txnId = 0;
+    tuple.timestamp = 0;
+    tuple.deleted = true;
+    if (length < 27) return tuple;
+    
+    memcpy(&tuple.rowId, data, 8);
+    memcpy(&tuple.txnId, data + 8, 8);
+    memcpy(&tuple.timestamp, data + 16, 8);
+    tuple.deleted = data[24] != 0;
+    
+    uint16_t count;
+    memcpy(&count, data + 25, 2);
+    
+    size_t offset = 27;
+    for (uint16_t i = 0; i < count && offset + 2 <= length; i++) {
+        uint16_t nameLen;
+        memcpy(&nameLen, data + offset, 2);
+        offset += 2;
+        
+        if (length - offset < nameLen) break;
+        std::string name(reinterpret_cast<const char*>(data + offset), nameLen);
+        offset += nameLen;
+        
+        Value value;
+        if (!Value::deserialize(data, length, offset, value)) break;
+        tuple.columns.emplace(std::move(name), std::move(value));
+    }
     return tuple;
 }
 
+void WALRecord::encode(std::vector<uint8_t>& out, WALRecordType type, uint64_t lsn, uint64_t txnId,
+                       const uint8_t* data, size_t length) {
+    putFixed<uint64_t>(out, lsn);
+    out.push_back(static_cast<uint8_t>(type));
+    putFixed<uint64_t>(out, txnId);
+    putVarint(out, length);
+    putBytes(out, data, length);
+}
+
+void WALRecord::serialize(std::vector<uint8_t>& out) const {
+    encode(out, type, lsn, txnId, data.data(), data.size());
+}
+
 std::vector<uint8_t> WALRecord::serialize() const {
     std::vector<uint8_t> buffer;
-    buffer.push_back(static_cast<uint8_t>(type));
-    for (int i = 0; i < 8; i++) buffer.push_back((lsn >> (i * 8)) & 0xFF);
-    for (int i = 0; i < 8; i++) buffer.push_back((txnId >> (i * 8)) & 0xFF);
-    buffer.insert(buffer.end(), data.begin(), data.end());
+    buffer.reserve(17 + varintSize(data.size()) + data.size());
+    serialize(buffer);
     return buffer;
 }
 
-WALRecord WALRecord::deserialize(const uint8_t* data) {
-    WALRecord record;
-    // Implementation details...
-    return record;
+bool WALRecord::decode(const uint8_t* buffer, size_t size, size_t& offset, WALRecordView& view) {
+    if (offset > size) return false;
+    ByteReader in(buffer + offset, size - offset);
+    view.lsn = in.get<uint64_t>();
+    view.type = static_cast<WALRecordType>(in.get<uint8_t>());
+    view.txnId = in.get<uint64_t>();
+    uint64_t length = in.varint();
+    if (!in.ok() || length > UINT32_MAX) return false;
+    view.length = static_cast<uint32_t>(length);
+    view.data = in.take(view.length);
+    if (!in.ok()) return false;
+    offset += in.consumed(buffer + offset);
+    return true;
+}
+
+bool WALRecord::deserialize(const uint8_t* buffer, size_t size, size_t& offset, WALRecord& record) {
+    WALRecordView view;
+    if (!decode(buffer, size, offset, view)) return false;
+    record.type = view.type;
+    record.lsn = view.lsn;
+    record.txnId = view.txnId;
+    record.length = view.length;
+    record.data.assign(view.data, view.data + view.length);
+    return true;
+}
+
+bool Value::deserialize(const uint8_t* data, size_t length, size_t& offset, Value& out) {
+    if (offset >= length) return false;
+    size_t left = length - offset - 1;
+    size_t need;
+    switch (static_cast<DataType>(data[offset])) {
+        case DataType::TYPE_NULL:
+            need = 0;
+            break;
+        case DataType::TYPE_BOOLEAN:
+            need = 1;
+            break;
+        case DataType::TYPE_INT8:
+        case DataType::TYPE_INT16:
+        case DataType::TYPE_INT32:
+        case DataType::TYPE_INT64:
+        case DataType::TYPE_TIMESTAMP:
+        case DataType::TYPE_FLOAT:
+        case DataType::TYPE_DOUBLE:
+            need = 8;
+            break;
+        case DataType::TYPE_STRING:
+        case DataType::TYPE_BINARY:
+        case DataType::TYPE_JSON: {
+            if (left < 4) return false;
+            uint32_t len;
+            memcpy(&len, data + offset + 1, 4);
+            need = 4 + static_cast<size_t>(len);
+            break;
+        }
+        default:
+            return false;
+    }
+    if (left < need) return false;
+    out = deserialize(data, offset);
+    return true;
 }
 
 Value Value::deserialize(const uint8_t* data, size_t& offset) {
     Value v;
-    // Implementation details...
+    v.type = static_cast<DataType>(data[offset++]);
+    
+    switch (v.type) {
+        case DataType::TYPE_NULL:
+            break;
+        case DataType::TYPE_BOOLEAN:
+            v.boolVal = data[offset++] != 0;
+            break;
+        case DataType::TYPE_INT8:
+        case DataType::TYPE_INT16:
+        case DataType::TYPE_INT32:
+        case DataType::TYPE_INT64:
+        case DataType::TYPE_TIMESTAMP:
+            memcpy(&v.intVal, data + offset, 8);
+            offset += 8;
+            break;
+        case DataType::TYPE_FLOAT:
+        case DataType::TYPE_DOUBLE:
+            memcpy(&v.doubleVal, data + offset, 8);
+            offset += 8;
+            break;
+        case DataType::TYPE_STRING: {
+            uint32_t len;
+            memcpy(&len, data + offset, 4);
+            offset += 4;
+            v.stringVal.assign(reinterpret_cast<const char*>(data + offset), len);
+            offset += len;
+            break;
+        }
+        case DataType::TYPE_BINARY:
+        case DataType::TYPE_JSON: {
+            uint32_t len;
+            memcpy(&len, data + offset, 4);
+            offset += 4;
+            v.binaryVal.assign(data + offset, data + offset + len);
+            offset += len;
+            break;
+        }
+    }
     return v;
 }
 
+// Total order used by indexes: NULL first, numbers compared by value across
+// widths, then strings, then raw bytes.
+int Value::compare(const Value& other) const {
+    if (isNull() || other.isNull()) {
+        return (isNull() ? 0 : 1) - (other.isNull() ? 0 : 1);
+    }
+    
+    if (isNumericType(type) && isNumericType(other.type)) {
+        if (isIntegerType(type) && isIntegerType(other.type)) {
+            return (intVal > other.intVal) - (intVal < other.intVal);
+        }
+        auto asDouble = [](const Value& v) {
+            if (v.type == DataType::TYPE_BOOLEAN) return v.boolVal ? 1.0 : 0.0;
+            return isIntegerType(v.type) ? static_cast<double>(v.intVal) : v.doubleVal;
+        };
+        double a = asDouble(*this), b = asDouble(other);
+        return (a > b) - (a < b);
+    }
+    
+    if (type == DataType::TYPE_STRING && other.type == DataType::TYPE_STRING) {
+        return stringVal.compare(other.stringVal);
+    }
+    
+    if (type != other.type) {
+        return static_cast<int>(type) - static_cast<int>(other.type);
+    }
+    
+    if (binaryVal == other.binaryVal) return 0;
+    return binaryVal < other.binaryVal ? -1 : 1;
+}
+
+// Numbers go through a double, as Value::compare does for mixed types, and
+// an integral one hashes as an int64 whatever its type
+uint64_t Value::hash() const {
+    uint8_t tag = static_cast<uint8_t>(type);
+    const void* data = nullptr;
+    size_t length = 0;
+    int64_t whole;
+    double number;
+    if (isNumericType(type)) {
+        number = type == DataType::TYPE_BOOLEAN ? (boolVal ? 1.0 : 0.0)
+                 : isIntegerType(type) ? static_cast<double>(intVal) : doubleVal;
+        if (number == std::trunc(number) && number >= -9.2e18 && number <= 9.2e18) {
+            tag = 'i';
+            whole = static_cast<int64_t>(number);
+            data = &whole;
+        } else {
+            tag = 'd';
+            data = &number;
+        }
+        length = 8;
+    } else if (type == DataType::TYPE_STRING) {
+        data = stringVal.data();
+        length = stringVal.size();
+    } else {
+        data = binaryVal.data();
+        length = binaryVal.size();
+    }
+    return hashBytes(data, length, hashBytes(&tag, 1));
+}
+
 bool Value::operator==(const Value& other) const {
     if (type != other.type) return false;
     switch (type) {
         case DataType::TYPE_BOOLEAN: return boolVal == other.boolVal;
-        case DataType::TYPE_INT64: return intVal == other.intVal;
+        case DataType::TYPE_INT8:
+        case DataType::TYPE_INT16:
+        case DataType::TYPE_INT32:
+        case DataType::TYPE_INT64:
+        case DataType::TYPE_TIMESTAMP: return intVal == other.intVal;
+        case DataType::TYPE_FLOAT:
+        case DataType::TYPE_DOUBLE: return doubleVal == other.doubleVal;
         case DataType::TYPE_STRING: return stringVal == other.stringVal;
+        case DataType::TYPE_BINARY:
+        case DataType::TYPE_JSON: return binaryVal == other.binaryVal;
         default: return false;
     }
 }
@@ -0,0 +1,1136 @@
+#include "../include/hybriddb.h"
+#include <cstring>
+#include <cstdio>
+#include <cmath>
+#include <algorithm>
+#include <sstream>
+#include <iomanip>
+#ifndef PLATFORM_WINDOWS
+#include <sys/stat.h>
+#endif
+
+namespace hybriddb {
+
+// ============================================================================
+// TIME-SERIES STORE IMPLEMENTATION
+// ============================================================================
+//
+// Files per table, under series_<id>/:
+//   series.def     column names, types and nullability, chunk interval, retention
+//   chunks.lst     next chunk number and every chunk's number and start time;
+//                  replaced whole (write + rename) when chunks come and go
+//   chunk_N.dat    encoded column chunks of chunk N, appended segment by segment;
+//                  the last one of each segment holds the rows' logical row ids
+//   chunk_N.dir    one length-prefixed entry per segment: first row ordinal, row
+//                  count and, per column, offset/length/encoding/zone map
+//   chunk_N.del    bitmap over chunk N's row ordinals
+//   rollups.log    bucket states appended after every seal; the last record for
+//                  a bucket wins, and the log is rewritten compactly on open
+// As in the column store, a segment becomes visible once its directory entry
+// is written.
+//
+// Gorilla streams are written most significant bit first, after the column
+// chunk's NULL prefix; NULL slots repeat the previous value. Delta-of-delta:
+// the first timestamp in 64 bits, then per row the change in delta as '0'
+// (none), '10' + 7 bits, '110' + 9 bits, '1110' + 12 bits or '1111' + 64
+// bits. XOR: the first value's bits, then per row '0' (same value), '10' and
+// the meaningful bits inside the previous window, or '11', 5 bits of leading
+// zeros, 6 bits of length and the meaningful bits.
+
+static const char SERIES_CHUNKS_MAGIC[4] = {'H', 'D', 'B', 'T'};
+static const int64_t ROLLUP_WIDTHS[2] = {60, 3600};
+
+namespace {
+
+class BitWriter {
+private:
+    std::vector<uint8_t>& out;
+    uint64_t acc;       // filled from the top
+    int used;
+    
+public:
+    explicit BitWriter(std::vector<uint8_t>& buffer) : out(buffer), acc(0), used(0) {}
+    
+    // The low count bits of value, count <= 64
+    void write(uint64_t value, int count) {
+        while (count > 0) {
+            int take = std::min(count, 64 - used);
+            uint64_t bits = value >> (count - take);
+            if (take < 64) bits &= (1ULL << take) - 1;
+            acc |= bits << (64 - used - take);
+            used += take;
+            count -= take;
+            if (used == 64) {
+                for (int shift = 56; shift >= 0; shift -= 8) out.push_back(static_cast<uint8_t>(acc >> shift));
+                acc = 0;
+                used = 0;
+            }
+        }
+    }
+    
+    void finish() {
+        for (int shift = 56; used > 0; shift -= 8, used -= 8) out.push_back(static_cast<uint8_t>(acc >> shift));
+        acc = 0;
+        used = 0;
+    }
+};
+
+// Reads whole words, so data needs 9 readable bytes past its length
+class BitReader {
+private:
+    const uint8_t* data;
+    size_t bits;
+    size_t pos;
+    
+public:
+    BitReader(const uint8_t* bytes, size_t length) : data(bytes), bits(length * 8), pos(0) {}
+    
+    // count in 1..64
+    bool read(int count, uint64_t& value) {
+        if (pos + count > bits) return false;
+        size_t byte = pos >> 3;
+        int shift = pos & 7;
+        uint64_t word;
+        memcpy(&word, data + byte, sizeof(word));
+        word = __builtin_bswap64(word) << shift;
+        if (count > 64 - shift) word |= data[byte + 8] >> (8 - shift);
+        value = word >> (64 - count);
+        pos += count;
+        return true;
+    }
+    
+    bool bit(bool& set) {
+        if (pos >= bits) return false;
+        set = (data[pos >> 3] >> (7 - (pos & 7))) & 1;
+        pos++;
+        return true;
+    }
+};
+
+inline int64_t floorTo(int64_t t, int64_t width) {
+    int64_t q = t / width;
+    if (t % width != 0 && t < 0) q--;
+    return q * width;
+}
+
+bool usesInts(DataType type) {
+    return isIntegerType(type) || type == DataType::TYPE_BOOLEAN;
+}
+
+bool usesDoubles(DataType type) {
+    return type == DataType::TYPE_FLOAT || type == DataType::TYPE_DOUBLE;
+}
+
+int64_t asInt(const Value& v) {
+    if (v.type == DataType::TYPE_BOOLEAN) return v.boolVal ? 1 : 0;
+    if (usesDoubles(v.type)) return static_cast<int64_t>(v.doubleVal);
+    return v.intVal;
+}
+
+double asDouble(const Value& v) {
+    if (usesDoubles(v.type)) return v.doubleVal;
+    if (v.type == DataType::TYPE_BOOLEAN) return v.boolVal ? 1.0 : 0.0;
+    return static_cast<double>(v.intVal);
+}
+
+Value typed(Value v, DataType type) {
+    v.type = type;
+    return v;
+}
+
+void encodeDeltaOfDelta(const std::vector<int64_t>& values, std::vector<uint8_t>& out) {
+    BitWriter writer(out);
+    writer.write(static_cast<uint64_t>(values[0]), 64);
+    
+    uint64_t previousDelta = 0;
+    for (size_t i = 1; i < values.size(); i++) {
+        uint64_t delta = static_cast<uint64_t>(values[i]) - static_cast<uint64_t>(values[i - 1]);
+        int64_t dod = static_cast<int64_t>(delta - previousDelta);
+        previousDelta = delta;
+        
+        if (dod == 0) {
+            writer.write(0, 1);
+        } else if (dod >= -63 && dod <= 64) {
+            writer.write(0x2, 2);
+            writer.write(static_cast<uint64_t>(dod + 63), 7);
+        } else if (dod >= -255 && dod <= 256) {
+            writer.write(0x6, 3);
+            writer.write(static_cast<uint64_t>(dod + 255), 9);
+        } else if (dod >= -2047 && dod <= 2048) {
+            writer.write(0xE, 4);
+            writer.write(static_cast<uint64_t>(dod + 2047), 12);
+        } else {
+            writer.write(0xF, 4);
+            writer.write(static_cast<uint64_t>(dod), 64);
+        }
+    }
+    writer.finish();
+}
+
+bool decodeDeltaOfDelta(const uint8_t* data, size_t length, size_t n, std::vector<int64_t>& out) {
+    BitReader reader(data, length);
+    out.resize(n);
+    
+    uint64_t value;
+    if (!reader.read(64, value)) return false;
+    out[0] = static_cast<int64_t>(value);
+    
+    uint64_t delta = 0;
+    for (size_t i = 1; i < n; i++) {
+        // Count the leading 1s of the prefix, up to four
+        int ones = 0;
+        bool set = true;
+        while (ones < 4) {
+            if (!reader.bit(set)) return false;
+            if (!set) break;
+            ones++;
+        }
+        
+        static const int widths[] = {0, 7, 9, 12, 64};
+        static const int64_t biases[] = {0, 63, 255, 2047, 0};
+        uint64_t bits = 0;
+        if (ones > 0 && !reader.read(widths[ones], bits)) return false;
+        int64_t dod = static_cast<int64_t>(bits) - biases[ones];
+        
+        delta += static_cast<uint64_t>(dod);
+        value += delta;
+        out[i] = static_cast<int64_t>(value);
+    }
+    return true;
+}
+
+void encodeXOR(const std::vector<double>& values, std::vector<uint8_t>& out) {
+    BitWriter writer(out);
+    uint64_t previous;
+    memcpy(&previous, &values[0], sizeof(previous));
+    writer.write(previous, 64);
+    
+    int leading = -1, trailing = 0;
+    for (size_t i = 1; i < values.size(); i++) {
+        uint64_t current;
+        memcpy(&current, &values[i], sizeof(current));
+        uint64_t x = current ^ previous;
+        previous = current;
+        
+        if (x == 0) {
+            writer.write(0, 1);
+            continue;
+        }
+        
+        int lead = std::min(__builtin_clzll(x), 31);
+        int trail = __builtin_ctzll(x);
+        if (leading >= 0 && lead >= leading && trail >= trailing) {
+            writer.write(0x2, 2);
+            writer.write(x >> trailing, 64 - leading - trailing);
+        } else {
+            int significant = 64 - lead - trail;
+            writer.write(0x3, 2);
+            writer.write(lead, 5);
+            writer.write(significant & 63, 6);
+            writer.write(x >> trail, significant);
+            leading = lead;
+            trailing = trail;
+        }
+    }
+    writer.finish();
+}
+
+bool decodeXOR(const uint8_t* data, size_t length, size_t n, std::vector<double>& out) {
+    BitReader reader(data, length);
+    out.resize(n);
+    
+    uint64_t previous;
+    if (!reader.read(64, previous)) return false;
+    memcpy(&out[0], &previous, sizeof(double));
+    
+    int leading = -1, trailing = 0;
+    for (size_t i = 1; i < n; i++) {
+        bool set;
+        if (!reader.bit(set)) return false;
+        if (set) {
+            if (!reader.bit(set)) return false;
+            if (set) {
+                uint64_t lead, significant;
+                if (!reader.read(5, lead) || !reader.read(6, significant)) return false;
+                if (significant == 0) significant = 64;
+                if (lead + significant > 64) return false;
+                leading = static_cast<int>(lead);
+                trailing = 64 - leading - static_cast<int>(significant);
+            } else if (leading < 0) {
+                return false;
+            }
+            
+            uint64_t x;
+            if (!reader.read(64 - leading - trailing, x)) return false;
+            previous ^= x << trailing;
+        }
+        memcpy(&out[i], &previous, sizeof(double));
+    }
+    return true;
+}
+
+// Timestamps (and any other integer column asked for) as delta-of-delta,
+// doubles as XOR; zone gets min/max over the non-NULL values
+ColumnEncoding encodeGorilla(const std::vector<const Value*>& column, DataType type,
+                             std::vector<uint8_t>& out, ZoneMap& zone) {
+    size_t n = column.size();
+    zone.min = Value();
+    zone.max = Value();
+    zone.nullCount = 0;
+    
+    std::vector<uint8_t> nulls((n + 7) / 8, 0);
+    for (size_t i = 0; i < n; i++) {
+        if (!column[i] || column[i]->isNull()) {
+            nulls[i / 8] |= 1 << (i % 8);
+            zone.nullCount++;
+        }
+    }
+    out.push_back(zone.nullCount > 0 ? 1 : 0);
+    if (zone.nullCount > 0) out.insert(out.end(), nulls.begin(), nulls.end());
+    
+    size_t first = 0;
+    while (first < n && (!column[first] || column[first]->isNull())) first++;
+    auto present = [&](size_t i) { return column[i] && !column[i]->isNull(); };
+    
+    if (usesInts(type)) {
+        std::vector<int64_t> values(n);
+        int64_t last = first < n ? asInt(*column[first]) : 0;
+        int64_t min = INT64_MAX, max = INT64_MIN;
+        for (size_t i = 0; i < n; i++) {
+            if (present(i)) {
+                last = asInt(*column[i]);
+                min = std::min(min, last);
+                max = std::max(max, last);
+            }
+            values[i] = last;
+        }
+        if (first < n) {
+            zone.min = typed(Value(min), type);
+            zone.max = typed(Value(max), type);
+        }
+        encodeDeltaOfDelta(values, out);
+        return ColumnEncoding::DELTA_OF_DELTA;
+    }
+    
+    std::vector<double> values(n);
+    double last = first < n ? asDouble(*column[first]) : 0.0;
+    double min = last, max = last;
+    for (size_t i = 0; i < n; i++) {
+        if (present(i)) {
+            last = asDouble(*column[i]);
+            min = std::min(min, last);
+            max = std::max(max, last);
+        }
+        values[i] = last;
+    }
+    if (first < n) {
+        zone.min = typed(Value(min), type);
+        zone.max = typed(Value(max), type);
+    }
+    encodeXOR(values, out);
+    return ColumnEncoding::XOR;
+}
+
+bool decodeGorilla(const uint8_t* data, size_t length, ColumnEncoding encoding, DataType type,
+                   size_t n, ColumnVector& out) {
+    out.type = type;
+    out.ints.clear();
+    out.doubles.clear();
+    out.values.clear();
+    out.nulls.clear();
+    if (length < 1) return false;
+    
+    size_t offset = 1;
+    if (data[0]) {
+        offset += (n + 7) / 8;
+        if (offset > length) return false;
+        out.nulls.resize(n);
+        for (size_t i = 0; i < n; i++) out.nulls[i] = (data[1 + i / 8] >> (i % 8)) & 1;
+    }
+    
+    if (encoding == ColumnEncoding::DELTA_OF_DELTA) {
+        return usesInts(type) && decodeDeltaOfDelta(data + offset, length - offset, n, out.ints);
+    }
+    return usesDoubles(type) && decodeXOR(data + offset, length - offset, n, out.doubles);
+}
+
+void removeDirectory(const std::string& directory) {
+#ifdef PLATFORM_WINDOWS
+    RemoveDirectoryA(directory.c_str());
+#else
+    rmdir(directory.c_str());
+#endif
+}
+
+std::vector<uint8_t> readFile(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    return std::vector<uint8_t>(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+} // namespace
+
+TimeSeriesStore::TimeSeriesStore(const std::string& dataDir)
+    : dataDirectory(dataDir), chunksDropped(0), rowsSealed(0), timestampBytes(0), values(0), valueBytes(0) {}
+    
+std::string TimeSeriesStore::tableDirectory(uint32_t tableId) const {
+    std::ostringstream path;
+    path << dataDirectory << "/series_" << std::setfill('0') << std::setw(6) << tableId;
+    return path.str();
+}
+
+std::string TimeSeriesStore::chunkPath(const Table& table, uint32_t chunk, const char* extension) const {
+    std::ostringstream path;
+    path << table.directory << "/chunk_" << std::setfill('0') << std::setw(6) << chunk << extension;
+    return path.str();
+}
+
+bool TimeSeriesStore::createTable(uint32_t tableId, const std::vector<ColumnDef>& columns,
+                                  const SeriesOptions& options) {
+    std::lock_guard<std::mutex> lock(mutex);
+    
+    bool timed = false;
+    for (const auto& col : columns) timed |= col.type == DataType::TYPE_TIMESTAMP;
+    if (!timed || options.chunkInterval <= 0 || options.retention < 0) return false;
+    
+    std::string directory = tableDirectory(tableId);
+#ifdef PLATFORM_WINDOWS
+    CreateDirectoryA(directory.c_str(), NULL);
+#else
+    mkdir(directory.c_str(), 0755);
+#endif
+    
+    std::vector<uint8_t> definition;
+    putFixed<uint16_t>(definition, columns.size());
+    for (const auto& col : columns) {
+        putFixed<uint16_t>(definition, col.name.size());
+        definition.insert(definition.end(), col.name.begin(), col.name.end());
+        definition.push_back(static_cast<uint8_t>(col.type));
+        definition.push_back(col.nullable ? 1 : 0);
+    }
+    putFixed<int64_t>(definition, options.chunkInterval);
+    putFixed<int64_t>(definition, options.retention);
+    
+    std::ofstream file(directory + "/series.def", std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(definition.data()), definition.size());
+    if (!file) return false;
+    file.close();
+    
+    std::vector<uint8_t> manifest(SERIES_CHUNKS_MAGIC, SERIES_CHUNKS_MAGIC + 4);
+    putFixed<uint32_t>(manifest, 0);
+    putFixed<uint32_t>(manifest, 0);
+    std::ofstream chunks(directory + "/chunks.lst", std::ios::binary | std::ios::trunc);
+    chunks.write(reinterpret_cast<const char*>(manifest.data()), manifest.size());
+    if (!chunks) return false;
+    chunks.close();
+    std::ofstream(directory + "/rollups.log", std::ios::binary | std::ios::trunc);
+    
+    tables.erase(tableId);
+    return openTable(tableId) != nullptr;
+}
+
+bool TimeSeriesStore::dropTable(uint32_t tableId) {
+    std::lock_guard<std::mutex> lock(mutex);
+    
+    Table* table = openTable(tableId);
+    if (!table) return false;
+    
+    std::vector<uint32_t> ids;
+    for (const auto& [id, partition] : table->chunkIds) ids.push_back(id);
+    std::string directory = table->directory;
+    std::vector<std::string> paths;
+    for (uint32_t id : ids) {
+        for (const char* extension : {".dat", ".dir", ".del"}) paths.push_back(chunkPath(*table, id, extension));
+    }
+    tables.erase(tableId);
+    
+    for (const auto& path : paths) remove(path.c_str());
+    remove((directory + "/series.def").c_str());
+    remove((directory + "/chunks.lst").c_str());
+    remove((directory + "/rollups.log").c_str());
+    removeDirectory(directory);
+    return true;
+}
+
+// Loads a table's definition, chunk directories and rollups on first use
+TimeSeriesStore::Table* TimeSeriesStore::openTable(uint32_t tableId) {
+    auto it = tables.find(tableId);
+    if (it != tables.end()) return it->second.get();
+    
+    std::string directory = tableDirectory(tableId);
+    std::vector<uint8_t> bytes = readFile(directory + "/series.def");
+    if (bytes.empty()) {
+        tables[tableId] = nullptr;
+        return nullptr;
+    }
+    
+    auto table = std::make_unique<Table>();
+    table->directory = directory;
+    table->timeColumn = SIZE_MAX;
+    table->nextChunk = 0;
+    table->newest = INT64_MIN;
+    
+    ByteReader in(bytes.data(), bytes.size());
+    uint16_t count = in.get<uint16_t>();
+    for (uint16_t c = 0; c < count && in.ok(); c++) {
+        ColumnDef col;
+        uint16_t nameLength = in.get<uint16_t>();
+        const uint8_t* name = in.take(nameLength);
+        if (!name) break;
+        col.name.assign(reinterpret_cast<const char*>(name), nameLength);
+        col.type = static_cast<DataType>(in.get<uint8_t>());
+        col.nullable = in.get<uint8_t>() != 0;
+        col.primaryKey = false;
+        col.unique = false;
+        
+        size_t position = table->columns.size();
+        if (col.type == DataType::TYPE_TIMESTAMP && table->timeColumn == SIZE_MAX) {
+            table->timeColumn = position;
+        } else if (col.type == DataType::TYPE_STRING) {
+            table->tagColumns.push_back(position);
+        } else if (isNumericType(col.type) && col.type != DataType::TYPE_BOOLEAN) {
+            table->valueColumns.push_back(position);
+        }
+        table->columns.push_back(col);
+    }
+    table->options.chunkInterval = in.get<int64_t>();
+    table->options.retention = in.get<int64_t>();
+    if (!in.ok() || table->timeColumn == SIZE_MAX || table->options.chunkInterval <= 0) {
+        std::cerr << "Could not open time-series table " << directory << "\n";
+        tables[tableId] = nullptr;
+        return nullptr;
+    }
+    
+    bytes = readFile(directory + "/chunks.lst");
+    ByteReader manifest(bytes.data(), bytes.size());
+    const uint8_t* magic = manifest.take(4);
+    if (!magic || memcmp(magic, SERIES_CHUNKS_MAGIC, 4) != 0) {
+        std::cerr << "Could not open time-series table " << directory << ": damaged chunk list\n";
+        tables[tableId] = nullptr;
+        return nullptr;
+    }
+    table->nextChunk = manifest.get<uint32_t>();
+    uint32_t chunks = manifest.get<uint32_t>();
+    for (uint32_t c = 0; c < chunks && manifest.ok(); c++) {
+        uint32_t id = manifest.get<uint32_t>();
+        int64_t start = manifest.get<int64_t>();
+        if (!manifest.ok()) break;
+        if (!openPartition(*table, id, start, false)) {
+            std::cerr << "Skipping unreadable chunk " << chunkPath(*table, id, ".dat") << "\n";
+        }
+    }
+    for (const auto& [start, partition] : table->chunks) {
+        for (const auto& segment : partition->segments) {
+            const ZoneMap& zone = segment.chunks[table->timeColumn].zone;
+            if (!zone.max.isNull()) table->newest = std::max(table->newest, zone.max.intVal);
+        }
+    }
+    
+    // Replay the rollup log, then rewrite it with one record per bucket
+    bytes = readFile(directory + "/rollups.log");
+    ByteReader records(bytes.data(), bytes.size());
+    while (records.remaining() >= sizeof(uint32_t)) {
+        uint32_t length = records.get<uint32_t>();
+        const uint8_t* data = records.take(length);
+        if (!data) break;
+        
+        ByteReader record(data, length);
+        uint8_t which = record.get<uint8_t>();
+        int64_t bucketStart = record.get<int64_t>();
+        uint16_t keyLength = record.get<uint16_t>();
+        const uint8_t* key = record.take(keyLength);
+        Bucket bucket;
+        bucket.rows = record.get<uint64_t>();
+        uint16_t stats = record.get<uint16_t>();
+        for (uint16_t s = 0; s < stats && record.ok(); s++) {
+            Stat stat;
+            stat.count = record.get<uint64_t>();
+            stat.sum = record.get<double>();
+            stat.min = record.get<double>();
+            stat.max = record.get<double>();
+            bucket.stats.push_back(stat);
+        }
+        if (!record.ok() || which > 1 || bucket.stats.size() != table->valueColumns.size()) break;
+        std::string series(reinterpret_cast<const char*>(key), keyLength);
+        table->rollups[which][{bucketStart, series}] = std::move(bucket);
+    }
+    
+    std::vector<std::pair<int, std::pair<int64_t, std::string>>> all;
+    for (int w = 0; w < 2; w++) {
+        for (const auto& [key, bucket] : table->rollups[w]) all.emplace_back(w, key);
+    }
+    std::string logPath = directory + "/rollups.log";
+    table->rollupLog.open(logPath + ".tmp", std::ios::binary | std::ios::trunc);
+    if (!appendRollups(*table, all) || (table->rollupLog.close(), rename((logPath + ".tmp").c_str(), logPath.c_str()) != 0)) {
+        std::cerr << "Could not rewrite " << logPath << "\n";
+    }
+    table->rollupLog.open(logPath, std::ios::binary | std::ios::app);
+    
+    Table* opened = table.get();
+    tables[tableId] = std::move(table);
+    return opened;
+}
+
+bool TimeSeriesStore::openPartition(Table& table, uint32_t id, int64_t start, bool create) {
+    auto partition = std::make_unique<Partition>();
+    partition->id = id;
+    partition->start = start;
+    partition->rowCount = 0;
+    
+    if (create) {
+        for (const char* extension : {".dat", ".dir", ".del"}) {
+            std::ofstream file(chunkPath(table, id, extension), std::ios::binary | std::ios::trunc);
+            if (!file) return false;
+        }
+    }
+    
+    // A torn entry at the end of the directory is a segment that never finished
+    std::vector<uint8_t> bytes = readFile(chunkPath(table, id, ".dir"));
+    ByteReader entries(bytes.data(), bytes.size());
+    while (entries.remaining() >= sizeof(uint32_t)) {
+        uint32_t length = entries.get<uint32_t>();
+        const uint8_t* data = entries.take(length);
+        if (!data) break;
+        
+        ByteReader entry(data, length);
+        Segment segment;
+        segment.firstRow = entry.get<uint32_t>();
+        segment.rowCount = entry.get<uint32_t>();
+        uint16_t chunks = entry.get<uint16_t>();
+        for (uint16_t c = 0; c < chunks && entry.ok(); c++) {
+            Chunk chunk;
+            chunk.offset = entry.get<uint64_t>();
+            chunk.length = entry.get<uint32_t>();
+            chunk.encoding = static_cast<ColumnEncoding>(entry.get<uint8_t>());
+            chunk.zone.nullCount = entry.get<uint32_t>();
+            chunk.zone.min = entry.value();
+            chunk.zone.max = entry.value();
+            segment.chunks.push_back(chunk);
+        }
+        if (!entry.ok() || segment.chunks.size() != table.columns.size() + 1) break;
+        
+        partition->rowCount = segment.firstRow + segment.rowCount;
+        partition->segments.push_back(std::move(segment));
+    }
+    
+    partition->deleted = readFile(chunkPath(table, id, ".del"));
+    partition->deleted.resize((partition->rowCount + 7) / 8, 0);
+    
+    auto mode = std::ios::in | std::ios::out | std::ios::binary;
+    partition->data.open(chunkPath(table, id, ".dat"), mode);
+    partition->directoryFile.open(chunkPath(table, id, ".dir"), mode);
+    partition->deleteFile.open(chunkPath(table, id, ".del"), mode);
+    if (!partition->data || !partition->directoryFile || !partition->deleteFile) return false;
+    
+    table.chunkIds[id] = partition.get();
+    table.chunks[start] = std::move(partition);
+    return true;
+}
+
+bool TimeSeriesStore::writeManifest(Table& table) {
+    std::vector<uint8_t> manifest(SERIES_CHUNKS_MAGIC, SERIES_CHUNKS_MAGIC + 4);
+    putFixed<uint32_t>(manifest, table.nextChunk);
+    putFixed<uint32_t>(manifest, table.chunks.size());
+    for (const auto& [start, partition] : table.chunks) {
+        putFixed<uint32_t>(manifest, partition->id);
+        putFixed<int64_t>(manifest, start);
+    }
+    
+    std::string path = table.directory + "/chunks.lst";
+    std::ofstream file(path + ".tmp", std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(manifest.data()), manifest.size());
+    file.close();
+    if (!file) return false;
+    return rename((path + ".tmp").c_str(), path.c_str()) == 0;
+}
+
+bool TimeSeriesStore::writeSegment(Table& table, Partition& partition, const Tuple* rows, size_t count) {
+    std::vector<Chunk> chunks;
+    std::vector<const Value*> column(count);
+    std::vector<uint8_t> buffer;
+    
+    auto writeChunk = [&](ColumnEncoding encoding, const ZoneMap& zone) {
+        partition.data.seekp(0, std::ios::end);
+        uint64_t offset = static_cast<uint64_t>(partition.data.tellp());
+        partition.data.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+        chunks.push_back({offset, static_cast<uint32_t>(buffer.size()), encoding, zone});
+        return static_cast<bool>(partition.data);
+    };
+    
+    for (size_t c = 0; c < table.columns.size(); c++) {
+        const ColumnDef& col = table.columns[c];
+        for (size_t r = 0; r < count; r++) {
+            auto it = rows[r].columns.find(col.name);
+            column[r] = it != rows[r].columns.end() ? &it->second : nullptr;
+        }
+        
+        ZoneMap zone;
+        buffer.clear();
+        ColumnEncoding encoding;
+        if (c == table.timeColumn) {
+            encoding = encodeGorilla(column, col.type, buffer, zone);
+            timestampBytes += buffer.size();
+        } else if (usesDoubles(col.type)) {
+            encoding = encodeGorilla(column, col.type, buffer, zone);
+            values += count - zone.nullCount;
+            valueBytes += buffer.size();
+        } else {
+            encoding = encodeColumnChunk(column, col.type, buffer, zone);
+        }
+        if (!writeChunk(encoding, zone)) return false;
+    }
+    
+    std::vector<Value> rowIds;
+    rowIds.reserve(count);
+    for (size_t r = 0; r < count; r++) {
+        rowIds.emplace_back(static_cast<int64_t>(rows[r].rowId));
+        column[r] = &rowIds[r];
+    }
+    ZoneMap zone;
+    buffer.clear();
+    ColumnEncoding encoding = encodeColumnChunk(column, DataType::TYPE_INT64, buffer, zone);
+    if (!writeChunk(encoding, zone)) return false;
+    partition.data.flush();
+    
+    // The directory entry is what publishes the segment
+    std::vector<uint8_t> entry;
+    putFixed<uint32_t>(entry, partition.rowCount);
+    putFixed<uint32_t>(entry, count);
+    putFixed<uint16_t>(entry, chunks.size());
+    for (const auto& chunk : chunks) {
+        putFixed<uint64_t>(entry, chunk.offset);
+        putFixed<uint32_t>(entry, chunk.length);
+        entry.push_back(static_cast<uint8_t>(chunk.encoding));
+        putFixed<uint32_t>(entry, chunk.zone.nullCount);
+        chunk.zone.min.serialize(entry);
+        chunk.zone.max.serialize(entry);
+    }
+    uint32_t entryLength = entry.size();
+    partition.directoryFile.seekp(0, std::ios::end);
+    partition.directoryFile.write(reinterpret_cast<const char*>(&entryLength), sizeof(entryLength));
+    partition.directoryFile.write(reinterpret_cast<const char*>(entry.data()), entry.size());
+    partition.directoryFile.flush();
+    if (!partition.directoryFile) return false;
+    
+    Segment segment;
+    segment.firstRow = partition.rowCount;
+    segment.rowCount = count;
+    segment.chunks = std::move(chunks);
+    partition.segments.push_back(std::move(segment));
+    partition.rowCount += count;
+    partition.deleted.resize((partition.rowCount + 7) / 8, 0);
+    return true;
+}
+
+bool TimeSeriesStore::readChunk(Table& table, Partition& partition, const Segment& segment, size_t column,
+                                ColumnVector& out) {
+    const Chunk& chunk = segment.chunks[column];
+    DataType type = column < table.columns.size() ? table.columns[column].type : DataType::TYPE_INT64;
+    
+    // Padded so bit unpacking can read whole words past the end
+    thread_local std::vector<uint8_t> buffer;
+    buffer.assign(chunk.length + 16, 0);
+    
+    partition.data.seekg(chunk.offset);
+    partition.data.read(reinterpret_cast<char*>(buffer.data()), chunk.length);
+    if (!partition.data) {
+        partition.data.clear();
+        return false;
+    }
+    if (chunk.encoding == ColumnEncoding::DELTA_OF_DELTA || chunk.encoding == ColumnEncoding::XOR) {
+        return decodeGorilla(buffer.data(), chunk.length, chunk.encoding, type, segment.rowCount, out);
+    }
+    return decodeColumnChunk(buffer.data(), chunk.length, chunk.encoding, type, segment.rowCount, out);
+}
+
+int64_t TimeSeriesStore::timeOf(const Table& table, const Tuple& row) const {
+    auto it = row.columns.find(table.columns[table.timeColumn].name);
+    return it == row.columns.end() || it->second.isNull() ? 0 : asInt(it->second);
+}
+
+std::string TimeSeriesStore::seriesKey(const Table& table, const Tuple& row) const {
+    std::string key;
+    for (size_t c : table.tagColumns) {
+        auto it = row.columns.find(table.columns[c].name);
+        auto bytes = it != row.columns.end() ? it->second.serialize() : Value().serialize();
+        key.append(bytes.begin(), bytes.end());
+    }
+    return key;
+}
+
+void TimeSeriesStore::fold(const Table& table, Rollup& rollup, int64_t bucketStart, const std::string& key,
+                           const Tuple& row) const {
+    Bucket& bucket = rollup[{bucketStart, key}];
+    if (bucket.stats.empty()) {
+        bucket.rows = 0;
+        bucket.stats.assign(table.valueColumns.size(), Stat{0, 0.0, 0.0, 0.0});
+    }
+    bucket.rows++;
+    
+    for (size_t i = 0; i < table.valueColumns.size(); i++) {
+        auto it = row.columns.find(table.columns[table.valueColumns[i]].name);
+        if (it == row.columns.end() || it->second.isNull()) continue;
+        double v = asDouble(it->second);
+        Stat& stat = bucket.stats[i];
+        stat.min = stat.count ? std::min(stat.min, v) : v;
+        stat.max = stat.count ? std::max(stat.max, v) : v;
+        stat.sum += v;
+        stat.count++;
+    }
+}
+
+bool TimeSeriesStore::appendRollups(Table& table,
+                                    const std::vector<std::pair<int, std::pair<int64_t, std::string>>>& touched) {
+    std::vector<uint8_t> records;
+    for (const auto& [which, key] : touched) {
+        auto it = table.rollups[which].find(key);
+        if (it == table.rollups[which].end()) continue;
+        
+        std::vector<uint8_t> record;
+        record.push_back(static_cast<uint8_t>(which));
+        putFixed<int64_t>(record, key.first);
+        putFixed<uint16_t>(record, key.second.size());
+        record.insert(record.end(), key.second.begin(), key.second.end());
+        putFixed<uint64_t>(record, it->second.rows);
+        putFixed<uint16_t>(record, it->second.stats.size());
+        for (const auto& stat : it->second.stats) {
+            putFixed<uint64_t>(record, stat.count);
+            putFixed<double>(record, stat.sum);
+            putFixed<double>(record, stat.min);
+            putFixed<double>(record, stat.max);
+        }
+        putFixed<uint32_t>(records, record.size());
+        records.insert(records.end(), record.begin(), record.end());
+    }
+    
+    table.rollupLog.write(reinterpret_cast<const char*>(records.data()), records.size());
+    table.rollupLog.flush();
+    return static_cast<bool>(table.rollupLog);
+}
+
+bool TimeSeriesStore::isSeriesTable(uint32_t tableId) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return openTable(tableId) != nullptr;
+}
+
+std::vector<ColumnDef> TimeSeriesStore::getColumns(uint32_t tableId) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Table* table = openTable(tableId);
+    return table ? table->columns : std::vector<ColumnDef>();
+}
+
+bool TimeSeriesStore::append(uint32_t tableId, std::vector<Tuple>& rows) {
+    std::lock_guard<std::mutex> lock(mutex);
+    
+    Table* table = openTable(tableId);
+    if (!table) return false;
+    if (rows.empty()) return true;
+    
+    std::vector<std::pair<int64_t, size_t>> order(rows.size());
+    for (size_t i = 0; i < rows.size(); i++) order[i] = {timeOf(*table, rows[i]), i};
+    std::stable_sort(order.begin(), order.end(),
+                     [](const std::pair<int64_t, size_t>& a, const std::pair<int64_t, size_t>& b) {
+                         return a.first < b.first;
+                     });
+    std::vector<Tuple> sorted;
+    sorted.reserve(rows.size());
+    for (const auto& entry : order) sorted.push_back(std::move(rows[entry.second]));
+    rows.swap(sorted);
+    
+    int64_t interval = table->options.chunkInterval;
+    size_t i = 0;
+    while (i < rows.size()) {
+        int64_t start = floorTo(order[i].first, interval);
+        size_t end = i;
+        while (end < rows.size() && floorTo(order[end].first, interval) == start) end++;
+        
+        auto it = table->chunks.find(start);
+        if (it == table->chunks.end()) {
+            if (table->nextChunk > 0xFFFFFF) return false;
+            if (!openPartition(*table, table->nextChunk, start, true)) return false;
+            table->nextChunk++;
+            if (!writeManifest(*table)) return false;
+            it = table->chunks.find(start);
+        }
+        
+        Partition& partition = *it->second;
+        for (size_t s = i; s < end; s += COLUMN_BLOCK_ROWS) {
+            if (partition.rowCount > UINT32_MAX - COLUMN_BLOCK_ROWS) return false;
+            if (!writeSegment(*table, partition, &rows[s], std::min<size_t>(COLUMN_BLOCK_ROWS, end - s))) return false;
+        }
+        i = end;
+    }
+    table->newest = std::max(table->newest, order.back().first);
+    rowsSealed += rows.size();
+    
+    std::vector<std::pair<int, std::pair<int64_t, std::string>>> touched;
+    for (size_t r = 0; r < rows.size(); r++) {
+        std::string key = seriesKey(*table, rows[r]);
+        for (int w = 0; w < 2; w++) {
+            int64_t bucketStart = floorTo(order[r].first, ROLLUP_WIDTHS[w]);
+            fold(*table, table->rollups[w], bucketStart, key, rows[r]);
+            touched.emplace_back(w, std::make_pair(bucketStart, key));
+        }
+    }
+    std::sort(touched.begin(), touched.end());
+    touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+    return appendRollups(*table, touched);
+}
+
+uint64_t TimeSeriesStore::dropExpired(uint32_t tableId) {
+    std::lock_guard<std::mutex> lock(mutex);
+    
+    Table* table = openTable(tableId);
+    if (!table || table->options.retention <= 0 || table->chunks.empty()) return 0;
+    if (table->newest < INT64_MIN + table->options.retention) return 0;
+    int64_t cutoff = table->newest - table->options.retention;
+    
+    uint64_t live = 0;
+    std::vector<std::unique_ptr<Partition>> expired;
+    while (!table->chunks.empty()) {
+        auto it = table->chunks.begin();
+        if (it->first > cutoff - table->options.chunkInterval) break;
+        
+        Partition& partition = *it->second;
+        uint64_t deleted = 0;
+        for (uint8_t byte : partition.deleted) deleted += __builtin_popcount(byte);
+        live += partition.rowCount - deleted;
+        table->chunkIds.erase(partition.id);
+        expired.push_back(std::move(it->second));
+        table->chunks.erase(it);
+    }
+    if (expired.empty()) return 0;
+    
+    // Unlisted first, so a crash leaves stray files rather than missing ones
+    if (!writeManifest(*table)) std::cerr << "Could not update " << table->directory << "/chunks.lst\n";
+    for (auto& partition : expired) {
+        partition->data.close();
+        partition->directoryFile.close();
+        partition->deleteFile.close();
+        for (const char* extension : {".dat", ".dir", ".del"}) {
+            remove(chunkPath(*table, partition->id, extension).c_str());
+        }
+        chunksDropped++;
+    }
+    return live;
+}
+
+std::vector<std::pair<uint64_t, std::vector<ZoneMap>>> TimeSeriesStore::findSegments(uint32_t tableId, int64_t from,
+                                                                                     int64_t to) {
+    std::lock_guard<std::mutex> lock(mutex);
+    
+    std::vector<std::pair<uint64_t, std::vector<ZoneMap>>> segments;
+    Table* table = openTable(tableId);
+    if (!table || from > to) return segments;
+    
+    // Chunk starts are multiples of the interval, so the first chunk that can
+    // hold from starts at from rounded down
+    int64_t interval = table->options.chunkInterval;
+    auto it = from < INT64_MIN + interval ? table->chunks.begin() : table->chunks.lower_bound(floorTo(from, interval));
+    for (; it != table->chunks.end() && it->first <= to; ++it) {
+        const Partition& partition = *it->second;
+        for (size_t s = 0; s < partition.segments.size(); s++) {
+            std::vector<ZoneMap> zones;
+            for (size_t c = 0; c < table->columns.size(); c++) zones.push_back(partition.segments[s].chunks[c].zone);
+            segments.emplace_back((static_cast<uint64_t>(partition.id) << 32) | s, std::move(zones));
+        }
+    }
+    return segments;
+}
+
+bool TimeSeriesStore::readSegment(uint32_t tableId, uint64_t handle, const std::vector<size_t>& columns,
+                                  std::vector<ColumnVector>& out, std::vector<uint8_t>& deleted,
+                                  uint64_t* firstTupleId, std::vector<int64_t>* rowIds) {
+    std::lock_guard<std::mutex> lock(mutex);
+    
+    Table* table = openTable(tableId);
+    if (!table) return false;
+    auto it = table->chunkIds.find(static_cast<uint32_t>(handle >> 32));
+    if (it == table->chunkIds.end()) return false;
+    Partition& partition = *it->second;
+    size_t index = static_cast<uint32_t>(handle);
+    if (index >= partition.segments.size()) return false;
+    const Segment& segment = partition.segments[index];
+    
+    out.resize(columns.size());
+    for (size_t i = 0; i < columns.size(); i++) {
+        if (columns[i] >= table->columns.size() || !readChunk(*table, partition, segment, columns[i], out[i])) {
+            return false;
+        }
+    }
+    
+    if (rowIds) {
+        ColumnVector ids;
+        if (!readChunk(*table, partition, segment, table->columns.size(), ids)) return false;
+        rowIds->swap(ids.ints);
+    }
+    
+    deleted.resize(segment.rowCount);
+    for (uint32_t r = 0; r < segment.rowCount; r++) {
+        uint32_t ordinal = segment.firstRow + r;
+        deleted[r] = (partition.deleted[ordinal / 8] >> (ordinal % 8)) & 1;
+    }
+    if (firstTupleId) *firstTupleId = makeSeriesTupleId(partition.id, segment.firstRow);
+    return true;
+}
+
+bool TimeSeriesStore::readRow(uint32_t tableId, uint64_t tupleId, Tuple& tuple) {
+    std::lock_guard<std::mutex> lock(mutex);
+    
+    Table* table = openTable(tableId);
+    if (!table) return false;
+    auto it = table->chunkIds.find(seriesTupleChunk(tupleId));
+    if (it == table->chunkIds.end()) return false;
+    Partition& partition = *it->second;
+    uint32_t ordinal = seriesTupleRow(tupleId);
+    if (ordinal >= partition.rowCount || ((partition.deleted[ordinal / 8] >> (ordinal % 8)) & 1)) return false;
+    
+    auto segment = std::upper_bound(partition.segments.begin(), partition.segments.end(), ordinal,
+                                    [](uint32_t row, const Segment& s) { return row < s.firstRow; });
+    if (segment == partition.segments.begin()) return false;
+    --segment;
+    
+    size_t row = ordinal - segment->firstRow;
+    ColumnVector column;
+    tuple.columns.clear();
+    for (size_t c = 0; c <= table->columns.size(); c++) {
+        if (!readChunk(*table, partition, *segment, c, column)) return false;
+        if (c < table->columns.size()) tuple.columns[table->columns[c].name] = column.get(row);
+        else tuple.rowId = column.ints[row];
+    }
+    tuple.txnId = 0;
+    tuple.timestamp = 0;
+    tuple.deleted = false;
+    return true;
+}
+
+bool TimeSeriesStore::setDeleted(uint32_t tableId, uint64_t tupleId, bool deleted) {
+    std::lock_guard<std::mutex> lock(mutex);
+    
+    Table* table = openTable(tableId);
+    if (!table) return false;
+    auto it = table->chunkIds.find(seriesTupleChunk(tupleId));
+    if (it == table->chunkIds.end()) return false;
+    Partition& partition = *it->second;
+    uint32_t ordinal = seriesTupleRow(tupleId);
+    if (ordinal >= partition.rowCount) return false;
+    
+    uint8_t& byte = partition.deleted[ordinal / 8];
+    if (deleted) byte |= 1 << (ordinal % 8);
+    else byte &= ~(1 << (ordinal % 8));
+    
+    partition.deleteFile.seekp(ordinal / 8);
+    partition.deleteFile.write(reinterpret_cast<const char*>(&byte), 1);
+    partition.deleteFile.flush();
+    return static_cast<bool>(partition.deleteFile);
+}
+
+std::vector<ColumnDef> TimeSeriesStore::getRollupColumns(uint32_t tableId) {
+    std::lock_guard<std::mutex> lock(mutex);
+    
+    std::vector<ColumnDef> columns;
+    Table* table = openTable(tableId);
+    if (!table) return columns;
+    
+    auto column = [&](const std::string& name, DataType type) {
+        columns.push_back({name, type, true, false, false, Value()});
+    };
+    column("bucket", DataType::TYPE_TIMESTAMP);
+    for (size_t c : table->tagColumns) column(table->columns[c].name, table->columns[c].type);
+    column("rows", DataType::TYPE_INT64);
+    for (size_t c : table->valueColumns) {
+        const ColumnDef& col = table->columns[c];
+        column("min_" + col.name, col.type);
+        column("max_" + col.name, col.type);
+        column("avg_" + col.name, DataType::TYPE_DOUBLE);
+    }
+    return columns;
+}
+
+bool TimeSeriesStore::readRollup(uint32_t tableId, int64_t width, int64_t from, int64_t to,
+                                 const std::vector<Tuple>& pending, std::vector<Tuple>& out) {
+    std::lock_guard<std::mutex> lock(mutex);
+    
+    Table* table = openTable(tableId);
+    int which = width == ROLLUP_WIDTHS[0] ? 0 : width == ROLLUP_WIDTHS[1] ? 1 : -1;
+    if (!table || which < 0) return false;
+    
+    const Rollup& stored = table->rollups[which];
+    Rollup rollup(stored.lower_bound({from, std::string()}), stored.upper_bound({to, std::string(1, '\xff')}));
+    for (const Tuple& row : pending) {
+        int64_t bucketStart = floorTo(timeOf(*table, row), width);
+        if (bucketStart < from || bucketStart > to) continue;
+        fold(*table, rollup, bucketStart, seriesKey(*table, row), row);
+    }
+    
+    for (const auto& [key, bucket] : rollup) {
+        Tuple tuple;
+        tuple.rowId = 0;
+        tuple.txnId = 0;
+        tuple.timestamp = 0;
+        tuple.deleted = false;
+        tuple.columns["bucket"] = typed(Value(key.first), DataType::TYPE_TIMESTAMP);
+        
+        const uint8_t* tags = reinterpret_cast<const uint8_t*>(key.second.data());
+        size_t offset = 0;
+        for (size_t c : table->tagColumns) {
+            tuple.columns[table->columns[c].name] = offset < key.second.size() ? Value::deserialize(tags, offset) : Value();
+        }
+        tuple.columns["rows"] = Value(static_cast<int64_t>(bucket.rows));
+        
+        for (size_t i = 0; i < table->valueColumns.size(); i++) {
+            const ColumnDef& col = table->columns[table->valueColumns[i]];
+            const Stat& stat = bucket.stats[i];
+            Value min, max, avg;
+            if (stat.count) {
+                if (usesDoubles(col.type)) {
+                    min = typed(Value(stat.min), col.type);
+                    max = typed(Value(stat.max), col.type);
+                } else {
+                    min = typed(Value(static_cast<int64_t>(std::llround(stat.min))), col.type);
+                    max = typed(Value(static_cast<int64_t>(std::llround(stat.max))), col.type);
+                }
+                avg = Value(stat.sum / stat.count);
+            }
+            tuple.columns["min_" + col.name] = min;
+            tuple.columns["max_" + col.name] = max;
+            tuple.columns["avg_" + col.name] = avg;
+        }
+        out.push_back(std::move(tuple));
+    }
+    return true;
+}
+
+TimeSeriesStats TimeSeriesStore::getStats() {
+    TimeSeriesStats stats;
+    stats.chunks = 0;
+    stats.rollupBuckets = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto& [id, table] : tables) {
+            if (!table) continue;
+            stats.chunks += table->chunks.size();
+            stats.rollupBuckets += table->rollups[0].size() + table->rollups[1].size();
+        }
+    }
+    stats.chunksDropped = chunksDropped.load();
+    stats.rowsSealed = rowsSealed.load();
+    stats.timestampBytes = timestampBytes.load();
+    stats.values = values.load();
+    stats.valueBytes = valueBytes.load();
+    return stats;
+}
+
+void TimeSeriesStore::sync() {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto& [id, table] : tables) {
+        if (!table) continue;
+        for (auto& [start, partition] : table->chunks) {
+            partition->data.flush();
+            partition->directoryFile.flush();
+            partition->deleteFile.flush();
+        }
+        table->rollupLog.flush();
+    }
+}
+
+} // namespace hybriddb
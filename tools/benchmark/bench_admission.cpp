@@ -0,0 +1,75 @@
+#include "benchmark.h"
+#include <cstdio>
+#include <thread>
+
+namespace hybriddb {
+namespace bench {
+
+// What admission adds to a request: an uncontended admit and release, the
+// memory estimate of a lookup and a scan, then eight threads at high and
+// low priority sharing two slots, to show the high ones waiting less.
+
+HYBRIDDB_BENCHMARK(admission) {
+    AdmissionConfig config;
+    config.slots = 2;
+    AdmissionController controller(config);
+    std::string error;
+    
+    const int admits = 1000000;
+    Timer timer;
+    for (int i = 0; i < admits; i++) {
+        AdmissionTicket ticket;
+        ticket.acquire(&controller, Priority::NORMAL, ADMISSION_MIN_RESERVATION, false, error);
+    }
+    report("admission/uncontended", admits, 0, timer.seconds());
+    
+    std::string dir = scratchDirectory(options, "admission");
+    StorageEngine storage(dir + "/tables");
+    WALManager wal(dir + "/wal");
+    TransactionManager txnManager(&wal);
+    QueryEngine engine(&storage, &txnManager);
+    
+    std::vector<ColumnDef> columns(2);
+    columns[0] = {"id", DataType::TYPE_INT64, false, true, true, Value()};
+    columns[1] = {"name", DataType::TYPE_STRING, false, false, false, Value()};
+    engine.createTable("items", columns, false);
+    
+    const int estimates = 20000;
+    timer = Timer();
+    uint64_t bytes = 0;
+    for (int i = 0; i < estimates; i++) bytes = engine.estimateMemory("SELECT name FROM items WHERE id = 42");
+    report("admission/estimate/lookup", estimates, 0, timer.seconds());
+    timer = Timer();
+    for (int i = 0; i < estimates; i++) bytes = engine.estimateMemory("SELECT name FROM items ORDER BY name");
+    report("admission/estimate/scan", estimates, 0, timer.seconds());
+    printf("admission: a sorted scan reserves %llu bytes\n", static_cast<unsigned long long>(bytes));
+    
+    const int threads = 8, requests = 2000;
+    std::vector<std::thread> workers;
+    timer = Timer();
+    for (int t = 0; t < threads; t++) {
+        Priority priority = t % 2 == 0 ? Priority::HIGH : Priority::LOW;
+        workers.emplace_back([&controller, priority]() {
+            std::string error;
+            for (int i = 0; i < requests; i++) {
+                AdmissionTicket ticket;
+                if (!ticket.acquire(&controller, priority, ADMISSION_MIN_RESERVATION, false, error)) continue;
+                std::this_thread::sleep_for(std::chrono::microseconds(20));
+            }
+        });
+    }
+    for (auto& worker : workers) worker.join();
+    report("admission/contended", threads * requests, 0, timer.seconds());
+    
+    AdmissionStats stats = controller.getStats();
+    for (Priority priority : {Priority::HIGH, Priority::LOW}) {
+        const AdmissionClassStats& counts = stats.classes[static_cast<size_t>(priority)];
+        printf("admission: %s priority: %llu admitted, %llu timed out, %.3f ms mean wait, %.3f ms max\n",
+               priorityName(priority), static_cast<unsigned long long>(counts.admitted),
+               static_cast<unsigned long long>(counts.timedOut),
+               counts.admitted ? counts.waitNanos / 1e6 / counts.admitted : 0.0, counts.maxWaitNanos / 1e6);
+    }
+}
+
+} // namespace bench
+} // namespace hybriddb
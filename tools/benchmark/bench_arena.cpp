@@ -0,0 +1,95 @@
+#include "benchmark.h"
+#include <cstddef>
+#include <cstdio>
+#include <sstream>
+
+namespace hybriddb {
+namespace bench {
+
+// The same short queries from several threads at once, each thread either
+// allocating from the heap or, like a connection, from its own scratch arena
+// reset before every query. Then the raw cost of a small allocation from
+// each.
+
+static std::string customers(uint64_t count) {
+    std::ostringstream csv;
+    for (uint64_t i = 0; i < count; i++) {
+        csv << i << ",customer-" << (i * 7919) % count << "," << (i * 37) % 1000 << "\n";
+    }
+    return csv.str();
+}
+
+HYBRIDDB_BENCHMARK(arena) {
+    std::string dir = scratchDirectory(options, "arena");
+    StorageEngine storage(dir + "/tables");
+    WALManager wal(dir + "/wal");
+    TransactionManager txnManager(&wal);
+    QueryEngine engine(&storage, &txnManager);
+    
+    std::vector<ColumnDef> columns(3);
+    columns[0] = {"id", DataType::TYPE_INT64, false, true, true, Value()};
+    columns[1] = {"name", DataType::TYPE_STRING, false, false, false, Value()};
+    columns[2] = {"score", DataType::TYPE_INT64, true, false, false, Value()};
+    engine.createTable("customers", columns, false);
+    
+    std::string csv = customers(options.rows);
+    auto loader = engine.beginCopy("customers", CopyFormat::CSV, 0);
+    loader->feed(reinterpret_cast<const uint8_t*>(csv.data()), csv.size());
+    if (!loader->finish()) {
+        std::cerr << "load: " << loader->getError() << "\n";
+        return;
+    }
+    
+    const int threads = 4;
+    const int queries = 10;
+    for (int useArena = 0; useArena < 2; useArena++) {
+        std::atomic<uint64_t> allocations(0);
+        Timer timer;
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; t++) {
+            workers.emplace_back([&, t]() {
+                Arena scratch;
+                std::string result, error;
+                for (int q = 0; q < queries; q++) {
+                    scratch.reset();
+                    ArenaScope scope(useArena ? &scratch : nullptr);
+                    std::string sql = "SELECT id, name FROM customers WHERE score >= " +
+                                      std::to_string((t * 7 + q) % 1000) + " ORDER BY name LIMIT 20";
+                    engine.execute(sql, 0, result, error);
+                    allocations += scratch.getStats().allocations;
+                }
+            });
+        }
+        for (auto& worker : workers) worker.join();
+        report(useArena ? "arena/select/arena" : "arena/select/heap", threads * queries, 0, timer.seconds());
+        if (useArena) {
+            printf("arena: %.1f scratch allocations per query\n",
+                   static_cast<double>(allocations.load()) / (threads * queries));
+        }
+    }
+    
+    const int small = 1000000;
+    {
+        Timer timer;
+        std::vector<void*> blocks(1000);
+        for (int i = 0; i < small; i++) {
+            void*& slot = blocks[i % blocks.size()];
+            ::operator delete(slot);
+            slot = ::operator new(48);
+        }
+        for (void* block : blocks) ::operator delete(block);
+        report("arena/allocate/heap", small, 0, timer.seconds());
+    }
+    {
+        Arena scratch;
+        Timer timer;
+        for (int i = 0; i < small; i++) {
+            if (i % 1000 == 0) scratch.reset();
+            scratch.allocate(48, alignof(std::max_align_t));
+        }
+        report("arena/allocate/arena", small, 0, timer.seconds());
+    }
+}
+
+} // namespace bench
+} // namespace hybriddb
@@ -0,0 +1,65 @@
+#include "benchmark.h"
+#include <cstdio>
+
+namespace hybriddb {
+namespace bench {
+
+// Buffer pool lookups that hit, from one thread and from several sharing
+// the pool mutex, lookups that miss, and insertions that each evict a page
+// because they cycle over four times as many pages as the pool holds.
+
+HYBRIDDB_BENCHMARK(buffer_pool) {
+    const size_t poolMB = 64;
+    const uint32_t resident = static_cast<uint32_t>(poolMB * 1024 * 1024 / PAGE_SIZE);
+    BufferPool pool(poolMB);
+    
+    Page page;
+    for (uint32_t id = 0; id < resident; id++) {
+        page.initialize(id, 1);
+        pool.putPage(1, page);
+    }
+    
+    const uint64_t lookups = options.rows * 10;
+    {
+        uint64_t found = 0;
+        Timer timer;
+        for (uint64_t i = 0; i < lookups; i++) {
+            found += pool.getPage(1, static_cast<uint32_t>((i * 7919) % resident)) != nullptr;
+        }
+        report("buffer_pool/get/hit", lookups, lookups * PAGE_SIZE, timer.seconds());
+        if (found != lookups) printf("buffer_pool: %llu of %llu lookups missed\n",
+                                     static_cast<unsigned long long>(lookups - found),
+                                     static_cast<unsigned long long>(lookups));
+    }
+    {
+        const int threads = 4;
+        std::vector<std::thread> workers;
+        Timer timer;
+        for (int t = 0; t < threads; t++) {
+            workers.emplace_back([&, t]() {
+                for (uint64_t i = 0; i < lookups / threads; i++) {
+                    pool.getPage(1, static_cast<uint32_t>((i * 7919 + t) % resident));
+                }
+            });
+        }
+        for (auto& worker : workers) worker.join();
+        report("buffer_pool/get/hit-4-threads", lookups, lookups * PAGE_SIZE, timer.seconds());
+    }
+    {
+        Timer timer;
+        for (uint64_t i = 0; i < lookups; i++) pool.getPage(2, static_cast<uint32_t>(i));
+        report("buffer_pool/get/miss", lookups, 0, timer.seconds());
+    }
+    {
+        const uint64_t puts = options.rows;
+        Timer timer;
+        for (uint64_t i = 0; i < puts; i++) {
+            page.header.pageId = resident + static_cast<uint32_t>(i % (4 * resident));
+            pool.putPage(1, page);
+        }
+        report("buffer_pool/put/evict", puts, puts * PAGE_SIZE, timer.seconds());
+    }
+}
+
+} // namespace bench
+} // namespace hybriddb
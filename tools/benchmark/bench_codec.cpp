@@ -0,0 +1,167 @@
+#include "benchmark.h"
+#include <cstdio>
+
+namespace hybriddb {
+namespace bench {
+
+// Encode and decode throughput of each record type. Encoding is timed both
+// into a fresh vector per record and appended to one reused buffer; rows are
+// also encoded into a buffer cleared per row, the way inserts and the WAL
+// use a thread's scratch record. WAL records are decoded both in place and
+// into an owning WALRecord.
+
+static Tuple sampleRow(uint64_t i) {
+    Tuple tuple;
+    tuple.rowId = i;
+    tuple.txnId = i / 10;
+    tuple.timestamp = 1700000000 + i;
+    tuple.deleted = false;
+    tuple.columns["id"] = Value(static_cast<int64_t>(i));
+    tuple.columns["name"] = Value("customer-" + std::to_string(i));
+    tuple.columns["score"] = Value(static_cast<double>(i % 1000) / 7);
+    tuple.columns["active"] = Value(i % 3 == 0);
+    return tuple;
+}
+
+HYBRIDDB_BENCHMARK(codec) {
+    const size_t count = options.rows;
+    std::vector<Tuple> rows;
+    rows.reserve(count);
+    for (size_t i = 0; i < count; i++) rows.push_back(sampleRow(i));
+    
+    std::vector<uint8_t> buffer;
+    size_t sink = 0;
+    
+    // Values
+    {
+        Timer timer;
+        for (const auto& row : rows) {
+            for (const auto& [name, value] : row.columns) sink += value.serialize().size();
+        }
+        report("codec/value/encode/fresh", count * 4, sink, timer.seconds());
+    }
+    {
+        buffer.clear();
+        Timer timer;
+        for (const auto& row : rows) {
+            for (const auto& [name, value] : row.columns) value.serialize(buffer);
+        }
+        report("codec/value/encode/append", count * 4, buffer.size(), timer.seconds());
+    }
+    {
+        Timer timer;
+        size_t offset = 0, values = 0;
+        Value value;
+        while (Value::deserialize(buffer.data(), buffer.size(), offset, value)) values++;
+        report("codec/value/decode", values, buffer.size(), timer.seconds());
+    }
+    
+    // Tuples, as stored in pages and carried by INSERT records
+    {
+        sink = 0;
+        Timer timer;
+        for (const auto& row : rows) sink += row.serialize().size();
+        report("codec/tuple/encode/fresh", count, sink, timer.seconds());
+    }
+    {
+        std::vector<uint8_t> record;
+        sink = 0;
+        Timer timer;
+        for (const auto& row : rows) {
+            record.clear();
+            row.serialize(record);
+            sink += record.size();
+        }
+        report("codec/tuple/encode/reuse", count, sink, timer.seconds());
+    }
+    std::vector<size_t> ends;
+    ends.reserve(count);
+    {
+        buffer.clear();
+        Timer timer;
+        for (const auto& row : rows) {
+            row.serialize(buffer);
+            ends.push_back(buffer.size());
+        }
+        report("codec/tuple/encode/append", count, buffer.size(), timer.seconds());
+    }
+    {
+        Timer timer;
+        size_t start = 0;
+        for (size_t end : ends) {
+            sink += Tuple::deserialize(buffer.data() + start, end - start).columns.size();
+            start = end;
+        }
+        report("codec/tuple/decode", count, buffer.size(), timer.seconds());
+    }
+    
+    // WAL records carrying the encoded rows
+    std::vector<WALRecord> records(count);
+    for (size_t i = 0; i < count; i++) {
+        records[i].type = WALRecordType::INSERT;
+        records[i].lsn = i;
+        records[i].txnId = i / 10;
+        records[i].data = rows[i].serialize();
+        records[i].length = records[i].data.size();
+    }
+    {
+        sink = 0;
+        Timer timer;
+        for (const auto& record : records) sink += record.serialize().size();
+        report("codec/wal/encode/fresh", count, sink, timer.seconds());
+    }
+    {
+        buffer.clear();
+        Timer timer;
+        for (const auto& record : records) record.serialize(buffer);
+        report("codec/wal/encode/append", count, buffer.size(), timer.seconds());
+    }
+    {
+        Timer timer;
+        size_t offset = 0, decoded = 0;
+        WALRecordView view;
+        while (WALRecord::decode(buffer.data(), buffer.size(), offset, view)) {
+            sink += view.length;
+            decoded++;
+        }
+        report("codec/wal/decode/view", decoded, buffer.size(), timer.seconds());
+    }
+    {
+        Timer timer;
+        size_t offset = 0, decoded = 0;
+        WALRecord record;
+        while (WALRecord::deserialize(buffer.data(), buffer.size(), offset, record)) decoded++;
+        report("codec/wal/decode/copy", decoded, buffer.size(), timer.seconds());
+    }
+    
+    // Protocol messages the size of small results
+    std::vector<Message> messages(count);
+    for (size_t i = 0; i < count; i++) {
+        messages[i].type = MessageType::RESULT;
+        messages[i].payload = records[i].data;
+    }
+    {
+        sink = 0;
+        Timer timer;
+        for (const auto& msg : messages) sink += msg.serialize().size();
+        report("codec/message/encode/fresh", count, sink, timer.seconds());
+    }
+    {
+        buffer.clear();
+        Timer timer;
+        for (const auto& msg : messages) msg.serialize(buffer);
+        report("codec/message/encode/append", count, buffer.size(), timer.seconds());
+    }
+    {
+        Timer timer;
+        size_t offset = 0, decoded = 0;
+        Message msg;
+        while (Message::deserialize(buffer.data(), buffer.size(), offset, msg)) decoded++;
+        report("codec/message/decode", decoded, buffer.size(), timer.seconds());
+    }
+    
+    if (sink == 0) printf("codec: nothing encoded\n");
+}
+
+} // namespace bench
+} // namespace hybriddb
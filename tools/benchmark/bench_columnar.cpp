@@ -0,0 +1,83 @@
+#include "benchmark.h"
+#include <cstdio>
+#include <sstream>
+
+namespace hybriddb {
+namespace bench {
+
+// Analytic queries over the same rows stored as a row table and as a column
+// table: full aggregates, a range the zone maps can prune, and a filter on a
+// low-cardinality string column.
+
+static std::vector<ColumnDef> metricColumns() {
+    std::vector<ColumnDef> columns(5);
+    columns[0] = {"id", DataType::TYPE_INT64, false, true, true, Value()};
+    columns[1] = {"host", DataType::TYPE_STRING, false, false, false, Value()};
+    columns[2] = {"region", DataType::TYPE_STRING, false, false, false, Value()};
+    columns[3] = {"cpu", DataType::TYPE_DOUBLE, true, false, false, Value()};
+    columns[4] = {"requests", DataType::TYPE_INT64, true, false, false, Value()};
+    return columns;
+}
+
+static std::string metricRows(uint64_t count) {
+    static const char* const regions[] = {"us-east", "us-west", "eu-central", "ap-south"};
+    std::ostringstream csv;
+    for (uint64_t i = 0; i < count; i++) {
+        csv << i << ",host" << i % 200 << "," << regions[(i / 1000) % 4] << ","
+            << (i * 7 % 1000) * 0.1 << "," << i % 5000 << "\n";
+    }
+    return csv.str();
+}
+
+static void load(QueryEngine& engine, const std::string& table, const std::string& csv) {
+    auto loader = engine.beginCopy(table, CopyFormat::CSV, 0);
+    loader->feed(reinterpret_cast<const uint8_t*>(csv.data()), csv.size());
+    if (!loader->finish()) std::cerr << table << ": " << loader->getError() << "\n";
+}
+
+HYBRIDDB_BENCHMARK(columnar) {
+    std::string dir = scratchDirectory(options, "columnar");
+    StorageEngine storage(dir + "/tables");
+    WALManager wal(dir + "/wal");
+    TransactionManager txnManager(&wal);
+    QueryEngine engine(&storage, &txnManager);
+    
+    auto columns = metricColumns();
+    std::string csv = metricRows(options.rows);
+    engine.createTable("metrics_rows", columns, false);
+    engine.createTable("metrics_columns", columns, false, StorageMode::COLUMN);
+    load(engine, "metrics_rows", csv);
+    load(engine, "metrics_columns", csv);
+    
+    const char* const queries[][2] = {
+        {"sum", "SELECT COUNT(*), SUM(requests), AVG(cpu) FROM %s"},
+        {"min-max", "SELECT MIN(host), MAX(cpu) FROM %s"},
+        {"range", "SELECT SUM(requests) FROM %s WHERE id >= %llu"},
+        {"region", "SELECT COUNT(*), AVG(cpu) FROM %s WHERE region = 'eu-central' AND cpu > 50"},
+    };
+    
+    for (const auto& query : queries) {
+        std::string results[2];
+        const char* const tables[] = {"metrics_rows", "metrics_columns"};
+        for (int t = 0; t < 2; t++) {
+            char sql[256];
+            snprintf(sql, sizeof(sql), query[1], tables[t],
+                     static_cast<unsigned long long>(options.rows - options.rows / 100));
+            std::string error;
+            Timer timer;
+            if (!engine.execute(sql, 0, results[t], error)) {
+                std::cerr << query[0] << ": " << error << "\n";
+                return;
+            }
+            report(std::string("columnar/") + (t ? "column/" : "row/") + query[0],
+                   options.rows, 0, timer.seconds());
+        }
+        if (results[0] != results[1]) {
+            std::cerr << "columnar/" << query[0] << ": row and column results differ: "
+                      << results[0] << " vs " << results[1] << "\n";
+        }
+    }
+}
+
+} // namespace bench
+} // namespace hybriddb
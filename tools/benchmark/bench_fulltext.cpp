@@ -0,0 +1,131 @@
+#include "benchmark.h"
+#include <cmath>
+#include <cstdio>
+#include <sstream>
+
+namespace hybriddb {
+namespace bench {
+
+// Short documents over a skewed vocabulary, searched three ways: LIKE on
+// the text, MATCH through a full-text index for the top 10, and MATCH with
+// a leading non-index conjunct so every row is tokenized. The index counts
+// must agree with the row-by-row ones; the last line shows how few of the
+// matching documents block-max WAND had to score.
+
+static const uint64_t VOCABULARY = 20000;
+
+// Word ranks are log-uniform, so a few words are in most documents and most
+// words in a handful, roughly like natural text
+static std::string documents(uint64_t count) {
+    std::ostringstream csv;
+    uint64_t state = 0x9e3779b97f4a7c15ULL;
+    auto next = [&]() {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        return state >> 33;
+    };
+    for (uint64_t i = 0; i < count; i++) {
+        csv << i << ",";
+        uint64_t words = 20 + next() % 40;
+        for (uint64_t w = 0; w < words; w++) {
+            double u = static_cast<double>(next() % 1000000) / 1000000;
+            uint64_t rank = static_cast<uint64_t>(std::pow(static_cast<double>(VOCABULARY), u)) - 1;
+            csv << (w ? " " : "") << "w" << rank;
+        }
+        csv << "\n";
+    }
+    return csv.str();
+}
+
+static uint64_t countOf(const std::string& result) {
+    size_t colon = result.find(':');
+    return colon == std::string::npos ? 0 : std::stoull(result.substr(colon + 1));
+}
+
+HYBRIDDB_BENCHMARK(fulltext) {
+    std::string dir = scratchDirectory(options, "fulltext");
+    StorageEngine storage(dir + "/tables");
+    WALManager wal(dir + "/wal");
+    TransactionManager txnManager(&wal);
+    QueryEngine engine(&storage, &txnManager);
+    
+    std::vector<ColumnDef> columns(2);
+    columns[0] = {"id", DataType::TYPE_INT64, false, true, true, Value()};
+    columns[1] = {"body", DataType::TYPE_STRING, true, false, false, Value()};
+    engine.createTable("articles", columns, false);
+    
+    std::string csv = documents(options.rows);
+    auto loader = engine.beginCopy("articles", CopyFormat::CSV, 0);
+    loader->feed(reinterpret_cast<const uint8_t*>(csv.data()), csv.size());
+    if (!loader->finish()) {
+        std::cerr << "load: " << loader->getError() << "\n";
+        return;
+    }
+    
+    std::string result, error;
+    {
+        Timer timer;
+        if (!engine.execute("CREATE FULLTEXT INDEX articles_body ON articles (body)", 0, result, error)) {
+            std::cerr << "index: " << error << "\n";
+            return;
+        }
+        report("fulltext/build", options.rows, csv.size(), timer.seconds());
+    }
+    
+    FullTextIndex* index = nullptr;
+    for (TableIndex* candidate : engine.getIndexes(engine.getTableSchema("articles")->tableId)) {
+        if (candidate->isFullText()) index = static_cast<FullTextIndex*>(candidate);
+    }
+    
+    const char* const queries[][2] = {
+        {"common", "w1 w2"},
+        {"mixed", "w3 w4711"},
+        {"rare", "w9001 w12345"},
+    };
+    for (const auto& query : queries) {
+        std::string name = query[0];
+        std::string words = query[1];
+        std::string first = words.substr(0, words.find(' '));
+        
+        Timer likeTimer;
+        engine.execute("SELECT COUNT(*) FROM articles WHERE body LIKE '%" + first + " %'", 0, result, error);
+        report("fulltext/" + name + "/like-scan", options.rows, csv.size(), likeTimer.seconds());
+        
+        const int runs = 100;
+        Timer topTimer;
+        for (int i = 0; i < runs; i++) {
+            engine.execute("SELECT id FROM articles WHERE MATCH(body, '" + words + "') LIMIT 10", 0, result, error);
+        }
+        report("fulltext/" + name + "/match-top10", runs, 0, topTimer.seconds());
+        
+        Timer countTimer;
+        engine.execute("SELECT COUNT(*) FROM articles WHERE MATCH(body, '" + words + "')", 0, result, error);
+        uint64_t matches = countOf(result);
+        report("fulltext/" + name + "/match-all", matches, 0, countTimer.seconds());
+        
+        Timer scanTimer;
+        engine.execute("SELECT COUNT(*) FROM articles WHERE id >= 0 AND MATCH(body, '" + words + "')", 0, result,
+                       error);
+        report("fulltext/" + name + "/match-scan", options.rows, csv.size(), scanTimer.seconds());
+        if (countOf(result) != matches) {
+            std::cerr << "fulltext/" << name << ": index found " << matches << " documents, the scan "
+                      << countOf(result) << "\n";
+        }
+        
+        size_t scored = 0;
+        if (index) index->search(words, 10, &scored);
+        printf("fulltext/%s: top 10 of %llu matching documents after scoring %llu\n", name.c_str(),
+               static_cast<unsigned long long>(matches), static_cast<unsigned long long>(scored));
+    }
+    
+    if (!index) return;
+    FullTextStats stats = index->getStats();
+    printf("fulltext: %llu documents, %llu segments after %llu merges, %llu postings in %llu bytes "
+           "(%.2f bits per posting)\n",
+           static_cast<unsigned long long>(stats.documents), static_cast<unsigned long long>(stats.segments),
+           static_cast<unsigned long long>(stats.merges), static_cast<unsigned long long>(stats.postings),
+           static_cast<unsigned long long>(stats.postingBytes),
+           stats.postings ? 8.0 * stats.postingBytes / stats.postings : 0.0);
+}
+
+} // namespace bench
+} // namespace hybriddb
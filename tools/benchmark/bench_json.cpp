@@ -0,0 +1,101 @@
+#include "benchmark.h"
+#include <cstring>
+#include <sstream>
+
+namespace hybriddb {
+namespace bench {
+
+// Document ingest: the byte-at-a-time encoder against the structural-index
+// parser, on many small documents (one per row) and on one large array, plus
+// the Value::fromText wrapper that INSERT and COPY go through.
+
+static std::string userDocument(uint64_t i) {
+    std::ostringstream doc;
+    doc << "{\"id\": " << i
+        << ", \"username\": \"user" << i << "\""
+        << ", \"email\": \"user" << i << "@example.com\""
+        << ", \"score\": " << (i % 1000) * 0.5
+        << ", \"active\": " << ((i % 3) ? "true" : "false")
+        << ", \"bio\": \"line one\\nline \\\"two\\\" \\u00e9\""
+        << ", \"tags\": [\"t" << i % 7 << "\", \"t" << i % 11 << "\", \"t" << i % 13 << "\"]"
+        << ", \"address\": {\"city\": \"City " << i % 100 << "\", \"zip\": \"" << 10000 + i % 90000
+        << "\", \"geo\": [" << (i % 180) * 0.25 << ", " << (i % 90) * -0.5 << "]}"
+        << ", \"manager\": null}";
+    return doc.str();
+}
+
+HYBRIDDB_BENCHMARK(json) {
+    std::vector<std::string> documents;
+    documents.reserve(options.rows);
+    uint64_t totalBytes = 0;
+    for (uint64_t i = 0; i < options.rows; i++) {
+        documents.push_back(userDocument(i));
+        totalBytes += documents.back().size();
+    }
+    
+    std::string array = "[";
+    for (uint64_t i = 0; i < options.rows; i++) {
+        if (i) array += ",\n  ";
+        array += documents[i];
+    }
+    array += "]";
+    
+    // Both encoders must agree byte for byte before timings mean anything
+    std::vector<uint8_t> scalar, structural;
+    std::string error;
+    for (uint64_t i = 0; i < options.rows; i += std::max<uint64_t>(1, options.rows / 1000)) {
+        JSONDocument::encodeScalar(documents[i].data(), documents[i].size(), scalar, error);
+        JSONDocument::encode(documents[i].data(), documents[i].size(), structural, error);
+        if (scalar != structural || !error.empty()) {
+            std::cerr << "json: encoders disagree on document " << i << " " << error << "\n";
+            return;
+        }
+    }
+    
+    std::vector<uint8_t> out;
+    {
+        Timer timer;
+        for (const auto& doc : documents) {
+            if (!JSONDocument::encodeScalar(doc.data(), doc.size(), out, error)) break;
+        }
+        report("json/scalar/documents", documents.size(), totalBytes, timer.seconds());
+    }
+    {
+        Timer timer;
+        for (const auto& doc : documents) {
+            if (!JSONDocument::encode(doc.data(), doc.size(), out, error)) break;
+        }
+        report("json/structural/documents", documents.size(), totalBytes, timer.seconds());
+    }
+    {
+        Timer timer;
+        for (const auto& doc : documents) {
+            Value v = Value::fromText(doc, DataType::TYPE_JSON);
+            if (v.type != DataType::TYPE_JSON) break;
+        }
+        report("json/value-fromtext/documents", documents.size(), totalBytes, timer.seconds());
+    }
+    
+    std::vector<uint32_t> positions;
+    {
+        Timer timer;
+        JSONDocument::structuralIndex(array.data(), array.size(), positions, error);
+        report("json/structural-index/array", positions.size(), array.size(), timer.seconds());
+    }
+    {
+        Timer timer;
+        JSONDocument::encodeScalar(array.data(), array.size(), scalar, error);
+        report("json/scalar/array", 1, array.size(), timer.seconds());
+    }
+    {
+        Timer timer;
+        JSONDocument::encode(array.data(), array.size(), structural, error);
+        report("json/structural/array", 1, array.size(), timer.seconds());
+    }
+    if (scalar != structural || !error.empty()) {
+        std::cerr << "json: encoders disagree on the array document " << error << "\n";
+    }
+}
+
+} // namespace bench
+} // namespace hybriddb
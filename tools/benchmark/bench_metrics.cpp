@@ -0,0 +1,60 @@
+#include "benchmark.h"
+#include <cstdio>
+
+namespace hybriddb {
+namespace bench {
+
+// What the instrumentation costs on a hot path: counter increments,
+// histogram records and timed scopes from several threads at once, an
+// uncontended lock taken plainly and through MeteredLock, then a scrape.
+
+HYBRIDDB_BENCHMARK(metrics) {
+    const int threads = 4;
+    const uint64_t events = options.rows * 50;
+    
+    auto run = [&](const char* name, const auto& body) {
+        Timer timer;
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; t++) {
+            workers.emplace_back([&]() {
+                for (uint64_t i = 0; i < events; i++) body(i);
+            });
+        }
+        for (auto& worker : workers) worker.join();
+        double seconds = timer.seconds();
+        report(name, threads * events, 0, seconds);
+        printf("%s: %.1f ns per event per thread\n", name, seconds * 1e9 / events);
+    };
+    
+    run("metrics/counter", [](uint64_t) { Metrics::add(Counter::QUERIES_OTHER); });
+    run("metrics/histogram", [](uint64_t i) { Metrics::record(Histogram::QUERY_PARSE, i & 0xFFFFF); });
+    run("metrics/timer", [](uint64_t) { LatencyTimer timer(Histogram::QUERY_EXECUTE); });
+    
+    std::mutex plain;
+    Timer lockTimer;
+    for (uint64_t i = 0; i < events; i++) {
+        std::lock_guard<std::mutex> lock(plain);
+    }
+    report("metrics/lock/plain", events, 0, lockTimer.seconds());
+    
+    Timer meteredTimer;
+    for (uint64_t i = 0; i < events; i++) {
+        MeteredLock<std::mutex> lock(plain, Counter::LOCK_WAITS_STORAGE);
+    }
+    report("metrics/lock/metered", events, 0, meteredTimer.seconds());
+    
+    const int scrapes = 100;
+    Timer scrapeTimer;
+    uint64_t recorded = 0;
+    for (int i = 0; i < scrapes; i++) recorded = Metrics::collect().histogram(Histogram::QUERY_PARSE).count;
+    report("metrics/collect", scrapes, 0, scrapeTimer.seconds());
+    
+    MetricsSnapshot metrics = Metrics::collect();
+    const HistogramSnapshot& parse = metrics.histogram(Histogram::QUERY_PARSE);
+    printf("metrics: %llu values recorded, p50 %llu p99 %llu (uniform to %d)\n",
+           static_cast<unsigned long long>(recorded), static_cast<unsigned long long>(parse.percentile(0.5)),
+           static_cast<unsigned long long>(parse.percentile(0.99)), 0xFFFFF);
+}
+
+} // namespace bench
+} // namespace hybriddb
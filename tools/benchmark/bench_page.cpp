@@ -0,0 +1,65 @@
+#include "benchmark.h"
+#include <cstdio>
+
+namespace hybriddb {
+namespace bench {
+
+// Page checksums as every read verifies them and every write sets them,
+// over pages filled with encoded rows, and the record append that fills
+// a page.
+
+HYBRIDDB_BENCHMARK(page) {
+    const size_t count = 256;
+    std::vector<Page> pages(count);
+    std::vector<uint8_t> record;
+    for (size_t p = 0; p < count; p++) {
+        pages[p].initialize(static_cast<uint32_t>(p), 1);
+        for (uint64_t i = 0;; i++) {
+            Tuple tuple;
+            tuple.rowId = p * 1000 + i;
+            tuple.txnId = 1;
+            tuple.timestamp = 1700000000 + i;
+            tuple.deleted = false;
+            tuple.columns["id"] = Value(static_cast<int64_t>(tuple.rowId));
+            tuple.columns["name"] = Value("customer-" + std::to_string(tuple.rowId));
+            record.clear();
+            tuple.serialize(record);
+            if (!pages[p].appendRecord(record.data(), static_cast<uint16_t>(record.size()))) break;
+        }
+        pages[p].header.checksum = pages[p].calculateChecksum();
+    }
+    
+    const uint64_t rounds = std::max<uint64_t>(1, options.rows / count);
+    {
+        uint32_t sum = 0;
+        Timer timer;
+        for (uint64_t r = 0; r < rounds; r++) {
+            for (const Page& page : pages) sum += page.calculateChecksum();
+        }
+        report("page/checksum", rounds * count, rounds * count * PAGE_SIZE, timer.seconds());
+        printf("page: checksum sum %u\n", sum);
+    }
+    {
+        uint64_t valid = 0;
+        Timer timer;
+        for (uint64_t r = 0; r < rounds; r++) {
+            for (const Page& page : pages) valid += page.verify();
+        }
+        report("page/verify", rounds * count, rounds * count * PAGE_SIZE, timer.seconds());
+        if (valid != rounds * count) printf("page: %llu pages failed to verify\n",
+                                            static_cast<unsigned long long>(rounds * count - valid));
+    }
+    {
+        uint64_t records = 0;
+        Page page;
+        Timer timer;
+        for (uint64_t r = 0; r < rounds; r++) {
+            page.initialize(0, 1);
+            while (page.appendRecord(record.data(), static_cast<uint16_t>(record.size()))) records++;
+        }
+        report("page/append", records, records * record.size(), timer.seconds());
+    }
+}
+
+} // namespace bench
+} // namespace hybriddb
@@ -0,0 +1,88 @@
+#include "benchmark.h"
+#include <cstdio>
+#include <sstream>
+
+namespace hybriddb {
+namespace bench {
+
+// Id ranges of growing width over an indexed row table, run three ways:
+// before ANALYZE, where the planner guesses every two-sided range narrow
+// enough for the index; after ANALYZE, where the histogram decides; and
+// behind an OR no index can answer, which always scans. Where the index
+// and the scan cross over is what INDEX_ROW_COST has to reflect. The
+// results must agree.
+
+static std::string readings(uint64_t count) {
+    std::ostringstream csv;
+    uint64_t state = 0x853c49e6748fea9bULL;
+    for (uint64_t i = 0; i < count; i++) {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        csv << i << "," << (state >> 33) % count << "," << (i % 1000) * 0.5 << "\n";
+    }
+    return csv.str();
+}
+
+HYBRIDDB_BENCHMARK(planner) {
+    std::string dir = scratchDirectory(options, "planner");
+    StorageEngine storage(dir + "/tables");
+    WALManager wal(dir + "/wal");
+    TransactionManager txnManager(&wal);
+    QueryEngine engine(&storage, &txnManager);
+    
+    // Keys are random, so an index range fetches rows from all over the table
+    std::vector<ColumnDef> columns(3);
+    columns[0] = {"id", DataType::TYPE_INT64, false, true, true, Value()};
+    columns[1] = {"sensor", DataType::TYPE_INT64, false, false, false, Value()};
+    columns[2] = {"reading", DataType::TYPE_DOUBLE, true, false, false, Value()};
+    engine.createTable("readings", columns, false);
+    
+    std::string csv = readings(options.rows);
+    auto loader = engine.beginCopy("readings", CopyFormat::CSV, 0);
+    loader->feed(reinterpret_cast<const uint8_t*>(csv.data()), csv.size());
+    std::string result, error;
+    if (!loader->finish() ||
+        !engine.execute("CREATE INDEX readings_sensor ON readings (sensor)", 0, result, error)) {
+        std::cerr << "load: " << loader->getError() << error << "\n";
+        return;
+    }
+    
+    const double widths[] = {0.0001, 0.001, 0.01, 0.05, 0.2, 0.5};
+    std::string answers[sizeof(widths) / sizeof(widths[0])][3];
+    const char* const runs[] = {"guessed", "analyzed", "scan"};
+    for (int run = 0; run < 3; run++) {
+        if (run == 1) {
+            Timer timer;
+            if (!engine.execute("ANALYZE readings", 0, result, error)) {
+                std::cerr << "analyze: " << error << "\n";
+                return;
+            }
+            report("planner/analyze", options.rows, 0, timer.seconds());
+        }
+        for (size_t w = 0; w < sizeof(widths) / sizeof(widths[0]); w++) {
+            long long from = static_cast<long long>(options.rows / 4);
+            long long to = from + static_cast<long long>(widths[w] * options.rows);
+            char sql[160];
+            snprintf(sql, sizeof(sql),
+                     "SELECT COUNT(*), SUM(reading) FROM readings WHERE %ssensor >= %lld AND sensor < %lld%s",
+                     run == 2 ? "(" : "", from, to, run == 2 ? ") OR id < 0" : "");
+            Timer timer;
+            if (!engine.execute(sql, 0, answers[w][run], error)) {
+                std::cerr << sql << ": " << error << "\n";
+                return;
+            }
+            char name[64];
+            snprintf(name, sizeof(name), "planner/%s/%g%%", runs[run], widths[w] * 100);
+            report(name, options.rows, 0, timer.seconds());
+        }
+    }
+    
+    for (size_t w = 0; w < sizeof(widths) / sizeof(widths[0]); w++) {
+        if (answers[w][0] != answers[w][2] || answers[w][1] != answers[w][2]) {
+            std::cerr << "planner/" << widths[w] * 100 << "%: results differ: " << answers[w][0] << " vs "
+                      << answers[w][1] << " vs " << answers[w][2] << "\n";
+        }
+    }
+}
+
+} // namespace bench
+} // namespace hybriddb
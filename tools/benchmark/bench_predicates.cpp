@@ -0,0 +1,113 @@
+#include "benchmark.h"
+#include <algorithm>
+#include <cstdio>
+#include <functional>
+
+namespace hybriddb {
+namespace bench {
+
+// WHERE clauses of 1, 3 and 10 predicates over rows already in memory, so
+// only evaluation is measured: once through a std::function around
+// Expr::matches, the way QueryEngine::select filters, and once through a
+// CompiledPredicate. A scan evaluates each row right after decoding it, so
+// the rows come from a set small enough to stay in cache. Every predicate
+// keeps most rows, so the conjunctions run to the end. The match counts
+// must agree.
+
+static const uint64_t WORKING_SET = 256;
+
+static TableSchema readingsSchema() {
+    TableSchema schema;
+    schema.tableId = 1;
+    schema.tableName = "readings";
+    schema.isDocumentMode = false;
+    schema.rowCount = 0;
+    schema.nextRowId = 0;
+    const char* const names[] = {"id", "device", "site", "seq", "temp", "humidity", "pressure", "battery",
+                                 "model", "region", "status", "firmware"};
+    for (int i = 0; i < 12; i++) {
+        DataType type = i < 4 ? DataType::TYPE_INT64 : i < 8 ? DataType::TYPE_DOUBLE : DataType::TYPE_STRING;
+        schema.columns.push_back({names[i], type, true, false, false, Value()});
+    }
+    return schema;
+}
+
+static std::vector<Tuple> readingRows(uint64_t count) {
+    std::vector<Tuple> rows(count);
+    uint64_t state = 0xda942042e4dd58b5ULL;
+    auto next = [&]() {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        return state >> 33;
+    };
+    char text[32];
+    for (uint64_t i = 0; i < count; i++) {
+        auto& columns = rows[i].columns;
+        columns["id"] = Value(static_cast<int64_t>(i));
+        columns["device"] = Value(static_cast<int64_t>(next() % 1000));
+        columns["site"] = Value(static_cast<int64_t>(next() % 50));
+        columns["seq"] = Value(static_cast<int64_t>(next() % 100000));
+        columns["temp"] = Value(static_cast<double>(next() % 6000) / 100 - 10);
+        columns["humidity"] = Value(static_cast<double>(next() % 1000) / 10);
+        columns["pressure"] = Value(950 + static_cast<double>(next() % 1000) / 10);
+        columns["battery"] = Value(static_cast<double>(next() % 100) / 100);
+        snprintf(text, sizeof(text), "model-%llu", static_cast<unsigned long long>(next() % 20));
+        columns["model"] = Value(text);
+        snprintf(text, sizeof(text), "region-%llu", static_cast<unsigned long long>(next() % 8));
+        columns["region"] = Value(text);
+        columns["status"] = Value(next() % 10 ? "ok" : "degraded");
+        snprintf(text, sizeof(text), "%llu.%llu", static_cast<unsigned long long>(1 + next() % 3),
+                 static_cast<unsigned long long>(next() % 10));
+        columns["firmware"] = Value(text);
+    }
+    return rows;
+}
+
+HYBRIDDB_BENCHMARK(predicates) {
+    TableSchema schema = readingsSchema();
+    std::vector<Tuple> rows = readingRows(std::min(options.rows, WORKING_SET));
+    uint64_t passes = std::max<uint64_t>(1, options.rows / rows.size());
+    
+    const std::pair<const char*, const char*> filters[] = {
+        {"1", "temp > -5"},
+        {"3", "temp > -5 AND status = 'ok' AND device != 7"},
+        {"10", "temp > -5 AND status = 'ok' AND device != 7 AND humidity <= 95 AND pressure >= 955 AND "
+               "site < 48 AND battery > 0.02 AND model != 'model-3' AND region >= 'region-0' AND seq > 100"},
+    };
+    for (const auto& filter : filters) {
+        Statement stmt;
+        std::string error;
+        if (!SQLParser::parse(std::string("SELECT * FROM readings WHERE ") + filter.second, stmt, error)) {
+            std::cerr << filter.first << ": " << error << "\n";
+            return;
+        }
+        const Expr* where = stmt.where.get();
+        
+        std::function<bool(const Tuple&)> interpreted = [where](const Tuple& tuple) { return where->matches(tuple); };
+        uint64_t interpretedCount = 0;
+        Timer interpretedTimer;
+        for (uint64_t pass = 0; pass < passes; pass++) {
+            for (const auto& row : rows) interpretedCount += interpreted(row);
+        }
+        report(std::string("predicates/") + filter.first + "/std-function", passes * rows.size(), 0,
+               interpretedTimer.seconds());
+               
+        uint64_t compiledCount = 0;
+        Timer compiledTimer;
+        CompiledPredicate compiled(schema, where);
+        for (uint64_t pass = 0; pass < passes; pass++) {
+            for (const auto& row : rows) compiledCount += compiled.matches(row);
+        }
+        report(std::string("predicates/") + filter.first + "/compiled", passes * rows.size(), 0,
+               compiledTimer.seconds());
+               
+        printf("predicates/%s: %llu of %llu rows match\n", filter.first,
+               static_cast<unsigned long long>(compiledCount), static_cast<unsigned long long>(passes * rows.size()));
+        if (interpretedCount != compiledCount) {
+            std::cerr << "predicates/" << filter.first << ": the interpreter matched " << interpretedCount
+                      << " rows, the compiled predicate " << compiledCount << "\n";
+        }
+    }
+}
+
+} // namespace bench
+} // namespace hybriddb
@@ -0,0 +1,76 @@
+#include "benchmark.h"
+#include <cstdio>
+#include <sstream>
+
+namespace hybriddb {
+namespace bench {
+
+// What the query log and EXPLAIN ANALYZE add to a statement: a primary key
+// lookup and a filtered scan run plainly, with the query log recording
+// each, and under EXPLAIN ANALYZE, then the fingerprint alone.
+
+HYBRIDDB_BENCHMARK(profile) {
+    std::string dir = scratchDirectory(options, "profile");
+    StorageEngine storage(dir + "/tables");
+    WALManager wal(dir + "/wal");
+    TransactionManager txnManager(&wal);
+    QueryEngine engine(&storage, &txnManager);
+    
+    std::vector<ColumnDef> columns(3);
+    columns[0] = {"id", DataType::TYPE_INT64, false, true, true, Value()};
+    columns[1] = {"kind", DataType::TYPE_STRING, false, false, false, Value()};
+    columns[2] = {"amount", DataType::TYPE_INT64, true, false, false, Value()};
+    engine.createTable("events", columns, false);
+    
+    std::ostringstream csv;
+    for (uint64_t i = 0; i < options.rows; i++) csv << i << ",k" << i % 100 << "," << (i * 37) % 10000 << "\n";
+    std::string text = csv.str();
+    auto loader = engine.beginCopy("events", CopyFormat::CSV, 0);
+    loader->feed(reinterpret_cast<const uint8_t*>(text.data()), text.size());
+    if (!loader->finish()) {
+        std::cerr << "load: " << loader->getError() << "\n";
+        return;
+    }
+    
+    QueryLog log;
+    std::string result, error;
+    auto run = [&](const char* name, const std::string& prefix, const std::string& sql, int runs) {
+        Timer timer;
+        for (int i = 0; i < runs; i++) {
+            std::string statement = prefix + sql;
+            if (sql.back() == '=') statement += std::to_string((i * 7919) % options.rows);
+            if (!engine.execute(statement, 0, result, error)) {
+                std::cerr << name << ": " << error << "\n";
+                return;
+            }
+        }
+        report(name, runs, 0, timer.seconds());
+    };
+    
+    const std::string lookup = "SELECT kind, amount FROM events WHERE id =";
+    const std::string scan = "SELECT id FROM events WHERE kind = 'k7' AND amount > 5000";
+    const int lookups = 20000, scans = 20;
+    
+    run("profile/lookup/plain", "", lookup, lookups);
+    run("profile/scan/plain", "", scan, scans);
+    engine.setQueryLog(&log);
+    run("profile/lookup/logged", "", lookup, lookups);
+    run("profile/scan/logged", "", scan, scans);
+    engine.setQueryLog(nullptr);
+    run("profile/lookup/explain-analyze", "EXPLAIN ANALYZE ", lookup, lookups);
+    run("profile/scan/explain-analyze", "EXPLAIN ANALYZE ", scan, scans);
+    printf("profile: %s\n", result.c_str());
+    
+    std::string shape;
+    Timer timer;
+    for (int i = 0; i < lookups; i++) SQLParser::fingerprint(lookup + " " + std::to_string(i), shape);
+    report("profile/fingerprint", lookups, 0, timer.seconds());
+    
+    for (const auto& stats : log.getStats()) {
+        printf("profile: %llu calls, %.3f ms mean: %s\n", static_cast<unsigned long long>(stats.calls),
+               stats.totalNanos / 1e6 / stats.calls, stats.query.c_str());
+    }
+}
+
+} // namespace bench
+} // namespace hybriddb
@@ -0,0 +1,52 @@
+#include "benchmark.h"
+#include <cstdio>
+
+namespace hybriddb {
+namespace bench {
+
+// Message framing through the kernel: writeFrame and readFrame over a
+// connected socket pair, one frame at a time with the reader on its own
+// thread, for a small query and a result of a few kilobytes. codec covers
+// the same frames built and parsed in memory.
+
+#ifdef PLATFORM_WINDOWS
+
+HYBRIDDB_BENCHMARK(protocol) {
+    printf("protocol: socket pairs are not available on Windows, skipped\n");
+}
+
+#else
+
+static void roundTrips(const char* name, size_t size, uint64_t count) {
+    int pair[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) != 0) {
+        printf("%s: socketpair failed\n", name);
+        return;
+    }
+    
+    std::vector<uint8_t> payload(size, 'x');
+    uint64_t received = 0;
+    Timer timer;
+    std::thread reader([&]() {
+        Message msg;
+        while (received < count && readFrame(pair[1], msg)) received++;
+    });
+    for (uint64_t i = 0; i < count; i++) {
+        if (!writeFrame(pair[0], MessageType::QUERY, payload.data(), payload.size())) break;
+    }
+    reader.join();
+    report(name, received, received * (size + 5), timer.seconds());
+    
+    close(pair[0]);
+    close(pair[1]);
+}
+
+HYBRIDDB_BENCHMARK(protocol) {
+    roundTrips("protocol/frame/64B", 64, options.rows);
+    roundTrips("protocol/frame/4KB", 4096, options.rows / 4);
+}
+
+#endif
+
+} // namespace bench
+} // namespace hybriddb
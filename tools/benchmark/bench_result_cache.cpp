@@ -0,0 +1,80 @@
+#include "benchmark.h"
+#include <cstdio>
+#include <sstream>
+
+namespace hybriddb {
+namespace bench {
+
+// One filtered SELECT, run by the query engine and answered from the result
+// cache the way a connection does it: normalize the text and look it up.
+// The last pair times a miss that follows every write, which is what a
+// table written as often as it is read gets from the cache.
+
+static std::string events(uint64_t count) {
+    std::ostringstream csv;
+    for (uint64_t i = 0; i < count; i++) {
+        csv << i << ",k" << (i * 7919) % 100 << "," << (i * 37) % 10000 << "\n";
+    }
+    return csv.str();
+}
+
+HYBRIDDB_BENCHMARK(result_cache) {
+    std::string dir = scratchDirectory(options, "result_cache");
+    StorageEngine storage(dir + "/tables");
+    WALManager wal(dir + "/wal");
+    TransactionManager txnManager(&wal);
+    QueryEngine engine(&storage, &txnManager);
+    ResultCache cache(64 << 20);
+    engine.setResultCache(&cache);
+    
+    std::vector<ColumnDef> columns(3);
+    columns[0] = {"id", DataType::TYPE_INT64, false, true, true, Value()};
+    columns[1] = {"kind", DataType::TYPE_STRING, false, false, false, Value()};
+    columns[2] = {"amount", DataType::TYPE_INT64, true, false, false, Value()};
+    engine.createTable("events", columns, false);
+    
+    std::string csv = events(options.rows);
+    auto loader = engine.beginCopy("events", CopyFormat::CSV, 0);
+    loader->feed(reinterpret_cast<const uint8_t*>(csv.data()), csv.size());
+    if (!loader->finish()) {
+        std::cerr << "load: " << loader->getError() << "\n";
+        return;
+    }
+    
+    const char* sql = "SELECT id, amount FROM events WHERE kind = 'k7' AND amount > 5000";
+    std::string result, error, key;
+    const int runs = 20;
+    {
+        Timer timer;
+        for (int i = 0; i < runs; i++) engine.execute(sql, 0, result, error);
+        report("result_cache/execute", runs, 0, timer.seconds());
+    }
+    {
+        const int hits = 100000;
+        size_t bytes = 0;
+        Timer timer;
+        for (int i = 0; i < hits; i++) {
+            SQLParser::normalize(sql, key);
+            if (auto cached = cache.lookup(key)) bytes += cached->size();
+        }
+        report("result_cache/hit", hits, bytes, timer.seconds());
+    }
+    {
+        Timer timer;
+        for (int i = 0; i < runs; i++) {
+            std::string insert = "INSERT INTO events VALUES (" + std::to_string(options.rows + i) + ", 'k7', 9999)";
+            engine.execute(insert, 0, result, error);
+            SQLParser::normalize(sql, key);
+            if (!cache.lookup(key)) engine.execute(sql, 0, result, error);
+        }
+        report("result_cache/write-then-read", runs, 0, timer.seconds());
+    }
+    
+    auto stats = cache.getStats();
+    printf("result_cache: %llu hits, %llu misses, %llu invalidations, %llu bytes cached\n",
+           static_cast<unsigned long long>(stats.hits), static_cast<unsigned long long>(stats.misses),
+           static_cast<unsigned long long>(stats.invalidations), static_cast<unsigned long long>(stats.bytes));
+}
+
+} // namespace bench
+} // namespace hybriddb
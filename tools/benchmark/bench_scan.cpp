@@ -0,0 +1,100 @@
+#include "benchmark.h"
+#include <cstdio>
+#include <sstream>
+
+namespace hybriddb {
+namespace bench {
+
+// Orders loaded in id order into two row tables, one WITH (BLOOM_FILTER = ON).
+// A narrow id range and a lookup of one random code run as written, where
+// page summaries rule out most pages, and behind an OR that no summary can
+// decide, which reads every page. The results must agree.
+
+static std::vector<ColumnDef> orderColumns() {
+    std::vector<ColumnDef> columns(4);
+    columns[0] = {"id", DataType::TYPE_INT64, false, false, false, Value()};
+    columns[1] = {"code", DataType::TYPE_STRING, false, false, false, Value()};
+    columns[2] = {"amount", DataType::TYPE_DOUBLE, true, false, false, Value()};
+    columns[3] = {"status", DataType::TYPE_STRING, true, false, false, Value()};
+    return columns;
+}
+
+// Codes are random, so only a bloom filter can place one
+static std::string orderRows(uint64_t count) {
+    std::ostringstream csv;
+    uint64_t state = 0x2545f4914f6cdd1dULL;
+    for (uint64_t i = 0; i < count; i++) {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        csv << i << ",c" << (state >> 24) % 100000000 << "," << (i * 37) % 10000 * 0.01 << ","
+            << (i % 7 ? "shipped" : "open") << "\n";
+    }
+    return csv.str();
+}
+
+HYBRIDDB_BENCHMARK(scan) {
+    std::string dir = scratchDirectory(options, "scan");
+    StorageEngine storage(dir + "/tables");
+    WALManager wal(dir + "/wal");
+    TransactionManager txnManager(&wal);
+    QueryEngine engine(&storage, &txnManager);
+    
+    auto columns = orderColumns();
+    std::string csv = orderRows(options.rows);
+    engine.createTable("orders", columns, false);
+    engine.createTable("orders_bloom", columns, false, StorageMode::ROW, PageCompression::NONE, SeriesOptions(),
+                       true);
+                       
+    const char* const tables[] = {"orders", "orders_bloom"};
+    for (const char* table : tables) {
+        auto loader = engine.beginCopy(table, CopyFormat::CSV, 0);
+        loader->feed(reinterpret_cast<const uint8_t*>(csv.data()), csv.size());
+        if (!loader->finish()) {
+            std::cerr << table << ": " << loader->getError() << "\n";
+            return;
+        }
+    }
+    
+    // A code from the middle of the table
+    size_t middle = csv.find('\n', csv.size() / 2) + 1;
+    size_t comma = csv.find(',', middle);
+    std::string code = csv.substr(comma + 1, csv.find(',', comma + 1) - comma - 1);
+    long long from = static_cast<long long>(options.rows / 2);
+    
+    char range[128], lookup[128];
+    snprintf(range, sizeof(range), "id >= %lld AND id < %lld", from, from + 1000);
+    snprintf(lookup, sizeof(lookup), "code = '%s'", code.c_str());
+    const std::pair<const char*, const char*> queries[] = {{"range", range}, {"lookup", lookup}};
+    
+    for (const char* table : tables) {
+        for (const auto& query : queries) {
+            std::string results[2];
+            for (int unskippable = 0; unskippable < 2; unskippable++) {
+                std::string sql = std::string("SELECT COUNT(*), SUM(amount) FROM ") + table + " WHERE " +
+                                  (unskippable ? "(" + std::string(query.second) + ") OR id < 0" : query.second);
+                std::string error;
+                ScanStats before = storage.getScanStats();
+                Timer timer;
+                if (!engine.execute(sql, 0, results[unskippable], error)) {
+                    std::cerr << query.first << ": " << error << "\n";
+                    return;
+                }
+                report(std::string("scan/") + table + "/" + query.first + (unskippable ? "/all-pages" : "/skipping"),
+                       options.rows, 0, timer.seconds());
+                       
+                ScanStats after = storage.getScanStats();
+                if (!unskippable) {
+                    printf("scan/%s/%s: %llu pages read, %llu skipped\n", table, query.first,
+                           static_cast<unsigned long long>(after.pagesRead - before.pagesRead),
+                           static_cast<unsigned long long>(after.pagesSkipped - before.pagesSkipped));
+                }
+            }
+            if (results[0] != results[1]) {
+                std::cerr << "scan/" << table << "/" << query.first << ": results differ: " << results[0]
+                          << " vs " << results[1] << "\n";
+            }
+        }
+    }
+}
+
+} // namespace bench
+} // namespace hybriddb
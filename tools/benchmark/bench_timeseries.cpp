@@ -0,0 +1,127 @@
+#include "benchmark.h"
+#include <cstdio>
+#include <sstream>
+
+namespace hybriddb {
+namespace bench {
+
+// Metrics at a 10 second interval loaded into a column table and a time-series
+// table: a recent time range, a full aggregate, then the hourly rollup that
+// the time-series table answers without touching its rows. Ends with the
+// Gorilla bit rates for the sealed timestamps and values.
+
+static const int64_t SERIES_START = 1700000000;
+
+static std::vector<ColumnDef> seriesColumns() {
+    std::vector<ColumnDef> columns(4);
+    columns[0] = {"ts", DataType::TYPE_TIMESTAMP, false, false, false, Value()};
+    columns[1] = {"host", DataType::TYPE_STRING, false, false, false, Value()};
+    columns[2] = {"cpu", DataType::TYPE_DOUBLE, true, false, false, Value()};
+    columns[3] = {"requests", DataType::TYPE_INT64, true, false, false, Value()};
+    return columns;
+}
+
+// 50 hosts reporting together every 10 seconds; cpu moves in small steps
+static std::string seriesRows(uint64_t count) {
+    std::ostringstream csv;
+    for (uint64_t i = 0; i < count; i++) {
+        uint64_t tick = i / 50;
+        csv << SERIES_START + static_cast<int64_t>(tick) * 10 << ",host" << i % 50 << ","
+            << 20 + ((tick + i % 50) % 40) * 0.25 << "," << (tick * 31 + i) % 1000 << "\n";
+    }
+    return csv.str();
+}
+
+static void load(QueryEngine& engine, const std::string& table, const std::string& csv) {
+    auto loader = engine.beginCopy(table, CopyFormat::CSV, 0);
+    loader->feed(reinterpret_cast<const uint8_t*>(csv.data()), csv.size());
+    if (!loader->finish()) std::cerr << table << ": " << loader->getError() << "\n";
+}
+
+HYBRIDDB_BENCHMARK(timeseries) {
+    std::string dir = scratchDirectory(options, "timeseries");
+    StorageEngine storage(dir + "/tables");
+    WALManager wal(dir + "/wal");
+    TransactionManager txnManager(&wal);
+    QueryEngine engine(&storage, &txnManager);
+    
+    auto columns = seriesColumns();
+    std::string csv = seriesRows(options.rows);
+    SeriesOptions series;
+    series.chunkInterval = 3600;
+    engine.createTable("metrics_columns", columns, false, StorageMode::COLUMN);
+    engine.createTable("metrics_series", columns, false, StorageMode::TIMESERIES, PageCompression::NONE, series);
+    
+    const char* const tables[] = {"metrics_columns", "metrics_series"};
+    for (int t = 0; t < 2; t++) {
+        Timer timer;
+        load(engine, tables[t], csv);
+        report(std::string("timeseries/load/") + (t ? "series" : "column"), options.rows, csv.size(),
+               timer.seconds());
+    }
+    
+    // The last hour of data
+    int64_t end = SERIES_START + static_cast<int64_t>(options.rows / 50) * 10;
+    const char* const queries[][2] = {
+        {"last-hour", "SELECT COUNT(*), AVG(cpu), MAX(requests) FROM %s WHERE ts >= %lld"},
+        {"all", "SELECT COUNT(*), AVG(cpu), MAX(requests) FROM %s"},
+    };
+    for (const auto& query : queries) {
+        std::string results[2];
+        for (int t = 0; t < 2; t++) {
+            char sql[256];
+            snprintf(sql, sizeof(sql), query[1], tables[t], static_cast<long long>(end - 3600));
+            std::string error;
+            Timer timer;
+            if (!engine.execute(sql, 0, results[t], error)) {
+                std::cerr << query[0] << ": " << error << "\n";
+                return;
+            }
+            report(std::string("timeseries/") + (t ? "series/" : "column/") + query[0],
+                   options.rows, 0, timer.seconds());
+        }
+        if (results[0] != results[1]) {
+            std::cerr << "timeseries/" << query[0] << ": column and time-series results differ: "
+                      << results[0] << " vs " << results[1] << "\n";
+        }
+    }
+    
+    // Hourly averages per host: grouped from the rows on the column table, read
+    // from the rollups on the time-series table
+    std::string result, error;
+    uint64_t groups = 0;
+    {
+        Timer timer;
+        for (int64_t hour = SERIES_START - SERIES_START % 3600; hour < end; hour += 3600) {
+            for (int host = 0; host < 50; host++) {
+                char sql[256];
+                snprintf(sql, sizeof(sql),
+                         "SELECT COUNT(*), AVG(cpu) FROM metrics_columns WHERE ts >= %lld AND ts < %lld "
+                         "AND host = 'host%d'",
+                         static_cast<long long>(hour), static_cast<long long>(hour + 3600), host);
+                engine.execute(sql, 0, result, error);
+                groups++;
+            }
+        }
+        report("timeseries/column/hourly", groups, 0, timer.seconds());
+    }
+    {
+        Timer timer;
+        if (!engine.execute("SELECT bucket, host, rows, avg_cpu FROM metrics_series ROLLUP HOUR", 0, result,
+                            error)) {
+            std::cerr << "rollup: " << error << "\n";
+        }
+        report("timeseries/series/hourly", groups, 0, timer.seconds());
+    }
+    
+    TimeSeriesStats stats = storage.getTimeSeriesStore()->getStats();
+    printf("timeseries: %llu chunks, %llu rows sealed, %.2f bits per timestamp, %.2f bits per value, "
+           "%llu rollup buckets\n",
+           static_cast<unsigned long long>(stats.chunks), static_cast<unsigned long long>(stats.rowsSealed),
+           stats.rowsSealed ? 8.0 * stats.timestampBytes / stats.rowsSealed : 0.0,
+           stats.values ? 8.0 * stats.valueBytes / stats.values : 0.0,
+           static_cast<unsigned long long>(stats.rollupBuckets));
+}
+
+} // namespace bench
+} // namespace hybriddb
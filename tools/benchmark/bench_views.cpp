@@ -0,0 +1,94 @@
+#include "benchmark.h"
+#include <cstdio>
+#include <sstream>
+
+namespace hybriddb {
+namespace bench {
+
+// Orders per region, counted and summed by a GROUP BY that scans the table
+// and by reading a materialized view of the same query. Single-row inserts
+// are timed before the view exists and after, which is what keeping it
+// current costs a write. After the inserts, an update and a delete the two
+// answers must still agree.
+
+static const int REGIONS = 50;
+
+static std::string orders(uint64_t count) {
+    std::ostringstream csv;
+    for (uint64_t i = 0; i < count; i++) {
+        csv << i << ",r" << (i * 7919) % REGIONS << "," << (i * 37) % 10000 << "\n";
+    }
+    return csv.str();
+}
+
+HYBRIDDB_BENCHMARK(views) {
+    std::string dir = scratchDirectory(options, "views");
+    StorageEngine storage(dir + "/tables");
+    WALManager wal(dir + "/wal");
+    TransactionManager txnManager(&wal);
+    QueryEngine engine(&storage, &txnManager);
+    
+    std::vector<ColumnDef> columns(3);
+    columns[0] = {"id", DataType::TYPE_INT64, false, true, true, Value()};
+    columns[1] = {"region", DataType::TYPE_STRING, false, false, false, Value()};
+    columns[2] = {"amount", DataType::TYPE_INT64, true, false, false, Value()};
+    engine.createTable("orders", columns, false);
+    
+    std::string csv = orders(options.rows);
+    auto loader = engine.beginCopy("orders", CopyFormat::CSV, 0);
+    loader->feed(reinterpret_cast<const uint8_t*>(csv.data()), csv.size());
+    if (!loader->finish()) {
+        std::cerr << "load: " << loader->getError() << "\n";
+        return;
+    }
+    
+    const char* grouped = "SELECT region, COUNT(*), SUM(amount) FROM orders GROUP BY region ORDER BY region";
+    std::string result, error;
+    uint64_t id = options.rows;
+    const int writes = 1000;
+    auto insert = [&](const char* name) {
+        Timer timer;
+        for (int i = 0; i < writes; i++, id++) {
+            char sql[128];
+            snprintf(sql, sizeof(sql), "INSERT INTO orders VALUES (%llu, 'r%d', %d)",
+                     static_cast<unsigned long long>(id), static_cast<int>(id % REGIONS), static_cast<int>(id % 100));
+            if (!engine.execute(sql, 0, result, error)) {
+                std::cerr << "insert: " << error << "\n";
+                return false;
+            }
+        }
+        report(name, writes, 0, timer.seconds());
+        return true;
+    };
+    if (!insert("views/insert/no-view")) return;
+    
+    {
+        Timer timer;
+        if (!engine.execute("CREATE MATERIALIZED VIEW by_region AS SELECT region, COUNT(*), SUM(amount) "
+                            "FROM orders GROUP BY region", 0, result, error)) {
+            std::cerr << "view: " << error << "\n";
+            return;
+        }
+        report("views/build", options.rows, 0, timer.seconds());
+    }
+    if (!insert("views/insert/with-view")) return;
+    engine.execute("UPDATE orders SET amount = 0 WHERE id < 100", 0, result, error);
+    engine.execute("DELETE FROM orders WHERE id >= 100 AND id < 200", 0, result, error);
+    
+    std::string scanned, read;
+    {
+        Timer timer;
+        engine.execute(grouped, 0, scanned, error);
+        report("views/group-by-scan", options.rows, 0, timer.seconds());
+    }
+    {
+        const int runs = 1000;
+        Timer timer;
+        for (int i = 0; i < runs; i++) engine.execute("SELECT * FROM by_region ORDER BY region", 0, read, error);
+        report("views/read", runs, 0, timer.seconds());
+    }
+    if (scanned != read) std::cerr << "views: the view and the scan differ: " << read << " vs " << scanned << "\n";
+}
+
+} // namespace bench
+} // namespace hybriddb
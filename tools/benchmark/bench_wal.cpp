@@ -0,0 +1,99 @@
+#include "benchmark.h"
+#include <cstdio>
+
+namespace hybriddb {
+namespace bench {
+
+// The write-ahead log as writes see it: records appended from one thread
+// and from several contending for the log mutex, an explicit flush after
+// each small batch, and whole transactions (begin, one logged insert,
+// commit) from one thread and from several.
+
+static std::vector<uint8_t> insertRecord(uint64_t id) {
+    Tuple tuple;
+    tuple.rowId = id;
+    tuple.txnId = 1;
+    tuple.timestamp = 1700000000 + id;
+    tuple.deleted = false;
+    tuple.columns["id"] = Value(static_cast<int64_t>(id));
+    tuple.columns["name"] = Value("customer-" + std::to_string(id));
+    tuple.columns["email"] = Value("customer-" + std::to_string(id) + "@example.com");
+    
+    std::vector<uint8_t> data(sizeof(uint32_t));
+    uint32_t tableId = 1;
+    memcpy(data.data(), &tableId, sizeof(tableId));
+    tuple.serialize(data);
+    return data;
+}
+
+HYBRIDDB_BENCHMARK(wal) {
+    std::string dir = scratchDirectory(options, "wal");
+    const std::vector<uint8_t> record = insertRecord(42);
+    const int threads = 4;
+    
+    {
+        WALManager wal(dir + "/append");
+        Timer timer;
+        for (uint64_t i = 0; i < options.rows; i++) wal.append(WALRecordType::INSERT, 1, record.data(), record.size());
+        wal.flush();
+        report("wal/append", options.rows, options.rows * record.size(), timer.seconds());
+    }
+    {
+        WALManager wal(dir + "/append-threads");
+        std::vector<std::thread> workers;
+        Timer timer;
+        for (int t = 0; t < threads; t++) {
+            workers.emplace_back([&, t]() {
+                for (uint64_t i = 0; i < options.rows / threads; i++) {
+                    wal.append(WALRecordType::INSERT, t + 1, record.data(), record.size());
+                }
+            });
+        }
+        for (auto& worker : workers) worker.join();
+        wal.flush();
+        report("wal/append/4-threads", options.rows, options.rows * record.size(), timer.seconds());
+    }
+    {
+        WALManager wal(dir + "/flush");
+        const uint64_t batches = std::max<uint64_t>(1, options.rows / 100);
+        Timer timer;
+        for (uint64_t b = 0; b < batches; b++) {
+            for (int i = 0; i < 10; i++) wal.append(WALRecordType::INSERT, 1, record.data(), record.size());
+            wal.flush();
+        }
+        report("wal/flush/10-records", batches, batches * 10 * record.size(), timer.seconds());
+    }
+    {
+        WALManager wal(dir + "/commit");
+        TransactionManager txns(&wal);
+        Timer timer;
+        for (uint64_t i = 0; i < options.rows; i++) {
+            uint64_t txnId = txns.begin();
+            txns.logOperation(txnId, WALRecordType::INSERT, record);
+            txns.commit(txnId);
+        }
+        wal.flush();
+        report("wal/commit", options.rows, options.rows * record.size(), timer.seconds());
+    }
+    {
+        WALManager wal(dir + "/commit-threads");
+        TransactionManager txns(&wal);
+        std::vector<std::thread> workers;
+        Timer timer;
+        for (int t = 0; t < threads; t++) {
+            workers.emplace_back([&]() {
+                for (uint64_t i = 0; i < options.rows / threads; i++) {
+                    uint64_t txnId = txns.begin();
+                    txns.logOperation(txnId, WALRecordType::INSERT, record);
+                    txns.commit(txnId);
+                }
+            });
+        }
+        for (auto& worker : workers) worker.join();
+        wal.flush();
+        report("wal/commit/4-threads", options.rows, options.rows * record.size(), timer.seconds());
+    }
+}
+
+} // namespace bench
+} // namespace hybriddb
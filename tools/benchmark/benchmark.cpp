@@ -0,0 +1,87 @@
+#include "benchmark.h"
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#ifndef PLATFORM_WINDOWS
+#include <sys/stat.h>
+#endif
+
+namespace hybriddb {
+namespace bench {
+
+static std::vector<std::pair<std::string, BenchmarkFn>>& registry() {
+    static std::vector<std::pair<std::string, BenchmarkFn>> benchmarks;
+    return benchmarks;
+}
+
+bool registerBenchmark(const char* name, BenchmarkFn fn) {
+    registry().emplace_back(name, fn);
+    return true;
+}
+
+void report(const std::string& name, uint64_t items, uint64_t bytes, double seconds) {
+    double itemsPerSec = seconds > 0 ? items / seconds : 0;
+    double mbPerSec = seconds > 0 ? bytes / seconds / (1024.0 * 1024.0) : 0;
+    
+    printf("%-32s %12llu items %10.3f s %14.0f items/s %10.1f MB/s\n",
+           name.c_str(), static_cast<unsigned long long>(items), seconds, itemsPerSec, mbPerSec);
+    fflush(stdout);
+}
+
+std::string scratchDirectory(const Options& options, const std::string& name) {
+    std::string path = options.dataDirectory + "/" + name;
+    std::string command = "rm -rf '" + path + "'";
+    if (system(command.c_str()) != 0) {
+        std::cerr << "Failed to clear " << path << "\n";
+    }
+    
+#ifdef PLATFORM_WINDOWS
+    CreateDirectoryA(options.dataDirectory.c_str(), NULL);
+    CreateDirectoryA(path.c_str(), NULL);
+#else
+    mkdir(options.dataDirectory.c_str(), 0755);
+    mkdir(path.c_str(), 0755);
+#endif
+    return path;
+}
+
+} // namespace bench
+} // namespace hybriddb
+
+// ============================================================================
+// MAIN ENTRY POINT
+// ============================================================================
+
+int main(int argc, char* argv[]) {
+    hybriddb::bench::Options options;
+    options.rows = 200000;
+    options.dataDirectory = "./bench_data";
+    std::vector<std::string> filters;
+    
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-n" && i + 1 < argc) {
+            options.rows = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "-d" && i + 1 < argc) {
+            options.dataDirectory = argv[++i];
+        } else if (arg == "-l") {
+            for (const auto& [name, fn] : hybriddb::bench::registry()) std::cout << name << "\n";
+            return 0;
+        } else {
+            filters.push_back(arg);
+        }
+    }
+    
+    for (const auto& [name, fn] : hybriddb::bench::registry()) {
+        bool selected = filters.empty();
+        for (const auto& filter : filters) {
+            if (name.find(filter) != std::string::npos) selected = true;
+        }
+        if (!selected) continue;
+        
+        std::cout << "== " << name << " ==\n";
+        fn(options);
+    }
+    
+    return 0;
+}
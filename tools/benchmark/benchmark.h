@@ -0,0 +1,47 @@
+#ifndef HYBRIDDB_BENCHMARK_H
+#define HYBRIDDB_BENCHMARK_H
+
+#include "hybriddb.h"
+#include <chrono>
+#include <string>
+
+namespace hybriddb {
+namespace bench {
+
+struct Options {
+    uint64_t rows;
+    std::string dataDirectory;
+};
+
+typedef void (*BenchmarkFn)(const Options& options);
+
+bool registerBenchmark(const char* name, BenchmarkFn fn);
+
+// Defines and registers a benchmark: HYBRIDDB_BENCHMARK(ingest) { ... }
+#define HYBRIDDB_BENCHMARK(name) \
+    static void bench_##name(const Options& options); \
+    static bool bench_##name##_registered = registerBenchmark(#name, bench_##name); \
+    static void bench_##name(const Options& options)
+    
+class Timer {
+private:
+    std::chrono::steady_clock::time_point start;
+    
+public:
+    Timer() : start(std::chrono::steady_clock::now()) {}
+    
+    double seconds() const {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+};
+
+// Prints one result line with item and byte throughput
+void report(const std::string& name, uint64_t items, uint64_t bytes, double seconds);
+
+// Fresh, empty directory for a benchmark's data files
+std::string scratchDirectory(const Options& options, const std::string& name);
+
+} // namespace bench
+} // namespace hybriddb
+
+#endif // HYBRIDDB_BENCHMARK_H
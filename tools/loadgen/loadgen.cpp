@@ -0,0 +1,1005 @@
+#include "hybriddb.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <set>
+
+// ============================================================================
+// LOAD GENERATOR
+// ============================================================================
+//
+// Drives a running server over the wire protocol with the YCSB core
+// workloads A-F or a TPC-C-like transaction mix. Each thread holds one
+// connection and issues its next operation as soon as the last one answers.
+// Latencies recorded after the warmup go into per-thread histograms with the
+// server's own bucket layout; the merged figures come out as one JSON object
+// on stdout, so runs on one machine can be compared with a diff.
+
+namespace hybriddb {
+namespace loadgen {
+
+enum Operation {
+    OP_READ,
+    OP_UPDATE,
+    OP_INSERT,
+    OP_SCAN,
+    OP_READ_MODIFY_WRITE,
+    OP_NEW_ORDER,
+    OP_PAYMENT,
+    OP_ORDER_STATUS,
+    OP_DELIVERY,
+    OP_STOCK_LEVEL,
+    OPERATIONS
+};
+
+static const char* OPERATION_NAMES[OPERATIONS] = {
+    "read", "update", "insert", "scan", "read-modify-write",
+    "new-order", "payment", "order-status", "delivery", "stock-level"
+};
+
+struct Options {
+    std::string host = "127.0.0.1";
+    uint16_t port = DEFAULT_PORT;
+    std::string workload = "ycsb-a";
+    int threads = 4;
+    uint64_t records = 10000;           // YCSB rows loaded
+    int fields = 10;                    // YCSB columns besides the key
+    int fieldLength = 100;
+    int warehouses = 4;                 // TPC-C scale
+    double seconds = 10;
+    double warmup = 2;
+    uint64_t seed = 1;
+    bool load = true;
+    int priority = -1;                  // admission priority of the run's connections; -1 leaves the default
+};
+
+// ============================================================================
+// CONNECTION
+// ============================================================================
+
+class Connection {
+private:
+    SocketHandle socket;
+    bool connected;
+    
+public:
+    std::string error;
+    
+    Connection() : socket(0), connected(false) {}
+    ~Connection() { close(); }
+    Connection(const Connection&) = delete;
+    Connection& operator=(const Connection&) = delete;
+    
+    bool open(const Options& options) {
+        connected = connectSocket(options.host, options.port, socket);
+        if (!connected) {
+            error = "cannot connect to " + options.host + ":" + std::to_string(options.port);
+            return false;
+        }
+        std::string result;
+        return options.priority < 0 ||
+               request(MessageType::SET_PRIORITY, std::string(1, static_cast<char>(options.priority)), result);
+    }
+    
+    void close() {
+        if (!connected) return;
+        writeFrame(socket, MessageType::DISCONNECT, nullptr, 0);
+        closeSocket(socket);
+        connected = false;
+    }
+    
+    bool isOpen() const { return connected; }
+    
+    // False on an ERROR reply, with its text in error, and when the
+    // connection is lost, which also closes it
+    bool request(MessageType type, const std::string& payload, std::string& result) {
+        Message reply;
+        if (!connected || !writeFrame(socket, type, reinterpret_cast<const uint8_t*>(payload.data()), payload.size()) ||
+            !readFrame(socket, reply)) {
+            if (connected) closeSocket(socket);
+            connected = false;
+            error = "connection lost";
+            return false;
+        }
+        result.assign(reply.payload.begin(), reply.payload.end());
+        if (reply.type != MessageType::RESULT) {
+            error = result;
+            return false;
+        }
+        return true;
+    }
+    
+    bool query(const std::string& sql, std::string& result) { return request(MessageType::QUERY, sql, result); }
+    
+    bool query(const std::string& sql) {
+        std::string result;
+        return query(sql, result);
+    }
+    
+    bool begin() {
+        std::string result;
+        return request(MessageType::BEGIN_TXN, "", result);
+    }
+    
+    bool commit() {
+        std::string result;
+        return request(MessageType::COMMIT_TXN, "", result);
+    }
+    
+    // Keeps the error that made the transaction give up
+    void rollback() {
+        std::string result, cause = error;
+        request(MessageType::ROLLBACK_TXN, "", result);
+        error = cause;
+    }
+};
+
+// Every value of a numeric column in a JSON result, in row order
+static std::vector<int64_t> integers(const std::string& json, const std::string& column) {
+    std::vector<int64_t> values;
+    std::string key = "\"" + column + "\":";
+    for (size_t at = json.find(key); at != std::string::npos; at = json.find(key, at + key.size())) {
+        const char* text = json.c_str() + at + key.size();
+        if (*text == '-' || (*text >= '0' && *text <= '9')) {
+            values.push_back(static_cast<int64_t>(strtod(text, nullptr)));
+        }
+    }
+    return values;
+}
+
+static double number(const std::string& json, const std::string& column) {
+    std::string key = "\"" + column + "\":";
+    size_t at = json.find(key);
+    return at == std::string::npos ? 0 : strtod(json.c_str() + at + key.size(), nullptr);
+}
+
+// ============================================================================
+// LATENCY RECORDING
+// ============================================================================
+
+struct OperationStats {
+    uint64_t count = 0;
+    uint64_t errors = 0;
+    uint64_t sumNanos = 0;
+    uint64_t maxNanos = 0;
+    std::vector<uint64_t> buckets;
+    
+    OperationStats() : buckets(HISTOGRAM_BUCKETS, 0) {}
+    
+    void record(uint64_t nanos) {
+        count++;
+        sumNanos += nanos;
+        maxNanos = std::max(maxNanos, nanos);
+        buckets[Metrics::bucketOf(nanos)]++;
+    }
+    
+    void merge(const OperationStats& other) {
+        count += other.count;
+        errors += other.errors;
+        sumNanos += other.sumNanos;
+        maxNanos = std::max(maxNanos, other.maxNanos);
+        for (size_t b = 0; b < buckets.size(); b++) buckets[b] += other.buckets[b];
+    }
+};
+
+static void appendMicros(std::string& out, const char* name, double nanos) {
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), "\"%s\":%.1f", name, nanos / 1000.0);
+    out += buffer;
+}
+
+// Percentiles are bucket limits, so the largest can overshoot the maximum
+static void appendLatency(std::string& out, const OperationStats& stats) {
+    HistogramSnapshot histogram;
+    histogram.count = stats.count;
+    histogram.sum = stats.sumNanos;
+    histogram.buckets = stats.buckets;
+    
+    out += "{\"count\":" + std::to_string(stats.count) + ",";
+    appendMicros(out, "mean", stats.count ? static_cast<double>(stats.sumNanos) / stats.count : 0);
+    out += ",";
+    appendMicros(out, "p50", static_cast<double>(std::min(histogram.percentile(0.50), stats.maxNanos)));
+    out += ",";
+    appendMicros(out, "p99", static_cast<double>(std::min(histogram.percentile(0.99), stats.maxNanos)));
+    out += ",";
+    appendMicros(out, "p999", static_cast<double>(std::min(histogram.percentile(0.999), stats.maxNanos)));
+    out += ",";
+    appendMicros(out, "max", static_cast<double>(stats.maxNanos));
+    out += "}";
+}
+
+// ============================================================================
+// KEY DISTRIBUTIONS
+// ============================================================================
+
+// YCSB's zipfian generator (Gray et al., "Quickly generating billion-record
+// synthetic databases"): item 0 is the most popular, with theta 0.99
+class Zipfian {
+private:
+    uint64_t items;
+    double theta, alpha, zetan, eta, half;
+    
+    static double zeta(uint64_t n, double theta) {
+        double sum = 0;
+        for (uint64_t i = 1; i <= n; i++) sum += 1.0 / std::pow(static_cast<double>(i), theta);
+        return sum;
+    }
+    
+public:
+    explicit Zipfian(uint64_t items, double theta = 0.99) : items(std::max<uint64_t>(items, 2)), theta(theta) {
+        zetan = zeta(this->items, theta);
+        alpha = 1.0 / (1.0 - theta);
+        eta = (1.0 - std::pow(2.0 / this->items, 1.0 - theta)) / (1.0 - zeta(2, theta) / zetan);
+        half = 1.0 + std::pow(0.5, theta);
+    }
+    
+    uint64_t next(std::mt19937_64& rng) const {
+        double u = std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+        double uz = u * zetan;
+        if (uz < 1.0) return 0;
+        if (uz < half) return 1;
+        uint64_t item = static_cast<uint64_t>(items * std::pow(eta * u - eta + 1.0, alpha));
+        return std::min(item, items - 1);
+    }
+};
+
+// Spreads the popular items over the key space, as YCSB's scrambled zipfian does
+static uint64_t scramble(uint64_t item, uint64_t items) {
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (int i = 0; i < 8; i++) {
+        hash ^= (item >> (i * 8)) & 0xFF;
+        hash *= 0x100000001B3ULL;
+    }
+    return hash % items;
+}
+
+// ============================================================================
+// WORKLOADS
+// ============================================================================
+
+// One thread's view of a run: its connection, random stream and counts
+struct Worker {
+    Connection connection;
+    std::mt19937_64 rng;
+    OperationStats stats[OPERATIONS];
+    int index;
+    
+    uint64_t uniform(uint64_t low, uint64_t high) {
+        return std::uniform_int_distribution<uint64_t>(low, high)(rng);
+    }
+};
+
+class Workload {
+public:
+    virtual ~Workload() = default;
+    
+    // Creates and fills the tables; rows is what was inserted
+    virtual bool load(const Options& options, uint64_t& rows, std::string& error) = 0;
+    // Runs one operation, which is recorded under op; false if it failed
+    virtual bool run(Worker& worker, Operation& op) = 0;
+};
+
+// Creates the tables from one connection and fills them from options.threads,
+// each inserting the rows fill produces for its share of parts
+static bool loadParallel(const Options& options, const std::vector<std::string>& schema, uint64_t parts,
+                         const std::function<uint64_t(Connection&, uint64_t, std::string&)>& fill,
+                         uint64_t& rows, std::string& error) {
+    Connection setup;
+    if (!setup.open(options)) {
+        error = setup.error;
+        return false;
+    }
+    for (const auto& statement : schema) {
+        if (!setup.query(statement)) {
+            error = statement + ": " + setup.error;
+            return false;
+        }
+    }
+    
+    std::atomic<uint64_t> nextPart(0), inserted(0);
+    std::mutex failure;
+    std::vector<std::thread> loaders;
+    for (int t = 0; t < options.threads; t++) {
+        loaders.emplace_back([&]() {
+            Connection connection;
+            if (!connection.open(options)) {
+                std::lock_guard<std::mutex> lock(failure);
+                error = connection.error;
+                return;
+            }
+            for (uint64_t part = nextPart++; part < parts; part = nextPart++) {
+                std::string cause;
+                uint64_t count = fill(connection, part, cause);
+                inserted += count;
+                if (!cause.empty()) {
+                    std::lock_guard<std::mutex> lock(failure);
+                    error = cause;
+                    return;
+                }
+            }
+        });
+    }
+    for (auto& loader : loaders) loader.join();
+    rows = inserted;
+    return error.empty();
+}
+
+// Gathers VALUES tuples into multi-row INSERTs of up to 200 rows
+class InsertBuilder {
+private:
+    Connection& connection;
+    std::string prefix, sql;
+    size_t pending;
+    
+public:
+    uint64_t rows;
+    std::string error;
+    
+    InsertBuilder(Connection& connection, const std::string& table)
+        : connection(connection), prefix("INSERT INTO " + table + " VALUES "), pending(0), rows(0) {}
+        
+    bool add(const std::string& tuple) {
+        sql += pending ? ", (" : prefix + "(";
+        sql += tuple;
+        sql += ")";
+        return ++pending < 200 || flush();
+    }
+    
+    bool flush() {
+        if (pending == 0) return error.empty();
+        if (connection.query(sql)) {
+            rows += pending;
+        } else if (error.empty()) {
+            error = prefix + "...: " + connection.error;
+        }
+        sql.clear();
+        pending = 0;
+        return error.empty();
+    }
+};
+
+// ----------------------------------------------------------------------------
+// YCSB
+// ----------------------------------------------------------------------------
+//
+// usertable holds ycsb_key and field0..fieldN-1 of random letters. The
+// workloads differ in their mix and in which keys they favour:
+//   A  50% read, 50% update                zipfian
+//   B  95% read, 5% update                 zipfian
+//   C  100% read                           zipfian
+//   D  95% read, 5% insert                 latest: recently inserted keys
+//   E  95% scan of 1-100 rows, 5% insert   zipfian start key
+//   F  50% read, 50% read-modify-write     zipfian, the write in a transaction
+
+class YCSB : public Workload {
+private:
+    const Options& options;
+    char kind;
+    Zipfian zipfian;
+    std::string letters;                // values are cut from here
+    std::atomic<uint64_t> nextKey;      // next key to insert
+    
+    uint64_t chooseKey(Worker& worker) {
+        uint64_t item = zipfian.next(worker.rng);
+        if (kind != 'd') return scramble(item, options.records);
+        uint64_t latest = nextKey.load() - 1;
+        return item > latest ? latest : latest - item;
+    }
+    
+    void appendValue(Worker& worker, std::string& sql) {
+        sql += "'";
+        sql.append(letters, worker.uniform(0, letters.size() - options.fieldLength), options.fieldLength);
+        sql += "'";
+    }
+    
+    std::string insertRow(std::mt19937_64& rng, uint64_t key) {
+        std::string row = std::to_string(key);
+        for (int f = 0; f < options.fields; f++) {
+            row += ", '";
+            size_t offset = std::uniform_int_distribution<size_t>(0, letters.size() - options.fieldLength)(rng);
+            row.append(letters, offset, options.fieldLength);
+            row += "'";
+        }
+        return row;
+    }
+    
+public:
+    YCSB(const Options& options, char kind)
+        : options(options), kind(kind), zipfian(options.records), nextKey(options.records) {
+        std::mt19937_64 rng(options.seed);
+        letters.resize(64 * 1024 + options.fieldLength);
+        for (char& c : letters) c = static_cast<char>('a' + rng() % 26);
+    }
+    
+    bool load(const Options& options, uint64_t& rows, std::string& error) override {
+        std::string create = "CREATE TABLE usertable (ycsb_key BIGINT PRIMARY KEY";
+        for (int f = 0; f < options.fields; f++) create += ", field" + std::to_string(f) + " TEXT";
+        create += ")";
+        
+        const uint64_t chunk = 1000;
+        uint64_t parts = (options.records + chunk - 1) / chunk;
+        return loadParallel(options, {"DROP TABLE IF EXISTS usertable", create}, parts,
+                            [&](Connection& connection, uint64_t part, std::string& cause) {
+            std::mt19937_64 rng(options.seed + part);
+            InsertBuilder insert(connection, "usertable");
+            uint64_t last = std::min(options.records, (part + 1) * chunk);
+            for (uint64_t key = part * chunk; key < last; key++) {
+                if (!insert.add(insertRow(rng, key))) break;
+            }
+            insert.flush();
+            cause = insert.error;
+            return insert.rows;
+        }, rows, error);
+    }
+    
+    bool run(Worker& worker, Operation& op) override {
+        Connection& connection = worker.connection;
+        uint64_t dice = worker.uniform(0, 99);
+        
+        switch (kind) {
+            case 'a': op = dice < 50 ? OP_READ : OP_UPDATE; break;
+            case 'b': op = dice < 95 ? OP_READ : OP_UPDATE; break;
+            case 'c': op = OP_READ; break;
+            case 'd': op = dice < 95 ? OP_READ : OP_INSERT; break;
+            case 'e': op = dice < 95 ? OP_SCAN : OP_INSERT; break;
+            default: op = dice < 50 ? OP_READ : OP_READ_MODIFY_WRITE; break;
+        }
+        
+        std::string sql, result;
+        switch (op) {
+            case OP_READ:
+                return connection.query("SELECT * FROM usertable WHERE ycsb_key = " +
+                                        std::to_string(chooseKey(worker)), result);
+            case OP_SCAN:
+                return connection.query("SELECT * FROM usertable WHERE ycsb_key >= " +
+                                        std::to_string(chooseKey(worker)) + " LIMIT " +
+                                        std::to_string(worker.uniform(1, 100)), result);
+            case OP_INSERT: {
+                uint64_t key = nextKey++;
+                return connection.query("INSERT INTO usertable VALUES (" + insertRow(worker.rng, key) + ")");
+            }
+            default:
+                break;
+        }
+        
+        uint64_t key = chooseKey(worker);
+        sql = "UPDATE usertable SET field" + std::to_string(worker.uniform(0, options.fields - 1)) + " = ";
+        appendValue(worker, sql);
+        sql += " WHERE ycsb_key = " + std::to_string(key);
+        if (op == OP_UPDATE) return connection.query(sql, result);
+        
+        if (!connection.begin()) return false;
+        if (!connection.query("SELECT * FROM usertable WHERE ycsb_key = " + std::to_string(key), result) ||
+            !connection.query(sql, result)) {
+            connection.rollback();
+            return false;
+        }
+        return connection.commit();
+    }
+};
+
+// ----------------------------------------------------------------------------
+// TPC-C-like
+// ----------------------------------------------------------------------------
+//
+// The five TPC-C transactions in their standard mix (45% New-Order, 43%
+// Payment, 4% each Order-Status, Delivery and Stock-Level) over a scaled-down
+// schema: 10 districts per warehouse, 100 customers per district, 1000 items
+// and 30 orders per district to start with, the last 9 of them undelivered.
+// The SQL subset has single-column keys and no arithmetic in SET, so
+// composite keys are packed into one BIGINT and every read-modify-write
+// reads the value inside the transaction and writes back a literal. Each
+// thread has a home warehouse, as a TPC-C terminal does.
+
+static const int DISTRICTS = 10;
+static const int CUSTOMERS = 100;
+static const int ITEMS = 1000;
+static const int INITIAL_ORDERS = 30;
+static const int UNDELIVERED = 9;
+static const int64_t ORDER_SPACE = 10000000;    // order ids per district
+static const int LINE_SPACE = 16;               // order lines per order
+
+class TPCC : public Workload {
+private:
+    const Options& options;
+    
+    static int64_t districtKey(int64_t w, int64_t d) { return w * DISTRICTS + d; }
+    static int64_t customerKey(int64_t district, int64_t c) { return district * CUSTOMERS + c; }
+    static int64_t orderKey(int64_t district, int64_t o) { return district * ORDER_SPACE + o; }
+    static int64_t stockKey(int64_t w, int64_t i) { return w * ITEMS + i; }
+    
+    // TPC-C's last names from three syllables; here about three customers
+    // of a district share each
+    static std::string lastName(int64_t c) {
+        static const char* SYLLABLES[10] = {"BAR", "OUGHT", "ABLE", "PRI", "PRES",
+                                            "ESE", "ANTI", "CALLY", "ATION", "EING"};
+        int64_t n = c / 3;
+        return std::string(SYLLABLES[n / 100 % 10]) + SYLLABLES[n / 10 % 10] + SYLLABLES[n % 10];
+    }
+    
+    static std::string money(double amount) {
+        char buffer[32];
+        snprintf(buffer, sizeof(buffer), "%.2f", amount);
+        return buffer;
+    }
+    
+    int homeWarehouse(Worker& worker) const { return worker.index % options.warehouses; }
+    
+    bool newOrder(Worker& worker) {
+        Connection& db = worker.connection;
+        int64_t w = homeWarehouse(worker);
+        int64_t district = districtKey(w, worker.uniform(0, DISTRICTS - 1));
+        int64_t customer = customerKey(district, worker.uniform(0, CUSTOMERS - 1));
+        int lines = static_cast<int>(worker.uniform(5, 10));
+        std::string result;
+        
+        if (!db.begin()) return false;
+        bool ok = db.query("SELECT w_ytd FROM warehouse WHERE w_id = " + std::to_string(w), result) &&
+                  db.query("SELECT c_balance FROM customer WHERE c_key = " + std::to_string(customer), result) &&
+                  db.query("SELECT d_next_o_id FROM district WHERE d_key = " + std::to_string(district), result);
+        int64_t order = ok ? static_cast<int64_t>(number(result, "d_next_o_id")) : 0;
+        ok = ok && order > 0 &&
+             db.query("UPDATE district SET d_next_o_id = " + std::to_string(order + 1) +
+                      " WHERE d_key = " + std::to_string(district)) &&
+             db.query("INSERT INTO orders VALUES (" + std::to_string(orderKey(district, order)) + ", " +
+                      std::to_string(district) + ", " + std::to_string(customer) + ", " +
+                      std::to_string(lines) + ", 0)") &&
+             db.query("INSERT INTO new_order VALUES (" + std::to_string(orderKey(district, order)) + ", " +
+                      std::to_string(district) + ")");
+                      
+        std::string orderLines;
+        for (int n = 0; ok && n < lines; n++) {
+            int64_t item = worker.uniform(0, ITEMS - 1);
+            int64_t stock = stockKey(w, item);
+            int64_t quantity = worker.uniform(1, 10);
+            ok = db.query("SELECT i_price FROM item WHERE i_id = " + std::to_string(item), result);
+            double price = number(result, "i_price");
+            ok = ok && db.query("SELECT s_quantity, s_order_cnt FROM stock WHERE s_key = " +
+                                std::to_string(stock), result);
+            int64_t left = static_cast<int64_t>(number(result, "s_quantity")) - quantity;
+            if (left < 10) left += 91;
+            ok = ok && db.query("UPDATE stock SET s_quantity = " + std::to_string(left) + ", s_order_cnt = " +
+                                std::to_string(static_cast<int64_t>(number(result, "s_order_cnt")) + 1) +
+                                " WHERE s_key = " + std::to_string(stock));
+            if (n) orderLines += ", ";
+            orderLines += "(" + std::to_string(orderKey(district, order) * LINE_SPACE + n) + ", " +
+                          std::to_string(orderKey(district, order)) + ", " + std::to_string(item) + ", " +
+                          std::to_string(quantity) + ", " + money(price * quantity) + ", 0)";
+        }
+        ok = ok && db.query("INSERT INTO order_line VALUES " + orderLines);
+        
+        if (!ok) {
+            db.rollback();
+            return false;
+        }
+        return db.commit();
+    }
+    
+    bool payment(Worker& worker) {
+        Connection& db = worker.connection;
+        int64_t w = homeWarehouse(worker);
+        int64_t district = districtKey(w, worker.uniform(0, DISTRICTS - 1));
+        double amount = worker.uniform(100, 500000) / 100.0;
+        std::string result;
+        
+        if (!db.begin()) return false;
+        bool ok = db.query("SELECT w_ytd FROM warehouse WHERE w_id = " + std::to_string(w), result) &&
+                  db.query("UPDATE warehouse SET w_ytd = " + money(number(result, "w_ytd") + amount) +
+                           " WHERE w_id = " + std::to_string(w)) &&
+                  db.query("SELECT d_ytd FROM district WHERE d_key = " + std::to_string(district), result) &&
+                  db.query("UPDATE district SET d_ytd = " + money(number(result, "d_ytd") + amount) +
+                           " WHERE d_key = " + std::to_string(district));
+                           
+        // 60% find the customer by last name and take the middle one
+        int64_t customer = customerKey(district, worker.uniform(0, CUSTOMERS - 1));
+        if (ok && worker.uniform(0, 99) < 60) {
+            ok = db.query("SELECT c_key FROM customer WHERE c_d_key = " + std::to_string(district) +
+                          " AND c_last = '" + lastName(customer % CUSTOMERS) + "' ORDER BY c_key", result);
+            std::vector<int64_t> found = integers(result, "c_key");
+            if (!found.empty()) customer = found[(found.size() - 1) / 2];
+        }
+        ok = ok && db.query("SELECT c_balance, c_payment_cnt FROM customer WHERE c_key = " +
+                            std::to_string(customer), result) &&
+             db.query("UPDATE customer SET c_balance = " + money(number(result, "c_balance") - amount) +
+                      ", c_payment_cnt = " + std::to_string(static_cast<int64_t>(number(result, "c_payment_cnt")) + 1) +
+                      " WHERE c_key = " + std::to_string(customer)) &&
+             db.query("INSERT INTO history (h_c_key, h_amount) VALUES (" + std::to_string(customer) + ", " +
+                      money(amount) + ")");
+                      
+        if (!ok) {
+            db.rollback();
+            return false;
+        }
+        return db.commit();
+    }
+    
+    bool orderStatus(Worker& worker) {
+        Connection& db = worker.connection;
+        int64_t district = districtKey(homeWarehouse(worker), worker.uniform(0, DISTRICTS - 1));
+        int64_t customer = customerKey(district, worker.uniform(0, CUSTOMERS - 1));
+        std::string result;
+        
+        if (!db.query("SELECT c_balance FROM customer WHERE c_key = " + std::to_string(customer), result) ||
+            !db.query("SELECT o_key, o_carrier_id FROM orders WHERE o_c_key = " + std::to_string(customer) +
+                      " ORDER BY o_key DESC LIMIT 1", result)) {
+            return false;
+        }
+        std::vector<int64_t> order = integers(result, "o_key");
+        return order.empty() ||
+               db.query("SELECT * FROM order_line WHERE ol_o_key = " + std::to_string(order[0]), result);
+    }
+    
+    // Delivers the oldest undelivered order of each district in one transaction
+    bool delivery(Worker& worker) {
+        Connection& db = worker.connection;
+        int64_t w = homeWarehouse(worker);
+        int64_t carrier = worker.uniform(1, 10);
+        std::string result;
+        
+        if (!db.begin()) return false;
+        bool ok = true;
+        for (int d = 0; ok && d < DISTRICTS; d++) {
+            int64_t district = districtKey(w, d);
+            ok = db.query("SELECT no_key FROM new_order WHERE no_d_key = " + std::to_string(district) +
+                          " ORDER BY no_key LIMIT 1", result);
+            std::vector<int64_t> oldest = integers(result, "no_key");
+            if (!ok || oldest.empty()) continue;
+            std::string order = std::to_string(oldest[0]);
+            ok = db.query("DELETE FROM new_order WHERE no_key = " + order) &&
+                 db.query("SELECT o_c_key FROM orders WHERE o_key = " + order, result);
+            std::string customer = std::to_string(static_cast<int64_t>(number(result, "o_c_key")));
+            ok = ok && db.query("UPDATE orders SET o_carrier_id = " + std::to_string(carrier) +
+                                " WHERE o_key = " + order) &&
+                 db.query("SELECT SUM(ol_amount) FROM order_line WHERE ol_o_key = " + order, result);
+            double total = number(result, "sum(ol_amount)");
+            ok = ok && db.query("UPDATE order_line SET ol_delivery_d = " + std::to_string(time(nullptr)) +
+                                " WHERE ol_o_key = " + order) &&
+                 db.query("SELECT c_balance FROM customer WHERE c_key = " + customer, result) &&
+                 db.query("UPDATE customer SET c_balance = " + money(number(result, "c_balance") + total) +
+                          " WHERE c_key = " + customer);
+        }
+        
+        if (!ok) {
+            db.rollback();
+            return false;
+        }
+        return db.commit();
+    }
+    
+    // Counts the recently ordered items whose stock is below a threshold
+    bool stockLevel(Worker& worker) {
+        Connection& db = worker.connection;
+        int64_t w = homeWarehouse(worker);
+        int64_t district = districtKey(w, worker.uniform(0, DISTRICTS - 1));
+        int64_t threshold = worker.uniform(10, 20);
+        std::string result;
+        
+        if (!db.query("SELECT d_next_o_id FROM district WHERE d_key = " + std::to_string(district), result)) {
+            return false;
+        }
+        int64_t next = static_cast<int64_t>(number(result, "d_next_o_id"));
+        if (!db.query("SELECT ol_i_id FROM order_line WHERE ol_o_key >= " +
+                      std::to_string(orderKey(district, std::max<int64_t>(1, next - 20))) +
+                      " AND ol_o_key < " + std::to_string(orderKey(district, next)), result)) {
+            return false;
+        }
+        
+        std::vector<int64_t> ordered = integers(result, "ol_i_id");
+        std::set<int64_t> items(ordered.begin(), ordered.end());
+        for (int64_t item : items) {
+            if (!db.query("SELECT s_quantity FROM stock WHERE s_key = " + std::to_string(stockKey(w, item)) +
+                          " AND s_quantity < " + std::to_string(threshold), result)) {
+                return false;
+            }
+        }
+        return true;
+    }
+    
+    uint64_t fillWarehouse(Connection& connection, int64_t w, std::string& error) {
+        std::mt19937_64 rng(options.seed + w);
+        auto random = [&](int64_t low, int64_t high) {
+            return std::uniform_int_distribution<int64_t>(low, high)(rng);
+        };
+        InsertBuilder warehouse(connection, "warehouse"), district(connection, "district"),
+            customer(connection, "customer"), stock(connection, "stock"), orders(connection, "orders"),
+            newOrder(connection, "new_order"), orderLine(connection, "order_line");
+        std::vector<InsertBuilder*> tables = {&warehouse, &district, &customer, &stock, &orders, &newOrder, &orderLine};
+        
+        warehouse.add(std::to_string(w) + ", 300000.00");
+        for (int64_t i = 0; i < ITEMS; i++) {
+            stock.add(std::to_string(stockKey(w, i)) + ", " + std::to_string(random(10, 100)) + ", 0");
+        }
+        for (int64_t d = 0; d < DISTRICTS; d++) {
+            int64_t dk = districtKey(w, d);
+            district.add(std::to_string(dk) + ", " + std::to_string(INITIAL_ORDERS + 1) + ", 30000.00");
+            for (int64_t c = 0; c < CUSTOMERS; c++) {
+                customer.add(std::to_string(customerKey(dk, c)) + ", " + std::to_string(dk) + ", '" + lastName(c) +
+                             "', -10.00, 1");
+            }
+            for (int64_t o = 1; o <= INITIAL_ORDERS; o++) {
+                int64_t key = orderKey(dk, o);
+                bool delivered = o <= INITIAL_ORDERS - UNDELIVERED;
+                int64_t lines = random(5, 10);
+                orders.add(std::to_string(key) + ", " + std::to_string(dk) + ", " +
+                           std::to_string(customerKey(dk, random(0, CUSTOMERS - 1))) + ", " + std::to_string(lines) +
+                           ", " + std::to_string(delivered ? random(1, 10) : 0));
+                if (!delivered) newOrder.add(std::to_string(key) + ", " + std::to_string(dk));
+                for (int64_t n = 0; n < lines; n++) {
+                    orderLine.add(std::to_string(key * LINE_SPACE + n) + ", " + std::to_string(key) + ", " +
+                                  std::to_string(random(0, ITEMS - 1)) + ", 5, " +
+                                  money(delivered ? 0 : random(1, 999999) / 100.0) + ", " +
+                                  std::to_string(delivered ? 1700000000 : 0));
+                }
+            }
+        }
+        
+        uint64_t rows = 0;
+        for (InsertBuilder* table : tables) {
+            table->flush();
+            rows += table->rows;
+            if (error.empty()) error = table->error;
+        }
+        return rows;
+    }
+    
+public:
+    explicit TPCC(const Options& options) : options(options) {}
+    
+    bool load(const Options& options, uint64_t& rows, std::string& error) override {
+        std::vector<std::string> schema;
+        for (const char* table : {"warehouse", "district", "customer", "history", "item", "stock", "orders",
+                                  "new_order", "order_line"}) {
+            schema.push_back(std::string("DROP TABLE IF EXISTS ") + table);
+        }
+        schema.push_back("CREATE TABLE warehouse (w_id BIGINT PRIMARY KEY, w_ytd DOUBLE)");
+        schema.push_back("CREATE TABLE district (d_key BIGINT PRIMARY KEY, d_next_o_id BIGINT, d_ytd DOUBLE)");
+        schema.push_back("CREATE TABLE customer (c_key BIGINT PRIMARY KEY, c_d_key BIGINT, c_last TEXT, "
+                         "c_balance DOUBLE, c_payment_cnt BIGINT)");
+        schema.push_back("CREATE TABLE history (h_id BIGINT PRIMARY KEY, h_c_key BIGINT, h_amount DOUBLE)");
+        schema.push_back("CREATE TABLE item (i_id BIGINT PRIMARY KEY, i_name TEXT, i_price DOUBLE)");
+        schema.push_back("CREATE TABLE stock (s_key BIGINT PRIMARY KEY, s_quantity BIGINT, s_order_cnt BIGINT)");
+        schema.push_back("CREATE TABLE orders (o_key BIGINT PRIMARY KEY, o_d_key BIGINT, o_c_key BIGINT, "
+                         "o_ol_cnt BIGINT, o_carrier_id BIGINT)");
+        schema.push_back("CREATE TABLE new_order (no_key BIGINT PRIMARY KEY, no_d_key BIGINT)");
+        schema.push_back("CREATE TABLE order_line (ol_key BIGINT PRIMARY KEY, ol_o_key BIGINT, ol_i_id BIGINT, "
+                         "ol_quantity BIGINT, ol_amount DOUBLE, ol_delivery_d BIGINT)");
+        schema.push_back("CREATE INDEX customer_district ON customer (c_d_key)");
+        schema.push_back("CREATE INDEX orders_customer ON orders (o_c_key)");
+        schema.push_back("CREATE INDEX new_order_district ON new_order (no_d_key)");
+        schema.push_back("CREATE INDEX order_line_order ON order_line (ol_o_key)");
+        
+        // Part 0 is the item table, the rest one warehouse each
+        return loadParallel(options, schema, options.warehouses + 1,
+                            [&](Connection& connection, uint64_t part, std::string& cause) -> uint64_t {
+            if (part > 0) return fillWarehouse(connection, static_cast<int64_t>(part) - 1, cause);
+            std::mt19937_64 rng(options.seed);
+            InsertBuilder item(connection, "item");
+            for (int64_t i = 0; i < ITEMS; i++) {
+                item.add(std::to_string(i) + ", 'item-" + std::to_string(i) + "', " +
+                         money(std::uniform_int_distribution<int>(100, 10000)(rng) / 100.0));
+            }
+            item.flush();
+            cause = item.error;
+            return item.rows;
+        }, rows, error);
+    }
+    
+    bool run(Worker& worker, Operation& op) override {
+        uint64_t dice = worker.uniform(0, 99);
+        if (dice < 45) {
+            op = OP_NEW_ORDER;
+            return newOrder(worker);
+        }
+        if (dice < 88) {
+            op = OP_PAYMENT;
+            return payment(worker);
+        }
+        if (dice < 92) {
+            op = OP_ORDER_STATUS;
+            return orderStatus(worker);
+        }
+        if (dice < 96) {
+            op = OP_DELIVERY;
+            return delivery(worker);
+        }
+        op = OP_STOCK_LEVEL;
+        return stockLevel(worker);
+    }
+};
+
+// ============================================================================
+// RUN
+// ============================================================================
+
+static std::unique_ptr<Workload> makeWorkload(const Options& options) {
+    if (options.workload == "tpcc") return std::unique_ptr<Workload>(new TPCC(options));
+    if (options.workload.size() == 6 && options.workload.compare(0, 5, "ycsb-") == 0 &&
+        options.workload[5] >= 'a' && options.workload[5] <= 'f') {
+        return std::unique_ptr<Workload>(new YCSB(options, options.workload[5]));
+    }
+    return nullptr;
+}
+
+static std::string decimal(double value, const char* format = "%.1f") {
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), format, value);
+    return buffer;
+}
+
+static int run(const Options& options) {
+    std::unique_ptr<Workload> workload = makeWorkload(options);
+    if (!workload) {
+        std::cerr << "unknown workload " << options.workload << ": use ycsb-a .. ycsb-f or tpcc\n";
+        return 1;
+    }
+    
+    uint64_t loaded = 0;
+    double loadSeconds = 0;
+    if (options.load) {
+        std::cerr << "loading " << options.workload << "...\n";
+        std::string error;
+        auto started = std::chrono::steady_clock::now();
+        if (!workload->load(options, loaded, error)) {
+            std::cerr << "load failed: " << error << "\n";
+            return 1;
+        }
+        loadSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    }
+    
+    std::vector<std::unique_ptr<Worker>> workers;
+    for (int t = 0; t < options.threads; t++) {
+        workers.emplace_back(new Worker());
+        workers.back()->index = t;
+        workers.back()->rng.seed(options.seed * 1000003 + t);
+        if (!workers.back()->connection.open(options)) {
+            std::cerr << workers.back()->connection.error << "\n";
+            return 1;
+        }
+    }
+    
+    std::cerr << "running " << options.workload << " on " << options.threads << " threads for "
+              << options.warmup << " s warmup + " << options.seconds << " s...\n";
+    auto start = std::chrono::steady_clock::now();
+    auto measured = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(options.warmup));
+    auto deadline = measured + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(options.seconds));
+    std::atomic<int> lost(0);
+    std::vector<std::thread> threads;
+    for (auto& worker : workers) {
+        threads.emplace_back([&, w = worker.get()]() {
+            for (;;) {
+                auto began = std::chrono::steady_clock::now();
+                if (began >= deadline) break;
+                Operation op = OP_READ;
+                bool ok = workload->run(*w, op);
+                auto ended = std::chrono::steady_clock::now();
+                if (began >= measured && ended <= deadline) {
+                    w->stats[op].record(std::chrono::duration_cast<std::chrono::nanoseconds>(ended - began).count());
+                    w->stats[op].errors += !ok;
+                }
+                if (!w->connection.isOpen()) {
+                    lost++;
+                    break;
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) thread.join();
+    
+    OperationStats total, byOperation[OPERATIONS];
+    for (auto& worker : workers) {
+        for (int op = 0; op < OPERATIONS; op++) {
+            byOperation[op].merge(worker->stats[op]);
+            total.merge(worker->stats[op]);
+        }
+    }
+    
+    std::string json = "{\"workload\":\"" + options.workload + "\",\"threads\":" + std::to_string(options.threads);
+    if (options.workload == "tpcc") {
+        json += ",\"warehouses\":" + std::to_string(options.warehouses);
+    } else {
+        json += ",\"records\":" + std::to_string(options.records) + ",\"fields\":" + std::to_string(options.fields) +
+                ",\"fieldLength\":" + std::to_string(options.fieldLength);
+    }
+    if (options.priority >= 0) {
+        json += std::string(",\"priority\":\"") + priorityName(static_cast<Priority>(options.priority)) + "\"";
+    }
+    json += ",\"seconds\":" + decimal(options.seconds) + ",\"warmupSeconds\":" + decimal(options.warmup) +
+            ",\"seed\":" + std::to_string(options.seed);
+    if (options.load) {
+        json += ",\"load\":{\"rows\":" + std::to_string(loaded) + ",\"seconds\":" + decimal(loadSeconds, "%.3f") +
+                ",\"rowsPerSecond\":" + decimal(loadSeconds > 0 ? loaded / loadSeconds : 0) + "}";
+    }
+    json += ",\"operations\":" + std::to_string(total.count) + ",\"errors\":" + std::to_string(total.errors) +
+            ",\"lostConnections\":" + std::to_string(lost.load()) +
+            ",\"throughput\":" + decimal(total.count / options.seconds);
+    if (options.workload == "tpcc") {
+        json += ",\"newOrdersPerMinute\":" +
+                decimal((byOperation[OP_NEW_ORDER].count - byOperation[OP_NEW_ORDER].errors) * 60.0 / options.seconds);
+    }
+    json += ",\"latencyMicros\":";
+    appendLatency(json, total);
+    json += ",\"byOperation\":{";
+    bool first = true;
+    for (int op = 0; op < OPERATIONS; op++) {
+        if (byOperation[op].count == 0) continue;
+        if (!first) json += ",";
+        first = false;
+        json += "\"" + std::string(OPERATION_NAMES[op]) + "\":{\"count\":" + std::to_string(byOperation[op].count) +
+                ",\"errors\":" + std::to_string(byOperation[op].errors) +
+                ",\"throughput\":" + decimal(byOperation[op].count / options.seconds) + ",\"latencyMicros\":";
+        appendLatency(json, byOperation[op]);
+        json += "}";
+    }
+    json += "}}";
+    std::cout << json << std::endl;
+    return lost.load() ? 1 : 0;
+}
+
+} // namespace loadgen
+} // namespace hybriddb
+
+// ============================================================================
+// MAIN ENTRY POINT
+// ============================================================================
+
+static void usage() {
+    std::cerr << "usage: hybriddb-loadgen [-h host] [-p port] [-w ycsb-a..ycsb-f | tpcc] [-c threads]\n"
+                 "                        [-n records] [-f fields] [-l field length] [-W warehouses]\n"
+                 "                        [-t seconds] [-u warmup seconds] [-s seed] [-P high | normal | low] [-L]\n"
+                 "  -P  admission priority of the connections\n"
+                 "  -L  skip the load phase and run against the tables a previous run left\n";
+}
+
+int main(int argc, char* argv[]) {
+#ifdef PLATFORM_WINDOWS
+    WSADATA wsaData;
+    WSAStartup(MAKEWORD(2, 2), &wsaData);
+#endif
+    
+    hybriddb::loadgen::Options options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool value = i + 1 < argc;
+        if (arg == "-h" && value) {
+            options.host = argv[++i];
+        } else if (arg == "-p" && value) {
+            options.port = static_cast<uint16_t>(std::atoi(argv[++i]));
+        } else if (arg == "-w" && value) {
+            options.workload = argv[++i];
+        } else if (arg == "-c" && value) {
+            options.threads = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "-n" && value) {
+            options.records = std::max<uint64_t>(2, std::strtoull(argv[++i], nullptr, 10));
+        } else if (arg == "-f" && value) {
+            options.fields = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "-l" && value) {
+            options.fieldLength = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "-W" && value) {
+            options.warehouses = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "-t" && value) {
+            options.seconds = std::max(0.1, std::strtod(argv[++i], nullptr));
+        } else if (arg == "-u" && value) {
+            options.warmup = std::max(0.0, std::strtod(argv[++i], nullptr));
+        } else if (arg == "-s" && value) {
+            options.seed = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "-P" && value) {
+            std::string priority = argv[++i];
+            options.priority = priority == "high" ? 0 : priority == "normal" ? 1 : priority == "low" ? 2 : -1;
+            if (options.priority < 0) {
+                usage();
+                return 1;
+            }
+        } else if (arg == "-L") {
+            options.load = false;
+        } else {
+            usage();
+            return 1;
+        }
+    }
+    
+    return hybriddb::loadgen::run(options);
+}
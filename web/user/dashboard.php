@@ -9,6 +9,18 @@ if (!isset($_SESSION['user_id'])) {
 
 $db = new HybridDB('localhost', 5432);
 $username = $_SESSION['username'];
+
+// User search runs on the server's full-text index; only the best matches come back
+$search = trim($_GET['q'] ?? '');
+$found = [];
+if ($search !== '') {
+    try {
+        $found = $db->query("SELECT id, data FROM users WHERE MATCH(data.username, " .
+                            HybridDB::quote($search) . ") LIMIT 20");
+    } catch (Exception $e) {
+        $searchError = $e->getMessage();
+    }
+}
 ?>
 <!DOCTYPE html>
 <html lang="en">
@@ -204,6 +216,31 @@ $username = $_SESSION['username'];
             </table>
         </div>
 
+        <div class="card">
+            <h2>Find Users</h2>
+            <form method="GET" style="margin-bottom: 20px;">
+                <input type="text" name="q" value="<?php echo htmlspecialchars($search); ?>"
+                    placeholder="Words from a username" style="padding: 10px; width: 300px;">
+                <button type="submit" class="btn btn-primary">Search</button>
+            </form>
+            <?php if (isset($searchError)): ?>
+                <p><?php echo htmlspecialchars($searchError); ?></p>
+            <?php elseif ($search !== ''): ?>
+                <table>
+                    <tr>
+                        <th>User ID</th>
+                        <th>Username</th>
+                    </tr>
+                    <?php foreach ($found as $user): ?>
+                        <tr>
+                            <td><?php echo $user['id']; ?></td>
+                            <td><?php echo htmlspecialchars($user['data']['username']); ?></td>
+                        </tr>
+                    <?php endforeach; ?>
+                </table>
+            <?php endif; ?>
+        </div>
+
         <div class="card">
             <h2>About HybridDB</h2>
             <p><strong>Features:</strong></p>
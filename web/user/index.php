@@ -12,15 +12,16 @@ require_once '../../client-libs/php/HybridDB.php';
 // Initialize HybridDB connection
 $db = new HybridDB('localhost', 5432);
 
-// Create users table if not exists
+// Users are documents; username and email are looked up through path indexes,
+// and the dashboard's user search goes through a full-text index on usernames
 try {
-    $db->query("CREATE TABLE IF NOT EXISTS users (
+    $db->query("CREATE DOCUMENT TABLE IF NOT EXISTS users (
         id INTEGER PRIMARY KEY,
-        username STRING NOT NULL,
-        password STRING NOT NULL,
-        email STRING NOT NULL,
-        created_at TIMESTAMP
+        data JSON NOT NULL
     )");
+    $db->query("CREATE UNIQUE INDEX IF NOT EXISTS users_username ON users (data.username)");
+    $db->query("CREATE UNIQUE INDEX IF NOT EXISTS users_email ON users (data.email)");
+    $db->query("CREATE FULLTEXT INDEX IF NOT EXISTS users_search ON users (data.username)");
 } catch (Exception $e) {
     // Table already exists
 }
@@ -36,10 +37,13 @@ if ($_SERVER['REQUEST_METHOD'] === 'POST' && isset($_POST['register'])) {
 
         try {
             $db->insert('users', [
-                'username' => $username,
-                'password' => $passwordHash,
-                'email' => $email,
-                'created_at' => time()
+                'data' => json_encode([
+                    'username' => $username,
+                    'password' => $passwordHash,
+                    'email' => $email,
+                    'created_at' => date('Y-m-d H:i:s'),
+                    'role' => 'user'
+                ])
             ]);
 
             $success = "Registration successful! Please login.";
@@ -56,11 +60,11 @@ if ($_SERVER['REQUEST_METHOD'] === 'POST' && isset($_POST['login'])) {
 
     if ($username && $password) {
         try {
-            $users = $db->select('users', "username = '$username'");
+            $users = $db->select('users', "data.username = " . HybridDB::quote($username));
 
-            if (!empty($users) && password_verify($password, $users[0]['password'])) {
+            if (!empty($users) && password_verify($password, $users[0]['data']['password'])) {
                 $_SESSION['user_id'] = $users[0]['id'];
-                $_SESSION['username'] = $users[0]['username'];
+                $_SESSION['username'] = $users[0]['data']['username'];
                 header('Location: dashboard.php');
                 exit;
             } else {